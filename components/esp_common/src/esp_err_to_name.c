@@ -151,6 +151,9 @@ static const esp_err_msg_t esp_err_msg_table[] = {
 #   ifdef      ESP_ERR_NVS_PART_NOT_FOUND
     ERR_TBL_IT(ESP_ERR_NVS_PART_NOT_FOUND),                 /*  4367 0x110f Partition with specified name is not found
                                                                             in the partition table */
+#   endif
+#   ifdef      ESP_ERR_NVS_BATCH_ACTIVE
+    ERR_TBL_IT(ESP_ERR_NVS_BATCH_ACTIVE),                   /*  4368 0x1110 A batch is in progress on the partition */
 #   endif
     // components/app_update/include/esp_ota_ops.h
 #   ifdef      ESP_ERR_OTA_BASE
@@ -81,7 +81,11 @@ esp_err_t esp_event_loop_create_default()
         .task_name = "sys_evt",
         .task_stack_size = ESP_TASKD_EVENT_STACK,
         .task_priority = ESP_TASKD_EVENT_PRIO,
-        .task_core_id = 0
+        .task_core_id = 0,
+        .data_pool_blocks = CONFIG_ESP_EVENT_DEFAULT_LOOP_DATA_POOL_BLOCKS,
+#if CONFIG_ESP_EVENT_DEFAULT_LOOP_DATA_POOL_BLOCKS
+        .data_pool_block_size = CONFIG_ESP_EVENT_DEFAULT_LOOP_DATA_POOL_BLOCK_SIZE,
+#endif
     };
 
     esp_err_t err;
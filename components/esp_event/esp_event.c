@@ -32,6 +32,8 @@
 #ifdef CONFIG_ESP_EVENT_LOOP_PROFILING
 // LOOP @<address, name> rx:<recieved events no.> dr:<dropped events no.>
 #define LOOP_DUMP_FORMAT              "LOOP @%p,%s rx:%u dr:%u\n"
+ // data pool size:<block size> blk:<blocks> used:<blocks used> peak:<most blocks used> alloc:<blocks taken> ex:<posts without free block>
+#define POOL_DUMP_FORMAT              "  POOL size:%u blk:%u used:%u peak:%u alloc:%u ex:%u\n"
  // handler @<address> ev:<base, id> inv:<times invoked> time:<runtime>
 #define HANDLER_DUMP_FORMAT           "  HANDLER @%p ev:%s,%s inv:%u time:%lld us\n"
 
@@ -97,7 +99,7 @@ static int esp_event_dump_prepare()
 
     // Reserve slightly more memory than computed
     int allowance = 3;
-    int size = (((loops + allowance) * (sizeof(LOOP_DUMP_FORMAT) + 10 + 20 + 2 * 11)) +
+    int size = (((loops + allowance) * (sizeof(LOOP_DUMP_FORMAT) + 10 + 20 + 2 * 11 + sizeof(POOL_DUMP_FORMAT) + 6 * 11)) +
                         ((handlers + allowance) * (sizeof(HANDLER_DUMP_FORMAT) + 10 + 2 * 20 + 11 + 20)));
 
     return size;
@@ -122,30 +124,24 @@ static void esp_event_loop_run_task(void* args)
     vTaskSuspend(NULL);
 }
 
-static void handler_execute(esp_event_loop_instance_t* loop, esp_event_handler_instance_t *handler, esp_event_post_instance_t post)
+static void handler_execute(esp_event_loop_instance_t* loop, esp_event_handler_instance_t *handler, const esp_event_post_instance_t* post)
 {
-    ESP_LOGD(TAG, "running post %s:%d with handler %p on loop %p", post.base, post.id, handler->handler, loop);
+    ESP_LOGD(TAG, "running post %s:%d with handler %p on loop %p", post->base, post->id, handler->handler, loop);
 
 #ifdef CONFIG_ESP_EVENT_LOOP_PROFILING
     int64_t start, diff;
     start = esp_timer_get_time();
 #endif
     // Execute the handler
-#if CONFIG_ESP_EVENT_POST_FROM_ISR
     void* data_ptr = NULL;
 
-    if (post.data_set) {
-        if (post.data_allocated) {
-            data_ptr = post.data.ptr;
-        } else {
-            data_ptr = &post.data.val;
-        }
+    if (post->data_type == ESP_EVENT_POST_DATA_INLINE) {
+        data_ptr = (void*) post->data.val;
+    } else if (post->data_type != ESP_EVENT_POST_DATA_NONE) {
+        data_ptr = post->data.ptr;
     }
 
-    (*(handler->handler))(handler->arg, post.base, post.id, data_ptr);
-#else
-    (*(handler->handler))(handler->arg, post.base, post.id, post.data);
-#endif
+    (*(handler->handler))(handler->arg, post->base, post->id, data_ptr);
 
 #ifdef CONFIG_ESP_EVENT_LOOP_PROFILING
     diff = esp_timer_get_time() - start;
@@ -293,12 +289,17 @@ static esp_err_t loop_node_add_handler(esp_event_loop_node_t* loop_node, esp_eve
     }
 }
 
-static esp_err_t handler_instances_remove(esp_event_handler_instances_t* handlers, esp_event_handler_t handler)
+static esp_err_t handler_instances_remove(esp_event_handler_instances_t* handlers, esp_event_handler_t handler, bool defer)
 {
     esp_event_handler_instance_t *it, *temp;
 
     SLIST_FOREACH_SAFE(it, handlers, next, temp) {
         if (it->handler == handler) {
+            if (defer) {
+                // Handlers are being executed, the instance may still be in use
+                it->handler = NULL;
+                return ESP_OK;
+            }
             SLIST_REMOVE(handlers, it, esp_event_handler_instance, next);
             free(it);
             return ESP_OK;
@@ -309,16 +310,16 @@ static esp_err_t handler_instances_remove(esp_event_handler_instances_t* handler
 }
 
 
-static esp_err_t base_node_remove_handler(esp_event_base_node_t* base_node, int32_t id, esp_event_handler_t handler)
+static esp_err_t base_node_remove_handler(esp_event_base_node_t* base_node, int32_t id, esp_event_handler_t handler, bool defer)
 {
     if (id == ESP_EVENT_ANY_ID) {
-        return handler_instances_remove(&(base_node->handlers), handler);
+        return handler_instances_remove(&(base_node->handlers), handler, defer);
     }
     else {
         esp_event_id_node_t *it, *temp;
         SLIST_FOREACH_SAFE(it, &(base_node->id_nodes), next, temp) {
             if (it->id == id) {
-                esp_err_t res = handler_instances_remove(&(it->handlers), handler);
+                esp_err_t res = handler_instances_remove(&(it->handlers), handler, defer);
 
                 if (res == ESP_OK) {
                     if (SLIST_EMPTY(&(it->handlers))) {
@@ -334,16 +335,16 @@ static esp_err_t base_node_remove_handler(esp_event_base_node_t* base_node, int3
     return ESP_ERR_NOT_FOUND;
 }
 
-static esp_err_t loop_node_remove_handler(esp_event_loop_node_t* loop_node, esp_event_base_t base, int32_t id, esp_event_handler_t handler)
+static esp_err_t loop_node_remove_handler(esp_event_loop_node_t* loop_node, esp_event_base_t base, int32_t id, esp_event_handler_t handler, bool defer)
 {
     if (base == esp_event_any_base && id == ESP_EVENT_ANY_ID) {
-        return handler_instances_remove(&(loop_node->handlers), handler);
+        return handler_instances_remove(&(loop_node->handlers), handler, defer);
     }
     else {
         esp_event_base_node_t *it, *temp;
         SLIST_FOREACH_SAFE(it, &(loop_node->base_nodes), next, temp) {
             if (it->base == base) {
-                esp_err_t res = base_node_remove_handler(it, id, handler);
+                esp_err_t res = base_node_remove_handler(it, id, handler, defer);
 
                 if (res == ESP_OK) {
                     if (SLIST_EMPTY(&(it->handlers)) && SLIST_EMPTY(&(it->id_nodes))) {
@@ -392,18 +393,375 @@ static void loop_node_remove_all_handler(esp_event_loop_node_t* loop_node)
     }
 }
 
-static void inline __attribute__((always_inline)) post_instance_delete(esp_event_post_instance_t* post)
+static void handler_instances_remove_unregistered(esp_event_handler_instances_t* handlers)
 {
-#if CONFIG_ESP_EVENT_POST_FROM_ISR
-    if (post->data_allocated && post->data.ptr) {
-        free(post->data.ptr);
+    esp_event_handler_instance_t *it, *temp;
+    SLIST_FOREACH_SAFE(it, handlers, next, temp) {
+        if (it->handler == NULL) {
+            SLIST_REMOVE(handlers, it, esp_event_handler_instance, next);
+            free(it);
+        }
     }
-#else
-    if (post->data) {
-        free(post->data);
+}
+
+// Remove the handlers unregistered while handlers were executed, and the nodes left empty
+static void loop_remove_unregistered_handlers(esp_event_loop_instance_t* loop)
+{
+    esp_event_loop_node_t *loop_node, *loop_temp;
+    esp_event_base_node_t *base_node, *base_temp;
+    esp_event_id_node_t *id_node, *id_temp;
+
+    SLIST_FOREACH_SAFE(loop_node, &(loop->loop_nodes), next, loop_temp) {
+        handler_instances_remove_unregistered(&(loop_node->handlers));
+
+        SLIST_FOREACH_SAFE(base_node, &(loop_node->base_nodes), next, base_temp) {
+            handler_instances_remove_unregistered(&(base_node->handlers));
+
+            SLIST_FOREACH_SAFE(id_node, &(base_node->id_nodes), next, id_temp) {
+                handler_instances_remove_unregistered(&(id_node->handlers));
+                if (SLIST_EMPTY(&(id_node->handlers))) {
+                    SLIST_REMOVE(&(base_node->id_nodes), id_node, esp_event_id_node, next);
+                    free(id_node);
+                }
+            }
+
+            if (SLIST_EMPTY(&(base_node->handlers)) && SLIST_EMPTY(&(base_node->id_nodes))) {
+                SLIST_REMOVE(&(loop_node->base_nodes), base_node, esp_event_base_node, next);
+                free(base_node);
+            }
+        }
+
+        if (SLIST_EMPTY(&(loop_node->handlers)) && SLIST_EMPTY(&(loop_node->base_nodes))) {
+            SLIST_REMOVE(&(loop->loop_nodes), loop_node, esp_event_loop_node, next);
+            free(loop_node);
+        }
     }
-#endif
-    memset(post, 0, sizeof(*post));
+}
+
+/*
+ * Search the handler lists for the handlers of an event, in execution order. No base node matches
+ * when base is NULL, and no id node when id is ESP_EVENT_ANY_ID. The handlers found are stored in
+ * handlers if it is not NULL, or executed if post is not NULL.
+ *
+ * Returns the number of handlers found.
+ */
+static size_t loop_find_handlers(esp_event_loop_instance_t* loop, esp_event_base_t base, int32_t id,
+                                 esp_event_handler_instance_t** handlers, esp_event_post_instance_t* post)
+{
+    esp_event_handler_instance_t *handler;
+    esp_event_loop_node_t *loop_node;
+    esp_event_base_node_t *base_node;
+    esp_event_id_node_t *id_node;
+    size_t count = 0;
+
+#define FOUND_HANDLER(h)    do { \
+                                if (handlers) { \
+                                    handlers[count] = (h); \
+                                } else if (post && (h)->handler) { \
+                                    handler_execute(loop, (h), post); \
+                                } \
+                                count++; \
+                            } while(0)
+
+    SLIST_FOREACH(loop_node, &(loop->loop_nodes), next) {
+        // Loop level handlers
+        SLIST_FOREACH(handler, &(loop_node->handlers), next) {
+            FOUND_HANDLER(handler);
+        }
+
+        SLIST_FOREACH(base_node, &(loop_node->base_nodes), next) {
+            if (base_node->base == base) {
+                // Base level handlers
+                SLIST_FOREACH(handler, &(base_node->handlers), next) {
+                    FOUND_HANDLER(handler);
+                }
+
+                SLIST_FOREACH(id_node, &(base_node->id_nodes), next) {
+                    if (id_node->id == id) {
+                        // Id level handlers
+                        SLIST_FOREACH(handler, &(id_node->handlers), next) {
+                            FOUND_HANDLER(handler);
+                        }
+                        // Skip to next base node
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+#undef FOUND_HANDLER
+
+    return count;
+}
+
+static inline uint32_t dispatch_index_hash(esp_event_base_t base, int32_t id)
+{
+    uint32_t hash = ((uint32_t)(uintptr_t)base ^ ((uint32_t)id * 0x9e3779b1U)) * 0x85ebca6bU;
+
+    return hash ^ (hash >> 16);
+}
+
+static esp_event_dispatch_entry_t* dispatch_index_find(const esp_event_dispatch_index_t* index, esp_event_base_t base, int32_t id)
+{
+    uint32_t i = dispatch_index_hash(base, id) & index->mask;
+
+    // The table is at most half full, so the probing ends at an unused entry
+    while (index->entries[i].base) {
+        if (index->entries[i].base == base && index->entries[i].id == id) {
+            return &(index->entries[i]);
+        }
+        i = (i + 1) & index->mask;
+    }
+
+    return NULL;
+}
+
+static void dispatch_index_insert(esp_event_dispatch_index_t* index, esp_event_base_t base, int32_t id)
+{
+    uint32_t i = dispatch_index_hash(base, id) & index->mask;
+
+    while (index->entries[i].base) {
+        if (index->entries[i].base == base && index->entries[i].id == id) {
+            return;
+        }
+        i = (i + 1) & index->mask;
+    }
+
+    index->entries[i].base = base;
+    index->entries[i].id = id;
+}
+
+static void dispatch_index_free(esp_event_dispatch_index_t* index)
+{
+    if (index) {
+        free(index->handlers);
+        free(index);
+    }
+}
+
+static esp_event_dispatch_index_t* dispatch_index_build(esp_event_loop_instance_t* loop)
+{
+    esp_event_loop_node_t *loop_node;
+    esp_event_base_node_t *base_node;
+    esp_event_id_node_t *id_node;
+    esp_event_dispatch_index_t* index;
+    size_t keys = 0, size = 2, total;
+
+    SLIST_FOREACH(loop_node, &(loop->loop_nodes), next) {
+        SLIST_FOREACH(base_node, &(loop_node->base_nodes), next) {
+            keys++;
+            SLIST_FOREACH(id_node, &(base_node->id_nodes), next) {
+                keys++;
+            }
+        }
+    }
+
+    while (size < 2 * keys) {
+        size <<= 1;
+    }
+
+    index = calloc(1, sizeof(*index) + size * sizeof(esp_event_dispatch_entry_t));
+    if (!index) {
+        return NULL;
+    }
+
+    index->mask = size - 1;
+    index->entries = (esp_event_dispatch_entry_t*) (index + 1);
+
+    // A base may have nodes in several loop nodes, its events get a single entry
+    SLIST_FOREACH(loop_node, &(loop->loop_nodes), next) {
+        SLIST_FOREACH(base_node, &(loop_node->base_nodes), next) {
+            dispatch_index_insert(index, base_node->base, ESP_EVENT_ANY_ID);
+            SLIST_FOREACH(id_node, &(base_node->id_nodes), next) {
+                dispatch_index_insert(index, base_node->base, id_node->id);
+            }
+        }
+    }
+
+    total = index->any.count = loop_find_handlers(loop, NULL, ESP_EVENT_ANY_ID, NULL, NULL);
+    for (size_t i = 0; i < size; i++) {
+        esp_event_dispatch_entry_t* entry = &(index->entries[i]);
+
+        if (entry->base) {
+            entry->count = loop_find_handlers(loop, entry->base, entry->id, NULL, NULL);
+            total += entry->count;
+        }
+    }
+
+    if (total > UINT16_MAX) {
+        goto on_err;
+    }
+
+    if (total) {
+        index->handlers = malloc(total * sizeof(esp_event_handler_instance_t*));
+        if (!index->handlers) {
+            goto on_err;
+        }
+    }
+
+    total = loop_find_handlers(loop, NULL, ESP_EVENT_ANY_ID, index->handlers, NULL);
+    for (size_t i = 0; i < size; i++) {
+        esp_event_dispatch_entry_t* entry = &(index->entries[i]);
+
+        if (entry->base) {
+            entry->first = total;
+            total += loop_find_handlers(loop, entry->base, entry->id, index->handlers + total, NULL);
+        }
+    }
+
+    return index;
+
+on_err:
+    dispatch_index_free(index);
+    return NULL;
+}
+
+/*
+ * Rebuild the dispatch index after the handlers changed. An index replaced while handlers are
+ * executed may still be in use, it is freed after the execution.
+ */
+static void loop_dispatch_index_update(esp_event_loop_instance_t* loop)
+{
+    esp_event_dispatch_index_t* old = loop->dispatch_index;
+
+    if (SLIST_EMPTY(&(loop->loop_nodes))) {
+        loop->dispatch_index = NULL;
+        loop->dispatch_index_stale = false;
+    } else {
+        loop->dispatch_index = dispatch_index_build(loop);
+        loop->dispatch_index_stale = loop->dispatch_index == NULL;
+        if (loop->dispatch_index_stale) {
+            ESP_LOGW(TAG, "alloc for dispatch index of loop %p failed", loop);
+        }
+    }
+
+    if (old) {
+        if (loop->dispatching) {
+            old->next_retired = loop->retired_indexes;
+            loop->retired_indexes = old;
+        } else {
+            dispatch_index_free(old);
+        }
+    }
+}
+
+// Execute the handlers of a post, returns whether there are any
+static bool loop_dispatch(esp_event_loop_instance_t* loop, esp_event_post_instance_t* post)
+{
+    const esp_event_dispatch_index_t* index;
+    const esp_event_dispatch_entry_t* entry;
+    bool exec = false;
+
+    if (loop->dispatch_index_stale) {
+        loop_dispatch_index_update(loop);
+    }
+
+    loop->dispatching = true;
+
+    index = loop->dispatch_index;
+    if (loop->dispatch_index_stale) {
+        exec = loop_find_handlers(loop, post->base, post->id, NULL, post) > 0;
+    } else if (index) {
+        entry = dispatch_index_find(index, post->base, post->id);
+        if (!entry) {
+            entry = dispatch_index_find(index, post->base, ESP_EVENT_ANY_ID);
+        }
+        if (!entry) {
+            entry = &(index->any);
+        }
+
+        for (size_t i = 0; i < entry->count; i++) {
+            esp_event_handler_instance_t* handler = index->handlers[entry->first + i];
+
+            // Skip the handlers unregistered by the handlers executed before
+            if (handler->handler) {
+                handler_execute(loop, handler, post);
+            }
+            exec = true;
+        }
+    }
+
+    loop->dispatching = false;
+
+    while (loop->retired_indexes) {
+        esp_event_dispatch_index_t* retired = loop->retired_indexes;
+
+        loop->retired_indexes = retired->next_retired;
+        dispatch_index_free(retired);
+    }
+
+    if (loop->handlers_removed) {
+        loop->handlers_removed = false;
+        loop_remove_unregistered_handlers(loop);
+        loop_dispatch_index_update(loop);
+    }
+
+    return exec;
+}
+
+/*
+ * Copy the event data into the post, a pool block or, unless posting from an ISR, a heap allocation.
+ * Data which fits into the post or a pool block never touches the heap.
+ */
+static esp_err_t post_instance_set_data(esp_event_loop_instance_t* loop, esp_event_post_instance_t* post,
+                                        const void* event_data, size_t event_data_size, bool from_isr)
+{
+    void* data;
+
+    if (event_data == NULL || event_data_size == 0) {
+        post->data_type = ESP_EVENT_POST_DATA_NONE;
+        return ESP_OK;
+    }
+
+    if (event_data_size <= sizeof(post->data.val)) {
+        memcpy(post->data.val, event_data, event_data_size);
+        post->data_type = ESP_EVENT_POST_DATA_INLINE;
+        return ESP_OK;
+    }
+
+    data = NULL;
+    if (loop->data_pool && event_data_size <= loop->data_pool_block_size) {
+        data = from_isr ? esp_mempool_alloc_from_isr(loop->data_pool) : esp_mempool_alloc(loop->data_pool);
+        if (data) {
+            post->data_type = ESP_EVENT_POST_DATA_POOL;
+        } else if (from_isr) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    if (data == NULL) {
+        if (from_isr) {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        // Make persistent copy of event data on heap.
+        data = malloc(event_data_size);
+        if (data == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        post->data_type = ESP_EVENT_POST_DATA_HEAP;
+    }
+
+    memcpy(data, event_data, event_data_size);
+    post->data.ptr = data;
+
+    return ESP_OK;
+}
+
+static void inline __attribute__((always_inline)) post_instance_delete(esp_event_loop_instance_t* loop, esp_event_post_instance_t* post,
+                                                                       bool from_isr)
+{
+    if (post->data_type == ESP_EVENT_POST_DATA_HEAP) {
+        free(post->data.ptr);
+    } else if (post->data_type == ESP_EVENT_POST_DATA_POOL) {
+        if (from_isr) {
+            esp_mempool_free_from_isr(loop->data_pool, post->data.ptr);
+        } else {
+            esp_mempool_free(loop->data_pool, post->data.ptr);
+        }
+    }
+    post->data_type = ESP_EVENT_POST_DATA_NONE;
 }
 
 /* ---------------------------- Public API --------------------------------- */
@@ -441,6 +799,17 @@ esp_err_t esp_event_loop_create(const esp_event_loop_args_t* event_loop_args, es
     }
 #endif
 
+    // Posted from ISRs too, so the pool is locked by masking interrupts
+    if (event_loop_args->data_pool_blocks > 0) {
+        loop->data_pool = esp_mempool_create(event_loop_args->data_pool_block_size, event_loop_args->data_pool_blocks,
+                                             MALLOC_CAP_8BIT, ESP_MEMPOOL_ISR_SAFE);
+        if (loop->data_pool == NULL) {
+            ESP_LOGE(TAG, "alloc for event data pool failed");
+            goto on_err;
+        }
+        loop->data_pool_block_size = event_loop_args->data_pool_block_size;
+    }
+
     SLIST_INIT(&(loop->loop_nodes));
 
     // Create the loop task if requested
@@ -492,17 +861,16 @@ on_err:
     }
 #endif
 
+    esp_mempool_delete(loop->data_pool);
     free(loop);
 
     return err;
 }
 
-// On event lookup performance: The library implements the event list as a linked list, which results to O(n)
-// lookup time. The test comparing this implementation to the O(lg n) performance of rbtrees
-// (https://github.com/freebsd/freebsd/blob/master/sys/sys/tree.h)
-// indicate that the difference is not that substantial, especially considering the additional
-// pointers per node of rbtrees. Code for the rbtree implementation of the event loop library is archived
-// in feature/esp_event_loop_library_rbtrees if needed.
+// On event lookup performance: The library keeps the registered handlers in linked lists. Searching them
+// for every post touched every loop, base and id node, so the handlers of every event are collected
+// into a dispatch index whenever they change, see dispatch_index_build(). A post costs a hash table
+// lookup and the execution of its handlers.
 esp_err_t esp_event_loop_run(esp_event_loop_handle_t event_loop, TickType_t ticks_to_run)
 {
     assert(event_loop);
@@ -524,47 +892,12 @@ esp_err_t esp_event_loop_run(esp_event_loop_handle_t event_loop, TickType_t tick
 
         loop->running_task = xTaskGetCurrentTaskHandle();
 
-        bool exec = false;
-
-        esp_event_handler_instance_t *handler;
-        esp_event_loop_node_t *loop_node;
-        esp_event_base_node_t *base_node;
-        esp_event_id_node_t *id_node;
-
-        SLIST_FOREACH(loop_node, &(loop->loop_nodes), next) {
-            // Execute loop level handlers
-            SLIST_FOREACH(handler, &(loop_node->handlers), next) {
-                handler_execute(loop, handler, post);
-                exec |= true;
-            }
-
-            SLIST_FOREACH(base_node, &(loop_node->base_nodes), next) {
-                if (base_node->base == post.base) {
-                    // Execute base level handlers
-                    SLIST_FOREACH(handler, &(base_node->handlers), next) {
-                        handler_execute(loop, handler, post);
-                        exec |= true;
-                    }
-
-                    SLIST_FOREACH(id_node, &(base_node->id_nodes), next) {
-                        if (id_node->id == post.id) {
-                            // Execute id level handlers
-                            SLIST_FOREACH(handler, &(id_node->handlers), next) {
-                                handler_execute(loop, handler, post);
-                                exec |= true;
-                            }
-                            // Skip to next base node
-                            break;
-                        }
-                    }
-                }
-            }
-        }
+        bool exec = loop_dispatch(loop, &post);
 
         esp_event_base_t base = post.base;
         int32_t id = post.id;
 
-        post_instance_delete(&post);
+        post_instance_delete(loop, &post, false);
 
         if (ticks_to_run != portMAX_DELAY) {
             end = xTaskGetTickCount();
@@ -622,15 +955,17 @@ esp_err_t esp_event_loop_delete(esp_event_loop_handle_t event_loop)
         SLIST_REMOVE(&(loop->loop_nodes), it, esp_event_loop_node, next);
         free(it);
     }
+    dispatch_index_free(loop->dispatch_index);
 
     // Drop existing posts on the queue
     esp_event_post_instance_t post;
     while(xQueueReceive(loop->queue, &post, 0) == pdTRUE) {
-        post_instance_delete(&post);
+        post_instance_delete(loop, &post, false);
     }
 
     // Cleanup loop
     vQueueDelete(loop->queue);
+    esp_mempool_delete(loop->data_pool);
     free(loop);
     // Free loop mutex before deleting
     xSemaphoreGiveRecursive(loop_mutex);
@@ -704,6 +1039,10 @@ esp_err_t esp_event_handler_register_with(esp_event_loop_handle_t event_loop, es
         err = loop_node_add_handler(last_loop_node, event_base, event_id, event_handler, event_handler_arg);
     }
 
+    if (err == ESP_OK) {
+        loop_dispatch_index_update(loop);
+    }
+
 on_err:
     xSemaphoreGiveRecursive(loop->mutex);
     return err;
@@ -730,8 +1069,13 @@ esp_err_t esp_event_handler_unregister_with(esp_event_loop_handle_t event_loop,
 
     esp_event_loop_node_t *it, *temp;
 
+    // Handlers unregistered by an executing handler are only marked, and removed after the execution
+    if (loop->dispatching) {
+        loop->handlers_removed = true;
+    }
+
     SLIST_FOREACH_SAFE(it, &(loop->loop_nodes), next, temp) {
-        esp_err_t res = loop_node_remove_handler(it, event_base, event_id, event_handler);
+        esp_err_t res = loop_node_remove_handler(it, event_base, event_id, event_handler, loop->dispatching);
 
         if (res == ESP_OK && SLIST_EMPTY(&(it->base_nodes)) && SLIST_EMPTY(&(it->handlers))) {
             SLIST_REMOVE(&(loop->loop_nodes), it, esp_event_loop_node, next);
@@ -740,6 +1084,8 @@ esp_err_t esp_event_handler_unregister_with(esp_event_loop_handle_t event_loop,
         }
     }
 
+    loop_dispatch_index_update(loop);
+
     xSemaphoreGiveRecursive(loop->mutex);
 
     return ESP_OK;
@@ -757,24 +1103,11 @@ esp_err_t esp_event_post_to(esp_event_loop_handle_t event_loop, esp_event_base_t
     esp_event_loop_instance_t* loop = (esp_event_loop_instance_t*) event_loop;
 
     esp_event_post_instance_t post;
-    memset((void*)(&post), 0, sizeof(post));
-
-    if (event_data != NULL && event_data_size != 0) {
-        // Make persistent copy of event data on heap.
-        void* event_data_copy = calloc(1, event_data_size);
-
-        if (event_data_copy == NULL) {
-            return ESP_ERR_NO_MEM;
-        }
+    esp_err_t err;
 
-        memcpy(event_data_copy, event_data, event_data_size);
-#if CONFIG_ESP_EVENT_POST_FROM_ISR
-        post.data.ptr = event_data_copy;
-        post.data_allocated = true;
-        post.data_set = true;
-#else
-        post.data = event_data_copy;
-#endif
+    err = post_instance_set_data(loop, &post, event_data, event_data_size, false);
+    if (err != ESP_OK) {
+        return err;
     }
     post.base = event_base;
     post.id = event_id;
@@ -806,7 +1139,7 @@ esp_err_t esp_event_post_to(esp_event_loop_handle_t event_loop, esp_event_base_t
     }
 
     if (result != pdTRUE) {
-        post_instance_delete(&post);
+        post_instance_delete(loop, &post, false);
 
 #ifdef CONFIG_ESP_EVENT_LOOP_PROFILING
         atomic_fetch_add(&loop->events_dropped, 1);
@@ -834,16 +1167,11 @@ esp_err_t esp_event_isr_post_to(esp_event_loop_handle_t event_loop, esp_event_ba
     esp_event_loop_instance_t* loop = (esp_event_loop_instance_t*) event_loop;
 
     esp_event_post_instance_t post;
-    memset((void*)(&post), 0, sizeof(post));
-
-    if (event_data_size > sizeof(post.data.val)) {
-        return ESP_ERR_INVALID_ARG;
-    }
+    esp_err_t err;
 
-    if (event_data != NULL && event_data_size != 0) {
-        memcpy((void*)(&(post.data.val)), event_data, event_data_size);
-        post.data_allocated = false;
-        post.data_set = true;
+    err = post_instance_set_data(loop, &post, event_data, event_data_size, true);
+    if (err != ESP_OK) {
+        return err;
     }
     post.base = event_base;
     post.id = event_id;
@@ -854,7 +1182,7 @@ esp_err_t esp_event_isr_post_to(esp_event_loop_handle_t event_loop, esp_event_ba
     result = xQueueSendToBackFromISR(loop->queue, &post, task_unblocked);
 
     if (result != pdTRUE) {
-        post_instance_delete(&post);
+        post_instance_delete(loop, &post, true);
 
 #ifdef CONFIG_ESP_EVENT_LOOP_PROFILING
         atomic_fetch_add(&loop->events_dropped, 1);
@@ -900,6 +1228,15 @@ esp_err_t esp_event_dump(FILE* file)
         PRINT_DUMP_INFO(dst, sz, LOOP_DUMP_FORMAT, loop_it, loop_it->task != NULL ? loop_it->name : "none" ,
                         events_recieved, events_dropped);
 
+        if (loop_it->data_pool) {
+            esp_mempool_stats_t pool_stats;
+
+            esp_mempool_get_stats(loop_it->data_pool, &pool_stats);
+            PRINT_DUMP_INFO(dst, sz, POOL_DUMP_FORMAT, pool_stats.block_size, pool_stats.block_num,
+                            pool_stats.block_num - pool_stats.free_num, pool_stats.used_max,
+                            pool_stats.alloc_count, pool_stats.fail_count);
+        }
+
         int sz_bak = sz;
 
         SLIST_FOREACH(loop_node_it, &(loop_it->loop_nodes), next) {
@@ -38,6 +38,10 @@ typedef struct {
     uint32_t task_stack_size;                   /**< stack size of the event loop task, ignored if task name is NULL */
     BaseType_t task_core_id;                    /**< core to which the event loop task is pinned to,
                                                         ignored if task name is NULL */
+    uint32_t data_pool_blocks;                  /**< number of blocks preallocated for event data larger than
+                                                        CONFIG_ESP_EVENT_POST_INLINE_DATA_SIZE; 0 for no pool */
+    uint32_t data_pool_block_size;              /**< size of the blocks of the event data pool, the largest event
+                                                        data posted without allocating memory */
 } esp_event_loop_args_t;
 
 /**
@@ -249,6 +253,9 @@ esp_err_t esp_event_post(esp_event_base_t event_base,
  * This function behaves in the same manner as esp_event_post_to, except the additional specification of the event loop
  * to post the event to.
  *
+ * Event data of up to CONFIG_ESP_EVENT_POST_INLINE_DATA_SIZE bytes is copied into the post itself. Larger event data
+ * is copied into a block of the data pool of the loop if it fits and a block is free, or else into a heap allocation.
+ *
  * @param[in] event_loop the event loop to post to
  * @param[in] event_base the event base that identifies the event
  * @param[in] event_id the event id that identifies the event
@@ -277,7 +284,8 @@ esp_err_t esp_event_post_to(esp_event_loop_handle_t event_loop,
  * @param[in] event_base the event base that identifies the event
  * @param[in] event_id the event id that identifies the event
  * @param[in] event_data the data, specific to the event occurence, that gets passed to the handler
- * @param[in] event_data_size the size of the event data; max is 4 bytes
+ * @param[in] event_data_size the size of the event data; max is CONFIG_ESP_EVENT_POST_INLINE_DATA_SIZE, or the
+ *                            data pool block size of the loop if it has a data pool
  * @param[out] task_unblocked an optional parameter (can be NULL) which indicates that an event task with 
  *                            higher priority than currently running task has been unblocked by the posted event;
  *                            a context switch should be requested before the interrupt is existed.
@@ -290,7 +298,9 @@ esp_err_t esp_event_post_to(esp_event_loop_handle_t event_loop,
  *  - ESP_OK: Success
  *  - ESP_FAIL: Event queue for the default event loop full
  *  - ESP_ERR_INVALID_ARG: Invalid combination of event base and event id,
- *                          data size of more than 4 bytes 
+ *                          data larger than CONFIG_ESP_EVENT_POST_INLINE_DATA_SIZE and
+ *                          the data pool blocks of the loop
+ *  - ESP_ERR_NO_MEM: No free block in the data pool of the loop
  *  - Others: Fail
  */
 esp_err_t esp_event_isr_post(esp_event_base_t event_base,
@@ -305,7 +315,8 @@ esp_err_t esp_event_isr_post(esp_event_base_t event_base,
  * @param[in] event_base the event base that identifies the event
  * @param[in] event_id the event id that identifies the event
  * @param[in] event_data the data, specific to the event occurence, that gets passed to the handler
- * @param[in] event_data_size the size of the event data
+ * @param[in] event_data_size the size of the event data; max is CONFIG_ESP_EVENT_POST_INLINE_DATA_SIZE, or the
+ *                            data pool block size of the loop if it has a data pool
  * @param[out] task_unblocked an optional parameter (can be NULL) which indicates that an event task with 
  *                            higher priority than currently running task has been unblocked by the posted event;
  *                            a context switch should be requested before the interrupt is existed.
@@ -318,7 +329,9 @@ esp_err_t esp_event_isr_post(esp_event_base_t event_base,
  *  - ESP_OK: Success
  *  - ESP_FAIL: Event queue for the loop full
  *  - ESP_ERR_INVALID_ARG: Invalid combination of event base and event id,
- *                          data size of more than 4 bytes 
+ *                          data larger than CONFIG_ESP_EVENT_POST_INLINE_DATA_SIZE and
+ *                          the data pool blocks of the loop
+ *  - ESP_ERR_NO_MEM: No free block in the data pool of the loop
  *  - Others: Fail
  */
 esp_err_t esp_event_isr_post_to(esp_event_loop_handle_t event_loop,
@@ -336,6 +349,7 @@ esp_err_t esp_event_isr_post_to(esp_event_loop_handle_t event_loop,
  *
  @verbatim
        event loop
+           data pool
            handler
            handler
            ...
@@ -354,6 +368,17 @@ esp_err_t esp_event_isr_post_to(esp_event_loop_handle_t event_loop,
            total_recieved - number of successfully posted events
            total_dropped - number of events unsucessfully posted due to queue being full
 
+   data pool, for loops with a data pool
+       format: POOL size:block_size blk:blocks used:used peak:peak alloc:allocated ex:exhausted
+       where:
+           block_size - size of the blocks for event data
+           blocks - number of blocks of the pool
+           used - number of blocks holding the data of posts not yet executed
+           peak - largest number of blocks used at once
+           allocated - number of blocks taken from the pool for the data of posts
+           exhausted - number of posts which found no free block, their data was allocated from the
+                       heap, or the post failed when posting from an ISR
+
    handler
        format: address ev:base,id inv:total_invoked run:total_runtime
        where:
@@ -16,6 +16,7 @@
 #define ESP_EVENT_INTERNAL_H_
 
 #include "esp_event.h"
+#include "esp_mempool.h"
 #include "stdatomic.h"
 
 #ifdef __cplusplus
@@ -67,6 +68,25 @@ typedef struct esp_event_loop_node {
 
 typedef SLIST_HEAD(esp_event_loop_nodes, esp_event_loop_node) esp_event_loop_nodes_t;
 
+/// Handlers to execute for an event, a slice of the handler vector of the dispatch index
+typedef struct esp_event_dispatch_entry {
+    esp_event_base_t base;                                          /**< base of the event, NULL for an unused entry */
+    int32_t id;                                                     /**< id of the event, ESP_EVENT_ANY_ID for the events
+                                                                            of the base without id level handlers */
+    uint16_t first;                                                 /**< index of the first handler to execute */
+    uint16_t count;                                                 /**< number of handlers to execute */
+} esp_event_dispatch_entry_t;
+
+/// Handlers to execute by event, built from the handler lists whenever they change
+typedef struct esp_event_dispatch_index {
+    uint32_t mask;                                                  /**< number of entries minus one, a power of two minus one */
+    esp_event_dispatch_entry_t any;                                 /**< loop level handlers, executed for events
+                                                                            of bases without handlers */
+    esp_event_dispatch_entry_t* entries;                            /**< hash table of the events with handlers */
+    esp_event_handler_instance_t** handlers;                        /**< handlers of all events in execution order */
+    struct esp_event_dispatch_index* next_retired;                  /**< next index replaced while handlers were executed */
+} esp_event_dispatch_index_t;
+
 /// Event loop
 typedef struct esp_event_loop_instance {
     const char* name;                                               /**< name of this event loop */
@@ -77,6 +97,17 @@ typedef struct esp_event_loop_instance {
     SemaphoreHandle_t mutex;                                        /**< mutex for updating the events linked list */
     esp_event_loop_nodes_t loop_nodes;                              /**< set of linked lists containing the
                                                                             registered handlers for the loop */
+    esp_event_dispatch_index_t* dispatch_index;                     /**< handlers to execute by event, NULL if none */
+    bool dispatch_index_stale;                                      /**< the index could not be built, the handler
+                                                                            lists are searched instead */
+    bool dispatching;                                               /**< handlers are being executed */
+    bool handlers_removed;                                          /**< handlers were unregistered while handlers were
+                                                                            executed, they are removed afterwards */
+    esp_event_dispatch_index_t* retired_indexes;                    /**< indexes replaced while handlers were executed,
+                                                                            freed after the execution */
+    esp_mempool_handle_t data_pool;                                 /**< blocks for the data of posts to the loop,
+                                                                            NULL if the loop has no pool */
+    uint32_t data_pool_block_size;                                  /**< largest event data a block holds */
 #ifdef CONFIG_ESP_EVENT_LOOP_PROFILING
     atomic_uint_least32_t events_recieved;                          /**< number of events successfully posted to the loop */
     atomic_uint_least32_t events_dropped;                           /**< number of events dropped due to queue being full */
@@ -85,23 +116,28 @@ typedef struct esp_event_loop_instance {
 #endif
 } esp_event_loop_instance_t;
 
-#if CONFIG_ESP_EVENT_POST_FROM_ISR
+/// Number of words of event data stored in the post
+#define ESP_EVENT_POST_INLINE_DATA_WORDS    ((CONFIG_ESP_EVENT_POST_INLINE_DATA_SIZE + 3) / 4)
+
+/// Where the data of a post is stored
+typedef enum {
+    ESP_EVENT_POST_DATA_NONE = 0,                                   /**< the event has no data */
+    ESP_EVENT_POST_DATA_INLINE,                                     /**< in the post */
+    ESP_EVENT_POST_DATA_POOL,                                       /**< in a block of the data pool of the loop */
+    ESP_EVENT_POST_DATA_HEAP,                                       /**< in a heap allocation */
+} esp_event_post_data_type_t;
+
 typedef union esp_event_post_data {
-    uint32_t val;
-    void *ptr;
+    uint32_t val[ESP_EVENT_POST_INLINE_DATA_WORDS];                 /**< event data stored in the post */
+    void *ptr;                                                      /**< event data in a pool block or on the heap */
 } esp_event_post_data_t;
-#else
-typedef void* esp_event_post_data_t;
-#endif
 
 /// Event posted to the event queue
 typedef struct esp_event_post_instance {
-#if CONFIG_ESP_EVENT_POST_FROM_ISR
-    bool data_allocated;                                             /**< indicates whether data is allocated from heap */
-    bool data_set;                                                   /**< indicates if data is null */
-#endif
     esp_event_base_t base;                                           /**< the event base */
     int32_t id;                                                      /**< the event id */
+    uint8_t data_type;                                               /**< where the data is stored,
+                                                                            an esp_event_post_data_type_t */
     esp_event_post_data_t data;                                      /**< data associated with the event */
 } esp_event_post_instance_t;
 
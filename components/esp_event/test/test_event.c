@@ -290,6 +290,8 @@ static void test_handler_post_from_isr(void* event_handler_arg, esp_event_base_t
 #endif
 
 #if CONFIG_ESP_EVENT_POST_FROM_ISR
+static uint8_t s_test_isr_large_data[CONFIG_ESP_EVENT_POST_INLINE_DATA_SIZE + 1];
+
 void IRAM_ATTR test_event_on_timer_alarm(void* para)
 {
     /* Retrieve the interrupt status and the counter value
@@ -305,8 +307,11 @@ void IRAM_ATTR test_event_on_timer_alarm(void* para)
     TIMERG0.hw_timer[TIMER_0].alarm_low = (uint32_t) timer_counter_value;
 
     int data = (int) para;
-    // Posting events with data more than 4 bytes should fail.
-    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_event_isr_post(s_test_base1, TEST_EVENT_BASE1_EV1, &data, 5, NULL));
+#if !CONFIG_ESP_EVENT_DEFAULT_LOOP_DATA_POOL_BLOCKS
+    // Posting events with data larger than a post should fail without a data pool.
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_event_isr_post(s_test_base1, TEST_EVENT_BASE1_EV1, s_test_isr_large_data,
+                                                              sizeof(s_test_isr_large_data), NULL));
+#endif
     // This should succeedd, as data is int-sized. The handler for the event checks that the passed event data
     // is correct.
     BaseType_t task_unblocked;
@@ -1172,19 +1177,73 @@ TEST_CASE("can properly prepare event data posted to loop", "[event]")
 
     TEST_ASSERT_EQUAL(ESP_OK, esp_event_post_to(loop, s_test_base1, TEST_EVENT_BASE1_EV1, NULL, 0, portMAX_DELAY));
     TEST_ASSERT_EQUAL(pdTRUE, xQueueReceive(loop_def->queue, &post, portMAX_DELAY));
-    TEST_ASSERT_EQUAL(false, post.data_set);
-    TEST_ASSERT_EQUAL(false, post.data_allocated);
-    TEST_ASSERT_EQUAL(NULL, post.data.ptr);
+    TEST_ASSERT_EQUAL(ESP_EVENT_POST_DATA_NONE, post.data_type);
 
     int sample = 0;
     TEST_ASSERT_EQUAL(ESP_OK, esp_event_isr_post_to(loop, s_test_base1, TEST_EVENT_BASE1_EV1, &sample, sizeof(sample), NULL));
     TEST_ASSERT_EQUAL(pdTRUE, xQueueReceive(loop_def->queue, &post, portMAX_DELAY));
-    TEST_ASSERT_EQUAL(true, post.data_set);
-    TEST_ASSERT_EQUAL(false, post.data_allocated);
-    TEST_ASSERT_EQUAL(false, post.data.val);
+    TEST_ASSERT_EQUAL(ESP_EVENT_POST_DATA_INLINE, post.data_type);
+    TEST_ASSERT_EQUAL(0, post.data.val[0]);
+
+    // Data larger than the post needs a data pool when posted from an ISR
+    uint8_t large[CONFIG_ESP_EVENT_POST_INLINE_DATA_SIZE + 1] = { 0 };
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_event_isr_post_to(loop, s_test_base1, TEST_EVENT_BASE1_EV1, large, sizeof(large), NULL));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_event_post_to(loop, s_test_base1, TEST_EVENT_BASE1_EV1, large, sizeof(large), portMAX_DELAY));
+    TEST_ASSERT_EQUAL(pdTRUE, xQueueReceive(loop_def->queue, &post, portMAX_DELAY));
+    TEST_ASSERT_EQUAL(ESP_EVENT_POST_DATA_HEAP, post.data_type);
+    free(post.data.ptr);
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_event_loop_delete(loop));
+
+    TEST_TEARDOWN();
+}
+
+TEST_CASE("can post event data from the data pool of a loop", "[event]")
+{
+    TEST_SETUP();
+
+    esp_event_loop_handle_t loop;
+    esp_event_loop_args_t loop_args = test_event_get_default_loop_args();
+
+    loop_args.task_name = NULL;
+    loop_args.data_pool_blocks = 1;
+    loop_args.data_pool_block_size = 64;
+    TEST_ASSERT_EQUAL(ESP_OK, esp_event_loop_create(&loop_args, &loop));
+
+    esp_event_loop_instance_t* loop_def = (esp_event_loop_instance_t*) loop;
+    esp_mempool_stats_t stats;
+    // The handler adds the first word of the data to the count
+    int data[16] = { 1 };
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_event_isr_post_to(loop, s_test_base1, TEST_EVENT_BASE1_EV1, data, sizeof(data), NULL));
+    esp_mempool_get_stats(loop_def->data_pool, &stats);
+    TEST_ASSERT_EQUAL(0, stats.free_num);
+
+    // The only block is in use, the data of the next posts is allocated or the ISR post fails
+    TEST_ASSERT_EQUAL(ESP_ERR_NO_MEM, esp_event_isr_post_to(loop, s_test_base1, TEST_EVENT_BASE1_EV1, data, sizeof(data), NULL));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_event_post_to(loop, s_test_base1, TEST_EVENT_BASE1_EV1, data, sizeof(data), portMAX_DELAY));
+    esp_mempool_get_stats(loop_def->data_pool, &stats);
+    TEST_ASSERT_EQUAL(2, stats.fail_count);
+
+    int count = 0;
+
+    simple_arg_t arg = {
+        .data = &count,
+        .mutex = xSemaphoreCreateMutex()
+    };
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_event_handler_register_with(loop, s_test_base1, TEST_EVENT_BASE1_EV1, test_event_simple_handler, &arg));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_event_loop_run(loop, pdMS_TO_TICKS(10)));
+
+    TEST_ASSERT_EQUAL(2, count);
+    esp_mempool_get_stats(loop_def->data_pool, &stats);
+    TEST_ASSERT_EQUAL(1, stats.free_num);
+    TEST_ASSERT_EQUAL(1, stats.used_max);
 
     TEST_ASSERT_EQUAL(ESP_OK, esp_event_loop_delete(loop));
 
+    vSemaphoreDelete(arg.mutex);
+
     TEST_TEARDOWN();
 }
 
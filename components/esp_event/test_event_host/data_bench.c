@@ -0,0 +1,234 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Measure the cost of posting an event with data and executing its handler, by size of the data.
+ * The former esp_event_post_to() copied the data of every post into a heap allocation, freed after
+ * the handlers were executed; a copy of that path is compared with esp_event_post_to() on a loop
+ * without and with a data pool. Before the timed runs, the data handlers receive and the data posted
+ * from ISRs are checked, as is the accounting of the pool.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_event.h"
+#include "esp_event_internal.h"
+
+#define BENCH_EVENTS        200000
+#define BENCH_RUNS          3
+#define BENCH_QUEUE_SIZE    32
+#define POOL_BLOCKS         8
+#define POOL_BLOCK_SIZE     128
+#define DATA_MAX            256
+
+static const char *s_base = "SENSOR_EVENT";
+
+static uint8_t s_expected[DATA_MAX];
+static size_t s_expected_size;
+static uint64_t s_calls;
+
+static inline uint64_t bench_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void data_handler(void *arg, esp_event_base_t base, int32_t id, void *data)
+{
+    if (s_expected_size && (data == NULL || memcmp(data, s_expected, s_expected_size))) {
+        printf("handler received wrong data for %zu bytes\n", s_expected_size);
+        exit(1);
+    }
+    s_calls++;
+}
+
+/* --------------------------------------- Former data copy --------------------------------------- */
+
+static esp_err_t legacy_post_to(esp_event_loop_handle_t event_loop, esp_event_base_t event_base, int32_t event_id,
+                                void *event_data, size_t event_data_size, TickType_t ticks_to_wait)
+{
+    esp_event_loop_instance_t *loop = (esp_event_loop_instance_t *) event_loop;
+    esp_event_post_instance_t post;
+
+    memset((void *)(&post), 0, sizeof(post));
+
+    if (event_data != NULL && event_data_size != 0) {
+        void *event_data_copy = calloc(1, event_data_size);
+
+        if (event_data_copy == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+
+        memcpy(event_data_copy, event_data, event_data_size);
+        post.data.ptr = event_data_copy;
+        post.data_type = ESP_EVENT_POST_DATA_HEAP;
+    }
+    post.base = event_base;
+    post.id = event_id;
+
+    if (xQueueSendToBack(loop->queue, &post, ticks_to_wait) != pdTRUE) {
+        free(post.data.ptr);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    return ESP_OK;
+}
+
+/* ------------------------------------------- Benchmark ------------------------------------------- */
+
+static esp_event_loop_handle_t create_loop(uint32_t pool_blocks)
+{
+    esp_event_loop_args_t args = {
+        .queue_size = BENCH_QUEUE_SIZE,
+        .task_name = NULL,
+        .data_pool_blocks = pool_blocks,
+        .data_pool_block_size = POOL_BLOCK_SIZE,
+    };
+    esp_event_loop_handle_t loop;
+
+    if (esp_event_loop_create(&args, &loop) != ESP_OK ||
+        esp_event_handler_register_with(loop, s_base, ESP_EVENT_ANY_ID, data_handler, NULL) != ESP_OK) {
+        printf("loop creation failed\n");
+        exit(1);
+    }
+
+    return loop;
+}
+
+static void expect(int ok, const char *what)
+{
+    if (!ok) {
+        printf("check failed: %s\n", what);
+        exit(1);
+    }
+}
+
+static void set_expected(size_t size)
+{
+    for (size_t i = 0; i < size; i++) {
+        s_expected[i] = (uint8_t)(i * 31 + size);
+    }
+    s_expected_size = size;
+}
+
+static void check_data(void)
+{
+    esp_event_loop_handle_t loop = create_loop(2);
+    esp_mempool_handle_t pool = ((esp_event_loop_instance_t *) loop)->data_pool;
+    esp_mempool_stats_t stats;
+    static const size_t s_sizes[] = { 1, 4, CONFIG_ESP_EVENT_POST_INLINE_DATA_SIZE, CONFIG_ESP_EVENT_POST_INLINE_DATA_SIZE + 1,
+                                      POOL_BLOCK_SIZE, POOL_BLOCK_SIZE + 1, DATA_MAX };
+
+    for (size_t n = 0; n < sizeof(s_sizes) / sizeof(s_sizes[0]); n++) {
+        set_expected(s_sizes[n]);
+        expect(esp_event_post_to(loop, s_base, 0, s_expected, s_sizes[n], 0) == ESP_OK, "post");
+        esp_event_loop_run(loop, 0);
+    }
+
+    // Data posted from an ISR fits into the post or a pool block, the queue keeps the blocks in use
+    set_expected(POOL_BLOCK_SIZE);
+    expect(esp_event_isr_post_to(loop, s_base, 0, s_expected, POOL_BLOCK_SIZE + 1, NULL) == ESP_ERR_INVALID_ARG,
+           "ISR post larger than a block");
+    expect(esp_event_isr_post_to(loop, s_base, 0, s_expected, POOL_BLOCK_SIZE, NULL) == ESP_OK, "ISR post");
+    expect(esp_event_isr_post_to(loop, s_base, 0, s_expected, POOL_BLOCK_SIZE, NULL) == ESP_OK, "ISR post");
+    esp_mempool_get_stats(pool, &stats);
+    expect(stats.free_num == 0 && stats.used_max == 2, "pool blocks used");
+    expect(esp_event_isr_post_to(loop, s_base, 0, s_expected, POOL_BLOCK_SIZE, NULL) == ESP_ERR_NO_MEM,
+           "ISR post with the pool exhausted");
+    expect(esp_event_post_to(loop, s_base, 0, s_expected, POOL_BLOCK_SIZE, 0) == ESP_OK,
+           "post with the pool exhausted");
+    esp_mempool_get_stats(pool, &stats);
+    expect(stats.fail_count == 2, "pool exhaustion counted");
+    for (int i = 0; i < 3; i++) {
+        esp_event_loop_run(loop, 0);
+    }
+    esp_mempool_get_stats(pool, &stats);
+    expect(stats.free_num == stats.block_num, "pool blocks freed");
+    expect(s_calls == sizeof(s_sizes) / sizeof(s_sizes[0]) + 3, "handlers executed");
+
+    // Posts left on the queue release their data with the loop
+    expect(esp_event_post_to(loop, s_base, 0, s_expected, POOL_BLOCK_SIZE, 0) == ESP_OK, "post");
+    esp_event_loop_delete(loop);
+}
+
+typedef esp_err_t (*post_func_t)(esp_event_loop_handle_t, esp_event_base_t, int32_t, void *, size_t, TickType_t);
+
+static double bench_once(esp_event_loop_handle_t loop, post_func_t post, size_t size)
+{
+    uint64_t start, ns;
+
+    s_calls = 0;
+    start = bench_ns();
+    for (int i = 0; i < BENCH_EVENTS; i++) {
+        post(loop, s_base, i & 7, s_expected, size, 0);
+        esp_event_loop_run(loop, 0);
+    }
+    ns = bench_ns() - start;
+
+    if (s_calls != BENCH_EVENTS) {
+        printf("%llu handlers executed for %d events\n", (unsigned long long)s_calls, BENCH_EVENTS);
+        exit(1);
+    }
+
+    return (double)ns / BENCH_EVENTS;
+}
+
+/* Best of several runs, to keep other load on the host out of the comparison */
+static double bench_run(esp_event_loop_handle_t loop, post_func_t post, size_t size)
+{
+    double best = 0;
+
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        double ns = bench_once(loop, post, size);
+
+        if (!run || ns < best) {
+            best = ns;
+        }
+    }
+
+    return best;
+}
+
+int main(void)
+{
+    static const size_t s_sizes[] = { 4, 16, 64, 128, 256 };
+    esp_event_loop_handle_t loop = create_loop(0);
+    esp_event_loop_handle_t pool_loop = create_loop(POOL_BLOCKS);
+
+    check_data();
+
+    printf("%6s %14s %14s %14s\n", "bytes", "heap ns/post", "no pool ns", "pool ns/post");
+    for (size_t n = 0; n < sizeof(s_sizes) / sizeof(s_sizes[0]); n++) {
+        size_t size = s_sizes[n];
+        double heap, inline_only, pool;
+
+        set_expected(size);
+        heap = bench_run(loop, legacy_post_to, size);
+        inline_only = bench_run(loop, esp_event_post_to, size);
+        pool = bench_run(pool_loop, esp_event_post_to, size);
+        printf("%6zu %14.1f %14.1f %14.1f\n", size, heap, inline_only, pool);
+    }
+
+    esp_event_loop_delete(loop);
+    esp_event_loop_delete(pool_loop);
+
+    return 0;
+}
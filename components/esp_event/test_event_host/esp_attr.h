@@ -0,0 +1,4 @@
+// Host build stub of esp_attr.h
+#pragma once
+
+#define IRAM_ATTR
@@ -0,0 +1,13 @@
+// Host build stub of esp_err.h
+#pragma once
+
+#include <stdint.h>
+
+typedef int32_t esp_err_t;
+
+#define ESP_OK                  0
+#define ESP_FAIL                -1
+#define ESP_ERR_NO_MEM          0x101
+#define ESP_ERR_INVALID_ARG     0x102
+#define ESP_ERR_TIMEOUT         0x107
+#define ESP_ERR_NOT_FOUND       0x105
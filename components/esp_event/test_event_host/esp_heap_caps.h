@@ -0,0 +1,9 @@
+// Host build stub of esp_heap_caps.h, the capabilities are ignored
+#pragma once
+
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+
+#define heap_caps_malloc(size, caps) malloc(size)
+#define heap_caps_free(ptr) free(ptr)
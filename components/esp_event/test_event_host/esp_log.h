@@ -0,0 +1,13 @@
+// Host build stub of esp_log.h, the benchmark does not print the log of the event loop
+#pragma once
+
+#include <stdio.h>
+
+#define ESP_LOG_DISCARD(tag, ...) do { if (0) { printf("%s", tag); printf(__VA_ARGS__); } } while (0)
+
+#define ESP_LOGE(tag, ...) ESP_LOG_DISCARD(tag, __VA_ARGS__)
+#define ESP_LOGW(tag, ...) ESP_LOG_DISCARD(tag, __VA_ARGS__)
+#define ESP_LOGI(tag, ...) ESP_LOG_DISCARD(tag, __VA_ARGS__)
+#define ESP_LOGD(tag, ...) ESP_LOG_DISCARD(tag, __VA_ARGS__)
+#define ESP_LOGV(tag, ...) ESP_LOG_DISCARD(tag, __VA_ARGS__)
+#define ESP_EARLY_LOGE(tag, ...) ESP_LOG_DISCARD(tag, __VA_ARGS__)
@@ -0,0 +1,325 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Measure the cost of posting an event and executing its handlers as the number of events
+ * with handlers grows. Every event has an id level handler, every base a base level handler
+ * and the loop a loop level handler, like the Wi-Fi, IP and application events of a device.
+ * The dispatch index is compared with a copy of the former esp_event_loop_run(), which
+ * searched the loop, base and id nodes for every event. Before the timed runs, the handlers
+ * executed and their order are compared for both on a mix of registrations.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_event.h"
+#include "esp_event_internal.h"
+
+#define BENCH_EVENTS        200000
+#define BENCH_RUNS          3
+#define BENCH_QUEUE_SIZE    32
+#define TRACE_MAX           64
+
+static const char *s_bases[] = {
+    "WIFI_EVENT", "IP_EVENT", "MQTT_EVENTS", "HTTP_EVENT", "SENSOR_EVENT", "GPIO_EVENT", "OTA_EVENT", "APP_EVENT",
+};
+
+#define NUM_BASES   (sizeof(s_bases) / sizeof(s_bases[0]))
+
+static uintptr_t s_trace[TRACE_MAX];
+static size_t s_trace_len;
+static uint64_t s_calls;
+
+static inline uint64_t bench_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Handlers are told apart by their function, several are needed to register more than one to a list */
+#define TRACE_HANDLER(n) \
+    static void trace_handler_##n(void *arg, esp_event_base_t base, int32_t id, void *data) \
+    { \
+        if (s_trace_len < TRACE_MAX) { \
+            s_trace[s_trace_len++] = (uintptr_t)arg; \
+        } \
+        s_calls++; \
+    }
+
+TRACE_HANDLER(0)
+TRACE_HANDLER(1)
+TRACE_HANDLER(2)
+TRACE_HANDLER(3)
+
+/* ----------------------------------------- Former dispatch ----------------------------------------- */
+
+static void legacy_handler_execute(esp_event_loop_instance_t *loop, esp_event_handler_instance_t *handler, esp_event_post_instance_t post)
+{
+    void *data_ptr = NULL;
+
+    if (post.data_type == ESP_EVENT_POST_DATA_INLINE) {
+        data_ptr = post.data.val;
+    } else if (post.data_type != ESP_EVENT_POST_DATA_NONE) {
+        data_ptr = post.data.ptr;
+    }
+
+    (*(handler->handler))(handler->arg, post.base, post.id, data_ptr);
+}
+
+static void legacy_post_instance_delete(esp_event_post_instance_t *post)
+{
+    if (post->data_type == ESP_EVENT_POST_DATA_HEAP) {
+        free(post->data.ptr);
+    }
+    memset(post, 0, sizeof(*post));
+}
+
+static esp_err_t legacy_loop_run(esp_event_loop_handle_t event_loop, TickType_t ticks_to_run)
+{
+    esp_event_loop_instance_t *loop = (esp_event_loop_instance_t *) event_loop;
+    esp_event_post_instance_t post;
+    TickType_t marker = xTaskGetTickCount();
+    TickType_t end = 0;
+    int64_t remaining_ticks = ticks_to_run;
+
+    while (xQueueReceive(loop->queue, &post, ticks_to_run) == pdTRUE) {
+        xSemaphoreTakeRecursive(loop->mutex, portMAX_DELAY);
+
+        loop->running_task = xTaskGetCurrentTaskHandle();
+
+        bool exec = false;
+
+        esp_event_handler_instance_t *handler;
+        esp_event_loop_node_t *loop_node;
+        esp_event_base_node_t *base_node;
+        esp_event_id_node_t *id_node;
+
+        SLIST_FOREACH(loop_node, &(loop->loop_nodes), next) {
+            SLIST_FOREACH(handler, &(loop_node->handlers), next) {
+                legacy_handler_execute(loop, handler, post);
+                exec |= true;
+            }
+
+            SLIST_FOREACH(base_node, &(loop_node->base_nodes), next) {
+                if (base_node->base == post.base) {
+                    SLIST_FOREACH(handler, &(base_node->handlers), next) {
+                        legacy_handler_execute(loop, handler, post);
+                        exec |= true;
+                    }
+
+                    SLIST_FOREACH(id_node, &(base_node->id_nodes), next) {
+                        if (id_node->id == post.id) {
+                            SLIST_FOREACH(handler, &(id_node->handlers), next) {
+                                legacy_handler_execute(loop, handler, post);
+                                exec |= true;
+                            }
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+
+        legacy_post_instance_delete(&post);
+
+        if (ticks_to_run != portMAX_DELAY) {
+            end = xTaskGetTickCount();
+            remaining_ticks -= end - marker;
+            if (remaining_ticks <= 0) {
+                xSemaphoreGiveRecursive(loop->mutex);
+                break;
+            } else {
+                marker = end;
+            }
+        }
+
+        loop->running_task = NULL;
+
+        xSemaphoreGiveRecursive(loop->mutex);
+
+        (void)exec;
+    }
+
+    return ESP_OK;
+}
+
+/* ------------------------------------------- Benchmark ------------------------------------------- */
+
+static esp_event_loop_handle_t create_loop(void)
+{
+    esp_event_loop_args_t args = {
+        .queue_size = BENCH_QUEUE_SIZE,
+        .task_name = NULL,
+    };
+    esp_event_loop_handle_t loop;
+
+    if (esp_event_loop_create(&args, &loop) != ESP_OK) {
+        printf("loop creation failed\n");
+        exit(1);
+    }
+
+    return loop;
+}
+
+static void register_handler(esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id,
+                             esp_event_handler_t handler, uintptr_t tag)
+{
+    if (esp_event_handler_register_with(loop, base, id, handler, (void *)tag) != ESP_OK) {
+        printf("registration failed\n");
+        exit(1);
+    }
+}
+
+/* Post an event and return the tags of the handlers executed, by the index or by the former search */
+static size_t trace_event(esp_event_loop_handle_t loop, esp_event_base_t base, int32_t id, int legacy, uintptr_t *trace)
+{
+    s_trace_len = 0;
+    esp_event_post_to(loop, base, id, NULL, 0, 0);
+    if (legacy) {
+        legacy_loop_run(loop, 0);
+    } else {
+        esp_event_loop_run(loop, 0);
+    }
+    memcpy(trace, s_trace, s_trace_len * sizeof(s_trace[0]));
+
+    return s_trace_len;
+}
+
+static void compare_traces(esp_event_loop_handle_t loop, const char *step)
+{
+    const char *bases[] = { s_bases[0], s_bases[1], s_bases[2] };
+
+    for (size_t b = 0; b < sizeof(bases) / sizeof(bases[0]); b++) {
+        for (int32_t id = 0; id < 4; id++) {
+            uintptr_t expected[TRACE_MAX], actual[TRACE_MAX];
+            size_t expected_len = trace_event(loop, bases[b], id, 1, expected);
+            size_t actual_len = trace_event(loop, bases[b], id, 0, actual);
+
+            if (expected_len != actual_len || memcmp(expected, actual, actual_len * sizeof(actual[0]))) {
+                printf("%s: handlers of %s:%d differ from the former dispatch\n", step, bases[b], id);
+                exit(1);
+            }
+        }
+    }
+}
+
+static void check_order(void)
+{
+    esp_event_loop_handle_t loop = create_loop();
+    const char *a = s_bases[0], *b = s_bases[1];
+
+    /* Loop level handlers registered after base or id level ones start a new loop node */
+    register_handler(loop, ESP_EVENT_ANY_BASE, ESP_EVENT_ANY_ID, trace_handler_0, 100);
+    register_handler(loop, a, 1, trace_handler_1, 1);
+    register_handler(loop, a, ESP_EVENT_ANY_ID, trace_handler_2, 2);
+    register_handler(loop, ESP_EVENT_ANY_BASE, ESP_EVENT_ANY_ID, trace_handler_1, 101);
+    register_handler(loop, b, 1, trace_handler_0, 3);
+    register_handler(loop, a, 1, trace_handler_3, 4);
+    register_handler(loop, a, 2, trace_handler_0, 5);
+    register_handler(loop, b, ESP_EVENT_ANY_ID, trace_handler_1, 6);
+    register_handler(loop, ESP_EVENT_ANY_BASE, ESP_EVENT_ANY_ID, trace_handler_2, 102);
+    register_handler(loop, a, 1, trace_handler_2, 7);
+    register_handler(loop, b, 3, trace_handler_3, 8);
+    compare_traces(loop, "registered");
+
+    esp_event_handler_unregister_with(loop, a, 1, trace_handler_3);
+    esp_event_handler_unregister_with(loop, ESP_EVENT_ANY_BASE, ESP_EVENT_ANY_ID, trace_handler_1);
+    esp_event_handler_unregister_with(loop, b, ESP_EVENT_ANY_ID, trace_handler_1);
+    compare_traces(loop, "unregistered");
+
+    esp_event_loop_delete(loop);
+}
+
+static double bench_once(esp_event_loop_handle_t loop, size_t num_events, int legacy)
+{
+    size_t ids = (num_events + NUM_BASES - 1) / NUM_BASES;
+    uint64_t start, ns;
+
+    s_calls = 0;
+    start = bench_ns();
+    for (int i = 0; i < BENCH_EVENTS; i++) {
+        size_t event = (i * 7) % num_events;
+
+        esp_event_post_to(loop, s_bases[event % NUM_BASES], event / NUM_BASES % ids, NULL, 0, 0);
+        if (legacy) {
+            legacy_loop_run(loop, 0);
+        } else {
+            esp_event_loop_run(loop, 0);
+        }
+    }
+    ns = bench_ns() - start;
+
+    /* The loop, base and id level handlers */
+    if (s_calls != (uint64_t)BENCH_EVENTS * 3) {
+        printf("%llu handlers executed for %d events\n", (unsigned long long)s_calls, BENCH_EVENTS);
+        exit(1);
+    }
+
+    return (double)ns / BENCH_EVENTS;
+}
+
+/* Best of several runs, to keep other load on the host out of the comparison */
+static double bench_run(esp_event_loop_handle_t loop, size_t num_events, int legacy)
+{
+    double best = 0;
+
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        double ns = bench_once(loop, num_events, legacy);
+
+        if (!run || ns < best) {
+            best = ns;
+        }
+    }
+
+    return best;
+}
+
+int main(void)
+{
+    static const size_t s_num_events[] = { 1, 8, 32, 128, 512 };
+
+    check_order();
+
+    printf("%8s %10s %14s %14s %8s\n", "events", "handlers", "lists ns/post", "index ns/post", "speedup");
+    for (size_t n = 0; n < sizeof(s_num_events) / sizeof(s_num_events[0]); n++) {
+        size_t num_events = s_num_events[n];
+        size_t bases = num_events < NUM_BASES ? num_events : NUM_BASES;
+        size_t ids = (num_events + NUM_BASES - 1) / NUM_BASES;
+        esp_event_loop_handle_t loop = create_loop();
+        double lists, index;
+
+        register_handler(loop, ESP_EVENT_ANY_BASE, ESP_EVENT_ANY_ID, trace_handler_0, 0);
+        for (size_t b = 0; b < bases; b++) {
+            register_handler(loop, s_bases[b], ESP_EVENT_ANY_ID, trace_handler_1, 0);
+            for (size_t id = 0; id < ids; id++) {
+                register_handler(loop, s_bases[b], id, trace_handler_2, 0);
+            }
+        }
+
+        lists = bench_run(loop, num_events, 1);
+        index = bench_run(loop, num_events, 0);
+        printf("%8zu %10zu %14.1f %14.1f %7.2fx\n", num_events, 1 + bases + bases * ids, lists, index, lists / index);
+
+        esp_event_loop_delete(loop);
+    }
+
+    return 0;
+}
@@ -0,0 +1,50 @@
+// Host build stub of queue.h, a ring of items which never blocks
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    size_t item_size;
+    size_t length;
+    size_t read;
+    size_t count;
+    uint8_t items[];
+} host_queue_t;
+
+typedef host_queue_t *QueueHandle_t;
+
+static inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    host_queue_t *queue = calloc(1, sizeof(host_queue_t) + length * item_size);
+
+    if (queue) {
+        queue->item_size = item_size;
+        queue->length = length;
+    }
+    return queue;
+}
+
+static inline BaseType_t xQueueSendToBack(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    if (queue->count == queue->length) {
+        return pdFALSE;
+    }
+    memcpy(queue->items + ((queue->read + queue->count) % queue->length) * queue->item_size, item, queue->item_size);
+    queue->count++;
+    return pdTRUE;
+}
+
+static inline BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    if (queue->count == 0) {
+        return pdFALSE;
+    }
+    memcpy(item, queue->items + queue->read * queue->item_size, queue->item_size);
+    queue->read = (queue->read + 1) % queue->length;
+    queue->count--;
+    return pdTRUE;
+}
+
+#define xQueueSendToBackFromISR(queue, item, woken) xQueueSendToBack(queue, item, 0)
+#define vQueueDelete(queue) free(queue)
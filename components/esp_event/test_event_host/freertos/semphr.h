@@ -0,0 +1,30 @@
+// Host build stub of semphr.h, taking a mutex never blocks in the single threaded benchmark
+#pragma once
+
+#include <stdlib.h>
+#include "queue.h"
+
+typedef struct {
+    int count;
+} host_mutex_t;
+
+typedef host_mutex_t *SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void)
+{
+    return calloc(1, sizeof(host_mutex_t));
+}
+
+static inline BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t mutex, TickType_t ticks)
+{
+    mutex->count++;
+    return pdTRUE;
+}
+
+static inline BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t mutex)
+{
+    mutex->count--;
+    return pdTRUE;
+}
+
+#define vSemaphoreDelete(mutex) free(mutex)
@@ -0,0 +1,18 @@
+// Host build stub of task.h, loops are run by the benchmark itself
+#pragma once
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+#define xTaskGetTickCount() ((TickType_t)0)
+#define xTaskGetCurrentTaskHandle() ((TaskHandle_t)1)
+static inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t func, const char *name, uint32_t stack, void *arg,
+                                                 UBaseType_t prio, TaskHandle_t *task, BaseType_t core)
+{
+    return pdFALSE;
+}
+
+#define vTaskSuspend(task)
+#define vTaskSuspendAll()
+#define xTaskResumeAll() ((void)0)
+#define vTaskDelete(task)
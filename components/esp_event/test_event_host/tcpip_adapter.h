@@ -0,0 +1,6 @@
+// Host build stub of tcpip_adapter.h, only the types used by esp_event_legacy.h
+#pragma once
+
+typedef struct { int unused; } ip_event_ap_staipassigned_t;
+typedef struct { int unused; } ip_event_got_ip_t;
+typedef struct { int unused; } ip_event_got_ip6_t;
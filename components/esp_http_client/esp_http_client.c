@@ -23,6 +23,7 @@
 #include "esp_transport_tcp.h"
 #include "http_utils.h"
 #include "http_auth.h"
+#include "http_conn_pool.h"
 #include "sdkconfig.h"
 #include "esp_http_client.h"
 #include "errno.h"
@@ -118,6 +119,9 @@ struct esp_http_client {
     bool                        first_line_prepared;
     int                         header_index;
     bool                        is_async;
+    bool                        use_conn_pool;
+    bool                        conn_pooled;
+    bool                        conn_reused;
 };
 
 typedef struct esp_http_client esp_http_client_t;
@@ -166,7 +170,7 @@ enum HttpStatus_Code
 };
 
 
-static esp_err_t esp_http_client_request_send(esp_http_client_handle_t client, int write_len);
+static esp_err_t esp_http_client_request_send(esp_http_client_handle_t client, int write_len, bool with_post_data);
 static esp_err_t esp_http_client_connect(esp_http_client_handle_t client);
 static esp_err_t esp_http_client_send_post_data(esp_http_client_handle_t client);
 
@@ -376,6 +380,11 @@ static esp_err_t _set_config(esp_http_client_handle_t client, const esp_http_cli
     if (config->is_async) {
         client->is_async = true;
     }
+#ifdef CONFIG_HTTP_CLIENT_CONN_POOL
+    /* Asynchronous clients keep connecting the transport of the client */
+    client->use_conn_pool = !config->is_async && !config->disable_connection_pool;
+#endif
+    client->connection_info.cert_pem = (char *)config->cert_pem;
 
     return ESP_OK;
 }
@@ -412,6 +421,78 @@ static esp_err_t _clear_auth_data(esp_http_client_handle_t client)
     return ESP_OK;
 }
 
+#ifdef CONFIG_HTTP_CLIENT_CONN_POOL
+static void _get_conn_key(esp_http_client_handle_t client, http_conn_key_t *key)
+{
+    key->scheme = client->connection_info.scheme;
+    key->host = client->connection_info.host;
+    key->port = client->connection_info.port;
+    key->tls_config = client->connection_info.cert_pem;
+}
+
+/**
+ * Create a transport for a connection of the pool, which is not in the transport list of the client
+ * as it may outlive the client
+ */
+static esp_transport_handle_t _create_pooled_transport(esp_http_client_handle_t client)
+{
+    esp_transport_handle_t t = NULL;
+
+    if (strcasecmp(client->connection_info.scheme, "http") == 0) {
+        t = esp_transport_tcp_init();
+    }
+#ifdef CONFIG_ESP_HTTP_CLIENT_ENABLE_HTTPS
+    else if (strcasecmp(client->connection_info.scheme, "https") == 0) {
+        t = esp_transport_ssl_init();
+        if (t && client->connection_info.cert_pem) {
+            esp_transport_ssl_set_cert_data(t, client->connection_info.cert_pem, strlen(client->connection_info.cert_pem));
+        }
+    }
+#endif
+    return t;
+}
+#endif
+
+/**
+ * Give up the pooled transport of the client, returning it to the pool if asked to, or closing it
+ */
+static void _release_pooled_transport(esp_http_client_handle_t client, bool keep_alive)
+{
+#ifdef CONFIG_HTTP_CLIENT_CONN_POOL
+    if (!client->conn_pooled) {
+        return;
+    }
+    if (keep_alive) {
+        http_conn_key_t key;
+        _get_conn_key(client, &key);
+        http_conn_pool_put(&key, client->transport);
+    } else {
+        esp_transport_close(client->transport);
+        esp_transport_destroy(client->transport);
+    }
+    client->transport = NULL;
+    client->conn_pooled = false;
+#endif
+}
+
+/**
+ * A connection taken from the pool may have been closed by the server just before the request was sent.
+ * The request is then sent again on a new connection, once.
+ */
+static bool _retry_on_new_connection(esp_http_client_handle_t client, bool *retried)
+{
+    if (!client->conn_reused || *retried) {
+        return false;
+    }
+    ESP_LOGD(TAG, "Reused connection failed, retry on a new connection");
+    *retried = true;
+    client->conn_reused = false;
+    _release_pooled_transport(client, false);
+    client->state = HTTP_STATE_INIT;
+    client->process_again = 1;
+    return true;
+}
+
 static esp_err_t esp_http_client_prepare(esp_http_client_handle_t client)
 {
     client->process_again = 0;
@@ -799,6 +880,7 @@ int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len)
 esp_err_t esp_http_client_perform(esp_http_client_handle_t client)
 {
     esp_err_t err;
+    bool retried = false;
     do {
         if (client->process_again) {
             esp_http_client_prepare(client);
@@ -817,10 +899,13 @@ esp_err_t esp_http_client_perform(esp_http_client_handle_t client)
                 }
                 /* falls through */
             case HTTP_STATE_CONNECTED:
-                if ((err = esp_http_client_request_send(client, client->post_len)) != ESP_OK) {
+                if ((err = esp_http_client_request_send(client, client->post_len, true)) != ESP_OK) {
                     if (client->is_async && errno == EAGAIN) {
                         return ESP_ERR_HTTP_EAGAIN;
                     }
+                    if (_retry_on_new_connection(client, &retried)) {
+                        break;
+                    }
                     return err;
                 }
                 /* falls through */
@@ -837,6 +922,9 @@ esp_err_t esp_http_client_perform(esp_http_client_handle_t client)
                     if (client->is_async && errno == EAGAIN) {
                         return ESP_ERR_HTTP_EAGAIN;
                     }
+                    if (client->response->status_code == -1 && _retry_on_new_connection(client, &retried)) {
+                        break;
+                    }
                     return ESP_ERR_HTTP_FETCH_HEADER;
                 }
                 /* falls through */
@@ -868,6 +956,11 @@ esp_err_t esp_http_client_perform(esp_http_client_handle_t client)
                 if (!http_should_keep_alive(client->parser)) {
                     ESP_LOGD(TAG, "Close connection");
                     esp_http_client_close(client);
+                } else if (client->conn_pooled) {
+                    /* Only a connection the whole response was read from can take another request */
+                    _release_pooled_transport(client, client->is_chunk_complete &&
+                                              client->connection_info.method != HTTP_METHOD_HEAD);
+                    client->state = HTTP_STATE_INIT;
                 } else {
                     if (client->state > HTTP_STATE_CONNECTED) {
                         client->state = HTTP_STATE_CONNECTED;
@@ -924,7 +1017,22 @@ static esp_err_t esp_http_client_connect(esp_http_client_handle_t client)
 
     if (client->state < HTTP_STATE_CONNECTED) {
         ESP_LOGD(TAG, "Begin connect to: %s://%s:%d", client->connection_info.scheme, client->connection_info.host, client->connection_info.port);
-        client->transport = esp_transport_list_get_transport(client->transport_list, client->connection_info.scheme);
+        client->conn_reused = false;
+#ifdef CONFIG_HTTP_CLIENT_CONN_POOL
+        if (client->use_conn_pool) {
+            http_conn_key_t key;
+            _get_conn_key(client, &key);
+            if ((client->transport = http_conn_pool_get(&key)) != NULL) {
+                client->conn_reused = true;
+            } else {
+                client->transport = _create_pooled_transport(client);
+            }
+            client->conn_pooled = (client->transport != NULL);
+        } else
+#endif
+        {
+            client->transport = esp_transport_list_get_transport(client->transport_list, client->connection_info.scheme);
+        }
         if (client->transport == NULL) {
             ESP_LOGE(TAG, "No transport found");
 #ifndef CONFIG_ESP_HTTP_CLIENT_ENABLE_HTTPS
@@ -934,9 +1042,15 @@ static esp_err_t esp_http_client_connect(esp_http_client_handle_t client)
 #endif
             return ESP_ERR_HTTP_INVALID_TRANSPORT;
         }
+        if (client->conn_reused) {
+            /* Already connected, as if the client had kept the connection itself */
+            client->state = HTTP_STATE_CONNECTED;
+            return ESP_OK;
+        }
         if (!client->is_async) {
             if (esp_transport_connect(client->transport, client->connection_info.host, client->connection_info.port, client->timeout_ms) < 0) {
                 ESP_LOGE(TAG, "Connection failed, sock < 0");
+                _release_pooled_transport(client, false);
                 return ESP_ERR_HTTP_CONNECT;
             }
         } else {
@@ -997,9 +1111,10 @@ static int http_client_prepare_first_line(esp_http_client_handle_t client, int w
     return first_line_len;
 }
 
-static esp_err_t esp_http_client_request_send(esp_http_client_handle_t client, int write_len)
+static esp_err_t esp_http_client_request_send(esp_http_client_handle_t client, int write_len, bool with_post_data)
 {
     int first_line_len = 0;
+    bool post_data_sent = false;
     if (!client->first_line_prepared) {
         if ((first_line_len = http_client_prepare_first_line(client, write_len)) < 0) {
             return first_line_len;
@@ -1034,6 +1149,15 @@ static esp_err_t esp_http_client_request_send(esp_http_client_handle_t client, i
             wlen += first_line_len;
             first_line_len = 0;
         }
+        /* Post data fitting behind the end of the header goes out with it: written on its own, it would
+           wait for the ACK of the header, which the server delays on a connection kept alive */
+        if (with_post_data && !client->is_async && client->post_data && client->post_len > 0 &&
+                wlen >= 4 && memcmp(client->request->buffer->data + wlen - 4, "\r\n\r\n", 4) == 0 &&
+                client->post_len < client->buffer_size - wlen) {
+            memcpy(client->request->buffer->data + wlen, client->post_data, client->post_len);
+            wlen += client->post_len;
+            post_data_sent = true;
+        }
         client->request->buffer->data[wlen] = 0;
         ESP_LOGD(TAG, "Write header[%d]: %s", client->header_index, client->request->buffer->data);
 
@@ -1052,8 +1176,8 @@ static esp_err_t esp_http_client_request_send(esp_http_client_handle_t client, i
         wlen = client->buffer_size;
     }
 
-    client->data_written_index = 0;
-    client->data_write_left = client->post_len;
+    client->data_written_index = post_data_sent ? client->post_len : 0;
+    client->data_write_left = post_data_sent ? 0 : client->post_len;
     client->state = HTTP_STATE_REQ_COMPLETE_HEADER;
     return ESP_OK;
 }
@@ -1092,7 +1216,7 @@ esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len)
     if ((err = esp_http_client_connect(client)) != ESP_OK) {
         return err;
     }
-    if ((err = esp_http_client_request_send(client, write_len)) != ESP_OK) {
+    if ((err = esp_http_client_request_send(client, write_len, false)) != ESP_OK) {
         return err; 
     }
     return ESP_OK;
@@ -1123,6 +1247,10 @@ esp_err_t esp_http_client_close(esp_http_client_handle_t client)
     if (client->state >= HTTP_STATE_INIT) {
         http_dispatch_event(client, HTTP_EVENT_DISCONNECTED, NULL, 0);
         client->state = HTTP_STATE_INIT;
+        if (client->conn_pooled) {
+            _release_pooled_transport(client, false);
+            return ESP_OK;
+        }
         return esp_transport_close(client->transport);
     }
     return ESP_OK;
@@ -1183,3 +1311,11 @@ esp_http_client_transport_t esp_http_client_get_transport_type(esp_http_client_h
         return HTTP_TRANSPORT_UNKNOWN;
     }
 }
+
+esp_err_t esp_http_client_flush_connection_pool(void)
+{
+#ifdef CONFIG_HTTP_CLIENT_CONN_POOL
+    http_conn_pool_flush();
+#endif
+    return ESP_OK;
+}
@@ -115,6 +115,7 @@ typedef struct {
     int                         buffer_size;              /*!< HTTP buffer size (both send and receive) */
     void                        *user_data;               /*!< HTTP user_data context */
     bool                        is_async;                 /*!< Set asynchronous mode, only supported with HTTPS for now */
+    bool                        disable_connection_pool;  /*!< Keep the connection with the client rather than in the shared pool, see CONFIG_HTTP_CLIENT_CONN_POOL */
 } esp_http_client_config_t;
 
 
@@ -151,6 +152,8 @@ esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *co
  *             You can do any amount of calls to esp_http_client_perform while using the same esp_http_client_handle_t. The underlying connection may be kept open if the server allows it.
  *             If you intend to transfer more than one file, you are even encouraged to do so.
  *             esp_http_client will then attempt to re-use the same connection for the following transfers, thus making the operations faster, less CPU intense and using less network resources.
+ *             With CONFIG_HTTP_CLIENT_CONN_POOL, a connection kept open is put in a pool shared by all the clients after the transfer,
+ *             and any client transferring from the same scheme, host and port next takes it from there.
  *             Just note that you will have to use `esp_http_client_set_**` between the invokes to set options for the following esp_http_client_perform.
  *
  * @note       You must never call this function simultaneously from two places using the same client handle.
@@ -373,6 +376,15 @@ esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client);
  */
 esp_http_client_transport_t esp_http_client_get_transport_type(esp_http_client_handle_t client);
 
+/**
+ * @brief      Close all the idle connections kept in the connection pool, for instance after the network changed.
+ *             Connections in use by clients are not affected.
+ *
+ * @return
+ *     - ESP_OK
+ */
+esp_err_t esp_http_client_flush_connection_pool(void);
+
 
 #ifdef __cplusplus
 }
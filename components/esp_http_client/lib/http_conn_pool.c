@@ -0,0 +1,200 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "sys/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "http_conn_pool.h"
+
+#ifdef CONFIG_HTTP_CLIENT_CONN_POOL
+
+static const char *TAG = "HTTP_CONN_POOL";
+
+/**
+ * Idle connection, with its scheme and host stored behind it
+ */
+typedef struct http_conn {
+    esp_transport_handle_t transport;   /*!< Connected transport */
+    const char *scheme;                 /*!< Scheme, points into name */
+    const char *host;                   /*!< Host, points into name */
+    int port;                           /*!< Port */
+    const void *tls_config;             /*!< Certificate the server was verified with */
+    int64_t idle_since;                 /*!< Time it was returned to the pool, in microseconds */
+    TAILQ_ENTRY(http_conn) next;        /*!< Pool list, the most recently returned first */
+    char name[];                        /*!< Scheme and host, both zero terminated */
+} http_conn_t;
+
+TAILQ_HEAD(http_conn_list, http_conn);
+
+static struct http_conn_list s_idle = TAILQ_HEAD_INITIALIZER(s_idle);
+static int s_idle_count;
+
+/* The lock only guards the list, connections are checked and closed outside of it */
+static inline void http_conn_pool_lock(void)
+{
+    vTaskSuspendAll();
+}
+
+static inline void http_conn_pool_unlock(void)
+{
+    xTaskResumeAll();
+}
+
+static bool http_conn_match(const http_conn_t *conn, const http_conn_key_t *key)
+{
+    return conn->port == key->port &&
+           conn->tls_config == key->tls_config &&
+           strcasecmp(conn->host, key->host) == 0 &&
+           strcasecmp(conn->scheme, key->scheme) == 0;
+}
+
+static void http_conn_destroy(http_conn_t *conn)
+{
+    esp_transport_close(conn->transport);
+    esp_transport_destroy(conn->transport);
+    free(conn);
+}
+
+/* Moves the connections idle for too long to the expired list, called with the lock held */
+static void http_conn_pool_expire(struct http_conn_list *expired, int64_t now)
+{
+    http_conn_t *conn;
+
+    while ((conn = TAILQ_LAST(&s_idle, http_conn_list)) != NULL &&
+            now - conn->idle_since >= (int64_t)CONFIG_HTTP_CLIENT_CONN_POOL_IDLE_TIMEOUT_MS * 1000) {
+        TAILQ_REMOVE(&s_idle, conn, next);
+        TAILQ_INSERT_TAIL(expired, conn, next);
+        s_idle_count--;
+    }
+}
+
+static void http_conn_pool_destroy_list(struct http_conn_list *list)
+{
+    http_conn_t *conn;
+
+    while ((conn = TAILQ_FIRST(list)) != NULL) {
+        TAILQ_REMOVE(list, conn, next);
+        ESP_LOGD(TAG, "Close idle connection to %s://%s:%d", conn->scheme, conn->host, conn->port);
+        http_conn_destroy(conn);
+    }
+}
+
+esp_transport_handle_t http_conn_pool_get(const http_conn_key_t *key)
+{
+    struct http_conn_list expired = TAILQ_HEAD_INITIALIZER(expired);
+    esp_transport_handle_t t = NULL;
+    http_conn_t *conn;
+
+    while (t == NULL) {
+        http_conn_pool_lock();
+        http_conn_pool_expire(&expired, esp_timer_get_time());
+        TAILQ_FOREACH(conn, &s_idle, next) {
+            if (http_conn_match(conn, key)) {
+                TAILQ_REMOVE(&s_idle, conn, next);
+                s_idle_count--;
+                break;
+            }
+        }
+        http_conn_pool_unlock();
+
+        if (conn == NULL) {
+            break;
+        }
+        /* Nothing is expected from the server on an idle connection: if it can be read,
+         * the server closed it, or the connection failed */
+        if (esp_transport_poll_read(conn->transport, 0) != 0) {
+            ESP_LOGD(TAG, "Idle connection to %s://%s:%d was closed", conn->scheme, conn->host, conn->port);
+            TAILQ_INSERT_TAIL(&expired, conn, next);
+            continue;
+        }
+        ESP_LOGD(TAG, "Reuse connection to %s://%s:%d", conn->scheme, conn->host, conn->port);
+        t = conn->transport;
+        free(conn);
+    }
+
+    http_conn_pool_destroy_list(&expired);
+    return t;
+}
+
+void http_conn_pool_put(const http_conn_key_t *key, esp_transport_handle_t t)
+{
+    struct http_conn_list expired = TAILQ_HEAD_INITIALIZER(expired);
+    size_t scheme_len = strlen(key->scheme) + 1;
+    size_t host_len = strlen(key->host) + 1;
+    http_conn_t *conn = malloc(sizeof(http_conn_t) + scheme_len + host_len);
+
+    if (conn == NULL) {
+        esp_transport_close(t);
+        esp_transport_destroy(t);
+        return;
+    }
+    conn->transport = t;
+    conn->scheme = memcpy(conn->name, key->scheme, scheme_len);
+    conn->host = memcpy(conn->name + scheme_len, key->host, host_len);
+    conn->port = key->port;
+    conn->tls_config = key->tls_config;
+    conn->idle_since = esp_timer_get_time();
+
+    http_conn_pool_lock();
+    http_conn_pool_expire(&expired, conn->idle_since);
+
+    http_conn_t *it;
+    int per_host = 0;
+    TAILQ_FOREACH(it, &s_idle, next) {
+        per_host += http_conn_match(it, key);
+    }
+    if (per_host >= CONFIG_HTTP_CLIENT_CONN_POOL_MAX_PER_HOST) {
+        TAILQ_INSERT_TAIL(&expired, conn, next);
+    } else {
+        if (s_idle_count >= CONFIG_HTTP_CLIENT_CONN_POOL_SIZE) {
+            it = TAILQ_LAST(&s_idle, http_conn_list);
+            TAILQ_REMOVE(&s_idle, it, next);
+            TAILQ_INSERT_TAIL(&expired, it, next);
+            s_idle_count--;
+        }
+        TAILQ_INSERT_HEAD(&s_idle, conn, next);
+        s_idle_count++;
+    }
+    http_conn_pool_unlock();
+
+    http_conn_pool_destroy_list(&expired);
+}
+
+void http_conn_pool_flush(void)
+{
+    struct http_conn_list flushed = TAILQ_HEAD_INITIALIZER(flushed);
+
+    http_conn_pool_lock();
+    TAILQ_CONCAT(&flushed, &s_idle, next);
+    s_idle_count = 0;
+    http_conn_pool_unlock();
+
+    http_conn_pool_destroy_list(&flushed);
+}
+
+int http_conn_pool_idle_count(void)
+{
+    return s_idle_count;
+}
+
+#endif /* CONFIG_HTTP_CLIENT_CONN_POOL */
@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include "esp_log.h"
+#include "esp_mempool.h"
 #include "http_header.h"
 #include "http_utils.h"
 
@@ -34,20 +35,60 @@ typedef struct http_header_item {
     STAILQ_ENTRY(http_header_item) next;   /*!< Point to next entry */
 } http_header_item_t;
 
-STAILQ_HEAD(http_header, http_header_item);
+STAILQ_HEAD(http_header_list, http_header_item);
 
+/**
+ * header list, with the pool its items are preferably taken from
+ */
+struct http_header {
+    struct http_header_list items;      /*!< header items */
+    esp_mempool_handle_t item_pool;     /*!< preallocated header items */
+};
+
+static http_header_item_handle_t http_header_item_alloc(http_header_handle_t header)
+{
+    http_header_item_handle_t item = NULL;
+
+    if (header->item_pool) {
+        item = esp_mempool_alloc(header->item_pool);
+    }
+    if (item) {
+        memset(item, 0, sizeof(http_header_item_t));
+    } else {
+        item = calloc(1, sizeof(http_header_item_t));
+    }
+    return item;
+}
+
+static void http_header_item_free(http_header_handle_t header, http_header_item_handle_t item)
+{
+    free(item->key);
+    free(item->value);
+    if (esp_mempool_is_from(header->item_pool, item)) {
+        esp_mempool_free(header->item_pool, item);
+    } else {
+        free(item);
+    }
+}
 
 http_header_handle_t http_header_init()
 {
     http_header_handle_t header = calloc(1, sizeof(struct http_header));
     HTTP_MEM_CHECK(TAG, header, return NULL);
-    STAILQ_INIT(header);
+    STAILQ_INIT(&header->items);
+#if CONFIG_HTTP_HEADER_ITEM_POOL_SIZE > 0
+    header->item_pool = esp_mempool_create(sizeof(http_header_item_t), CONFIG_HTTP_HEADER_ITEM_POOL_SIZE, MALLOC_CAP_8BIT, 0);
+    if (header->item_pool == NULL) {
+        ESP_LOGW(TAG, "No memory for header item pool, use heap");
+    }
+#endif
     return header;
 }
 
 esp_err_t http_header_destroy(http_header_handle_t header)
 {
     esp_err_t err = http_header_clean(header);
+    esp_mempool_delete(header->item_pool);
     free(header);
     return err;
 }
@@ -58,7 +99,7 @@ http_header_item_handle_t http_header_get_item(http_header_handle_t header, cons
     if (header == NULL || key == NULL) {
         return NULL;
     }
-    STAILQ_FOREACH(item, header, next) {
+    STAILQ_FOREACH(item, &header->items, next) {
         if (strcasecmp(item->key, key) == 0) {
             return item;
         }
@@ -84,7 +125,7 @@ static esp_err_t http_header_new_item(http_header_handle_t header, const char *k
 {
     http_header_item_handle_t item;
 
-    item = calloc(1, sizeof(http_header_item_t));
+    item = http_header_item_alloc(header);
     HTTP_MEM_CHECK(TAG, item, return ESP_ERR_NO_MEM);
     http_utils_assign_string(&item->key, key, 0);
     HTTP_MEM_CHECK(TAG, item->key, goto _header_new_item_exit);
@@ -92,11 +133,10 @@ static esp_err_t http_header_new_item(http_header_handle_t header, const char *k
     http_utils_assign_string(&item->value, value, 0);
     HTTP_MEM_CHECK(TAG, item->value, goto _header_new_item_exit);
     http_utils_trim_whitespace(&item->value);
-    STAILQ_INSERT_TAIL(header, item, next);
+    STAILQ_INSERT_TAIL(&header->items, item, next);
     return ESP_OK;
 _header_new_item_exit:
-    free(item->key);
-    free(item->value);
+    http_header_item_free(header, item);
     return ESP_ERR_NO_MEM;
 }
 
@@ -143,10 +183,8 @@ esp_err_t http_header_delete(http_header_handle_t header, const char *key)
 {
     http_header_item_handle_t item = http_header_get_item(header, key);
     if (item) {
-        STAILQ_REMOVE(header, item, http_header_item, next);
-        free(item->key);
-        free(item->value);
-        free(item);
+        STAILQ_REMOVE(&header->items, item, http_header_item, next);
+        http_header_item_free(header, item);
     } else {
         return ESP_ERR_NOT_FOUND;
     }
@@ -178,7 +216,7 @@ int http_header_generate_string(http_header_handle_t header, int index, char *bu
     int idx = 0;
     int ret_idx = -1;
     bool is_end = false;
-    STAILQ_FOREACH(item, header, next) {
+    STAILQ_FOREACH(item, &header->items, next) {
         if (item->value && idx >= index) {
             siz += strlen(item->key);
             siz += strlen(item->value);
@@ -201,7 +239,7 @@ int http_header_generate_string(http_header_handle_t header, int index, char *bu
 
     int str_len = 0;
     idx = 0;
-    STAILQ_FOREACH(item, header, next) {
+    STAILQ_FOREACH(item, &header->items, next) {
         if (item->value && idx >= index && idx < ret_idx) {
             str_len += snprintf(buffer + str_len, *buffer_len - str_len, "%s: %s\r\n", item->key, item->value);
         }
@@ -216,15 +254,13 @@ int http_header_generate_string(http_header_handle_t header, int index, char *bu
 
 esp_err_t http_header_clean(http_header_handle_t header)
 {
-    http_header_item_handle_t item = STAILQ_FIRST(header), tmp;
+    http_header_item_handle_t item = STAILQ_FIRST(&header->items), tmp;
     while (item != NULL) {
         tmp = STAILQ_NEXT(item, next);
-        free(item->key);
-        free(item->value);
-        free(item);
+        http_header_item_free(header, item);
         item = tmp;
     }
-    STAILQ_INIT(header);
+    STAILQ_INIT(&header->items);
     return ESP_OK;
 }
 
@@ -232,7 +268,7 @@ int http_header_count(http_header_handle_t header)
 {
     http_header_item_handle_t item;
     int count = 0;
-    STAILQ_FOREACH(item, header, next) {
+    STAILQ_FOREACH(item, &header->items, next) {
         count ++;
     }
     return count;
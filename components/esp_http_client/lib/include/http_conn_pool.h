@@ -0,0 +1,76 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _HTTP_CONN_POOL_H_
+#define _HTTP_CONN_POOL_H_
+
+#include "esp_transport.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Connections are shared by the clients connecting to the same scheme, host and port,
+ * with the same TLS settings, which are told apart by the certificate they verify.
+ */
+typedef struct {
+    const char *scheme;         /*!< Scheme, "http" or "https" */
+    const char *host;           /*!< Host name or address */
+    int         port;           /*!< Port */
+    const void *tls_config;     /*!< Certificate the server is verified with, NULL if none */
+} http_conn_key_t;
+
+/**
+ * @brief      Take an idle connection from the pool. Connections idle for longer than
+ *             CONFIG_HTTP_CLIENT_CONN_POOL_IDLE_TIMEOUT_MS, and those the server has
+ *             closed or sent unexpected data on, are closed instead of returned.
+ *
+ * @param[in]  key   The destination of the connection
+ *
+ * @return
+ *     - Connected transport, owned by the caller until returned by http_conn_pool_put()
+ *     - NULL if there is no idle connection to the destination
+ */
+esp_transport_handle_t http_conn_pool_get(const http_conn_key_t *key);
+
+/**
+ * @brief      Return a connection to the pool, after a response was read completely from it.
+ *             The connection is closed and destroyed if the pool holds
+ *             CONFIG_HTTP_CLIENT_CONN_POOL_MAX_PER_HOST idle connections to the destination already,
+ *             or if it is out of memory. If the pool holds CONFIG_HTTP_CLIENT_CONN_POOL_SIZE idle
+ *             connections, the one idle the longest is closed to make room.
+ *
+ * @param[in]  key   The destination of the connection
+ * @param[in]  t     The connected transport, the pool owns it afterwards
+ */
+void http_conn_pool_put(const http_conn_key_t *key, esp_transport_handle_t t);
+
+/**
+ * @brief      Close and destroy all the idle connections of the pool
+ */
+void http_conn_pool_flush(void);
+
+/**
+ * @brief      Get the number of idle connections in the pool
+ *
+ * @return     Number of idle connections
+ */
+int http_conn_pool_idle_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,25 @@
+// Host build stub of esp_mempool.h, the header items are taken from the heap with a pool size of 0
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct esp_mempool *esp_mempool_handle_t;
+
+static inline void *esp_mempool_alloc(esp_mempool_handle_t pool)
+{
+    return NULL;
+}
+
+static inline bool esp_mempool_is_from(esp_mempool_handle_t pool, void *ptr)
+{
+    return false;
+}
+
+static inline void esp_mempool_free(esp_mempool_handle_t pool, void *ptr)
+{
+}
+
+static inline void esp_mempool_delete(esp_mempool_handle_t pool)
+{
+}
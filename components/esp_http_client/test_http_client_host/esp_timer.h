@@ -0,0 +1,6 @@
+// Host build stub of esp_timer.h, the test defines esp_timer_get_time() to be able to skip time
+#pragma once
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
@@ -0,0 +1,10 @@
+// Host build stub of esp_tls.h, only the error record kept by the transports
+#pragma once
+
+#include "esp_err.h"
+
+typedef struct esp_tls_last_error {
+    esp_err_t last_error;
+    int       esp_tls_error_code;
+    int       esp_tls_flags;
+} esp_tls_last_error_t;
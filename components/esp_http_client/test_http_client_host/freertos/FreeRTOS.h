@@ -0,0 +1,5 @@
+// Host build stub of FreeRTOS.h, the test runs the client in one thread
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
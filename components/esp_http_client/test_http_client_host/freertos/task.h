@@ -0,0 +1,13 @@
+// Host build stub of task.h, the scheduler does not need to be suspended in one thread
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+static inline void vTaskSuspendAll(void)
+{
+}
+
+static inline int xTaskResumeAll(void)
+{
+    return 0;
+}
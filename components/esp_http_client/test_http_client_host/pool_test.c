@@ -0,0 +1,435 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Check and measure the connection pool of the HTTP client. First the limits of the pool are
+ * checked with transports which only count how often they are closed. Then the client posts to
+ * a stand-in server, run in a thread of the test, which listens on three ports for three hosts
+ * and counts the connections it accepts. Like a telemetry uploader, a new client is created for
+ * every request: with the pool, each host is connected to once. The server closing the idle
+ * connections, dropping a request on a reused connection and the idle timeout are checked to
+ * lead to new connections without failing a request. At last the time of a request is measured
+ * with and without the pool, on loopback TCP, which leaves out the TLS handshake the pool spares
+ * on HTTPS connections.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "esp_http_client.h"
+#include "esp_timer.h"
+#include "http_auth.h"
+#include "http_conn_pool.h"
+
+#define SERVER_HOSTS        3
+#define SERVER_CONNS        64
+#define BENCH_REQUESTS      600
+#define BENCH_RUNS          3
+
+static int64_t s_time_skipped;
+
+static inline uint64_t bench_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void expect(int ok, const char *what)
+{
+    if (!ok) {
+        printf("check failed: %s\n", what);
+        exit(1);
+    }
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return bench_ns() / 1000 + s_time_skipped;
+}
+
+/* The test uses no authentication */
+char *http_auth_digest(const char *username, const char *password, esp_http_auth_data_t *auth_data)
+{
+    return NULL;
+}
+
+char *http_auth_basic(const char *username, const char *password)
+{
+    return NULL;
+}
+
+/* ------------------------------------------ Pool limits ------------------------------------------ */
+
+static int s_closed;
+
+static int counted_close(esp_transport_handle_t t)
+{
+    s_closed++;
+    return 0;
+}
+
+/* Nothing to read, the connection is healthy */
+static int idle_poll_read(esp_transport_handle_t t, int timeout_ms)
+{
+    return 0;
+}
+
+static esp_transport_handle_t counted_transport(void)
+{
+    esp_transport_handle_t t = esp_transport_init();
+    esp_transport_set_func(t, NULL, NULL, NULL, counted_close, idle_poll_read, NULL, NULL);
+    return t;
+}
+
+static void check_pool_limits(void)
+{
+    http_conn_key_t a = { "http", "a.example.com", 80, NULL };
+    http_conn_key_t b = { "http", "b.example.com", 80, NULL };
+    http_conn_key_t a_tls = { "https", "a.example.com", 443, "cert" };
+    esp_transport_handle_t t[CONFIG_HTTP_CLIENT_CONN_POOL_SIZE + 2];
+
+    /* Per host limit: the connection returned beyond it is closed */
+    s_closed = 0;
+    for (int i = 0; i < CONFIG_HTTP_CLIENT_CONN_POOL_MAX_PER_HOST + 1; i++) {
+        http_conn_pool_put(&a, counted_transport());
+    }
+    expect(http_conn_pool_idle_count() == CONFIG_HTTP_CLIENT_CONN_POOL_MAX_PER_HOST, "idle per host limited");
+    expect(s_closed == 1, "connection beyond the host limit closed");
+
+    /* Connections to other hosts, schemes or certificates are not taken */
+    expect(http_conn_pool_get(&b) == NULL, "no connection to another host");
+    expect(http_conn_pool_get(&a_tls) == NULL, "no connection with another scheme");
+    t[0] = http_conn_pool_get(&a);
+    expect(t[0] != NULL, "connection to the host taken");
+    expect(http_conn_pool_idle_count() == CONFIG_HTTP_CLIENT_CONN_POOL_MAX_PER_HOST - 1, "connection left the pool");
+    http_conn_pool_put(&a, t[0]);
+
+    /* Pool limit: the connection idle the longest is closed, the newest ones stay */
+    s_closed = 0;
+    for (int i = 0; i < CONFIG_HTTP_CLIENT_CONN_POOL_SIZE; i++) {
+        char host[16];
+        snprintf(host, sizeof(host), "h%d", i);
+        http_conn_key_t key = { "http", host, 80, NULL };
+        http_conn_pool_put(&key, counted_transport());
+    }
+    expect(http_conn_pool_idle_count() == CONFIG_HTTP_CLIENT_CONN_POOL_SIZE, "idle connections limited");
+    expect(s_closed == CONFIG_HTTP_CLIENT_CONN_POOL_MAX_PER_HOST, "oldest connections closed");
+    expect(http_conn_pool_get(&a) == NULL, "oldest connections gone");
+
+    /* Idle timeout */
+    s_closed = 0;
+    s_time_skipped += (int64_t)CONFIG_HTTP_CLIENT_CONN_POOL_IDLE_TIMEOUT_MS * 1000;
+    expect(http_conn_pool_get(&a) == NULL && http_conn_pool_idle_count() == 0, "idle connections expired");
+    expect(s_closed == CONFIG_HTTP_CLIENT_CONN_POOL_SIZE, "expired connections closed");
+
+    http_conn_pool_put(&b, counted_transport());
+    s_closed = 0;
+    esp_http_client_flush_connection_pool();
+    expect(http_conn_pool_idle_count() == 0 && s_closed == 1, "pool flushed");
+}
+
+/* ------------------------------------------ Stand-in server ------------------------------------------ */
+
+typedef enum {
+    SERVER_CMD_CLOSE_IDLE = 'c',        /* Close all connections */
+    SERVER_CMD_DROP_NEXT = 'd',         /* Close the connection of the next request without responding */
+    SERVER_CMD_QUIT = 'q',
+} server_cmd_t;
+
+typedef struct {
+    int fd;
+    int host;
+    size_t len;
+    char buf[1024];
+} server_conn_t;
+
+static struct {
+    int listen_fd[SERVER_HOSTS];
+    int port[SERVER_HOSTS];
+    int accepts[SERVER_HOSTS];
+    int requests;
+    int ctl[2];
+    bool drop_next;
+    server_conn_t conns[SERVER_CONNS];
+} s_server;
+
+static void server_close(server_conn_t *conn)
+{
+    close(conn->fd);
+    conn->fd = -1;
+}
+
+/* Answers the complete requests received on a connection */
+static void server_process(server_conn_t *conn)
+{
+    static const char response[] = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 2\r\n\r\nok";
+
+    for (;;) {
+        conn->buf[conn->len] = '\0';
+        char *end = strstr(conn->buf, "\r\n\r\n");
+        if (end == NULL) {
+            return;
+        }
+        size_t body = 0;
+        char *cl = strcasestr(conn->buf, "Content-Length:");
+        if (cl && cl < end) {
+            body = strtoul(cl + strlen("Content-Length:"), NULL, 10);
+        }
+        size_t req_len = end + 4 - conn->buf + body;
+        if (conn->len < req_len) {
+            return;
+        }
+        s_server.requests++;
+        if (s_server.drop_next) {
+            s_server.drop_next = false;
+            server_close(conn);
+            return;
+        }
+        expect(write(conn->fd, response, sizeof(response) - 1) == sizeof(response) - 1, "response sent");
+        memmove(conn->buf, conn->buf + req_len, conn->len - req_len);
+        conn->len -= req_len;
+    }
+}
+
+static void *server_task(void *arg)
+{
+    struct pollfd fds[1 + SERVER_HOSTS + SERVER_CONNS];
+
+    for (;;) {
+        int n = 0;
+        fds[n++] = (struct pollfd) { .fd = s_server.ctl[1], .events = POLLIN };
+        for (int h = 0; h < SERVER_HOSTS; h++) {
+            fds[n++] = (struct pollfd) { .fd = s_server.listen_fd[h], .events = POLLIN };
+        }
+        for (int i = 0; i < SERVER_CONNS; i++) {
+            fds[n++] = (struct pollfd) { .fd = s_server.conns[i].fd, .events = POLLIN };
+        }
+        expect(poll(fds, n, -1) > 0, "server poll");
+
+        for (int i = 0; i < SERVER_CONNS; i++) {
+            server_conn_t *conn = &s_server.conns[i];
+            if (conn->fd >= 0 && fds[1 + SERVER_HOSTS + i].revents) {
+                ssize_t len = read(conn->fd, conn->buf + conn->len, sizeof(conn->buf) - 1 - conn->len);
+                if (len <= 0) {
+                    server_close(conn);
+                } else {
+                    conn->len += len;
+                    server_process(conn);
+                }
+            }
+        }
+        for (int h = 0; h < SERVER_HOSTS; h++) {
+            if (fds[1 + h].revents & POLLIN) {
+                int fd = accept(s_server.listen_fd[h], NULL, NULL);
+                expect(fd >= 0, "accept");
+                int i = 0;
+                while (s_server.conns[i].fd >= 0) {
+                    expect(++i < SERVER_CONNS, "server connections");
+                }
+                s_server.conns[i] = (server_conn_t) { .fd = fd, .host = h };
+                s_server.accepts[h]++;
+            }
+        }
+        if (fds[0].revents & POLLIN) {
+            char cmd;
+            expect(read(s_server.ctl[1], &cmd, 1) == 1, "server command");
+            if (cmd == SERVER_CMD_CLOSE_IDLE) {
+                for (int i = 0; i < SERVER_CONNS; i++) {
+                    if (s_server.conns[i].fd >= 0) {
+                        server_close(&s_server.conns[i]);
+                    }
+                }
+            } else if (cmd == SERVER_CMD_DROP_NEXT) {
+                s_server.drop_next = true;
+            }
+            expect(write(s_server.ctl[1], &cmd, 1) == 1, "server command done");
+            if (cmd == SERVER_CMD_QUIT) {
+                return NULL;
+            }
+        }
+    }
+}
+
+static void server_command(server_cmd_t cmd)
+{
+    char done = cmd;
+    expect(write(s_server.ctl[0], &done, 1) == 1 && read(s_server.ctl[0], &done, 1) == 1, "server command");
+    /* Let the client see the connections closed */
+    usleep(10000);
+}
+
+static pthread_t server_start(void)
+{
+    pthread_t thread;
+
+    for (int i = 0; i < SERVER_CONNS; i++) {
+        s_server.conns[i].fd = -1;
+    }
+    for (int h = 0; h < SERVER_HOSTS; h++) {
+        struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+        socklen_t addr_len = sizeof(addr);
+        s_server.listen_fd[h] = socket(AF_INET, SOCK_STREAM, 0);
+        expect(bind(s_server.listen_fd[h], (struct sockaddr *)&addr, sizeof(addr)) == 0, "bind");
+        expect(listen(s_server.listen_fd[h], 128) == 0, "listen");
+        getsockname(s_server.listen_fd[h], (struct sockaddr *)&addr, &addr_len);
+        s_server.port[h] = ntohs(addr.sin_port);
+    }
+    expect(socketpair(AF_UNIX, SOCK_STREAM, 0, s_server.ctl) == 0, "server control");
+    expect(pthread_create(&thread, NULL, server_task, NULL) == 0, "server thread");
+    return thread;
+}
+
+static int server_accepts(void)
+{
+    int accepts = 0;
+    for (int h = 0; h < SERVER_HOSTS; h++) {
+        accepts += s_server.accepts[h];
+    }
+    return accepts;
+}
+
+/* ------------------------------------------ Client checks ------------------------------------------ */
+
+/* Posts a record with a new client, like an uploader waking up now and then */
+static void post(int host, bool disable_connection_pool)
+{
+    static const char record[] = "{\"temperature\":21.5}";
+    char url[64];
+
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/telemetry", s_server.port[host]);
+    esp_http_client_config_t config = {
+        .url = url,
+        .method = HTTP_METHOD_POST,
+        .disable_connection_pool = disable_connection_pool,
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    expect(client != NULL, "client created");
+    esp_http_client_set_post_field(client, record, sizeof(record) - 1);
+    expect(esp_http_client_perform(client) == ESP_OK, "request performed");
+    expect(esp_http_client_get_status_code(client) == 200, "response status");
+    esp_http_client_cleanup(client);
+}
+
+static void check_client(void)
+{
+    /* Every host is connected to once, whatever the number of requests */
+    for (int i = 0; i < 10; i++) {
+        for (int h = 0; h < SERVER_HOSTS; h++) {
+            post(h, false);
+        }
+    }
+    expect(s_server.accepts[0] == 1 && s_server.accepts[1] == 1 && s_server.accepts[2] == 1, "one connection per host");
+    expect(http_conn_pool_idle_count() == SERVER_HOSTS, "connections idle in the pool");
+
+    /* Clients out of the pool connect every time */
+    for (int i = 0; i < 10; i++) {
+        post(0, true);
+    }
+    expect(s_server.accepts[0] == 11, "connection per request without the pool");
+
+    /* The server closed the idle connections: found out before sending the request */
+    int accepts = server_accepts();
+    server_command(SERVER_CMD_CLOSE_IDLE);
+    post(1, false);
+    expect(server_accepts() == accepts + 1, "closed idle connection not reused");
+
+    /* The server closed the connection while the request was sent: sent again on a new one */
+    accepts = server_accepts();
+    int requests = s_server.requests;
+    server_command(SERVER_CMD_DROP_NEXT);
+    post(1, false);
+    expect(server_accepts() == accepts + 1 && s_server.requests == requests + 2, "dropped request sent again");
+
+    /* A request failing on a new connection is not sent again */
+    server_command(SERVER_CMD_CLOSE_IDLE);
+    server_command(SERVER_CMD_DROP_NEXT);
+    requests = s_server.requests;
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/telemetry", s_server.port[2]);
+    esp_http_client_config_t config = { .url = url };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    expect(esp_http_client_perform(client) != ESP_OK, "request on a new connection failed");
+    expect(s_server.requests == requests + 1, "request on a new connection sent once");
+    esp_http_client_cleanup(client);
+
+    /* Connections idle for too long are closed */
+    post(2, false);
+    accepts = server_accepts();
+    s_time_skipped += (int64_t)CONFIG_HTTP_CLIENT_CONN_POOL_IDLE_TIMEOUT_MS * 1000;
+    post(2, false);
+    expect(server_accepts() == accepts + 1, "expired connection not reused");
+
+    esp_http_client_flush_connection_pool();
+    expect(http_conn_pool_idle_count() == 0, "pool flushed");
+}
+
+/* ------------------------------------------- Benchmark ------------------------------------------- */
+
+static double bench_requests(bool disable_connection_pool, int *connects)
+{
+    double best = 0;
+
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        esp_http_client_flush_connection_pool();
+        int accepts = server_accepts();
+        uint64_t start = bench_ns();
+        for (int n = 0; n < BENCH_REQUESTS; n++) {
+            post(n % SERVER_HOSTS, disable_connection_pool);
+        }
+        double ns = (double)(bench_ns() - start) / BENCH_REQUESTS;
+        if (run == 0 || ns < best) {
+            best = ns;
+        }
+        *connects = server_accepts() - accepts;
+    }
+    return best;
+}
+
+int main(void)
+{
+    check_pool_limits();
+    printf("pool limits: ok\n");
+
+    pthread_t server = server_start();
+    check_client();
+    printf("client: ok\n");
+
+    int connects_pool, connects_none;
+    double ns_none = bench_requests(true, &connects_none);
+    double ns_pool = bench_requests(false, &connects_pool);
+    printf("%d requests to %d hosts over loopback TCP, a client per request, best of %d runs\n",
+           BENCH_REQUESTS, SERVER_HOSTS, BENCH_RUNS);
+    printf("%-16s %10s %14s\n", "", "connects", "us/request");
+    printf("%-16s %10d %14.1f\n", "without pool", connects_none, ns_none / 1000);
+    printf("%-16s %10d %14.1f\n", "with pool", connects_pool, ns_pool / 1000);
+
+    esp_http_client_flush_connection_pool();
+    server_command(SERVER_CMD_QUIT);
+    pthread_join(server, NULL);
+    return 0;
+}
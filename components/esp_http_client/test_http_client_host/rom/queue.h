@@ -0,0 +1,4 @@
+// Host build stub of rom/queue.h
+#pragma once
+
+#include <sys/queue.h>
@@ -0,0 +1,9 @@
+// Host build stub of sdkconfig.h, the defaults of the HTTP client options without HTTPS
+#pragma once
+
+#define CONFIG_HTTP_BUF_SIZE                        512
+#define CONFIG_HTTP_HEADER_ITEM_POOL_SIZE           0
+#define CONFIG_HTTP_CLIENT_CONN_POOL                1
+#define CONFIG_HTTP_CLIENT_CONN_POOL_SIZE           4
+#define CONFIG_HTTP_CLIENT_CONN_POOL_MAX_PER_HOST   2
+#define CONFIG_HTTP_CLIENT_CONN_POOL_IDLE_TIMEOUT_MS 30000
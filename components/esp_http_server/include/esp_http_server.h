@@ -282,6 +282,9 @@ esp_err_t httpd_stop(httpd_handle_t handle);
 /* Max supported HTTP request URI length */
 #define HTTPD_MAX_URI_LEN CONFIG_HTTPD_MAX_URI_LEN
 
+/* Max path parameters, "{name}" segments and a trailing "*", in a registered URI */
+#define HTTPD_MAX_PATH_PARAMS 8
+
 /**
  * @brief HTTP Request Data Structure
  */
@@ -351,6 +354,20 @@ typedef struct httpd_uri {
  * @note    URI handlers can be registered in real time as long as the
  *          server handle is valid.
  *
+ * The URI is matched against the path of a request segment by segment,
+ * the segments being the parts between '/' characters. Besides literal
+ * segments, which must be equal, a URI may contain:
+ *  - "{name}" : a path parameter, matching any non-empty segment
+ *  - "*"      : as the last segment, matching the rest of the path,
+ *               e.g. "/api/v1/device/ *" (without the space) matches
+ *               "/api/v1/device/" and "/api/v1/device/3/state"
+ *
+ * When several URIs match a path, literal segments take precedence over
+ * path parameters, which take precedence over "*". The handler can fetch
+ * the segments matched with httpd_req_get_path_param(). The cost of the
+ * lookup depends on the number of segments of the path, not on the number
+ * of handlers registered.
+ *
  * Example usage:
  * @code{c}
  *
@@ -392,10 +409,14 @@ typedef struct httpd_uri {
  *
  * @return
  *  - ESP_OK : On successfully registering the handler
- *  - ESP_ERR_INVALID_ARG : Null arguments
+ *  - ESP_ERR_INVALID_ARG : Null arguments, or more than HTTPD_MAX_PATH_PARAMS
+ *                          path parameters in the URI
  *  - ESP_ERR_HTTPD_HANDLERS_FULL  : If no slots left for new handler
  *  - ESP_ERR_HTTPD_HANDLER_EXISTS : If handler with same URI and
- *                                   method is already registered
+ *                                   method is already registered.
+ *                                   URIs differing only in the names of
+ *                                   path parameters are the same.
+ *  - ESP_ERR_HTTPD_ALLOC_MEM : Failed to allocate memory for the handler
  */
 esp_err_t httpd_register_uri_handler(httpd_handle_t handle,
                                      const httpd_uri_t *uri_handler);
@@ -744,6 +765,34 @@ esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len)
  */
 esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size);
 
+/**
+ * @brief   Get the value of a path parameter of the request URL
+ *
+ * Path parameters are the segments of the request path matched by the
+ * "{name}" segments of the URI the handler was registered with, and the
+ * rest of the path matched by a trailing "*", which has the name "*".
+ *
+ * @note
+ *  - This API is supposed to be called only from the context of
+ *    a URI handler where httpd_req_t* request pointer is valid
+ *  - The value is not URLdecoded
+ *  - If actual value size is greater than val_size, then the value is truncated,
+ *    accompanied by truncation error as return value.
+ *
+ * @param[in]  r         The request being responded to
+ * @param[in]  name      The name of the parameter, without the braces
+ * @param[out] val       Pointer to the buffer into which the value will be copied if found
+ * @param[in]  val_size  Size of the user buffer "val"
+ *
+ * @return
+ *  - ESP_OK : Parameter is found in the URI of the handler and its value copied to buffer
+ *  - ESP_ERR_NOT_FOUND          : Parameter not found
+ *  - ESP_ERR_INVALID_ARG        : Null arguments
+ *  - ESP_ERR_HTTPD_INVALID_REQ  : Invalid HTTP request pointer
+ *  - ESP_ERR_HTTPD_RESULT_TRUNC : Value string truncated
+ */
+esp_err_t httpd_req_get_path_param(httpd_req_t *r, const char *name, char *val, size_t val_size);
+
 /**
  * @brief   API to send a complete HTTP response.
  *
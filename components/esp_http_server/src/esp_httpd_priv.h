@@ -17,6 +17,7 @@
 #define _HTTPD_PRIV_H_
 
 #include <stdbool.h>
+#include <sys/queue.h>
 #include <sys/socket.h>
 #include <sys/param.h>
 #include <netinet/in.h>
@@ -125,7 +126,9 @@ struct sock_db {
     httpd_send_func_t send_fn;              /*!< Send function for this socket */
     httpd_recv_func_t recv_fn;              /*!< Receive function for this socket */
     httpd_pending_func_t pending_fn;        /*!< Pending function for this socket */
-    uint64_t lru_counter;                   /*!< LRU Counter indicating when the socket was last used */
+    struct sock_db *index_next;             /*!< Next session in the same bucket of the descriptor index */
+    SLIST_ENTRY(sock_db) free_entry;        /*!< Entry in the list of free socket database slots */
+    TAILQ_ENTRY(sock_db) lru_entry;         /*!< Entry in the list of open sessions, least recently used first */
     char pending_data[PARSER_BLOCK_SIZE];   /*!< Buffer for pending data to be received */
     size_t pending_len;                     /*!< Length of pending data to be received */
 };
@@ -148,8 +151,19 @@ struct httpd_req_aux {
         const char *value;
     } *resp_hdrs;                                   /*!< Additional headers in response packet */
     struct http_parser_url url_parse_res;           /*!< URL parsing result, used for retrieving URL elements */
+    const httpd_uri_t *uri_handler;                 /*!< URI handler matching the request, NULL if none */
+    unsigned        path_params_count;              /*!< Count of path parameters matched */
+    struct path_param {
+        uint16_t off;                               /*!< Offset of the value in the URI of the request */
+        uint16_t len;                               /*!< Length of the value */
+    } path_params[HTTPD_MAX_PATH_PARAMS];           /*!< Path parameters, in the order of the URI of the handler */
 };
 
+/**
+ * @brief   Node of the tree of registered URI handlers, a segment of their URIs
+ */
+struct httpd_uri_node;
+
 /**
  * @brief   Server data for each instance. This is exposed publicaly as
  *          httpd_handle_t but internal structure/members are kept private.
@@ -161,7 +175,17 @@ struct httpd_data {
     int msg_fd;                             /*!< Ctrl message sender FD */
     struct thread_data hd_td;               /*!< Information for the HTTPd thread */
     struct sock_db *hd_sd;                  /*!< The socket database */
+    struct sock_db **hd_sd_index;           /*!< Open sessions by descriptor, in buckets chained through index_next */
+    unsigned hd_sd_index_mask;              /*!< Number of buckets of the descriptor index minus one */
+    SLIST_HEAD(, sock_db) hd_sd_free;       /*!< Free slots of the socket database */
+    TAILQ_HEAD(, sock_db) hd_sd_lru;        /*!< Open sessions, least recently used first */
+    fd_set hd_sd_fds;                       /*!< Descriptors of the open sessions */
+    int hd_sd_max_fd;                       /*!< Largest descriptor of the open sessions, -1 if none */
     httpd_uri_t **hd_calls;                 /*!< Registered URI handlers */
+    struct httpd_uri_node *hd_uri_root;     /*!< Tree of the URI handlers, by the segments of their URIs */
+    struct httpd_uri_node **hd_uri_table;   /*!< Literal segments of the tree by parent node and segment */
+    unsigned hd_uri_table_mask;             /*!< Number of buckets of the segment table minus one */
+    unsigned hd_uri_nodes;                  /*!< Number of nodes in the segment table */
     struct httpd_req hd_req;                /*!< The current HTTPD request */
     struct httpd_req_aux hd_req_aux;        /*!< Additional data about the HTTPD request kept unexposed */
 };
@@ -225,20 +249,14 @@ esp_err_t httpd_sess_process(struct httpd_data *hd, int clifd);
  * @brief   Remove client descriptor from the session / socket database
  *          and close the connection for this client.
  *
- * @note    The returned descriptor should be used by httpd_sess_iterate()
- *          to continue the iteration correctly. This ensurs that the
- *          iteration is not restarted abruptly which may cause reading from
- *          a socket which has been already processed and thus blocking
- *          the server loop until data appears on that socket.
+ * @note    The slots of the other sessions in the socket database are left
+ *          as they are, so the server loop can continue walking through them
+ *          after a session has been deleted.
  *
  * @param[in] hd    Server instance data
  * @param[in] clifd Descriptor of the client to be removed from the session.
- *
- * @return
- *  - +VE : Client descriptor preceding the one being deleted
- *  - -1  : No descriptor preceding the one being deleted
  */
-int httpd_sess_delete(struct httpd_data *hd, int clifd);
+void httpd_sess_delete(struct httpd_data *hd, int clifd);
 
 /**
  * @brief   Free session context
@@ -249,13 +267,16 @@ int httpd_sess_delete(struct httpd_data *hd, int clifd);
 void httpd_sess_free_ctx(void *ctx, httpd_free_ctx_fn_t free_fn);
 
 /**
- * @brief   Add descriptors present in the socket database to an fd_set and
- *          update the value of maxfd which are needed by the select function
+ * @brief   Copy the descriptors present in the socket database to an fd_set and
+ *          set the value of maxfd which are needed by the select function
  *          for looking through all available sockets for incoming data.
  *
+ * @note    The set of descriptors is kept up to date as sessions are opened
+ *          and closed, so this doesn't walk through the socket database.
+ *
  * @param[in]  hd    Server instance data
- * @param[out] fdset File descriptor set to be updated.
- * @param[out] maxfd Maximum value among all file descriptors.
+ * @param[out] fdset File descriptor set to be overwritten.
+ * @param[out] maxfd Maximum value among all file descriptors, -1 if none.
  */
 void httpd_sess_set_descriptors(struct httpd_data *hd, fd_set *fdset, int *maxfd);
 
@@ -155,12 +155,11 @@ static void httpd_process_ctrl_msg(struct httpd_data *hd)
 static esp_err_t httpd_server(struct httpd_data *hd)
 {
     fd_set read_set;
-    FD_ZERO(&read_set);
+    int tmp_max_fd;
+    httpd_sess_set_descriptors(hd, &read_set, &tmp_max_fd);
     FD_SET(hd->listen_fd, &read_set);
     FD_SET(hd->ctrl_fd, &read_set);
 
-    int tmp_max_fd;
-    httpd_sess_set_descriptors(hd, &read_set, &tmp_max_fd);
     int maxfd = MAX(hd->listen_fd, tmp_max_fd);
     tmp_max_fd = maxfd;
     maxfd = MAX(hd->ctrl_fd, tmp_max_fd);
@@ -184,17 +183,17 @@ static esp_err_t httpd_server(struct httpd_data *hd)
     }
 
     /* Case1: Do we have any activity on the current data
-     * sessions? */
-    int fd = -1;
-    while ((fd = httpd_sess_iterate(hd, fd)) != -1) {
-        if (FD_ISSET(fd, &read_set) || (httpd_sess_pending(hd, fd))) {
+     * sessions? All the sessions ready are served in one pass
+     * through the socket database, whose slots stay in place
+     * while sessions are deleted */
+    for (int i = 0; i < hd->config.max_open_sockets; i++) {
+        int fd = hd->hd_sd[i].fd;
+        if (fd != -1 && (FD_ISSET(fd, &read_set) || (httpd_sess_pending(hd, fd)))) {
             ESP_LOGD(TAG, LOG_FMT("processing socket %d"), fd);
             if (httpd_sess_process(hd, fd) != ESP_OK) {
                 ESP_LOGD(TAG, LOG_FMT("closing socket %d"), fd);
                 close(fd);
-                /* Delete session and update fd to that
-                 * preceding the one being deleted */
-                fd = httpd_sess_delete(hd, fd);
+                httpd_sess_delete(hd, fd);
             }
         }
     }
@@ -313,9 +312,23 @@ static struct httpd_data *httpd_create(const httpd_config_t *config)
             free(hd);
             return NULL;
         }
+        /* Buckets of the descriptor index, a power of two not less than the number of sockets */
+        hd->hd_sd_index_mask = 1;
+        while (hd->hd_sd_index_mask < config->max_open_sockets) {
+            hd->hd_sd_index_mask <<= 1;
+        }
+        hd->hd_sd_index = calloc(hd->hd_sd_index_mask, sizeof(struct sock_db *));
+        hd->hd_sd_index_mask--;
+        if (hd->hd_sd_index == NULL) {
+            free(hd->hd_sd);
+            free(hd->hd_calls);
+            free(hd);
+            return NULL;
+        }
         struct httpd_req_aux *ra = &hd->hd_req_aux;
         ra->resp_hdrs = calloc(config->max_resp_headers, sizeof(struct resp_hdr));
         if (ra->resp_hdrs == NULL) {
+            free(hd->hd_sd_index);
             free(hd->hd_sd);
             free(hd->hd_calls);
             free(hd);
@@ -334,6 +347,7 @@ static void httpd_delete(struct httpd_data *hd)
     struct httpd_req_aux *ra = &hd->hd_req_aux;
     /* Free memory of httpd instance data */
     free(ra->resp_hdrs);
+    free(hd->hd_sd_index);
     free(hd->hd_sd);
 
     /* Free registered URI handlers */
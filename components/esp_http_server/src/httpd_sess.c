@@ -14,6 +14,7 @@
 
 
 #include <stdlib.h>
+#include <errno.h>
 #include <esp_log.h>
 #include <esp_err.h>
 
@@ -25,13 +26,68 @@ static const char *TAG = "httpd_sess";
 
 bool httpd_is_sess_available(struct httpd_data *hd)
 {
-    int i;
-    for (i = 0; i < hd->config.max_open_sockets; i++) {
-        if (hd->hd_sd[i].fd == -1) {
-            return true;
-        }
+    return !SLIST_EMPTY(&hd->hd_sd_free);
+}
+
+static inline struct sock_db **httpd_sess_bucket(struct httpd_data *hd, int sockfd)
+{
+    /* lwIP hands out consecutive descriptors, which fill the buckets evenly */
+    return &hd->hd_sd_index[(unsigned)sockfd & hd->hd_sd_index_mask];
+}
+
+/* Adds an open session to the descriptor index, the set of descriptors for
+ * select() and to the list of sessions as the least recently used one, like
+ * a session which hasn't been processed yet always was */
+static void httpd_sess_link(struct httpd_data *hd, struct sock_db *sd)
+{
+    struct sock_db **bucket = httpd_sess_bucket(hd, sd->fd);
+
+    sd->index_next = *bucket;
+    *bucket = sd;
+    TAILQ_INSERT_HEAD(&hd->hd_sd_lru, sd, lru_entry);
+    FD_SET(sd->fd, &hd->hd_sd_fds);
+    if (sd->fd > hd->hd_sd_max_fd) {
+        hd->hd_sd_max_fd = sd->fd;
     }
-    return false;
+}
+
+/* Removes a session from where httpd_sess_link() added it and frees its slot */
+static void httpd_sess_unlink(struct httpd_data *hd, struct sock_db *sd)
+{
+    struct sock_db **prev = httpd_sess_bucket(hd, sd->fd);
+
+    while (*prev != sd) {
+        prev = &(*prev)->index_next;
+    }
+    *prev = sd->index_next;
+    TAILQ_REMOVE(&hd->hd_sd_lru, sd, lru_entry);
+    FD_CLR(sd->fd, &hd->hd_sd_fds);
+    while (hd->hd_sd_max_fd >= 0 && !FD_ISSET(hd->hd_sd_max_fd, &hd->hd_sd_fds)) {
+        hd->hd_sd_max_fd--;
+    }
+
+    /* mark session slot as available */
+    sd->fd = -1;
+    SLIST_INSERT_HEAD(&hd->hd_sd_free, sd, free_entry);
+}
+
+/* Makes an open session the most recently used one */
+static inline void httpd_sess_touch(struct httpd_data *hd, struct sock_db *sd)
+{
+    TAILQ_REMOVE(&hd->hd_sd_lru, sd, lru_entry);
+    TAILQ_INSERT_TAIL(&hd->hd_sd_lru, sd, lru_entry);
+}
+
+/* Frees the 'user' and 'transport' contexts of a session */
+static void httpd_sess_release_ctx(struct sock_db *sd)
+{
+    httpd_sess_free_ctx(sd->ctx, sd->free_ctx);
+    sd->ctx = NULL;
+    sd->free_ctx = NULL;
+
+    httpd_sess_free_ctx(sd->transport_ctx, sd->free_transport_ctx);
+    sd->transport_ctx = NULL;
+    sd->free_transport_ctx = NULL;
 }
 
 struct sock_db *httpd_sess_get(struct httpd_data *hd, int sockfd)
@@ -48,13 +104,11 @@ struct sock_db *httpd_sess_get(struct httpd_data *hd, int sockfd)
         return hd->hd_req_aux.sd;
     }
 
-    int i;
-    for (i = 0; i < hd->config.max_open_sockets; i++) {
-        if (hd->hd_sd[i].fd == sockfd) {
-            return &hd->hd_sd[i];
-        }
+    struct sock_db *sd = *httpd_sess_bucket(hd, sockfd);
+    while (sd && sd->fd != sockfd) {
+        sd = sd->index_next;
     }
-    return NULL;
+    return sd;
 }
 
 esp_err_t httpd_sess_new(struct httpd_data *hd, int newfd)
@@ -66,25 +120,32 @@ esp_err_t httpd_sess_new(struct httpd_data *hd, int newfd)
         return ESP_FAIL;
     }
 
-    int i;
-    for (i = 0; i < hd->config.max_open_sockets; i++) {
-        if (hd->hd_sd[i].fd == -1) {
-            memset(&hd->hd_sd[i], 0, sizeof(hd->hd_sd[i]));
-            hd->hd_sd[i].fd = newfd;
-            hd->hd_sd[i].handle = (httpd_handle_t) hd;
-            hd->hd_sd[i].send_fn = httpd_default_send;
-            hd->hd_sd[i].recv_fn = httpd_default_recv;
-
-            /* Call user-defined session opening function */
-            if (hd->config.open_fn) {
-                esp_err_t ret = hd->config.open_fn(hd, hd->hd_sd[i].fd);
-                if (ret != ESP_OK) return ret;
-            }
-            return ESP_OK;
+    struct sock_db *sd = SLIST_FIRST(&hd->hd_sd_free);
+    if (sd == NULL) {
+        ESP_LOGD(TAG, LOG_FMT("unable to launch session for fd = %d"), newfd);
+        return ESP_FAIL;
+    }
+
+    SLIST_REMOVE_HEAD(&hd->hd_sd_free, free_entry);
+    memset(sd, 0, sizeof(*sd));
+    sd->fd = newfd;
+    sd->handle = (httpd_handle_t) hd;
+    sd->send_fn = httpd_default_send;
+    sd->recv_fn = httpd_default_recv;
+    httpd_sess_link(hd, sd);
+
+    /* Call user-defined session opening function */
+    if (hd->config.open_fn) {
+        esp_err_t ret = hd->config.open_fn(hd, sd->fd);
+        if (ret != ESP_OK) {
+            /* The caller closes the descriptor, the contexts open_fn set are freed
+             * and the slot is free again */
+            httpd_sess_release_ctx(sd);
+            httpd_sess_unlink(hd, sd);
+            return ret;
         }
     }
-    ESP_LOGD(TAG, LOG_FMT("unable to launch session for fd = %d"), newfd);
-    return ESP_FAIL;
+    return ESP_OK;
 }
 
 void httpd_sess_free_ctx(void *ctx, httpd_free_ctx_fn_t free_fn)
@@ -178,16 +239,8 @@ void httpd_sess_set_transport_ctx(httpd_handle_t handle, int sockfd, void *ctx,
 void httpd_sess_set_descriptors(struct httpd_data *hd,
                                 fd_set *fdset, int *maxfd)
 {
-    int i;
-    *maxfd = -1;
-    for (i = 0; i < hd->config.max_open_sockets; i++) {
-        if (hd->hd_sd[i].fd != -1) {
-            FD_SET(hd->hd_sd[i].fd, fdset);
-            if (hd->hd_sd[i].fd > *maxfd) {
-                *maxfd = hd->hd_sd[i].fd;
-            }
-        }
-    }
+    *fdset = hd->hd_sd_fds;
+    *maxfd = hd->hd_sd_max_fd;
 }
 
 /** Check if a FD is valid */
@@ -196,12 +249,6 @@ static int fd_is_valid(int fd)
     return fcntl(fd, F_GETFD, 0) != -1 || errno != EBADF;
 }
 
-static inline uint64_t httpd_sess_get_lru_counter()
-{
-    static uint64_t lru_counter = 0;
-    return lru_counter++;
-}
-
 void httpd_sess_delete_invalid(struct httpd_data *hd)
 {
     for (int i = 0; i < hd->config.max_open_sockets; i++) {
@@ -212,59 +259,39 @@ void httpd_sess_delete_invalid(struct httpd_data *hd)
     }
 }
 
-int httpd_sess_delete(struct httpd_data *hd, int fd)
+void httpd_sess_delete(struct httpd_data *hd, int fd)
 {
     ESP_LOGD(TAG, LOG_FMT("fd = %d"), fd);
-    int i;
-    int pre_sess_fd = -1;
-    for (i = 0; i < hd->config.max_open_sockets; i++) {
-        if (hd->hd_sd[i].fd == fd) {
-            /* global close handler */
-            if (hd->config.close_fn) {
-                hd->config.close_fn(hd, fd);
-            }
+    struct sock_db *sd = httpd_sess_get(hd, fd);
+    if (sd == NULL) {
+        return;
+    }
 
-            /* release 'user' context */
-            if (hd->hd_sd[i].ctx) {
-                if (hd->hd_sd[i].free_ctx) {
-                    hd->hd_sd[i].free_ctx(hd->hd_sd[i].ctx);
-                } else {
-                    free(hd->hd_sd[i].ctx);
-                }
-                hd->hd_sd[i].ctx = NULL;
-                hd->hd_sd[i].free_ctx = NULL;
-            }
+    /* global close handler */
+    if (hd->config.close_fn) {
+        hd->config.close_fn(hd, fd);
+    }
 
-            /* release 'transport' context */
-            if (hd->hd_sd[i].transport_ctx) {
-                if (hd->hd_sd[i].free_transport_ctx) {
-                    hd->hd_sd[i].free_transport_ctx(hd->hd_sd[i].transport_ctx);
-                } else {
-                    free(hd->hd_sd[i].transport_ctx);
-                }
-                hd->hd_sd[i].transport_ctx = NULL;
-                hd->hd_sd[i].free_transport_ctx = NULL;
-            }
+    /* release 'user' and 'transport' contexts */
+    httpd_sess_release_ctx(sd);
 
-            /* mark session slot as available */
-            hd->hd_sd[i].fd = -1;
-            break;
-        } else if (hd->hd_sd[i].fd != -1) {
-            /* Return the fd just preceding the one being
-             * deleted so that iterator can continue from
-             * the correct fd */
-            pre_sess_fd = hd->hd_sd[i].fd;
-        }
-    }
-    return pre_sess_fd;
+    httpd_sess_unlink(hd, sd);
 }
 
 void httpd_sess_init(struct httpd_data *hd)
 {
     int i;
-    for (i = 0; i < hd->config.max_open_sockets; i++) {
+    SLIST_INIT(&hd->hd_sd_free);
+    TAILQ_INIT(&hd->hd_sd_lru);
+    FD_ZERO(&hd->hd_sd_fds);
+    hd->hd_sd_max_fd = -1;
+    memset(hd->hd_sd_index, 0, (hd->hd_sd_index_mask + 1) * sizeof(hd->hd_sd_index[0]));
+
+    /* Free slots are taken in the order of the socket database */
+    for (i = hd->config.max_open_sockets - 1; i >= 0; i--) {
         hd->hd_sd[i].fd = -1;
         hd->hd_sd[i].ctx = NULL;
+        SLIST_INSERT_HEAD(&hd->hd_sd_free, &hd->hd_sd[i], free_entry);
     }
 }
 
@@ -304,7 +331,7 @@ esp_err_t httpd_sess_process(struct httpd_data *hd, int newfd)
         return ESP_FAIL;
     }
     ESP_LOGD(TAG, LOG_FMT("success"));
-    sd->lru_counter = httpd_sess_get_lru_counter();
+    httpd_sess_touch(hd, sd);
     return ESP_OK;
 }
 
@@ -316,34 +343,21 @@ esp_err_t httpd_sess_update_lru_counter(httpd_handle_t handle, int sockfd)
 
     /* Search for the socket database entry */
     struct httpd_data *hd = (struct httpd_data *) handle;
-    int i;
-    for (i = 0; i < hd->config.max_open_sockets; i++) {
-        if (hd->hd_sd[i].fd == sockfd) {
-            hd->hd_sd[i].lru_counter = httpd_sess_get_lru_counter();
-            return ESP_OK;
-        }
+    struct sock_db *sd = httpd_sess_get(hd, sockfd);
+    if (sd == NULL) {
+        return ESP_ERR_NOT_FOUND;
     }
-    return ESP_ERR_NOT_FOUND;
+    httpd_sess_touch(hd, sd);
+    return ESP_OK;
 }
 
 esp_err_t httpd_sess_close_lru(struct httpd_data *hd)
 {
-    uint64_t lru_counter = UINT64_MAX;
-    int lru_fd = -1;
-    int i;
-    for (i = 0; i < hd->config.max_open_sockets; i++) {
-        /* If a descriptor is -1, there is no need to close any session.
-         * So, we can return from here, without finding the Least Recently Used
-         * session
-         */
-        if (hd->hd_sd[i].fd == -1) {
-            return ESP_OK;
-        }
-        if (hd->hd_sd[i].lru_counter < lru_counter) {
-            lru_counter = hd->hd_sd[i].lru_counter;
-            lru_fd = hd->hd_sd[i].fd;
-        }
+    /* If a slot is free, there is no need to close any session */
+    if (httpd_is_sess_available(hd)) {
+        return ESP_OK;
     }
+    int lru_fd = TAILQ_FIRST(&hd->hd_sd_lru)->fd;
     ESP_LOGD(TAG, LOG_FMT("fd = %d"), lru_fd);
     return httpd_sess_trigger_close(hd, lru_fd);
 }
@@ -355,11 +369,9 @@ int httpd_sess_iterate(struct httpd_data *hd, int start_fd)
 
     if (start_fd != -1) {
         /* Take our index to where this fd is stored */
-        for (i = 0; i < hd->config.max_open_sockets; i++) {
-            if (hd->hd_sd[i].fd == start_fd) {
-                start_index = i + 1;
-                break;
-            }
+        struct sock_db *sd = httpd_sess_get(hd, start_fd);
+        if (sd) {
+            start_index = sd - hd->hd_sd + 1;
         }
     }
 
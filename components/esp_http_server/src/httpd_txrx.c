@@ -22,6 +22,11 @@
 
 static const char *TAG = "httpd_txrx";
 
+/* MSG_MORE only is a hint to the stack, it is left out where not supported */
+#ifndef MSG_MORE
+#define MSG_MORE 0
+#endif
+
 esp_err_t httpd_sess_set_send_override(httpd_handle_t hd, int sockfd, httpd_send_func_t send_func)
 {
     struct sock_db *sess = httpd_sess_get(hd, sockfd);
@@ -71,13 +76,13 @@ int httpd_send(httpd_req_t *r, const char *buf, size_t buf_len)
     return ret;
 }
 
-static esp_err_t httpd_send_all(httpd_req_t *r, const char *buf, size_t buf_len)
+static esp_err_t httpd_send_all(httpd_req_t *r, const char *buf, size_t buf_len, int flags)
 {
     struct httpd_req_aux *ra = r->aux;
     int ret;
 
     while (buf_len > 0) {
-        ret = ra->sd->send_fn(ra->sd->handle, ra->sd->fd, buf, buf_len, 0);
+        ret = ra->sd->send_fn(ra->sd->handle, ra->sd->fd, buf, buf_len, flags);
         if (ret < 0) {
             ESP_LOGD(TAG, LOG_FMT("error in send_fn"));
             return ESP_FAIL;
@@ -89,6 +94,59 @@ static esp_err_t httpd_send_all(httpd_req_t *r, const char *buf, size_t buf_len)
     return ESP_OK;
 }
 
+/* Flushes the response data collected in the scratch buffer. MSG_MORE tells
+ * the stack that more data of the response follows this part */
+static esp_err_t httpd_resp_buf_flush(httpd_req_t *r, size_t *len, int flags)
+{
+    struct httpd_req_aux *ra = r->aux;
+
+    if (*len == 0) {
+        return ESP_OK;
+    }
+
+    esp_err_t ret = httpd_send_all(r, ra->scratch, *len, flags);
+    *len = 0;
+    return ret;
+}
+
+/* Appends to the response data collected in the scratch buffer, which is free
+ * once the response is being sent. Data which doesn't fit even into an empty
+ * scratch buffer is sent directly after the collected data, with the flags given */
+static esp_err_t httpd_resp_buf_add(httpd_req_t *r, size_t *len, const char *buf, size_t buf_len, int flags)
+{
+    struct httpd_req_aux *ra = r->aux;
+
+    if (buf_len > sizeof(ra->scratch) - *len) {
+        if (httpd_resp_buf_flush(r, len, MSG_MORE) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        if (buf_len > sizeof(ra->scratch)) {
+            return httpd_send_all(r, buf, buf_len, flags);
+        }
+    }
+
+    memcpy(ra->scratch + *len, buf, buf_len);
+    *len += buf_len;
+    return ESP_OK;
+}
+
+/* Collects the additional headers set by httpd_resp_set_hdr() and the
+ * blank line ending the header section after the status line */
+static esp_err_t httpd_resp_buf_add_hdrs(httpd_req_t *r, size_t *len)
+{
+    struct httpd_req_aux *ra = r->aux;
+
+    for (unsigned i = 0; i < ra->resp_hdrs_count; i++) {
+        if (httpd_resp_buf_add(r, len, ra->resp_hdrs[i].field, strlen(ra->resp_hdrs[i].field), MSG_MORE) != ESP_OK ||
+            httpd_resp_buf_add(r, len, ": ", 2, MSG_MORE) != ESP_OK ||
+            httpd_resp_buf_add(r, len, ra->resp_hdrs[i].value, strlen(ra->resp_hdrs[i].value), MSG_MORE) != ESP_OK ||
+            httpd_resp_buf_add(r, len, "\r\n", 2, MSG_MORE) != ESP_OK) {
+            return ESP_FAIL;
+        }
+    }
+    return httpd_resp_buf_add(r, len, "\r\n", 2, MSG_MORE);
+}
+
 static size_t httpd_recv_pending(httpd_req_t *r, char *buf, size_t buf_len)
 {
     struct httpd_req_aux *ra = r->aux;
@@ -243,8 +301,8 @@ esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
 
     struct httpd_req_aux *ra = r->aux;
     const char *httpd_hdr_str = "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %d\r\n";
-    const char *colon_separator = ": ";
-    const char *cr_lf_seperator = "\r\n";
+    int hdr_len;
+    size_t len;
 
     if (buf_len == -1) buf_len = strlen(buf);
 
@@ -252,47 +310,29 @@ esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
     ra->req_hdrs_count = 0;
 
     /* Size of essential headers is limited by scratch buffer size */
-    if (snprintf(ra->scratch, sizeof(ra->scratch), httpd_hdr_str,
-                 ra->status, ra->content_type, buf_len) >= sizeof(ra->scratch)) {
+    hdr_len = snprintf(ra->scratch, sizeof(ra->scratch), httpd_hdr_str,
+                       ra->status, ra->content_type, buf_len);
+    if (hdr_len < 0 || hdr_len >= sizeof(ra->scratch)) {
         return ESP_ERR_HTTPD_RESP_HDR;
     }
+    len = hdr_len;
 
-    /* Sending essential headers */
-    if (httpd_send_all(r, ra->scratch, strlen(ra->scratch)) != ESP_OK) {
+    /* Status line, headers and content are collected in the scratch buffer,
+     * so that small responses are sent out with a single send */
+    if (httpd_resp_buf_add_hdrs(r, &len) != ESP_OK) {
         return ESP_ERR_HTTPD_RESP_SEND;
     }
 
-    /* Sending additional headers based on set_header */
-    for (unsigned i = 0; i < ra->resp_hdrs_count; i++) {
-        /* Send header field */
-        if (httpd_send_all(r, ra->resp_hdrs[i].field, strlen(ra->resp_hdrs[i].field)) != ESP_OK) {
-            return ESP_ERR_HTTPD_RESP_SEND;
-        }
-        /* Send ': ' */
-        if (httpd_send_all(r, colon_separator, strlen(colon_separator)) != ESP_OK) {
-            return ESP_ERR_HTTPD_RESP_SEND;
-        }
-        /* Send header value */
-        if (httpd_send_all(r, ra->resp_hdrs[i].value, strlen(ra->resp_hdrs[i].value)) != ESP_OK) {
-            return ESP_ERR_HTTPD_RESP_SEND;
-        }
-        /* Send CR + LF */
-        if (httpd_send_all(r, cr_lf_seperator, strlen(cr_lf_seperator)) != ESP_OK) {
+    /* Collecting content */
+    if (buf && buf_len) {
+        if (httpd_resp_buf_add(r, &len, buf, buf_len, 0) != ESP_OK) {
             return ESP_ERR_HTTPD_RESP_SEND;
         }
     }
 
-    /* End header section */
-    if (httpd_send_all(r, cr_lf_seperator, strlen(cr_lf_seperator)) != ESP_OK) {
+    if (httpd_resp_buf_flush(r, &len, 0) != ESP_OK) {
         return ESP_ERR_HTTPD_RESP_SEND;
     }
-
-    /* Sending content */
-    if (buf && buf_len) {
-        if (httpd_send_all(r, buf, buf_len) != ESP_OK) {
-            return ESP_ERR_HTTPD_RESP_SEND;
-        }
-    }
     return ESP_OK;
 }
 
@@ -310,66 +350,42 @@ esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len
 
     struct httpd_req_aux *ra = r->aux;
     const char *httpd_chunked_hdr_str = "HTTP/1.1 %s\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\n";
-    const char *colon_separator = ": ";
-    const char *cr_lf_seperator = "\r\n";
+    size_t len = 0;
 
     /* Request headers are no longer available */
     ra->req_hdrs_count = 0;
 
     if (!ra->first_chunk_sent) {
         /* Size of essential headers is limited by scratch buffer size */
-        if (snprintf(ra->scratch, sizeof(ra->scratch), httpd_chunked_hdr_str,
-                     ra->status, ra->content_type) >= sizeof(ra->scratch)) {
+        int hdr_len = snprintf(ra->scratch, sizeof(ra->scratch), httpd_chunked_hdr_str,
+                               ra->status, ra->content_type);
+        if (hdr_len < 0 || hdr_len >= sizeof(ra->scratch)) {
             return ESP_ERR_HTTPD_RESP_HDR;
         }
+        len = hdr_len;
 
-        /* Sending essential headers */
-        if (httpd_send_all(r, ra->scratch, strlen(ra->scratch)) != ESP_OK) {
-            return ESP_ERR_HTTPD_RESP_SEND;
-        }
-
-        /* Sending additional headers based on set_header */
-        for (unsigned i = 0; i < ra->resp_hdrs_count; i++) {
-            /* Send header field */
-            if (httpd_send_all(r, ra->resp_hdrs[i].field, strlen(ra->resp_hdrs[i].field)) != ESP_OK) {
-                return ESP_ERR_HTTPD_RESP_SEND;
-            }
-            /* Send ': ' */
-            if (httpd_send_all(r, colon_separator, strlen(colon_separator)) != ESP_OK) {
-                return ESP_ERR_HTTPD_RESP_SEND;
-            }
-            /* Send header value */
-            if (httpd_send_all(r, ra->resp_hdrs[i].value, strlen(ra->resp_hdrs[i].value)) != ESP_OK) {
-                return ESP_ERR_HTTPD_RESP_SEND;
-            }
-            /* Send CR + LF */
-            if (httpd_send_all(r, cr_lf_seperator, strlen(cr_lf_seperator)) != ESP_OK) {
-                return ESP_ERR_HTTPD_RESP_SEND;
-            }
-        }
-
-        /* End header section */
-        if (httpd_send_all(r, cr_lf_seperator, strlen(cr_lf_seperator)) != ESP_OK) {
+        /* Headers are sent out together with the first chunk */
+        if (httpd_resp_buf_add_hdrs(r, &len) != ESP_OK) {
             return ESP_ERR_HTTPD_RESP_SEND;
         }
         ra->first_chunk_sent = true;
     }
 
-    /* Sending chunked content */
+    /* Collecting chunk size, chunked content and end of chunk */
     char len_str[10];
     snprintf(len_str, sizeof(len_str), "%x\r\n", buf_len);
-    if (httpd_send_all(r, len_str, strlen(len_str)) != ESP_OK) {
+    if (httpd_resp_buf_add(r, &len, len_str, strlen(len_str), MSG_MORE) != ESP_OK) {
         return ESP_ERR_HTTPD_RESP_SEND;
     }
 
     if (buf) {
-        if (httpd_send_all(r, buf, (size_t) buf_len) != ESP_OK) {
+        if (httpd_resp_buf_add(r, &len, buf, (size_t) buf_len, MSG_MORE) != ESP_OK) {
             return ESP_ERR_HTTPD_RESP_SEND;
         }
     }
 
-    /* Indicate end of chunk */
-    if (httpd_send_all(r, "\r\n", strlen("\r\n")) != ESP_OK) {
+    if (httpd_resp_buf_add(r, &len, "\r\n", 2, 0) != ESP_OK ||
+        httpd_resp_buf_flush(r, &len, 0) != ESP_OK) {
         return ESP_ERR_HTTPD_RESP_SEND;
     }
     return ESP_OK;
@@ -13,6 +13,7 @@
 // limitations under the License.
 
 
+#include <stdlib.h>
 #include <errno.h>
 #include <esp_log.h>
 #include <esp_err.h>
@@ -23,17 +24,275 @@
 
 static const char *TAG = "httpd_uri";
 
+/* The registered URIs are kept in a tree of their segments, the parts between
+ * '/' characters: "/api/{id}/state" is "", "api", "{id}" and "state" from the
+ * root. Each node holds the handlers of its URI, with a bitmap of their methods.
+ * The literal children of all nodes are found in one hash table by parent node
+ * and segment, the "{name}" and "*" children of a node are linked to it. Looking
+ * up a request path thus takes one probe of the table per segment, however many
+ * handlers are registered.
+ */
+struct httpd_uri_node {
+    struct httpd_uri_node *parent;          /*!< Node of the preceding segment, NULL for the root */
+    struct httpd_uri_node *hash_next;       /*!< Next node in the same bucket of the segment table */
+    struct httpd_uri_node *param;           /*!< Child matching any non-empty segment, "{name}" */
+    struct httpd_uri_node *wildcard;        /*!< Child matching the rest of the path, "*" */
+    struct httpd_uri_route *routes;         /*!< Handlers registered with the URI ending at this node */
+    uint64_t methods;                       /*!< Methods of the handlers, one bit for each */
+    uint32_t hash;                          /*!< Hash of the parent node and the segment */
+    unsigned children;                      /*!< Number of literal children */
+    size_t segment_len;                     /*!< Length of the literal segment */
+    char segment[];                         /*!< Literal segment, empty for "{name}" and "*" nodes */
+};
+
+/* A registered handler. The URI handler comes first, hd_calls points to it */
+struct httpd_uri_route {
+    httpd_uri_t uri;                        /*!< Copy of the URI handler registered */
+    struct httpd_uri_node *node;            /*!< Node of the URI */
+    struct httpd_uri_route *next;           /*!< Next handler of the same node */
+};
+
+/* Segment table size the table starts with, it doubles as nodes are added */
+#define HTTPD_URI_TABLE_MIN     16
+
+#define HTTPD_URI_METHOD_BIT(method) \
+    (((unsigned)(method) < 64) ? ((uint64_t)1 << (unsigned)(method)) : 0)
+
+typedef enum {
+    HTTPD_URI_SEGMENT_LITERAL,
+    HTTPD_URI_SEGMENT_PARAM,
+    HTTPD_URI_SEGMENT_WILDCARD,
+} httpd_uri_segment_t;
+
+static httpd_uri_segment_t httpd_uri_segment_type(const char *seg, size_t len, bool last)
+{
+    if (len >= 3 && seg[0] == '{' && seg[len - 1] == '}') {
+        return HTTPD_URI_SEGMENT_PARAM;
+    }
+    if (last && len == 1 && seg[0] == '*') {
+        return HTTPD_URI_SEGMENT_WILDCARD;
+    }
+    return HTTPD_URI_SEGMENT_LITERAL;
+}
+
+/* Length of the segment starting at seg, up to the next '/' or end */
+static inline size_t httpd_uri_segment_len(const char *seg, const char *end)
+{
+    const char *slash = memchr(seg, '/', end - seg);
+    return (slash ? slash : end) - seg;
+}
+
+static uint32_t httpd_uri_hash(const struct httpd_uri_node *parent, const char *seg, size_t len)
+{
+    /* FNV-1a of the segment, started from the parent node */
+    uint32_t hash = 2166136261U ^ (uint32_t)(uintptr_t)parent;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)seg[i]) * 16777619U;
+    }
+    /* Mix the low bits of the pointer into those selecting the bucket */
+    hash ^= hash >> 15;
+    hash *= 0x2c1b3c6dU;
+    return hash ^ (hash >> 12);
+}
+
+static struct httpd_uri_node *httpd_uri_child(struct httpd_data *hd, const struct httpd_uri_node *parent,
+                                              const char *seg, size_t len)
+{
+    uint32_t hash = httpd_uri_hash(parent, seg, len);
+    struct httpd_uri_node *node = hd->hd_uri_table[hash & hd->hd_uri_table_mask];
+
+    while (node && (node->hash != hash || node->parent != parent ||
+                    node->segment_len != len || memcmp(node->segment, seg, len))) {
+        node = node->hash_next;
+    }
+    return node;
+}
+
+static void httpd_uri_table_insert(struct httpd_data *hd, struct httpd_uri_node *node)
+{
+    struct httpd_uri_node **bucket = &hd->hd_uri_table[node->hash & hd->hd_uri_table_mask];
+    node->hash_next = *bucket;
+    *bucket = node;
+}
+
+static void httpd_uri_table_grow(struct httpd_data *hd)
+{
+    unsigned size = (hd->hd_uri_table_mask + 1) * 2;
+    struct httpd_uri_node **old_table = hd->hd_uri_table;
+    unsigned old_size = hd->hd_uri_table_mask + 1;
+
+    struct httpd_uri_node **table = calloc(size, sizeof(struct httpd_uri_node *));
+    if (table == NULL) {
+        /* The table keeps working with longer buckets */
+        return;
+    }
+
+    hd->hd_uri_table = table;
+    hd->hd_uri_table_mask = size - 1;
+    for (unsigned i = 0; i < old_size; i++) {
+        struct httpd_uri_node *node = old_table[i];
+        while (node) {
+            struct httpd_uri_node *next = node->hash_next;
+            httpd_uri_table_insert(hd, node);
+            node = next;
+        }
+    }
+    free(old_table);
+}
+
+static struct httpd_uri_node *httpd_uri_node_new(struct httpd_uri_node *parent, const char *seg, size_t len)
+{
+    struct httpd_uri_node *node = calloc(1, sizeof(struct httpd_uri_node) + len + 1);
+    if (node) {
+        node->parent = parent;
+        node->segment_len = len;
+        memcpy(node->segment, seg, len);
+    }
+    return node;
+}
+
+/* Removes the nodes left without handlers and children, from a node up to the root */
+static void httpd_uri_node_release(struct httpd_data *hd, struct httpd_uri_node *node)
+{
+    while (node && node->parent && !node->routes && !node->children && !node->param && !node->wildcard) {
+        struct httpd_uri_node *parent = node->parent;
+
+        if (parent->param == node) {
+            parent->param = NULL;
+        } else if (parent->wildcard == node) {
+            parent->wildcard = NULL;
+        } else {
+            struct httpd_uri_node **prev = &hd->hd_uri_table[node->hash & hd->hd_uri_table_mask];
+            while (*prev != node) {
+                prev = &(*prev)->hash_next;
+            }
+            *prev = node->hash_next;
+            parent->children--;
+            hd->hd_uri_nodes--;
+        }
+        free(node);
+        node = parent;
+    }
+}
+
+/* Finds the node of a registered URI, creating the missing nodes if asked to */
+static struct httpd_uri_node *httpd_uri_node_get(struct httpd_data *hd, const char *uri, bool create)
+{
+    const char *end = uri + strlen(uri);
+    const char *seg = uri;
+
+    if (hd->hd_uri_root == NULL) {
+        if (!create) {
+            return NULL;
+        }
+        hd->hd_uri_table = calloc(HTTPD_URI_TABLE_MIN, sizeof(struct httpd_uri_node *));
+        hd->hd_uri_root = httpd_uri_node_new(NULL, NULL, 0);
+        if (hd->hd_uri_table == NULL || hd->hd_uri_root == NULL) {
+            free(hd->hd_uri_table);
+            free(hd->hd_uri_root);
+            hd->hd_uri_table = NULL;
+            hd->hd_uri_root = NULL;
+            return NULL;
+        }
+        hd->hd_uri_table_mask = HTTPD_URI_TABLE_MIN - 1;
+    }
+
+    struct httpd_uri_node *node = hd->hd_uri_root;
+    while (node) {
+        size_t len = httpd_uri_segment_len(seg, end);
+        bool last = (seg + len == end);
+        struct httpd_uri_node *child = NULL;
+
+        switch (httpd_uri_segment_type(seg, len, last)) {
+        case HTTPD_URI_SEGMENT_PARAM:
+            if (node->param == NULL && create) {
+                node->param = httpd_uri_node_new(node, NULL, 0);
+            }
+            child = node->param;
+            break;
+        case HTTPD_URI_SEGMENT_WILDCARD:
+            if (node->wildcard == NULL && create) {
+                node->wildcard = httpd_uri_node_new(node, NULL, 0);
+            }
+            child = node->wildcard;
+            break;
+        default:
+            child = httpd_uri_child(hd, node, seg, len);
+            if (child == NULL && create) {
+                child = httpd_uri_node_new(node, seg, len);
+                if (child) {
+                    child->hash = httpd_uri_hash(node, seg, len);
+                    httpd_uri_table_insert(hd, child);
+                    node->children++;
+                    if (++hd->hd_uri_nodes > hd->hd_uri_table_mask + 1) {
+                        httpd_uri_table_grow(hd);
+                    }
+                }
+            }
+            break;
+        }
+
+        if (child == NULL) {
+            if (create) {
+                /* Failed to allocate memory, release the nodes added on the way */
+                httpd_uri_node_release(hd, node);
+            }
+            return NULL;
+        }
+        if (last) {
+            return child;
+        }
+        node = child;
+        seg += len + 1;
+    }
+    return NULL;
+}
+
+static struct httpd_uri_route *httpd_uri_node_route(struct httpd_uri_node *node, httpd_method_t method)
+{
+    struct httpd_uri_route *route = NULL;
+
+    if (node && (node->methods & HTTPD_URI_METHOD_BIT(method))) {
+        route = node->routes;
+        while (route->uri.method != method) {
+            route = route->next;
+        }
+    }
+    return route;
+}
+
+/* Removes a handler from its node and slot, and frees it */
+static void httpd_uri_route_delete(struct httpd_data *hd, int i)
+{
+    struct httpd_uri_route *route = (struct httpd_uri_route *) hd->hd_calls[i];
+    struct httpd_uri_node *node = route->node;
+    struct httpd_uri_route **prev = &node->routes;
+
+    ESP_LOGD(TAG, LOG_FMT("[%d] removing %s"), i, route->uri.uri);
+    while (*prev != route) {
+        prev = &(*prev)->next;
+    }
+    *prev = route->next;
+    node->methods &= ~HTTPD_URI_METHOD_BIT(route->uri.method);
+    httpd_uri_node_release(hd, node);
+
+    free((char*)route->uri.uri);
+    free(route);
+    hd->hd_calls[i] = NULL;
+}
+
 static int httpd_find_uri_handler(struct httpd_data *hd,
                                   const char* uri,
                                   httpd_method_t method)
 {
+    struct httpd_uri_route *route = httpd_uri_node_route(httpd_uri_node_get(hd, uri, false), method);
+    if (route == NULL) {
+        return -1;
+    }
+
     for (int i = 0; i < hd->config.max_uri_handlers; i++) {
-        if (hd->hd_calls[i]) {
-            ESP_LOGD(TAG, LOG_FMT("[%d] = %s"), i, hd->hd_calls[i]->uri);
-            if ((hd->hd_calls[i]->method == method) &&          // First match methods
-                (strcmp(hd->hd_calls[i]->uri, uri) == 0)) {     // Then match uri strings
-                return i;
-            }
+        if (hd->hd_calls[i] == &route->uri) {
+            return i;
         }
     }
     return -1;
@@ -42,12 +301,28 @@ static int httpd_find_uri_handler(struct httpd_data *hd,
 esp_err_t httpd_register_uri_handler(httpd_handle_t handle,
                                      const httpd_uri_t *uri_handler)
 {
-    if (handle == NULL || uri_handler == NULL) {
+    if (handle == NULL || uri_handler == NULL || uri_handler->uri == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
 
     struct httpd_data *hd = (struct httpd_data *) handle;
 
+    /* Path parameters are limited by the values kept for a request */
+    const char *end = uri_handler->uri + strlen(uri_handler->uri);
+    unsigned params = 0;
+    for (const char *seg = uri_handler->uri; seg <= end; seg++) {
+        size_t len = httpd_uri_segment_len(seg, end);
+        if (httpd_uri_segment_type(seg, len, seg + len == end) != HTTPD_URI_SEGMENT_LITERAL) {
+            params++;
+        }
+        seg += len;
+    }
+    if (params > HTTPD_MAX_PATH_PARAMS) {
+        ESP_LOGW(TAG, LOG_FMT("handler %s has more than %d path parameters"),
+                 uri_handler->uri, HTTPD_MAX_PATH_PARAMS);
+        return ESP_ERR_INVALID_ARG;
+    }
+
     /* Make sure another handler with same URI and method
      * is not already registered
      */
@@ -60,24 +335,38 @@ esp_err_t httpd_register_uri_handler(httpd_handle_t handle,
 
     for (int i = 0; i < hd->config.max_uri_handlers; i++) {
         if (hd->hd_calls[i] == NULL) {
-            hd->hd_calls[i] = malloc(sizeof(httpd_uri_t));
-            if (hd->hd_calls[i] == NULL) {
+            struct httpd_uri_route *route = calloc(1, sizeof(struct httpd_uri_route));
+            if (route == NULL) {
                 /* Failed to allocate memory */
                 return ESP_ERR_HTTPD_ALLOC_MEM;
             }
 
             /* Copy URI string */
-            hd->hd_calls[i]->uri = strdup(uri_handler->uri);
-            if (hd->hd_calls[i]->uri == NULL) {
+            route->uri.uri = strdup(uri_handler->uri);
+            if (route->uri.uri == NULL) {
+                /* Failed to allocate memory */
+                free(route);
+                return ESP_ERR_HTTPD_ALLOC_MEM;
+            }
+
+            /* Find or add the nodes of the URI */
+            route->node = httpd_uri_node_get(hd, uri_handler->uri, true);
+            if (route->node == NULL) {
                 /* Failed to allocate memory */
-                free(hd->hd_calls[i]);
+                free((char*)route->uri.uri);
+                free(route);
                 return ESP_ERR_HTTPD_ALLOC_MEM;
             }
 
             /* Copy remaining members */
-            hd->hd_calls[i]->method   = uri_handler->method;
-            hd->hd_calls[i]->handler  = uri_handler->handler;
-            hd->hd_calls[i]->user_ctx = uri_handler->user_ctx;
+            route->uri.method   = uri_handler->method;
+            route->uri.handler  = uri_handler->handler;
+            route->uri.user_ctx = uri_handler->user_ctx;
+
+            route->next = route->node->routes;
+            route->node->routes = route;
+            route->node->methods |= HTTPD_URI_METHOD_BIT(uri_handler->method);
+            hd->hd_calls[i] = &route->uri;
             ESP_LOGD(TAG, LOG_FMT("[%d] installed %s"), i, uri_handler->uri);
             return ESP_OK;
         }
@@ -98,11 +387,7 @@ esp_err_t httpd_unregister_uri_handler(httpd_handle_t handle,
     int i = httpd_find_uri_handler(hd, uri, method);
 
     if (i != -1) {
-        ESP_LOGD(TAG, LOG_FMT("[%d] removing %s"), i, hd->hd_calls[i]->uri);
-
-        free((char*)hd->hd_calls[i]->uri);
-        free(hd->hd_calls[i]);
-        hd->hd_calls[i] = NULL;
+        httpd_uri_route_delete(hd, i);
         return ESP_OK;
     }
     ESP_LOGW(TAG, LOG_FMT("handler %s with method %d not found"), uri, method);
@@ -116,17 +401,20 @@ esp_err_t httpd_unregister_uri(httpd_handle_t handle, const char *uri)
     }
 
     struct httpd_data *hd = (struct httpd_data *) handle;
+    struct httpd_uri_node *node = httpd_uri_node_get(hd, uri, false);
     bool found = false;
 
-    for (int i = 0; i < hd->config.max_uri_handlers; i++) {
+    /* The handlers of all methods are on the node of the URI */
+    for (int i = 0; node && i < hd->config.max_uri_handlers; i++) {
         if ((hd->hd_calls[i] != NULL) &&
-            (strcmp(hd->hd_calls[i]->uri, uri) == 0)) {
-            ESP_LOGD(TAG, LOG_FMT("[%d] removing %s"), i, uri);
-
-            free((char*)hd->hd_calls[i]->uri);
-            free(hd->hd_calls[i]);
-            hd->hd_calls[i] = NULL;
+            (((struct httpd_uri_route *) hd->hd_calls[i])->node == node)) {
             found = true;
+            /* The node goes with its last handler */
+            bool last = (node->routes->next == NULL);
+            httpd_uri_route_delete(hd, i);
+            if (last) {
+                break;
+            }
         }
     }
     if (!found) {
@@ -139,39 +427,86 @@ void httpd_unregister_all_uri_handlers(struct httpd_data *hd)
 {
     for (unsigned i = 0; i < hd->config.max_uri_handlers; i++) {
         if (hd->hd_calls[i]) {
-            ESP_LOGD(TAG, LOG_FMT("[%d] removing %s"), i, hd->hd_calls[i]->uri);
+            httpd_uri_route_delete(hd, i);
+        }
+    }
+
+    /* Without handlers, only the root is left */
+    free(hd->hd_uri_root);
+    free(hd->hd_uri_table);
+    hd->hd_uri_root = NULL;
+    hd->hd_uri_table = NULL;
+    hd->hd_uri_nodes = 0;
+}
+
+/* Matches the path from segment seg on below a node: literal segments first, then
+ * path parameters, then the rest of the path by "*". The values of the parameters
+ * matched are kept in the request, from index param on. The depth of the search is
+ * bounded by the depth of the tree, as it only descends into nodes which exist */
+static struct httpd_uri_route *httpd_uri_match(struct httpd_data *hd, struct httpd_uri_node *node,
+                                               const char *seg, const char *end, unsigned param,
+                                               httpd_method_t method, httpd_err_resp_t *err)
+{
+    struct httpd_req_aux *ra = &hd->hd_req_aux;
+    struct httpd_uri_route *route;
+    struct httpd_uri_node *child;
+
+    if (seg == NULL) {
+        /* The whole path matched the URI of this node */
+        route = httpd_uri_node_route(node, method);
+        if (route) {
+            ra->path_params_count = param;
+        } else if (node->methods) {
+            /* URI found but method not allowed.
+             * If URI IS found later then this
+             * error is to be neglected */
+            *err = HTTPD_405_METHOD_NOT_ALLOWED;
+        }
+        return route;
+    }
+
+    size_t len = httpd_uri_segment_len(seg, end);
+    const char *next = (seg + len < end) ? seg + len + 1 : NULL;
 
-            free((char*)hd->hd_calls[i]->uri);
-            free(hd->hd_calls[i]);
+    if (node->children && (child = httpd_uri_child(hd, node, seg, len)) != NULL) {
+        route = httpd_uri_match(hd, child, next, end, param, method, err);
+        if (route) {
+            return route;
         }
     }
+
+    if (node->param && len > 0) {
+        ra->path_params[param].off = seg - hd->hd_req.uri;
+        ra->path_params[param].len = len;
+        route = httpd_uri_match(hd, node->param, next, end, param + 1, method, err);
+        if (route) {
+            return route;
+        }
+    }
+
+    if (node->wildcard) {
+        ra->path_params[param].off = seg - hd->hd_req.uri;
+        ra->path_params[param].len = end - seg;
+        return httpd_uri_match(hd, node->wildcard, NULL, end, param + 1, method, err);
+    }
+    return NULL;
 }
 
-/* Alternate implmentation of httpd_find_uri_handler()
- * which takes a uri_len field. This is useful when the URI
- * string contains extra parameters that are not to be included
- * while matching with the registered URI_handler strings
- */
+/* Finds the handler for the path of a request. The path is matched
+ * from its first segment, which is empty when it starts with '/' */
 static httpd_uri_t* httpd_find_uri_handler2(httpd_err_resp_t *err,
                                             struct httpd_data *hd,
                                             const char *uri, size_t uri_len,
                                             httpd_method_t method)
 {
+    struct httpd_uri_route *route = NULL;
+
     *err = 0;
-    for (int i = 0; i < hd->config.max_uri_handlers; i++) {
-        if (hd->hd_calls[i]) {
-            ESP_LOGD(TAG, LOG_FMT("[%d] = %s"), i, hd->hd_calls[i]->uri);
-            if ((strlen(hd->hd_calls[i]->uri) == uri_len) &&            // First match uri length
-                (strncmp(hd->hd_calls[i]->uri, uri, uri_len) == 0))  {  // Then match uri strings
-                if (hd->hd_calls[i]->method == method)  {               // Finally match methods
-                    return hd->hd_calls[i];
-                }
-                /* URI found but method not allowed.
-                 * If URI IS found later then this
-                 * error is to be neglected */
-                *err = HTTPD_405_METHOD_NOT_ALLOWED;
-            }
-        }
+    if (hd->hd_uri_root) {
+        route = httpd_uri_match(hd, hd->hd_uri_root, uri, uri + uri_len, 0, method, err);
+    }
+    if (route) {
+        return &route->uri;
     }
     if (*err == 0) {
         *err = HTTPD_404_NOT_FOUND;
@@ -179,6 +514,49 @@ static httpd_uri_t* httpd_find_uri_handler2(httpd_err_resp_t *err,
     return NULL;
 }
 
+esp_err_t httpd_req_get_path_param(httpd_req_t *r, const char *name, char *val, size_t val_size)
+{
+    if (r == NULL || name == NULL || val == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!httpd_valid_req(r)) {
+        return ESP_ERR_HTTPD_INVALID_REQ;
+    }
+
+    struct httpd_req_aux *ra = r->aux;
+    if (ra->uri_handler == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    /* Parameters are numbered in the order of the URI of the handler */
+    const char *uri = ra->uri_handler->uri;
+    const char *end = uri + strlen(uri);
+    size_t name_len = strlen(name);
+    unsigned param = 0;
+    for (const char *seg = uri; seg <= end; seg++) {
+        size_t len = httpd_uri_segment_len(seg, end);
+        httpd_uri_segment_t type = httpd_uri_segment_type(seg, len, seg + len == end);
+
+        if (type != HTTPD_URI_SEGMENT_LITERAL) {
+            bool match = (type == HTTPD_URI_SEGMENT_PARAM) ?
+                         (len - 2 == name_len && strncmp(seg + 1, name, name_len) == 0) :
+                         (strcmp(name, "*") == 0);
+            if (match && param < ra->path_params_count) {
+                size_t min_val_size = ra->path_params[param].len + 1;
+                strlcpy(val, r->uri + ra->path_params[param].off, MIN(val_size, min_val_size));
+                if (val_size < min_val_size) {
+                    return ESP_ERR_HTTPD_RESULT_TRUNC;
+                }
+                return ESP_OK;
+            }
+            param++;
+        }
+        seg += len;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
 esp_err_t httpd_uri(struct httpd_data *hd)
 {
     httpd_uri_t            *uri = NULL;
@@ -188,6 +566,9 @@ esp_err_t httpd_uri(struct httpd_data *hd)
     /* For conveying URI not found/method not allowed */
     httpd_err_resp_t err = 0;
 
+    hd->hd_req_aux.uri_handler = NULL;
+    hd->hd_req_aux.path_params_count = 0;
+
     ESP_LOGD(TAG, LOG_FMT("request for %s with type %d"), req->uri, req->method);
     /* URL parser result contains offset and length of path string */
     if (res->field_set & (1 << UF_PATH)) {
@@ -213,6 +594,7 @@ esp_err_t httpd_uri(struct httpd_data *hd)
 
     /* Attach user context data (passed during URI registration) into request */
     req->user_ctx = uri->user_ctx;
+    hd->hd_req_aux.uri_handler = uri;
 
     /* Invoke handler */
     if (uri->handler(req) != ESP_OK) {
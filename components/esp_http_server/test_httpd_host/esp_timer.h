@@ -0,0 +1,4 @@
+// Host build stub of esp_timer.h, only included by osal.h
+#pragma once
+
+#include <stdint.h>
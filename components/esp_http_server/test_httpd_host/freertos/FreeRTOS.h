@@ -0,0 +1,10 @@
+// Host build stub of FreeRTOS.h, only the types used by the HTTP server headers
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define pdPASS              1
+#define portTICK_RATE_MS    1
+
+typedef void *TaskHandle_t;
@@ -0,0 +1,379 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Count the send calls and bytes per call of httpd_resp_send() and httpd_resp_send_chunk().
+ * The former functions sent the status line, every part of every additional header, the end
+ * of the header section and the content with separate sends; a copy of them is compared with
+ * the functions collecting the response in the scratch buffer. A mock send function records
+ * the bytes sent, which must be the same for both on a range of header counts and content
+ * sizes, also when it accepts only part of the data per call. The time per response is then
+ * measured on a socket pair, with the default send function of the server.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <esp_http_server.h>
+#include "esp_httpd_priv.h"
+
+#define BENCH_RESPONSES     20000
+#define BENCH_RUNS          3
+#define MAX_HEADERS         8
+#define CAPTURE_SIZE        16384
+
+static char s_capture[CAPTURE_SIZE];
+static size_t s_capture_len;
+static unsigned s_calls;
+static unsigned s_more_calls;
+static int s_last_flags;
+static size_t s_partial;
+static char s_content[4096];
+
+static inline uint64_t bench_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void expect(int ok, const char *what)
+{
+    if (!ok) {
+        printf("check failed: %s\n", what);
+        exit(1);
+    }
+}
+
+/* The sessions are not looked up, only the send override of httpd_txrx.c refers to them */
+struct sock_db *httpd_sess_get(struct httpd_data *hd, int sockfd)
+{
+    return NULL;
+}
+
+/* Records the data sent, accepting at most s_partial bytes per call when it is set */
+static int capture_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags)
+{
+    if (s_partial && buf_len > s_partial) {
+        buf_len = s_partial;
+    }
+    expect(s_capture_len + buf_len <= CAPTURE_SIZE, "capture buffer size");
+    memcpy(s_capture + s_capture_len, buf, buf_len);
+    s_capture_len += buf_len;
+    s_calls++;
+    if (flags & MSG_MORE) {
+        s_more_calls++;
+    }
+    s_last_flags = flags;
+    return buf_len;
+}
+
+/* ---------------------------------------- Former responses ---------------------------------------- */
+
+static esp_err_t legacy_send_all(httpd_req_t *r, const char *buf, size_t buf_len)
+{
+    struct httpd_req_aux *ra = r->aux;
+    int ret;
+
+    while (buf_len > 0) {
+        ret = ra->sd->send_fn(ra->sd->handle, ra->sd->fd, buf, buf_len, 0);
+        if (ret < 0) {
+            return ESP_FAIL;
+        }
+        buf     += ret;
+        buf_len -= ret;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t legacy_send_hdrs(httpd_req_t *r)
+{
+    struct httpd_req_aux *ra = r->aux;
+
+    if (legacy_send_all(r, ra->scratch, strlen(ra->scratch)) != ESP_OK) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+
+    for (unsigned i = 0; i < ra->resp_hdrs_count; i++) {
+        if (legacy_send_all(r, ra->resp_hdrs[i].field, strlen(ra->resp_hdrs[i].field)) != ESP_OK ||
+            legacy_send_all(r, ": ", 2) != ESP_OK ||
+            legacy_send_all(r, ra->resp_hdrs[i].value, strlen(ra->resp_hdrs[i].value)) != ESP_OK ||
+            legacy_send_all(r, "\r\n", 2) != ESP_OK) {
+            return ESP_ERR_HTTPD_RESP_SEND;
+        }
+    }
+
+    if (legacy_send_all(r, "\r\n", 2) != ESP_OK) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t legacy_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    struct httpd_req_aux *ra = r->aux;
+
+    if (buf_len == -1) buf_len = strlen(buf);
+
+    ra->req_hdrs_count = 0;
+
+    if (snprintf(ra->scratch, sizeof(ra->scratch), "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %d\r\n",
+                 ra->status, ra->content_type, (int)buf_len) >= sizeof(ra->scratch)) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+
+    if (legacy_send_hdrs(r) != ESP_OK) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+
+    if (buf && buf_len) {
+        if (legacy_send_all(r, buf, buf_len) != ESP_OK) {
+            return ESP_ERR_HTTPD_RESP_SEND;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t legacy_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    struct httpd_req_aux *ra = r->aux;
+
+    if (buf_len == -1) buf_len = strlen(buf);
+
+    ra->req_hdrs_count = 0;
+
+    if (!ra->first_chunk_sent) {
+        if (snprintf(ra->scratch, sizeof(ra->scratch), "HTTP/1.1 %s\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\n",
+                     ra->status, ra->content_type) >= sizeof(ra->scratch)) {
+            return ESP_ERR_HTTPD_RESP_HDR;
+        }
+
+        if (legacy_send_hdrs(r) != ESP_OK) {
+            return ESP_ERR_HTTPD_RESP_SEND;
+        }
+        ra->first_chunk_sent = true;
+    }
+
+    char len_str[10];
+    snprintf(len_str, sizeof(len_str), "%x\r\n", (unsigned)buf_len);
+    if (legacy_send_all(r, len_str, strlen(len_str)) != ESP_OK) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+
+    if (buf) {
+        if (legacy_send_all(r, buf, (size_t) buf_len) != ESP_OK) {
+            return ESP_ERR_HTTPD_RESP_SEND;
+        }
+    }
+
+    if (legacy_send_all(r, "\r\n", 2) != ESP_OK) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    return ESP_OK;
+}
+
+/* ---------------------------------------------- Test ---------------------------------------------- */
+
+typedef esp_err_t (*resp_func_t)(httpd_req_t *, const char *, ssize_t);
+
+static struct httpd_data s_hd;
+static struct sock_db s_sd;
+static struct httpd_req_aux s_ra;
+static struct resp_hdr s_resp_hdrs[MAX_HEADERS];
+static httpd_req_t s_req;
+
+static const char *s_fields[MAX_HEADERS] = {
+    "Cache-Control", "Connection", "Access-Control-Allow-Origin", "X-Request-Id",
+    "Set-Cookie", "Location", "Server", "Date",
+};
+
+static const char *s_values[MAX_HEADERS] = {
+    "no-cache", "keep-alive", "*", "8f14e45fceea167a5a36dedd4bea2543",
+    "session=38afes7a8; Path=/; HttpOnly", "/index.html", "esp8266", "Mon, 06 Jan 2020 10:00:00 GMT",
+};
+
+static httpd_req_t *new_req(unsigned num_hdrs, httpd_send_func_t send_fn, int fd)
+{
+    memset(&s_ra, 0, sizeof(s_ra));
+    memset(&s_sd, 0, sizeof(s_sd));
+    s_hd.config.max_resp_headers = MAX_HEADERS;
+    s_sd.handle = &s_hd;
+    s_sd.fd = fd;
+    s_sd.send_fn = send_fn;
+    s_ra.sd = &s_sd;
+    s_ra.status = HTTPD_200;
+    s_ra.content_type = HTTPD_TYPE_TEXT;
+    s_ra.resp_hdrs = s_resp_hdrs;
+    s_req.handle = &s_hd;
+    s_req.aux = &s_ra;
+
+    for (unsigned i = 0; i < num_hdrs; i++) {
+        expect(httpd_resp_set_hdr(&s_req, s_fields[i], s_values[i]) == ESP_OK, "set header");
+    }
+
+    return &s_req;
+}
+
+/* Sends a response, or a chunked response of num_chunks chunks of size bytes and the last chunk */
+static void capture(unsigned num_hdrs, size_t size, unsigned num_chunks, resp_func_t send, resp_func_t send_chunk)
+{
+    httpd_req_t *r = new_req(num_hdrs, capture_send, 0);
+
+    s_capture_len = 0;
+    s_calls = s_more_calls = 0;
+    if (!num_chunks) {
+        expect(send(r, s_content, size) == ESP_OK, "response sent");
+    } else {
+        for (unsigned n = 0; n < num_chunks; n++) {
+            expect(send_chunk(r, s_content, size) == ESP_OK, "chunk sent");
+        }
+        expect(send_chunk(r, NULL, 0) == ESP_OK, "last chunk sent");
+    }
+}
+
+static void compare(unsigned num_hdrs, size_t size, unsigned num_chunks)
+{
+    static char expected[CAPTURE_SIZE];
+    size_t expected_len;
+
+    capture(num_hdrs, size, num_chunks, legacy_resp_send, legacy_resp_send_chunk);
+    memcpy(expected, s_capture, s_capture_len);
+    expected_len = s_capture_len;
+
+    capture(num_hdrs, size, num_chunks, httpd_resp_send, httpd_resp_send_chunk);
+    if (expected_len != s_capture_len || memcmp(expected, s_capture, s_capture_len)) {
+        printf("%u headers, %zu bytes, %u chunks, partial sends of %zu: response differs from the former one\n",
+               num_hdrs, size, num_chunks, s_partial);
+        exit(1);
+    }
+    expect(s_last_flags == 0, "last send without MSG_MORE");
+}
+
+static void check_responses(void)
+{
+    static const size_t s_sizes[] = { 0, 1, 100, 300, HTTPD_SCRATCH_BUF, HTTPD_SCRATCH_BUF + 1, 2000, sizeof(s_content) };
+    static const size_t s_partials[] = { 0, 1, 7, 256 };
+    static char long_value[HTTPD_SCRATCH_BUF + 100];
+
+    for (size_t i = 0; i < sizeof(s_content); i++) {
+        s_content[i] = 'a' + i % 26;
+    }
+
+    for (size_t p = 0; p < sizeof(s_partials) / sizeof(s_partials[0]); p++) {
+        s_partial = s_partials[p];
+        for (unsigned num_hdrs = 0; num_hdrs <= MAX_HEADERS; num_hdrs++) {
+            for (size_t n = 0; n < sizeof(s_sizes) / sizeof(s_sizes[0]); n++) {
+                compare(num_hdrs, s_sizes[n], 0);
+                compare(num_hdrs, s_sizes[n], 1);
+                compare(num_hdrs, s_sizes[n], 2);
+            }
+        }
+    }
+    s_partial = 0;
+
+    /* Small responses take a single send, also with the first and the last chunk */
+    capture(5, 100, 0, httpd_resp_send, httpd_resp_send_chunk);
+    expect(s_calls == 1, "single send of a small response");
+    capture(5, 100, 1, httpd_resp_send, httpd_resp_send_chunk);
+    expect(s_calls == 2, "single send per chunk");
+
+    /* Content larger than the scratch buffer follows the headers without being copied */
+    capture(5, 2000, 0, httpd_resp_send, httpd_resp_send_chunk);
+    expect(s_calls == 2 && s_more_calls == 1, "headers and content of a large response");
+
+    /* A header value larger than the scratch buffer is sent directly as well */
+    const char *value = s_values[0];
+    memset(long_value, 'v', sizeof(long_value) - 1);
+    s_values[0] = long_value;
+    compare(3, 100, 0);
+    compare(3, 100, 2);
+    s_values[0] = value;
+}
+
+/* Responses with the default send function of the server, on a socket pair drained after each one */
+static double bench_once(int fds[2], unsigned num_hdrs, size_t size, resp_func_t send)
+{
+    static char drain[8192];
+    uint64_t start;
+
+    start = bench_ns();
+    for (int i = 0; i < BENCH_RESPONSES; i++) {
+        httpd_req_t *r = new_req(num_hdrs, httpd_default_send, fds[0]);
+
+        expect(send(r, s_content, size) == ESP_OK, "response sent");
+        while (recv(fds[1], drain, sizeof(drain), MSG_DONTWAIT) > 0) {
+        }
+    }
+
+    return (double)(bench_ns() - start) / BENCH_RESPONSES;
+}
+
+/* Best of several runs, to keep other load on the host out of the comparison */
+static double bench_run(int fds[2], unsigned num_hdrs, size_t size, resp_func_t send)
+{
+    double best = 0;
+
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        double ns = bench_once(fds, num_hdrs, size, send);
+
+        if (!run || ns < best) {
+            best = ns;
+        }
+    }
+
+    return best;
+}
+
+int main(void)
+{
+    static const unsigned s_num_hdrs[] = { 0, 2, 5, 8 };
+    static const size_t s_sizes[] = { 64, 1024 };
+    int fds[2];
+
+    check_responses();
+
+    expect(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "socket pair");
+
+    printf("%8s %6s %13s %10s %13s %10s %15s %15s\n", "headers", "bytes", "former sends", "bytes/send",
+           "new sends", "bytes/send", "former ns/resp", "new ns/resp");
+    for (size_t h = 0; h < sizeof(s_num_hdrs) / sizeof(s_num_hdrs[0]); h++) {
+        for (size_t n = 0; n < sizeof(s_sizes) / sizeof(s_sizes[0]); n++) {
+            unsigned num_hdrs = s_num_hdrs[h], legacy_calls;
+            size_t size = s_sizes[n];
+            double legacy_bytes;
+
+            capture(num_hdrs, size, 0, legacy_resp_send, legacy_resp_send_chunk);
+            legacy_calls = s_calls;
+            legacy_bytes = (double)s_capture_len / s_calls;
+            capture(num_hdrs, size, 0, httpd_resp_send, httpd_resp_send_chunk);
+
+            printf("%8u %6zu %13u %10.1f %13u %10.1f %15.1f %15.1f\n", num_hdrs, size,
+                   legacy_calls, legacy_bytes, s_calls, (double)s_capture_len / s_calls,
+                   bench_run(fds, num_hdrs, size, legacy_resp_send), bench_run(fds, num_hdrs, size, httpd_resp_send));
+        }
+    }
+
+    close(fds[0]);
+    close(fds[1]);
+
+    return 0;
+}
@@ -0,0 +1,5 @@
+// Host build stub of sdkconfig.h, the defaults of the HTTP server options
+#pragma once
+
+#define CONFIG_HTTPD_MAX_REQ_HDR_LEN    512
+#define CONFIG_HTTPD_MAX_URI_LEN        512
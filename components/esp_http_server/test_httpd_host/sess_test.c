@@ -0,0 +1,423 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Check and measure the session database of the server. A pseudo random sequence of opened,
+ * processed and deleted sessions is run against a model: after every step the session of every
+ * descriptor, the descriptors for select() and the session closed to make room for a new one
+ * must match. A session open_fn refuses gives back its contexts and its slot. Then the work of the server per request, looking up the session, marking it used
+ * and collecting the descriptors for the next select(), and the search for the least recently
+ * used session are timed against a copy of the former functions, which walked through all the
+ * slots of the socket database for each of them. So is a select() wakeup with all sessions ready,
+ * where the former loop looked up every session again to continue the iteration.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <esp_http_server.h>
+#include "esp_httpd_priv.h"
+
+#define BENCH_REQUESTS      200000
+#define BENCH_RUNS          3
+#define TEST_SOCKETS        13
+#define TEST_FD_BASE        54
+#define TEST_FD_RANGE       64
+#define TEST_OPS            100000
+
+static int s_closed_fd;
+
+static inline uint64_t bench_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void expect(int ok, const char *what)
+{
+    if (!ok) {
+        printf("check failed: %s\n", what);
+        exit(1);
+    }
+}
+
+/* Requests are neither received nor parsed */
+esp_err_t httpd_req_new(struct httpd_data *hd, struct sock_db *sd)
+{
+    return ESP_OK;
+}
+
+esp_err_t httpd_req_delete(struct httpd_data *hd)
+{
+    return ESP_OK;
+}
+
+/* The session httpd_sess_trigger_close() queues to be closed is recorded instead */
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg)
+{
+    s_closed_fd = ((struct sock_db *)arg)->fd;
+    return ESP_OK;
+}
+
+/* Like httpd_create() and httpd_start() of httpd_main.c */
+static struct httpd_data *create_server(uint16_t max_open_sockets)
+{
+    struct httpd_data *hd = calloc(1, sizeof(struct httpd_data));
+
+    hd->config.max_open_sockets = max_open_sockets;
+    hd->config.lru_purge_enable = true;
+    hd->hd_sd = calloc(max_open_sockets, sizeof(struct sock_db));
+    hd->hd_sd_index_mask = 1;
+    while (hd->hd_sd_index_mask < max_open_sockets) {
+        hd->hd_sd_index_mask <<= 1;
+    }
+    hd->hd_sd_index = calloc(hd->hd_sd_index_mask, sizeof(struct sock_db *));
+    hd->hd_sd_index_mask--;
+    expect(hd->hd_sd && hd->hd_sd_index, "server allocation");
+    httpd_sess_init(hd);
+
+    return hd;
+}
+
+static void delete_server(struct httpd_data *hd)
+{
+    free(hd->hd_sd_index);
+    free(hd->hd_sd);
+    free(hd);
+}
+
+/* ------------------------------------------ Model check ------------------------------------------ */
+
+/* Open sessions of the model by descriptor, with the order they are used in. Sessions which
+ * haven't been processed yet are used least recently, the one opened last first */
+static bool s_open[TEST_FD_RANGE];
+static int64_t s_used[TEST_FD_RANGE];
+static int64_t s_seq;
+static int s_num_open;
+
+static void check_model(struct httpd_data *hd)
+{
+    fd_set fds;
+    int max_fd, lru_fd = -1, expected_max_fd = -1;
+    int iterated = 0;
+
+    httpd_sess_set_descriptors(hd, &fds, &max_fd);
+    for (int i = 0; i < TEST_FD_RANGE; i++) {
+        int fd = TEST_FD_BASE + i;
+        struct sock_db *sd = httpd_sess_get(hd, fd);
+
+        expect(s_open[i] == (sd != NULL), "session of a descriptor");
+        expect(!sd || sd->fd == fd, "descriptor of a session");
+        expect(s_open[i] == !!FD_ISSET(fd, &fds), "descriptor for select()");
+        if (s_open[i]) {
+            expected_max_fd = fd;
+            if (lru_fd == -1 || s_used[i] < s_used[lru_fd - TEST_FD_BASE]) {
+                lru_fd = fd;
+            }
+        }
+    }
+    expect(max_fd == expected_max_fd, "largest descriptor for select()");
+    expect(httpd_is_sess_available(hd) == (s_num_open < TEST_SOCKETS), "session available");
+
+    for (int fd = httpd_sess_iterate(hd, -1); fd != -1; fd = httpd_sess_iterate(hd, fd)) {
+        expect(s_open[fd - TEST_FD_BASE], "iterated session open");
+        iterated++;
+    }
+    expect(iterated == s_num_open, "all sessions iterated");
+
+    s_closed_fd = -1;
+    expect(httpd_sess_close_lru(hd) == ESP_OK, "close least recently used");
+    expect(s_closed_fd == (s_num_open == TEST_SOCKETS ? lru_fd : -1), "least recently used session");
+}
+
+static void run_op(struct httpd_data *hd, uint32_t op, int fd)
+{
+    int i = fd - TEST_FD_BASE;
+
+    switch (op % 5) {
+    case 0:
+    case 1:
+        if (s_open[i]) {
+            expect(httpd_sess_new(hd, fd) == ESP_FAIL, "session opened twice");
+        } else if (s_num_open == TEST_SOCKETS) {
+            expect(httpd_sess_new(hd, fd) == ESP_FAIL, "session opened with all slots in use");
+        } else {
+            expect(httpd_sess_new(hd, fd) == ESP_OK, "session opened");
+            s_open[i] = true;
+            s_used[i] = -++s_seq;
+            s_num_open++;
+        }
+        break;
+    case 2:
+        expect(httpd_sess_process(hd, fd) == (s_open[i] ? ESP_OK : ESP_FAIL), "session processed");
+        if (s_open[i]) {
+            s_used[i] = ++s_seq;
+        }
+        break;
+    case 3:
+        expect(httpd_sess_update_lru_counter(hd, fd) == (s_open[i] ? ESP_OK : ESP_ERR_NOT_FOUND), "session used");
+        if (s_open[i]) {
+            s_used[i] = ++s_seq;
+        }
+        break;
+    default:
+        httpd_sess_delete(hd, fd);
+        if (s_open[i]) {
+            s_open[i] = false;
+            s_num_open--;
+        }
+        break;
+    }
+
+    check_model(hd);
+}
+
+static void check_sessions(void)
+{
+    struct httpd_data *hd = create_server(TEST_SOCKETS);
+    uint32_t seed = 1;
+
+    for (int n = 0; n < TEST_OPS; n++) {
+        seed = seed * 1103515245 + 12345;
+        /* Mostly nearby descriptors, like lwIP hands out, sometimes any in the range */
+        int fd = TEST_FD_BASE + ((seed >> 8) % 8 ? (seed >> 12) % (TEST_SOCKETS + 4) : (seed >> 12) % TEST_FD_RANGE);
+        run_op(hd, seed >> 24, fd);
+    }
+
+    delete_server(hd);
+}
+
+static int s_freed_ctx;
+
+static void count_free_ctx(void *ctx)
+{
+    s_freed_ctx++;
+}
+
+/* Sets both contexts of the session, then refuses it */
+static esp_err_t refuse_open(httpd_handle_t hd, int sockfd)
+{
+    static int s_ctx, s_transport_ctx;
+
+    httpd_sess_set_ctx(hd, sockfd, &s_ctx, count_free_ctx);
+    httpd_sess_set_transport_ctx(hd, sockfd, &s_transport_ctx, count_free_ctx);
+    return ESP_FAIL;
+}
+
+static void check_refused_open(void)
+{
+    struct httpd_data *hd = create_server(1);
+
+    hd->config.open_fn = refuse_open;
+    expect(httpd_sess_new(hd, TEST_FD_BASE) == ESP_FAIL, "session refused");
+    expect(s_freed_ctx == 2, "contexts of the refused session freed");
+    expect(httpd_sess_get(hd, TEST_FD_BASE) == NULL && httpd_is_sess_available(hd), "slot free again");
+
+    hd->config.open_fn = NULL;
+    expect(httpd_sess_new(hd, TEST_FD_BASE) == ESP_OK, "session opened");
+    struct sock_db *sd = httpd_sess_get(hd, TEST_FD_BASE);
+    expect(sd->ctx == NULL && sd->transport_ctx == NULL, "no context left in the slot");
+    httpd_sess_delete(hd, TEST_FD_BASE);
+    expect(s_freed_ctx == 2, "contexts freed once");
+    delete_server(hd);
+}
+
+/* ----------------------------------------- Former sessions ----------------------------------------- */
+
+/* The slots of the former socket database, as large as the current ones */
+struct legacy_sock_db {
+    struct sock_db sd;
+    uint64_t lru_counter;
+};
+
+static uint64_t s_legacy_lru_counter;
+
+static struct legacy_sock_db *legacy_sess_get(struct legacy_sock_db *db, int max_open_sockets, int sockfd)
+{
+    for (int i = 0; i < max_open_sockets; i++) {
+        if (db[i].sd.fd == sockfd) {
+            return &db[i];
+        }
+    }
+    return NULL;
+}
+
+static void legacy_sess_set_descriptors(struct legacy_sock_db *db, int max_open_sockets, fd_set *fdset, int *maxfd)
+{
+    *maxfd = -1;
+    for (int i = 0; i < max_open_sockets; i++) {
+        if (db[i].sd.fd != -1) {
+            FD_SET(db[i].sd.fd, fdset);
+            if (db[i].sd.fd > *maxfd) {
+                *maxfd = db[i].sd.fd;
+            }
+        }
+    }
+}
+
+static int legacy_sess_lru(struct legacy_sock_db *db, int max_open_sockets)
+{
+    uint64_t lru_counter = UINT64_MAX;
+    int lru_fd = -1;
+
+    for (int i = 0; i < max_open_sockets; i++) {
+        if (db[i].sd.fd == -1) {
+            return -1;
+        }
+        if (db[i].lru_counter < lru_counter) {
+            lru_counter = db[i].lru_counter;
+            lru_fd = db[i].sd.fd;
+        }
+    }
+    return lru_fd;
+}
+
+static int legacy_sess_iterate(struct legacy_sock_db *db, int max_open_sockets, int start_fd)
+{
+    int start_index = 0;
+
+    if (start_fd != -1) {
+        for (int i = 0; i < max_open_sockets; i++) {
+            if (db[i].sd.fd == start_fd) {
+                start_index = i + 1;
+                break;
+            }
+        }
+    }
+
+    for (int i = start_index; i < max_open_sockets; i++) {
+        if (db[i].sd.fd != -1) {
+            return db[i].sd.fd;
+        }
+    }
+    return -1;
+}
+
+/* ------------------------------------------- Benchmark ------------------------------------------- */
+
+static volatile int s_sink;
+
+/* A request on every session in turn: select() descriptors, session lookup and LRU update, then a purge search */
+static double bench_once(struct httpd_data *hd, struct legacy_sock_db *db, int sockets, int legacy)
+{
+    uint64_t start;
+    fd_set fds;
+    int max_fd;
+
+    start = bench_ns();
+    for (int n = 0; n < BENCH_REQUESTS; n++) {
+        int fd = TEST_FD_BASE + (n * 7) % sockets;
+
+        if (legacy) {
+            FD_ZERO(&fds);
+            legacy_sess_set_descriptors(db, sockets, &fds, &max_fd);
+            struct legacy_sock_db *sd = legacy_sess_get(db, sockets, fd);
+            sd->lru_counter = s_legacy_lru_counter++;
+            s_sink = legacy_sess_lru(db, sockets);
+        } else {
+            httpd_sess_set_descriptors(hd, &fds, &max_fd);
+            httpd_sess_process(hd, fd);
+            httpd_sess_close_lru(hd);
+            s_sink = s_closed_fd;
+        }
+    }
+
+    return (double)(bench_ns() - start) / BENCH_REQUESTS;
+}
+
+/* A select() wakeup with all the sessions ready, served like the loop of httpd_server() does */
+static double bench_wakeup_once(struct httpd_data *hd, struct legacy_sock_db *db, int sockets, int legacy)
+{
+    int wakeups = BENCH_REQUESTS / sockets;
+    uint64_t start;
+
+    start = bench_ns();
+    for (int n = 0; n < wakeups; n++) {
+        if (legacy) {
+            int fd = -1;
+            while ((fd = legacy_sess_iterate(db, sockets, fd)) != -1) {
+                struct legacy_sock_db *sd = legacy_sess_get(db, sockets, fd);
+                if (sd->sd.pending_len == 0) {
+                    sd = legacy_sess_get(db, sockets, fd);
+                    sd->lru_counter = s_legacy_lru_counter++;
+                }
+            }
+        } else {
+            for (int i = 0; i < sockets; i++) {
+                int fd = hd->hd_sd[i].fd;
+                if (fd != -1 && !httpd_sess_pending(hd, fd)) {
+                    httpd_sess_process(hd, fd);
+                }
+            }
+        }
+    }
+
+    return (double)(bench_ns() - start) / wakeups;
+}
+
+/* Best of several runs, to keep other load on the host out of the comparison */
+static double bench_run(struct httpd_data *hd, struct legacy_sock_db *db, int sockets, int legacy, int wakeup)
+{
+    double best = 0;
+
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        double ns = wakeup ? bench_wakeup_once(hd, db, sockets, legacy) : bench_once(hd, db, sockets, legacy);
+
+        if (!run || ns < best) {
+            best = ns;
+        }
+    }
+
+    return best;
+}
+
+int main(void)
+{
+    static const int s_sockets[] = { 7, 16, 32, 64 };
+
+    check_sessions();
+    check_refused_open();
+
+    printf("%8s %14s %14s %8s %16s %16s %8s\n", "sockets", "former ns/req", "index ns/req", "speedup",
+           "former ns/wakeup", "index ns/wakeup", "speedup");
+    for (size_t n = 0; n < sizeof(s_sockets) / sizeof(s_sockets[0]); n++) {
+        int sockets = s_sockets[n];
+        struct httpd_data *hd = create_server(sockets);
+        struct legacy_sock_db *db = calloc(sockets, sizeof(struct legacy_sock_db));
+        double legacy, index, legacy_wakeup, index_wakeup;
+
+        for (int i = 0; i < sockets; i++) {
+            expect(httpd_sess_new(hd, TEST_FD_BASE + i) == ESP_OK, "session opened");
+            db[i].sd.fd = TEST_FD_BASE + i;
+        }
+
+        legacy = bench_run(hd, db, sockets, 1, 0);
+        index = bench_run(hd, db, sockets, 0, 0);
+        legacy_wakeup = bench_run(hd, db, sockets, 1, 1);
+        index_wakeup = bench_run(hd, db, sockets, 0, 1);
+        printf("%8d %14.1f %14.1f %7.2fx %16.1f %16.1f %7.2fx\n", sockets, legacy, index, legacy / index,
+               legacy_wakeup, index_wakeup, legacy_wakeup / index_wakeup);
+
+        free(db);
+        delete_server(hd);
+    }
+
+    return 0;
+}
@@ -0,0 +1,465 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Check and measure the lookup of URI handlers. Pseudo random sets of URIs with literal segments,
+ * path parameters and wildcards are registered and unregistered, and the handler httpd_uri() runs
+ * for random paths and methods is compared with the one a plain search through all handlers finds:
+ * among those matching the path, the one whose segments are literal, parameter or wildcard in the
+ * most specific order. The path parameters the handler gets and the 404/405 errors are checked too.
+ * Then 200 handlers of a REST API are registered and the lookup is timed against a copy of the
+ * former httpd_find_uri_handler2(), which compared the path with the URI of every handler.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/* The lookup of the handlers is static, so the source of the server is compiled in */
+#include "../src/httpd_uri.c"
+
+#define BENCH_LOOKUPS       200000
+#define BENCH_RUNS          3
+#define BENCH_RESOURCES     40
+#define TEST_ROUTES         48
+#define TEST_OPS            20000
+#define TEST_DEPTH          5
+
+static struct httpd_data *s_hd;
+static int s_called;
+static httpd_err_resp_t s_err;
+
+static inline uint64_t bench_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void expect(int ok, const char *what)
+{
+    if (!ok) {
+        printf("check failed: %s\n", what);
+        exit(1);
+    }
+}
+
+/* The error responses are recorded instead of sent */
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_resp_t error)
+{
+    s_err = error;
+    return ESP_OK;
+}
+
+static esp_err_t record_handler(httpd_req_t *req)
+{
+    s_called = (intptr_t)req->user_ctx;
+    return ESP_OK;
+}
+
+static struct httpd_data *create_server(uint16_t max_uri_handlers)
+{
+    struct httpd_data *hd = calloc(1, sizeof(struct httpd_data));
+
+    hd->config.max_uri_handlers = max_uri_handlers;
+    hd->hd_calls = calloc(max_uri_handlers, sizeof(httpd_uri_t *));
+    expect(hd->hd_calls != NULL, "server allocation");
+    hd->hd_req.aux = &hd->hd_req_aux;
+    hd->hd_req.handle = hd;
+
+    return hd;
+}
+
+static void delete_server(struct httpd_data *hd)
+{
+    httpd_unregister_all_uri_handlers(hd);
+    free(hd->hd_calls);
+    free(hd);
+}
+
+/* Sets up the request like httpd_parse.c does and runs httpd_uri() */
+static int lookup(struct httpd_data *hd, const char *path, httpd_method_t method)
+{
+    struct http_parser_url *res = &hd->hd_req_aux.url_parse_res;
+
+    strlcpy((char *)hd->hd_req.uri, path, sizeof(hd->hd_req.uri));
+    hd->hd_req.method = method;
+    memset(res, 0, sizeof(*res));
+    res->field_set = 1 << UF_PATH;
+    res->field_data[UF_PATH].off = 0;
+    res->field_data[UF_PATH].len = strlen(path);
+
+    s_called = -1;
+    s_err = 0;
+    expect(httpd_uri(hd) == ESP_OK, "httpd_uri()");
+    return s_called;
+}
+
+/* ------------------------------------------ Model check ------------------------------------------ */
+
+static const char *s_uri_segments[] = { "a", "b", "c", "", "{x}", "{y}", "*" };
+static const char *s_path_segments[] = { "a", "b", "c", "d", "" };
+
+static char s_uris[TEST_ROUTES][64];
+static httpd_method_t s_methods[TEST_ROUTES];
+static bool s_registered[TEST_ROUTES];
+
+#define SEG_COUNT(a)    (sizeof(a) / sizeof(a[0]))
+
+/* Splits a string at '/' characters */
+static int split(const char *str, char seg[][HTTPD_MAX_URI_LEN + 1])
+{
+    int n = 0;
+
+    for (;;) {
+        const char *slash = strchr(str, '/');
+        size_t len = slash ? slash - str : strlen(str);
+        memcpy(seg[n], str, len);
+        seg[n++][len] = '\0';
+        if (!slash) {
+            return n;
+        }
+        str = slash + 1;
+    }
+}
+
+static int seg_type(const char *seg, bool last)
+{
+    size_t len = strlen(seg);
+    if (len >= 3 && seg[0] == '{' && seg[len - 1] == '}') {
+        return 1;
+    }
+    return (last && strcmp(seg, "*") == 0) ? 2 : 0;
+}
+
+/* Whether a URI matches a path, with the kinds of its segments and the parameter values */
+static bool reference_match(const char *uri, const char *path, int *types, int *num_types,
+                            char values[][HTTPD_MAX_URI_LEN + 1], int *num_values)
+{
+    static char useg[64][HTTPD_MAX_URI_LEN + 1], pseg[64][HTTPD_MAX_URI_LEN + 1];
+    int nu = split(uri, useg), np = split(path, pseg);
+
+    *num_types = *num_values = 0;
+    for (int i = 0; i < nu; i++) {
+        int type = seg_type(useg[i], i == nu - 1);
+        types[(*num_types)++] = type;
+        if (type == 2) {
+            /* The rest of the path, from this segment on */
+            if (i >= np) {
+                return false;
+            }
+            const char *rest = path;
+            for (int k = 0; k < i; k++) {
+                rest = strchr(rest, '/') + 1;
+            }
+            strcpy(values[(*num_values)++], rest);
+            return true;
+        }
+        if (i >= np) {
+            return false;
+        }
+        if (type == 1) {
+            if (pseg[i][0] == '\0') {
+                return false;
+            }
+            strcpy(values[(*num_values)++], pseg[i]);
+        } else if (strcmp(useg[i], pseg[i])) {
+            return false;
+        }
+    }
+    return nu == np;
+}
+
+/* The handler for a path: of those matching, the one with literal segments before parameters before "*" */
+static int reference_lookup(const char *path, httpd_method_t method, httpd_err_resp_t *err,
+                            char values[][HTTPD_MAX_URI_LEN + 1], int *num_values)
+{
+    int best = -1, best_types[64], best_num = 0;
+    static char v[HTTPD_MAX_PATH_PARAMS + 64][HTTPD_MAX_URI_LEN + 1];
+
+    *err = HTTPD_404_NOT_FOUND;
+    for (int r = 0; r < TEST_ROUTES; r++) {
+        int types[64], num, nv;
+        if (!s_registered[r] || !reference_match(s_uris[r], path, types, &num, v, &nv)) {
+            continue;
+        }
+        if (s_methods[r] != method) {
+            *err = HTTPD_405_METHOD_NOT_ALLOWED;
+            continue;
+        }
+        bool better = (best == -1);
+        for (int i = 0; !better && i < num && i < best_num; i++) {
+            if (types[i] != best_types[i]) {
+                better = types[i] < best_types[i];
+                break;
+            }
+        }
+        if (better) {
+            best = r;
+            best_num = num;
+            memcpy(best_types, types, sizeof(types));
+            *num_values = nv;
+            memcpy(values, v, nv * sizeof(v[0]));
+        }
+    }
+    return best;
+}
+
+/* URIs differing in the names of their parameters only are the same */
+static bool same_uri(const char *a, const char *b)
+{
+    char na[64], nb[64];
+
+    strcpy(na, a);
+    strcpy(nb, b);
+    for (char *c = na; (c = strstr(c, "{y}")) != NULL; c[1] = 'x');
+    for (char *c = nb; (c = strstr(c, "{y}")) != NULL; c[1] = 'x');
+    return strcmp(na, nb) == 0;
+}
+
+static void random_string(uint32_t *seed, char *out, const char **segs, size_t num_segs, int max_depth)
+{
+    *seed = *seed * 1103515245 + 12345;
+    int depth = 1 + (*seed >> 16) % max_depth;
+
+    /* Most paths start with '/', the first segment is empty then */
+    *seed = *seed * 1103515245 + 12345;
+    strcpy(out, ((*seed >> 16) % 8) ? "" : segs[0]);
+    for (int i = 0; i < depth; i++) {
+        *seed = *seed * 1103515245 + 12345;
+        strcat(out, "/");
+        strcat(out, segs[(*seed >> 16) % num_segs]);
+    }
+}
+
+static void check_params(char values[][HTTPD_MAX_URI_LEN + 1], int num_values, int route)
+{
+    static char useg[64][HTTPD_MAX_URI_LEN + 1];
+    int nu = split(s_uris[route], useg), param = 0;
+    char val[HTTPD_MAX_URI_LEN + 1];
+
+    for (int i = 0; i < nu; i++) {
+        int type = seg_type(useg[i], i == nu - 1);
+        if (type == 0) {
+            continue;
+        }
+        char name[HTTPD_MAX_URI_LEN + 1];
+        strcpy(name, type == 2 ? "*" : useg[i] + 1);
+        name[strlen(name) - (type == 2 ? 0 : 1)] = '\0';
+        /* With a name used twice, the first one is found */
+        bool first = true;
+        for (int k = 0; k < i; k++) {
+            first &= strcmp(useg[k], useg[i]) != 0;
+        }
+        if (first) {
+            expect(httpd_req_get_path_param(&s_hd->hd_req, name, val, sizeof(val)) == ESP_OK, "path parameter found");
+            expect(strcmp(val, values[param]) == 0, "path parameter value");
+        }
+        param++;
+    }
+    expect(param == num_values, "path parameters matched");
+    expect(httpd_req_get_path_param(&s_hd->hd_req, "none", val, sizeof(val)) == ESP_ERR_NOT_FOUND, "no such parameter");
+}
+
+static void check_routes(void)
+{
+    static char values[HTTPD_MAX_PATH_PARAMS + 64][HTTPD_MAX_URI_LEN + 1];
+    uint32_t seed = 1;
+    char path[128];
+
+    s_hd = create_server(TEST_ROUTES);
+    for (int r = 0; r < TEST_ROUTES; r++) {
+        random_string(&seed, s_uris[r], s_uri_segments, SEG_COUNT(s_uri_segments), TEST_DEPTH - 1);
+        s_methods[r] = (r % 3) ? HTTP_GET : HTTP_POST;
+    }
+
+    for (int n = 0; n < TEST_OPS; n++) {
+        seed = seed * 1103515245 + 12345;
+        int r = (seed >> 16) % TEST_ROUTES;
+        seed = seed * 1103515245 + 12345;
+
+        if ((seed >> 16) % 4 == 0) {
+            /* Register or unregister a handler */
+            httpd_uri_t uri = { .uri = s_uris[r], .method = s_methods[r], .handler = record_handler,
+                                .user_ctx = (void *)(intptr_t)r };
+            bool exists = false;
+            for (int k = 0; k < TEST_ROUTES; k++) {
+                exists |= s_registered[k] && s_methods[k] == s_methods[r] && same_uri(s_uris[k], s_uris[r]);
+            }
+            if (s_registered[r]) {
+                expect(httpd_unregister_uri_handler(s_hd, s_uris[r], s_methods[r]) == ESP_OK, "unregistered");
+                s_registered[r] = false;
+            } else if (exists) {
+                expect(httpd_register_uri_handler(s_hd, &uri) == ESP_ERR_HTTPD_HANDLER_EXISTS, "registered twice");
+            } else {
+                expect(httpd_register_uri_handler(s_hd, &uri) == ESP_OK, "registered");
+                s_registered[r] = true;
+            }
+            continue;
+        }
+
+        int num_values = 0;
+        httpd_err_resp_t err;
+        httpd_method_t method = ((seed >> 16) % 3) ? HTTP_GET : HTTP_POST;
+        random_string(&seed, path, s_path_segments, SEG_COUNT(s_path_segments), TEST_DEPTH);
+
+        int expected = reference_lookup(path, method, &err, values, &num_values);
+        int found = lookup(s_hd, path, method);
+        if (found != expected || (expected == -1 && s_err != err)) {
+            printf("%s %s: handler %d (%s), expected %d (%s), error %d, expected %d\n",
+                   method == HTTP_GET ? "GET" : "POST", path, found, found >= 0 ? s_uris[found] : "",
+                   expected, expected >= 0 ? s_uris[expected] : "", s_err, err);
+            exit(1);
+        }
+        if (found != -1) {
+            check_params(values, num_values, found);
+        }
+    }
+
+    /* Removing all the handlers leaves no nodes behind */
+    for (int r = 0; r < TEST_ROUTES; r++) {
+        if (s_registered[r]) {
+            expect(httpd_unregister_uri(s_hd, s_uris[r]) == ESP_OK, "all methods unregistered");
+            for (int k = r; k < TEST_ROUTES; k++) {
+                s_registered[k] &= !same_uri(s_uris[k], s_uris[r]);
+            }
+        }
+    }
+    expect(s_hd->hd_uri_nodes == 0, "nodes released");
+    expect(s_hd->hd_uri_root->children == 0 && !s_hd->hd_uri_root->param && !s_hd->hd_uri_root->wildcard,
+           "root released");
+
+    /* Too many parameters */
+    httpd_uri_t uri = { .uri = "/{a}/{b}/{c}/{d}/{e}/{f}/{g}/{h}/*", .method = HTTP_GET, .handler = record_handler };
+    expect(httpd_register_uri_handler(s_hd, &uri) == ESP_ERR_INVALID_ARG, "too many parameters");
+    delete_server(s_hd);
+}
+
+/* ----------------------------------------- Former lookup ----------------------------------------- */
+
+static httpd_uri_t *legacy_find_uri_handler2(httpd_err_resp_t *err, struct httpd_data *hd,
+                                             const char *uri, size_t uri_len, httpd_method_t method)
+{
+    *err = 0;
+    for (int i = 0; i < hd->config.max_uri_handlers; i++) {
+        if (hd->hd_calls[i]) {
+            if ((strlen(hd->hd_calls[i]->uri) == uri_len) &&
+                (strncmp(hd->hd_calls[i]->uri, uri, uri_len) == 0))  {
+                if (hd->hd_calls[i]->method == method)  {
+                    return hd->hd_calls[i];
+                }
+                *err = HTTPD_405_METHOD_NOT_ALLOWED;
+            }
+        }
+    }
+    if (*err == 0) {
+        *err = HTTPD_404_NOT_FOUND;
+    }
+    return NULL;
+}
+
+/* ------------------------------------------- Benchmark ------------------------------------------- */
+
+static const char *s_resources[BENCH_RESOURCES] = {
+    "device", "sensor", "relay", "led", "button", "wifi", "ap", "sta", "scan", "ota",
+    "firmware", "config", "time", "ntp", "mqtt", "http", "log", "user", "session", "token",
+    "file", "dir", "gpio", "pwm", "adc", "uart", "i2c", "spi", "timer", "alarm",
+    "schedule", "scene", "group", "zone", "camera", "audio", "battery", "power", "system", "stats",
+};
+
+/* Five handlers per resource: list, create, read, update and the state of an item */
+static void register_api(struct httpd_data *hd, bool params)
+{
+    char uri[64];
+    int n = 0;
+
+    for (int r = 0; r < BENCH_RESOURCES; r++) {
+        static const struct { const char *fmt; httpd_method_t method; } s_kinds[] = {
+            { "/api/v1/%s", HTTP_GET }, { "/api/v1/%s", HTTP_POST }, { "/api/v1/%s/%s", HTTP_GET },
+            { "/api/v1/%s/%s", HTTP_PUT }, { "/api/v1/%s/%s/state", HTTP_GET },
+        };
+        for (size_t k = 0; k < sizeof(s_kinds) / sizeof(s_kinds[0]); k++) {
+            snprintf(uri, sizeof(uri), s_kinds[k].fmt, s_resources[r], params ? "{id}" : "7");
+            httpd_uri_t handler = { .uri = uri, .method = s_kinds[k].method, .handler = record_handler,
+                                    .user_ctx = (void *)(intptr_t)n++ };
+            expect(httpd_register_uri_handler(hd, &handler) == ESP_OK, "API registered");
+        }
+    }
+}
+
+static double bench_once(struct httpd_data *hd, const char *path, httpd_method_t method, bool legacy)
+{
+    double best = 0;
+    size_t len = strlen(path);
+    httpd_err_resp_t err;
+    int found = 0;
+
+    /* The request is set up once, then only the lookup is timed */
+    lookup(hd, path, method);
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        uint64_t start = bench_ns();
+        for (int n = 0; n < BENCH_LOOKUPS; n++) {
+            if (legacy) {
+                found += legacy_find_uri_handler2(&err, hd, hd->hd_req.uri, len, method) != NULL;
+            } else {
+                found += httpd_find_uri_handler2(&err, hd, hd->hd_req.uri, len, method) != NULL;
+            }
+        }
+        double ns = (double)(bench_ns() - start) / BENCH_LOOKUPS;
+        if (run == 0 || ns < best) {
+            best = ns;
+        }
+    }
+    /* Keeps the lookups from being optimized out */
+    return found < 0 ? -1 : best;
+}
+
+static void bench(void)
+{
+    static const struct { const char *path; httpd_method_t method; const char *desc; } s_paths[] = {
+        { "/api/v1/device/7", HTTP_GET, "first resource" },
+        { "/api/v1/system/7/state", HTTP_GET, "late resource" },
+        { "/api/v1/stats", HTTP_POST, "last resource" },
+        { "/api/v2/stats", HTTP_GET, "not found" },
+    };
+
+    struct httpd_data *literal = create_server(BENCH_RESOURCES * 5);
+    struct httpd_data *params = create_server(BENCH_RESOURCES * 5);
+    register_api(literal, false);
+    register_api(params, true);
+
+    printf("%d handlers, best of %d x %d lookups\n", BENCH_RESOURCES * 5, BENCH_RUNS, BENCH_LOOKUPS);
+    printf("%-24s %-15s %12s %12s %12s\n", "path", "", "former ns", "tree ns", "{id} ns");
+    for (size_t i = 0; i < sizeof(s_paths) / sizeof(s_paths[0]); i++) {
+        double former = bench_once(literal, s_paths[i].path, s_paths[i].method, true);
+        double tree = bench_once(literal, s_paths[i].path, s_paths[i].method, false);
+        double param = bench_once(params, s_paths[i].path, s_paths[i].method, false);
+        printf("%-24s %-15s %12.1f %12.1f %12.1f\n", s_paths[i].path, s_paths[i].desc, former, tree, param);
+    }
+
+    delete_server(literal);
+    delete_server(params);
+}
+
+int main(void)
+{
+    check_routes();
+    printf("routes: ok\n");
+    bench();
+    return 0;
+}
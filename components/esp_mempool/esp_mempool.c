@@ -0,0 +1,197 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include "esp_mempool.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define ESP_MEMPOOL_STATIC      0x80000000  ///< Pool buffer is provided by the user
+
+/**
+ * Memory pool control block, the free blocks are linked through their first word.
+ */
+struct esp_mempool {
+    uint8_t     *start;         ///< First block
+    uint8_t     *end;           ///< Memory behind the last block
+
+    void        *free_list;     ///< First free block
+
+    size_t      block_size;     ///< Size of every block by byte
+    size_t      block_num;      ///< Number of blocks
+    size_t      free_num;       ///< Number of free blocks
+    size_t      min_free_num;   ///< Minimum number of free blocks ever
+
+    uint32_t    alloc_count;    ///< Number of successful allocations
+    uint32_t    fail_count;     ///< Number of failed allocations
+
+    uint32_t    flags;          ///< ESP_MEMPOOL_ISR_SAFE and ESP_MEMPOOL_STATIC
+};
+
+_Static_assert(sizeof(struct esp_mempool) <= ESP_MEMPOOL_HEAD_SIZE, "ESP_MEMPOOL_HEAD_SIZE is too small");
+
+static const char *TAG = "mempool";
+
+static inline void mempool_lock(esp_mempool_handle_t pool)
+{
+    if (pool->flags & ESP_MEMPOOL_ISR_SAFE)
+        taskENTER_CRITICAL();
+    else
+        vTaskSuspendAll();
+}
+
+static inline void mempool_unlock(esp_mempool_handle_t pool)
+{
+    if (pool->flags & ESP_MEMPOOL_ISR_SAFE)
+        taskEXIT_CRITICAL();
+    else
+        xTaskResumeAll();
+}
+
+static esp_mempool_handle_t mempool_init(void *buffer, size_t block_size, size_t block_num, uint32_t flags)
+{
+    esp_mempool_handle_t pool = buffer;
+
+    memset(pool, 0, sizeof(struct esp_mempool));
+
+    pool->block_size = ESP_MEMPOOL_BLOCK_SIZE(block_size);
+    pool->block_num = block_num;
+    pool->free_num = pool->min_free_num = block_num;
+    pool->flags = flags;
+
+    pool->start = (uint8_t *)buffer + ESP_MEMPOOL_HEAD_SIZE;
+    pool->end = pool->start + pool->block_size * block_num;
+
+    for (size_t i = block_num; i > 0; i--) {
+        void *p = pool->start + pool->block_size * (i - 1);
+
+        *(void **)p = pool->free_list;
+        pool->free_list = p;
+    }
+
+    return pool;
+}
+
+esp_mempool_handle_t esp_mempool_create(size_t block_size, size_t block_num, uint32_t caps, uint32_t flags)
+{
+    void *buffer;
+
+    if (!block_size || !block_num)
+        return NULL;
+
+    buffer = heap_caps_malloc(ESP_MEMPOOL_BUFFER_SIZE(block_size, block_num), caps);
+    if (!buffer) {
+        ESP_LOGE(TAG, "no memory for %u blocks of %u bytes", block_num, block_size);
+        return NULL;
+    }
+
+    return mempool_init(buffer, block_size, block_num, flags & ~ESP_MEMPOOL_STATIC);
+}
+
+esp_mempool_handle_t esp_mempool_create_static(size_t block_size, size_t block_num, void *buffer, uint32_t flags)
+{
+    if (!block_size || !block_num || !buffer || ((uintptr_t)buffer & (sizeof(void *) - 1)))
+        return NULL;
+
+    return mempool_init(buffer, block_size, block_num, flags | ESP_MEMPOOL_STATIC);
+}
+
+void esp_mempool_delete(esp_mempool_handle_t pool)
+{
+    if (!pool)
+        return;
+
+    if (pool->free_num != pool->block_num)
+        ESP_LOGW(TAG, "delete pool %p with %u blocks in use", pool, pool->block_num - pool->free_num);
+
+    if (!(pool->flags & ESP_MEMPOOL_STATIC))
+        heap_caps_free(pool);
+}
+
+void *IRAM_ATTR esp_mempool_alloc(esp_mempool_handle_t pool)
+{
+    void *p;
+
+    mempool_lock(pool);
+
+    p = pool->free_list;
+    if (p) {
+        pool->free_list = *(void **)p;
+        pool->free_num--;
+        if (pool->free_num < pool->min_free_num)
+            pool->min_free_num = pool->free_num;
+        pool->alloc_count++;
+    } else {
+        pool->fail_count++;
+    }
+
+    mempool_unlock(pool);
+
+    return p;
+}
+
+void IRAM_ATTR esp_mempool_free(esp_mempool_handle_t pool, void *ptr)
+{
+    if (!esp_mempool_is_from(pool, ptr) || ((uint8_t *)ptr - pool->start) % pool->block_size) {
+        ESP_EARLY_LOGE(TAG, "free(%p) is not a block of pool %p", ptr, pool);
+        return;
+    }
+
+    mempool_lock(pool);
+
+    *(void **)ptr = pool->free_list;
+    pool->free_list = ptr;
+    pool->free_num++;
+
+    mempool_unlock(pool);
+}
+
+void *IRAM_ATTR esp_mempool_alloc_from_isr(esp_mempool_handle_t pool)
+{
+    assert(pool->flags & ESP_MEMPOOL_ISR_SAFE);
+
+    return esp_mempool_alloc(pool);
+}
+
+void IRAM_ATTR esp_mempool_free_from_isr(esp_mempool_handle_t pool, void *ptr)
+{
+    assert(pool->flags & ESP_MEMPOOL_ISR_SAFE);
+
+    esp_mempool_free(pool, ptr);
+}
+
+bool IRAM_ATTR esp_mempool_is_from(esp_mempool_handle_t pool, const void *ptr)
+{
+    return pool && (const uint8_t *)ptr >= pool->start && (const uint8_t *)ptr < pool->end;
+}
+
+void esp_mempool_get_stats(esp_mempool_handle_t pool, esp_mempool_stats_t *stats)
+{
+    mempool_lock(pool);
+
+    stats->block_size = pool->block_size;
+    stats->block_num = pool->block_num;
+    stats->free_num = pool->free_num;
+    stats->used_max = pool->block_num - pool->min_free_num;
+    stats->alloc_count = pool->alloc_count;
+    stats->fail_count = pool->fail_count;
+
+    mempool_unlock(pool);
+}
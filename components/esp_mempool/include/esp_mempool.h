@@ -0,0 +1,149 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "esp_heap_caps.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ESP_MEMPOOL_ISR_SAFE    (1 << 0)    ///< Pool is locked by masking interrupts, so it can be used from ISR
+
+/**
+ * @brief Size of the pool control block which is placed in front of the blocks of a static pool
+ */
+#define ESP_MEMPOOL_HEAD_SIZE   (12 * sizeof(void *))
+
+/**
+ * @brief Size of one block of the pool, blocks are pointer aligned and can hold at least a pointer
+ */
+#define ESP_MEMPOOL_BLOCK_SIZE(_size) \
+    ((_size) < sizeof(void *) ? sizeof(void *) : (((_size) + sizeof(void *) - 1) & ~(sizeof(void *) - 1)))
+
+/**
+ * @brief Size of the buffer which esp_mempool_create_static() needs for "_num" blocks of "_size" bytes
+ */
+#define ESP_MEMPOOL_BUFFER_SIZE(_size, _num) (ESP_MEMPOOL_HEAD_SIZE + ESP_MEMPOOL_BLOCK_SIZE(_size) * (_num))
+
+/**
+ * Type by which memory pools are referenced.
+ */
+typedef struct esp_mempool *esp_mempool_handle_t;
+
+/**
+ * Memory pool statistics.
+ */
+typedef struct {
+    size_t      block_size;     ///< Size of every block by byte
+    size_t      block_num;      ///< Number of blocks of the pool
+    size_t      free_num;       ///< Number of free blocks now
+    size_t      used_max;       ///< Maximum number of blocks ever used at the same time (high-water mark)
+    uint32_t    alloc_count;    ///< Number of successful allocations
+    uint32_t    fail_count;     ///< Number of allocations which failed because the pool was empty
+} esp_mempool_stats_t;
+
+/**
+ * @brief Create a pool of fixed-size blocks, the pool and its blocks are allocated from the heap
+ *
+ * @param block_size Size, in bytes, of every block
+ * @param block_num Number of blocks
+ * @param caps Bitwise OR of MALLOC_CAP_* flags indicating the type of memory for the blocks
+ * @param flags 0 or ESP_MEMPOOL_ISR_SAFE
+ *
+ * @return Handle of the pool, or NULL if there is no enough memory
+ */
+esp_mempool_handle_t esp_mempool_create(size_t block_size, size_t block_num, uint32_t caps, uint32_t flags);
+
+/**
+ * @brief Create a pool of fixed-size blocks in a buffer provided by the caller
+ *
+ * @param block_size Size, in bytes, of every block
+ * @param block_num Number of blocks
+ * @param buffer Pointer aligned buffer of at least ESP_MEMPOOL_BUFFER_SIZE(block_size, block_num) bytes
+ * @param flags 0 or ESP_MEMPOOL_ISR_SAFE
+ *
+ * @return Handle of the pool, or NULL if the parameters are invalid
+ */
+esp_mempool_handle_t esp_mempool_create_static(size_t block_size, size_t block_num, void *buffer, uint32_t flags);
+
+/**
+ * @brief Delete a pool, the blocks of the pool must not be used after this
+ *
+ * @param pool Handle of the pool
+ */
+void esp_mempool_delete(esp_mempool_handle_t pool);
+
+/**
+ * @brief Allocate one block from the pool in constant time
+ *
+ * @param pool Handle of the pool
+ *
+ * @return Pointer to the block, or NULL if the pool is empty
+ */
+void *esp_mempool_alloc(esp_mempool_handle_t pool);
+
+/**
+ * @brief Give a block back to the pool in constant time
+ *
+ * @param pool Handle of the pool
+ * @param ptr Pointer to the block previously returned from esp_mempool_alloc()
+ */
+void esp_mempool_free(esp_mempool_handle_t pool, void *ptr);
+
+/**
+ * @brief Allocate one block from the pool in ISR, the pool must be created with ESP_MEMPOOL_ISR_SAFE
+ *
+ * @param pool Handle of the pool
+ *
+ * @return Pointer to the block, or NULL if the pool is empty
+ */
+void *esp_mempool_alloc_from_isr(esp_mempool_handle_t pool);
+
+/**
+ * @brief Give a block back to the pool in ISR, the pool must be created with ESP_MEMPOOL_ISR_SAFE
+ *
+ * @param pool Handle of the pool
+ * @param ptr Pointer to the block previously returned from esp_mempool_alloc(_from_isr)()
+ */
+void esp_mempool_free_from_isr(esp_mempool_handle_t pool, void *ptr);
+
+/**
+ * @brief Check if the memory belongs to the pool
+ *
+ * Users that fall back to the heap when the pool is empty can use this to choose how to free a block.
+ *
+ * @param pool Handle of the pool, can be NULL
+ * @param ptr Pointer to the memory
+ *
+ * @return true if the memory is one block of the pool, or false
+ */
+bool esp_mempool_is_from(esp_mempool_handle_t pool, const void *ptr);
+
+/**
+ * @brief Get statistics of the pool
+ *
+ * @param pool Handle of the pool
+ * @param stats Pointer to the structure which will be filled with the statistics
+ */
+void esp_mempool_get_stats(esp_mempool_handle_t pool, esp_mempool_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
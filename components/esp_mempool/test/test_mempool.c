@@ -0,0 +1,76 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unity.h>
+
+#include "esp_mempool.h"
+
+#define TEST_BLOCK_SIZE 20
+#define TEST_BLOCK_NUM  4
+
+static void test_mempool_blocks(esp_mempool_handle_t pool)
+{
+    void *p[TEST_BLOCK_NUM];
+    esp_mempool_stats_t stats;
+
+    for (int i = 0; i < TEST_BLOCK_NUM; i++) {
+        p[i] = esp_mempool_alloc(pool);
+        TEST_ASSERT_NOT_NULL(p[i]);
+        TEST_ASSERT(esp_mempool_is_from(pool, p[i]));
+        memset(p[i], i, TEST_BLOCK_SIZE);
+    }
+    TEST_ASSERT_NULL(esp_mempool_alloc(pool));
+
+    for (int i = 0; i < TEST_BLOCK_NUM; i++) {
+        for (int j = 0; j < TEST_BLOCK_SIZE; j++)
+            TEST_ASSERT_EQUAL(i, ((uint8_t *)p[i])[j]);
+    }
+
+    esp_mempool_free(pool, p[1]);
+    TEST_ASSERT_EQUAL_PTR(p[1], esp_mempool_alloc(pool));
+
+    for (int i = 0; i < TEST_BLOCK_NUM; i++)
+        esp_mempool_free(pool, p[i]);
+
+    esp_mempool_get_stats(pool, &stats);
+    TEST_ASSERT_EQUAL(TEST_BLOCK_NUM, stats.block_num);
+    TEST_ASSERT_EQUAL(TEST_BLOCK_NUM, stats.free_num);
+    TEST_ASSERT_EQUAL(TEST_BLOCK_NUM, stats.used_max);
+    TEST_ASSERT_EQUAL(TEST_BLOCK_NUM + 1, stats.alloc_count);
+    TEST_ASSERT_EQUAL(1, stats.fail_count);
+}
+
+TEST_CASE("Test mempool alloc/free from heap", "[mempool]")
+{
+    esp_mempool_handle_t pool = esp_mempool_create(TEST_BLOCK_SIZE, TEST_BLOCK_NUM, MALLOC_CAP_8BIT, 0);
+
+    TEST_ASSERT_NOT_NULL(pool);
+    test_mempool_blocks(pool);
+    esp_mempool_delete(pool);
+}
+
+TEST_CASE("Test mempool alloc/free from static buffer", "[mempool]")
+{
+    static void *buffer[ESP_MEMPOOL_BUFFER_SIZE(TEST_BLOCK_SIZE, TEST_BLOCK_NUM) / sizeof(void *)];
+    esp_mempool_handle_t pool = esp_mempool_create_static(TEST_BLOCK_SIZE, TEST_BLOCK_NUM, buffer, ESP_MEMPOOL_ISR_SAFE);
+
+    TEST_ASSERT_NOT_NULL(pool);
+    TEST_ASSERT_FALSE(esp_mempool_is_from(pool, buffer));
+    test_mempool_blocks(pool);
+    esp_mempool_delete(pool);
+}
@@ -0,0 +1,5 @@
+// Host build stub of FreeRTOS.h, the benchmark is single threaded
+#pragma once
+
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
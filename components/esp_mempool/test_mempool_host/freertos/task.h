@@ -0,0 +1,5 @@
+// Host build stub of task.h, the benchmark is single threaded
+#pragma once
+
+#define vTaskSuspendAll()
+#define xTaskResumeAll() ((void)0)
@@ -0,0 +1,155 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Compare fixed-size block pools with the capability heap for the small same-sized
+ * allocations of MQTT outbox and HTTP header items, on a heap which holds a mix of
+ * other allocations.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "esp_heap_caps.h"
+#include "esp_mempool.h"
+
+#define BENCH_ARENA_SIZE    (80 * 1024)
+#define BENCH_BLOCK_SIZE    32
+#define BENCH_LIVE_MAX      16
+#define BENCH_BACKGROUND    256
+#define BENCH_LOOPS         200000
+
+heap_region_t g_heap_region[HEAP_REGIONS_MAX];
+
+static uint8_t s_arena[BENCH_ARENA_SIZE] __attribute__((aligned(4)));
+
+void vPortETSIntrLock(void)
+{
+}
+
+void vPortETSIntrUnlock(void)
+{
+}
+
+void esp_task_wdt_reset(void)
+{
+}
+
+static inline uint64_t bench_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint8_t s_slots[BENCH_LOOPS];
+
+/*
+ * Keep up to BENCH_LIVE_MAX blocks alive and allocate or free one of them at random,
+ * like a queue of in-flight messages.
+ */
+static double bench_run(void *(*alloc_fn)(void *), void (*free_fn)(void *, void *), void *arg)
+{
+    void *live[BENCH_LIVE_MAX] = { 0 };
+    uint64_t start, ns;
+
+    start = bench_ns();
+    for (int i = 0; i < BENCH_LOOPS; i++) {
+        int slot = s_slots[i];
+
+        if (live[slot]) {
+            free_fn(arg, live[slot]);
+            live[slot] = NULL;
+        } else {
+            live[slot] = alloc_fn(arg);
+        }
+    }
+    ns = bench_ns() - start;
+
+    for (int i = 0; i < BENCH_LIVE_MAX; i++) {
+        if (live[i])
+            free_fn(arg, live[i]);
+    }
+
+    return (double)ns / BENCH_LOOPS;
+}
+
+static void *heap_alloc(void *arg)
+{
+    return heap_caps_malloc(BENCH_BLOCK_SIZE, MALLOC_CAP_8BIT);
+}
+
+static void heap_free(void *arg, void *p)
+{
+    heap_caps_free(p);
+}
+
+static void *pool_alloc(void *arg)
+{
+    return esp_mempool_alloc(arg);
+}
+
+static void pool_free(void *arg, void *p)
+{
+    esp_mempool_free(arg, p);
+}
+
+int main(int argc, char **argv)
+{
+    void *background[BENCH_BACKGROUND];
+    esp_mempool_handle_t pool;
+    esp_mempool_stats_t stats;
+    double heap_ns, pool_ns;
+
+    g_heap_region[0].start_addr = s_arena;
+    g_heap_region[0].total_size = sizeof(s_arena);
+    g_heap_region[0].caps = MALLOC_CAP_8BIT | MALLOC_CAP_32BIT | MALLOC_CAP_DMA;
+    esp_heap_caps_init_region(g_heap_region, 1);
+
+    // fragment the heap with other long living allocations
+    srand(1);
+    for (int i = 0; i < BENCH_BACKGROUND; i++)
+        background[i] = heap_caps_malloc(16 + rand() % 200, MALLOC_CAP_8BIT);
+    for (int i = 0; i < BENCH_BACKGROUND; i += 2)
+        heap_caps_free(background[i]);
+
+    pool = esp_mempool_create(BENCH_BLOCK_SIZE, BENCH_LIVE_MAX, MALLOC_CAP_8BIT, 0);
+    if (!pool) {
+        printf("failed to create pool\n");
+        return 1;
+    }
+
+    for (int i = 0; i < BENCH_LOOPS; i++)
+        s_slots[i] = rand() % BENCH_LIVE_MAX;
+
+    heap_ns = bench_run(heap_alloc, heap_free, NULL);
+    pool_ns = bench_run(pool_alloc, pool_free, pool);
+
+    esp_mempool_get_stats(pool, &stats);
+
+    printf("%d blocks of %d bytes, %d operations\n", BENCH_LIVE_MAX, BENCH_BLOCK_SIZE, BENCH_LOOPS);
+    printf("heap_caps_malloc/free %8.1f ns/op\n", heap_ns);
+    printf("esp_mempool_alloc/free %7.1f ns/op\n", pool_ns);
+    printf("pool high-water %u/%u blocks, %u allocations, %u failed\n", (unsigned)stats.used_max,
+           (unsigned)stats.block_num, stats.alloc_count, stats.fail_count);
+
+    esp_mempool_delete(pool);
+
+    return 0;
+}
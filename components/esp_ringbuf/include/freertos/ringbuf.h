@@ -125,6 +125,50 @@ BaseType_t xRingbufferSend(RingbufHandle_t xRingbuffer, const void *pvItem, size
  */
 BaseType_t xRingbufferSendFromISR(RingbufHandle_t xRingbuffer, const void *pvItem, size_t xItemSize, BaseType_t *pxHigherPriorityTaskWoken);
 
+/**
+ * @brief       Acquire memory for an item in the ring buffer
+ *
+ * Attempt to reserve contiguous memory for an item of xItemSize bytes, so that
+ * the item can be written in place instead of being copied by xRingbufferSend().
+ * The item is not visible to readers until xRingbufferSendComplete() is called.
+ * This function will block until enough free space is available or until it
+ * timesout.
+ *
+ * @param[in]   xRingbuffer     Ring buffer to acquire the memory from
+ * @param[out]  ppvItem         Double pointer to the acquired memory (set to NULL on failure)
+ * @param[in]   xItemSize       Size of the item to acquire.
+ * @param[in]   xTicksToWait    Ticks to wait for room in the ring buffer.
+ *
+ * @note    Only one item can be acquired at a time. Until it is completed, other
+ *          calls to xRingbufferSend(), xRingbufferSendFromISR() and this function
+ *          on the same ring buffer wait (or fail) as if the buffer was full.
+ * @note    The acquired memory is never split, so allow-split buffers place the
+ *          item as a no-split buffer would, and xItemSize may not exceed half the
+ *          buffer size minus the header. Byte buffers accept up to the whole
+ *          buffer size, but may have to wait until the buffer has been drained
+ *          for enough contiguous space to become free.
+ *
+ * @return
+ *      - pdTRUE if succeeded
+ *      - pdFALSE on time-out or when the item can never fit in contiguous memory of the buffer
+ */
+BaseType_t xRingbufferSendAcquire(RingbufHandle_t xRingbuffer, void **ppvItem, size_t xItemSize, TickType_t xTicksToWait);
+
+/**
+ * @brief       Complete an item acquired by xRingbufferSendAcquire()
+ *
+ * Make the item written into the memory acquired by xRingbufferSendAcquire()
+ * available to readers, as if it had been sent with xRingbufferSend().
+ *
+ * @param[in]   xRingbuffer     Ring buffer the item was acquired from
+ * @param[in]   pvItem          Pointer returned by xRingbufferSendAcquire()
+ *
+ * @return
+ *      - pdTRUE if succeeded
+ *      - pdFALSE if pvItem is not the item currently acquired from this ring buffer
+ */
+BaseType_t xRingbufferSendComplete(RingbufHandle_t xRingbuffer, void *pvItem);
+
 /**
  * @brief   Retrieve an item from the ring buffer
  *
@@ -28,6 +28,7 @@
 #define rbALLOW_SPLIT_FLAG          ( ( UBaseType_t ) 1 )   //The ring buffer allows items to be split
 #define rbBYTE_BUFFER_FLAG          ( ( UBaseType_t ) 2 )   //The ring buffer is a byte buffer
 #define rbBUFFER_FULL_FLAG          ( ( UBaseType_t ) 4 )   //The ring buffer is currently full (write pointer == free pointer)
+#define rbSEND_ACQUIRED_FLAG        ( ( UBaseType_t ) 8 )   //An item has been acquired by xRingbufferSendAcquire() and not yet completed
 
 //Item flags
 #define rbITEM_FREE_FLAG            ( ( UBaseType_t ) 1 )   //Item has been retrieved and returned by application, free to overwrite
@@ -48,23 +49,31 @@ typedef BaseType_t (*CheckItemAvailFunction_t) (Ringbuffer_t *pxRingbuffer);
 typedef void *(*GetItemFunction_t)(Ringbuffer_t *pxRingbuffer, BaseType_t *pxIsSplit, size_t xMaxSize, size_t *pxItemSize);
 typedef void (*ReturnItemFunction_t)(Ringbuffer_t *pxRingbuffer, uint8_t *pvItem);
 typedef size_t (*GetCurMaxSizeFunction_t)(Ringbuffer_t *pxRingbuffer);
+typedef uint8_t *(*AcquireItemFunction_t)(Ringbuffer_t *pxRingbuffer, size_t xItemSize);
+typedef void (*SendItemDoneFunction_t)(Ringbuffer_t *pxRingbuffer, uint8_t *pucItem, size_t xItemSize);
 
 struct Ringbuffer_t {
     size_t xSize;                               //Size of the data storage
     UBaseType_t uxRingbufferFlags;              //Flags to indicate the type and status of ring buffer
     size_t xMaxItemSize;                        //Maximum item size
+    size_t xMaxAcquireSize;                     //Maximum size of an item acquired in contiguous memory
 
     CheckItemFitsFunction_t xCheckItemFits;     //Function to check if item can currently fit in ring buffer
     CopyItemFunction_t vCopyItem;               //Function to copy item to ring buffer
     GetItemFunction_t pvGetItem;                //Function to get item from ring buffer
     ReturnItemFunction_t vReturnItem;           //Function to return item to ring buffer
     GetCurMaxSizeFunction_t xGetCurMaxSize;     //Function to get current free size
+    CheckItemFitsFunction_t xCheckAcquireFits;  //Function to check if contiguous memory for an item can currently be acquired
+    AcquireItemFunction_t pvAcquireItem;        //Function to reserve memory for an item without making it available
+    SendItemDoneFunction_t vSendItemDone;       //Function to make a reserved item available for retrieval
 
     uint8_t *pucWrite;                          //Write Pointer. Points to where the next item should be written
     uint8_t *pucRead;                           //Read Pointer. Points to where the next item should be read from
     uint8_t *pucFree;                           //Free Pointer. Points to the last item that has yet to be returned to the ring buffer
     uint8_t *pucHead;                           //Pointer to the start of the ring buffer storage area
     uint8_t *pucTail;                           //Pointer to the end of the ring buffer storage area
+    uint8_t *pucAcquire;                        //Pointer to the item acquired by xRingbufferSendAcquire(), if any
+    size_t xAcquireSize;                        //Size of the acquired item
 
     BaseType_t xItemsWaiting;                   //Number of items/bytes(for byte buffers) currently in ring buffer that have not yet been read
     SemaphoreHandle_t xFreeSpaceSemaphore;      //Binary semaphore, wakes up writing threads when more free space becomes available or when another thread times out attempting to write
@@ -91,12 +100,33 @@ static size_t prvGetFreeSize(Ringbuffer_t *pxRingbuffer);
 //Checks if an item/data is currently available for retrieval
 static BaseType_t prvCheckItemAvail(Ringbuffer_t *pxRingbuffer);
 
+//Checks if an item will currently fit in a ring buffer with item headers, xAllowSplit selects if the item may be split when wrapping around
+static BaseType_t prvCheckItemFitsHeader( Ringbuffer_t *pxRingbuffer, size_t xItemSize, BaseType_t xAllowSplit);
+
 //Checks if an item will currently fit in a no-split/allow-split ring buffer
 static BaseType_t prvCheckItemFitsDefault( Ringbuffer_t *pxRingbuffer, size_t xItemSize);
 
 //Checks if an item will currently fit in a byte buffer
 static BaseType_t prvCheckItemFitsByteBuffer( Ringbuffer_t *pxRingbuffer, size_t xItemSize);
 
+//Checks if an item will currently fit in contiguous memory of a no-split/allow-split ring buffer
+static BaseType_t prvCheckAcquireFitsDefault( Ringbuffer_t *pxRingbuffer, size_t xItemSize);
+
+//Checks if an item will currently fit in contiguous memory of a byte buffer. Rewinds an empty byte buffer to its head
+static BaseType_t prvCheckAcquireFitsByteBuffer( Ringbuffer_t *pxRingbuffer, size_t xItemSize);
+
+//Reserves contiguous memory and writes the header of an item in a no-split/allow-split ring buffer. Only call this function after calling prvCheckAcquireFitsDefault()
+static uint8_t *prvAcquireItemDefault(Ringbuffer_t *pxRingbuffer, size_t xItemSize);
+
+//Reserves contiguous memory for data in a byte buffer. Only call this function after calling prvCheckAcquireFitsByteBuffer()
+static uint8_t *prvAcquireItemByteBuf(Ringbuffer_t *pxRingbuffer, size_t xItemSize);
+
+//Advances the write pointer past an item reserved by prvAcquireItemDefault(), making it available for retrieval
+static void prvSendItemDoneDefault(Ringbuffer_t *pxRingbuffer, uint8_t *pucItem, size_t xItemSize);
+
+//Advances the write pointer past data reserved by prvAcquireItemByteBuf(), making it available for retrieval
+static void prvSendItemDoneByteBuf(Ringbuffer_t *pxRingbuffer, uint8_t *pucItem, size_t xItemSize);
+
 //Copies an item to a no-split ring buffer. Only call this function after calling prvCheckItemFitsDefault()
 static void prvCopyItemNoSplit(Ringbuffer_t *pxRingbuffer, const uint8_t *pucItem, size_t xItemSize);
 
@@ -157,7 +187,7 @@ static size_t prvGetFreeSize(Ringbuffer_t *pxRingbuffer)
     return xReturn;
 }
 
-static BaseType_t prvCheckItemFitsDefault( Ringbuffer_t *pxRingbuffer, size_t xItemSize)
+static BaseType_t prvCheckItemFitsHeader( Ringbuffer_t *pxRingbuffer, size_t xItemSize, BaseType_t xAllowSplit)
 {
     //Check arguments and buffer state
     configASSERT(rbCHECK_ALIGNED(pxRingbuffer->pucWrite));              //pucWrite is always aligned in no-split ring buffers
@@ -177,7 +207,7 @@ static BaseType_t prvCheckItemFitsDefault( Ringbuffer_t *pxRingbuffer, size_t xI
         return pdTRUE;      //Item fits without wrapping around
     }
     //Check if item fits by wrapping
-    if (pxRingbuffer->uxRingbufferFlags & rbALLOW_SPLIT_FLAG) {
+    if (xAllowSplit == pdTRUE) {
         //Allow split wrapping incurs an extra header
         return (xTotalItemSize + rbHEADER_SIZE <= pxRingbuffer->xSize - (pxRingbuffer->pucWrite - pxRingbuffer->pucFree)) ? pdTRUE : pdFALSE;
     } else {
@@ -185,6 +215,17 @@ static BaseType_t prvCheckItemFitsDefault( Ringbuffer_t *pxRingbuffer, size_t xI
     }
 }
 
+static BaseType_t prvCheckItemFitsDefault( Ringbuffer_t *pxRingbuffer, size_t xItemSize)
+{
+    return prvCheckItemFitsHeader(pxRingbuffer, xItemSize, (pxRingbuffer->uxRingbufferFlags & rbALLOW_SPLIT_FLAG) ? pdTRUE : pdFALSE);
+}
+
+static BaseType_t prvCheckAcquireFitsDefault( Ringbuffer_t *pxRingbuffer, size_t xItemSize)
+{
+    //Acquired items are never split, not even in allow-split buffers
+    return prvCheckItemFitsHeader(pxRingbuffer, xItemSize, pdFALSE);
+}
+
 static BaseType_t prvCheckItemFitsByteBuffer( Ringbuffer_t *pxRingbuffer, size_t xItemSize)
 {
     //Check arguments and buffer state
@@ -202,31 +243,76 @@ static BaseType_t prvCheckItemFitsByteBuffer( Ringbuffer_t *pxRingbuffer, size_t
     return (xItemSize <= pxRingbuffer->xSize - (pxRingbuffer->pucWrite - pxRingbuffer->pucFree)) ? pdTRUE : pdFALSE;
 }
 
-static void prvCopyItemNoSplit(Ringbuffer_t *pxRingbuffer, const uint8_t *pucItem, size_t xItemSize)
+static BaseType_t prvCheckAcquireFitsByteBuffer( Ringbuffer_t *pxRingbuffer, size_t xItemSize)
+{
+    //Check arguments and buffer state
+    configASSERT(pxRingbuffer->pucWrite >= pxRingbuffer->pucHead && pxRingbuffer->pucWrite < pxRingbuffer->pucTail);    //Check write pointer is within bounds
+
+    if (pxRingbuffer->pucWrite == pxRingbuffer->pucFree) {
+        //Buffer is either complete empty or completely full
+        if (pxRingbuffer->uxRingbufferFlags & rbBUFFER_FULL_FLAG) {
+            return pdFALSE;
+        }
+        //Buffer is empty (so nothing is being read either), restart at the head to make the whole buffer contiguous
+        configASSERT(pxRingbuffer->pucRead == pxRingbuffer->pucFree);
+        pxRingbuffer->pucWrite = pxRingbuffer->pucHead;
+        pxRingbuffer->pucRead = pxRingbuffer->pucHead;
+        pxRingbuffer->pucFree = pxRingbuffer->pucHead;
+        return (xItemSize <= pxRingbuffer->xSize) ? pdTRUE : pdFALSE;
+    }
+    if (pxRingbuffer->pucFree > pxRingbuffer->pucWrite) {
+        //Free space does not wrap around
+        return (xItemSize <= pxRingbuffer->pucFree - pxRingbuffer->pucWrite) ? pdTRUE : pdFALSE;
+    }
+    //Free space wraps around, data can only be acquired up to the tail
+    return (xItemSize <= pxRingbuffer->pucTail - pxRingbuffer->pucWrite) ? pdTRUE : pdFALSE;
+}
+
+static uint8_t *prvAcquireItemDefault(Ringbuffer_t *pxRingbuffer, size_t xItemSize)
 {
     //Check arguments and buffer state
     size_t xAlignedItemSize = rbALIGN_SIZE(xItemSize);                  //Rounded up aligned item size
     size_t xRemLen = pxRingbuffer->pucTail - pxRingbuffer->pucWrite;    //Length from pucWrite until end of buffer
-    configASSERT(rbCHECK_ALIGNED(pxRingbuffer->pucWrite));              //pucWrite is always aligned in no-split ring buffers
+    uint8_t *pucWrite = pxRingbuffer->pucWrite;
+    configASSERT(rbCHECK_ALIGNED(pxRingbuffer->pucWrite));              //pucWrite is always aligned in no-split/allow-split ring buffers
     configASSERT(pxRingbuffer->pucWrite >= pxRingbuffer->pucHead && pxRingbuffer->pucWrite < pxRingbuffer->pucTail);    //Check write pointer is within bounds
     configASSERT(xRemLen >= rbHEADER_SIZE);                             //Remaining length must be able to at least fit an item header
 
     //If remaining length can't fit item, set as dummy data and wrap around
     if (xRemLen < xAlignedItemSize + rbHEADER_SIZE) {
-        ItemHeader_t *pxDummy = (ItemHeader_t *)pxRingbuffer->pucWrite;
+        ItemHeader_t *pxDummy = (ItemHeader_t *)pucWrite;
         pxDummy->uxItemFlags = rbITEM_DUMMY_DATA_FLAG;      //Set remaining length as dummy data
         pxDummy->xItemLen = 0;                              //Dummy data should have no length
-        pxRingbuffer->pucWrite = pxRingbuffer->pucHead;     //Reset write pointer to wrap around
+        pucWrite = pxRingbuffer->pucHead;                   //Wrap around
     }
 
-    //Item should be guaranteed to fit at this point. Set item header and copy data
-    ItemHeader_t *pxHeader = (ItemHeader_t *)pxRingbuffer->pucWrite;
+    /*
+     * Item should be guaranteed to fit at this point. Set item header, pucWrite is
+     * only advanced once the item is done, so readers can't retrieve it before
+     */
+    ItemHeader_t *pxHeader = (ItemHeader_t *)pucWrite;
     pxHeader->xItemLen = xItemSize;
     pxHeader->uxItemFlags = 0;
-    pxRingbuffer->pucWrite += rbHEADER_SIZE;    //Advance pucWrite past header
-    memcpy(pxRingbuffer->pucWrite, pucItem, xItemSize);
+    return pucWrite + rbHEADER_SIZE;
+}
+
+static uint8_t *prvAcquireItemByteBuf(Ringbuffer_t *pxRingbuffer, size_t xItemSize)
+{
+    //Check arguments and buffer state
+    configASSERT(pxRingbuffer->pucWrite >= pxRingbuffer->pucHead && pxRingbuffer->pucWrite < pxRingbuffer->pucTail);    //Check write pointer is within bounds
+    configASSERT(xItemSize <= pxRingbuffer->pucTail - pxRingbuffer->pucWrite);    //Acquired data never wraps around
+    return pxRingbuffer->pucWrite;
+}
+
+static void prvSendItemDoneDefault(Ringbuffer_t *pxRingbuffer, uint8_t *pucItem, size_t xItemSize)
+{
+    //Check arguments
+    configASSERT(rbCHECK_ALIGNED(pucItem));
+    configASSERT(pucItem >= pxRingbuffer->pucHead + rbHEADER_SIZE && pucItem <= pxRingbuffer->pucTail);
+    configASSERT(((ItemHeader_t *)(pucItem - rbHEADER_SIZE))->xItemLen == xItemSize);
+
     pxRingbuffer->xItemsWaiting++;
-    pxRingbuffer->pucWrite += xAlignedItemSize; //Advance pucWrite past item to next aligned address
+    pxRingbuffer->pucWrite = pucItem + rbALIGN_SIZE(xItemSize);    //Advance pucWrite past item to next aligned address
 
     //If current remaining length can't fit a header, wrap around write pointer
     if (pxRingbuffer->pucTail - pxRingbuffer->pucWrite < rbHEADER_SIZE) {
@@ -239,6 +325,32 @@ static void prvCopyItemNoSplit(Ringbuffer_t *pxRingbuffer, const uint8_t *pucIte
     }
 }
 
+static void prvSendItemDoneByteBuf(Ringbuffer_t *pxRingbuffer, uint8_t *pucItem, size_t xItemSize)
+{
+    //Check arguments
+    configASSERT(pucItem == pxRingbuffer->pucWrite);
+
+    pxRingbuffer->xItemsWaiting += xItemSize;
+    pxRingbuffer->pucWrite += xItemSize;
+
+    //Wrap around pucWrite if it reaches the end
+    if (pxRingbuffer->pucWrite == pxRingbuffer->pucTail) {
+        pxRingbuffer->pucWrite = pxRingbuffer->pucHead;
+    }
+    //Check if buffer is full
+    if (pxRingbuffer->pucWrite == pxRingbuffer->pucFree && xItemSize > 0) {
+        pxRingbuffer->uxRingbufferFlags |= rbBUFFER_FULL_FLAG;      //Mark the buffer as full to avoid confusion with an empty buffer
+    }
+}
+
+static void prvCopyItemNoSplit(Ringbuffer_t *pxRingbuffer, const uint8_t *pucItem, size_t xItemSize)
+{
+    //Items are copied into memory acquired the same way as by xRingbufferSendAcquire()
+    uint8_t *pucData = prvAcquireItemDefault(pxRingbuffer, xItemSize);
+    memcpy(pucData, pucItem, xItemSize);
+    prvSendItemDoneDefault(pxRingbuffer, pucData, xItemSize);
+}
+
 static void prvCopyItemAllowSplit(Ringbuffer_t *pxRingbuffer, const uint8_t *pucItem, size_t xItemSize)
 {
     //Check arguments and buffer state
@@ -691,6 +803,10 @@ RingbufHandle_t xRingbufferCreate(size_t xBufferSize, ringbuf_type_t xBufferType
          */
         pxRingbuffer->xMaxItemSize = rbALIGN_SIZE(pxRingbuffer->xSize / 2) - rbHEADER_SIZE;
         pxRingbuffer->xGetCurMaxSize = prvGetCurMaxSizeNoSplit;
+        pxRingbuffer->xCheckAcquireFits = prvCheckAcquireFitsDefault;
+        pxRingbuffer->pvAcquireItem = prvAcquireItemDefault;
+        pxRingbuffer->vSendItemDone = prvSendItemDoneDefault;
+        pxRingbuffer->xMaxAcquireSize = pxRingbuffer->xMaxItemSize;
     } else if (xBufferType == RINGBUF_TYPE_ALLOWSPLIT) {
         pxRingbuffer->uxRingbufferFlags |= rbALLOW_SPLIT_FLAG;
         pxRingbuffer->xCheckItemFits = prvCheckItemFitsDefault;
@@ -700,6 +816,11 @@ RingbufHandle_t xRingbufferCreate(size_t xBufferSize, ringbuf_type_t xBufferType
         //Worst case an item is split into two, incurring two headers of overhead
         pxRingbuffer->xMaxItemSize = pxRingbuffer->xSize - (sizeof(ItemHeader_t) * 2);
         pxRingbuffer->xGetCurMaxSize = prvGetCurMaxSizeAllowSplit;
+        //Acquired items are placed as in no-split buffers, so they have the same maximum size
+        pxRingbuffer->xCheckAcquireFits = prvCheckAcquireFitsDefault;
+        pxRingbuffer->pvAcquireItem = prvAcquireItemDefault;
+        pxRingbuffer->vSendItemDone = prvSendItemDoneDefault;
+        pxRingbuffer->xMaxAcquireSize = rbALIGN_SIZE(pxRingbuffer->xSize / 2) - rbHEADER_SIZE;
     } else if (xBufferType == RINGBUF_TYPE_BYTEBUF) {
         pxRingbuffer->uxRingbufferFlags |= rbBYTE_BUFFER_FLAG;
         pxRingbuffer->xCheckItemFits = prvCheckItemFitsByteBuffer;
@@ -709,6 +830,10 @@ RingbufHandle_t xRingbufferCreate(size_t xBufferSize, ringbuf_type_t xBufferType
         //Byte buffers do not incur any overhead
         pxRingbuffer->xMaxItemSize = pxRingbuffer->xSize;
         pxRingbuffer->xGetCurMaxSize = prvGetCurMaxSizeByteBuf;
+        pxRingbuffer->xCheckAcquireFits = prvCheckAcquireFitsByteBuffer;
+        pxRingbuffer->pvAcquireItem = prvAcquireItemByteBuf;
+        pxRingbuffer->vSendItemDone = prvSendItemDoneByteBuf;
+        pxRingbuffer->xMaxAcquireSize = pxRingbuffer->xSize;
     } else {
         //Unsupported type
         configASSERT(0);
@@ -767,7 +892,7 @@ BaseType_t xRingbufferSend(RingbufHandle_t xRingbuffer, const void *pvItem, size
         }
         //Semaphore obtained, check if item can fit
         taskENTER_CRITICAL();
-        if(pxRingbuffer->xCheckItemFits(pxRingbuffer, xItemSize) == pdTRUE) {
+        if ((pxRingbuffer->uxRingbufferFlags & rbSEND_ACQUIRED_FLAG) == 0 && pxRingbuffer->xCheckItemFits(pxRingbuffer, xItemSize) == pdTRUE) {
             //Item will fit, copy item
             pxRingbuffer->vCopyItem(pxRingbuffer, pvItem, xItemSize);
             xReturn = pdTRUE;
@@ -816,7 +941,7 @@ BaseType_t xRingbufferSendFromISR(RingbufHandle_t xRingbuffer, const void *pvIte
     BaseType_t xReturn;
     BaseType_t xReturnSemaphore = pdFALSE;
     taskENTER_CRITICAL();
-    if (pxRingbuffer->xCheckItemFits(xRingbuffer, xItemSize) == pdTRUE) {
+    if ((pxRingbuffer->uxRingbufferFlags & rbSEND_ACQUIRED_FLAG) == 0 && pxRingbuffer->xCheckItemFits(xRingbuffer, xItemSize) == pdTRUE) {
         pxRingbuffer->vCopyItem(xRingbuffer, pvItem, xItemSize);
         xReturn = pdTRUE;
         //Check if the free semaphore should be returned to allow other tasks to send
@@ -838,6 +963,86 @@ BaseType_t xRingbufferSendFromISR(RingbufHandle_t xRingbuffer, const void *pvIte
     return xReturn;
 }
 
+BaseType_t xRingbufferSendAcquire(RingbufHandle_t xRingbuffer, void **ppvItem, size_t xItemSize, TickType_t xTicksToWait)
+{
+    //Check arguments
+    Ringbuffer_t *pxRingbuffer = (Ringbuffer_t *)xRingbuffer;
+    configASSERT(pxRingbuffer);
+    configASSERT(ppvItem != NULL);
+    *ppvItem = NULL;
+    if (xItemSize > pxRingbuffer->xMaxAcquireSize) {
+        return pdFALSE;     //Data will never ever fit in contiguous memory of the buffer
+    }
+
+    //Attempt to acquire memory for an item
+    BaseType_t xReturn = pdFALSE;
+    TickType_t xTicksEnd = xTaskGetTickCount() + xTicksToWait;
+    TickType_t xTicksRemaining = xTicksToWait;
+    while (xTicksRemaining <= xTicksToWait) {   //xTicksToWait will underflow once xTaskGetTickCount() > ticks_end
+        //Block until more free space becomes available or timeout
+        if (xSemaphoreTake(pxRingbuffer->xFreeSpaceSemaphore, xTicksRemaining) != pdTRUE) {
+            xReturn = pdFALSE;
+            break;
+        }
+        //Semaphore obtained, check if no other item is acquired and the item can fit
+        taskENTER_CRITICAL();
+        if ((pxRingbuffer->uxRingbufferFlags & rbSEND_ACQUIRED_FLAG) == 0 && pxRingbuffer->xCheckAcquireFits(pxRingbuffer, xItemSize) == pdTRUE) {
+            //Item will fit, reserve the memory
+            pxRingbuffer->pucAcquire = pxRingbuffer->pvAcquireItem(pxRingbuffer, xItemSize);
+            pxRingbuffer->xAcquireSize = xItemSize;
+            pxRingbuffer->uxRingbufferFlags |= rbSEND_ACQUIRED_FLAG;
+            *ppvItem = pxRingbuffer->pucAcquire;
+            xReturn = pdTRUE;
+            taskEXIT_CRITICAL();
+            break;
+        }
+        //Item doesn't fit, adjust ticks and take the semaphore again
+        if (xTicksToWait != portMAX_DELAY) {
+            xTicksRemaining = xTicksEnd - xTaskGetTickCount();
+        }
+        taskEXIT_CRITICAL();
+        /*
+         * Gap between critical section and re-acquiring of the semaphore. If
+         * semaphore is given now, priority inversion might occur (see docs)
+         */
+    }
+    /*
+     * The free semaphore is not given back on success, other tasks can't send
+     * anyway until xRingbufferSendComplete() gives it
+     */
+    return xReturn;
+}
+
+BaseType_t xRingbufferSendComplete(RingbufHandle_t xRingbuffer, void *pvItem)
+{
+    //Check arguments
+    Ringbuffer_t *pxRingbuffer = (Ringbuffer_t *)xRingbuffer;
+    configASSERT(pxRingbuffer);
+    configASSERT(pvItem != NULL);
+
+    BaseType_t xReturnSemaphore = pdFALSE;
+    taskENTER_CRITICAL();
+    if ((pxRingbuffer->uxRingbufferFlags & rbSEND_ACQUIRED_FLAG) == 0 || pvItem != pxRingbuffer->pucAcquire) {
+        taskEXIT_CRITICAL();
+        return pdFALSE;     //Item was not acquired from this buffer
+    }
+    pxRingbuffer->vSendItemDone(pxRingbuffer, pxRingbuffer->pucAcquire, pxRingbuffer->xAcquireSize);
+    pxRingbuffer->uxRingbufferFlags &= ~rbSEND_ACQUIRED_FLAG;
+    pxRingbuffer->pucAcquire = NULL;
+    //Check if the free semaphore should be returned to allow other tasks to send
+    if (prvGetFreeSize(pxRingbuffer) > 0) {
+        xReturnSemaphore = pdTRUE;
+    }
+    taskEXIT_CRITICAL();
+
+    //Indicate item was successfully sent
+    xSemaphoreGive(pxRingbuffer->xItemsBufferedSemaphore);
+    if (xReturnSemaphore == pdTRUE) {
+        xSemaphoreGive(pxRingbuffer->xFreeSpaceSemaphore);  //Give back semaphore so other tasks can send
+    }
+    return pdTRUE;
+}
+
 void *xRingbufferReceive(RingbufHandle_t xRingbuffer, size_t *pxItemSize, TickType_t xTicksToWait)
 {
     //Check arguments
@@ -1046,7 +1251,11 @@ size_t xRingbufferGetCurFreeSize(RingbufHandle_t xRingbuffer)
 
     size_t xFreeSize;
     taskENTER_CRITICAL();
-    xFreeSize = pxRingbuffer->xGetCurMaxSize(pxRingbuffer);
+    if (pxRingbuffer->uxRingbufferFlags & rbSEND_ACQUIRED_FLAG) {
+        xFreeSize = 0;      //Nothing can be sent until the acquired item is completed
+    } else {
+        xFreeSize = pxRingbuffer->xGetCurMaxSize(pxRingbuffer);
+    }
     taskEXIT_CRITICAL();
     return xFreeSize;
 }
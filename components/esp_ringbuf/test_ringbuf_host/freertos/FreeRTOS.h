@@ -0,0 +1,25 @@
+// Host build stub of FreeRTOS.h, the benchmark is single threaded
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <assert.h>
+
+#define INC_FREERTOS_H
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portBYTE_ALIGNMENT_MASK (0x0003)
+
+#define configASSERT(x) assert(x)
+
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+#define portENTER_CRITICAL()
+#define portEXIT_CRITICAL()
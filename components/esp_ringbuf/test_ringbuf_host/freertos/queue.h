@@ -0,0 +1,8 @@
+// Host build stub of queue.h, queue sets are not used by the benchmark
+#pragma once
+
+typedef void *QueueSetHandle_t;
+typedef void *QueueSetMemberHandle_t;
+
+#define xQueueAddToSet(member, set) pdFALSE
+#define xQueueRemoveFromSet(member, set) pdFALSE
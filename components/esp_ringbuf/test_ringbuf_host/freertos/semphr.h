@@ -0,0 +1,37 @@
+// Host build stub of semphr.h, taking a semaphore never blocks in the single threaded benchmark
+#pragma once
+
+#include <stdlib.h>
+#include "queue.h"
+
+typedef struct {
+    int count;
+} host_semaphore_t;
+
+typedef host_semaphore_t *SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return calloc(1, sizeof(host_semaphore_t));
+}
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    if (sem->count == 0) {
+        return pdFALSE;
+    }
+    sem->count = 0;
+    return pdTRUE;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    if (sem->count) {
+        return pdFALSE;
+    }
+    sem->count = 1;
+    return pdTRUE;
+}
+
+#define xSemaphoreGiveFromISR(sem, woken) xSemaphoreGive(sem)
+#define vSemaphoreDelete(sem) free(sem)
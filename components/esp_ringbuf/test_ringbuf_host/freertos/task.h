@@ -0,0 +1,4 @@
+// Host build stub of task.h, the benchmark is single threaded
+#pragma once
+
+#define xTaskGetTickCount() ((TickType_t)0)
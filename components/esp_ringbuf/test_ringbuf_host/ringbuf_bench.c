@@ -0,0 +1,224 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Compare the throughput of producers which build their items in a local buffer and
+ * copy them with xRingbufferSend() with producers which write the items in place with
+ * xRingbufferSendAcquire() and xRingbufferSendComplete(), for all ring buffer types.
+ * The producer sends a burst of items which the consumer then drains, before the
+ * timed runs the data retrieved is checked for both ways of sending.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "FreeRTOS.h"
+#include "ringbuf.h"
+
+#define BENCH_RINGBUF_SIZE  (16 * 1024)
+#define BENCH_BURST         8
+#define BENCH_BYTES         (128 * 1024 * 1024)
+#define BENCH_RUNS          3
+
+static const size_t s_item_sizes[] = { 32, 256, 1024 };
+
+static const struct {
+    ringbuf_type_t type;
+    const char *name;
+} s_types[] = {
+    { RINGBUF_TYPE_NOSPLIT, "no-split" },
+    { RINGBUF_TYPE_ALLOWSPLIT, "allow-split" },
+    { RINGBUF_TYPE_BYTEBUF, "byte buffer" },
+};
+
+static inline uint64_t bench_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Received frames, s_frames[n] == (uint8_t)n so that every item starts with a different byte */
+static uint8_t s_frames[1024 + 256];
+
+/* The work of the producer, like a driver fetching a frame from its DMA buffer */
+static void fill_item(uint8_t *dst, size_t size, uint32_t seq)
+{
+    memcpy(dst, &s_frames[seq & 0xff], size);
+}
+
+static int send_copy(RingbufHandle_t rb, size_t size, uint32_t seq)
+{
+    uint8_t item[1024];
+
+    fill_item(item, size, seq);
+
+    return xRingbufferSend(rb, item, size, 0) == pdTRUE;
+}
+
+static int send_acquire(RingbufHandle_t rb, size_t size, uint32_t seq)
+{
+    void *item;
+
+    if (xRingbufferSendAcquire(rb, &item, size, 0) != pdTRUE) {
+        return 0;
+    }
+    fill_item(item, size, seq);
+
+    return xRingbufferSendComplete(rb, item) == pdTRUE;
+}
+
+/*
+ * Retrieve everything buffered, byte buffers and split items may hand out an item
+ * in several parts. When "check" is set the data is compared with what the producer
+ * wrote, "seq" and "offset" track the position in the stream.
+ */
+static size_t drain(RingbufHandle_t rb, ringbuf_type_t type, size_t size, uint32_t *seq, size_t *offset, int check)
+{
+    size_t total = 0;
+
+    while (1) {
+        void *parts[2] = { NULL, NULL };
+        size_t lens[2] = { 0, 0 };
+
+        if (type == RINGBUF_TYPE_ALLOWSPLIT) {
+            if (xRingbufferReceiveSplit(rb, &parts[0], &parts[1], &lens[0], &lens[1], 0) != pdTRUE) {
+                break;
+            }
+        } else {
+            parts[0] = xRingbufferReceive(rb, &lens[0], 0);
+            if (parts[0] == NULL) {
+                break;
+            }
+        }
+
+        for (int p = 0; p < 2 && parts[p]; p++) {
+            const uint8_t *data = parts[p];
+
+            for (size_t i = 0; check && i < lens[p]; i++) {
+                if (data[i] != (uint8_t)(*seq + *offset)) {
+                    printf("data mismatch in item %u at offset %zu\n", *seq, *offset);
+                    exit(1);
+                }
+                if (++*offset == size) {
+                    *offset = 0;
+                    ++*seq;
+                }
+            }
+            total += lens[p];
+            vRingbufferReturnItem(rb, parts[p]);
+        }
+    }
+
+    return total;
+}
+
+static void check_type(ringbuf_type_t type, const char *name)
+{
+    for (size_t s = 0; s < sizeof(s_item_sizes) / sizeof(s_item_sizes[0]); s++) {
+        size_t size = s_item_sizes[s];
+        RingbufHandle_t rb = xRingbufferCreate(BENCH_RINGBUF_SIZE, type);
+        uint32_t sent = 0, received = 0;
+        size_t offset = 0;
+
+        /* Alternate both ways of sending with bursts of varying length, so that items wrap around everywhere */
+        for (int round = 0; round < 2000; round++) {
+            int burst = 1 + round % (BENCH_BURST + 3);
+
+            for (int i = 0; i < burst; i++) {
+                int (*send_fn)(RingbufHandle_t, size_t, uint32_t) = ((round + i) & 1) ? send_acquire : send_copy;
+
+                if (!send_fn(rb, size, sent)) {
+                    break;
+                }
+                sent++;
+            }
+            drain(rb, type, size, &received, &offset, 1);
+            if (received != sent || offset != 0) {
+                printf("%s: %u items sent but %u received\n", name, sent, received);
+                exit(1);
+            }
+        }
+        vRingbufferDelete(rb);
+    }
+}
+
+static double bench_once(ringbuf_type_t type, size_t size, int (*send_fn)(RingbufHandle_t, size_t, uint32_t))
+{
+    RingbufHandle_t rb = xRingbufferCreate(BENCH_RINGBUF_SIZE, type);
+    size_t total = 0;
+    uint32_t seq = 0;
+    size_t offset = 0;
+    uint64_t start, ns;
+
+    start = bench_ns();
+    while (total < BENCH_BYTES) {
+        for (int i = 0; i < BENCH_BURST; i++) {
+            if (!send_fn(rb, size, seq++)) {
+                printf("send of %zu bytes failed\n", size);
+                exit(1);
+            }
+        }
+        total += drain(rb, type, size, &seq, &offset, 0);
+    }
+    ns = bench_ns() - start;
+    vRingbufferDelete(rb);
+
+    return (double)total / 1048576 / ((double)ns / 1e9);
+}
+
+/* Best of several runs, to keep other load on the host out of the comparison */
+static double bench_run(ringbuf_type_t type, size_t size, int (*send_fn)(RingbufHandle_t, size_t, uint32_t))
+{
+    double best = 0;
+
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        double mbps = bench_once(type, size, send_fn);
+
+        if (mbps > best) {
+            best = mbps;
+        }
+    }
+
+    return best;
+}
+
+int main(void)
+{
+    for (size_t i = 0; i < sizeof(s_frames); i++) {
+        s_frames[i] = (uint8_t)i;
+    }
+
+    for (size_t t = 0; t < sizeof(s_types) / sizeof(s_types[0]); t++) {
+        check_type(s_types[t].type, s_types[t].name);
+    }
+
+    printf("%-12s %6s %14s %14s %8s\n", "type", "item", "send MB/s", "acquire MB/s", "speedup");
+    for (size_t t = 0; t < sizeof(s_types) / sizeof(s_types[0]); t++) {
+        for (size_t s = 0; s < sizeof(s_item_sizes) / sizeof(s_item_sizes[0]); s++) {
+            size_t size = s_item_sizes[s];
+            double copy = bench_run(s_types[t].type, size, send_copy);
+            double acquire = bench_run(s_types[t].type, size, send_acquire);
+
+            printf("%-12s %6zu %14.1f %14.1f %7.2fx\n", s_types[t].name, size, copy, acquire, acquire / copy);
+        }
+    }
+
+    return 0;
+}
@@ -72,13 +72,39 @@ typedef struct heap_region {
 
 	uint32_t caps;          ///< Heap capacity
 
-	void *free_blk;      ///< First free memory block
+	void *free_blk;      ///< First free memory block(only used by first-fit allocation)
 
 	size_t free_bytes;      ///< Current free heap size by byte
 
 	size_t min_free_bytes;  ///< Minimum free heap size by byte ever
+
+	size_t free_blks;       ///< Number of free memory blocks
+	size_t used_blks;       ///< Number of used memory blocks
+	uint16_t free_blk_hist[HEAP_HIST_NUM]; ///< Number of free memory blocks of every power-of-two size class
+
+#ifdef CONFIG_HEAP_SEGREGATED_BINS
+	uint32_t fl_bitmap;     ///< Bitmap of first-level size classes which have free blocks
+	uint8_t sl_bitmap[HEAP_BIN_FL_NUM]; ///< Bitmap of second-level size classes which have free blocks
+
+	void *bins[HEAP_BIN_FL_NUM][HEAP_BIN_SL_NUM]; ///< Free block list head of every size class
+#endif
 } heap_region_t;
 
+/**
+ * @brief Structure to access heap metadata via heap_caps_get_info
+ */
+typedef struct {
+    size_t total_free_bytes;      ///<  Total free bytes in the heap. Equivalent to heap_caps_get_free_size().
+    size_t total_allocated_bytes; ///<  Total bytes allocated to data in the heap, including block headers.
+    size_t largest_free_block;    ///<  Size of largest free block in the heap. This is the largest malloc-able size.
+    size_t minimum_free_bytes;    ///<  Lifetime minimum free heap size. Equivalent to heap_caps_get_minimum_free_size().
+    size_t allocated_blocks;      ///<  Number of (variable size) blocks allocated in the heap.
+    size_t free_blocks;           ///<  Number of (variable size) free blocks in the heap.
+    size_t total_blocks;          ///<  Total number of (variable size) blocks in the heap.
+    size_t fragmentation;         ///<  Fragmentation index in percent, 100 * (1 - largest free block / total free bytes).
+    size_t free_blocks_hist[HEAP_HIST_NUM]; ///< Number of free blocks whose size is in [2^(4 + n), 2^(5 + n)), the last class is open.
+} multi_heap_info_t;
+
 
 /**
  * @brief Get the total free size of all the regions that have the given capabilities
@@ -104,6 +130,28 @@ size_t heap_caps_get_free_size(uint32_t caps);
  */
 size_t heap_caps_get_minimum_free_size(uint32_t caps);
 
+/**
+ * @brief Get the largest free block of memory able to be allocated with the given capabilities.
+ *
+ * Returns the largest value of ``s`` for which ``heap_caps_malloc(s, caps)`` will succeed.
+ *
+ * @param caps Bitwise OR of MALLOC_CAP_* flags indicating the type of memory
+ *
+ * @return Size of largest free block in bytes.
+ */
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+
+/**
+ * @brief Get heap statistics of all the regions that have the given capabilities
+ *
+ * Block and size class counters are maintained on every allocation, so this only walks
+ * the block chain to find the largest free block when segregated bins are disabled.
+ *
+ * @param info Pointer to a structure which will be filled with relevant heap metadata.
+ * @param caps Bitwise OR of MALLOC_CAP_* flags indicating the type of memory
+ */
+void heap_caps_get_info(multi_heap_info_t *info, uint32_t caps);
+
 /**
  * @brief Initialize regions of memory to the collection of heaps at runtime.
  *
@@ -14,6 +14,10 @@
 
 #pragma once
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
 #include "sdkconfig.h"
 #include "esp_err.h"
 
@@ -27,15 +31,49 @@ typedef enum {
 	HEAP_TRACE_NONE = 0,
 
     HEAP_TRACE_LEAKS,
+    HEAP_TRACE_ALL,
 } heap_trace_mode_t;
 
 /**
- * @brief heap trace record information(not used)
+ * @brief heap trace record of one allocation or free event
  */
 typedef struct {
-    char    buf[1];     /*!< record buffer */
+    uint32_t    tick;           /*!< RTOS tick count when the event happened */
+    void        *address;       /*!< address of the memory */
+    uint32_t    size : 31;      /*!< size of the memory by byte */
+    uint32_t    freed : 1;      /*!< 0: allocation event, 1: free event */
+    const char  *file;          /*!< caller file name, or caller function address if "line" is 0 */
+    uint32_t    line;           /*!< caller file line, or 0 */
 } heap_trace_record_t;
 
+/**
+ * @brief live allocation in a heap trace snapshot
+ */
+typedef struct {
+    void        *address;       /*!< address of the memory */
+    size_t      size;           /*!< size of the memory by byte */
+    const char  *file;          /*!< caller file name or function address, NULL if the memory was not traced */
+    size_t      line;           /*!< caller file line, or 0 */
+} heap_trace_snapshot_item_t;
+
+/**
+ * @brief heap trace snapshot of all live allocations, sorted by address
+ */
+typedef struct {
+    heap_trace_snapshot_item_t  *items;     /*!< item buffer, provided by the user */
+    size_t                      max;        /*!< number of items the buffer can hold */
+    size_t                      num;        /*!< number of items taken */
+    uint32_t                    tick;       /*!< RTOS tick count when the snapshot was taken */
+} heap_trace_snapshot_t;
+
+/**
+ * @brief callback of heap_trace_snapshot_diff() for every difference
+ *
+ * @param item live allocation which only exists in one of the snapshots
+ * @param allocated true if the memory was allocated after the first snapshot, false if it was freed before the second one
+ * @param arg user argument
+ */
+typedef void (*heap_trace_diff_cb_t)(const heap_trace_snapshot_item_t *item, bool allocated, void *arg);
 /**
  * @brief Check if heap trace is on
  *
@@ -44,7 +82,16 @@ typedef struct {
 int heap_trace_is_on(void);
 
 /**
- * @brief Empty function just for passing compiling some place.
+ * @brief Set the ring buffer which HEAP_TRACE_ALL records allocation and free events into.
+ *
+ * When the buffer is full the oldest record is overwritten.
+ *
+ * @param record_buffer buffer of records, NULL to remove the buffer
+ * @param num_records number of records the buffer can hold
+ *
+ * @return
+ * - ESP_ERR_INVALID_STATE Heap tracing is running.
+ * - ESP_OK Buffer is set.
  */
 esp_err_t heap_trace_init_standalone(heap_trace_record_t *record_buffer, size_t num_records);
 
@@ -53,7 +100,9 @@ esp_err_t heap_trace_init_standalone(heap_trace_record_t *record_buffer, size_t
  *
  * @param mode Mode for tracing.
  * - HEAP_TRACE_LEAKS means only suspected memory leaks are traced. (When memory is freed, the record is removed from the trace buffer.)
+ * - HEAP_TRACE_ALL means that in addition every allocation and free is recorded into the buffer set by heap_trace_init_standalone().
  * @return
+ * - ESP_ERR_INVALID_STATE HEAP_TRACE_ALL is requested but no record buffer is set.
  * - ESP_OK Tracing is started.
  */
 esp_err_t heap_trace_start(heap_trace_mode_t mode);
@@ -83,6 +132,64 @@ esp_err_t heap_trace_resume(void);
  */
 void heap_trace_dump(void);
 
+/**
+ * @brief Get the number of records in the ring buffer
+ *
+ * @return number of records
+ */
+size_t heap_trace_get_count(void);
+
+/**
+ * @brief Get the number of records which were overwritten because the ring buffer was full
+ *
+ * @return number of lost records
+ */
+uint32_t heap_trace_get_lost(void);
+
+/**
+ * @brief Get one record of the ring buffer
+ *
+ * @param index record index, 0 is the oldest record
+ * @param record pointer of the record to copy to
+ *
+ * @return
+ * - ESP_ERR_INVALID_ARG Index is out of range.
+ * - ESP_OK Record is copied.
+ */
+esp_err_t heap_trace_get(size_t index, heap_trace_record_t *record);
+
+/**
+ * @brief Dump the ring buffer records to stdout, one event per line, for tools/heap_trace_decode.py
+ */
+void heap_trace_dump_records(void);
+
+/**
+ * @brief Take a snapshot of all live allocations of the heap
+ *
+ * "items" and "max" of the snapshot must be set by the user, allocations that don't fit are not taken.
+ *
+ * @param snapshot snapshot to fill
+ *
+ * @return
+ * - ESP_ERR_INVALID_ARG Snapshot has no item buffer.
+ * - ESP_ERR_NO_MEM Item buffer is too small, only the first "max" allocations are taken.
+ * - ESP_OK Snapshot is taken.
+ */
+esp_err_t heap_trace_snapshot_take(heap_trace_snapshot_t *snapshot);
+
+/**
+ * @brief Compare two snapshots and report the allocations that only exist in one of them
+ *
+ * @param before snapshot taken first
+ * @param after snapshot taken later
+ * @param cb callback for every difference, NULL to print the allocations of "after" that are not in "before"
+ * @param arg user argument of the callback
+ *
+ * @return number of allocations in "after" that are not in "before", these are the leak candidates
+ */
+size_t heap_trace_snapshot_diff(const heap_trace_snapshot_t *before, const heap_trace_snapshot_t *after,
+                                heap_trace_diff_cb_t cb, void *arg);
+
 #endif /* CONFIG_HEAP_TRACING */
 
 #ifdef __cplusplus
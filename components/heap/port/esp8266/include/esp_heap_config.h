@@ -25,3 +25,13 @@
 #endif
 
 #define MEM_BLK_MIN 1
+
+#define HEAP_HIST_SHIFT 4                               ///< Smallest statistics size class is 2^4 bytes
+#define HEAP_HIST_NUM 12                                ///< Statistics size classes
+
+#ifdef CONFIG_HEAP_SEGREGATED_BINS
+#define HEAP_BIN_SL_LOG2 2                              ///< Second-level size classes per power of two(log2)
+#define HEAP_BIN_SL_NUM (1 << HEAP_BIN_SL_LOG2)
+#define HEAP_BIN_FL_SHIFT 4                             ///< Smallest first-level size class is 2^4 bytes
+#define HEAP_BIN_FL_NUM 14                              ///< First-level size classes, up to 2^(4+14) bytes
+#endif
@@ -15,6 +15,7 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -38,6 +39,14 @@ extern "C" {
     esp_task_wdt_reset();                   \
 }
 
+/* heap_trace_record() is in IRAM, with CONFIG_HEAP_TRACING freertos/linker.lf puts
+ * xTaskGetTickCount() there too */
+#define _heap_caps_get_tick()               \
+({                                          \
+    extern uint32_t xTaskGetTickCount(void);\
+    xTaskGetTickCount();                    \
+})
+
 /**
  * @brief Get the total free size of DRAM region
  *
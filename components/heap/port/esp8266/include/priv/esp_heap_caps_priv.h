@@ -16,6 +16,7 @@
 
 #include "sdkconfig.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -30,14 +31,14 @@ extern "C" {
 #endif
 
 #define _mem_blk_get_ptr(_mem_blk, _offset, _mask)                          \
-    ((mem_blk_t *)((((uint32_t *)(_mem_blk))[_offset]) & (~_mask)))
+    ((mem_blk_t *)((((uintptr_t *)(_mem_blk))[_offset]) & (~_mask)))
 
 #define _mem_blk_set_ptr(_mem_blk, _val, _offset, _mask)                    \
 {                                                                           \
-    uint32_t *__p = (uint32_t *)(_mem_blk);                                 \
-    uint32_t __bits = __p[_offset] & (_mask);                               \
+    uintptr_t *__p = (uintptr_t *)(_mem_blk);                               \
+    uintptr_t __bits = __p[_offset] & (_mask);                              \
                                                                             \
-    __p[_offset] = (uint32_t)(_val) | __bits;                               \
+    __p[_offset] = (uintptr_t)(_val) | __bits;                              \
 }
 
 #define mem_blk_prev(_mem_blk) _mem_blk_get_ptr(_mem_blk, 0, MEM_BLK_TAG)
@@ -54,7 +55,7 @@ static inline size_t mem_blk_head_size(bool trace)
 static inline void mem_blk_set_traced(mem2_blk_t *mem_blk, const char *file, size_t line)
 {
 #ifdef CONFIG_HEAP_TRACING
-    uint32_t *val = (uint32_t *)mem_blk + 1;
+    uintptr_t *val = (uintptr_t *)mem_blk + 1;
 
     *val |= MEM_BLK_TRACE;
 
@@ -65,35 +66,35 @@ static inline void mem_blk_set_traced(mem2_blk_t *mem_blk, const char *file, siz
 
 static inline void mem_blk_set_untraced(mem2_blk_t *mem_blk)
 {
-    uint32_t *val = (uint32_t *)mem_blk + 1;
+    uintptr_t *val = (uintptr_t *)mem_blk + 1;
 
     *val &= ~MEM_BLK_TRACE;
 }
 
 static inline int mem_blk_is_traced(mem_blk_t *mem_blk)
 {
-    uint32_t *val = (uint32_t *)mem_blk + 1;
+    uintptr_t *val = (uintptr_t *)mem_blk + 1;
 
     return *val & MEM_BLK_TRACE;
 }
 
 static inline void mem_blk_set_used(mem_blk_t *mem_blk)
 {
-    uint32_t *val = (uint32_t *)mem_blk;
+    uintptr_t *val = (uintptr_t *)mem_blk;
 
     *val |= MEM_BLK_TAG;
 }
 
 static inline void mem_blk_set_unused(mem_blk_t *mem_blk)
 {
-    uint32_t *val = (uint32_t *)mem_blk;
+    uintptr_t *val = (uintptr_t *)mem_blk;
 
     *val &= ~MEM_BLK_TAG;
 }
 
 static inline int mem_blk_is_used(mem_blk_t *mem_blk)
 {
-    uint32_t *val = (uint32_t *)mem_blk;
+    uintptr_t *val = (uintptr_t *)mem_blk;
 
     return *val & MEM_BLK_TAG;
 }
@@ -134,7 +135,7 @@ static inline size_t ptr2memblk_size(size_t size, bool trace)
 
 static inline bool ptr_is_traced(void *ptr)
 {
-    uint32_t *p = (uint32_t *)ptr - 1;
+    uintptr_t *p = (uintptr_t *)ptr - 1;
 
     return p[0] & MEM_BLK_TRACE ? true : false;
 }
@@ -162,11 +163,33 @@ static inline size_t ptr_size(void *ptr)
     return size;
 }
 
+#ifdef CONFIG_HEAP_SEGREGATED_BINS
+/**
+ * Size-class list links, stored in the payload of a free memory block.
+ */
+typedef struct mem_free_link {
+    mem_blk_t       *prev;  ///< Point to previous free memory block of the same size class
+    mem_blk_t       *next;  ///< Point to next free memory block of the same size class
+} mem_free_link_t;
+
+#define HEAP_BIN_BLK_MIN        (MEM_HEAD_SIZE + sizeof(mem_free_link_t))   ///< Minimum memory block size
+
+static inline mem_free_link_t *mem_blk_free_link(mem_blk_t *mem_blk)
+{
+    return (mem_free_link_t *)((uint8_t *)mem_blk + MEM_HEAD_SIZE);
+}
+#endif
+
 #ifdef CONFIG_HEAP_TRACING
 static inline size_t mem2_blk_line(mem2_blk_t *mem2_blk)
 {
     return mem2_blk->line & ~MEM_BLK_TRACE;
 }
+
+/**
+ * @brief Record an allocation or free event into the heap trace ring buffer, called with the heap locked
+ */
+void heap_trace_record(void *ptr, size_t size, bool freed, const char *file, size_t line);
 #endif
 
 #ifdef __cplusplus
@@ -36,6 +36,148 @@ size_t g_heap_region_num;
 int __g_heap_trace_mode = HEAP_TRACE_NONE;
 #endif
 
+#ifdef CONFIG_HEAP_SEGREGATED_BINS
+/**
+ * @brief Map a memory block size to its size class (first-level, second-level).
+ */
+static inline void heap_bin_mapping(size_t size, int *fl, int *sl)
+{
+    int f = 31 - __builtin_clz(size);
+    int s = (size >> (f - HEAP_BIN_SL_LOG2)) & (HEAP_BIN_SL_NUM - 1);
+
+    f -= HEAP_BIN_FL_SHIFT;
+    if (f >= HEAP_BIN_FL_NUM) {
+        f = HEAP_BIN_FL_NUM - 1;
+        s = HEAP_BIN_SL_NUM - 1;
+    }
+
+    *fl = f;
+    *sl = s;
+}
+
+/**
+ * @brief Add a free memory block to the head of its size class list.
+ */
+static inline void heap_bin_insert(heap_region_t *region, mem_blk_t *mem_blk)
+{
+    int fl, sl;
+    mem_blk_t *head;
+    mem_free_link_t *link = mem_blk_free_link(mem_blk);
+
+    heap_bin_mapping(blk_link_size(mem_blk), &fl, &sl);
+
+    head = region->bins[fl][sl];
+    link->prev = NULL;
+    link->next = head;
+    if (head)
+        mem_blk_free_link(head)->prev = mem_blk;
+
+    region->bins[fl][sl] = mem_blk;
+    region->fl_bitmap |= 1 << fl;
+    region->sl_bitmap[fl] |= 1 << sl;
+}
+
+/**
+ * @brief Remove a free memory block from its size class list, must be called before the block size changes.
+ */
+static inline void heap_bin_remove(heap_region_t *region, mem_blk_t *mem_blk)
+{
+    int fl, sl;
+    mem_free_link_t *link = mem_blk_free_link(mem_blk);
+
+    heap_bin_mapping(blk_link_size(mem_blk), &fl, &sl);
+
+    if (link->next)
+        mem_blk_free_link(link->next)->prev = link->prev;
+
+    if (link->prev) {
+        mem_blk_free_link(link->prev)->next = link->next;
+    } else {
+        region->bins[fl][sl] = link->next;
+        if (!link->next) {
+            region->sl_bitmap[fl] &= ~(1 << sl);
+            if (!region->sl_bitmap[fl])
+                region->fl_bitmap &= ~(1 << fl);
+        }
+    }
+}
+
+/**
+ * @brief Find a free memory block which is not smaller than "size" in bounded time.
+ *
+ * The request is rounded up to the next size class so that any block of the found class fits, only the
+ * last class collects blocks of unbounded size and has to be searched.
+ */
+static inline mem_blk_t *heap_bin_find(heap_region_t *region, size_t size)
+{
+    int fl, sl;
+    uint32_t bitmap;
+    mem_blk_t *mem_blk;
+
+    heap_bin_mapping(size + (1 << (31 - __builtin_clz(size) - HEAP_BIN_SL_LOG2)) - 1, &fl, &sl);
+
+    bitmap = region->sl_bitmap[fl] & (~0U << sl);
+    if (!bitmap) {
+        bitmap = region->fl_bitmap & (~0U << (fl + 1));
+        if (!bitmap)
+            return NULL;
+
+        fl = __builtin_ctz(bitmap);
+        bitmap = region->sl_bitmap[fl];
+    }
+    sl = __builtin_ctz(bitmap);
+
+    mem_blk = region->bins[fl][sl];
+    if (fl == HEAP_BIN_FL_NUM - 1 && sl == HEAP_BIN_SL_NUM - 1) {
+        while (mem_blk && blk_link_size(mem_blk) < size)
+            mem_blk = mem_blk_free_link(mem_blk)->next;
+    }
+
+    return mem_blk;
+}
+#endif
+
+/**
+ * @brief Map a memory block size to its statistics size class.
+ */
+static inline int heap_hist_index(size_t size)
+{
+    int i = 31 - __builtin_clz(size) - HEAP_HIST_SHIFT;
+
+    if (i < 0)
+        i = 0;
+    else if (i >= HEAP_HIST_NUM)
+        i = HEAP_HIST_NUM - 1;
+
+    return i;
+}
+
+/**
+ * @brief Account a memory block which becomes free, must be called after its size is final.
+ */
+static inline void heap_free_blk_add(heap_region_t *region, mem_blk_t *mem_blk)
+{
+    region->free_blks++;
+    region->free_blk_hist[heap_hist_index(blk_link_size(mem_blk))]++;
+
+#ifdef CONFIG_HEAP_SEGREGATED_BINS
+    heap_bin_insert(region, mem_blk);
+#endif
+}
+
+/**
+ * @brief Account a free memory block which is used or merged, must be called before its size changes.
+ */
+static inline void heap_free_blk_del(heap_region_t *region, mem_blk_t *mem_blk)
+{
+    region->free_blks--;
+    region->free_blk_hist[heap_hist_index(blk_link_size(mem_blk))]--;
+
+#ifdef CONFIG_HEAP_SEGREGATED_BINS
+    heap_bin_remove(region, mem_blk);
+#endif
+}
+
 /**
  * @brief Initialize regions of memory to the collection of heaps at runtime.
  */
@@ -59,6 +201,18 @@ void esp_heap_caps_init_region(heap_region_t *region, size_t max_num)
 
         g_heap_region[num].free_blk = mem_start;
         g_heap_region[num].min_free_bytes = g_heap_region[num].free_bytes = blk_link_size(mem_start);
+
+        g_heap_region[num].free_blks = 0;
+        g_heap_region[num].used_blks = 0;
+        memset(g_heap_region[num].free_blk_hist, 0, sizeof(g_heap_region[num].free_blk_hist));
+
+#ifdef CONFIG_HEAP_SEGREGATED_BINS
+        g_heap_region[num].fl_bitmap = 0;
+        memset(g_heap_region[num].sl_bitmap, 0, sizeof(g_heap_region[num].sl_bitmap));
+        memset(g_heap_region[num].bins, 0, sizeof(g_heap_region[num].bins));
+#endif
+
+        heap_free_blk_add(&g_heap_region[num], mem_start);
     }
     g_heap_region_num = max_num;
 }
@@ -91,6 +245,78 @@ size_t heap_caps_get_minimum_free_size(uint32_t caps)
     return bytes;
 }
 
+/**
+ * @brief Get the largest free block of memory able to be allocated with the given capabilities.
+ */
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    size_t largest = 0;
+
+    for (int i = 0; i < g_heap_region_num; i++) {
+        size_t size = 0;
+
+        if (caps != (caps & g_heap_region[i].caps))
+            continue;
+
+        _heap_caps_lock(i);
+
+#ifdef CONFIG_HEAP_SEGREGATED_BINS
+        if (g_heap_region[i].fl_bitmap) {
+            int fl = 31 - __builtin_clz(g_heap_region[i].fl_bitmap);
+            int sl = 31 - __builtin_clz(g_heap_region[i].sl_bitmap[fl]);
+            mem_blk_t *mem_blk = g_heap_region[i].bins[fl][sl];
+
+            for (; mem_blk; mem_blk = mem_blk_free_link(mem_blk)->next)
+                size = MAX(size, blk_link_size(mem_blk));
+        }
+#else
+        mem_blk_t *mem_blk = g_heap_region[i].free_blk;
+
+        for (; mem_blk && !mem_blk_is_end(mem_blk); mem_blk = mem_blk_next(mem_blk)) {
+            if (!mem_blk_is_used(mem_blk))
+                size = MAX(size, blk_link_size(mem_blk));
+        }
+#endif
+
+        _heap_caps_unlock(i);
+
+        if (size > MEM_HEAD_SIZE)
+            largest = MAX(largest, size - MEM_HEAD_SIZE);
+    }
+
+    return largest;
+}
+
+/**
+ * @brief Get heap statistics of all the regions that have the given capabilities
+ */
+void heap_caps_get_info(multi_heap_info_t *info, uint32_t caps)
+{
+    memset(info, 0, sizeof(multi_heap_info_t));
+
+    for (int i = 0; i < g_heap_region_num; i++) {
+        if (caps != (caps & g_heap_region[i].caps))
+            continue;
+
+        _heap_caps_lock(i);
+
+        info->total_free_bytes += g_heap_region[i].free_bytes;
+        info->total_allocated_bytes += g_heap_region[i].total_size - g_heap_region[i].free_bytes;
+        info->minimum_free_bytes += g_heap_region[i].min_free_bytes;
+        info->allocated_blocks += g_heap_region[i].used_blks;
+        info->free_blocks += g_heap_region[i].free_blks;
+        for (int j = 0; j < HEAP_HIST_NUM; j++)
+            info->free_blocks_hist[j] += g_heap_region[i].free_blk_hist[j];
+
+        _heap_caps_unlock(i);
+    }
+
+    info->total_blocks = info->allocated_blocks + info->free_blocks;
+    info->largest_free_block = heap_caps_get_largest_free_block(caps);
+    if (info->total_free_bytes)
+        info->fragmentation = 100 - (info->largest_free_block + MEM_HEAD_SIZE) * 100 / info->total_free_bytes;
+}
+
 /**
  * @brief Allocate a chunk of memory which has the given capabilities
  */
@@ -108,8 +334,8 @@ void IRAM_ATTR *_heap_caps_malloc(size_t size, uint32_t caps, const char *file,
     }
 
     for (num = 0; num < g_heap_region_num; num++) {
-        bool trace;
-        size_t head_size;
+        bool trace = false;
+        size_t split_size;
 
         if ((g_heap_region[num].caps & caps) != caps) {
             ESP_EARLY_LOGV(TAG, "caps in %x, num %d region %x @ %p", caps, num, g_heap_region[num].caps, &g_heap_region[num]);
@@ -119,10 +345,14 @@ void IRAM_ATTR *_heap_caps_malloc(size_t size, uint32_t caps, const char *file,
         _heap_caps_lock(num);
 
 #ifdef CONFIG_HEAP_TRACING
-        trace = __g_heap_trace_mode == HEAP_TRACE_LEAKS;
+        trace = __g_heap_trace_mode != HEAP_TRACE_NONE;
 #endif
 
         mem_blk_size = ptr2memblk_size(size, trace);
+#ifdef CONFIG_HEAP_SEGREGATED_BINS
+        if (mem_blk_size < HEAP_BIN_BLK_MIN)
+            mem_blk_size = HEAP_BIN_BLK_MIN;
+#endif
 
         ESP_EARLY_LOGV(TAG, "malloc size is %d(%x) blk size is %d(%x) region is %d", size, size,
                             mem_blk_size, mem_blk_size, num);
@@ -130,6 +360,16 @@ void IRAM_ATTR *_heap_caps_malloc(size_t size, uint32_t caps, const char *file,
         if (mem_blk_size > g_heap_region[num].free_bytes)
             goto next_region;
 
+#ifdef CONFIG_HEAP_SEGREGATED_BINS
+        mem_blk = heap_bin_find(&g_heap_region[num], mem_blk_size);
+
+        ESP_EARLY_LOGV(TAG, "malloc bin %p", mem_blk);
+
+        if (!mem_blk)
+            goto next_region;
+
+        split_size = HEAP_BIN_BLK_MIN;
+#else
         mem_blk = (mem_blk_t *)g_heap_region[num].free_blk;
 
         ESP_EARLY_LOGV(TAG, "malloc start %p", mem_blk);
@@ -145,12 +385,15 @@ void IRAM_ATTR *_heap_caps_malloc(size_t size, uint32_t caps, const char *file,
         if (!mem_blk || mem_blk_is_end(mem_blk))
             goto next_region;
 
+        split_size = mem_blk_head_size(trace) + MEM_BLK_MIN;
+#endif
+
+        heap_free_blk_del(&g_heap_region[num], mem_blk);
+
         ret_mem = blk2ptr(mem_blk, trace);
         ESP_EARLY_LOGV(TAG, "ret_mem is %p", ret_mem);
 
-        head_size = mem_blk_head_size(trace);
-
-        if (blk_link_size(mem_blk) >= mem_blk_size + head_size + MEM_BLK_MIN)
+        if (blk_link_size(mem_blk) >= mem_blk_size + split_size)
             next_mem_blk = (mem_blk_t *)((uint8_t *)mem_blk + mem_blk_size);
         else 
             next_mem_blk = mem_blk_next(mem_blk);
@@ -168,6 +411,8 @@ void IRAM_ATTR *_heap_caps_malloc(size_t size, uint32_t caps, const char *file,
 
             mem_blk_set_prev(mem_blk_next(mem_blk), next_mem_blk);
             mem_blk_set_next(mem_blk, next_mem_blk);
+
+            heap_free_blk_add(&g_heap_region[num], next_mem_blk);
         }
 
         mem_blk_set_used(mem_blk);
@@ -176,6 +421,7 @@ void IRAM_ATTR *_heap_caps_malloc(size_t size, uint32_t caps, const char *file,
             ESP_EARLY_LOGV(TAG, "mem_blk1 %p set trace", mem_blk);
         }
 
+#ifndef CONFIG_HEAP_SEGREGATED_BINS
         if (g_heap_region[num].free_blk == mem_blk) {
             mem_blk_t *free_blk = mem_blk;
 
@@ -188,13 +434,20 @@ void IRAM_ATTR *_heap_caps_malloc(size_t size, uint32_t caps, const char *file,
         } else {
             ESP_EARLY_LOGV(TAG, "free_blk is %p", g_heap_region[num].free_blk);
         }
+#endif
 
         mem_blk_size = blk_link_size(mem_blk);
         g_heap_region[num].free_bytes -= mem_blk_size;
+        g_heap_region[num].used_blks++;
 
         if (g_heap_region[num].min_free_bytes > g_heap_region[num].free_bytes)
             g_heap_region[num].min_free_bytes = g_heap_region[num].free_bytes;
 
+#ifdef CONFIG_HEAP_TRACING
+        if (__g_heap_trace_mode == HEAP_TRACE_ALL)
+            heap_trace_record(ret_mem, size, false, file, line);
+#endif
+
         ESP_EARLY_LOGV(TAG, "mem_blk2 %p, mem_blk->prev %p(%p), mem_blk->next %p(%p)", mem_blk, mem_blk_prev(mem_blk),
                             mem_blk->prev, mem_blk_next(mem_blk), mem_blk->next);
         ESP_EARLY_LOGV(TAG, "next_mem_blk %p, next_mem_blk->prev %p(%p), next_mem_blk->next %p(%p)", next_mem_blk,
@@ -256,7 +509,13 @@ void IRAM_ATTR _heap_caps_free(void *ptr, const char *file, size_t line)
 
     _heap_caps_lock(num);
 
+#ifdef CONFIG_HEAP_TRACING
+    if (__g_heap_trace_mode == HEAP_TRACE_ALL)
+        heap_trace_record(ptr, ptr_size(ptr), true, file, line);
+#endif
+
     g_heap_region[num].free_bytes += blk_link_size(mem_blk);
+    g_heap_region[num].used_blks--;
 
     ESP_EARLY_LOGV(TAG, "ptr prev=%p next=%p", mem_blk_prev(mem_blk), mem_blk_next(mem_blk));
     ESP_EARLY_LOGV(TAG, "ptr1 prev->next=%p next->prev=%p", mem_blk_prev(mem_blk) ? mem_blk_next(mem_blk_prev(mem_blk)) : NULL,
@@ -270,6 +529,7 @@ void IRAM_ATTR _heap_caps_free(void *ptr, const char *file, size_t line)
     last = mem_blk_next(next);
 
     if (prev && !mem_blk_is_used(prev)) {
+        heap_free_blk_del(&g_heap_region[num], prev);
         mem_blk_set_next(prev, next);
         mem_blk_set_prev(next, prev);
         tmp = prev;
@@ -277,17 +537,22 @@ void IRAM_ATTR _heap_caps_free(void *ptr, const char *file, size_t line)
         tmp = mem_blk;
 
     if (last && !mem_blk_is_used(next)) {
+        heap_free_blk_del(&g_heap_region[num], next);
         mem_blk_set_next(tmp, last);
         mem_blk_set_prev(last, tmp);
     }
 
+    heap_free_blk_add(&g_heap_region[num], tmp);
+
     ESP_EARLY_LOGV(TAG, "ptr2 prev->next=%p next->prev=%p", mem_blk_prev(mem_blk) ? mem_blk_next(mem_blk_prev(mem_blk)) : NULL,
                         mem_blk_prev(mem_blk_next(mem_blk)));
 
+#ifndef CONFIG_HEAP_SEGREGATED_BINS
     if ((uint8_t *)mem_blk < (uint8_t *)g_heap_region[num].free_blk) {
         ESP_EARLY_LOGV(TAG, "Free update free block from %p to %p", g_heap_region[num].free_blk, mem_blk);
         g_heap_region[num].free_blk = mem_blk;
     }
+#endif
 
     _heap_caps_unlock(num);
 }
@@ -304,6 +569,81 @@ void *_heap_caps_calloc(size_t count, size_t size, uint32_t caps, const char *fi
     return p;
 }
 
+/**
+ * @brief Resize a used memory block in place, by merging the next free memory block when growing
+ *        and splitting off the tail when there is enough space left.
+ */
+static bool IRAM_ATTR heap_caps_resize_blk(size_t num, mem_blk_t *mem_blk, size_t mem_blk_size, bool trace)
+{
+    heap_region_t *region = &g_heap_region[num];
+    mem_blk_t *next = mem_blk_next(mem_blk);
+    mem_blk_t *tail = NULL, *last;
+    size_t old_size = blk_link_size(mem_blk);
+#ifdef CONFIG_HEAP_SEGREGATED_BINS
+    const size_t split_size = HEAP_BIN_BLK_MIN;
+#else
+    const size_t split_size = mem_blk_head_size(trace) + MEM_BLK_MIN;
+    bool merge_free_blk = false;
+#endif
+
+    if (mem_blk_size > old_size) {
+        if (mem_blk_is_end(next) || mem_blk_is_used(next) || old_size + blk_link_size(next) < mem_blk_size)
+            return false;
+
+        ESP_EARLY_LOGV(TAG, "realloc %p merge next %p size %d", mem_blk, next, blk_link_size(next));
+
+        heap_free_blk_del(region, next);
+#ifndef CONFIG_HEAP_SEGREGATED_BINS
+        merge_free_blk = next == region->free_blk;
+#endif
+        last = mem_blk_next(next);
+        mem_blk_set_next(mem_blk, last);
+        mem_blk_set_prev(last, mem_blk);
+        next = last;
+    }
+
+    if (blk_link_size(mem_blk) >= mem_blk_size + split_size) {
+        tail = (mem_blk_t *)((uint8_t *)mem_blk + mem_blk_size);
+        tail->prev = tail->next = NULL;
+
+        mem_blk_set_prev(tail, mem_blk);
+        mem_blk_set_next(tail, next);
+        mem_blk_set_prev(next, tail);
+        mem_blk_set_next(mem_blk, tail);
+
+        if (!mem_blk_is_end(next) && !mem_blk_is_used(next)) {
+            heap_free_blk_del(region, next);
+            last = mem_blk_next(next);
+            mem_blk_set_next(tail, last);
+            mem_blk_set_prev(last, tail);
+        }
+
+        heap_free_blk_add(region, tail);
+
+        ESP_EARLY_LOGV(TAG, "realloc %p split tail %p size %d", mem_blk, tail, blk_link_size(tail));
+    }
+
+#ifndef CONFIG_HEAP_SEGREGATED_BINS
+    if (merge_free_blk) {
+        mem_blk_t *free_blk = tail ? tail : mem_blk;
+
+        while (free_blk && !mem_blk_is_end(free_blk) && mem_blk_is_used(free_blk)) {
+            free_blk = mem_blk_next(free_blk);
+        }
+
+        region->free_blk = free_blk;
+    } else if (tail && (uint8_t *)tail < (uint8_t *)region->free_blk) {
+        region->free_blk = tail;
+    }
+#endif
+
+    region->free_bytes = region->free_bytes + old_size - blk_link_size(mem_blk);
+    if (region->min_free_bytes > region->free_bytes)
+        region->min_free_bytes = region->free_bytes;
+
+    return true;
+}
+
 /**
  * @brief Reallocate memory previously allocated via heap_caps_(m/c/r/z)alloc().
  */
@@ -311,6 +651,38 @@ void *_heap_caps_realloc(void *mem, size_t newsize, uint32_t caps, const char *f
 {
     void *return_addr = (void *)__builtin_return_address(0);
 
+    if (mem && newsize) {
+        size_t num = get_blk_region(mem);
+
+        if (num < g_heap_region_num && (g_heap_region[num].caps & caps) == caps) {
+            bool trace = ptr_is_traced(mem);
+            mem_blk_t *mem_blk = ptr2blk(mem, trace);
+            size_t mem_blk_size = ptr2memblk_size(newsize, trace);
+            bool resized;
+
+#ifdef CONFIG_HEAP_SEGREGATED_BINS
+            if (mem_blk_size < HEAP_BIN_BLK_MIN)
+                mem_blk_size = HEAP_BIN_BLK_MIN;
+#endif
+
+            _heap_caps_lock(num);
+#ifdef CONFIG_HEAP_TRACING
+            size_t old_size = ptr_size(mem);
+#endif
+            resized = heap_caps_resize_blk(num, mem_blk, mem_blk_size, trace);
+#ifdef CONFIG_HEAP_TRACING
+            if (resized && __g_heap_trace_mode == HEAP_TRACE_ALL) {
+                heap_trace_record(mem, old_size, true, file, line);
+                heap_trace_record(mem, newsize, false, file, line);
+            }
+#endif
+            _heap_caps_unlock(num);
+
+            if (resized)
+                return mem;
+        }
+    }
+
     void *p = _heap_caps_malloc(newsize, caps, file, line);
     if (p && mem) {
         size_t mem_size = ptr_size(mem);
@@ -17,11 +17,13 @@
 #ifdef CONFIG_HEAP_TRACING
 
 #include <string.h>
+#include <stdlib.h>
 
 #include "esp_heap_caps.h"
 #include "esp_heap_port.h"
 #include "esp_heap_trace.h"
 #include "priv/esp_heap_caps_priv.h"
+#include "esp_attr.h"
 
 //#define CONFIG_TRACE_ALL
 //#define CONFIG_TRACE_MEM_LINK 1
@@ -51,11 +53,63 @@ extern size_t g_heap_region_num;
 extern heap_region_t g_heap_region[];
 extern int __g_heap_trace_mode;
 
+static heap_trace_mode_t s_trace_mode = HEAP_TRACE_LEAKS;   ///< Mode which heap_trace_resume() restores
+
+static heap_trace_record_t *s_records;                      ///< Ring buffer of HEAP_TRACE_ALL
+static size_t s_records_max;                                ///< Number of records the ring buffer can hold
+static size_t s_records_num;                                ///< Number of records in the ring buffer
+static size_t s_records_head;                               ///< Index of the oldest record
+static uint32_t s_records_lost;                             ///< Number of overwritten records
+
 /**
- * @brief Empty function just for passing compiling some place.
+ * @brief Record an allocation or free event into the ring buffer, called with the heap locked
+ */
+void IRAM_ATTR heap_trace_record(void *ptr, size_t size, bool freed, const char *file, size_t line)
+{
+    heap_trace_record_t *record;
+    size_t index = s_records_head + s_records_num;
+
+    if (!s_records_max)
+        return;
+
+    if (index >= s_records_max)
+        index -= s_records_max;
+
+    if (s_records_num < s_records_max) {
+        s_records_num++;
+    } else {
+        if (++s_records_head == s_records_max)
+            s_records_head = 0;
+        s_records_lost++;
+    }
+
+    record = &s_records[index];
+    record->tick = _heap_caps_get_tick();
+    record->address = ptr;
+    record->size = size;
+    record->freed = freed;
+    record->file = file;
+    record->line = line;
+}
+
+/**
+ * @brief Set the ring buffer which HEAP_TRACE_ALL records allocation and free events into.
  */
 esp_err_t heap_trace_init_standalone(heap_trace_record_t *record_buffer, size_t num_records)
 {
+    if (__g_heap_trace_mode != HEAP_TRACE_NONE)
+        return ESP_ERR_INVALID_STATE;
+
+    _heap_caps_lock(0);
+
+    s_records = record_buffer;
+    s_records_max = record_buffer ? num_records : 0;
+    s_records_num = 0;
+    s_records_head = 0;
+    s_records_lost = 0;
+
+    _heap_caps_unlock(0);
+
     return ESP_OK;
 }
 
@@ -64,7 +118,7 @@ esp_err_t heap_trace_init_standalone(heap_trace_record_t *record_buffer, size_t
  */
 int heap_trace_is_on(void)
 {
-    return __g_heap_trace_mode == HEAP_TRACE_LEAKS;
+    return __g_heap_trace_mode != HEAP_TRACE_NONE;
 }
 
 /**
@@ -72,6 +126,11 @@ int heap_trace_is_on(void)
  */
 esp_err_t heap_trace_start(heap_trace_mode_t mode)
 {
+    if (mode == HEAP_TRACE_ALL && !s_records_max)
+        return ESP_ERR_INVALID_STATE;
+
+    if (mode != HEAP_TRACE_NONE)
+        s_trace_mode = mode;
     __g_heap_trace_mode = mode;
 
     return ESP_OK;
@@ -92,11 +151,207 @@ esp_err_t heap_trace_stop(void)
  */
 esp_err_t heap_trace_resume(void)
 {
-    __g_heap_trace_mode = HEAP_TRACE_LEAKS;
+    __g_heap_trace_mode = s_trace_mode;
 
     return ESP_OK;
 }
 
+/**
+ * @brief Get the number of records in the ring buffer
+ */
+size_t heap_trace_get_count(void)
+{
+    return s_records_num;
+}
+
+/**
+ * @brief Get the number of records which were overwritten because the ring buffer was full
+ */
+uint32_t heap_trace_get_lost(void)
+{
+    return s_records_lost;
+}
+
+/**
+ * @brief Get one record of the ring buffer
+ */
+esp_err_t heap_trace_get(size_t index, heap_trace_record_t *record)
+{
+    esp_err_t ret = ESP_OK;
+
+    _heap_caps_lock(0);
+
+    if (index < s_records_num) {
+        index += s_records_head;
+        if (index >= s_records_max)
+            index -= s_records_max;
+
+        memcpy(record, &s_records[index], sizeof(heap_trace_record_t));
+    } else
+        ret = ESP_ERR_INVALID_ARG;
+
+    _heap_caps_unlock(0);
+
+    return ret;
+}
+
+static inline const char *heap_trace_file_name(const char *file)
+{
+    const char *name = rindex(file, '/');
+
+    return name ? name + 1 : file;
+}
+
+/**
+ * @brief Dump the ring buffer records to stdout
+ *
+ * Every line is "<A|F> <tick> <address> <size> <caller>", caller is "<file>:<line>" or the function address.
+ */
+void heap_trace_dump_records(void)
+{
+    heap_trace_record_t record;
+
+    ESP_EARLY_LOGI(TAG, "records %u lost %u", heap_trace_get_count(), heap_trace_get_lost());
+
+    for (size_t i = 0; heap_trace_get(i, &record) == ESP_OK; i++) {
+        if (!record.line) {
+            ESP_EARLY_LOGI(TAG, "%c %u %p %u %p", record.freed ? 'F' : 'A', record.tick, record.address, record.size,
+                           record.file);
+        } else {
+            ESP_EARLY_LOGI(TAG, "%c %u %p %u %s:%u", record.freed ? 'F' : 'A', record.tick, record.address, record.size,
+                           heap_trace_file_name(record.file), record.line);
+        }
+
+        _heap_caps_feed_wdt(0);
+    }
+}
+
+static int heap_trace_snapshot_cmp(const void *a, const void *b)
+{
+    const heap_trace_snapshot_item_t *item_a = a, *item_b = b;
+
+    if (item_a->address == item_b->address)
+        return 0;
+
+    return (uint8_t *)item_a->address < (uint8_t *)item_b->address ? -1 : 1;
+}
+
+/**
+ * @brief Take a snapshot of all live allocations of the heap
+ */
+esp_err_t heap_trace_snapshot_take(heap_trace_snapshot_t *snapshot)
+{
+    uint8_t num;
+    mem_blk_t *p;
+    size_t cnt = 0;
+    bool sorted = true;
+
+    if (!snapshot || !snapshot->items)
+        return ESP_ERR_INVALID_ARG;
+
+    snapshot->tick = _heap_caps_get_tick();
+
+    for (num = 0; num < g_heap_region_num; num++) {
+        _heap_caps_lock(num);
+
+        p = (mem_blk_t *)HEAP_ALIGN(g_heap_region[num].start_addr);
+        for (; !mem_blk_is_end(p); p = mem_blk_next(p)) {
+            heap_trace_snapshot_item_t *item;
+            bool traced;
+
+            if (!mem_blk_is_used(p))
+                continue;
+
+            if (cnt++ >= snapshot->max)
+                continue;
+
+            traced = mem_blk_is_traced(p);
+            item = &snapshot->items[cnt - 1];
+            item->address = blk2ptr(p, traced);
+            item->size = blk_link_size(p) - mem_blk_head_size(traced);
+            if (traced) {
+                mem2_blk_t *mem2_blk = (mem2_blk_t *)p;
+
+                item->file = mem2_blk->file;
+                item->line = mem2_blk_line(mem2_blk);
+            } else {
+                item->file = NULL;
+                item->line = 0;
+            }
+
+            if (cnt > 1 && (uint8_t *)item->address < (uint8_t *)item[-1].address)
+                sorted = false;
+        }
+
+        _heap_caps_unlock(num);
+    }
+
+    snapshot->num = cnt < snapshot->max ? cnt : snapshot->max;
+
+    /* regions are not sorted by address */
+    if (!sorted)
+        qsort(snapshot->items, snapshot->num, sizeof(heap_trace_snapshot_item_t), heap_trace_snapshot_cmp);
+
+    return cnt > snapshot->max ? ESP_ERR_NO_MEM : ESP_OK;
+}
+
+static void heap_trace_snapshot_print(const heap_trace_snapshot_item_t *item, bool allocated, void *arg)
+{
+    if (!allocated)
+        return;
+
+    if (!item->file) {
+        ESP_EARLY_LOGI(TAG, "mem @%p size %d not traced", item->address, item->size);
+    } else if (!item->line) {
+        ESP_EARLY_LOGI(TAG, "mem @%p size %d caller func %p", item->address, item->size, item->file);
+    } else {
+        ESP_EARLY_LOGI(TAG, "mem @%p size %d caller file %s line %d", item->address, item->size,
+                       heap_trace_file_name(item->file), item->line);
+    }
+}
+
+static inline bool heap_trace_snapshot_same(const heap_trace_snapshot_item_t *a, const heap_trace_snapshot_item_t *b)
+{
+    return a->size == b->size && a->file == b->file && a->line == b->line;
+}
+
+/**
+ * @brief Compare two snapshots and report the allocations that only exist in one of them
+ */
+size_t heap_trace_snapshot_diff(const heap_trace_snapshot_t *before, const heap_trace_snapshot_t *after,
+                                heap_trace_diff_cb_t cb, void *arg)
+{
+    size_t i = 0, j = 0, allocated = 0;
+
+    if (!cb)
+        cb = heap_trace_snapshot_print;
+
+    while (i < before->num || j < after->num) {
+        const heap_trace_snapshot_item_t *a = i < before->num ? &before->items[i] : NULL;
+        const heap_trace_snapshot_item_t *b = j < after->num ? &after->items[j] : NULL;
+        int cmp = !a ? 1 : !b ? -1 : heap_trace_snapshot_cmp(a, b);
+
+        if (cmp == 0 && heap_trace_snapshot_same(a, b)) {
+            i++;
+            j++;
+            continue;
+        }
+
+        /* equal addresses with different callers or sizes mean the memory was freed and allocated again */
+        if (cmp <= 0) {
+            cb(a, false, arg);
+            i++;
+        }
+        if (cmp >= 0) {
+            cb(b, true, arg);
+            allocated++;
+            j++;
+        }
+    }
+
+    return allocated;
+}
+
 /**
  * @brief Dump heap trace record data to stdout
  */
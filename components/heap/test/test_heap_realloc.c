@@ -0,0 +1,66 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include <unity.h>
+
+#include "esp_heap_caps.h"
+
+TEST_CASE("Test Heap realloc grows and shrinks in place", "[Heap]")
+{
+    uint8_t *p, *q, *guard, *p2;
+    size_t free_size, min_free_size;
+
+    p = heap_caps_malloc(64, MALLOC_CAP_8BIT);
+    q = heap_caps_malloc(1024, MALLOC_CAP_8BIT);
+    guard = heap_caps_malloc(16, MALLOC_CAP_8BIT);
+    TEST_ASSERT_NOT_NULL(p);
+    TEST_ASSERT_NOT_NULL(q);
+    TEST_ASSERT_NOT_NULL(guard);
+    TEST_ASSERT(q > p && guard > q);
+
+    for (int i = 0; i < 64; i++)
+        p[i] = i;
+    heap_caps_free(q);
+
+    free_size = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    min_free_size = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+
+    // grow into the free block which "q" left behind
+    p2 = heap_caps_realloc(p, 512, MALLOC_CAP_8BIT);
+    TEST_ASSERT_EQUAL_PTR(p, p2);
+    for (int i = 0; i < 64; i++)
+        TEST_ASSERT_EQUAL(i, p2[i]);
+
+    // no second copy of the buffer ever existed, so the low water mark moved by the growth only
+    TEST_ASSERT(free_size - heap_caps_get_free_size(MALLOC_CAP_8BIT) < 512);
+    TEST_ASSERT(heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT) >= MIN(min_free_size, free_size - 512));
+
+    // shrink splits off the tail and gives it back to the heap
+    free_size = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    p2 = heap_caps_realloc(p, 32, MALLOC_CAP_8BIT);
+    TEST_ASSERT_EQUAL_PTR(p, p2);
+    TEST_ASSERT(heap_caps_get_free_size(MALLOC_CAP_8BIT) - free_size >= 512 - 32 - 16);
+
+    // the tail is merged with the free block behind it, so growing again stays in place
+    p2 = heap_caps_realloc(p, 900, MALLOC_CAP_8BIT);
+    TEST_ASSERT_EQUAL_PTR(p, p2);
+
+    heap_caps_free(p2);
+    heap_caps_free(guard);
+}
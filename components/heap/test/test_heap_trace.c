@@ -0,0 +1,109 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <unity.h>
+
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_heap_trace.h"
+
+#ifdef CONFIG_HEAP_TRACING
+
+#define TEST_RECORDS    8
+#define TEST_ITEMS      256
+
+static heap_trace_record_t s_records[TEST_RECORDS];
+static heap_trace_snapshot_item_t s_items[2][TEST_ITEMS];
+
+TEST_CASE("Test Heap trace records events into a ring buffer", "[Heap]")
+{
+    heap_trace_record_t record;
+    void *p[TEST_RECORDS];
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, heap_trace_start(HEAP_TRACE_ALL));
+
+    TEST_ESP_OK(heap_trace_init_standalone(s_records, TEST_RECORDS));
+
+    // keep other tasks from adding records
+    vTaskSuspendAll();
+
+    TEST_ESP_OK(heap_trace_start(HEAP_TRACE_ALL));
+    p[0] = heap_caps_malloc(40, MALLOC_CAP_8BIT);
+    heap_caps_free(p[0]);
+    heap_trace_stop();
+
+    xTaskResumeAll();
+
+    TEST_ASSERT_EQUAL(2, heap_trace_get_count());
+    TEST_ESP_OK(heap_trace_get(0, &record));
+    TEST_ASSERT_EQUAL_PTR(p[0], record.address);
+    TEST_ASSERT_EQUAL(40, record.size);
+    TEST_ASSERT_EQUAL(0, record.freed);
+    TEST_ESP_OK(heap_trace_get(1, &record));
+    TEST_ASSERT_EQUAL_PTR(p[0], record.address);
+    TEST_ASSERT_EQUAL(1, record.freed);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, heap_trace_get(2, &record));
+
+    // the ring buffer keeps the newest records
+    vTaskSuspendAll();
+
+    TEST_ESP_OK(heap_trace_resume());
+    for (int i = 0; i < TEST_RECORDS; i++)
+        p[i] = heap_caps_malloc(16 + i, MALLOC_CAP_8BIT);
+    heap_trace_stop();
+
+    xTaskResumeAll();
+
+    TEST_ASSERT_EQUAL(TEST_RECORDS, heap_trace_get_count());
+    TEST_ASSERT_EQUAL(2, heap_trace_get_lost());
+    TEST_ESP_OK(heap_trace_get(TEST_RECORDS - 1, &record));
+    TEST_ASSERT_EQUAL_PTR(p[TEST_RECORDS - 1], record.address);
+
+    for (int i = 0; i < TEST_RECORDS; i++)
+        heap_caps_free(p[i]);
+
+    TEST_ESP_OK(heap_trace_init_standalone(NULL, 0));
+}
+
+TEST_CASE("Test Heap trace snapshot diff finds new allocations", "[Heap]")
+{
+    heap_trace_snapshot_t before = { .items = s_items[0], .max = TEST_ITEMS };
+    heap_trace_snapshot_t after = { .items = s_items[1], .max = TEST_ITEMS };
+    void *leak, *tmp;
+
+    vTaskSuspendAll();
+
+    TEST_ESP_OK(heap_trace_start(HEAP_TRACE_LEAKS));
+    TEST_ESP_OK(heap_trace_snapshot_take(&before));
+    tmp = heap_caps_malloc(100, MALLOC_CAP_8BIT);
+    leak = heap_caps_malloc(200, MALLOC_CAP_8BIT);
+    heap_caps_free(tmp);
+    TEST_ESP_OK(heap_trace_snapshot_take(&after));
+    heap_trace_stop();
+
+    xTaskResumeAll();
+
+    TEST_ASSERT_EQUAL(1, heap_trace_snapshot_diff(&before, &after, NULL, NULL));
+    TEST_ASSERT_EQUAL(before.num + 1, after.num);
+
+    heap_caps_free(leak);
+}
+
+#endif /* CONFIG_HEAP_TRACING */
@@ -0,0 +1,14 @@
+// Host build stub of esp_log.h, logging is compiled out so it does not disturb the timing
+#pragma once
+
+#define ESP_EARLY_LOGE(tag, format, ...) do { (void)(tag); } while (0)
+#define ESP_EARLY_LOGW(tag, format, ...) do { (void)(tag); } while (0)
+#define ESP_EARLY_LOGI(tag, format, ...) do { (void)(tag); } while (0)
+#define ESP_EARLY_LOGD(tag, format, ...) do { (void)(tag); } while (0)
+#define ESP_EARLY_LOGV(tag, format, ...) do { (void)(tag); } while (0)
+
+#define ESP_LOGE(tag, format, ...) do { (void)(tag); } while (0)
+#define ESP_LOGW(tag, format, ...) do { (void)(tag); } while (0)
+#define ESP_LOGI(tag, format, ...) do { (void)(tag); } while (0)
+#define ESP_LOGD(tag, format, ...) do { (void)(tag); } while (0)
+#define ESP_LOGV(tag, format, ...) do { (void)(tag); } while (0)
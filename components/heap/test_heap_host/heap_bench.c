@@ -0,0 +1,307 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Replay an allocation trace against the capability heap and report the cost of every
+ * operation and the fragmentation of the heap.
+ *
+ * Trace format, one operation per line, '#' starts a comment:
+ *
+ *     m <id> <size>    malloc "size" bytes and bind the memory to "id"
+ *     r <id> <size>    realloc the memory bound to "id" to "size" bytes
+ *     f <id>           free the memory bound to "id"
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "esp_heap_caps.h"
+#include "esp_heap_port.h"
+#include "esp_heap_trace.h"
+#include "priv/esp_heap_caps_priv.h"
+
+#define HEAP_BENCH_ARENA_SIZE   (80 * 1024)
+#define HEAP_BENCH_IDS_MAX      4096
+#define HEAP_BENCH_FRAG_PERIOD  64
+#define HEAP_BENCH_RECORDS      1024
+
+typedef struct {
+    char        op;
+    uint32_t    id;
+    size_t      size;
+} heap_bench_op_t;
+
+typedef struct {
+    uint64_t    ns;
+    uint64_t    max_ns;
+    uint32_t    count;
+    uint32_t    fail;
+    uint32_t    in_place;
+} heap_bench_stat_t;
+
+heap_region_t g_heap_region[HEAP_REGIONS_MAX];
+
+static uint8_t s_arena[HEAP_BENCH_ARENA_SIZE] __attribute__((aligned(4)));
+static void *s_ptrs[HEAP_BENCH_IDS_MAX];
+
+void vPortETSIntrLock(void)
+{
+}
+
+void vPortETSIntrUnlock(void)
+{
+}
+
+void esp_task_wdt_reset(void)
+{
+}
+
+#ifdef CONFIG_HEAP_TRACING
+static heap_trace_record_t s_records[HEAP_BENCH_RECORDS];
+static heap_trace_snapshot_item_t s_snapshot_items[2][HEAP_BENCH_IDS_MAX];
+static uint32_t s_tick;
+
+uint32_t xTaskGetTickCount(void)
+{
+    return s_tick;
+}
+#endif
+
+static inline uint64_t heap_bench_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static heap_bench_op_t *heap_bench_load(const char *path, size_t *num)
+{
+    FILE *fp;
+    char line[128];
+    size_t cnt = 0, max = 1024;
+    heap_bench_op_t *ops;
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        perror(path);
+        return NULL;
+    }
+
+    ops = malloc(max * sizeof(heap_bench_op_t));
+    while (ops && fgets(line, sizeof(line), fp)) {
+        heap_bench_op_t *op;
+        unsigned long id, size = 0;
+        char c;
+
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+
+        if (sscanf(line, " %c %lu %lu", &c, &id, &size) < 2 || id >= HEAP_BENCH_IDS_MAX) {
+            fprintf(stderr, "%s: bad line \"%s\"\n", path, line);
+            continue;
+        }
+
+        if (cnt == max) {
+            max *= 2;
+            ops = realloc(ops, max * sizeof(heap_bench_op_t));
+            if (!ops)
+                break;
+        }
+
+        op = &ops[cnt++];
+        op->op = c;
+        op->id = id;
+        op->size = size;
+    }
+
+    fclose(fp);
+    *num = cnt;
+
+    return ops;
+}
+
+static size_t heap_bench_frag(size_t *free_bytes, size_t *largest)
+{
+    size_t free_blocks = 0;
+    mem_blk_t *p = (mem_blk_t *)HEAP_ALIGN(g_heap_region[0].start_addr);
+
+    *free_bytes = 0;
+    *largest = 0;
+    for (; !mem_blk_is_end(p); p = mem_blk_next(p)) {
+        if (!mem_blk_is_used(p)) {
+            size_t size = blk_link_size(p);
+
+            *free_bytes += size;
+            if (size > *largest)
+                *largest = size;
+            free_blocks++;
+        }
+    }
+
+    return free_blocks;
+}
+
+static void heap_bench_stat(heap_bench_stat_t *stat, uint64_t ns, bool ok)
+{
+    stat->ns += ns;
+    if (ns > stat->max_ns)
+        stat->max_ns = ns;
+    stat->count++;
+    if (!ok)
+        stat->fail++;
+}
+
+static void heap_bench_print(const char *name, heap_bench_stat_t *stat)
+{
+    printf("%-8s %8u ops %8.1f ns/op %8llu ns max %6u failed\n", name, stat->count,
+           stat->count ? (double)stat->ns / stat->count : 0.0, (unsigned long long)stat->max_ns, stat->fail);
+}
+
+int main(int argc, char **argv)
+{
+    size_t num, free_bytes, largest, free_blocks, free_blocks_hist = 0;
+    multi_heap_info_t info;
+    heap_bench_op_t *ops;
+    heap_bench_stat_t stat[3];
+    double frag, frag_max = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <trace file>\n", argv[0]);
+        return 1;
+    }
+
+    ops = heap_bench_load(argv[1], &num);
+    if (!ops)
+        return 1;
+
+    g_heap_region[0].start_addr = s_arena;
+    g_heap_region[0].total_size = sizeof(s_arena);
+    g_heap_region[0].caps = MALLOC_CAP_8BIT | MALLOC_CAP_32BIT | MALLOC_CAP_DMA;
+    esp_heap_caps_init_region(g_heap_region, 1);
+
+#ifdef CONFIG_HEAP_TRACING
+    heap_trace_snapshot_t snapshot[2] = {
+        { .items = s_snapshot_items[0], .max = HEAP_BENCH_IDS_MAX },
+        { .items = s_snapshot_items[1], .max = HEAP_BENCH_IDS_MAX },
+    };
+
+    heap_trace_init_standalone(s_records, HEAP_BENCH_RECORDS);
+    heap_trace_start(HEAP_TRACE_ALL);
+    heap_trace_snapshot_take(&snapshot[0]);
+#endif
+
+    memset(stat, 0, sizeof(stat));
+    for (size_t i = 0; i < num; i++) {
+        heap_bench_op_t *op = &ops[i];
+        void *p;
+        uint64_t t;
+
+#ifdef CONFIG_HEAP_TRACING
+        s_tick = i;
+#endif
+
+        switch (op->op) {
+        case 'm':
+            t = heap_bench_ns();
+            p = heap_caps_malloc(op->size, MALLOC_CAP_8BIT);
+            heap_bench_stat(&stat[0], heap_bench_ns() - t, p != NULL);
+            if (p) {
+                memset(p, 0x5a, op->size);
+                s_ptrs[op->id] = p;
+            }
+            break;
+        case 'r':
+            t = heap_bench_ns();
+            p = heap_caps_realloc(s_ptrs[op->id], op->size, MALLOC_CAP_8BIT);
+            heap_bench_stat(&stat[1], heap_bench_ns() - t, p != NULL);
+            if (p == s_ptrs[op->id])
+                stat[1].in_place++;
+            if (p)
+                s_ptrs[op->id] = p;
+            break;
+        case 'f':
+            if (!s_ptrs[op->id])
+                break;
+            t = heap_bench_ns();
+            heap_caps_free(s_ptrs[op->id]);
+            heap_bench_stat(&stat[2], heap_bench_ns() - t, true);
+            s_ptrs[op->id] = NULL;
+            break;
+        default:
+            break;
+        }
+
+        if (i % HEAP_BENCH_FRAG_PERIOD == 0) {
+            heap_bench_frag(&free_bytes, &largest);
+            frag = free_bytes ? 1.0 - (double)largest / free_bytes : 0;
+            if (frag > frag_max)
+                frag_max = frag;
+        }
+    }
+
+    free_blocks = heap_bench_frag(&free_bytes, &largest);
+    frag = free_bytes ? 1.0 - (double)largest / free_bytes : 0;
+    heap_caps_get_info(&info, MALLOC_CAP_8BIT);
+
+#ifdef CONFIG_HEAP_SEGREGATED_BINS
+    printf("allocator: segregated bins\n");
+#else
+    printf("allocator: first-fit\n");
+#endif
+#ifdef CONFIG_HEAP_TRACING
+    size_t live = 0, leaks;
+
+    heap_trace_snapshot_take(&snapshot[1]);
+    heap_trace_stop();
+
+    for (int i = 0; i < HEAP_BENCH_IDS_MAX; i++)
+        live += s_ptrs[i] != NULL;
+    leaks = heap_trace_snapshot_diff(&snapshot[0], &snapshot[1], NULL, NULL);
+
+    printf("trace: %u records, %u lost, %u live allocations in snapshot diff\n",
+           (unsigned)heap_trace_get_count(), (unsigned)heap_trace_get_lost(), (unsigned)leaks);
+    if (leaks != live) {
+        printf("heap trace snapshot diff has %u allocations, but %u are live\n", (unsigned)leaks, (unsigned)live);
+        return 1;
+    }
+#endif
+    heap_bench_print("malloc", &stat[0]);
+    heap_bench_print("realloc", &stat[1]);
+    heap_bench_print("free", &stat[2]);
+    printf("realloc in place %u/%u\n", stat[1].in_place, stat[1].count);
+    printf("minimum free %u bytes, fragmentation max %.3f end %.3f (free %u largest %u)\n",
+           (unsigned)g_heap_region[0].min_free_bytes, frag_max, frag, (unsigned)free_bytes, (unsigned)largest);
+
+    free(ops);
+
+    for (int i = 0; i < HEAP_HIST_NUM; i++)
+        free_blocks_hist += info.free_blocks_hist[i];
+
+    printf("free blocks %u, allocated blocks %u, fragmentation index %u%%\n",
+           (unsigned)info.free_blocks, (unsigned)info.allocated_blocks, (unsigned)info.fragmentation);
+
+    if (free_bytes != info.total_free_bytes || free_blocks != info.free_blocks || free_blocks != free_blocks_hist
+        || largest != info.largest_free_block + MEM_HEAD_SIZE) {
+        printf("heap corrupted: block chain has %u free bytes in %u blocks, largest %u\n",
+               (unsigned)free_bytes, (unsigned)free_blocks, (unsigned)largest);
+        return 1;
+    }
+
+    return 0;
+}
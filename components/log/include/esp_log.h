@@ -65,6 +65,31 @@ void esp_log_level_set(const char* tag, esp_log_level_t level);
 #define esp_log_level_set(tag, level)
 #endif /* CONFIG_LOG_SET_LEVEL */
 
+#ifdef CONFIG_LOG_BINARY
+/**
+ * @brief Output format of log entries
+ */
+typedef enum {
+    ESP_LOG_MODE_TEXT = 0,  /*!< Entries are formatted into text lines on the device */
+    ESP_LOG_MODE_BINARY,    /*!< Entries are written as binary records, to be decoded by tools/log_decode.py */
+} esp_log_mode_t;
+
+/**
+ * @brief Set output format for given tag
+ *
+ * Binary records hold the addresses of the tag and of the format string, so they
+ * can only be used for tags and formats which are string literals.
+ *
+ * @param tag Tag of the log entries. Must be a non-NULL zero terminated string.
+ *            Value "*" sets the format of all tags.
+ *
+ * @param mode Output format of the log entries with this tag.
+ */
+void esp_log_mode_set(const char* tag, esp_log_mode_t mode);
+#else
+#define esp_log_mode_set(tag, mode)
+#endif /* CONFIG_LOG_BINARY */
+
 /**
  * @brief Set function used to output log entries
  *
@@ -78,6 +103,32 @@ void esp_log_level_set(const char* tag, esp_log_level_t level);
  */
 putchar_like_t esp_log_set_putchar(putchar_like_t func);
 
+#ifdef CONFIG_LOG_ASYNC
+/**
+ * @brief Statistics of the asynchronous log output
+ */
+typedef struct {
+    uint32_t lines;         /*!< Lines queued for output */
+    uint32_t dropped;       /*!< Lines dropped because the buffer was full */
+    uint32_t truncated;     /*!< Lines cut to CONFIG_LOG_LINE_MAX characters */
+    uint32_t high_water;    /*!< Maximum number of bytes waiting in the buffer */
+} esp_log_async_stats_t;
+
+/**
+ * @brief Get statistics of the asynchronous log output
+ *
+ * @param stats Filled with the counters since startup
+ */
+void esp_log_async_get_stats(esp_log_async_stats_t *stats);
+
+/**
+ * @brief Write all queued log lines to the output from the calling task
+ *
+ * Can be used before a restart, so that the last lines are not lost.
+ */
+void esp_log_async_flush(void);
+#endif /* CONFIG_LOG_ASYNC */
+
 /**
  * @brief Function which returns timestamp to be used in log output
  *
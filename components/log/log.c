@@ -20,6 +20,7 @@
 #include <string.h>
 #include <sys/queue.h>
 #include <sys/lock.h>
+#include <sys/param.h>
 
 #include "esp_libc.h"
 #include "esp_attr.h"
@@ -31,6 +32,9 @@
 
 #ifndef BOOTLOADER_BUILD
 #include "FreeRTOS.h"
+#ifdef CONFIG_LOG_ASYNC
+#include "task.h"
+#endif
 #endif
 
 #ifdef CONFIG_LOG_COLORS
@@ -86,12 +90,140 @@ typedef struct uncached_tag_entry_{
 
 static esp_log_level_t s_global_tag_level = ESP_LOG_VERBOSE;
 static SLIST_HEAD(log_tags_head , uncached_tag_entry_) s_log_uncached_tags = SLIST_HEAD_INITIALIZER(s_log_uncached_tags);
-static uncached_tag_entry_t *s_uncached_tag_entry_prev;
 #endif /* CONFIG_LOG_SET_LEVEL */
 
+#ifdef CONFIG_LOG_BINARY
+#define LOG_BINARY_MARKER       0xff            // first byte of a binary record, text lines never start with it
+#define LOG_BINARY_RECORD_MAX   (2 + UINT8_MAX) // marker, length and up to 255 bytes
+
+typedef struct tag_mode_entry_ {
+    SLIST_ENTRY(tag_mode_entry_) entries;
+    uint8_t mode;   // esp_log_mode_t as uint8_t
+    char tag[0];    // beginning of a zero-terminated string
+} tag_mode_entry_t;
+
+static esp_log_mode_t s_global_tag_mode = ESP_LOG_MODE_TEXT;
+static SLIST_HEAD(log_mode_tags_head, tag_mode_entry_) s_log_mode_tags = SLIST_HEAD_INITIALIZER(s_log_mode_tags);
+#endif /* CONFIG_LOG_BINARY */
+
+#if defined(CONFIG_LOG_SET_LEVEL) || defined(CONFIG_LOG_BINARY)
+#define LOG_TAG_CACHE
+
+#if CONFIG_LOG_TAG_CACHE_SIZE & (CONFIG_LOG_TAG_CACHE_SIZE - 1)
+#error "CONFIG_LOG_TAG_CACHE_SIZE must be a power of two"
+#endif
+
+#define LOG_TAG_CACHE_WAYS      2
+#define LOG_TAG_CACHE_SETS      (CONFIG_LOG_TAG_CACHE_SIZE / LOG_TAG_CACHE_WAYS)
+#define LOG_TAG_CACHE_GEN_MASK  0xffffff
+
+// settings of a tag: generation of the cache, output format and level
+#define LOG_SETTINGS(gen, mode, level)  (((gen) << 8) | ((mode) << 4) | (level))
+#define LOG_SETTINGS_GEN(s)             ((s) >> 8)
+#define LOG_SETTINGS_MODE(s)            (((s) >> 4) & 0xf)
+#define LOG_SETTINGS_LEVEL(s)           ((esp_log_level_t)((s) & 0xf))
+
+/*
+ * Entries are written under s_lock and read without it. seq is odd while an entry
+ * changes, a reader which sees the same even seq before and after reading the tag
+ * and the settings got a consistent copy.
+ */
+typedef struct {
+    volatile uint32_t seq;
+    const char *volatile tag;
+    volatile uint32_t settings;
+} tag_cache_entry_t;
+
+static tag_cache_entry_t s_tag_cache[CONFIG_LOG_TAG_CACHE_SIZE];
+static volatile uint32_t s_tag_cache_gen = 1;  // settings of other generations are stale
+#endif /* CONFIG_LOG_SET_LEVEL || CONFIG_LOG_BINARY */
+
 static _lock_t s_lock;
 static putchar_like_t s_putchar_func = &putchar;
 
+#ifdef CONFIG_LOG_ASYNC
+static char s_async_buf[CONFIG_LOG_ASYNC_BUFFER_SIZE];
+static size_t s_async_read;             // offset of the oldest queued byte
+static size_t s_async_count;            // number of queued bytes
+static esp_log_async_stats_t s_async_stats;
+static uint32_t s_async_dropped_reported;
+static TaskHandle_t s_async_task;
+static bool s_async_starting;
+#endif
+
+#ifdef LOG_TAG_CACHE
+static inline tag_cache_entry_t *esp_log_tag_cache_set(const char *tag)
+{
+    // multiplicative hash of the address, the low bits of string addresses are poorly distributed
+    uint32_t hash = ((uint32_t)(uintptr_t)tag * 2654435761U) >> 16;
+
+    return &s_tag_cache[(hash % LOG_TAG_CACHE_SETS) * LOG_TAG_CACHE_WAYS];
+}
+
+/**
+ * @brief look up the settings of a tag by its address, without taking s_lock
+ */
+static inline bool esp_log_tag_cache_get(const char *tag, uint32_t *settings)
+{
+    tag_cache_entry_t *set = esp_log_tag_cache_set(tag);
+    const uint32_t gen = s_tag_cache_gen;
+
+    for (int i = 0; i < LOG_TAG_CACHE_WAYS; i++) {
+        const uint32_t seq = set[i].seq;
+        uint32_t value;
+
+        if (set[i].tag != tag)
+            continue;
+
+        value = set[i].settings;
+        if ((seq & 1) || set[i].seq != seq || LOG_SETTINGS_GEN(value) != gen)
+            continue;
+
+        *settings = value;
+        return true;
+    }
+
+    return false;
+}
+
+static void esp_log_tag_cache_write(tag_cache_entry_t *entry, const char *tag, uint32_t settings)
+{
+    entry->seq++;
+    entry->tag = tag;
+    entry->settings = settings;
+    entry->seq++;
+}
+
+/**
+ * @brief add the settings of a tag, called with s_lock held
+ */
+static void esp_log_tag_cache_put(const char *tag, uint32_t settings)
+{
+    tag_cache_entry_t *set = esp_log_tag_cache_set(tag);
+
+    // the tag added last goes to the first way, the one of the last way is evicted
+    for (int i = LOG_TAG_CACHE_WAYS - 1; i > 0; i--)
+        esp_log_tag_cache_write(&set[i], set[i - 1].tag, set[i - 1].settings);
+    esp_log_tag_cache_write(&set[0], tag, settings);
+}
+
+/**
+ * @brief make all cached settings stale, called with s_lock held
+ */
+static void esp_log_tag_cache_invalidate(void)
+{
+    uint32_t gen = (s_tag_cache_gen + 1) & LOG_TAG_CACHE_GEN_MASK;
+
+    if (!gen) {
+        // entries which were not touched since the generation wrapped around would look valid
+        for (int i = 0; i < CONFIG_LOG_TAG_CACHE_SIZE; i++)
+            esp_log_tag_cache_write(&s_tag_cache[i], NULL, 0);
+        gen = 1;
+    }
+    s_tag_cache_gen = gen;
+}
+#endif /* LOG_TAG_CACHE */
+
 #ifdef CONFIG_LOG_SET_LEVEL
 /**
  * @brief get entry by inputting tag
@@ -114,39 +246,25 @@ static bool esp_log_get_tag_entry(const char *tag, uncached_tag_entry_t **entry)
 
 static void clear_log_level_list(void)
 {
-    uncached_tag_entry_t *it = NULL;
+    uncached_tag_entry_t *it;
 
-    SLIST_FOREACH(it, &s_log_uncached_tags, entries) {
-        SLIST_REMOVE(&s_log_uncached_tags, it, uncached_tag_entry_, entries);
+    while ((it = SLIST_FIRST(&s_log_uncached_tags)) != NULL) {
+        SLIST_REMOVE_HEAD(&s_log_uncached_tags, entries);
         free(it);
     }
 }
 
 /**
- * @brief get level by inputting tag
+ * @brief get level by inputting tag, called with s_lock held
  */
 static esp_log_level_t esp_log_get_level(const char *tag)
 {
-    esp_log_level_t out_level;
     uncached_tag_entry_t *entry;
 
-    _lock_acquire_recursive(&s_lock);
-
-    if (s_uncached_tag_entry_prev && !strcmp(s_uncached_tag_entry_prev->tag, tag)) {
-        out_level = (esp_log_level_t)s_uncached_tag_entry_prev->level;
-        goto exit;
-    }
+    if (esp_log_get_tag_entry(tag, &entry) == true)
+        return (esp_log_level_t)entry->level;
 
-    if (esp_log_get_tag_entry(tag, &entry) == true) {
-        out_level = (esp_log_level_t)entry->level;
-        s_uncached_tag_entry_prev = entry;
-        goto exit;
-    } else
-        out_level = s_global_tag_level;
-
-exit:
-    _lock_release_recursive(&s_lock);
-    return out_level;
+    return s_global_tag_level;
 }
 
 /**
@@ -190,21 +308,438 @@ void esp_log_level_set(const char *tag, esp_log_level_t level)
     SLIST_INSERT_HEAD(&s_log_uncached_tags, new_entry, entries);
 
 exit:
+    esp_log_tag_cache_invalidate();
     _lock_release_recursive(&s_lock);
 }
 #endif /* CONFIG_LOG_SET_LEVEL */
 
-static int esp_log_write_str(const char *s)
+#ifdef CONFIG_LOG_BINARY
+static tag_mode_entry_t *esp_log_get_mode_entry(const char *tag)
 {
-    int ret;
+    tag_mode_entry_t *it;
+
+    SLIST_FOREACH(it, &s_log_mode_tags, entries) {
+        if (!strcmp(it->tag, tag))
+            return it;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief get output format by inputting tag, called with s_lock held
+ */
+static esp_log_mode_t esp_log_get_mode(const char *tag)
+{
+    tag_mode_entry_t *entry = esp_log_get_mode_entry(tag);
+
+    return entry ? (esp_log_mode_t)entry->mode : s_global_tag_mode;
+}
+
+/**
+ * @brief set output format for given tag
+ */
+void esp_log_mode_set(const char *tag, esp_log_mode_t mode)
+{
+    size_t bytes;
+    tag_mode_entry_t *entry;
+
+    _lock_acquire_recursive(&s_lock);
+
+    if (!strcmp(tag, "*")) {
+        s_global_tag_mode = mode;
+        while ((entry = SLIST_FIRST(&s_log_mode_tags)) != NULL) {
+            SLIST_REMOVE_HEAD(&s_log_mode_tags, entries);
+            free(entry);
+        }
+        goto exit;
+    }
+
+    entry = esp_log_get_mode_entry(tag);
+    if (entry) {
+        entry->mode = mode;
+        goto exit;
+    }
+
+    bytes = strlen(tag) + 1;
+
+    entry = malloc(sizeof(tag_mode_entry_t) + bytes);
+    if (!entry)
+        goto exit;
+
+    entry->mode = mode;
+    memcpy(entry->tag, tag, bytes);
+
+    SLIST_INSERT_HEAD(&s_log_mode_tags, entry, entries);
+
+exit:
+    esp_log_tag_cache_invalidate();
+    _lock_release_recursive(&s_lock);
+}
+
+static inline uint8_t *esp_log_binary_put(uint8_t *p, const uint8_t *end, const void *data, size_t len)
+{
+    if (!p || len > (size_t)(end - p))
+        return NULL;
+
+    memcpy(p, data, len);
+
+    return p + len;
+}
+
+static inline uint8_t *esp_log_binary_put_u32(uint8_t *p, const uint8_t *end, uint32_t value)
+{
+    const uint8_t data[4] = { value, value >> 8, value >> 16, value >> 24 };
+
+    return esp_log_binary_put(p, end, data, sizeof(data));
+}
+
+static inline uint8_t *esp_log_binary_put_u64(uint8_t *p, const uint8_t *end, uint64_t value)
+{
+    p = esp_log_binary_put_u32(p, end, (uint32_t)value);
+
+    return esp_log_binary_put_u32(p, end, (uint32_t)(value >> 32));
+}
+
+/**
+ * @brief Encode a log entry as binary record
+ *
+ * The record is: 0xff, the length of the rest of the record, the level, then the timestamp
+ * and the addresses of the tag and of the format as 32 bit values and the arguments. Integers
+ * and pointers take 4 bytes, or 8 bytes for long long, doubles take 8 bytes and strings a
+ * length byte followed by up to CONFIG_LOG_BINARY_STRING_MAX characters. All values are little
+ * endian. The arguments which don't fit into the record are left out.
+ *
+ * @return the length of the record
+ */
+static size_t esp_log_binary_format(uint8_t *buf, esp_log_level_t level, const char *tag, const char *fmt, va_list va)
+{
+    const uint8_t *end = buf + LOG_BINARY_RECORD_MAX;
+    uint8_t *p = buf + 2, *next;
+
+    buf[0] = LOG_BINARY_MARKER;
+    *p++ = level;
+    p = esp_log_binary_put_u32(p, end, esp_log_early_timestamp());
+    p = esp_log_binary_put_u32(p, end, (uint32_t)(uintptr_t)tag);
+    p = esp_log_binary_put_u32(p, end, (uint32_t)(uintptr_t)fmt);
+
+    for (const char *f = fmt; *f; f++) {
+        int longs = 0;
+        bool size_arg = false, long_double = false;
+        size_t precision = CONFIG_LOG_BINARY_STRING_MAX;
+
+        if (*f != '%')
+            continue;
+        if (*++f == '%')
+            continue;
+
+        next = p;
+        while (*f && strchr("-+ #0", *f))
+            f++;
+
+        // width and precision passed as arguments are part of the record
+        if (*f == '*') {
+            next = esp_log_binary_put_u32(next, end, va_arg(va, int));
+            f++;
+        } else {
+            while (*f >= '0' && *f <= '9')
+                f++;
+        }
+        if (*f == '.') {
+            f++;
+            if (*f == '*') {
+                int arg = va_arg(va, int);
+
+                next = esp_log_binary_put_u32(next, end, arg);
+                if (arg >= 0)
+                    precision = MIN(precision, (size_t)arg);
+                f++;
+            } else {
+                precision = 0;
+                while (*f >= '0' && *f <= '9') {
+                    precision = MIN(precision * 10 + *f - '0', CONFIG_LOG_BINARY_STRING_MAX);
+                    f++;
+                }
+            }
+        }
+
+        for (; *f && strchr("hlLqjzt", *f); f++) {
+            if (*f == 'l')
+                longs++;
+            else if (*f == 'q' || *f == 'j')
+                longs = 2;
+            else if (*f == 'z' || *f == 't')
+                size_arg = true;
+            else if (*f == 'L')
+                long_double = true;
+        }
+
+        switch (*f) {
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+            if (longs >= 2)
+                next = esp_log_binary_put_u64(next, end, va_arg(va, unsigned long long));
+            else if (longs == 1)
+                next = esp_log_binary_put_u32(next, end, va_arg(va, unsigned long));
+            else if (size_arg)
+                next = esp_log_binary_put_u32(next, end, va_arg(va, size_t));
+            else
+                next = esp_log_binary_put_u32(next, end, va_arg(va, unsigned int));
+            break;
+        case 'p':
+            next = esp_log_binary_put_u32(next, end, (uint32_t)(uintptr_t)va_arg(va, void *));
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+            union {
+                double d;
+                uint64_t u;
+            } value;
+
+            value.d = long_double ? (double)va_arg(va, long double) : va_arg(va, double);
+            next = esp_log_binary_put_u64(next, end, value.u);
+            break;
+        }
+        case 's': {
+            const char *str = va_arg(va, const char *);
+            uint8_t len;
+
+            if (!str)
+                str = "(null)";
+            len = strnlen(str, precision);
+            next = esp_log_binary_put(next, end, &len, 1);
+            next = esp_log_binary_put(next, end, str, len);
+            break;
+        }
+        case 'n':
+            (void)va_arg(va, void *);
+            break;
+        default:
+            // the types of the remaining arguments are unknown
+            next = NULL;
+            break;
+        }
+
+        if (!next)
+            break;
+        p = next;
+    }
 
-    do {
-        ret = s_putchar_func(*s);
-    } while (ret != EOF && *++s);
+    buf[1] = p - buf - 2;
+
+    return p - buf;
+}
+#endif /* CONFIG_LOG_BINARY */
+
+#ifdef LOG_TAG_CACHE
+/**
+ * @brief get level and output format of a tag
+ *
+ * Tags are found in the cache by their address, other copies of a tag string are
+ * resolved by comparing them with the configured tags and then cached as well.
+ */
+static uint32_t esp_log_get_settings(const char *tag)
+{
+    uint32_t settings;
+    esp_log_level_t level = ESP_LOG_VERBOSE;
+    uint32_t mode = 0;
+
+    if (esp_log_tag_cache_get(tag, &settings))
+        return settings;
+
+    _lock_acquire_recursive(&s_lock);
+#ifdef CONFIG_LOG_SET_LEVEL
+    level = esp_log_get_level(tag);
+#endif
+#ifdef CONFIG_LOG_BINARY
+    mode = esp_log_get_mode(tag);
+#endif
+    settings = LOG_SETTINGS(s_tag_cache_gen, mode, level);
+    esp_log_tag_cache_put(tag, settings);
+    _lock_release_recursive(&s_lock);
+
+    return settings;
+}
+#endif /* LOG_TAG_CACHE */
+
+static int esp_log_write_buf(const char *s, size_t len)
+{
+    int ret = 0;
+
+    for (size_t i = 0; i < len && ret != EOF; i++)
+        ret = s_putchar_func((unsigned char)s[i]);
 
     return ret;
 }
 
+/**
+ * @brief Format a log line including its prefix, colors and newline
+ *
+ * The line is cut to fit into buf, but always ends with the newline.
+ *
+ * @return the length of the complete line, larger than size - 1 if the line was cut
+ */
+static size_t esp_log_format(char *buf, size_t size, esp_log_level_t level, const char *tag, const char *fmt, va_list va)
+{
+    int ret;
+    size_t len = 0, full_len;
+    char prefix = level >= ESP_LOG_MAX ? 'N' : s_log_prefix[level];
+    const char *end = "\n";
+#ifdef CONFIG_LOG_COLORS
+    uint32_t color = level >= ESP_LOG_MAX ? 0 : s_log_color[level];
+
+    if (color) {
+        end = LOG_COLOR_END "\n";
+        len = sprintf(buf, LOG_COLOR_HEAD, color);
+    }
+#endif
+    const size_t end_len = strlen(end);
+    const size_t max = size - end_len - 1;  // room for the text of the line
+
+    ret = snprintf(buf + len, max + 1 - len, "%c (%d) %s: ", prefix, esp_log_early_timestamp(), tag);
+    len += ret > 0 ? ret : 0;
+    full_len = len;
+    len = MIN(len, max);
+
+    ret = vsnprintf(buf + len, max + 1 - len, fmt, va);
+    full_len += ret > 0 ? ret : 0;
+    len = MIN(full_len, max);
+
+    memcpy(buf + len, end, end_len + 1);
+
+    return full_len + end_len;
+}
+
+#ifdef CONFIG_LOG_ASYNC
+static void esp_log_async_drain(void)
+{
+    uint32_t dropped;
+
+    _lock_acquire_recursive(&s_lock);
+
+    /*
+     * Only the bytes counted in s_async_count are read, writers append after them,
+     * so the buffer is written out without blocking the writers.
+     */
+    while (1) {
+        size_t read, chunk;
+
+        taskENTER_CRITICAL();
+        read = s_async_read;
+        chunk = MIN(s_async_count, sizeof(s_async_buf) - read);
+        dropped = s_async_stats.dropped;
+        taskEXIT_CRITICAL();
+
+        if (!chunk)
+            break;
+
+        esp_log_write_buf(s_async_buf + read, chunk);
+
+        taskENTER_CRITICAL();
+        s_async_read = (read + chunk) % sizeof(s_async_buf);
+        s_async_count -= chunk;
+        taskEXIT_CRITICAL();
+    }
+
+    if (dropped != s_async_dropped_reported) {
+        char buf[48];
+        int len = snprintf(buf, sizeof(buf), "W (%d) log: %u lines dropped\n",
+                           esp_log_early_timestamp(), (unsigned)(dropped - s_async_dropped_reported));
+
+        esp_log_write_buf(buf, len);
+        s_async_dropped_reported = dropped;
+    }
+
+    _lock_release_recursive(&s_lock);
+}
+
+static void esp_log_async_task(void *arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        esp_log_async_drain();
+    }
+}
+
+/**
+ * @brief Create the task writing the log output when the first line is logged
+ */
+static bool esp_log_async_start(void)
+{
+    bool start;
+    TaskHandle_t task;
+
+    taskENTER_CRITICAL();
+    start = !s_async_starting;
+    s_async_starting = true;
+    taskEXIT_CRITICAL();
+
+    if (!start)
+        return s_async_task != NULL;
+
+    if (xTaskCreate(esp_log_async_task, "log", CONFIG_LOG_ASYNC_TASK_STACK_SIZE, NULL,
+                    CONFIG_LOG_ASYNC_TASK_PRIORITY, &task) != pdPASS) {
+        s_async_starting = false;
+        return false;
+    }
+    s_async_task = task;
+
+    return true;
+}
+
+/**
+ * @brief Queue a formatted line for the log task
+ *
+ * @return false if the log task is not running, then the line has to be written directly
+ */
+static bool esp_log_async_write(const char *line, size_t len)
+{
+    bool wake;
+
+    if (!s_async_task && !esp_log_async_start())
+        return false;
+
+    taskENTER_CRITICAL();
+    // The log task drains until the buffer is empty, so it only has to be woken up by the first line
+    wake = s_async_count == 0;
+    if (len <= sizeof(s_async_buf) - s_async_count) {
+        size_t write = (s_async_read + s_async_count) % sizeof(s_async_buf);
+        size_t first = MIN(len, sizeof(s_async_buf) - write);
+
+        memcpy(s_async_buf + write, line, first);
+        memcpy(s_async_buf, line + first, len - first);
+        s_async_count += len;
+        s_async_stats.lines++;
+        if (s_async_count > s_async_stats.high_water)
+            s_async_stats.high_water = s_async_count;
+    } else {
+        s_async_stats.dropped++;
+    }
+    taskEXIT_CRITICAL();
+
+    if (wake)
+        xTaskNotifyGive(s_async_task);
+
+    return true;
+}
+
+/**
+ * @brief Get statistics of the asynchronous log output
+ */
+void esp_log_async_get_stats(esp_log_async_stats_t *stats)
+{
+    taskENTER_CRITICAL();
+    *stats = s_async_stats;
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief Write all queued log lines to the output from the calling task
+ */
+void esp_log_async_flush(void)
+{
+    esp_log_async_drain();
+}
+#endif /* CONFIG_LOG_ASYNC */
+
 #endif
 
 /**
@@ -243,61 +778,73 @@ out:
  */
 void esp_log_write(esp_log_level_t level, const char *tag,  const char *fmt, ...)
 {
-    int ret;
     va_list va;
-    char *pbuf;
-    char prefix;
-
-    _lock_acquire_recursive(&s_lock);
+    size_t len;
+    char buf[CONFIG_LOG_LINE_MAX];
+    char *pbuf = buf;
+#ifdef LOG_TAG_CACHE
+    const uint32_t settings = esp_log_get_settings(tag);
+#endif
 
 #ifdef CONFIG_LOG_SET_LEVEL
-    if (!should_output(level, esp_log_get_level(tag)))
-        goto exit;
+    if (!should_output(level, LOG_SETTINGS_LEVEL(settings)))
+        return;
 #endif
 
-#ifdef CONFIG_LOG_COLORS
-    static char buf[16];
-    uint32_t color = level >= ESP_LOG_MAX ? 0 : s_log_color[level];
+#ifdef CONFIG_LOG_BINARY
+    if (LOG_SETTINGS_MODE(settings) == ESP_LOG_MODE_BINARY) {
+        uint8_t record[LOG_BINARY_RECORD_MAX];
 
-    if (color) {
-        sprintf(buf, LOG_COLOR_HEAD, color);
-        ret = esp_log_write_str(buf);
-        if (ret == EOF)
-            goto exit;
+        va_start(va, fmt);
+        len = esp_log_binary_format(record, level, tag, fmt, va);
+        va_end(va);
+
+#ifdef CONFIG_LOG_ASYNC
+        if (esp_log_async_write((const char *)record, len))
+            return;
+#endif
+        _lock_acquire_recursive(&s_lock);
+        esp_log_write_buf((const char *)record, len);
+        _lock_release_recursive(&s_lock);
+        return;
     }
 #endif
-    prefix = level >= ESP_LOG_MAX ? 'N' : s_log_prefix[level];
-    ret = asprintf(&pbuf, "%c (%d) %s: ", prefix, esp_log_early_timestamp(), tag);
-    if (ret < 0)
-        goto out;
-    ret = esp_log_write_str(pbuf);
-    free(pbuf);
-    if (ret == EOF)
-        goto exit;
 
     va_start(va, fmt);
-    ret = vasprintf(&pbuf, fmt, va);
+    len = esp_log_format(buf, sizeof(buf), level, tag, fmt, va);
     va_end(va);
-    if (ret < 0)
-        goto out;
-    ret = esp_log_write_str(pbuf);
-    free(pbuf);
-    if (ret == EOF)
-        goto exit;
 
-out:
-#ifdef CONFIG_LOG_COLORS
-    if (color) {
-        ret = esp_log_write_str(LOG_COLOR_END);
-        if (ret == EOF)
-            goto exit;
+#ifdef CONFIG_LOG_ASYNC
+    if (len >= sizeof(buf)) {
+        taskENTER_CRITICAL();
+        s_async_stats.truncated++;
+        taskEXIT_CRITICAL();
     }
+    if (esp_log_async_write(buf, MIN(len, sizeof(buf) - 1)))
+        return;
 #endif
-    if (ret > 0)
-        s_putchar_func('\n');
 
-exit:
+    if (len >= sizeof(buf)) {
+        // The line was cut, format it again into a buffer which is large enough (the timestamp may have grown)
+        const size_t size = len + 16;
+
+        pbuf = malloc(size);
+        if (pbuf) {
+            va_start(va, fmt);
+            len = MIN(esp_log_format(pbuf, size, level, tag, fmt, va), size - 1);
+            va_end(va);
+        } else {
+            pbuf = buf;
+            len = sizeof(buf) - 1;
+        }
+    }
+
+    _lock_acquire_recursive(&s_lock);
+    esp_log_write_buf(pbuf, len);
     _lock_release_recursive(&s_lock);
+
+    if (pbuf != buf)
+        free(pbuf);
 }
 
 /**
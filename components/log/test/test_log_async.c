@@ -0,0 +1,68 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <unity.h>
+#include "esp_log.h"
+
+#ifdef CONFIG_LOG_ASYNC
+
+static char s_output[512];
+static size_t s_output_len;
+
+static int capture_putchar(int ch)
+{
+    if (s_output_len < sizeof(s_output) - 1)
+        s_output[s_output_len++] = ch;
+
+    return ch;
+}
+
+TEST_CASE("Test async log output", "[log]")
+{
+    esp_log_async_stats_t before, after;
+    putchar_like_t old_func;
+    char line[CONFIG_LOG_LINE_MAX + 32];
+
+    esp_log_async_flush();
+    esp_log_async_get_stats(&before);
+
+    memset(s_output, 0, sizeof(s_output));
+    s_output_len = 0;
+    old_func = esp_log_set_putchar(capture_putchar);
+
+    ESP_LOGE("async", "line %d", 1);
+    ESP_LOGE("async", "line %d", 2);
+
+    // A line longer than CONFIG_LOG_LINE_MAX is cut but still ends with a newline
+    memset(line, 'x', sizeof(line) - 1);
+    line[sizeof(line) - 1] = '\0';
+    ESP_LOGE("async", "%s", line);
+
+    esp_log_async_flush();
+    esp_log_set_putchar(old_func);
+    esp_log_async_get_stats(&after);
+
+    TEST_ASSERT_NOT_NULL(strstr(s_output, "async: line 1"));
+    TEST_ASSERT_NOT_NULL(strstr(s_output, "async: line 2"));
+    TEST_ASSERT_TRUE(strstr(s_output, "async: line 1") < strstr(s_output, "async: line 2"));
+    TEST_ASSERT_EQUAL('\n', s_output[s_output_len - 1]);
+    TEST_ASSERT_EQUAL(3, after.lines - before.lines);
+    TEST_ASSERT_EQUAL(1, after.truncated - before.truncated);
+    TEST_ASSERT_EQUAL(0, after.dropped - before.dropped);
+}
+
+#endif /* CONFIG_LOG_ASYNC */
@@ -0,0 +1,76 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <unity.h>
+#include "esp_log.h"
+
+#ifdef CONFIG_LOG_BINARY
+
+static uint8_t s_output[512];
+static size_t s_output_len;
+
+static int capture_putchar(int ch)
+{
+    if (s_output_len < sizeof(s_output) - 1)
+        s_output[s_output_len++] = ch;
+
+    return ch;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+TEST_CASE("Test binary log records", "[log]")
+{
+    static const char tag[] = "binary";
+    static const char fmt[] = "%d %s";
+    putchar_like_t old_func;
+    const uint8_t *text;
+
+    memset(s_output, 0, sizeof(s_output));
+    s_output_len = 0;
+    old_func = esp_log_set_putchar(capture_putchar);
+
+    esp_log_mode_set(tag, ESP_LOG_MODE_BINARY);
+    esp_log_write(ESP_LOG_ERROR, tag, fmt, -2, "abc");
+    esp_log_mode_set(tag, ESP_LOG_MODE_TEXT);
+    esp_log_write(ESP_LOG_ERROR, tag, fmt, 3, "def");
+
+#ifdef CONFIG_LOG_ASYNC
+    esp_log_async_flush();
+#endif
+    esp_log_set_putchar(old_func);
+
+    // marker, length, level, timestamp, tag, format, int and string arguments
+    TEST_ASSERT_EQUAL_HEX8(0xff, s_output[0]);
+    TEST_ASSERT_EQUAL(13 + 4 + 4, s_output[1]);
+    TEST_ASSERT_EQUAL(ESP_LOG_ERROR, s_output[2]);
+    TEST_ASSERT_EQUAL_HEX32((uint32_t)tag, get_u32(s_output + 7));
+    TEST_ASSERT_EQUAL_HEX32((uint32_t)fmt, get_u32(s_output + 11));
+    TEST_ASSERT_EQUAL_HEX32(-2, get_u32(s_output + 15));
+    TEST_ASSERT_EQUAL(3, s_output[19]);
+    TEST_ASSERT_EQUAL_MEMORY("abc", s_output + 20, 3);
+
+    // the same tag in text mode again
+    text = s_output + 23;
+    TEST_ASSERT_TRUE(s_output_len > 23);
+    TEST_ASSERT_NOT_NULL(strstr((const char *)text, "binary: 3 def"));
+}
+
+#endif /* CONFIG_LOG_BINARY */
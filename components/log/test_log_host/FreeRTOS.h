@@ -0,0 +1,19 @@
+// Host build stub of FreeRTOS.h, tasks are threads and critical sections take a mutex
+#pragma once
+
+#include <stdint.h>
+
+typedef long BaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE ((BaseType_t)1)
+#define pdPASS pdTRUE
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+
+extern uint32_t g_esp_ticks_per_us;
+
+void host_critical_enter(void);
+void host_critical_exit(void);
+
+#define taskENTER_CRITICAL() host_critical_enter()
+#define taskEXIT_CRITICAL() host_critical_exit()
@@ -0,0 +1,4 @@
+// Host build stub of esp_attr.h, code placement attributes have no meaning on the host
+#pragma once
+
+#define IRAM_ATTR
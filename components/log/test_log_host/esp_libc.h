@@ -0,0 +1,2 @@
+// Host build stub of esp_libc.h, the C library of the host is used
+#pragma once
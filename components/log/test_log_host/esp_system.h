@@ -0,0 +1,4 @@
+// Host build stub of esp_system.h
+#pragma once
+
+#define CRYSTAL_USED 26
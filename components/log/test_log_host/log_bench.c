@@ -0,0 +1,489 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Measure the lines per second written by several tasks logging bursts of lines at INFO
+ * level, with a pause of 1 ms after each burst, and the latency each call of esp_log_write()
+ * has for its caller. The output goes to a sink which costs nothing, and to one which
+ * spins for every character like a slow UART.
+ *
+ * log_bench_sync also runs a copy of the former esp_log_write(), which allocated the
+ * prefix and the message and wrote them character by character under the lock.
+ *
+ * log_bench_binary compares text lines with binary records, which also take fewer bytes
+ * on the output. "log_bench_binary dump text|binary" writes lines with many kinds of
+ * arguments to stdout, "make check" decodes the binary ones with tools/log_decode.py
+ * and compares them with the text ones.
+ *
+ * log_bench_tags sets the level of 50 tags and measures the cost of suppressed lines,
+ * with the tag cache and with a copy of the former lookup, which compared the tag with
+ * the last one found and then with every configured tag under the lock.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "sys/lock.h"
+#include "esp_log.h"
+
+#define BENCH_TASKS         4
+#define BENCH_LINES         20000
+#define BENCH_BURST         20
+#define BENCH_SLOW_SPIN     40
+
+static const char *TAG = "bench";
+
+uint64_t g_esp_os_us;
+uint32_t g_esp_boot_ccount;
+uint32_t g_esp_ticks_per_us = 80;
+
+/* ------------------------------------ FreeRTOS and lock stubs ------------------------------------ */
+
+static pthread_mutex_t s_critical = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t s_lock_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+struct host_task {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint32_t notified;
+    TaskFunction_t func;
+    void *arg;
+};
+
+static __thread struct host_task *s_current_task;
+
+void host_critical_enter(void)
+{
+    pthread_mutex_lock(&s_critical);
+}
+
+void host_critical_exit(void)
+{
+    pthread_mutex_unlock(&s_critical);
+}
+
+void _lock_acquire_recursive(_lock_t *lock)
+{
+    pthread_mutex_lock(&s_lock_mutex);
+}
+
+void _lock_release_recursive(_lock_t *lock)
+{
+    pthread_mutex_unlock(&s_lock_mutex);
+}
+
+static void *host_task_main(void *arg)
+{
+    s_current_task = arg;
+    s_current_task->func(s_current_task->arg);
+
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t func, const char *name, uint32_t stack, void *arg, unsigned prio, TaskHandle_t *task)
+{
+    struct host_task *t = calloc(1, sizeof(*t));
+
+    pthread_mutex_init(&t->mutex, NULL);
+    pthread_cond_init(&t->cond, NULL);
+    t->func = func;
+    t->arg = arg;
+    *task = t;
+    pthread_create(&t->thread, NULL, host_task_main, t);
+
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    struct host_task *t = s_current_task;
+    uint32_t value;
+
+    pthread_mutex_lock(&t->mutex);
+    while (!t->notified) {
+        pthread_cond_wait(&t->cond, &t->mutex);
+    }
+    value = t->notified;
+    t->notified = clear ? 0 : value - 1;
+    pthread_mutex_unlock(&t->mutex);
+
+    return value;
+}
+
+void xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->mutex);
+    task->notified++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->mutex);
+}
+
+/* ------------------------------------------ Output sink ------------------------------------------ */
+
+static int s_sink_spin;
+static uint64_t s_sink_lines;
+static uint64_t s_sink_bytes;
+static int s_sink_record;       /* bytes left of a binary record, -1 before its length byte */
+static int s_sink_line_start = 1;
+
+static int bench_putchar(int ch)
+{
+    for (volatile int i = 0; i < s_sink_spin; i++) {
+    }
+    s_sink_bytes++;
+    if (s_sink_record < 0) {
+        s_sink_record = ch;
+    } else if (s_sink_record > 0) {
+        s_sink_record--;
+    } else if (s_sink_line_start && ch == 0xff) {
+        s_sink_record = -1;
+        return ch;
+    } else {
+        s_sink_line_start = ch == '\n';
+        if (ch == '\n') {
+            s_sink_lines++;
+        }
+        return ch;
+    }
+    if (s_sink_record == 0) {
+        s_sink_lines++;
+    }
+
+    return ch;
+}
+
+/* --------------------------------------- Former backend ----------------------------------------- */
+
+static int legacy_write_str(const char *s)
+{
+    int ret;
+
+    do {
+        ret = bench_putchar(*s);
+    } while (ret != EOF && *++s);
+
+    return ret;
+}
+
+static void legacy_log_write(esp_log_level_t level, const char *tag, const char *fmt, ...)
+{
+    int ret;
+    va_list va;
+    char *pbuf;
+
+    pthread_mutex_lock(&s_lock_mutex);
+
+    ret = asprintf(&pbuf, "%c (%d) %s: ", 'I', esp_log_early_timestamp(), tag);
+    if (ret < 0)
+        goto exit;
+    ret = legacy_write_str(pbuf);
+    free(pbuf);
+    if (ret == EOF)
+        goto exit;
+
+    va_start(va, fmt);
+    ret = vasprintf(&pbuf, fmt, va);
+    va_end(va);
+    if (ret < 0)
+        goto exit;
+    ret = legacy_write_str(pbuf);
+    free(pbuf);
+    if (ret > 0)
+        bench_putchar('\n');
+
+exit:
+    pthread_mutex_unlock(&s_lock_mutex);
+}
+
+#ifdef CONFIG_LOG_SET_LEVEL
+struct legacy_tag_entry {
+    struct legacy_tag_entry *next;
+    esp_log_level_t level;
+    char tag[12];
+};
+
+static struct legacy_tag_entry *s_legacy_tags;
+static struct legacy_tag_entry *s_legacy_tag_prev;
+
+static esp_log_level_t legacy_get_level(const char *tag)
+{
+    esp_log_level_t level = ESP_LOG_VERBOSE;
+
+    pthread_mutex_lock(&s_lock_mutex);
+    if (s_legacy_tag_prev && !strcmp(s_legacy_tag_prev->tag, tag)) {
+        level = s_legacy_tag_prev->level;
+    } else {
+        for (struct legacy_tag_entry *it = s_legacy_tags; it; it = it->next) {
+            if (!strcmp(it->tag, tag)) {
+                level = it->level;
+                s_legacy_tag_prev = it;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&s_lock_mutex);
+
+    return level;
+}
+#endif
+
+/* ------------------------------------------- Benchmark ------------------------------------------- */
+
+typedef struct {
+    int legacy;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint32_t histogram[64];     /* calls by log2 of their latency in ns */
+} bench_task_t;
+
+static inline uint64_t bench_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *bench_task(void *arg)
+{
+    bench_task_t *task = arg;
+
+    for (int i = 0; i < BENCH_LINES; i++) {
+        uint64_t start = bench_ns(), ns;
+
+        if (task->legacy) {
+            legacy_log_write(ESP_LOG_INFO, TAG, "publish topic sensors/%d qos %d len %d msg_id %d", i % 16, 1, 120 + i % 50, i);
+        } else {
+            ESP_LOGI(TAG, "publish topic sensors/%d qos %d len %d msg_id %d", i % 16, 1, 120 + i % 50, i);
+        }
+        ns = bench_ns() - start;
+        task->total_ns += ns;
+        if (ns > task->max_ns) {
+            task->max_ns = ns;
+        }
+        task->histogram[63 - __builtin_clzll(ns | 1)]++;
+
+        if (i % BENCH_BURST == BENCH_BURST - 1) {
+            const struct timespec pause = { .tv_nsec = 1000000 };
+
+            nanosleep(&pause, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+static void bench_run(const char *name, int legacy, int spin)
+{
+    pthread_t threads[BENCH_TASKS];
+    bench_task_t tasks[BENCH_TASKS];
+    uint32_t histogram[64] = { 0 };
+    uint64_t total_ns = 0, max_ns = 0, p99_ns = 0, start, elapsed;
+    uint64_t lines = (uint64_t)BENCH_TASKS * BENCH_LINES;
+    uint64_t dropped = 0;
+
+    s_sink_spin = spin;
+    s_sink_lines = 0;
+    s_sink_bytes = 0;
+#ifdef CONFIG_LOG_ASYNC
+    esp_log_async_stats_t before, after;
+
+    esp_log_async_get_stats(&before);
+#endif
+
+    memset(tasks, 0, sizeof(tasks));
+    start = bench_ns();
+    for (int i = 0; i < BENCH_TASKS; i++) {
+        tasks[i].legacy = legacy;
+        pthread_create(&threads[i], NULL, bench_task, &tasks[i]);
+    }
+    for (int i = 0; i < BENCH_TASKS; i++) {
+        pthread_join(threads[i], NULL);
+        total_ns += tasks[i].total_ns;
+        if (tasks[i].max_ns > max_ns) {
+            max_ns = tasks[i].max_ns;
+        }
+        for (int b = 0; b < 64; b++) {
+            histogram[b] += tasks[i].histogram[b];
+        }
+    }
+#ifdef CONFIG_LOG_ASYNC
+    esp_log_async_flush();
+    esp_log_async_get_stats(&after);
+    dropped = after.dropped - before.dropped;
+#endif
+    elapsed = bench_ns() - start;
+
+    for (uint64_t b = 0, calls = 0; b < 64; b++) {
+        calls += histogram[b];
+        if (calls * 100 >= lines * 99) {
+            p99_ns = 2ULL << b;
+            break;
+        }
+    }
+
+    printf("%-7s %-5s %10.0f %10.0f %10llu %10llu %10llu %8llu %6.1f\n", name, spin ? "slow" : "fast",
+           (double)s_sink_lines / ((double)elapsed / 1e9), (double)total_ns / lines,
+           (unsigned long long)p99_ns, (unsigned long long)max_ns,
+           (unsigned long long)(lines - s_sink_lines), (unsigned long long)dropped,
+           s_sink_lines ? (double)s_sink_bytes / s_sink_lines : 0.0);
+}
+
+#ifdef CONFIG_LOG_SET_LEVEL
+#define BENCH_TAGS          50
+#define BENCH_TAG_CALLS     2000000
+
+static char s_tags[BENCH_TAGS][12];
+
+static void *bench_tags_task(void *arg)
+{
+    int legacy = *(int *)arg;
+
+    for (int i = 0; i < BENCH_TAG_CALLS; i++) {
+        const char *tag = s_tags[i % BENCH_TAGS];
+
+        if (legacy) {
+            if (legacy_get_level(tag) >= ESP_LOG_INFO) {
+                legacy_log_write(ESP_LOG_INFO, tag, "suppressed %d", i);
+            }
+        } else {
+            esp_log_write(ESP_LOG_INFO, tag, "suppressed %d", i);
+        }
+    }
+
+    return NULL;
+}
+
+static void bench_tags_run(const char *name, int legacy, int num_tasks)
+{
+    pthread_t threads[BENCH_TASKS];
+    uint64_t start, elapsed;
+
+    s_sink_lines = 0;
+    start = bench_ns();
+    for (int i = 0; i < num_tasks; i++) {
+        pthread_create(&threads[i], NULL, bench_tags_task, &legacy);
+    }
+    for (int i = 0; i < num_tasks; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    elapsed = bench_ns() - start;
+
+    if (s_sink_lines) {
+        printf("%llu lines were not suppressed\n", (unsigned long long)s_sink_lines);
+        exit(1);
+    }
+    printf("%-7s %5d %10.1f\n", name, num_tasks, (double)elapsed / ((double)num_tasks * BENCH_TAG_CALLS));
+}
+
+static void bench_tags(void)
+{
+    char copy[12];
+
+    for (int i = 0; i < BENCH_TAGS; i++) {
+        struct legacy_tag_entry *entry = calloc(1, sizeof(*entry));
+
+        snprintf(s_tags[i], sizeof(s_tags[i]), "tag%02d", i);
+        esp_log_level_set(s_tags[i], ESP_LOG_WARN);
+        strcpy(entry->tag, s_tags[i]);
+        entry->level = ESP_LOG_WARN;
+        entry->next = s_legacy_tags;
+        s_legacy_tags = entry;
+    }
+
+    /* Another copy of a tag string is found by comparing it, a new level makes the cached one stale */
+    strcpy(copy, s_tags[7]);
+    esp_log_write(ESP_LOG_INFO, s_tags[7], "suppressed");
+    esp_log_write(ESP_LOG_INFO, copy, "suppressed");
+    esp_log_level_set(copy, ESP_LOG_INFO);
+    esp_log_write(ESP_LOG_INFO, s_tags[7], "written");
+    esp_log_level_set(s_tags[7], ESP_LOG_WARN);
+    esp_log_write(ESP_LOG_INFO, copy, "suppressed");
+    if (s_sink_lines != 1) {
+        printf("tag cache check failed, %llu lines written\n", (unsigned long long)s_sink_lines);
+        exit(1);
+    }
+
+    printf("%-7s %5s %10s\n", "lookup", "tasks", "ns/call");
+    for (int num_tasks = 1; num_tasks <= BENCH_TASKS; num_tasks *= BENCH_TASKS) {
+        bench_tags_run("legacy", 1, num_tasks);
+        bench_tags_run("cache", 0, num_tasks);
+    }
+}
+#endif
+
+#ifdef CONFIG_LOG_BINARY
+static const char s_dump_string[] = "binary";
+
+static void dump(void)
+{
+    const char *name = "sensor";
+
+    ESP_LOGI(TAG, "no arguments");
+    ESP_LOGI(TAG, "%d %i %u %x %08X %o %c", -42, 7, 3000000000u, 0xbeef, 0x1234, 8, 'z');
+    ESP_LOGW(TAG, "%hhd %hd %hhu %hu", (signed char)-5, (short)-300, (unsigned char)200, (unsigned short)60000);
+    ESP_LOGE(TAG, "%ld %lu %lld %llu %zu", -100000L, 100000UL, -5000000000LL, 18000000000000000000ULL, (size_t)77);
+    ESP_LOGI(TAG, "[%s] [%10s] [%-10s] [%.3s] [%.*s]", name, name, name, name, 2, name);
+    ESP_LOGI(TAG, "[%*d] [%-*d] [%+d] [% d] [%#x] [%#o]", 6, 42, 6, 42, 5, 5, 255, 8);
+    ESP_LOGI(TAG, "%f %.3f %e %g %10.2f", 3.5, 2.0 / 3, 12345.678, 0.0001, -1.25);
+    ESP_LOGI(TAG, "%p 100%% %s", (void *)s_dump_string, (const char *)NULL);
+#ifdef CONFIG_LOG_ASYNC
+    esp_log_async_flush();
+#endif
+}
+#endif
+
+int main(int argc, char **argv)
+{
+#ifdef CONFIG_LOG_BINARY
+    if (argc == 3 && !strcmp(argv[1], "dump")) {
+        esp_log_mode_set(TAG, strcmp(argv[2], "binary") ? ESP_LOG_MODE_TEXT : ESP_LOG_MODE_BINARY);
+        dump();
+        return 0;
+    }
+#endif
+
+    esp_log_set_putchar(bench_putchar);
+#ifdef CONFIG_LOG_SET_LEVEL
+    bench_tags();
+    return 0;
+#endif
+
+    printf("%-7s %-5s %10s %10s %10s %10s %10s %8s %6s\n",
+           "backend", "sink", "lines/s", "avg ns", "p99 ns <", "max ns", "lost", "dropped", "bytes");
+    for (int spin = 0; spin <= BENCH_SLOW_SPIN; spin += BENCH_SLOW_SPIN) {
+#if defined(CONFIG_LOG_BINARY)
+        esp_log_mode_set(TAG, ESP_LOG_MODE_TEXT);
+        bench_run("text", 0, spin);
+        esp_log_mode_set(TAG, ESP_LOG_MODE_BINARY);
+        bench_run("binary", 0, spin);
+#elif defined(CONFIG_LOG_ASYNC)
+        bench_run("async", 0, spin);
+#else
+        bench_run("legacy", 1, spin);
+        bench_run("sync", 0, spin);
+#endif
+    }
+
+    return 0;
+}
@@ -0,0 +1,7 @@
+// Host build stub of rom/ets_sys.h
+#pragma once
+
+#include <stdio.h>
+
+#define ets_printf printf
+#define ets_vprintf vprintf
@@ -0,0 +1,9 @@
+#pragma once
+
+#define CONFIG_LOG_DEFAULT_LEVEL 3
+#define CONFIG_LOG_LINE_MAX 256
+#define CONFIG_LOG_BINARY_STRING_MAX 32
+#define CONFIG_LOG_TAG_CACHE_SIZE 64
+#define CONFIG_LOG_ASYNC_BUFFER_SIZE (16 * 1024)
+#define CONFIG_LOG_ASYNC_TASK_PRIORITY 1
+#define CONFIG_LOG_ASYNC_TASK_STACK_SIZE 2048
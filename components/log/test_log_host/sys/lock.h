@@ -0,0 +1,7 @@
+// Host build stub of sys/lock.h, log.c only has one lock, so all locks map to one recursive mutex
+#pragma once
+
+typedef int _lock_t;
+
+void _lock_acquire_recursive(_lock_t *lock);
+void _lock_release_recursive(_lock_t *lock);
@@ -0,0 +1,9 @@
+// Host build stub of task.h, tasks are threads and notifications are condition variables
+#pragma once
+
+typedef struct host_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+BaseType_t xTaskCreate(TaskFunction_t func, const char *name, uint32_t stack, void *arg, unsigned prio, TaskHandle_t *task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+void xTaskNotifyGive(TaskHandle_t task);
@@ -0,0 +1,9 @@
+// Host build stub of xtensa/hal.h, the timestamps of the benchmark are meaningless
+#pragma once
+
+#include <stdint.h>
+
+static inline uint32_t soc_get_ccount(void)
+{
+    return 0;
+}
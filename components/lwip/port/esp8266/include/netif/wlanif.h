@@ -16,6 +16,34 @@
 #ifndef _WLAN_LWIP_IF_H_
 #define _WLAN_LWIP_IF_H_
 
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Counters of the TCP segments sent again after the Wi-Fi driver failed to send them
+ */
+typedef struct {
+    uint32_t queued;            /**< segments queued to be sent again */
+    uint32_t failed_again;      /**< failures of segments already queued */
+    uint32_t resent;            /**< segments handed to the Wi-Fi driver again */
+    uint32_t released;          /**< segments released by TCP before they were sent again */
+    uint32_t dropped_full;      /**< segments not queued as the queue was full or could not be allocated */
+    uint32_t dropped_retries;   /**< segments dropped after the driver had no memory for them three times */
+    uint32_t dropped_error;     /**< segments dropped after the driver failed to send them */
+    uint32_t pending;           /**< segments queued now */
+} wlanif_tx_retry_stats_t;
+
+/**
+ * @brief Get the counters of the TCP segments sent again
+ *
+ * The counters are all 0 unless lwIP is built with ESP_TCP.
+ *
+ * @param stats the counters
+ */
+void wlanif_get_tx_retry_stats(wlanif_tx_retry_stats_t* stats);
 
 #ifdef __cplusplus
 }
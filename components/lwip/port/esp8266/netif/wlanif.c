@@ -47,6 +47,7 @@
 #include "tcpip_adapter.h"
 #include "freertos/semphr.h"
 #include "lwip/tcpip.h"
+#include "netif/wlanif.h"
 #include "stdlib.h"
 
 #include "esp8266/eagle_soc.h"
@@ -59,15 +60,28 @@ void wifi_station_set_default_hostname(uint8_t* hwaddr);
 #define IFNAME1 'n'
 
 #if ESP_TCP
+/*
+ * TCP pbufs the Wi-Fi driver failed to send are kept in a ring, in the order they failed, until
+ * send_from_list() sends them again. A hash of the pbuf addresses finds the pbufs which fail again
+ * while they are in the ring. The ring and the hash are allocated at the first failure.
+ */
+#define PBUF_SEND_LIST_MAX      (TCP_SND_QUEUELEN * MEMP_NUM_TCP_PCB + MEMP_NUM_TCP_PCB)
+#define PBUF_SEND_LIST_SIZE     (PBUF_SEND_LIST_MAX < 0xfffe ? PBUF_SEND_LIST_MAX : 0xfffe)
+#define PBUF_SEND_LIST_NONE     0xffff
+
 typedef struct pbuf_send_list {
-    struct pbuf_send_list* next;
     struct pbuf* p;
-    int aiofd;
-    int err_cnt;
+    uint8_t aiofd;
+    uint8_t err_cnt;
+    uint16_t hash_next;                     /* next entry with the same hash */
 } pbuf_send_list_t;
 
-static pbuf_send_list_t* pbuf_list_head = NULL;
+static pbuf_send_list_t* pbuf_list;
+static uint16_t* pbuf_list_hash;
+static uint16_t pbuf_list_hash_mask;
+static uint16_t pbuf_list_head;
 static int pbuf_send_list_num = 0;
+static wlanif_tx_retry_stats_t pbuf_list_stats;
 #endif
 static int low_level_send_cb(esp_aio_t* aio);
 
@@ -175,126 +189,176 @@ static inline bool check_pbuf_to_insert(struct pbuf* p)
     return false;
 }
 
-static void insert_to_list(int fd, struct pbuf* p)
+static inline uint16_t pbuf_list_hash_of(struct pbuf* p)
 {
-    pbuf_send_list_t* tmp_pbuf_list1;
-    pbuf_send_list_t* tmp_pbuf_list2;
+    uint32_t hash = (uint32_t)(uintptr_t)p * 0x9e3779b1U;
 
-    if (pbuf_send_list_num > (TCP_SND_QUEUELEN * MEMP_NUM_TCP_PCB + MEMP_NUM_TCP_PCB)) {
-        return;
+    return (hash >> 16) & pbuf_list_hash_mask;
+}
+
+static bool pbuf_list_alloc(void)
+{
+    uint16_t buckets = 1;
+
+    while (buckets < PBUF_SEND_LIST_SIZE / 2) {
+        buckets <<= 1;
     }
 
-    if (!check_pbuf_to_insert(p)) {
-        return;
+    pbuf_list = (pbuf_send_list_t*)malloc(PBUF_SEND_LIST_SIZE * sizeof(pbuf_send_list_t));
+    pbuf_list_hash = (uint16_t*)malloc(buckets * sizeof(uint16_t));
+
+    if (!pbuf_list || !pbuf_list_hash) {
+        free(pbuf_list);
+        free(pbuf_list_hash);
+        pbuf_list = NULL;
+        pbuf_list_hash = NULL;
+        return false;
     }
 
-    LWIP_DEBUGF(PBUF_CACHE_DEBUG, ("Insert %p,%d\n", p, pbuf_send_list_num));
+    memset(pbuf_list_hash, 0xff, buckets * sizeof(uint16_t));
+    pbuf_list_hash_mask = buckets - 1;
 
-    if (pbuf_list_head == NULL) {
-        tmp_pbuf_list1 = (pbuf_send_list_t*)malloc(sizeof(pbuf_send_list_t));
+    return true;
+}
+
+static pbuf_send_list_t* pbuf_list_find(struct pbuf* p)
+{
+    uint16_t i = pbuf_list_hash[pbuf_list_hash_of(p)];
 
-        if (!tmp_pbuf_list1) {
-            LWIP_DEBUGF(PBUF_CACHE_DEBUG, ("no memory malloc pbuf list error\n"));
-            return;
+    while (i != PBUF_SEND_LIST_NONE) {
+        if (pbuf_list[i].p == p) {
+            return &pbuf_list[i];
         }
 
-        pbuf_ref(p);
-        tmp_pbuf_list1->aiofd = fd;
-        tmp_pbuf_list1->p = p;
-        tmp_pbuf_list1->next = NULL;
-        tmp_pbuf_list1->err_cnt = 0;
-        pbuf_list_head = tmp_pbuf_list1;
-        pbuf_send_list_num++;
-        return;
+        i = pbuf_list[i].hash_next;
     }
 
-    tmp_pbuf_list1 = pbuf_list_head;
-    tmp_pbuf_list2 = tmp_pbuf_list1;
+    return NULL;
+}
 
-    while (tmp_pbuf_list1 != NULL) {
-        if (tmp_pbuf_list1->p == p) {
-            tmp_pbuf_list1->err_cnt ++;
-            return;
-        }
+/* Remove the oldest entry, the caller takes over its reference to the pbuf */
+static void pbuf_list_remove_head(void)
+{
+    uint16_t* link = &pbuf_list_hash[pbuf_list_hash_of(pbuf_list[pbuf_list_head].p)];
 
-        tmp_pbuf_list2 = tmp_pbuf_list1;
-        tmp_pbuf_list1 = tmp_pbuf_list2->next;
+    while (*link != pbuf_list_head) {
+        link = &pbuf_list[*link].hash_next;
     }
 
-    tmp_pbuf_list1 = (pbuf_send_list_t*)malloc(sizeof(pbuf_send_list_t));
+    *link = pbuf_list[pbuf_list_head].hash_next;
+
+    LWIP_DEBUGF(PBUF_CACHE_DEBUG, ("Delete %p,%d\n", pbuf_list[pbuf_list_head].p, pbuf_send_list_num));
+
+    pbuf_list_head = (pbuf_list_head + 1) % PBUF_SEND_LIST_SIZE;
+    pbuf_send_list_num--;
+}
 
-    if (!tmp_pbuf_list1) {
+static void insert_to_list(int fd, struct pbuf* p)
+{
+    pbuf_send_list_t* entry;
+    uint16_t i, hash;
+
+    if (!check_pbuf_to_insert(p)) {
+        return;
+    }
+
+    if (!pbuf_list && !pbuf_list_alloc()) {
         LWIP_DEBUGF(PBUF_CACHE_DEBUG, ("no memory malloc pbuf list error\n"));
+        pbuf_list_stats.dropped_full++;
+        return;
+    }
+
+    entry = pbuf_list_find(p);
+    if (entry) {
+        if (entry->err_cnt < UINT8_MAX) {
+            entry->err_cnt++;
+        }
+        pbuf_list_stats.failed_again++;
+        return;
+    }
+
+    if (pbuf_send_list_num >= PBUF_SEND_LIST_SIZE) {
+        pbuf_list_stats.dropped_full++;
         return;
     }
 
+    LWIP_DEBUGF(PBUF_CACHE_DEBUG, ("Insert %p,%d\n", p, pbuf_send_list_num));
+
+    i = (pbuf_list_head + pbuf_send_list_num) % PBUF_SEND_LIST_SIZE;
+    hash = pbuf_list_hash_of(p);
+
     pbuf_ref(p);
-    tmp_pbuf_list1->aiofd = fd;
-    tmp_pbuf_list1->p = p;
-    tmp_pbuf_list1->next = NULL;
-    tmp_pbuf_list1->err_cnt = 0;
-    tmp_pbuf_list2->next = tmp_pbuf_list1;
+    pbuf_list[i].aiofd = fd;
+    pbuf_list[i].p = p;
+    pbuf_list[i].err_cnt = 0;
+    pbuf_list[i].hash_next = pbuf_list_hash[hash];
+    pbuf_list_hash[hash] = i;
     pbuf_send_list_num++;
+    pbuf_list_stats.queued++;
 }
 
 void send_from_list()
 {
-    pbuf_send_list_t* tmp_pbuf_list1;
-
-    while (pbuf_list_head != NULL) {
-        if (pbuf_list_head->p->ref == 1) {
-            tmp_pbuf_list1 = pbuf_list_head->next;
-            LWIP_DEBUGF(PBUF_CACHE_DEBUG, ("Delete %p,%d\n", pbuf_list_head->p, pbuf_send_list_num));
-            pbuf_free(pbuf_list_head->p);
-            free(pbuf_list_head);
-            pbuf_send_list_num--;
-            pbuf_list_head = tmp_pbuf_list1;
+    pbuf_send_list_t* entry;
+
+    while (pbuf_send_list_num) {
+        entry = &pbuf_list[pbuf_list_head];
+
+        if (entry->p->ref == 1) {
+            /* TCP released the segment, it was acknowledged or the connection is gone */
+            pbuf_list_remove_head();
+            pbuf_free(entry->p);
+            pbuf_list_stats.released++;
         } else {
             esp_aio_t aio;
             esp_err_t err;
-            aio.fd = (int)pbuf_list_head->aiofd;
-            aio.pbuf = pbuf_list_head->p->payload;
-            aio.len = pbuf_list_head->p->len;
+            aio.fd = (int)entry->aiofd;
+            aio.pbuf = entry->p->payload;
+            aio.len = entry->p->len;
             aio.cb = low_level_send_cb;
-            aio.arg = pbuf_list_head->p;
+            aio.arg = entry->p;
             aio.ret = 0;
 
-            err = ieee80211_output_pbuf(aio);
+            err = ieee80211_output_pbuf(&aio);
 
 #if ESP_TCP_TXRX_PBUF_DEBUG
-            tcp_print_status(LWIP_RESEND_DATA_TO_WIFI_WHEN_WIFI_SEND_FAILED, (void*)pbuf_list_head->p, 0 ,0, 0);
+            tcp_print_status(LWIP_RESEND_DATA_TO_WIFI_WHEN_WIFI_SEND_FAILED, (void*)entry->p, 0 ,0, 0);
 #endif
-            tmp_pbuf_list1 = pbuf_list_head->next;
 
             if (err == ERR_MEM) {
-                pbuf_list_head->err_cnt++;
-
-                if (pbuf_list_head->err_cnt >= 3) {
-                    LWIP_DEBUGF(PBUF_CACHE_DEBUG, ("Delete %p,%d\n", pbuf_list_head->p, pbuf_send_list_num));
-                    pbuf_free(pbuf_list_head->p);
-                    free(pbuf_list_head);
-                    pbuf_send_list_num--;
-                    pbuf_list_head = tmp_pbuf_list1;
+                entry->err_cnt++;
+
+                if (entry->err_cnt >= 3) {
+                    pbuf_list_remove_head();
+                    pbuf_free(entry->p);
+                    pbuf_list_stats.dropped_retries++;
                 }
 
                 return;
             } else if (err == ERR_OK) {
-                LWIP_DEBUGF(PBUF_CACHE_DEBUG, ("Delete %p,%d\n", pbuf_list_head->p, pbuf_send_list_num));
-                free(pbuf_list_head);
-                pbuf_send_list_num--;
-                pbuf_list_head = tmp_pbuf_list1;
+                /* The reference of the entry goes with the pbuf to the driver */
+                pbuf_list_remove_head();
+                pbuf_list_stats.resent++;
             } else {
-                LWIP_DEBUGF(PBUF_CACHE_DEBUG, ("Delete %p,%d\n", pbuf_list_head->p, pbuf_send_list_num));
-                pbuf_free(pbuf_list_head->p);
-                free(pbuf_list_head);
-                pbuf_send_list_num--;
-                pbuf_list_head = tmp_pbuf_list1;
+                pbuf_list_remove_head();
+                pbuf_free(entry->p);
+                pbuf_list_stats.dropped_error++;
             }
         }
     }
 }
 #endif
 
+void wlanif_get_tx_retry_stats(wlanif_tx_retry_stats_t* stats)
+{
+#if ESP_TCP
+    *stats = pbuf_list_stats;
+    stats->pending = pbuf_send_list_num;
+#else
+    memset(stats, 0, sizeof(*stats));
+#endif
+}
+
 /**
  * In this function, the hardware should be initialized.
  * Called from ethernetif_init().
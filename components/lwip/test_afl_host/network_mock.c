@@ -91,18 +91,26 @@ esp_err_t tcpip_adapter_get_ip_info(tcpip_adapter_if_t tcpip_if, tcpip_adapter_i
 struct pbuf * pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
 {
     struct pbuf * p;
-    p = (struct pbuf *)malloc(MEMP_PBUF_POOL);
+    p = (struct pbuf *)malloc(sizeof(struct pbuf));
     p->tot_len = length;
     p->next = NULL;
     p->type_internal = PBUF_POOL;
     p->len = length;
+    p->ref = 1;
     p->payload = malloc(length);
     return p;
 }
 
-u8_t pbuf_free(struct pbuf *p)
+void pbuf_ref(struct pbuf *p)
 {
     if (p) {
+        p->ref++;
+    }
+}
+
+u8_t pbuf_free(struct pbuf *p)
+{
+    if (p && --p->ref == 0) {
         if (p->payload) {
             free(p->payload);
             p->payload = NULL;
@@ -0,0 +1,293 @@
+#include "no_warn_host.h"
+
+#include "lwip/opt.h"
+#include "lwip/pbuf.h"
+#include "lwip/ethip6.h"
+#include "netif/etharp.h"
+#include "netif/wlanif.h"
+#include "esp_aio.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TEST_SEGMENTS       512
+#define TEST_LIST_MAX       (TCP_SND_QUEUELEN * MEMP_NUM_TCP_PCB + MEMP_NUM_TCP_PCB)
+#define TEST_LIST_SIZE      (TEST_LIST_MAX < 0xfffe ? TEST_LIST_MAX : 0xfffe)
+#define TEST_SIM_OPS        200000
+
+#define TEST_CHECK(cond)    do { \
+                                if (!(cond)) { \
+                                    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+                                    abort(); \
+                                } \
+                            } while (0)
+
+//
+// Dependency injected test functions
+void wlanif_test_init_di(void);
+void wlanif_test_insert_to_list(int fd, struct pbuf* p);
+void send_from_list();
+
+//
+// Model of the retry list: the segments TCP holds, the segments queued in order and their failures
+static struct pbuf *s_segment[TEST_SEGMENTS];
+static bool s_tcp_holds[TEST_SEGMENTS];
+static bool s_queued[TEST_SEGMENTS];
+static int s_err_cnt[TEST_SEGMENTS];
+static int *s_queue;
+static int s_queue_head, s_queue_num;
+static wlanif_tx_retry_stats_t s_stats;
+
+// Driver calls expected by the model for the next send_from_list(), and the results to return
+static int s_expected_seg[TEST_LIST_SIZE + 1];
+static err_t s_expected_ret[TEST_LIST_SIZE + 1];
+static int s_expected_num, s_expected_pos;
+
+//
+// Mocks of the Wi-Fi driver and of the lwIP functions wlanif.c refers to
+int ieee80211_output_pbuf(esp_aio_t *aio)
+{
+    TEST_CHECK(s_expected_pos < s_expected_num);
+    TEST_CHECK(aio->arg == s_segment[s_expected_seg[s_expected_pos]]);
+    TEST_CHECK(aio->pbuf == ((struct pbuf *)aio->arg)->payload);
+
+    err_t ret = s_expected_ret[s_expected_pos++];
+    if (ret == ERR_OK) {
+        // The frame was sent, the driver releases the pbuf
+        pbuf_free(aio->arg);
+    }
+    return ret;
+}
+
+int8_t wifi_get_netif(uint8_t fd)
+{
+    return fd;
+}
+
+void wifi_station_set_default_hostname(uint8_t *hwaddr)
+{
+}
+
+err_t etharp_output(struct netif *netif, struct pbuf *q, const ip4_addr_t *ipaddr)
+{
+    return ERR_OK;
+}
+
+#if LWIP_IPV6
+err_t ethip6_output(struct netif *netif, struct pbuf *q, const ip6_addr_t *ip6addr)
+{
+    return ERR_OK;
+}
+#endif
+
+//
+// Model operations
+static void queue_pop(void)
+{
+    s_queued[s_queue[s_queue_head]] = false;
+    s_queue_head = (s_queue_head + 1) % TEST_LIST_SIZE;
+    s_queue_num--;
+}
+
+static void segment_new(int seg)
+{
+    if (s_segment[seg]) {
+        return;
+    }
+
+    // An IPv4 TCP frame, the only ones queued to be sent again
+    struct pbuf *p = pbuf_alloc(PBUF_RAW, 64, PBUF_RAM);
+    memset(p->payload, 0, 64);
+    ((uint8_t *)p->payload)[12] = 0x08;
+    ((uint8_t *)p->payload)[23] = 0x06;
+    s_segment[seg] = p;
+    s_tcp_holds[seg] = true;
+    s_err_cnt[seg] = 0;
+}
+
+static void segment_release(int seg)
+{
+    if (!s_tcp_holds[seg]) {
+        return;
+    }
+
+    s_tcp_holds[seg] = false;
+    pbuf_free(s_segment[seg]);
+    if (!s_queued[seg]) {
+        s_segment[seg] = NULL;
+    }
+}
+
+static void segment_failed(int seg)
+{
+    if (!s_tcp_holds[seg]) {
+        return;
+    }
+
+    if (s_queued[seg]) {
+        if (s_err_cnt[seg] < 255) {
+            s_err_cnt[seg]++;
+        }
+        s_stats.failed_again++;
+    } else if (s_queue_num == TEST_LIST_SIZE) {
+        s_stats.dropped_full++;
+    } else {
+        s_queue[(s_queue_head + s_queue_num) % TEST_LIST_SIZE] = seg;
+        s_queue_num++;
+        s_queued[seg] = true;
+        s_err_cnt[seg] = 0;
+        s_stats.queued++;
+    }
+
+    wlanif_test_insert_to_list(0, s_segment[seg]);
+}
+
+// The driver accepts the first segments it is offered and then fails with ERR_MEM or another error
+static void send_segments(uint8_t script)
+{
+    int accepted = script & 0x7;
+    err_t fail = (script & 0x8) ? ERR_MEM : ERR_IF;
+
+    s_expected_num = s_expected_pos = 0;
+
+    while (s_queue_num) {
+        int seg = s_queue[s_queue_head];
+
+        if (!s_tcp_holds[seg]) {
+            // Only the list holds the segment, it is released
+            s_stats.released++;
+            queue_pop();
+            continue;
+        }
+
+        s_expected_seg[s_expected_num] = seg;
+        if (accepted > 0) {
+            accepted--;
+            s_expected_ret[s_expected_num++] = ERR_OK;
+            s_stats.resent++;
+            queue_pop();
+        } else if (fail == ERR_MEM) {
+            s_expected_ret[s_expected_num++] = ERR_MEM;
+            if (++s_err_cnt[seg] >= 3) {
+                s_stats.dropped_retries++;
+                queue_pop();
+            }
+            break;
+        } else {
+            s_expected_ret[s_expected_num++] = ERR_IF;
+            s_stats.dropped_error++;
+            queue_pop();
+        }
+    }
+
+    send_from_list();
+    TEST_CHECK(s_expected_pos == s_expected_num);
+
+    // The list freed the segments it held last
+    for (int i = 0; i < TEST_SEGMENTS; i++) {
+        if (s_segment[i] && !s_tcp_holds[i] && !s_queued[i]) {
+            s_segment[i] = NULL;
+        }
+    }
+}
+
+static void check_model(void)
+{
+    wlanif_tx_retry_stats_t stats;
+
+    wlanif_get_tx_retry_stats(&stats);
+    s_stats.pending = s_queue_num;
+    TEST_CHECK(memcmp(&stats, &s_stats, sizeof(stats)) == 0);
+
+    for (int i = 0; i < TEST_SEGMENTS; i++) {
+        if (s_segment[i]) {
+            TEST_CHECK(s_segment[i]->ref == s_tcp_holds[i] + s_queued[i]);
+        }
+    }
+}
+
+static void run_op(uint8_t op, uint8_t arg1, uint8_t arg2)
+{
+    int seg = ((arg1 << 8) | arg2) % TEST_SEGMENTS;
+
+    switch (op % 4) {
+        case 0:
+            segment_new(seg);
+            break;
+        case 1:
+            segment_failed(seg);
+            break;
+        case 2:
+            segment_release(seg);
+            break;
+        default:
+            send_segments(arg1);
+            break;
+    }
+
+    check_model();
+}
+
+//
+// Test starts here
+//
+int main(int argc, char** argv)
+{
+    uint8_t buf[3];
+    FILE *file;
+
+    wlanif_test_init_di();
+    s_queue = calloc(TEST_LIST_SIZE, sizeof(int));
+
+#ifdef INSTR_IS_OFF
+    if (argc == 2) {
+        //
+        // Note: parameter1 is a file (operation sequence) which caused the crash
+        file = fopen(argv[1], "r");
+        if (!file) {
+            return 1;
+        }
+        while (fread(buf, 1, sizeof(buf), file) == sizeof(buf)) {
+            run_op(buf[0], buf[1], buf[2]);
+        }
+        fclose(file);
+    } else {
+        //
+        // Without a file, run a pseudo random sequence which fills the list and drains it again
+        uint32_t seed = 1;
+        for (int i = 0; i < TEST_SIM_OPS; i++) {
+            seed = seed * 1103515245 + 12345;
+            uint8_t op = (seed >> 16) % 8;
+            uint8_t arg1 = seed >> 24;
+            // More failures than sends in the first half, where the driver is out of memory
+            if (i < TEST_SIM_OPS / 2) {
+                op = op < 3 ? 0 : (op < 7 ? 1 : 2);
+                if ((seed >> 8) % 64 == 0) {
+                    op = 3;
+                    arg1 |= 0x08;
+                }
+            } else {
+                op = op < 2 ? 0 : (op < 3 ? 1 : (op < 5 ? 2 : 3));
+            }
+            run_op(op, arg1, seed >> 4);
+        }
+        for (int i = 0; i < TEST_SEGMENTS; i++) {
+            segment_release(i);
+        }
+        send_segments(0);
+        TEST_CHECK(s_queue_num == 0);
+        printf("queued %u, failed again %u, resent %u, released %u, dropped full %u, retries %u, error %u\n",
+               s_stats.queued, s_stats.failed_again, s_stats.resent, s_stats.released, s_stats.dropped_full,
+               s_stats.dropped_retries, s_stats.dropped_error);
+    }
+#else
+    while (__AFL_LOOP(1000)) {
+        while (fread(buf, 1, sizeof(buf), stdin) == sizeof(buf)) {
+            run_op(buf[0], buf[1], buf[2]);
+        }
+    }
+#endif
+
+    return 0;
+}
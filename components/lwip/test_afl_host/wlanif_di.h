@@ -0,0 +1,31 @@
+/*
+ * wlanif.c dependecy injection -- preincluded to inject interface test functions into static variables
+ *
+ */
+#include "no_warn_host.h"
+
+#include "lwip/opt.h"
+#include "lwip/pbuf.h"
+#include "esp_aio.h"
+
+// Build the retry list of TCP segments the Wi-Fi driver failed to send
+#undef ESP_TCP
+#define ESP_TCP 1
+
+#ifndef BUILDING_DEF
+
+static void insert_to_list(int fd, struct pbuf* p);
+
+void (*wlanif_test_static_insert_to_list)(int fd, struct pbuf* p) = NULL;
+
+void wlanif_test_init_di(void)
+{
+    wlanif_test_static_insert_to_list = insert_to_list;
+}
+
+void wlanif_test_insert_to_list(int fd, struct pbuf* p)
+{
+    wlanif_test_static_insert_to_list(fd, p);
+}
+
+#endif
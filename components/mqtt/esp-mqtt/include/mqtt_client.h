@@ -76,6 +76,14 @@ typedef esp_mqtt_event_t* esp_mqtt_event_handle_t;
 
 typedef esp_err_t (* mqtt_event_callback_t)(esp_mqtt_event_handle_t event);
 
+/**
+ * What esp_mqtt_client_enqueue() does when the queue of messages not sent yet is full
+ */
+typedef enum {
+    MQTT_QUEUE_DROP_NEWEST = 0,   /*!< the message enqueued is dropped, esp_mqtt_client_enqueue() fails */
+    MQTT_QUEUE_DROP_OLDEST,       /*!< the oldest message not sent yet is dropped to make room */
+} esp_mqtt_queue_drop_policy_t;
+
 /**
  * MQTT client configuration structure
  */
@@ -103,6 +111,8 @@ typedef struct {
     const char *client_cert_pem;            /*!< Pointer to certificate data in PEM format for SSL mutual authentication, default is NULL, not required if mutual authentication is not needed. If it is not NULL, also `client_key_pem` has to be provided. */
     const char *client_key_pem;             /*!< Pointer to private key data in PEM format for SSL mutual authentication, default is NULL, not required if mutual authentication is not needed. If it is not NULL, also `client_cert_pem` has to be provided. */
     esp_mqtt_transport_t transport;         /*!< overrides URI transport */
+    int out_queue_size;                     /*!< number of messages esp_mqtt_client_enqueue() queues in RAM before they are sent, default is 16 */
+    esp_mqtt_queue_drop_policy_t out_queue_drop_policy; /*!< message dropped when the queue is full, default is the message enqueued */
 } esp_mqtt_client_config_t;
 
 esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config);
@@ -112,6 +122,29 @@ esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client);
 int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos);
 int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *topic);
 int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain);
+
+/**
+ * @brief Queue a message to be published by the MQTT task
+ *
+ * Unlike esp_mqtt_client_publish(), which writes the message from the calling task, this only
+ * encodes it into the outbox and returns, it does not wait for the network. The MQTT task writes
+ * the queued messages within CONFIG_MQTT_TX_FLUSH_INTERVAL_MS, as many as fit in
+ * CONFIG_MQTT_TX_BATCH_SIZE bytes with one write. Messages may be queued before the client is
+ * connected, they are written once it is. Up to ``out_queue_size`` messages are queued in RAM, then
+ * ``out_queue_drop_policy`` tells which one is dropped. With CONFIG_MQTT_OUTBOX_SPILL, the oldest
+ * message is moved to flash instead, as are the ones the outbox has no room for, and they survive a
+ * reboot there; a message is dropped only once the spill partition is full.
+ *
+ * @param client    mqtt client handle
+ * @param topic     topic string
+ * @param data      payload string (set to NULL, sending empty payload message)
+ * @param len       data length, if set to 0, length is calculated from payload string
+ * @param qos       qos of publish message
+ * @param retain    retain flag
+ *
+ * @return message_id of a qos 1/2 message, 0 for qos 0, -1 if the message is dropped or on failure
+ */
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain);
 esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client);
 
 #ifdef __cplusplus
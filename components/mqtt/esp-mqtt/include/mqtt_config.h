@@ -76,6 +76,32 @@
 #define MQTT_ENABLE_WS              CONFIG_MQTT_TRANSPORT_WEBSOCKET
 #define MQTT_ENABLE_WSS             CONFIG_MQTT_TRANSPORT_WEBSOCKET_SECURE
 
+#define MQTT_OUT_QUEUE_SIZE         16
+
+#ifdef CONFIG_MQTT_TX_BATCH_SIZE
+#define MQTT_TX_BATCH_SIZE          CONFIG_MQTT_TX_BATCH_SIZE
+#else
+#define MQTT_TX_BATCH_SIZE          1460
+#endif
+
+#ifdef CONFIG_MQTT_TX_FLUSH_INTERVAL_MS
+#define MQTT_TX_FLUSH_INTERVAL_MS   CONFIG_MQTT_TX_FLUSH_INTERVAL_MS
+#else
+#define MQTT_TX_FLUSH_INTERVAL_MS   50
+#endif
+
 #define OUTBOX_EXPIRED_TIMEOUT_MS   (30*1000)
-#define OUTBOX_MAX_SIZE             (4*1024)
+
+#ifdef CONFIG_MQTT_OUTBOX_ARENA_SIZE
+#define OUTBOX_ARENA_SIZE           CONFIG_MQTT_OUTBOX_ARENA_SIZE
+#else
+#define OUTBOX_ARENA_SIZE           (4*1024)
+#endif
+#define OUTBOX_MAX_SIZE             OUTBOX_ARENA_SIZE
+
+#ifdef CONFIG_MQTT_OUTBOX_SPILL_PARTITION_LABEL
+#define OUTBOX_SPILL_PARTITION_LABEL CONFIG_MQTT_OUTBOX_SPILL_PARTITION_LABEL
+#else
+#define OUTBOX_SPILL_PARTITION_LABEL "mqtt_outbox"
+#endif
 #endif
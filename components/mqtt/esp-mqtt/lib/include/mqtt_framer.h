@@ -0,0 +1,94 @@
+/*
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE', which is part of this source code package.
+ */
+#ifndef _MQTT_FRAMER_H_
+#define _MQTT_FRAMER_H_
+
+#include <stdint.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Splits the byte stream read from the transport into MQTT packets.
+ *
+ * Reads are made into the free part of the buffer returned by mqtt_framer_get_space(),
+ * whatever their size: a read may end in the middle of the fixed header of a packet, or
+ * hold several packets. Every packet completely in the buffer is returned as one frame.
+ * A PUBLISH packet longer than the buffer is returned in chunks of the buffer length,
+ * the first of them holding the fixed header and the topic, the last one what is left.
+ */
+typedef struct mqtt_framer {
+    uint8_t *buffer;            /*!< Receive buffer */
+    uint32_t buffer_length;     /*!< Length of the receive buffer */
+    uint32_t start;             /*!< Start of the bytes not returned yet */
+    uint32_t end;               /*!< End of the bytes read into the buffer */
+    uint32_t stream_offset;     /*!< Offset in the PUBLISH packet streamed in chunks, 0 if none is */
+    uint32_t stream_length;     /*!< Total length of the PUBLISH packet streamed in chunks */
+} mqtt_framer_t;
+
+typedef struct mqtt_frame {
+    uint8_t *data;              /*!< A packet, or a chunk of a PUBLISH packet */
+    uint32_t length;            /*!< Length of the data */
+    uint32_t offset;            /*!< Offset of the data in the packet, 0 for the start of a packet */
+    uint32_t total_length;      /*!< Total length of the packet, fixed header included */
+} mqtt_frame_t;
+
+/**
+ * @brief      Initialize a framer
+ *
+ * @param      framer         The framer
+ * @param      buffer         The buffer the transport is read into
+ * @param[in]  buffer_length  The buffer length
+ */
+void mqtt_framer_init(mqtt_framer_t *framer, uint8_t *buffer, uint32_t buffer_length);
+
+/**
+ * @brief      Drop the bytes held by the framer, when the connection is closed
+ *
+ * @param      framer  The framer
+ */
+void mqtt_framer_reset(mqtt_framer_t *framer);
+
+/**
+ * @brief      Get the free part of the buffer, to read the transport into. The bytes not
+ *             returned yet are moved to the start of the buffer first.
+ *             The free part is never empty after mqtt_framer_next() returned 0.
+ *
+ * @param      framer  The framer
+ * @param[out] space   Length of the free part of the buffer
+ *
+ * @return     Start of the free part of the buffer
+ */
+uint8_t *mqtt_framer_get_space(mqtt_framer_t *framer, uint32_t *space);
+
+/**
+ * @brief      Tell the framer how many bytes were read into the free part of the buffer
+ *
+ * @param      framer  The framer
+ * @param[in]  length  Number of bytes read
+ */
+void mqtt_framer_commit(mqtt_framer_t *framer, uint32_t length);
+
+/**
+ * @brief      Get the next frame from the bytes read. The frame is valid until
+ *             mqtt_framer_get_space() is called.
+ *
+ * @param      framer  The framer
+ * @param[out] frame   The frame
+ *
+ * @return
+ *     - 1 if a frame is returned
+ *     - 0 if more bytes have to be read first
+ *     - -1 if the remaining length is malformed, or a packet longer than the buffer is not
+ *       a PUBLISH packet, or its topic does not fit in the buffer
+ */
+int mqtt_framer_next(mqtt_framer_t *framer, mqtt_frame_t *frame);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
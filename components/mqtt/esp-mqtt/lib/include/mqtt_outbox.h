@@ -18,14 +18,27 @@ typedef struct outbox_item * outbox_item_handle_t;
 
 outbox_handle_t outbox_init();
 outbox_item_handle_t outbox_enqueue(outbox_handle_t outbox, uint8_t *data, int len, int msg_id, int msg_type, int tick);
+/* Queues a message to be sent: it may be spilled to flash, and has no item until dequeued */
+esp_err_t outbox_append(outbox_handle_t outbox, uint8_t *data, int len, int msg_id, int msg_type, int tick);
 outbox_item_handle_t outbox_dequeue(outbox_handle_t outbox);
 outbox_item_handle_t outbox_get(outbox_handle_t outbox, int msg_id);
+uint8_t *outbox_item_get_data(outbox_item_handle_t item, int *len, int *msg_id, int *msg_type);
+esp_err_t outbox_delete_item(outbox_handle_t outbox, outbox_item_handle_t item);
 esp_err_t outbox_delete(outbox_handle_t outbox, int msg_id, int msg_type);
 esp_err_t outbox_delete_msgid(outbox_handle_t outbox, int msg_id);
 esp_err_t outbox_delete_msgtype(outbox_handle_t outbox, int msg_type);
+/* Deletes the pending items sent more than timeout ago */
 esp_err_t outbox_delete_expired(outbox_handle_t outbox, int current_tick, int timeout);
 
+/* Items are queued when enqueued, and pending once they are sent and wait for their acknowledgement */
 esp_err_t outbox_set_pending(outbox_handle_t outbox, int msg_id);
+esp_err_t outbox_set_item_pending(outbox_handle_t outbox, outbox_item_handle_t item, int tick);
+/* Counts the queued messages, the ones spilled to flash included */
+int outbox_get_queued_count(outbox_handle_t outbox);
+/* Counts the queued messages kept in RAM */
+int outbox_get_ram_queued_count(outbox_handle_t outbox);
+/* Moves the oldest message queued in RAM to flash, fails without a spill partition or once it is full */
+esp_err_t outbox_spill_oldest(outbox_handle_t outbox);
 int outbox_get_size(outbox_handle_t outbox);
 esp_err_t outbox_cleanup(outbox_handle_t outbox, int max_size);
 void outbox_destroy(outbox_handle_t outbox);
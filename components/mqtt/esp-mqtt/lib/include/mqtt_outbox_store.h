@@ -0,0 +1,100 @@
+/*
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE', which is part of this source code package.
+ */
+#ifndef _MQTT_OUTBOX_STORE_H_
+#define _MQTT_OUTBOX_STORE_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Log of outbox messages on a raw data partition, the tier the outbox spills its queued
+ * messages to when its arena is full.
+ *
+ * Messages are appended to the sectors of the partition in turn, and loaded back in the
+ * same order. A loaded message stays in the partition until it is deleted, once acknowledged,
+ * and a sector is erased when all its messages are. The log is read again when the store is
+ * opened, so the messages not deleted before a reboot are loaded again after it.
+ */
+typedef struct outbox_store *outbox_store_handle_t;
+
+#define OUTBOX_STORE_NO_RECORD  UINT32_MAX
+
+/**
+ * @brief      Open the store on a partition, and find the messages left in it
+ *
+ * @param[in]  label  The label of the data partition
+ *
+ * @return     The store, NULL if the partition is not found, is smaller than 2 sectors,
+ *             or is already open
+ */
+outbox_store_handle_t outbox_store_open(const char *label);
+
+/**
+ * @brief      Close the store, the messages in it are kept
+ *
+ * @param      store  The store
+ */
+void outbox_store_close(outbox_store_handle_t store);
+
+/**
+ * @brief      Append a message to the store
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_SIZE if the message is longer than a sector
+ *     - ESP_ERR_NO_MEM if every sector holds messages not deleted
+ *     - the error of the flash driver
+ */
+esp_err_t outbox_store_append(outbox_store_handle_t store, const uint8_t *data, int len, int msg_id, int msg_type);
+
+/**
+ * @brief      Get the oldest message not loaded yet
+ *
+ * @param      store     The store
+ * @param[out] msg_id    Its message id
+ * @param[out] msg_type  Its message type
+ *
+ * @return     Its length, 0 if every message was loaded
+ */
+int outbox_store_peek(outbox_store_handle_t store, int *msg_id, int *msg_type);
+
+/**
+ * @brief      Load the message returned by outbox_store_peek()
+ *
+ * @param      store   The store
+ * @param      data    Buffer of the length returned by outbox_store_peek()
+ * @param[out] record  The record of the message, to delete it with
+ *
+ * @return
+ *     - ESP_OK
+ *     - ESP_ERR_INVALID_CRC if the message was torn by a reset, it is skipped
+ *     - the error of the flash driver
+ */
+esp_err_t outbox_store_load(outbox_store_handle_t store, uint8_t *data, uint32_t *record);
+
+/**
+ * @brief      Delete a loaded message
+ *
+ * @param      store   The store
+ * @param[in]  record  The record returned by outbox_store_load()
+ *
+ * @return     ESP_OK, or the error of the flash driver
+ */
+esp_err_t outbox_store_delete(outbox_store_handle_t store, uint32_t record);
+
+/**
+ * @brief      Get the number of messages not loaded yet
+ */
+int outbox_store_get_count(outbox_store_handle_t store);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
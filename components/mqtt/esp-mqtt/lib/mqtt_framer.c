@@ -0,0 +1,142 @@
+/*
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE', which is part of this source code package.
+ */
+#include <stdbool.h>
+#include <string.h>
+#include "mqtt_framer.h"
+#include "mqtt_msg.h"
+
+/* The remaining length is encoded in 1 to 4 bytes, 7 bits in each */
+#define MQTT_MAX_REMAINING_LENGTH_BYTES 4
+
+void mqtt_framer_init(mqtt_framer_t *framer, uint8_t *buffer, uint32_t buffer_length)
+{
+    framer->buffer = buffer;
+    framer->buffer_length = buffer_length;
+    mqtt_framer_reset(framer);
+}
+
+void mqtt_framer_reset(mqtt_framer_t *framer)
+{
+    framer->start = 0;
+    framer->end = 0;
+    framer->stream_offset = 0;
+    framer->stream_length = 0;
+}
+
+uint8_t *mqtt_framer_get_space(mqtt_framer_t *framer, uint32_t *space)
+{
+    if (framer->start > 0) {
+        memmove(framer->buffer, framer->buffer + framer->start, framer->end - framer->start);
+        framer->end -= framer->start;
+        framer->start = 0;
+    }
+    *space = framer->buffer_length - framer->end;
+    return framer->buffer + framer->end;
+}
+
+void mqtt_framer_commit(mqtt_framer_t *framer, uint32_t length)
+{
+    framer->end += length;
+}
+
+/* Returns the length of the fixed header, 0 if it is not complete yet, -1 if it is malformed */
+static int mqtt_framer_decode_header(const uint8_t *data, uint32_t available, uint32_t *remaining_length)
+{
+    uint32_t value = 0;
+    int i;
+
+    for (i = 1; i <= MQTT_MAX_REMAINING_LENGTH_BYTES; ++i) {
+        if (i >= available) {
+            return 0;
+        }
+        value |= (uint32_t)(data[i] & 0x7f) << (7 * (i - 1));
+        if ((data[i] & 0x80) == 0) {
+            *remaining_length = value;
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+/* Checks the fixed header, topic and message id of a PUBLISH packet are in the bytes available */
+static bool mqtt_framer_has_publish_header(uint8_t *data, uint32_t header_length, uint32_t available)
+{
+    uint32_t length = header_length + 2;
+
+    if (length > available) {
+        return false;
+    }
+    length += (data[header_length] << 8) | data[header_length + 1];
+    if (mqtt_get_qos(data) > 0) {
+        length += 2;
+    }
+    return length <= available;
+}
+
+int mqtt_framer_next(mqtt_framer_t *framer, mqtt_frame_t *frame)
+{
+    uint8_t *data = framer->buffer + framer->start;
+    uint32_t available = framer->end - framer->start;
+    uint32_t remaining_length, length;
+    int header_length;
+
+    if (framer->stream_length) {
+        length = framer->stream_length - framer->stream_offset;
+        if (length > framer->buffer_length) {
+            length = framer->buffer_length;
+        }
+        if (available < length) {
+            return 0;
+        }
+        frame->data = data;
+        frame->length = length;
+        frame->offset = framer->stream_offset;
+        frame->total_length = framer->stream_length;
+        framer->start += length;
+        framer->stream_offset += length;
+        if (framer->stream_offset == framer->stream_length) {
+            framer->stream_offset = 0;
+            framer->stream_length = 0;
+        }
+        return 1;
+    }
+
+    header_length = mqtt_framer_decode_header(data, available, &remaining_length);
+    if (header_length <= 0) {
+        return header_length;
+    }
+    length = header_length + remaining_length;
+    if (length <= framer->buffer_length) {
+        if (available < length) {
+            return 0;
+        }
+        frame->data = data;
+        frame->length = length;
+        frame->offset = 0;
+        frame->total_length = length;
+        framer->start += length;
+        return 1;
+    }
+
+    /* Only a PUBLISH packet may be longer than the buffer, its payload is streamed.
+     * The first chunk fills the whole buffer, and has to hold the topic. */
+    if (mqtt_get_type(data) != MQTT_MSG_TYPE_PUBLISH) {
+        return -1;
+    }
+    if (available < framer->buffer_length) {
+        return 0;
+    }
+    if (!mqtt_framer_has_publish_header(data, header_length, available)) {
+        return -1;
+    }
+    frame->data = data;
+    frame->length = framer->buffer_length;
+    frame->offset = 0;
+    frame->total_length = length;
+    framer->start += framer->buffer_length;
+    framer->stream_offset = framer->buffer_length;
+    framer->stream_length = length;
+    return 1;
+}
@@ -259,7 +259,7 @@ uint16_t mqtt_get_id(uint8_t* buffer, uint16_t length)
 
                 if (mqtt_get_qos(buffer) > 0)
                 {
-                    if (i + 2 >= length)
+                    if (i + 2 > length)
                         return 0;
                     //i += 2;
                 } else {
@@ -3,168 +3,448 @@
 #include <string.h>
 #include "rom/queue.h"
 #include "esp_log.h"
+#include "mqtt_config.h"
+#include "mqtt_outbox_store.h"
 
 #ifndef CONFIG_MQTT_CUSTOM_OUTBOX
 
 
 static const char *TAG = "OUTBOX";
 
+/* Items and their message are allocated in turn from a ring arena. The space of an item is
+ * reused once it is deleted along with every item allocated before it. */
+#define OUTBOX_ALIGN(x)             (((x) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+#define OUTBOX_INDEX_RATIO          64
+
 typedef struct outbox_item {
-    char *buffer;
+    uint32_t size;
+    bool deleted;
+    bool pending;
     int len;
     int msg_id;
     int msg_type;
     int tick;
     int retry_count;
-    bool pending;
-    STAILQ_ENTRY(outbox_item) next;
+    uint32_t record;
+    TAILQ_ENTRY(outbox_item) next;
+    struct outbox_item *hash_next;
+    uint8_t buffer[];
 } outbox_item_t;
 
-STAILQ_HEAD(outbox_list_t, outbox_item);
+TAILQ_HEAD(outbox_item_list_t, outbox_item);
+
+/* The queued messages are sent in the order of the loaded list, then of the store,
+ * then of the queued list: the messages spilled to the store are older than the queued ones. */
+struct outbox_list_t {
+    struct outbox_item_list_t pending;
+    struct outbox_item_list_t loaded;
+    struct outbox_item_list_t queued;
+    outbox_item_handle_t *index;
+    int index_mask;
+    uint8_t *arena;
+    uint32_t head;
+    uint32_t tail;
+    uint32_t limit;
+    uint32_t used;
+    int queued_count;
+    int size;
+    outbox_store_handle_t store;
+};
+
+static outbox_item_handle_t outbox_arena_alloc(outbox_handle_t outbox, uint32_t size)
+{
+    outbox_item_handle_t item;
+    uint32_t offset;
+
+    if (outbox->used == 0) {
+        outbox->head = outbox->tail = 0;
+        outbox->limit = OUTBOX_ARENA_SIZE;
+    }
+    if (outbox->head < outbox->tail || (outbox->head == outbox->tail && outbox->used)) {
+        if (outbox->tail - outbox->head < size) {
+            return NULL;
+        }
+        offset = outbox->head;
+    } else if (OUTBOX_ARENA_SIZE - outbox->head >= size) {
+        offset = outbox->head;
+    } else if (outbox->tail >= size) {
+        outbox->limit = outbox->head;
+        offset = 0;
+    } else {
+        return NULL;
+    }
+    item = (outbox_item_handle_t)(outbox->arena + offset);
+    memset(item, 0, sizeof(outbox_item_t));
+    item->size = size;
+    outbox->head = offset + size;
+    outbox->used += size;
+    return item;
+}
+
+static void outbox_arena_free(outbox_handle_t outbox, outbox_item_handle_t item)
+{
+    item->deleted = true;
+    while (outbox->used) {
+        if (outbox->tail == outbox->limit) {
+            outbox->tail = 0;
+            outbox->limit = OUTBOX_ARENA_SIZE;
+        }
+        item = (outbox_item_handle_t)(outbox->arena + outbox->tail);
+        if (!item->deleted) {
+            break;
+        }
+        outbox->tail += item->size;
+        outbox->used -= item->size;
+    }
+}
+
+static outbox_item_handle_t *outbox_index_bucket(outbox_handle_t outbox, int msg_id)
+{
+    return &outbox->index[msg_id & outbox->index_mask];
+}
+
+static void outbox_index_add(outbox_handle_t outbox, outbox_item_handle_t item)
+{
+    outbox_item_handle_t *pitem = outbox_index_bucket(outbox, item->msg_id);
+
+    while (*pitem) {
+        pitem = &(*pitem)->hash_next;
+    }
+    *pitem = item;
+}
+
+static void outbox_index_remove(outbox_handle_t outbox, outbox_item_handle_t item)
+{
+    outbox_item_handle_t *pitem = outbox_index_bucket(outbox, item->msg_id);
+
+    while (*pitem != item) {
+        pitem = &(*pitem)->hash_next;
+    }
+    *pitem = item->hash_next;
+}
+
+static struct outbox_item_list_t *outbox_item_list(outbox_handle_t outbox, outbox_item_handle_t item)
+{
+    if (item->pending) {
+        return &outbox->pending;
+    }
+    return item->record != OUTBOX_STORE_NO_RECORD ? &outbox->loaded : &outbox->queued;
+}
+
+static void outbox_item_remove(outbox_handle_t outbox, outbox_item_handle_t item)
+{
+    TAILQ_REMOVE(outbox_item_list(outbox, item), item, next);
+    outbox_index_remove(outbox, item);
+    if (!item->pending) {
+        outbox->queued_count--;
+    }
+    outbox->size -= item->len;
+#ifdef CONFIG_MQTT_OUTBOX_SPILL
+    if (item->record != OUTBOX_STORE_NO_RECORD) {
+        outbox_store_delete(outbox->store, item->record);
+    }
+#endif
+    outbox_arena_free(outbox, item);
+}
+
+static void outbox_item_insert(outbox_handle_t outbox, outbox_item_handle_t item, int len, int msg_id, int msg_type, int tick, uint32_t record)
+{
+    item->len = len;
+    item->msg_id = msg_id;
+    item->msg_type = msg_type;
+    item->tick = tick;
+    item->record = record;
+    TAILQ_INSERT_TAIL(outbox_item_list(outbox, item), item, next);
+    outbox_index_add(outbox, item);
+    outbox->queued_count++;
+    outbox->size += len;
+}
+
+#ifdef CONFIG_MQTT_OUTBOX_SPILL
+/* Moves the oldest queued message to the store */
+static esp_err_t outbox_spill(outbox_handle_t outbox)
+{
+    outbox_item_handle_t item = TAILQ_FIRST(&outbox->queued);
+
+    if (outbox->store == NULL || item == NULL ||
+            outbox_store_append(outbox->store, item->buffer, item->len, item->msg_id, item->msg_type) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    ESP_LOGD(TAG, "SPILL msgid=%d, msg_type=%d, len=%d", item->msg_id, item->msg_type, item->len);
+    outbox_item_remove(outbox, item);
+    return ESP_OK;
+}
+#endif
+
+static outbox_item_handle_t outbox_item_alloc(outbox_handle_t outbox, int len)
+{
+    uint32_t size = OUTBOX_ALIGN(sizeof(outbox_item_t) + len);
+    outbox_item_handle_t item;
+
+    if (size > OUTBOX_ARENA_SIZE) {
+        return NULL;
+    }
+    item = outbox_arena_alloc(outbox, size);
+#ifdef CONFIG_MQTT_OUTBOX_SPILL
+    while (item == NULL && outbox_spill(outbox) == ESP_OK) {
+        item = outbox_arena_alloc(outbox, size);
+    }
+#endif
+    return item;
+}
 
+#ifdef CONFIG_MQTT_OUTBOX_SPILL
+/* Loads the oldest message of the store */
+static outbox_item_handle_t outbox_load(outbox_handle_t outbox)
+{
+    outbox_item_handle_t item;
+    int len, msg_id, msg_type;
+    uint32_t record;
+
+    while ((len = outbox_store_peek(outbox->store, &msg_id, &msg_type)) > 0) {
+        item = outbox_item_alloc(outbox, len);
+        if (item == NULL) {
+            return NULL;
+        }
+        if (outbox_store_load(outbox->store, item->buffer, &record) != ESP_OK) {
+            outbox_arena_free(outbox, item);
+            continue;
+        }
+        outbox_item_insert(outbox, item, len, msg_id, msg_type, 0, record);
+        ESP_LOGD(TAG, "LOAD msgid=%d, msg_type=%d, len=%d", msg_id, msg_type, len);
+        return item;
+    }
+    return NULL;
+}
+#endif
 
 outbox_handle_t outbox_init()
 {
+    int index_size = 1;
     outbox_handle_t outbox = calloc(1, sizeof(struct outbox_list_t));
     ESP_MEM_CHECK(TAG, outbox, return NULL);
-    STAILQ_INIT(outbox);
+    TAILQ_INIT(&outbox->pending);
+    TAILQ_INIT(&outbox->loaded);
+    TAILQ_INIT(&outbox->queued);
+    while (index_size < OUTBOX_ARENA_SIZE / OUTBOX_INDEX_RATIO) {
+        index_size <<= 1;
+    }
+    outbox->index_mask = index_size - 1;
+    outbox->index = calloc(index_size, sizeof(outbox_item_handle_t));
+    outbox->arena = malloc(OUTBOX_ARENA_SIZE);
+    ESP_MEM_CHECK(TAG, outbox->index && outbox->arena, {
+        free(outbox->index);
+        free(outbox->arena);
+        free(outbox);
+        return NULL;
+    });
+#ifdef CONFIG_MQTT_OUTBOX_SPILL
+    outbox->store = outbox_store_open(OUTBOX_SPILL_PARTITION_LABEL);
+    if (outbox->store == NULL) {
+        ESP_LOGW(TAG, "No spill partition, queue the messages in RAM only");
+    }
+#endif
     return outbox;
 }
 
 outbox_item_handle_t outbox_enqueue(outbox_handle_t outbox, uint8_t *data, int len, int msg_id, int msg_type, int tick)
 {
-    outbox_item_handle_t item = calloc(1, sizeof(outbox_item_t));
-    ESP_MEM_CHECK(TAG, item, return NULL);
-    item->msg_id = msg_id;
-    item->msg_type = msg_type;
-    item->tick = tick;
-    item->len = len;
-    item->buffer = malloc(len);
-    ESP_MEM_CHECK(TAG, item->buffer, {
-        free(item);
+    outbox_item_handle_t item = outbox_item_alloc(outbox, len);
+    if (item == NULL) {
+        ESP_LOGW(TAG, "No room for msgid=%d, msg_type=%d, len=%d, size=%d", msg_id, msg_type, len, outbox->size);
         return NULL;
-    });
+    }
     memcpy(item->buffer, data, len);
-    STAILQ_INSERT_TAIL(outbox, item, next);
+    outbox_item_insert(outbox, item, len, msg_id, msg_type, tick, OUTBOX_STORE_NO_RECORD);
     ESP_LOGD(TAG, "ENQUEUE msgid=%d, msg_type=%d, len=%d, size=%d", msg_id, msg_type, len, outbox_get_size(outbox));
     return item;
 }
 
+esp_err_t outbox_append(outbox_handle_t outbox, uint8_t *data, int len, int msg_id, int msg_type, int tick)
+{
+    if (OUTBOX_ALIGN(sizeof(outbox_item_t) + len) > OUTBOX_ARENA_SIZE) {
+        ESP_LOGE(TAG, "msgid=%d of len=%d is longer than the outbox", msg_id, len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (outbox_enqueue(outbox, data, len, msg_id, msg_type, tick)) {
+        return ESP_OK;
+    }
+#ifdef CONFIG_MQTT_OUTBOX_SPILL
+    /* the arena is held by pending messages, the queued ones go before this one */
+    while (outbox_spill(outbox) == ESP_OK) {
+    }
+    if (outbox->store && TAILQ_EMPTY(&outbox->queued) &&
+            outbox_store_append(outbox->store, data, len, msg_id, msg_type) == ESP_OK) {
+        ESP_LOGD(TAG, "SPILL msgid=%d, msg_type=%d, len=%d", msg_id, msg_type, len);
+        return ESP_OK;
+    }
+#endif
+    return ESP_ERR_NO_MEM;
+}
+
 outbox_item_handle_t outbox_get(outbox_handle_t outbox, int msg_id)
 {
-    outbox_item_handle_t item;
-    STAILQ_FOREACH(item, outbox, next) {
-        if (item->msg_id == msg_id) {
-            return item;
-        }
+    outbox_item_handle_t item = *outbox_index_bucket(outbox, msg_id);
+    while (item && item->msg_id != msg_id) {
+        item = item->hash_next;
     }
-    return NULL;
+    return item;
+}
+
+uint8_t *outbox_item_get_data(outbox_item_handle_t item, int *len, int *msg_id, int *msg_type)
+{
+    *len = item->len;
+    *msg_id = item->msg_id;
+    *msg_type = item->msg_type;
+    return item->buffer;
 }
 
 outbox_item_handle_t outbox_dequeue(outbox_handle_t outbox)
 {
-    outbox_item_handle_t item;
-    STAILQ_FOREACH(item, outbox, next) {
-        if (!item->pending) {
-            return item;
-        }
+    outbox_item_handle_t item = TAILQ_FIRST(&outbox->loaded);
+    if (item) {
+        return item;
     }
-    return NULL;
+#ifdef CONFIG_MQTT_OUTBOX_SPILL
+    if (outbox->store && outbox_store_get_count(outbox->store)) {
+        /* NULL while the arena has no room to load the next one */
+        return outbox_load(outbox);
+    }
+#endif
+    return TAILQ_FIRST(&outbox->queued);
 }
 esp_err_t outbox_delete(outbox_handle_t outbox, int msg_id, int msg_type)
 {
-    outbox_item_handle_t item, tmp;
-    STAILQ_FOREACH_SAFE(item, outbox, next, tmp) {
+    outbox_item_handle_t item = *outbox_index_bucket(outbox, msg_id);
+    while (item) {
         if (item->msg_id == msg_id && item->msg_type == msg_type) {
-            STAILQ_REMOVE(outbox, item, outbox_item, next);
-            free(item->buffer);
-            free(item);
+            outbox_item_remove(outbox, item);
             ESP_LOGD(TAG, "DELETED msgid=%d, msg_type=%d, remain size=%d", msg_id, msg_type, outbox_get_size(outbox));
             return ESP_OK;
         }
-
+        item = item->hash_next;
     }
     return ESP_FAIL;
 }
 esp_err_t outbox_delete_msgid(outbox_handle_t outbox, int msg_id)
 {
-    outbox_item_handle_t item, tmp;
-    STAILQ_FOREACH_SAFE(item, outbox, next, tmp) {
-        if (item->msg_id == msg_id) {
-            STAILQ_REMOVE(outbox, item, outbox_item, next);
-            free(item->buffer);
-            free(item);
-        }
+    outbox_item_handle_t item;
+    while ((item = outbox_get(outbox, msg_id)) != NULL) {
+        outbox_item_remove(outbox, item);
+    }
+    return ESP_OK;
+}
+esp_err_t outbox_delete_item(outbox_handle_t outbox, outbox_item_handle_t item)
+{
+    outbox_item_remove(outbox, item);
+    return ESP_OK;
+}
 
+esp_err_t outbox_set_item_pending(outbox_handle_t outbox, outbox_item_handle_t item, int tick)
+{
+    if (!item->pending) {
+        TAILQ_REMOVE(outbox_item_list(outbox, item), item, next);
+        item->pending = true;
+        item->tick = tick;
+        TAILQ_INSERT_TAIL(&outbox->pending, item, next);
+        outbox->queued_count--;
     }
     return ESP_OK;
 }
+
 esp_err_t outbox_set_pending(outbox_handle_t outbox, int msg_id)
 {
     outbox_item_handle_t item = outbox_get(outbox, msg_id);
     if (item) {
-        item->pending = true;
-        return ESP_OK;
+        return outbox_set_item_pending(outbox, item, item->tick);
     }
     return ESP_FAIL;
 }
 
-esp_err_t outbox_delete_msgtype(outbox_handle_t outbox, int msg_type)
+static void outbox_list_delete_msgtype(outbox_handle_t outbox, struct outbox_item_list_t *list, int msg_type)
 {
     outbox_item_handle_t item, tmp;
-    STAILQ_FOREACH_SAFE(item, outbox, next, tmp) {
+    TAILQ_FOREACH_SAFE(item, list, next, tmp) {
         if (item->msg_type == msg_type) {
-            STAILQ_REMOVE(outbox, item, outbox_item, next);
-            free(item->buffer);
-            free(item);
+            outbox_item_remove(outbox, item);
         }
-
     }
+}
+
+esp_err_t outbox_delete_msgtype(outbox_handle_t outbox, int msg_type)
+{
+    outbox_list_delete_msgtype(outbox, &outbox->pending, msg_type);
+    outbox_list_delete_msgtype(outbox, &outbox->loaded, msg_type);
+    outbox_list_delete_msgtype(outbox, &outbox->queued, msg_type);
     return ESP_OK;
 }
 
 esp_err_t outbox_delete_expired(outbox_handle_t outbox, int current_tick, int timeout)
 {
     outbox_item_handle_t item, tmp;
-    STAILQ_FOREACH_SAFE(item, outbox, next, tmp) {
+    TAILQ_FOREACH_SAFE(item, &outbox->pending, next, tmp) {
         if (current_tick - item->tick > timeout) {
-            STAILQ_REMOVE(outbox, item, outbox_item, next);
-            free(item->buffer);
-            free(item);
+            outbox_item_remove(outbox, item);
         }
-
     }
     return ESP_OK;
 }
 
-int outbox_get_size(outbox_handle_t outbox)
+int outbox_get_queued_count(outbox_handle_t outbox)
 {
-    int siz = 0;
-    outbox_item_handle_t item;
-    STAILQ_FOREACH(item, outbox, next) {
-        siz += item->len;
+#ifdef CONFIG_MQTT_OUTBOX_SPILL
+    if (outbox->store) {
+        return outbox->queued_count + outbox_store_get_count(outbox->store);
     }
-    return siz;
+#endif
+    return outbox->queued_count;
+}
+
+int outbox_get_ram_queued_count(outbox_handle_t outbox)
+{
+    return outbox->queued_count;
+}
+
+esp_err_t outbox_spill_oldest(outbox_handle_t outbox)
+{
+#ifdef CONFIG_MQTT_OUTBOX_SPILL
+    return outbox_spill(outbox);
+#else
+    return ESP_FAIL;
+#endif
+}
+
+int outbox_get_size(outbox_handle_t outbox)
+{
+    return outbox->size;
 }
 
 esp_err_t outbox_cleanup(outbox_handle_t outbox, int max_size)
 {
-    while(outbox_get_size(outbox) > max_size) {
-        outbox_item_handle_t item = outbox_dequeue(outbox);
+    while (outbox->size > max_size) {
+        outbox_item_handle_t item = TAILQ_FIRST(&outbox->loaded);
+        if (item == NULL) {
+            item = TAILQ_FIRST(&outbox->queued);
+        }
         if (item == NULL) {
             return ESP_FAIL;
         }
-        STAILQ_REMOVE(outbox, item, outbox_item, next);
-        free(item->buffer);
-        free(item);
+        outbox_item_remove(outbox, item);
     }
     return ESP_OK;
 }
 
 void outbox_destroy(outbox_handle_t outbox)
 {
-    outbox_cleanup(outbox, 0);
+#ifdef CONFIG_MQTT_OUTBOX_SPILL
+    if (outbox->store) {
+        /* the messages in the store are kept, for the next outbox to send them */
+        outbox_store_close(outbox->store);
+    }
+#endif
+    free(outbox->index);
+    free(outbox->arena);
     free(outbox);
 }
 
-#endif /* CONFIG_MQTT_CUSTOM_OUTBOX */
\ No newline at end of file
+#endif /* CONFIG_MQTT_CUSTOM_OUTBOX */
@@ -0,0 +1,362 @@
+/*
+ * This file is subject to the terms and conditions defined in
+ * file 'LICENSE', which is part of this source code package.
+ */
+#include "mqtt_config.h"
+
+#if defined(CONFIG_MQTT_OUTBOX_SPILL) && !defined(CONFIG_MQTT_CUSTOM_OUTBOX)
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_partition.h"
+#include "platform.h"
+#include "mqtt_outbox_store.h"
+
+static const char *TAG = "OUTBOX_STORE";
+
+/* Every sector in use starts with a header, its sequence number orders the sectors
+ * after a reboot. The records of the messages follow it, each aligned to 4 bytes. */
+#define STORE_SECTOR_MAGIC      0x424f514d
+#define STORE_RECORD_VALID      0x5aa5f00f
+#define STORE_RECORD_DELETED    0x00000000
+#define STORE_RECORD_FREE       0xffffffff
+
+#define STORE_ALIGN(x)          (((x) + 3) & ~3)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+} store_sector_header_t;
+
+/* A record is deleted by clearing its state, what flash allows without an erase */
+typedef struct {
+    uint32_t state;
+    uint16_t len;
+    uint16_t msg_id;
+    uint8_t msg_type;
+    uint8_t reserved;
+    uint16_t crc;
+} store_record_header_t;
+
+typedef enum {
+    STORE_SECTOR_DIRTY = 0,     /*!< Not known to be erased */
+    STORE_SECTOR_FREE,          /*!< Erased */
+    STORE_SECTOR_USED,          /*!< Holds a header and records */
+} store_sector_state_t;
+
+struct outbox_store {
+    const esp_partition_t *partition;
+    int sector_count;
+    uint8_t *sector_state;
+    uint16_t *live;             /*!< Records not deleted in every sector */
+    int write_sector;           /*!< Sector appended to, -1 before the first append */
+    uint32_t write_offset;
+    uint32_t seq;
+    int read_sector;            /*!< Position of the next record to load */
+    uint32_t read_offset;
+    store_record_header_t peeked;
+    int count;                  /*!< Records not loaded yet */
+};
+
+static const esp_partition_t *s_open_partition;
+
+/* CRC-16/CCITT a nibble at a time, the table of a byte at a time would take 512 bytes of RAM */
+static const uint16_t s_crc16_nibble[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+};
+
+static uint16_t store_crc16(uint16_t crc, const uint8_t *data, int len)
+{
+    while (len--) {
+        crc = (crc << 4) ^ s_crc16_nibble[(crc >> 12) ^ (*data >> 4)];
+        crc = (crc << 4) ^ s_crc16_nibble[(crc >> 12) ^ (*data++ & 0x0f)];
+    }
+    return crc;
+}
+
+static uint16_t store_record_crc(const store_record_header_t *header, const uint8_t *data)
+{
+    uint16_t crc = store_crc16(0xffff, (const uint8_t *)&header->len, 5);
+    return store_crc16(crc, data, header->len);
+}
+
+static uint32_t store_record_size(const store_record_header_t *header)
+{
+    return STORE_ALIGN(sizeof(store_record_header_t) + header->len);
+}
+
+/* Reads the header of the record at offset, returns false past the last record of the sector */
+static bool store_read_record(outbox_store_handle_t store, int sector, uint32_t offset, store_record_header_t *header)
+{
+    if (offset + sizeof(store_record_header_t) > SPI_FLASH_SEC_SIZE ||
+            esp_partition_read(store->partition, sector * SPI_FLASH_SEC_SIZE + offset, header, sizeof(*header)) != ESP_OK) {
+        return false;
+    }
+    if (header->state != STORE_RECORD_VALID && header->state != STORE_RECORD_DELETED) {
+        return false;
+    }
+    return offset + store_record_size(header) <= SPI_FLASH_SEC_SIZE;
+}
+
+/* Counts the valid records of a sector, and finds where the next one would be written. A record
+ * torn by a reset, or otherwise corrupted, ends the sector: nothing is appended to it any more. */
+static void store_scan_sector(outbox_store_handle_t store, int sector, uint8_t *buffer)
+{
+    store_record_header_t header = { .state = STORE_RECORD_FREE };
+    uint32_t offset = sizeof(store_sector_header_t);
+
+    store->live[sector] = 0;
+    while (store_read_record(store, sector, offset, &header)) {
+        if (header.state == STORE_RECORD_VALID) {
+            if (esp_partition_read(store->partition, sector * SPI_FLASH_SEC_SIZE + offset + sizeof(header),
+                                   buffer, header.len) != ESP_OK ||
+                    store_record_crc(&header, buffer) != header.crc) {
+                ESP_LOGW(TAG, "Corrupted record at 0x%x, skip the rest of the sector",
+                         sector * SPI_FLASH_SEC_SIZE + offset);
+                offset = SPI_FLASH_SEC_SIZE;
+                break;
+            }
+            store->live[sector]++;
+        }
+        offset += store_record_size(&header);
+    }
+    if (offset + sizeof(header) <= SPI_FLASH_SEC_SIZE && header.state != STORE_RECORD_FREE) {
+        /* a record header was started but not finished */
+        offset = SPI_FLASH_SEC_SIZE;
+    }
+    store->count += store->live[sector];
+    if (sector == store->write_sector) {
+        store->write_offset = offset;
+    }
+}
+
+static esp_err_t store_erase_sector(outbox_store_handle_t store, int sector)
+{
+    esp_err_t err = esp_partition_erase_range(store->partition, sector * SPI_FLASH_SEC_SIZE, SPI_FLASH_SEC_SIZE);
+    store->sector_state[sector] = err == ESP_OK ? STORE_SECTOR_FREE : STORE_SECTOR_DIRTY;
+    return err;
+}
+
+outbox_store_handle_t outbox_store_open(const char *label)
+{
+    const esp_partition_t *partition;
+    store_sector_header_t header;
+    outbox_store_handle_t store;
+    uint8_t *buffer;
+    int i, sector;
+
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (partition == NULL || partition->size < 2 * SPI_FLASH_SEC_SIZE) {
+        ESP_LOGE(TAG, "No partition %s of 2 sectors at least", label);
+        return NULL;
+    }
+    if (partition == s_open_partition) {
+        ESP_LOGE(TAG, "Partition %s is used by another outbox", label);
+        return NULL;
+    }
+    store = calloc(1, sizeof(struct outbox_store));
+    ESP_MEM_CHECK(TAG, store, return NULL);
+    store->partition = partition;
+    store->sector_count = partition->size / SPI_FLASH_SEC_SIZE;
+    store->sector_state = calloc(store->sector_count, sizeof(uint8_t));
+    store->live = calloc(store->sector_count, sizeof(uint16_t));
+    buffer = malloc(SPI_FLASH_SEC_SIZE);
+    ESP_MEM_CHECK(TAG, store->sector_state && store->live && buffer, {
+        free(buffer);
+        outbox_store_close(store);
+        return NULL;
+    });
+
+    /* the last sector written is the one of the highest sequence number */
+    store->write_sector = -1;
+    for (i = 0; i < store->sector_count; i++) {
+        if (esp_partition_read(partition, i * SPI_FLASH_SEC_SIZE, &header, sizeof(header)) != ESP_OK ||
+                header.magic != STORE_SECTOR_MAGIC) {
+            continue;
+        }
+        store->sector_state[i] = STORE_SECTOR_USED;
+        if (store->write_sector < 0 || (int32_t)(header.seq - store->seq) > 0) {
+            store->write_sector = i;
+            store->seq = header.seq;
+        }
+    }
+
+    /* sectors are written in turn, so the one after the last written is the oldest */
+    for (i = 1; store->write_sector >= 0 && i <= store->sector_count; i++) {
+        sector = (store->write_sector + i) % store->sector_count;
+        if (store->sector_state[sector] != STORE_SECTOR_USED) {
+            continue;
+        }
+        store_scan_sector(store, sector, buffer);
+        if (store->live[sector] == 0 && sector != store->write_sector) {
+            store->sector_state[sector] = STORE_SECTOR_DIRTY;
+            continue;
+        }
+        if (store->read_offset == 0) {
+            store->read_sector = sector;
+            store->read_offset = sizeof(store_sector_header_t);
+        }
+    }
+    if (store->read_offset == 0) {
+        store->read_sector = store->write_sector;
+        store->read_offset = sizeof(store_sector_header_t);
+    }
+    free(buffer);
+    s_open_partition = partition;
+    ESP_LOGI(TAG, "Partition %s of %d sectors holds %d messages", label, store->sector_count, store->count);
+    return store;
+}
+
+void outbox_store_close(outbox_store_handle_t store)
+{
+    if (s_open_partition == store->partition) {
+        s_open_partition = NULL;
+    }
+    free(store->sector_state);
+    free(store->live);
+    free(store);
+}
+
+/* Starts the sector after the write sector, unless it holds records not deleted */
+static esp_err_t store_next_write_sector(outbox_store_handle_t store)
+{
+    store_sector_header_t header;
+    int sector = (store->write_sector + 1) % store->sector_count;
+    esp_err_t err;
+
+    if (store->sector_state[sector] == STORE_SECTOR_USED) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (store->sector_state[sector] == STORE_SECTOR_DIRTY && (err = store_erase_sector(store, sector)) != ESP_OK) {
+        return err;
+    }
+    header.magic = STORE_SECTOR_MAGIC;
+    header.seq = store->seq + 1;
+    err = esp_partition_write(store->partition, sector * SPI_FLASH_SEC_SIZE, &header, sizeof(header));
+    if (err != ESP_OK) {
+        store->sector_state[sector] = STORE_SECTOR_DIRTY;
+        return err;
+    }
+    if (store->write_sector >= 0 && store->live[store->write_sector] == 0) {
+        store_erase_sector(store, store->write_sector);
+    }
+    if (store->count == 0) {
+        store->read_sector = sector;
+        store->read_offset = sizeof(header);
+    }
+    store->sector_state[sector] = STORE_SECTOR_USED;
+    store->live[sector] = 0;
+    store->write_sector = sector;
+    store->write_offset = sizeof(header);
+    store->seq = header.seq;
+    return ESP_OK;
+}
+
+esp_err_t outbox_store_append(outbox_store_handle_t store, const uint8_t *data, int len, int msg_id, int msg_type)
+{
+    store_record_header_t header = {
+        .state = STORE_RECORD_VALID,
+        .len = len,
+        .msg_id = msg_id,
+        .msg_type = msg_type,
+        .reserved = 0xff,
+    };
+    uint32_t address, state = STORE_RECORD_DELETED;
+    esp_err_t err;
+
+    if (sizeof(store_sector_header_t) + store_record_size(&header) > SPI_FLASH_SEC_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (store->write_sector < 0 || store->write_offset + store_record_size(&header) > SPI_FLASH_SEC_SIZE) {
+        if ((err = store_next_write_sector(store)) != ESP_OK) {
+            return err;
+        }
+    }
+    header.crc = store_record_crc(&header, data);
+    address = store->write_sector * SPI_FLASH_SEC_SIZE + store->write_offset;
+    /* on an error, the record is skipped, or ends the sector after a reboot */
+    store->write_offset += store_record_size(&header);
+    if ((err = esp_partition_write(store->partition, address, &header, sizeof(header))) != ESP_OK ||
+            (err = esp_partition_write(store->partition, address + sizeof(header), data, len)) != ESP_OK) {
+        esp_partition_write(store->partition, address, &state, sizeof(state));
+        return err;
+    }
+    store->live[store->write_sector]++;
+    store->count++;
+    return ESP_OK;
+}
+
+int outbox_store_peek(outbox_store_handle_t store, int *msg_id, int *msg_type)
+{
+    while (store->count > 0) {
+        if (!store_read_record(store, store->read_sector, store->read_offset, &store->peeked)) {
+            if (store->read_sector == store->write_sector) {
+                ESP_LOGE(TAG, "%d messages missing", store->count);
+                store->count = 0;
+                break;
+            }
+            /* the records not loaded yet are in the next sectors */
+            store->read_sector = (store->read_sector + 1) % store->sector_count;
+            store->read_offset = sizeof(store_sector_header_t);
+            continue;
+        }
+        if (store->peeked.state == STORE_RECORD_VALID) {
+            *msg_id = store->peeked.msg_id;
+            *msg_type = store->peeked.msg_type;
+            return store->peeked.len;
+        }
+        store->read_offset += store_record_size(&store->peeked);
+    }
+    return 0;
+}
+
+esp_err_t outbox_store_load(outbox_store_handle_t store, uint8_t *data, uint32_t *record)
+{
+    uint32_t address = store->read_sector * SPI_FLASH_SEC_SIZE + store->read_offset;
+    uint32_t state = STORE_RECORD_DELETED;
+    esp_err_t err;
+
+    err = esp_partition_read(store->partition, address + sizeof(store_record_header_t), data, store->peeked.len);
+    if (err != ESP_OK) {
+        return err;
+    }
+    store->read_offset += store_record_size(&store->peeked);
+    if (store_record_crc(&store->peeked, data) != store->peeked.crc) {
+        /* the record torn by a reset, not counted when the store was opened */
+        ESP_LOGE(TAG, "Corrupted record at 0x%x, msgid=%d", address, store->peeked.msg_id);
+        esp_partition_write(store->partition, address, &state, sizeof(state));
+        return ESP_ERR_INVALID_CRC;
+    }
+    store->count--;
+    *record = address;
+    return ESP_OK;
+}
+
+esp_err_t outbox_store_delete(outbox_store_handle_t store, uint32_t record)
+{
+    uint32_t state = STORE_RECORD_DELETED;
+    int sector = record / SPI_FLASH_SEC_SIZE;
+    esp_err_t err;
+
+    err = esp_partition_write(store->partition, record, &state, sizeof(state));
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (--store->live[sector] > 0 || sector == store->write_sector) {
+        return ESP_OK;
+    }
+    /* every record of the sector was loaded, the next ones to load are in the next sector */
+    if (sector == store->read_sector) {
+        store->read_sector = (sector + 1) % store->sector_count;
+        store->read_offset = sizeof(store_sector_header_t);
+    }
+    return store_erase_sector(store, sector);
+}
+
+int outbox_store_get_count(outbox_store_handle_t store)
+{
+    return store->count;
+}
+
+#endif /* CONFIG_MQTT_OUTBOX_SPILL */
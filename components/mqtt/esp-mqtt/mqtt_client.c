@@ -3,6 +3,7 @@
 
 #include "mqtt_client.h"
 #include "mqtt_msg.h"
+#include "mqtt_framer.h"
 #include "esp_transport.h"
 #include "esp_transport_tcp.h"
 #include "esp_transport_ssl.h"
@@ -22,10 +23,13 @@ typedef struct mqtt_state
     uint8_t *out_buffer;
     int in_buffer_length;
     int out_buffer_length;
+    mqtt_framer_t framer;
     uint32_t message_length;
     uint32_t message_length_read;
     mqtt_message_t *outbound_message;
     mqtt_connection_t mqtt_connection;
+    uint8_t *enqueue_buffer;
+    mqtt_connection_t enqueue_connection;
     uint16_t pending_msg_id;
     int pending_msg_type;
     int pending_publish_qos;
@@ -44,6 +48,8 @@ typedef struct {
     bool auto_reconnect;
     void *user_context;
     int network_timeout_ms;
+    int out_queue_size;
+    esp_mqtt_queue_drop_policy_t out_queue_drop_policy;
 } mqtt_config_storage_t;
 
 typedef enum {
@@ -70,10 +76,28 @@ struct esp_mqtt_client {
     bool wait_for_ping_resp;
     outbox_handle_t outbox;
     EventGroupHandle_t status_bits;
+    SemaphoreHandle_t api_lock;
+    SemaphoreHandle_t write_lock;
+    SemaphoreHandle_t queue_lock;
+    uint8_t *tx_buffer;
 };
 
 const static int STOPPED_BIT = BIT0;
 
+/* The API lock guards the pending message state and the processing of the received frames.
+ * The write lock guards out_buffer and outbound_message, and orders the writes to the
+ * transport: a message is encoded holding both, and the API lock is given back before it is
+ * written. The queue lock guards the outbox, tx_buffer and the encoder of
+ * esp_mqtt_client_enqueue(), which takes it only; it is never held over a transport call or
+ * an event handler, so enqueueing does not wait for the network. The locks are taken in the
+ * order API, write, queue. */
+#define MQTT_API_LOCK(c)          xSemaphoreTakeRecursive((c)->api_lock, portMAX_DELAY)
+#define MQTT_API_UNLOCK(c)        xSemaphoreGiveRecursive((c)->api_lock)
+#define MQTT_WRITE_LOCK(c)        xSemaphoreTake((c)->write_lock, portMAX_DELAY)
+#define MQTT_WRITE_UNLOCK(c)      xSemaphoreGive((c)->write_lock)
+#define MQTT_QUEUE_LOCK(c)        xSemaphoreTake((c)->queue_lock, portMAX_DELAY)
+#define MQTT_QUEUE_UNLOCK(c)      xSemaphoreGive((c)->queue_lock)
+
 static esp_err_t esp_mqtt_dispatch_event(esp_mqtt_client_handle_t client);
 static esp_err_t esp_mqtt_set_config(esp_mqtt_client_handle_t client, const esp_mqtt_client_config_t *config);
 static esp_err_t esp_mqtt_destroy_config(esp_mqtt_client_handle_t client);
@@ -100,6 +124,12 @@ static esp_err_t esp_mqtt_set_config(esp_mqtt_client_handle_t client, const esp_
     if (cfg->task_stack == 0) {
         cfg->task_stack = MQTT_TASK_STACK;
     }
+
+    cfg->out_queue_size = config->out_queue_size;
+    if (cfg->out_queue_size <= 0) {
+        cfg->out_queue_size = MQTT_OUT_QUEUE_SIZE;
+    }
+    cfg->out_queue_drop_policy = config->out_queue_drop_policy;
     err = ESP_ERR_NO_MEM;
     if (config->host) {
         cfg->host = strdup(config->host);
@@ -190,8 +220,13 @@ static esp_err_t esp_mqtt_destroy_config(esp_mqtt_client_handle_t client)
 
 static esp_err_t esp_mqtt_connect(esp_mqtt_client_handle_t client, int timeout_ms)
 {
-    int write_len, read_len, connect_rsp_code;
+    int write_len, read_len, connect_rsp_code, ret;
+    mqtt_frame_t frame;
+    uint32_t space;
+    uint8_t *buffer;
     client->wait_for_ping_resp = false;
+    MQTT_API_LOCK(client);
+    MQTT_WRITE_LOCK(client);
     mqtt_msg_init(&client->mqtt_state.mqtt_connection,
                   client->mqtt_state.out_buffer,
                   client->mqtt_state.out_buffer_length);
@@ -203,29 +238,35 @@ static esp_err_t esp_mqtt_connect(esp_mqtt_client_handle_t client, int timeout_m
     ESP_LOGI(TAG, "Sending MQTT CONNECT message, type: %d, id: %04X",
              client->mqtt_state.pending_msg_type,
              client->mqtt_state.pending_msg_id);
+    MQTT_API_UNLOCK(client);
 
     write_len = esp_transport_write(client->transport,
                                 (char *)client->mqtt_state.outbound_message->data,
                                 client->mqtt_state.outbound_message->length,
                                 client->config->network_timeout_ms);
+    MQTT_WRITE_UNLOCK(client);
     if (write_len < 0) {
         ESP_LOGE(TAG, "Writing failed, errno= %d", errno);
         return ESP_FAIL;
     }
-    read_len = esp_transport_read(client->transport,
-                              (char *)client->mqtt_state.in_buffer,
-                              client->mqtt_state.in_buffer_length,
-                              client->config->network_timeout_ms);
-    if (read_len < 0) {
-        ESP_LOGE(TAG, "Error network response");
-        return ESP_FAIL;
+    /* The broker may send more packets right behind the CONNACK, they stay in the framer */
+    mqtt_framer_reset(&client->mqtt_state.framer);
+    while ((ret = mqtt_framer_next(&client->mqtt_state.framer, &frame)) == 0) {
+        buffer = mqtt_framer_get_space(&client->mqtt_state.framer, &space);
+        read_len = esp_transport_read(client->transport, (char *)buffer, space, client->config->network_timeout_ms);
+        if (read_len <= 0) {
+            ESP_LOGE(TAG, "Error network response");
+            return ESP_FAIL;
+        }
+        mqtt_framer_commit(&client->mqtt_state.framer, read_len);
     }
 
-    if (mqtt_get_type(client->mqtt_state.in_buffer) != MQTT_MSG_TYPE_CONNACK) {
-        ESP_LOGE(TAG, "Invalid MSG_TYPE response: %d, read_len: %d", mqtt_get_type(client->mqtt_state.in_buffer), read_len);
+    if (ret < 0 || mqtt_get_type(frame.data) != MQTT_MSG_TYPE_CONNACK || frame.length < 4) {
+        ESP_LOGE(TAG, "Invalid MSG_TYPE response: %d, len: %d", mqtt_get_type(frame.data), frame.length);
         return ESP_FAIL;
     }
-    connect_rsp_code = mqtt_get_connect_return_code(client->mqtt_state.in_buffer);
+    client->event.session_present = mqtt_get_connect_session_present(frame.data);
+    connect_rsp_code = mqtt_get_connect_return_code(frame.data);
     switch (connect_rsp_code) {
         case CONNECTION_ACCEPTED:
             ESP_LOGD(TAG, "Connected");
@@ -344,6 +385,7 @@ esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *co
     client->mqtt_state.in_buffer = (uint8_t *)malloc(buffer_size);
     ESP_MEM_CHECK(TAG, client->mqtt_state.in_buffer, goto _mqtt_init_failed);
     client->mqtt_state.in_buffer_length = buffer_size;
+    mqtt_framer_init(&client->mqtt_state.framer, client->mqtt_state.in_buffer, buffer_size);
     client->mqtt_state.out_buffer = (uint8_t *)malloc(buffer_size);
     ESP_MEM_CHECK(TAG, client->mqtt_state.out_buffer, goto _mqtt_init_failed);
 
@@ -353,6 +395,12 @@ esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *co
     ESP_MEM_CHECK(TAG, client->outbox, goto _mqtt_init_failed);
     client->status_bits = xEventGroupCreate();
     ESP_MEM_CHECK(TAG, client->status_bits, goto _mqtt_init_failed);
+    client->api_lock = xSemaphoreCreateRecursiveMutex();
+    ESP_MEM_CHECK(TAG, client->api_lock, goto _mqtt_init_failed);
+    client->write_lock = xSemaphoreCreateMutex();
+    ESP_MEM_CHECK(TAG, client->write_lock, goto _mqtt_init_failed);
+    client->queue_lock = xSemaphoreCreateMutex();
+    ESP_MEM_CHECK(TAG, client->queue_lock, goto _mqtt_init_failed);
     return client;
 _mqtt_init_failed:
     esp_mqtt_client_destroy(client);
@@ -366,8 +414,19 @@ esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
     esp_transport_list_destroy(client->transport_list);
     outbox_destroy(client->outbox);
     vEventGroupDelete(client->status_bits);
+    if (client->api_lock) {
+        vSemaphoreDelete(client->api_lock);
+    }
+    if (client->write_lock) {
+        vSemaphoreDelete(client->write_lock);
+    }
+    if (client->queue_lock) {
+        vSemaphoreDelete(client->queue_lock);
+    }
     free(client->mqtt_state.in_buffer);
     free(client->mqtt_state.out_buffer);
+    free(client->mqtt_state.enqueue_buffer);
+    free(client->tx_buffer);
     free(client);
     return ESP_OK;
 }
@@ -438,6 +497,7 @@ esp_err_t esp_mqtt_client_set_uri(esp_mqtt_client_handle_t client, const char *u
     return ESP_OK;
 }
 
+//called with the write lock held
 static esp_err_t mqtt_write_data(esp_mqtt_client_handle_t client)
 {
     int write_len = esp_transport_write(client->transport,
@@ -458,7 +518,6 @@ static esp_err_t mqtt_write_data(esp_mqtt_client_handle_t client)
 
 static esp_err_t esp_mqtt_dispatch_event(esp_mqtt_client_handle_t client)
 {
-    client->event.msg_id = mqtt_get_id(client->mqtt_state.in_buffer, client->mqtt_state.in_buffer_length);
     client->event.user_context = client->config->user_context;
     client->event.client = client;
 
@@ -475,60 +534,37 @@ typedef struct {
     esp_transport_handle_t parent;
 } transport_ws_t;
 
-static void deliver_publish(esp_mqtt_client_handle_t client, uint8_t *message, int length)
+static void deliver_publish(esp_mqtt_client_handle_t client, mqtt_frame_t *frame)
 {
     const char *mqtt_topic, *mqtt_data;
     uint32_t mqtt_topic_length, mqtt_data_length;
-    uint32_t mqtt_len, mqtt_offset = 0, total_mqtt_len = 0;
-    int len_read;
-    esp_transport_handle_t transport = client->transport;
-
-    do
-    {
-        if (total_mqtt_len == 0) {
-            mqtt_topic_length = length;
-            mqtt_topic = mqtt_get_publish_topic(message, &mqtt_topic_length);
-            mqtt_data_length = length;
-            mqtt_data = mqtt_get_publish_data(message, &mqtt_data_length);
-            total_mqtt_len = client->mqtt_state.message_length - client->mqtt_state.message_length_read + mqtt_data_length;
-            mqtt_len = mqtt_data_length;
-            /* any further reading only the underlying payload */
-            transport = esp_transport_get_payload_transport_handle(transport);
-        } else {
-            mqtt_len = len_read;
-            mqtt_data = (const char*)client->mqtt_state.in_buffer;
-            mqtt_topic = NULL;
-            mqtt_topic_length = 0;
-        }
 
-        ESP_LOGD(TAG, "Get data len= %d, topic len=%d", mqtt_len, mqtt_topic_length);
-        client->event.event_id = MQTT_EVENT_DATA;
-        client->event.data = (char *)mqtt_data;
-        client->event.data_len = mqtt_len;
-        client->event.total_data_len = total_mqtt_len;
-        client->event.current_data_offset = mqtt_offset;
-        client->event.topic = (char *)mqtt_topic;
-        client->event.topic_len = mqtt_topic_length;
-        esp_mqtt_dispatch_event(client);
-
-        mqtt_offset += mqtt_len;
-        if (client->mqtt_state.message_length_read >= client->mqtt_state.message_length) {
-            break;
-        }
-
-        len_read = esp_transport_read(transport,
-                                  (char *)client->mqtt_state.in_buffer,
-                                  client->mqtt_state.message_length - client->mqtt_state.message_length_read > client->mqtt_state.in_buffer_length ?
-                                  client->mqtt_state.in_buffer_length : client->mqtt_state.message_length - client->mqtt_state.message_length_read,
-                                  client->config->network_timeout_ms);
-        if (len_read <= 0) {
-            ESP_LOGE(TAG, "Read error or timeout: %d", errno);
-            break;
-        }
-        client->mqtt_state.message_length_read += len_read;
-    } while (1);
+    if (frame->offset == 0) {
+        mqtt_topic_length = frame->length;
+        mqtt_topic = mqtt_get_publish_topic(frame->data, &mqtt_topic_length);
+        mqtt_data_length = frame->length;
+        mqtt_data = mqtt_get_publish_data(frame->data, &mqtt_data_length);
+        /* the payload runs to the end of the packet, the rest of it comes in the next frames */
+        client->mqtt_state.message_length = frame->total_length - frame->length + mqtt_data_length;
+        client->mqtt_state.message_length_read = 0;
+    } else {
+        mqtt_data = (const char *)frame->data;
+        mqtt_data_length = frame->length;
+        mqtt_topic = NULL;
+        mqtt_topic_length = 0;
+    }
 
+    ESP_LOGD(TAG, "Get data len= %d, topic len=%d", mqtt_data_length, mqtt_topic_length);
+    client->event.event_id = MQTT_EVENT_DATA;
+    client->event.data = (char *)mqtt_data;
+    client->event.data_len = mqtt_data_length;
+    client->event.total_data_len = client->mqtt_state.message_length;
+    client->event.current_data_offset = client->mqtt_state.message_length_read;
+    client->event.topic = (char *)mqtt_topic;
+    client->event.topic_len = mqtt_topic_length;
+    esp_mqtt_dispatch_event(client);
 
+    client->mqtt_state.message_length_read += mqtt_data_length;
 }
 
 static bool is_valid_mqtt_msg(esp_mqtt_client_handle_t client, int msg_type, int msg_id)
@@ -537,7 +573,10 @@ static bool is_valid_mqtt_msg(esp_mqtt_client_handle_t client, int msg_type, int
     if (client->mqtt_state.pending_msg_count == 0) {
         return false;
     }
-    if (outbox_delete(client->outbox, msg_id, msg_type) == ESP_OK) {
+    MQTT_QUEUE_LOCK(client);
+    esp_err_t err = outbox_delete(client->outbox, msg_id, msg_type);
+    MQTT_QUEUE_UNLOCK(client);
+    if (err == ESP_OK) {
         client->mqtt_state.pending_msg_count --;
         return true;
     }
@@ -553,40 +592,40 @@ static void mqtt_enqueue(esp_mqtt_client_handle_t client)
 {
     ESP_LOGD(TAG, "mqtt_enqueue id: %d, type=%d successful",
              client->mqtt_state.pending_msg_id, client->mqtt_state.pending_msg_type);
-    //lock mutex
+    //called with the API and write locks held
     if (client->mqtt_state.pending_msg_count > 0) {
         //Copy to queue buffer
-        outbox_enqueue(client->outbox,
-                       client->mqtt_state.outbound_message->data,
-                       client->mqtt_state.outbound_message->length,
-                       client->mqtt_state.pending_msg_id,
-                       client->mqtt_state.pending_msg_type,
-                       platform_tick_get_ms());
-    }
-    //unlock
+        //It is sent by the caller, the MQTT task must not send it again
+        MQTT_QUEUE_LOCK(client);
+        outbox_item_handle_t item = outbox_enqueue(client->outbox,
+                                    client->mqtt_state.outbound_message->data,
+                                    client->mqtt_state.outbound_message->length,
+                                    client->mqtt_state.pending_msg_id,
+                                    client->mqtt_state.pending_msg_type,
+                                    platform_tick_get_ms());
+        if (item) {
+            outbox_set_item_pending(client->outbox, item, platform_tick_get_ms());
+        }
+        MQTT_QUEUE_UNLOCK(client);
+    }
 }
 
-static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client)
+static void mqtt_process_packet(esp_mqtt_client_handle_t client, mqtt_frame_t *frame)
 {
-    int read_len;
     uint8_t msg_type;
     uint8_t msg_qos;
     uint16_t msg_id;
 
-    read_len = esp_transport_read(client->transport, (char *)client->mqtt_state.in_buffer, client->mqtt_state.in_buffer_length, 1000);
-
-    if (read_len < 0) {
-        ESP_LOGE(TAG, "Read error or end of stream");
-        return ESP_FAIL;
-    }
-
-    if (read_len == 0) {
-        return ESP_OK;
+    if (frame->offset > 0) {
+        /* the next chunk of a PUBLISH packet longer than the buffer */
+        deliver_publish(client, frame);
+        return;
     }
 
-    msg_type = mqtt_get_type(client->mqtt_state.in_buffer);
-    msg_qos = mqtt_get_qos(client->mqtt_state.in_buffer);
-    msg_id = mqtt_get_id(client->mqtt_state.in_buffer, client->mqtt_state.in_buffer_length);
+    msg_type = mqtt_get_type(frame->data);
+    msg_qos = mqtt_get_qos(frame->data);
+    msg_id = mqtt_get_id(frame->data, frame->length);
+    client->event.msg_id = msg_id;
 
     ESP_LOGD(TAG, "msg_type=%d, msg_id=%d", msg_type, msg_id);
     switch (msg_type)
@@ -606,27 +645,24 @@ static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client)
             }
             break;
         case MQTT_MSG_TYPE_PUBLISH:
-            if (msg_qos == 1) {
-                client->mqtt_state.outbound_message = mqtt_msg_puback(&client->mqtt_state.mqtt_connection, msg_id);
-            }
-            else if (msg_qos == 2) {
-                client->mqtt_state.outbound_message = mqtt_msg_pubrec(&client->mqtt_state.mqtt_connection, msg_id);
-            }
-
             if (msg_qos == 1 || msg_qos == 2) {
                 ESP_LOGD(TAG, "Queue response QoS: %d", msg_qos);
 
+                MQTT_WRITE_LOCK(client);
+                if (msg_qos == 1) {
+                    client->mqtt_state.outbound_message = mqtt_msg_puback(&client->mqtt_state.mqtt_connection, msg_id);
+                } else {
+                    client->mqtt_state.outbound_message = mqtt_msg_pubrec(&client->mqtt_state.mqtt_connection, msg_id);
+                }
                 if (mqtt_write_data(client) != ESP_OK) {
                     ESP_LOGE(TAG, "Error write qos msg repsonse, qos = %d", msg_qos);
                     // TODO: Shoule reconnect?
                     // return ESP_FAIL;
                 }
+                MQTT_WRITE_UNLOCK(client);
             }
-            client->mqtt_state.message_length_read = read_len;
-            client->mqtt_state.message_length = mqtt_get_total_length(client->mqtt_state.in_buffer, client->mqtt_state.message_length_read);
-            ESP_LOGI(TAG, "deliver_publish, message_length_read=%d, message_length=%d", read_len, client->mqtt_state.message_length);
-
-            deliver_publish(client, client->mqtt_state.in_buffer, client->mqtt_state.message_length_read);
+            ESP_LOGD(TAG, "deliver_publish, length=%d, total_length=%d", frame->length, frame->total_length);
+            deliver_publish(client, frame);
             break;
         case MQTT_MSG_TYPE_PUBACK:
             if (is_valid_mqtt_msg(client, MQTT_MSG_TYPE_PUBLISH, msg_id)) {
@@ -638,13 +674,17 @@ static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client)
             break;
         case MQTT_MSG_TYPE_PUBREC:
             ESP_LOGD(TAG, "received MQTT_MSG_TYPE_PUBREC");
+            MQTT_WRITE_LOCK(client);
             client->mqtt_state.outbound_message = mqtt_msg_pubrel(&client->mqtt_state.mqtt_connection, msg_id);
             mqtt_write_data(client);
+            MQTT_WRITE_UNLOCK(client);
             break;
         case MQTT_MSG_TYPE_PUBREL:
             ESP_LOGD(TAG, "received MQTT_MSG_TYPE_PUBREL");
+            MQTT_WRITE_LOCK(client);
             client->mqtt_state.outbound_message = mqtt_msg_pubcomp(&client->mqtt_state.mqtt_connection, msg_id);
             mqtt_write_data(client);
+            MQTT_WRITE_UNLOCK(client);
 
             break;
         case MQTT_MSG_TYPE_PUBCOMP:
@@ -660,10 +700,129 @@ static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client)
             client->wait_for_ping_resp = false;
             break;
     }
+}
 
+/* Processes every packet, or chunk of a long PUBLISH packet, read completely */
+static esp_err_t mqtt_process_frames(esp_mqtt_client_handle_t client)
+{
+    mqtt_frame_t frame;
+    int ret;
+
+    while ((ret = mqtt_framer_next(&client->mqtt_state.framer, &frame)) > 0) {
+        mqtt_process_packet(client, &frame);
+    }
+    if (ret < 0) {
+        ESP_LOGE(TAG, "Malformed packet, or packet longer than the buffer");
+        return ESP_FAIL;
+    }
     return ESP_OK;
 }
 
+static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client)
+{
+    int read_len, timeout_ms;
+    uint32_t space;
+    uint8_t *buffer;
+
+    /* packets read along with the CONNACK */
+    MQTT_API_LOCK(client);
+    esp_err_t err = mqtt_process_frames(client);
+    MQTT_API_UNLOCK(client);
+    /* once messages are queued, the wait for data is cut short to write them in time */
+    MQTT_QUEUE_LOCK(client);
+    timeout_ms = client->tx_buffer ? MQTT_TX_FLUSH_INTERVAL_MS : 1000;
+    MQTT_QUEUE_UNLOCK(client);
+    if (err != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    buffer = mqtt_framer_get_space(&client->mqtt_state.framer, &space);
+    read_len = esp_transport_read(client->transport, (char *)buffer, space, timeout_ms);
+
+    if (read_len < 0) {
+        ESP_LOGE(TAG, "Read error or end of stream");
+        return ESP_FAIL;
+    }
+
+    if (read_len == 0) {
+        return ESP_OK;
+    }
+
+    mqtt_framer_commit(&client->mqtt_state.framer, read_len);
+    MQTT_API_LOCK(client);
+    err = mqtt_process_frames(client);
+    MQTT_API_UNLOCK(client);
+    return err;
+}
+
+/* Marks a queued message sent: QoS 0 messages are done with, the others wait for their acknowledgement.
+ * Called with the API and queue locks held. */
+static void mqtt_queued_sent(esp_mqtt_client_handle_t client, outbox_item_handle_t item, uint8_t *data, int msg_id)
+{
+    if (mqtt_get_qos(data) == 0) {
+        outbox_delete_item(client->outbox, item);
+        return;
+    }
+    outbox_set_item_pending(client->outbox, item, platform_tick_get_ms());
+    client->mqtt_state.pending_msg_count ++;
+}
+
+/* Writes the messages queued by esp_mqtt_client_enqueue(), as many as fit in the tx buffer with one write */
+static esp_err_t mqtt_write_queued(esp_mqtt_client_handle_t client)
+{
+    outbox_item_handle_t item;
+    uint8_t *data, *write_data;
+    int len, msg_id, msg_type, write_len;
+
+    for (;;) {
+        MQTT_API_LOCK(client);
+        MQTT_QUEUE_LOCK(client);
+        write_data = client->tx_buffer;
+        write_len = 0;
+        /* nothing is queued before the tx buffer is allocated */
+        while (write_data && (item = outbox_dequeue(client->outbox)) != NULL) {
+            data = outbox_item_get_data(item, &len, &msg_id, &msg_type);
+            if (write_len + len > MQTT_TX_BATCH_SIZE) {
+                break;
+            }
+            memcpy(client->tx_buffer + write_len, data, len);
+            write_len += len;
+            mqtt_queued_sent(client, item, data, msg_id);
+        }
+        if (write_data && write_len == 0 && item != NULL) {
+            /* longer than the tx buffer, it is written from the outbox, where a pending
+             * message stays until the MQTT task deletes it */
+            outbox_set_item_pending(client->outbox, item, platform_tick_get_ms());
+            write_data = data;
+            write_len = len;
+        } else {
+            item = NULL;
+        }
+        MQTT_QUEUE_UNLOCK(client);
+        MQTT_API_UNLOCK(client);
+
+        if (write_len == 0) {
+            return ESP_OK;
+        }
+        MQTT_WRITE_LOCK(client);
+        len = esp_transport_write(client->transport, (char *)write_data, write_len, client->config->network_timeout_ms);
+        MQTT_WRITE_UNLOCK(client);
+        if (item) {
+            MQTT_API_LOCK(client);
+            MQTT_QUEUE_LOCK(client);
+            mqtt_queued_sent(client, item, write_data, msg_id);
+            MQTT_QUEUE_UNLOCK(client);
+            MQTT_API_UNLOCK(client);
+        }
+        if (len <= 0) {
+            ESP_LOGE(TAG, "Error write queued data or timeout, written len = %d", len);
+            return ESP_FAIL;
+        }
+        ESP_LOGD(TAG, "Sent %d bytes of queued messages", write_len);
+        client->keepalive_tick = platform_tick_get_ms();
+    }
+}
+
 static void esp_mqtt_task(void *pv)
 {
     esp_mqtt_client_handle_t client = (esp_mqtt_client_handle_t) pv;
@@ -707,7 +866,6 @@ static void esp_mqtt_task(void *pv)
                     break;
                 }
                 client->event.event_id = MQTT_EVENT_CONNECTED;
-                client->event.session_present = mqtt_get_connect_session_present(client->mqtt_state.in_buffer);
                 client->state = MQTT_STATE_CONNECTED;
                 esp_mqtt_dispatch_event(client);
 
@@ -719,6 +877,11 @@ static void esp_mqtt_task(void *pv)
                     break;
                 }
 
+                if (mqtt_write_queued(client) != ESP_OK) {
+                    esp_mqtt_abort_connection(client);
+                    break;
+                }
+
                 if (platform_tick_get_ms() - client->keepalive_tick > client->connect_info.keepalive * 1000 / 2) {
                     //No ping resp from last ping => Disconnected
                 	if(client->wait_for_ping_resp){
@@ -738,9 +901,11 @@ static void esp_mqtt_task(void *pv)
                 }
 
                 //Delete mesaage after 30 senconds
+                MQTT_QUEUE_LOCK(client);
                 outbox_delete_expired(client->outbox, platform_tick_get_ms(), OUTBOX_EXPIRED_TIMEOUT_MS);
                 //
                 outbox_cleanup(client->outbox, OUTBOX_MAX_SIZE);
+                MQTT_QUEUE_UNLOCK(client);
                 break;
             case MQTT_STATE_WAIT_TIMEOUT:
 
@@ -800,9 +965,12 @@ esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client)
 
 static esp_err_t esp_mqtt_client_ping(esp_mqtt_client_handle_t client)
 {
+    MQTT_WRITE_LOCK(client);
     client->mqtt_state.outbound_message = mqtt_msg_pingreq(&client->mqtt_state.mqtt_connection);
 
-    if (mqtt_write_data(client) != ESP_OK) {
+    esp_err_t err = mqtt_write_data(client);
+    MQTT_WRITE_UNLOCK(client);
+    if (err != ESP_OK) {
         ESP_LOGE(TAG, "Error sending ping");
         return ESP_FAIL;
     }
@@ -816,21 +984,27 @@ int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic
         ESP_LOGE(TAG, "Client has not connected");
         return -1;
     }
-    mqtt_enqueue(client); //move pending msg to outbox (if have)
+    MQTT_API_LOCK(client);
+    MQTT_WRITE_LOCK(client);
     client->mqtt_state.outbound_message = mqtt_msg_subscribe(&client->mqtt_state.mqtt_connection,
                                           topic, qos,
                                           &client->mqtt_state.pending_msg_id);
 
     client->mqtt_state.pending_msg_type = mqtt_get_type(client->mqtt_state.outbound_message->data);
     client->mqtt_state.pending_msg_count ++;
+    mqtt_enqueue(client); //move pending msg to outbox
+    int msg_id = client->mqtt_state.pending_msg_id;
+    MQTT_API_UNLOCK(client);
 
     if (mqtt_write_data(client) != ESP_OK) {
         ESP_LOGE(TAG, "Error to subscribe topic=%s, qos=%d", topic, qos);
+        MQTT_WRITE_UNLOCK(client);
         return -1;
     }
+    MQTT_WRITE_UNLOCK(client);
 
-    ESP_LOGD(TAG, "Sent subscribe topic=%s, id: %d, type=%d successful", topic, client->mqtt_state.pending_msg_id, client->mqtt_state.pending_msg_type);
-    return client->mqtt_state.pending_msg_id;
+    ESP_LOGD(TAG, "Sent subscribe topic=%s, id: %d successful", topic, msg_id);
+    return msg_id;
 }
 
 int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *topic)
@@ -839,7 +1013,8 @@ int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *top
         ESP_LOGE(TAG, "Client has not connected");
         return -1;
     }
-    mqtt_enqueue(client);
+    MQTT_API_LOCK(client);
+    MQTT_WRITE_LOCK(client);
     client->mqtt_state.outbound_message = mqtt_msg_unsubscribe(&client->mqtt_state.mqtt_connection,
                                           topic,
                                           &client->mqtt_state.pending_msg_id);
@@ -847,14 +1022,19 @@ int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *top
 
     client->mqtt_state.pending_msg_type = mqtt_get_type(client->mqtt_state.outbound_message->data);
     client->mqtt_state.pending_msg_count ++;
+    mqtt_enqueue(client);
+    int msg_id = client->mqtt_state.pending_msg_id;
+    MQTT_API_UNLOCK(client);
 
     if (mqtt_write_data(client) != ESP_OK) {
         ESP_LOGE(TAG, "Error to unsubscribe topic=%s", topic);
+        MQTT_WRITE_UNLOCK(client);
         return -1;
     }
+    MQTT_WRITE_UNLOCK(client);
 
-    ESP_LOGD(TAG, "Sent Unsubscribe topic=%s, id: %d, successful", topic, client->mqtt_state.pending_msg_id);
-    return client->mqtt_state.pending_msg_id;
+    ESP_LOGD(TAG, "Sent Unsubscribe topic=%s, id: %d, successful", topic, msg_id);
+    return msg_id;
 }
 
 int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain)
@@ -868,6 +1048,8 @@ int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic,
         len = strlen(data);
     }
 
+    MQTT_API_LOCK(client);
+    MQTT_WRITE_LOCK(client);
     mqtt_message_t *publish_msg = mqtt_msg_publish(&client->mqtt_state.mqtt_connection,
                                   topic, data, len,
                                   qos, retain,
@@ -875,20 +1057,81 @@ int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic,
 
     /* We have to set as pending all the qos>0 messages) */
     if (qos > 0) {
-        mqtt_enqueue(client);
         client->mqtt_state.outbound_message = publish_msg;
         client->mqtt_state.pending_msg_type = mqtt_get_type(client->mqtt_state.outbound_message->data);
         client->mqtt_state.pending_msg_id = pending_msg_id;
         client->mqtt_state.pending_msg_count ++;
+        mqtt_enqueue(client);
     } else {
         client->mqtt_state.outbound_message = publish_msg;
     }
+    MQTT_API_UNLOCK(client);
 
     if (mqtt_write_data(client) != ESP_OK) {
         ESP_LOGE(TAG, "Error to public data to topic=%s, qos=%d", topic, qos);
+        MQTT_WRITE_UNLOCK(client);
         return -1;
     }
+    MQTT_WRITE_UNLOCK(client);
     return pending_msg_id;
 }
 
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain)
+{
+    uint16_t msg_id = 0;
+    mqtt_message_t *publish_msg;
+    outbox_item_handle_t item;
+
+    if (len <= 0) {
+        len = strlen(data);
+    }
+
+    /* encoded with an encoder of its own, holding the queue lock only */
+    MQTT_QUEUE_LOCK(client);
+    if (client->mqtt_state.enqueue_buffer == NULL) {
+        client->mqtt_state.enqueue_buffer = malloc(client->mqtt_state.out_buffer_length);
+        ESP_MEM_CHECK(TAG, client->mqtt_state.enqueue_buffer, goto _mqtt_enqueue_failed);
+        mqtt_msg_init(&client->mqtt_state.enqueue_connection,
+                      client->mqtt_state.enqueue_buffer,
+                      client->mqtt_state.out_buffer_length);
+    }
+    if (client->tx_buffer == NULL) {
+        client->tx_buffer = malloc(MQTT_TX_BATCH_SIZE);
+        ESP_MEM_CHECK(TAG, client->tx_buffer, goto _mqtt_enqueue_failed);
+    }
+    /* the limit is on the messages queued in RAM, with a spill partition the oldest one is moved
+     * to flash to make room, and one is dropped only once the partition is full */
+    if (outbox_get_ram_queued_count(client->outbox) >= client->config->out_queue_size &&
+            outbox_spill_oldest(client->outbox) != ESP_OK) {
+        if (client->config->out_queue_drop_policy != MQTT_QUEUE_DROP_OLDEST) {
+            ESP_LOGW(TAG, "Queue full, drop the message to topic=%s", topic);
+            goto _mqtt_enqueue_failed;
+        }
+        item = outbox_dequeue(client->outbox);
+        if (item == NULL) {
+            ESP_LOGW(TAG, "Queue full, drop the message to topic=%s", topic);
+            goto _mqtt_enqueue_failed;
+        }
+        ESP_LOGW(TAG, "Queue full, drop the oldest message");
+        outbox_delete_item(client->outbox, item);
+    }
+
+    publish_msg = mqtt_msg_publish(&client->mqtt_state.enqueue_connection,
+                                   topic, data, len,
+                                   qos, retain,
+                                   &msg_id);
+    if (publish_msg->length == 0) {
+        ESP_LOGE(TAG, "Error to encode data to topic=%s, qos=%d", topic, qos);
+        goto _mqtt_enqueue_failed;
+    }
+    if (outbox_append(client->outbox, publish_msg->data, publish_msg->length,
+                      msg_id, MQTT_MSG_TYPE_PUBLISH, platform_tick_get_ms()) != ESP_OK) {
+        goto _mqtt_enqueue_failed;
+    }
+    MQTT_QUEUE_UNLOCK(client);
+    return msg_id;
+_mqtt_enqueue_failed:
+    MQTT_QUEUE_UNLOCK(client);
+    return -1;
+}
 
@@ -0,0 +1,476 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Check and measure the queued publishing of the MQTT client. The client is given a transport
+ * writing into a socket pair, whose other end a broker thread reads and frames. The test calls
+ * the function of the MQTT task writing the queued messages itself. It checks the drop policies
+ * of a full queue, the QoS 1 messages staying in the outbox until their PUBACK, a message longer
+ * than the tx buffer written alone, that messages are enqueued, and a PUBACK processed, while
+ * esp_mqtt_client_publish() is stuck in a write, and that publishers in 4 threads enqueueing, and one calling
+ * esp_mqtt_client_publish(), while the MQTT task writes, get every message to the broker whole
+ * and in order. Then messages are published by esp_mqtt_client_publish() and enqueued in bursts,
+ * counting the writes per message and timing the call of the publisher.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+
+/* The functions of the MQTT task are static, so the source of the client is compiled in */
+#include "../esp-mqtt/mqtt_client.c"
+
+#define BROKER_MAX_RECORDS  16384
+#define TEST_THREADS        4
+#define TEST_MESSAGES       2000
+#define TEST_SYNC_MESSAGES  500
+#define BENCH_MESSAGES      4000
+#define BENCH_RUNS          3
+
+typedef struct {
+    int qos;
+    uint16_t msg_id;
+    char payload[48];
+} broker_record_t;
+
+static int s_sock[2];
+static esp_transport_handle_t s_transport;
+static int s_write_calls;
+/* While set, a write waits for it to be cleared, for 2 seconds at most */
+static int s_stall_writes;
+static int s_write_stalled;
+
+/* What the broker thread got */
+static broker_record_t s_records[BROKER_MAX_RECORDS];
+static int s_record_count;
+static pthread_mutex_t s_broker_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int s_published_events;
+static int s_last_event_msg_id;
+
+static inline uint64_t bench_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void expect(int ok, const char *what)
+{
+    if (!ok) {
+        printf("check failed: %s\n", what);
+        exit(1);
+    }
+}
+
+static int pair_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms)
+{
+    int done = 0, n;
+
+    __atomic_add_fetch(&s_write_calls, 1, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&s_stall_writes, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&s_write_stalled, 1, __ATOMIC_RELEASE);
+        for (int i = 0; i < 2000 && __atomic_load_n(&s_stall_writes, __ATOMIC_ACQUIRE); i++) {
+            usleep(1000);
+        }
+        __atomic_store_n(&s_write_stalled, 0, __ATOMIC_RELEASE);
+    }
+    while (done < len) {
+        if ((n = write(s_sock[0], buffer + done, len - done)) <= 0) {
+            return -1;
+        }
+        done += n;
+    }
+    return len;
+}
+
+/* Nothing comes from the broker, the acknowledgements are handed to the client by the test */
+static int pair_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+{
+    return 0;
+}
+
+static int pair_close(esp_transport_handle_t t)
+{
+    return 0;
+}
+
+static int pair_poll(esp_transport_handle_t t, int timeout_ms)
+{
+    return 0;
+}
+
+static void *broker_task(void *arg)
+{
+    static uint8_t buffer[4096];
+    mqtt_framer_t framer;
+    mqtt_frame_t frame;
+    uint32_t space;
+    int n;
+
+    mqtt_framer_init(&framer, buffer, sizeof(buffer));
+    for (;;) {
+        uint8_t *p = mqtt_framer_get_space(&framer, &space);
+        if ((n = read(s_sock[1], p, space)) <= 0) {
+            return NULL;
+        }
+        mqtt_framer_commit(&framer, n);
+        while ((n = mqtt_framer_next(&framer, &frame)) > 0) {
+            uint32_t len = frame.length;
+            const char *data = mqtt_get_publish_data(frame.data, &len);
+
+            expect(frame.offset == 0 && mqtt_get_type(frame.data) == MQTT_MSG_TYPE_PUBLISH, "broker got a PUBLISH");
+            pthread_mutex_lock(&s_broker_lock);
+            expect(s_record_count < BROKER_MAX_RECORDS, "broker records");
+            broker_record_t *r = &s_records[s_record_count];
+            r->qos = mqtt_get_qos(frame.data);
+            r->msg_id = mqtt_get_id(frame.data, frame.length);
+            len = len < sizeof(r->payload) - 1 ? len : sizeof(r->payload) - 1;
+            memcpy(r->payload, data, len);
+            r->payload[len] = '\0';
+            s_record_count++;
+            pthread_mutex_unlock(&s_broker_lock);
+        }
+        expect(n == 0, "broker framing");
+    }
+}
+
+/* Waits for the broker to get count messages in all, and forgets them */
+static void broker_wait(int count, const char *what)
+{
+    for (int i = 0; i < 5000; i++) {
+        pthread_mutex_lock(&s_broker_lock);
+        int got = s_record_count;
+        pthread_mutex_unlock(&s_broker_lock);
+        if (got >= count) {
+            usleep(1000);
+            expect(s_record_count == count, what);
+            return;
+        }
+        usleep(1000);
+    }
+    expect(0, what);
+}
+
+static void broker_reset(void)
+{
+    pthread_mutex_lock(&s_broker_lock);
+    s_record_count = 0;
+    pthread_mutex_unlock(&s_broker_lock);
+}
+
+static esp_err_t record_event(esp_mqtt_event_handle_t event)
+{
+    if (event->event_id == MQTT_EVENT_PUBLISHED) {
+        s_published_events++;
+        s_last_event_msg_id = event->msg_id;
+    }
+    return ESP_OK;
+}
+
+static esp_mqtt_client_handle_t create_client(int queue_size, esp_mqtt_queue_drop_policy_t policy, int buffer_size)
+{
+    esp_mqtt_client_config_t config = {
+        .uri = "mqtt://127.0.0.1",
+        .client_id = "host",
+        .event_handle = record_event,
+        .buffer_size = buffer_size,
+        .out_queue_size = queue_size,
+        .out_queue_drop_policy = policy,
+    };
+    esp_mqtt_client_handle_t client = esp_mqtt_client_init(&config);
+
+    expect(client != NULL, "client init");
+    /* as if the MQTT task had connected */
+    client->transport = s_transport;
+    client->state = MQTT_STATE_CONNECTED;
+    mqtt_msg_init(&client->mqtt_state.mqtt_connection, client->mqtt_state.out_buffer, client->mqtt_state.out_buffer_length);
+    return client;
+}
+
+static void enqueue_numbered(esp_mqtt_client_handle_t client, int from, int to, int expected)
+{
+    char payload[16];
+
+    for (int i = from; i <= to; i++) {
+        snprintf(payload, sizeof(payload), "m%d", i);
+        expect(esp_mqtt_client_enqueue(client, "t", payload, 0, 0, 0) == expected, "enqueue result");
+    }
+}
+
+static void test_drop_policy(void)
+{
+    esp_mqtt_client_handle_t client = create_client(4, MQTT_QUEUE_DROP_NEWEST, 0);
+
+    broker_reset();
+    expect(mqtt_write_queued(client) == ESP_OK && s_record_count == 0, "nothing queued");
+    enqueue_numbered(client, 1, 4, 0);
+    enqueue_numbered(client, 5, 6, -1);
+    expect(mqtt_write_queued(client) == ESP_OK, "write queued");
+    broker_wait(4, "drop newest");
+    for (int i = 0; i < 4; i++) {
+        char expected[16];
+        snprintf(expected, sizeof(expected), "m%d", i + 1);
+        expect(strcmp(s_records[i].payload, expected) == 0, "drop newest keeps the first ones");
+    }
+    expect(outbox_get_queued_count(client->outbox) == 0 && outbox_get_size(client->outbox) == 0, "QoS 0 sent and deleted");
+    esp_mqtt_client_destroy(client);
+
+    client = create_client(4, MQTT_QUEUE_DROP_OLDEST, 0);
+    broker_reset();
+    enqueue_numbered(client, 1, 6, 0);
+    expect(mqtt_write_queued(client) == ESP_OK, "write queued");
+    broker_wait(4, "drop oldest");
+    for (int i = 0; i < 4; i++) {
+        char expected[16];
+        snprintf(expected, sizeof(expected), "m%d", i + 3);
+        expect(strcmp(s_records[i].payload, expected) == 0, "drop oldest keeps the last ones");
+    }
+    esp_mqtt_client_destroy(client);
+    printf("a full queue drops the message enqueued, or the oldest one\n");
+}
+
+static void test_qos1_and_long(void)
+{
+    static char long_payload[3000];
+    esp_mqtt_client_handle_t client = create_client(0, MQTT_QUEUE_DROP_NEWEST, 4096);
+    uint8_t puback[4] = { MQTT_MSG_TYPE_PUBACK << 4, 2 };
+    mqtt_frame_t frame = { puback, sizeof(puback), 0, sizeof(puback) };
+
+    broker_reset();
+    int msg_id = esp_mqtt_client_enqueue(client, "t/qos1", "acked", 0, 1, 0);
+    expect(msg_id > 0, "QoS 1 message id");
+    expect(mqtt_write_queued(client) == ESP_OK, "write queued");
+    broker_wait(1, "QoS 1 message");
+    expect(s_records[0].qos == 1 && s_records[0].msg_id == msg_id, "QoS 1 message written");
+    expect(outbox_get_queued_count(client->outbox) == 0 && outbox_get_size(client->outbox) > 0, "QoS 1 message pending");
+    expect(mqtt_write_queued(client) == ESP_OK && s_record_count == 1, "pending message not written again");
+
+    puback[2] = msg_id >> 8;
+    puback[3] = msg_id & 0xff;
+    s_published_events = 0;
+    mqtt_process_packet(client, &frame);
+    expect(s_published_events == 1 && s_last_event_msg_id == msg_id, "PUBLISHED event");
+    expect(outbox_get_size(client->outbox) == 0, "acknowledged message deleted");
+
+    /* A message longer than the tx buffer goes alone, from the outbox */
+    memset(long_payload, 'l', sizeof(long_payload) - 1);
+    broker_reset();
+    s_write_calls = 0;
+    enqueue_numbered(client, 1, 2, 0);
+    expect(esp_mqtt_client_enqueue(client, "t", long_payload, 0, 0, 0) == 0, "enqueue long");
+    enqueue_numbered(client, 3, 4, 0);
+    expect(mqtt_write_queued(client) == ESP_OK, "write queued");
+    broker_wait(5, "long message");
+    expect(s_write_calls == 3, "short, long and short writes");
+    expect(strcmp(s_records[1].payload, "m2") == 0 && s_records[2].payload[0] == 'l' &&
+           strcmp(s_records[3].payload, "m3") == 0, "long message in order");
+    esp_mqtt_client_destroy(client);
+    printf("QoS 1 messages wait for their PUBACK, longer ones than the tx buffer are written alone\n");
+}
+
+static void *stalled_publish_task(void *arg)
+{
+    expect(esp_mqtt_client_publish(arg, "t", "stalled", 0, 0, 0) == 0, "stalled publish");
+    return NULL;
+}
+
+static void test_stalled_write(void)
+{
+    esp_mqtt_client_handle_t client = create_client(16, MQTT_QUEUE_DROP_NEWEST, 0);
+    uint8_t puback[4] = { MQTT_MSG_TYPE_PUBACK << 4, 2 };
+    mqtt_frame_t frame = { puback, sizeof(puback), 0, sizeof(puback) };
+    pthread_t publisher;
+
+    broker_reset();
+    int msg_id = esp_mqtt_client_enqueue(client, "t/qos1", "acked", 0, 1, 0);
+    expect(msg_id > 0 && mqtt_write_queued(client) == ESP_OK, "QoS 1 message written");
+    broker_wait(1, "QoS 1 message");
+
+    s_stall_writes = 1;
+    pthread_create(&publisher, NULL, stalled_publish_task, client);
+    for (int i = 0; i < 2000 && !__atomic_load_n(&s_write_stalled, __ATOMIC_ACQUIRE); i++) {
+        usleep(1000);
+    }
+    expect(__atomic_load_n(&s_write_stalled, __ATOMIC_ACQUIRE), "publish stuck in a write");
+
+    /* neither waits for the write */
+    enqueue_numbered(client, 1, 8, 0);
+    puback[2] = msg_id >> 8;
+    puback[3] = msg_id & 0xff;
+    s_published_events = 0;
+    mqtt_process_packet(client, &frame);
+    expect(__atomic_load_n(&s_write_stalled, __ATOMIC_ACQUIRE), "enqueued while the write is stuck");
+    expect(s_published_events == 1 && s_last_event_msg_id == msg_id, "PUBACK processed while the write is stuck");
+
+    __atomic_store_n(&s_stall_writes, 0, __ATOMIC_RELEASE);
+    pthread_join(publisher, NULL);
+    expect(mqtt_write_queued(client) == ESP_OK, "write queued");
+    broker_wait(1 + 1 + 8, "stalled and queued messages");
+    expect(strcmp(s_records[1].payload, "stalled") == 0 && strcmp(s_records[9].payload, "m8") == 0,
+           "stalled message, then the queued ones");
+    esp_mqtt_client_destroy(client);
+    printf("messages are enqueued and acknowledged while a publisher is stuck in a write\n");
+}
+
+typedef struct {
+    esp_mqtt_client_handle_t client;
+    int index;
+    int dropped;
+} publisher_t;
+
+static int s_publishers_running;
+
+static void *enqueue_task(void *arg)
+{
+    publisher_t *p = arg;
+    char payload[32];
+
+    for (int i = 0; i < TEST_MESSAGES; i++) {
+        snprintf(payload, sizeof(payload), "q%d:%d", p->index, i);
+        while (esp_mqtt_client_enqueue(p->client, "t", payload, 0, 0, 0) < 0) {
+            p->dropped++;
+            sched_yield();
+        }
+    }
+    __atomic_sub_fetch(&s_publishers_running, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void *publish_task(void *arg)
+{
+    publisher_t *p = arg;
+    char payload[32];
+
+    for (int i = 0; i < TEST_SYNC_MESSAGES; i++) {
+        snprintf(payload, sizeof(payload), "s%d:%d", p->index, i);
+        expect(esp_mqtt_client_publish(p->client, "t", payload, 0, 0, 0) == 0, "publish");
+    }
+    __atomic_sub_fetch(&s_publishers_running, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void test_concurrent(void)
+{
+    esp_mqtt_client_handle_t client = create_client(16, MQTT_QUEUE_DROP_NEWEST, 0);
+    publisher_t publishers[TEST_THREADS + 1];
+    pthread_t threads[TEST_THREADS + 1];
+    int next[TEST_THREADS + 1] = { 0 }, dropped = 0;
+
+    broker_reset();
+    s_publishers_running = TEST_THREADS + 1;
+    for (int i = 0; i <= TEST_THREADS; i++) {
+        publishers[i] = (publisher_t) { client, i, 0 };
+        pthread_create(&threads[i], NULL, i < TEST_THREADS ? enqueue_task : publish_task, &publishers[i]);
+    }
+    /* the MQTT task */
+    while (__atomic_load_n(&s_publishers_running, __ATOMIC_ACQUIRE) > 0) {
+        expect(mqtt_write_queued(client) == ESP_OK, "write queued");
+        usleep(100);
+    }
+    expect(mqtt_write_queued(client) == ESP_OK, "write queued");
+    for (int i = 0; i <= TEST_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        dropped += publishers[i].dropped;
+    }
+    broker_wait(TEST_THREADS * TEST_MESSAGES + TEST_SYNC_MESSAGES, "every message");
+    for (int i = 0; i < s_record_count; i++) {
+        int thread, seq;
+        char kind;
+        expect(sscanf(s_records[i].payload, "%c%d:%d", &kind, &thread, &seq) == 3, "payload whole");
+        expect(kind == (thread < TEST_THREADS ? 'q' : 's'), "payload kind");
+        expect(seq == next[thread]++, "messages of a publisher in order");
+    }
+    esp_mqtt_client_destroy(client);
+    printf("%d threads enqueued %d messages and one published %d meanwhile, all whole and in order "
+           "(%d full queue retries)\n", TEST_THREADS, TEST_THREADS * TEST_MESSAGES, TEST_SYNC_MESSAGES, dropped);
+}
+
+static void bench(void)
+{
+    static const int bursts[] = { 1, 4, 16 };
+    char payload[33];
+    uint64_t best;
+
+    memset(payload, 'x', sizeof(payload) - 1);
+    payload[sizeof(payload) - 1] = '\0';
+
+    printf("%d QoS 0 messages of 32 bytes         writes/msg   ns/call\n", BENCH_MESSAGES);
+
+    esp_mqtt_client_handle_t client = create_client(16, MQTT_QUEUE_DROP_NEWEST, 0);
+    best = UINT64_MAX;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        broker_reset();
+        s_write_calls = 0;
+        uint64_t t0 = bench_ns();
+        for (int i = 0; i < BENCH_MESSAGES; i++) {
+            esp_mqtt_client_publish(client, "sensors/temp", payload, 0, 0, 0);
+        }
+        uint64_t t = bench_ns() - t0;
+        best = t < best ? t : best;
+        broker_wait(BENCH_MESSAGES, "bench publish");
+    }
+    printf("  esp_mqtt_client_publish()            %10.3f %9.1f\n",
+           (double)s_write_calls / BENCH_MESSAGES, (double)best / BENCH_MESSAGES);
+
+    for (int b = 0; b < sizeof(bursts) / sizeof(bursts[0]); b++) {
+        best = UINT64_MAX;
+        for (int run = 0; run < BENCH_RUNS; run++) {
+            uint64_t t = 0;
+            broker_reset();
+            s_write_calls = 0;
+            for (int i = 0; i < BENCH_MESSAGES; i += bursts[b]) {
+                uint64_t t0 = bench_ns();
+                for (int j = 0; j < bursts[b]; j++) {
+                    esp_mqtt_client_enqueue(client, "sensors/temp", payload, 0, 0, 0);
+                }
+                t += bench_ns() - t0;
+                mqtt_write_queued(client);
+            }
+            best = t < best ? t : best;
+            broker_wait(BENCH_MESSAGES, "bench enqueue");
+        }
+        printf("  esp_mqtt_client_enqueue(), %2d a flush %10.3f %9.1f\n",
+               bursts[b], (double)s_write_calls / BENCH_MESSAGES, (double)best / BENCH_MESSAGES);
+    }
+    esp_mqtt_client_destroy(client);
+}
+
+int main(void)
+{
+    pthread_t broker;
+
+    srandom(1);
+    expect(socketpair(AF_UNIX, SOCK_STREAM, 0, s_sock) == 0, "socket pair");
+    s_transport = esp_transport_init();
+    esp_transport_set_func(s_transport, NULL, pair_read, pair_write, pair_close, pair_poll, pair_poll, NULL);
+    pthread_create(&broker, NULL, broker_task, NULL);
+
+    test_drop_policy();
+    test_qos1_and_long();
+    test_stalled_write();
+    test_concurrent();
+    bench();
+
+    close(s_sock[0]);
+    pthread_join(broker, NULL);
+    esp_transport_destroy(s_transport);
+    printf("all client checks passed\n");
+    return 0;
+}
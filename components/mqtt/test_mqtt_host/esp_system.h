@@ -0,0 +1,21 @@
+// Host build stub of esp_system.h, for the client id and the message ids
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+    ESP_MAC_WIFI_STA,
+} esp_mac_type_t;
+
+static inline uint32_t esp_random(void)
+{
+    return (uint32_t)random();
+}
+
+static inline int esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+    memset(mac, 0, 6);
+    return 0;
+}
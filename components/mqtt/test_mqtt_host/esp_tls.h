@@ -0,0 +1,18 @@
+// Host build stub of esp_tls.h, the types named by the transport headers, the client is built without SSL
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef struct esp_tls_last_error {
+    esp_err_t last_error;
+    int       esp_tls_error_code;
+    int       esp_tls_flags;
+} esp_tls_last_error_t;
+
+typedef struct psk_key_hint {
+    const uint8_t *key;
+    const size_t   key_size;
+    const char    *hint;
+} psk_hint_key_t;
@@ -0,0 +1,417 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Check and measure the framer of the MQTT client. A stream of packets, with remaining lengths of
+ * 1 to 3 bytes and PUBLISH packets longer than the buffer, is fed to the framer in reads of the
+ * whole free space, of 1 byte, of 7 bytes and of pseudo random sizes. Every way has to return the
+ * same frames, the payload of each PUBLISH has to be put together again from them the way the
+ * client does, and the long PUBLISH packets have to come in chunks of the buffer length.
+ * Malformed remaining lengths, and packets longer than the buffer it cannot stream, are checked
+ * to be errors. Then a stream of short PUBLISH packets is framed from reads filling the 1024 byte
+ * buffer of the client, of which the former receive path handled one packet per read only.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "mqtt_framer.h"
+#include "mqtt_msg.h"
+
+#define TEST_BUFFER_SIZE    256
+#define TEST_MAX_PACKETS    16
+#define TEST_MAX_FRAMES     256
+#define BENCH_PACKETS       1000
+#define BENCH_REPEAT        100
+#define BENCH_PAYLOAD       48
+#define BENCH_RUNS          3
+
+typedef struct {
+    int type;
+    int qos;
+    uint16_t msg_id;
+    const char *topic;
+    const uint8_t *payload;
+    uint32_t payload_length;
+} test_packet_t;
+
+typedef struct {
+    int type;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t total_length;
+} test_frame_t;
+
+typedef enum {
+    READ_ALL,
+    READ_BYTE,
+    READ_SEVEN,
+    READ_RANDOM,
+} read_mode_t;
+
+static uint8_t s_stream[64 * 1024];
+static uint32_t s_stream_length;
+static test_packet_t s_packets[TEST_MAX_PACKETS];
+static int s_packet_count;
+
+/* What the consumer of the frames got, the client dispatches the same */
+static test_frame_t s_frames[TEST_MAX_FRAMES];
+static int s_frame_count;
+static uint8_t s_payloads[TEST_MAX_PACKETS][32 * 1024];
+static uint32_t s_payload_lengths[TEST_MAX_PACKETS];
+static uint32_t s_payload_totals[TEST_MAX_PACKETS];
+static uint16_t s_msg_ids[TEST_MAX_PACKETS];
+static char s_topics[TEST_MAX_PACKETS][64];
+static int s_packets_seen;
+
+int platform_random(int max)
+{
+    return rand() % max;
+}
+
+static inline uint64_t bench_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void expect(int ok, const char *what)
+{
+    if (!ok) {
+        printf("check failed: %s\n", what);
+        exit(1);
+    }
+}
+
+static void put_byte(uint8_t b)
+{
+    s_stream[s_stream_length++] = b;
+}
+
+static void put_remaining_length(uint32_t length)
+{
+    do {
+        uint8_t b = length % 128;
+        length /= 128;
+        put_byte(length ? b | 0x80 : b);
+    } while (length);
+}
+
+static void add_ack(int type, int flags, uint16_t msg_id)
+{
+    test_packet_t *p = &s_packets[s_packet_count++];
+
+    memset(p, 0, sizeof(*p));
+    p->type = type;
+    p->msg_id = msg_id;
+    put_byte(type << 4 | flags);
+    put_remaining_length(2);
+    put_byte(msg_id >> 8);
+    put_byte(msg_id & 0xff);
+}
+
+static void add_publish(const char *topic, const uint8_t *payload, uint32_t length, int qos, uint16_t msg_id)
+{
+    test_packet_t *p = &s_packets[s_packet_count++];
+    uint32_t topic_length = strlen(topic);
+
+    p->type = MQTT_MSG_TYPE_PUBLISH;
+    p->qos = qos;
+    p->msg_id = qos ? msg_id : 0;
+    p->topic = topic;
+    p->payload = payload;
+    p->payload_length = length;
+    put_byte(MQTT_MSG_TYPE_PUBLISH << 4 | qos << 1);
+    put_remaining_length(2 + topic_length + (qos ? 2 : 0) + length);
+    put_byte(topic_length >> 8);
+    put_byte(topic_length & 0xff);
+    memcpy(s_stream + s_stream_length, topic, topic_length);
+    s_stream_length += topic_length;
+    if (qos) {
+        put_byte(msg_id >> 8);
+        put_byte(msg_id & 0xff);
+    }
+    memcpy(s_stream + s_stream_length, payload, length);
+    s_stream_length += length;
+}
+
+/* Takes a frame apart the way mqtt_process_packet() and deliver_publish() of the client do */
+static void consume(mqtt_frame_t *frame)
+{
+    test_frame_t *f = &s_frames[s_frame_count++];
+    int n;
+
+    expect(s_frame_count <= TEST_MAX_FRAMES, "frame count");
+    if (frame->offset == 0) {
+        n = s_packets_seen++;
+        f->type = mqtt_get_type(frame->data);
+        s_msg_ids[n] = mqtt_get_id(frame->data, frame->length);
+        s_payload_lengths[n] = 0;
+        s_topics[n][0] = '\0';
+        if (f->type == MQTT_MSG_TYPE_PUBLISH) {
+            uint32_t topic_length = frame->length;
+            const char *topic = mqtt_get_publish_topic(frame->data, &topic_length);
+            uint32_t data_length = frame->length;
+            const char *data = mqtt_get_publish_data(frame->data, &data_length);
+
+            expect(topic != NULL && topic_length < sizeof(s_topics[n]), "topic of the first frame");
+            memcpy(s_topics[n], topic, topic_length);
+            s_topics[n][topic_length] = '\0';
+            s_payload_totals[n] = frame->total_length - frame->length + data_length;
+            memcpy(s_payloads[n], data, data_length);
+            s_payload_lengths[n] = data_length;
+        }
+    } else {
+        n = s_packets_seen - 1;
+        f->type = -1;
+        memcpy(s_payloads[n] + s_payload_lengths[n], frame->data, frame->length);
+        s_payload_lengths[n] += frame->length;
+    }
+    f->offset = frame->offset;
+    f->length = frame->length;
+    f->total_length = frame->total_length;
+}
+
+/* Feeds the stream to the framer like mqtt_process_receive() does, returns what mqtt_framer_next() returned last */
+static int feed(mqtt_framer_t *framer, const uint8_t *stream, uint32_t length, read_mode_t mode)
+{
+    uint32_t pos = 0, space, n;
+    mqtt_frame_t frame;
+    uint8_t *buffer;
+    int ret;
+
+    s_frame_count = 0;
+    s_packets_seen = 0;
+    for (;;) {
+        while ((ret = mqtt_framer_next(framer, &frame)) > 0) {
+            consume(&frame);
+        }
+        if (ret < 0 || pos == length) {
+            return ret;
+        }
+        buffer = mqtt_framer_get_space(framer, &space);
+        expect(space > 0, "free space after mqtt_framer_next() returned 0");
+        switch (mode) {
+        case READ_BYTE:
+            n = 1;
+            break;
+        case READ_SEVEN:
+            n = 7;
+            break;
+        case READ_RANDOM:
+            n = 1 + rand() % space;
+            break;
+        default:
+            n = space;
+            break;
+        }
+        if (n > space) {
+            n = space;
+        }
+        if (n > length - pos) {
+            n = length - pos;
+        }
+        memcpy(buffer, stream + pos, n);
+        pos += n;
+        mqtt_framer_commit(framer, n);
+    }
+}
+
+static void check_packets(const char *what)
+{
+    char msg[128];
+
+    snprintf(msg, sizeof(msg), "%s: packet count", what);
+    expect(s_packets_seen == s_packet_count, msg);
+    for (int i = 0; i < s_packet_count; i++) {
+        test_packet_t *p = &s_packets[i];
+
+        snprintf(msg, sizeof(msg), "%s: packet %d", what, i);
+        expect(s_msg_ids[i] == p->msg_id, msg);
+        if (p->type != MQTT_MSG_TYPE_PUBLISH) {
+            continue;
+        }
+        expect(strcmp(s_topics[i], p->topic) == 0, msg);
+        expect(s_payload_totals[i] == p->payload_length, msg);
+        expect(s_payload_lengths[i] == p->payload_length, msg);
+        expect(memcmp(s_payloads[i], p->payload, p->payload_length) == 0, msg);
+    }
+}
+
+static void test_stream(void)
+{
+    static uint8_t short_payload[200], long_payload[3000], huge_payload[20000];
+    static test_frame_t reference[TEST_MAX_FRAMES];
+    static const char *mode_names[] = { "whole reads", "1 byte reads", "7 byte reads", "random reads" };
+    uint8_t buffer[TEST_BUFFER_SIZE];
+    int reference_count = 0, chunks = 0;
+    mqtt_framer_t framer;
+
+    for (int i = 0; i < sizeof(huge_payload); i++) {
+        huge_payload[i] = rand();
+    }
+    memcpy(short_payload, huge_payload + 1, sizeof(short_payload));
+    memcpy(long_payload, huge_payload + 2, sizeof(long_payload));
+
+    s_stream_length = 0;
+    s_packet_count = 0;
+    put_byte(MQTT_MSG_TYPE_CONNACK << 4);
+    put_byte(2);
+    put_byte(1);
+    put_byte(CONNECTION_ACCEPTED);
+    s_packets[s_packet_count++] = (test_packet_t) { .type = MQTT_MSG_TYPE_CONNACK };
+    add_publish("t/a", (const uint8_t *)"hello", 5, 0, 0);
+    add_ack(MQTT_MSG_TYPE_SUBACK, 0, 0x1234);
+    add_publish("t/b", NULL, 0, 1, 0x0102);
+    add_publish("t/c", short_payload, sizeof(short_payload), 2, 0x0203);
+    add_publish("t/long", long_payload, sizeof(long_payload), 1, 0x0304);
+    put_byte(MQTT_MSG_TYPE_PINGRESP << 4);
+    put_byte(0);
+    s_packets[s_packet_count++] = (test_packet_t) { .type = MQTT_MSG_TYPE_PINGRESP };
+    add_publish("t/huge", huge_payload, sizeof(huge_payload), 0, 0);
+    add_ack(MQTT_MSG_TYPE_PUBACK, 0, 0x0405);
+
+    for (int mode = READ_ALL; mode <= READ_RANDOM; mode++) {
+        mqtt_framer_init(&framer, buffer, sizeof(buffer));
+        expect(feed(&framer, s_stream, s_stream_length, mode) == 0, mode_names[mode]);
+        check_packets(mode_names[mode]);
+        if (mode == READ_ALL) {
+            memcpy(reference, s_frames, sizeof(reference));
+            reference_count = s_frame_count;
+            continue;
+        }
+        expect(s_frame_count == reference_count, mode_names[mode]);
+        expect(memcmp(s_frames, reference, s_frame_count * sizeof(test_frame_t)) == 0, mode_names[mode]);
+    }
+
+    /* The long packets come in chunks of the buffer length, but the last one */
+    for (int i = 0; i < reference_count; i++) {
+        test_frame_t *f = &reference[i];
+        if (f->total_length <= TEST_BUFFER_SIZE) {
+            continue;
+        }
+        chunks++;
+        expect(f->length == TEST_BUFFER_SIZE || f->offset + f->length == f->total_length, "chunk length");
+        expect(f->offset % TEST_BUFFER_SIZE == 0, "chunk offset");
+    }
+    expect(chunks == (3000 + 13 + TEST_BUFFER_SIZE - 1) / TEST_BUFFER_SIZE +
+           (20000 + 12 + TEST_BUFFER_SIZE - 1) / TEST_BUFFER_SIZE, "chunk count");
+    printf("%d packets of a %u byte stream framed in %d frames, the same from reads of any size\n",
+           s_packet_count, s_stream_length, reference_count);
+}
+
+static void test_errors(void)
+{
+    static const uint8_t too_long_length[] = { 0x30, 0xff, 0xff, 0xff, 0xff, 0x01 };
+    static const uint8_t long_suback[] = { 0x90, 0xe8, 0x07, 0x00, 0x01 };
+    uint8_t buffer[TEST_BUFFER_SIZE];
+    mqtt_framer_t framer;
+
+    mqtt_framer_init(&framer, buffer, sizeof(buffer));
+    expect(feed(&framer, too_long_length, sizeof(too_long_length), READ_BYTE) == -1, "5 byte remaining length");
+
+    mqtt_framer_init(&framer, buffer, sizeof(buffer));
+    expect(feed(&framer, long_suback, sizeof(long_suback), READ_ALL) == -1, "SUBACK longer than the buffer");
+
+    /* The topic of a long PUBLISH has to be in its first chunk */
+    char topic[TEST_BUFFER_SIZE + 1];
+    memset(topic, 'x', TEST_BUFFER_SIZE);
+    topic[TEST_BUFFER_SIZE] = '\0';
+    s_stream_length = 0;
+    s_packet_count = 0;
+    add_publish(topic, (const uint8_t *)"data", 4, 0, 0);
+    mqtt_framer_init(&framer, buffer, sizeof(buffer));
+    expect(feed(&framer, s_stream, s_stream_length, READ_SEVEN) == -1, "topic longer than the buffer");
+
+    /* Nothing is returned before the remaining length is complete */
+    mqtt_frame_t frame;
+    uint32_t space;
+    mqtt_framer_init(&framer, buffer, sizeof(buffer));
+    uint8_t *p = mqtt_framer_get_space(&framer, &space);
+    p[0] = 0x30;
+    p[1] = 0x80;
+    mqtt_framer_commit(&framer, 2);
+    expect(mqtt_framer_next(&framer, &frame) == 0, "incomplete remaining length");
+    mqtt_framer_reset(&framer);
+    mqtt_framer_get_space(&framer, &space);
+    expect(space == TEST_BUFFER_SIZE, "reset drops the bytes held");
+    printf("malformed and unframeable packets are errors\n");
+}
+
+static void bench(void)
+{
+    static uint8_t payload[BENCH_PAYLOAD];
+    uint8_t buffer[1024];
+    mqtt_framer_t framer;
+    mqtt_frame_t frame;
+    uint64_t best = UINT64_MAX;
+    int reads = 0, frames = 0;
+
+    memset(payload, 'p', sizeof(payload));
+    s_stream_length = 0;
+    s_packet_count = 0;
+    for (int i = 0; i < BENCH_PACKETS; i++) {
+        add_publish("sensors/temp", payload, sizeof(payload), 0, 0);
+        s_packet_count = 0;
+    }
+    int packets = BENCH_PACKETS * BENCH_REPEAT;
+
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        uint64_t t0 = bench_ns();
+        uint32_t pos, space, n;
+
+        mqtt_framer_init(&framer, buffer, sizeof(buffer));
+        reads = 0;
+        frames = 0;
+        for (int i = 0; i < BENCH_REPEAT; i++) {
+            for (pos = 0; pos < s_stream_length; pos += n) {
+                uint8_t *p = mqtt_framer_get_space(&framer, &space);
+                n = space;
+                if (n > s_stream_length - pos) {
+                    n = s_stream_length - pos;
+                }
+                memcpy(p, s_stream + pos, n);
+                reads++;
+                mqtt_framer_commit(&framer, n);
+                while (mqtt_framer_next(&framer, &frame) > 0) {
+                    frames++;
+                }
+            }
+        }
+        uint64_t t = bench_ns() - t0;
+        if (t < best) {
+            best = t;
+        }
+    }
+    expect(frames == packets, "bench frames");
+    printf("%d PUBLISH packets of %d bytes in %d reads: %.1f ns per packet, "
+           "the former receive path handled %d of them\n",
+           packets, BENCH_PAYLOAD + 16, reads, (double)best / packets, reads);
+}
+
+int main(void)
+{
+    srand(1);
+    test_stream();
+    test_errors();
+    bench();
+    printf("all framer checks passed\n");
+    return 0;
+}
@@ -0,0 +1,16 @@
+// Host build stub of FreeRTOS.h, the locks of the client are pthread mutexes
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t EventBits_t;
+
+#define pdTRUE              1
+#define pdFALSE             0
+#define portMAX_DELAY       ((TickType_t)0xffffffffUL)
+#define portTICK_RATE_MS    1
+
+#define BIT0                (1 << 0)
@@ -0,0 +1,35 @@
+// Host build stub of event_groups.h, only the stop of the MQTT task waits on its bits, which the test never starts
+#pragma once
+
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+
+typedef EventBits_t *EventGroupHandle_t;
+
+static inline EventGroupHandle_t xEventGroupCreate(void)
+{
+    return calloc(1, sizeof(EventBits_t));
+}
+
+static inline EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    return *group |= bits;
+}
+
+static inline EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    EventBits_t old = *group;
+    *group &= ~bits;
+    return old;
+}
+
+static inline EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear,
+                                              BaseType_t all, TickType_t ticks)
+{
+    return *group;
+}
+
+static inline void vEventGroupDelete(EventGroupHandle_t group)
+{
+    free(group);
+}
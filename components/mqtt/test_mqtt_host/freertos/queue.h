@@ -0,0 +1,2 @@
+// Host build stub of queue.h
+#pragma once
@@ -0,0 +1,41 @@
+// Host build stub of semphr.h, mutexes are pthread mutexes
+#pragma once
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+
+typedef pthread_mutex_t *SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t host_mutex_create(int type)
+{
+    pthread_mutexattr_t attr;
+    SemaphoreHandle_t m = malloc(sizeof(pthread_mutex_t));
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, type);
+    pthread_mutex_init(m, &attr);
+    pthread_mutexattr_destroy(&attr);
+    return m;
+}
+
+#define xSemaphoreCreateMutex()             host_mutex_create(PTHREAD_MUTEX_NORMAL)
+#define xSemaphoreCreateRecursiveMutex()    host_mutex_create(PTHREAD_MUTEX_RECURSIVE)
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t m, TickType_t ticks)
+{
+    return pthread_mutex_lock(m) == 0;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t m)
+{
+    return pthread_mutex_unlock(m) == 0;
+}
+
+#define xSemaphoreTakeRecursive(m, ticks)   xSemaphoreTake(m, ticks)
+#define xSemaphoreGiveRecursive(m)          xSemaphoreGive(m)
+
+static inline void vSemaphoreDelete(SemaphoreHandle_t m)
+{
+    pthread_mutex_destroy(m);
+    free(m);
+}
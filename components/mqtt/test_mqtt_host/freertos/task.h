@@ -0,0 +1,23 @@
+// Host build stub of task.h, the test calls the functions of the MQTT task itself and never starts it
+#pragma once
+
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+static inline BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                     int prio, TaskHandle_t *handle)
+{
+    return pdFALSE;
+}
+
+static inline void vTaskDelay(TickType_t ticks)
+{
+    usleep(ticks * 1000);
+}
+
+static inline void vTaskDelete(TaskHandle_t task)
+{
+}
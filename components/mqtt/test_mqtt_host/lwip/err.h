@@ -0,0 +1,2 @@
+// Host build stub of lwip/err.h
+#pragma once
@@ -0,0 +1,4 @@
+// Host build stub of lwip/netdb.h
+#pragma once
+
+#include <netdb.h>
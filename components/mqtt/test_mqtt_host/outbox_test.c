@@ -0,0 +1,545 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Check and measure the outbox of the MQTT client, built with CONFIG_MQTT_OUTBOX_SPILL over a
+ * partition in RAM that behaves like NOR flash: a write may only clear bits, and an erase sets a
+ * whole sector. Without the partition, the messages are looked up by msg_id, deleted out of order,
+ * expired, and the arena bounds the bytes kept. With it, outages are simulated: messages are queued
+ * while nothing is sent, then sent and acknowledged in order while more are queued. The queue limit
+ * of the client, on the messages in RAM, spills the oldest one rather than dropping. Reboots drop
+ * the outbox without deleting anything, the messages spilled have to come back in order, also after
+ * a write torn by a power cut. Then the MQTT task sending the BENCH_MESSAGES queued in an outage is
+ * timed against the former outbox, a list of heap items it walked on every iteration.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "mqtt_outbox.h"
+#include "mqtt_outbox_store.h"
+#include "mqtt_config.h"
+#include "esp_partition.h"
+
+#define TEST_PARTITION_SIZE     (64 * SPI_FLASH_SEC_SIZE)
+#define TEST_MSG_TYPE           3
+#define TEST_MAX_LEN            120
+#define TEST_WINDOW             8
+#define OUTAGE_MESSAGES         2000
+#define BENCH_MESSAGES          2000
+#define BENCH_RUNS              3
+
+/* The partition in RAM, and the power cut: writes fail once s_write_budget bytes are written */
+static uint8_t s_flash[TEST_PARTITION_SIZE];
+static esp_partition_t s_partition = {
+    .type = ESP_PARTITION_TYPE_DATA,
+    .subtype = ESP_PARTITION_SUBTYPE_ANY,
+    .size = TEST_PARTITION_SIZE,
+    .label = OUTBOX_SPILL_PARTITION_LABEL,
+};
+static bool s_partition_present;
+static long s_write_budget = -1;
+static int s_bits_set;
+static long s_bytes_written;
+static int s_sectors_erased;
+
+static inline uint64_t bench_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void expect(int ok, const char *what)
+{
+    if (!ok) {
+        printf("check failed: %s\n", what);
+        exit(1);
+    }
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    return s_partition_present && strcmp(label, s_partition.label) == 0 ? &s_partition : NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    if (src_offset + size > partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, s_flash + src_offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    const uint8_t *data = src;
+    size_t i;
+
+    if (dst_offset + size > partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    for (i = 0; i < size; i++) {
+        if (s_write_budget == 0) {
+            return ESP_FAIL;
+        }
+        if (s_write_budget > 0) {
+            s_write_budget--;
+        }
+        if ((s_flash[dst_offset + i] & data[i]) != data[i]) {
+            s_bits_set++;
+        }
+        s_flash[dst_offset + i] &= data[i];
+        s_bytes_written++;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, uint32_t start_addr, uint32_t size)
+{
+    if (start_addr % SPI_FLASH_SEC_SIZE || size % SPI_FLASH_SEC_SIZE || start_addr + size > partition->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_write_budget == 0) {
+        return ESP_FAIL;
+    }
+    memset(s_flash + start_addr, 0xff, size);
+    s_sectors_erased += size / SPI_FLASH_SEC_SIZE;
+    return ESP_OK;
+}
+
+static void flash_reset(bool present)
+{
+    memset(s_flash, 0xff, sizeof(s_flash));
+    s_partition_present = present;
+    s_write_budget = -1;
+    s_bits_set = 0;
+    s_bytes_written = 0;
+    s_sectors_erased = 0;
+}
+
+/* Message seq is "seq" in text, then a pattern up to a length depending on seq */
+static int make_message(int seq, uint8_t *data)
+{
+    int len = 24 + (seq * 37) % (TEST_MAX_LEN - 24);
+    int i, n = sprintf((char *)data, "%d", seq);
+
+    for (i = n + 1; i < len; i++) {
+        data[i] = (uint8_t)(seq + i);
+    }
+    data[n] = '\0';
+    return len;
+}
+
+static int msg_id_of(int seq)
+{
+    return seq % 65535 + 1;
+}
+
+/* Checks an item holds message seq, returns seq */
+static int check_item(outbox_item_handle_t item)
+{
+    uint8_t expected[TEST_MAX_LEN];
+    int len, msg_id, msg_type, seq;
+    uint8_t *data = outbox_item_get_data(item, &len, &msg_id, &msg_type);
+
+    seq = atoi((const char *)data);
+    expect(len == make_message(seq, expected) && memcmp(data, expected, len) == 0, "message intact");
+    expect(msg_id == msg_id_of(seq) && msg_type == TEST_MSG_TYPE, "message id and type");
+    return seq;
+}
+
+static esp_err_t append_message(outbox_handle_t outbox, int seq)
+{
+    uint8_t data[TEST_MAX_LEN];
+    int len = make_message(seq, data);
+
+    return outbox_append(outbox, data, len, msg_id_of(seq), TEST_MSG_TYPE, seq);
+}
+
+/* Sends and acknowledges every queued message, TEST_WINDOW at a time in reverse order,
+ * expecting them from seq first. Every few sent, one more is queued. Returns the next seq.
+ * The outbox may have no room to load a message until the ones sent are acknowledged. */
+static int drain(outbox_handle_t outbox, int first, int *next_to_queue, int queue_every)
+{
+    outbox_item_handle_t item, window[TEST_WINDOW];
+    int seq = first, sent = 0, inflight = 0, msg_id, len, msg_type;
+
+    for (;;) {
+        item = outbox_dequeue(outbox);
+        if (item) {
+            expect(check_item(item) == seq, "messages sent in order");
+            outbox_set_item_pending(outbox, item, seq);
+            window[inflight++] = item;
+            seq++;
+            if (queue_every && ++sent % queue_every == 0) {
+                expect(append_message(outbox, (*next_to_queue)++) == ESP_OK, "queued while sending");
+            }
+            if (inflight < TEST_WINDOW) {
+                continue;
+            }
+        } else if (inflight == 0) {
+            break;
+        }
+        while (inflight) {
+            outbox_item_get_data(window[--inflight], &len, &msg_id, &msg_type);
+            expect(outbox_delete(outbox, msg_id, TEST_MSG_TYPE) == ESP_OK, "acknowledged");
+        }
+    }
+    expect(outbox_get_queued_count(outbox) == 0, "nothing left queued");
+    return seq;
+}
+
+static void test_index_and_arena(void)
+{
+    outbox_item_handle_t item;
+    uint8_t data[TEST_MAX_LEN];
+    int queued[1024], count = 0, capacity, size = 0, i, len, seq = 0;
+
+    flash_reset(false);
+    outbox_handle_t outbox = outbox_init();
+    expect(outbox != NULL, "outbox without partition");
+
+    /* the arena bounds what is kept */
+    while ((len = make_message(seq, data)) > 0 &&
+            outbox_enqueue(outbox, data, len, msg_id_of(seq), TEST_MSG_TYPE, seq) != NULL) {
+        queued[count++] = seq++;
+        size += len;
+    }
+    capacity = count;
+    expect(outbox_get_size(outbox) == size && size <= OUTBOX_ARENA_SIZE, "size within the arena");
+    expect(append_message(outbox, seq) == ESP_ERR_NO_MEM, "full without partition");
+
+    /* acknowledged out of order, while new ones fill the room made */
+    srand(1);
+    for (i = 0; i < 20000; i++) {
+        int k = rand() % count, victim = queued[k];
+
+        item = outbox_get(outbox, msg_id_of(victim));
+        expect(item != NULL && check_item(item) == victim, "found by msg_id");
+        expect(outbox_delete(outbox, msg_id_of(victim), TEST_MSG_TYPE) == ESP_OK, "deleted by msg_id");
+        expect(outbox_get(outbox, msg_id_of(victim)) == NULL, "gone once deleted");
+        queued[k] = queued[--count];
+        while (count < 1024) {
+            len = make_message(seq, data);
+            if (outbox_enqueue(outbox, data, len, msg_id_of(seq), TEST_MSG_TYPE, seq) == NULL) {
+                break;
+            }
+            queued[count++] = seq++;
+        }
+    }
+    expect(outbox_get_queued_count(outbox) == count, "queued count");
+    for (i = 0, size = 0; i < count; i++) {
+        size += make_message(queued[i], data);
+    }
+    expect(outbox_get_size(outbox) == size, "size after out of order deletes");
+
+    /* only pending items expire, timed from when they are sent */
+    item = outbox_dequeue(outbox);
+    seq = check_item(item);
+    outbox_set_item_pending(outbox, item, 1000);
+    outbox_delete_expired(outbox, 100000, 30000);
+    expect(outbox_get_queued_count(outbox) == count - 1, "queued items do not expire");
+    outbox_delete_expired(outbox, 31001, 30000);
+    expect(outbox_get(outbox, msg_id_of(seq)) == NULL, "pending item expired");
+    count--;
+
+    /* once emptied, the whole arena is used again */
+    while ((item = outbox_dequeue(outbox)) != NULL) {
+        outbox_delete_item(outbox, item);
+    }
+    expect(outbox_get_size(outbox) == 0 && outbox_get_queued_count(outbox) == 0, "empty");
+    for (i = 0; i < capacity; i++) {
+        len = make_message(i, data);
+        expect(outbox_enqueue(outbox, data, len, msg_id_of(i), TEST_MSG_TYPE, i) != NULL, "room again");
+    }
+    outbox_destroy(outbox);
+    printf("%d messages fit in the %d byte arena, looked up and deleted out of order\n", capacity, OUTBOX_ARENA_SIZE);
+}
+
+static void test_outage(void)
+{
+    int next = 0, seq, i;
+
+    flash_reset(true);
+    outbox_handle_t outbox = outbox_init();
+    expect(outbox != NULL, "outbox");
+
+    /* a long outage, then a short one while the backlog is being sent */
+    for (; next < OUTAGE_MESSAGES; next++) {
+        expect(append_message(outbox, next) == ESP_OK, "queued during the outage");
+    }
+    expect(outbox_get_queued_count(outbox) == OUTAGE_MESSAGES, "all queued");
+    expect(outbox_get_size(outbox) <= OUTBOX_ARENA_SIZE, "RAM bounded");
+    seq = drain(outbox, 0, &next, 3);
+    expect(seq == next, "all sent");
+    for (i = 0; i < OUTAGE_MESSAGES / 4; i++) {
+        expect(append_message(outbox, next++) == ESP_OK, "queued during the second outage");
+    }
+    seq = drain(outbox, seq, &next, 0);
+    expect(seq == next && outbox_get_queued_count(outbox) == 0, "all sent after the second outage");
+    expect(s_bits_set == 0, "flash bits only cleared between erases");
+    outbox_destroy(outbox);
+    printf("%d messages queued through 2 outages sent in order, %ld bytes written to flash, %d sectors erased\n",
+           next, s_bytes_written, s_sectors_erased);
+}
+
+/* What esp_mqtt_client_enqueue() does with out_queue_size, while nothing is sent */
+static esp_err_t append_limited(outbox_handle_t outbox, int seq)
+{
+    if (outbox_get_ram_queued_count(outbox) >= MQTT_OUT_QUEUE_SIZE && outbox_spill_oldest(outbox) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    return append_message(outbox, seq);
+}
+
+static void test_queue_limit(void)
+{
+    int next = 0;
+
+    flash_reset(false);
+    outbox_handle_t outbox = outbox_init();
+    for (; next < MQTT_OUT_QUEUE_SIZE; next++) {
+        expect(append_limited(outbox, next) == ESP_OK, "queued in RAM");
+    }
+    expect(append_limited(outbox, next) == ESP_FAIL, "dropped without a partition");
+    outbox_destroy(outbox);
+
+    flash_reset(true);
+    outbox = outbox_init();
+    for (next = 0; next < OUTAGE_MESSAGES / 4; next++) {
+        expect(append_limited(outbox, next) == ESP_OK, "spilled rather than dropped");
+        expect(outbox_get_ram_queued_count(outbox) <= MQTT_OUT_QUEUE_SIZE, "limit on the messages in RAM");
+    }
+    expect(outbox_get_queued_count(outbox) == next, "all queued");
+    expect(drain(outbox, 0, &next, 0) == next, "all sent");
+    outbox_destroy(outbox);
+    printf("%d messages queued with a limit of %d in RAM, none dropped\n", next, MQTT_OUT_QUEUE_SIZE);
+}
+
+static void test_reboot(void)
+{
+    outbox_item_handle_t item;
+    int next = 0, seq, i, restored;
+
+    flash_reset(true);
+    outbox_handle_t outbox = outbox_init();
+    for (; next < 1000; next++) {
+        expect(append_message(outbox, next) == ESP_OK, "queued");
+    }
+    /* 100 sent and acknowledged, 10 sent but not acknowledged when the power goes */
+    for (i = 0; i < 110; i++) {
+        item = outbox_dequeue(outbox);
+        expect(check_item(item) == i, "sent in order");
+        outbox_set_item_pending(outbox, item, i);
+        if (i < 100) {
+            outbox_delete_item(outbox, item);
+        }
+    }
+    outbox_destroy(outbox);
+
+    /* the ones in flash come back from the first not acknowledged, the newest in RAM are lost */
+    outbox = outbox_init();
+    restored = outbox_get_queued_count(outbox);
+    expect(restored > 800 && restored <= 900, "restored after the reboot");
+    seq = drain(outbox, 100, &next, 0);
+    expect(seq == 100 + restored, "restored in order");
+    outbox_destroy(outbox);
+
+    /* a power cut in the middle of a record */
+    flash_reset(true);
+    outbox = outbox_init();
+    for (next = 0; next < 500; next++) {
+        expect(append_message(outbox, next) == ESP_OK, "queued");
+    }
+    s_write_budget = 70;
+    while (append_message(outbox, next) == ESP_OK) {
+        next++;
+    }
+    outbox_destroy(outbox);
+    s_write_budget = -1;
+    outbox = outbox_init();
+    restored = outbox_get_queued_count(outbox);
+    expect(restored > 0 && restored < next, "restored up to the torn record");
+    for (i = 0; i < 5; i++) {
+        expect(append_message(outbox, restored + i) == ESP_OK, "queued after the reboot");
+    }
+    seq = drain(outbox, 0, &next, 0);
+    expect(seq == restored + 5, "restored in order, the torn one skipped");
+    outbox_destroy(outbox);
+    expect(s_bits_set == 0, "flash bits only cleared between erases");
+    printf("spilled messages restored in order after reboots, from the first not acknowledged, "
+           "and up to a torn record\n");
+}
+
+/* The former outbox: a list of items allocated with their message, walked for every lookup,
+ * and twice on every iteration of the MQTT task, to delete the expired items and for its size */
+typedef struct former_item {
+    uint8_t *buffer;
+    int len;
+    int msg_id;
+    int msg_type;
+    int tick;
+    bool pending;
+    STAILQ_ENTRY(former_item) next;
+} former_item_t;
+
+STAILQ_HEAD(former_list_t, former_item);
+
+static void former_enqueue(struct former_list_t *list, uint8_t *data, int len, int msg_id, int msg_type, int tick)
+{
+    former_item_t *item = calloc(1, sizeof(former_item_t));
+    item->buffer = malloc(len);
+    memcpy(item->buffer, data, len);
+    item->len = len;
+    item->msg_id = msg_id;
+    item->msg_type = msg_type;
+    item->tick = tick;
+    STAILQ_INSERT_TAIL(list, item, next);
+}
+
+static former_item_t *former_dequeue(struct former_list_t *list)
+{
+    former_item_t *item;
+    STAILQ_FOREACH(item, list, next) {
+        if (!item->pending) {
+            return item;
+        }
+    }
+    return NULL;
+}
+
+static void former_delete(struct former_list_t *list, int msg_id, int msg_type)
+{
+    former_item_t *item;
+    STAILQ_FOREACH(item, list, next) {
+        if (item->msg_id == msg_id && item->msg_type == msg_type) {
+            STAILQ_REMOVE(list, item, former_item, next);
+            free(item->buffer);
+            free(item);
+            return;
+        }
+    }
+}
+
+static int former_task_iteration(struct former_list_t *list, int current_tick, int timeout)
+{
+    former_item_t *item, *tmp;
+    int size = 0;
+
+    STAILQ_FOREACH_SAFE(item, list, next, tmp) {
+        if (current_tick - item->tick > timeout) {
+            former_delete(list, item->msg_id, item->msg_type);
+        }
+    }
+    STAILQ_FOREACH(item, list, next) {
+        size += item->len;
+    }
+    return size;
+}
+
+static uint64_t bench_former(int *heap)
+{
+    struct former_list_t list = STAILQ_HEAD_INITIALIZER(list);
+    former_item_t *item, *window[TEST_WINDOW];
+    uint8_t data[TEST_MAX_LEN];
+    int seq, len, inflight;
+    uint64_t t0 = bench_ns();
+
+    *heap = 0;
+    for (seq = 0; seq < BENCH_MESSAGES; seq++) {
+        len = make_message(seq, data);
+        former_enqueue(&list, data, len, msg_id_of(seq), TEST_MSG_TYPE, seq);
+        *heap += sizeof(former_item_t) + len;
+    }
+    do {
+        for (inflight = 0; inflight < TEST_WINDOW && (item = former_dequeue(&list)) != NULL; inflight++) {
+            item->pending = true;
+            window[inflight] = item;
+        }
+        while (inflight) {
+            item = window[--inflight];
+            former_delete(&list, item->msg_id, item->msg_type);
+        }
+        former_task_iteration(&list, BENCH_MESSAGES, OUTBOX_EXPIRED_TIMEOUT_MS);
+    } while (!STAILQ_EMPTY(&list));
+    return bench_ns() - t0;
+}
+
+static uint64_t bench_outbox(void)
+{
+    outbox_item_handle_t item, window[TEST_WINDOW];
+    int seq, len, msg_id, msg_type, inflight, sent = 0;
+    uint64_t t0;
+
+    flash_reset(true);
+    outbox_handle_t outbox = outbox_init();
+    t0 = bench_ns();
+    for (seq = 0; seq < BENCH_MESSAGES; seq++) {
+        append_message(outbox, seq);
+    }
+    do {
+        for (inflight = 0; inflight < TEST_WINDOW && (item = outbox_dequeue(outbox)) != NULL; inflight++) {
+            outbox_set_item_pending(outbox, item, BENCH_MESSAGES);
+            window[inflight] = item;
+        }
+        sent += inflight;
+        while (inflight) {
+            outbox_item_get_data(window[--inflight], &len, &msg_id, &msg_type);
+            outbox_delete(outbox, msg_id, msg_type);
+        }
+        outbox_delete_expired(outbox, BENCH_MESSAGES, OUTBOX_EXPIRED_TIMEOUT_MS);
+        outbox_cleanup(outbox, OUTBOX_MAX_SIZE);
+    } while (outbox_get_queued_count(outbox));
+    t0 = bench_ns() - t0;
+    expect(sent == BENCH_MESSAGES, "bench sent all");
+    outbox_destroy(outbox);
+    return t0;
+}
+
+static void bench(void)
+{
+    uint64_t former = UINT64_MAX, outbox = UINT64_MAX, t;
+    int run, heap;
+
+    for (run = 0; run < BENCH_RUNS; run++) {
+        t = bench_former(&heap);
+        former = t < former ? t : former;
+        t = bench_outbox();
+        outbox = t < outbox ? t : outbox;
+    }
+    printf("%d messages queued in an outage, then sent %d a task iteration   ns/msg  RAM bytes  flash bytes/msg\n",
+           BENCH_MESSAGES, TEST_WINDOW);
+    printf("  former outbox, list of heap items                          %8.1f  %9d  %15s\n",
+           (double)former / BENCH_MESSAGES, heap, "-");
+    printf("  outbox, arena and spill partition                          %8.1f  %9d  %15.1f\n",
+           (double)outbox / BENCH_MESSAGES, OUTBOX_ARENA_SIZE, (double)s_bytes_written / BENCH_MESSAGES);
+}
+
+int main(void)
+{
+    test_index_and_arena();
+    test_outage();
+    test_queue_limit();
+    test_reboot();
+    bench();
+    printf("all outbox checks passed\n");
+    return 0;
+}
@@ -0,0 +1,18 @@
+// Host build stub of rom/queue.h, glibc's sys/queue.h lacks the _SAFE iterators of the BSD one
+#pragma once
+
+#include <sys/queue.h>
+
+#ifndef STAILQ_FOREACH_SAFE
+#define STAILQ_FOREACH_SAFE(var, head, field, tvar)                 \
+    for ((var) = STAILQ_FIRST((head));                              \
+            (var) && ((tvar) = STAILQ_NEXT((var), field), 1);       \
+            (var) = (tvar))
+#endif
+
+#ifndef TAILQ_FOREACH_SAFE
+#define TAILQ_FOREACH_SAFE(var, head, field, tvar)                  \
+    for ((var) = TAILQ_FIRST((head));                               \
+            (var) && ((tvar) = TAILQ_NEXT((var), field), 1);        \
+            (var) = (tvar))
+#endif
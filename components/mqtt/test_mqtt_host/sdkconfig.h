@@ -0,0 +1,8 @@
+// Host build stub of sdkconfig.h, the defaults of the MQTT options, without SSL and websocket transports
+#pragma once
+
+#define CONFIG_MQTT_PROTOCOL_311                    1
+#define CONFIG_MQTT_BUFFER_SIZE                     1024
+#define CONFIG_MQTT_OUTBOX_ARENA_SIZE               4096
+#define CONFIG_MQTT_TX_BATCH_SIZE                   1460
+#define CONFIG_MQTT_TX_FLUSH_INTERVAL_MS            50
@@ -44,6 +44,7 @@ typedef uint32_t nvs_handle;
 #define ESP_ERR_NVS_NO_FREE_PAGES       (ESP_ERR_NVS_BASE + 0x0d)  /*!< NVS partition doesn't contain any empty pages. This may happen if NVS partition was truncated. Erase the whole partition and call nvs_flash_init again. */
 #define ESP_ERR_NVS_VALUE_TOO_LONG      (ESP_ERR_NVS_BASE + 0x0e)  /*!< String or blob length is longer than supported by the implementation */
 #define ESP_ERR_NVS_PART_NOT_FOUND      (ESP_ERR_NVS_BASE + 0x0f)  /*!< Partition with specified name is not found in the partition table */
+#define ESP_ERR_NVS_BATCH_ACTIVE        (ESP_ERR_NVS_BASE + 0x10)  /*!< A batch is in progress on the partition */
 
 #define NVS_DEFAULT_PART_NAME           "nvs"   /*!< Default partition name of the NVS partition in the partition table */
 /**
@@ -55,6 +56,48 @@ typedef enum {
 	NVS_READWRITE  /*!< Read and write */
 } nvs_open_mode;
 
+/**
+ * @brief Types of variables
+ *
+ */
+typedef enum {
+    NVS_TYPE_U8    = 0x01,  /*!< Type uint8_t */
+    NVS_TYPE_I8    = 0x11,  /*!< Type int8_t */
+    NVS_TYPE_U16   = 0x02,  /*!< Type uint16_t */
+    NVS_TYPE_I16   = 0x12,  /*!< Type int16_t */
+    NVS_TYPE_U32   = 0x04,  /*!< Type uint32_t */
+    NVS_TYPE_I32   = 0x14,  /*!< Type int32_t */
+    NVS_TYPE_U64   = 0x08,  /*!< Type uint64_t */
+    NVS_TYPE_I64   = 0x18,  /*!< Type int64_t */
+    NVS_TYPE_STR   = 0x21,  /*!< Type string */
+    NVS_TYPE_BLOB  = 0x41,  /*!< Type blob */
+    NVS_TYPE_ANY   = 0xff   /*!< Must be last */
+} nvs_type_t;
+
+/**
+ * @brief Information about an entry obtained from nvs_entry_info function
+ */
+typedef struct {
+    char namespace_name[16];    /*!< Namespace to which the key-value belong */
+    char key[16];               /*!< Key of stored key-value pair */
+    nvs_type_t type;            /*!< Type of stored key-value pair */
+} nvs_entry_info_t;
+
+/**
+ * Opaque pointer type representing iterator to nvs entries
+ */
+typedef struct nvs_opaque_iterator_t *nvs_iterator_t;
+
+/**
+ * @brief Usage statistics of an NVS partition, in entries of 32 bytes
+ */
+typedef struct {
+    size_t used_entries;      /*!< Number of entries holding values, including namespace entries */
+    size_t free_entries;      /*!< Number of free entries, including erased entries which garbage collection reclaims */
+    size_t total_entries;     /*!< Number of all entries of the partition */
+    size_t namespace_count;   /*!< Number of namespaces */
+} nvs_stats_t;
+
 /**
  * @brief      Open non-volatile storage with a given namespace from the default NVS partition
  *
@@ -140,6 +183,8 @@ esp_err_t nvs_open_from_partition(const char *part_name, const char* name, nvs_o
  *               update will be finished after re-initialization of nvs, provided that
  *               flash operation doesn't fail again.
  *             - ESP_ERR_NVS_VALUE_TOO_LONG if the string value is too long
+ *             - ESP_ERR_NVS_BATCH_ACTIVE if a batch started with another handle is in
+ *               progress on the partition
  */
 esp_err_t nvs_set_i8  (nvs_handle handle, const char* key, int8_t value);
 esp_err_t nvs_set_u8  (nvs_handle handle, const char* key, uint8_t value);
@@ -162,8 +207,10 @@ esp_err_t nvs_set_str (nvs_handle handle, const char* key, const char* value);
  *                     Handles that were opened read only cannot be used.
  * @param[in]  key     Key name. Maximal length is 15 characters. Shouldn't be empty.
  * @param[in]  value   The value to set.
- * @param[in]  length  length of binary value to set, in bytes; Maximum length is
- *                     1984 bytes.
+ * @param[in]  length  length of binary value to set, in bytes. Values longer than
+ *                     1984 bytes are stored in chunks spread over several pages;
+ *                     the maximum length is 4000 bytes times the number of pages
+ *                     of the partition minus one.
  *
  * @return
  *             - ESP_OK if value was set successfully
@@ -177,9 +224,88 @@ esp_err_t nvs_set_str (nvs_handle handle, const char* key, const char* value);
  *               update will be finished after re-initialization of nvs, provided that
  *               flash operation doesn't fail again.
  *             - ESP_ERR_NVS_VALUE_TOO_LONG if the value is too long
+ *             - ESP_ERR_NVS_BATCH_ACTIVE if a batch started with another handle is in
+ *               progress on the partition
  */
 esp_err_t nvs_set_blob(nvs_handle handle, const char* key, const void* value, size_t length);
 
+/**
+ * @brief       start writing a blob in parts
+ *
+ * The data passed to nvs_set_blob_append is written to flash as it comes, so a large
+ * blob doesn't have to be kept in RAM. The blob replaces the previous value of the key
+ * when nvs_set_blob_end is called; until then readers see the previous value, and if
+ * power goes out before that, the previous value is kept.
+ *
+ * One blob can be written at a time in each partition. The key can't be set or erased
+ * otherwise until the blob is finished or aborted.
+ *
+ * @param[in]  handle  Handle obtained from nvs_open function.
+ *                     Handles that were opened read only cannot be used.
+ * @param[in]  key     Key name. Maximal length is 15 characters. Shouldn't be empty.
+ *
+ * @return
+ *             - ESP_OK if the write has been started
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_READ_ONLY if storage handle was opened as read only
+ *             - ESP_ERR_NVS_INVALID_STATE if a blob is being written in the partition already
+ *             - ESP_ERR_NVS_BATCH_ACTIVE if a batch is in progress on the partition
+ *             - ESP_ERR_NO_MEM if the buffer for small parts can't be allocated
+ */
+esp_err_t nvs_set_blob_begin(nvs_handle handle, const char* key);
+
+/**
+ * @brief       write the next part of a blob started with nvs_set_blob_begin
+ *
+ * Parts of 512 bytes or more are written right away, smaller ones are collected into
+ * 512 byte chunks. A blob has at most 127 chunks. If an error is returned, the blob
+ * has been dropped and the write has to be started again.
+ *
+ * @param[in]  handle  Handle which was passed to nvs_set_blob_begin.
+ * @param[in]  value   The data to append.
+ * @param[in]  length  Length of the data, in bytes.
+ *
+ * @return
+ *             - ESP_OK if the data has been written
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_INVALID_STATE if no blob is being written with the handle
+ *             - ESP_ERR_NVS_NOT_ENOUGH_SPACE if there is not enough space in the
+ *               underlying storage to save the value
+ *             - ESP_ERR_NVS_VALUE_TOO_LONG if the blob is too long
+ */
+esp_err_t nvs_set_blob_append(nvs_handle handle, const void* value, size_t length);
+
+/**
+ * @brief       finish the blob started with nvs_set_blob_begin
+ *
+ * @param[in]  handle  Handle which was passed to nvs_set_blob_begin.
+ *
+ * @return
+ *             - ESP_OK if the blob has replaced the previous value of the key
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_INVALID_STATE if no blob is being written with the handle
+ *             - ESP_ERR_NVS_BATCH_ACTIVE if a batch is in progress on the partition;
+ *               the blob can be finished once the batch is committed or aborted
+ *             - ESP_ERR_NVS_REMOVE_FAILED if the blob was written, but erasing the
+ *               previous value failed. This will be finished after re-initialization
+ *               of nvs, provided that flash operation doesn't fail again.
+ *             - other error codes from the underlying storage driver, the blob has
+ *               been dropped then
+ */
+esp_err_t nvs_set_blob_end(nvs_handle handle);
+
+/**
+ * @brief       drop the blob started with nvs_set_blob_begin
+ *
+ * @param[in]  handle  Handle which was passed to nvs_set_blob_begin.
+ *
+ * @return
+ *             - ESP_OK if the blob has been dropped, or no blob was being written with the handle
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - other error codes from the underlying storage driver
+ */
+esp_err_t nvs_set_blob_abort(nvs_handle handle);
+
 /**@{*/
 /**
  * @brief      get value for given key
@@ -289,6 +415,40 @@ esp_err_t nvs_get_str (nvs_handle handle, const char* key, char* out_value, size
 esp_err_t nvs_get_blob(nvs_handle handle, const char* key, void* out_value, size_t* length);
 /**@}*/
 
+/**
+ * @brief      get a part of a blob
+ *
+ * Reads a blob piece by piece, without a buffer for all of it. The size of
+ * the blob is returned by nvs_get_blob with zero out_value.
+ *
+ * \code{c}
+ * // Example (without error checking) of reading a blob in 256 byte pieces:
+ * uint8_t buf[256];
+ * size_t offset = 0;
+ * size_t size = sizeof(buf);
+ * while (nvs_get_blob_part(my_handle, "ca_cert", offset, buf, &size) == ESP_OK && size > 0) {
+ *     consume(buf, size);
+ *     offset += size;
+ *     size = sizeof(buf);
+ * }
+ * \endcode
+ *
+ * @param[in]     handle     Handle obtained from nvs_open function.
+ * @param[in]     key        Key name. Maximal length is 15 characters. Shouldn't be empty.
+ * @param[in]     offset     Offset of the part in the blob, in bytes.
+ * @param         out_value  Pointer to the output buffer.
+ * @param[inout]  length     A non-zero pointer to the size of out_value. Will be set to
+ *                           the number of bytes read, which is less than the size of
+ *                           out_value at the end of the blob, and zero past its end.
+ *
+ * @return
+ *             - ESP_OK if the part was retrieved successfully
+ *             - ESP_ERR_NVS_NOT_FOUND if the requested key doesn't exist
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_INVALID_LENGTH if offset is beyond the end of the blob
+ */
+esp_err_t nvs_get_blob_part(nvs_handle handle, const char* key, size_t offset, void* out_value, size_t* length);
+
 /**
  * @brief      Erase key-value pair with given key name.
  *
@@ -306,6 +466,8 @@ esp_err_t nvs_get_blob(nvs_handle handle, const char* key, void* out_value, size
  *              - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
  *              - ESP_ERR_NVS_READ_ONLY if handle was opened as read only
  *              - ESP_ERR_NVS_NOT_FOUND if the requested key doesn't exist
+ *              - ESP_ERR_NVS_BATCH_ACTIVE if a batch started with another handle is in
+ *                progress on the partition
  *              - other error codes from the underlying storage driver
  */
 esp_err_t nvs_erase_key(nvs_handle handle, const char* key);
@@ -322,10 +484,47 @@ esp_err_t nvs_erase_key(nvs_handle handle, const char* key);
  *              - ESP_OK if erase operation was successful
  *              - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
  *              - ESP_ERR_NVS_READ_ONLY if handle was opened as read only
+ *              - ESP_ERR_NVS_BATCH_ACTIVE if a batch is in progress on the partition
  *              - other error codes from the underlying storage driver
  */
 esp_err_t nvs_erase_all(nvs_handle handle);
 
+/**
+ * @brief      Start a batch of changes which become visible all together
+ *
+ * Until nvs_commit or nvs_batch_abort is called with this handle, values set and
+ * erased with this handle are only written as a part of the batch. Readers keep seeing
+ * the previous values. Once nvs_commit returns, all changes are visible; if power goes
+ * out before that, none of them will be.
+ *
+ * There is one batch per partition at a time. While it is in progress, other handles of
+ * the partition can read values, but setting or erasing values and nvs_commit with them
+ * fail with ESP_ERR_NVS_BATCH_ACTIVE. nvs_erase_all can't be used with any handle.
+ *
+ * @param[in]  handle  Storage handle obtained with nvs_open.
+ *                     Handles that were opened read only cannot be used.
+ *
+ * @return
+ *             - ESP_OK if the batch has been started
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_READ_ONLY if handle was opened as read only
+ *             - ESP_ERR_NVS_BATCH_ACTIVE if a batch is in progress on the partition already
+ *             - other error codes from the underlying storage driver
+ */
+esp_err_t nvs_batch_begin(nvs_handle handle);
+
+/**
+ * @brief      Drop all changes of the batch started with nvs_batch_begin
+ *
+ * @param[in]  handle  Storage handle which was passed to nvs_batch_begin.
+ *
+ * @return
+ *             - ESP_OK if the changes have been dropped, or no batch was started with the handle
+ *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - other error codes from the underlying storage driver
+ */
+esp_err_t nvs_batch_abort(nvs_handle handle);
+
 /**
  * @brief      Write any pending changes to non-volatile storage
  *
@@ -333,12 +532,21 @@ esp_err_t nvs_erase_all(nvs_handle handle);
  * to non-volatile storage. Individual implementations may write to storage at other times,
  * but this is not guaranteed.
  *
+ * If a batch was started with nvs_batch_begin on this handle, the batch is committed:
+ * all its changes become visible at once. Otherwise the changes have been written
+ * already and this function does nothing.
+ *
  * @param[in]  handle  Storage handle obtained with nvs_open.
  *                     Handles that were opened read only cannot be used.
  *
  * @return
  *             - ESP_OK if the changes have been written successfully
  *             - ESP_ERR_NVS_INVALID_HANDLE if handle has been closed or is NULL
+ *             - ESP_ERR_NVS_BATCH_ACTIVE if a batch started with another handle is in
+ *               progress on the partition
+ *             - ESP_ERR_NVS_REMOVE_FAILED if the batch was committed, but erasing the
+ *               values it replaced failed. This will be finished after re-initialization
+ *               of nvs, provided that flash operation doesn't fail again.
  *             - other error codes from the underlying storage driver
  */
 esp_err_t nvs_commit(nvs_handle handle);
@@ -350,12 +558,112 @@ esp_err_t nvs_commit(nvs_handle handle);
  * the handle is not in use any more. Closing the handle may not automatically
  * write the changes to nonvolatile storage. This has to be done explicitly using
  * nvs_commit function.
+ * A batch started with this handle and not committed is dropped, as is a blob
+ * started with nvs_set_blob_begin and not finished.
  * Once this function is called on a handle, the handle should no longer be used.
  *
  * @param[in]  handle  Storage handle to close
  */
 void nvs_close(nvs_handle handle);
 
+/**
+ * @brief      Get the usage statistics of an NVS partition
+ *
+ * The statistics are computed from the entry state tables of the pages kept in RAM,
+ * flash memory is not read.
+ *
+ * One page of the partition (126 entries) is always kept empty for garbage collection,
+ * so values can be written as long as free_entries is larger than 126. Values which take
+ * several entries, i.e. strings and blobs, need that many free entries in one page.
+ *
+ * \code{c}
+ * // Example of nvs_get_stats() to get the number of used entries and free entries:
+ * nvs_stats_t nvs_stats;
+ * nvs_get_stats(NULL, &nvs_stats);
+ * printf("Count: UsedEntries = (%d), FreeEntries = (%d), AllEntries = (%d)\n",
+ *        nvs_stats.used_entries, nvs_stats.free_entries, nvs_stats.total_entries);
+ * \endcode
+ *
+ * @param[in]   part_name   Partition name, or NULL for the default partition
+ * @param[out]  nvs_stats   Returns the statistics. All fields are zero if an error is returned.
+ *
+ * @return
+ *             - ESP_OK if the statistics were returned
+ *             - ESP_ERR_INVALID_ARG if nvs_stats is NULL
+ *             - ESP_ERR_NVS_PART_NOT_FOUND if the partition has not been initialized
+ */
+esp_err_t nvs_get_stats(const char *part_name, nvs_stats_t *nvs_stats);
+
+/**
+ * @brief      Create an iterator to enumerate NVS entries based on one or more parameters
+ *
+ * \code{c}
+ * // Example of listing all the key-value pairs of any type under specified partition and namespace
+ * nvs_iterator_t it = nvs_entry_find(partition, namespace, NVS_TYPE_ANY);
+ * while (it != NULL) {
+ *         nvs_entry_info_t info;
+ *         nvs_entry_info(it, &info);
+ *         it = nvs_entry_next(it);
+ *         printf("key '%s', type '%d' \n", info.key, info.type);
+ * };
+ * // Note: no need to release iterator obtained from nvs_entry_find function when
+ * //       nvs_entry_find or nvs_entry_next function return NULL, indicating no other
+ * //       element for specified criteria was found.
+ * \endcode
+ *
+ * The iterator reads the pages one entry at a time. It lists the values seen by nvs_get_*
+ * functions: values written in a batch which is not committed yet are not listed. Values
+ * written or erased while iterating, also by garbage collection moving values to a new page,
+ * may be skipped or listed twice.
+ *
+ * @param[in]   part_name       Partition name
+ *
+ * @param[in]   namespace_name  Set this value if looking for entries with
+ *                              a specific namespace. Pass NULL otherwise.
+ *
+ * @param[in]   type            One of nvs_type_t values.
+ *
+ * @return
+ *          Iterator used to enumerate all the entries found,
+ *          or NULL if no entry satisfying criteria was found.
+ *          Iterator obtained through this function has to be released
+ *          using nvs_release_iterator when not used any more.
+ */
+nvs_iterator_t nvs_entry_find(const char *part_name, const char *namespace_name, nvs_type_t type);
+
+/**
+ * @brief      Returns next item matching the iterator criteria, NULL if no such item exists.
+ *
+ * Note that any copies of the iterator will be invalid after this call.
+ *
+ * @param[in]   iterator     Iterator obtained from nvs_entry_find function. Must be non-NULL.
+ *
+ * @return
+ *          NULL if no entry was found, valid nvs_iterator_t otherwise.
+ *          The iterator is released when NULL is returned.
+ */
+nvs_iterator_t nvs_entry_next(nvs_iterator_t iterator);
+
+/**
+ * @brief       Fills nvs_entry_info_t structure with information about entry pointed to by the iterator.
+ *
+ * @param[in]   iterator     Iterator obtained from nvs_entry_find or nvs_entry_next function. Must be non-NULL.
+ *
+ * @param[out]  out_info     Structure to which entry information is copied.
+ */
+void nvs_entry_info(nvs_iterator_t iterator, nvs_entry_info_t *out_info);
+
+/**
+ * @brief       Release iterator
+ *
+ * Iterators of a partition have to be released before the partition is deinitialized;
+ * an iterator of a deinitialized partition finds no more entries.
+ *
+ * @param[in]   iterator    Release iterator obtained from nvs_entry_find function. NULL argument is allowed.
+ *
+ */
+void nvs_release_iterator(nvs_iterator_t iterator);
+
 
 #ifdef __cplusplus
 } // extern "C"
@@ -38,6 +38,8 @@ public:
         mHandle(++s_nvs_next_handle),  // Begin the handle value with 1
         mReadOnly(readOnly),
         mNsIndex(nsIndex),
+        mBatch(false),
+        mBlobWrite(false),
         mStoragePtr(StoragePtr)
     {
     }
@@ -45,9 +47,18 @@ public:
     nvs_handle mHandle;
     uint8_t mReadOnly;
     uint8_t mNsIndex;
+    uint8_t mBatch;     // the batch of the storage was started with this handle
+    uint8_t mBlobWrite; // the blob write of the storage was started with this handle
     nvs::Storage* mStoragePtr;
 };
 
+struct nvs_opaque_iterator_t : public intrusive_list_node<nvs_opaque_iterator_t>
+{
+    nvs::Storage* mStoragePtr;  // nullptr once the partition is deinitialized
+    nvs::Storage::EntryIterator mIterator;
+    nvs_entry_info_t mInfo;
+};
+
 #ifdef ESP_PLATFORM
 SemaphoreHandle_t nvs::Lock::mSemaphore = NULL;
 #endif
@@ -58,6 +69,7 @@ using namespace nvs;
 static intrusive_list<HandleEntry> s_nvs_handles;
 uint32_t HandleEntry::s_nvs_next_handle;
 static intrusive_list<nvs::Storage> s_nvs_storage_list;
+static intrusive_list<nvs_opaque_iterator_t> s_nvs_iterators;
 
 static nvs::Storage* lookup_storage_from_name(const char *name)
 {
@@ -157,6 +169,13 @@ extern "C" esp_err_t nvs_flash_deinit_partition(const char* partition_name)
         it = next;
     }
 
+    /* Iterators of the storage find no more entries */
+    for (auto iter = s_nvs_iterators.begin(); iter != s_nvs_iterators.end(); ++iter) {
+        if (iter->mStoragePtr == storage) {
+            iter->mStoragePtr = nullptr;
+        }
+    }
+
     /* Finally delete the storage itself */
     s_nvs_storage_list.erase(storage);
     delete storage;
@@ -186,18 +205,36 @@ extern "C" esp_err_t nvs_flash_erase()
 }
 #endif
 
-static esp_err_t nvs_find_ns_handle(nvs_handle handle, HandleEntry& entry)
+static HandleEntry* nvs_find_handle_entry(nvs_handle handle)
 {
     auto it = find_if(begin(s_nvs_handles), end(s_nvs_handles), [=](HandleEntry& e) -> bool {
         return e.mHandle == handle;
     });
     if (it == end(s_nvs_handles)) {
+        return NULL;
+    }
+    return it;
+}
+
+static esp_err_t nvs_find_ns_handle(nvs_handle handle, HandleEntry& entry)
+{
+    HandleEntry* it = nvs_find_handle_entry(handle);
+    if (it == NULL) {
         return ESP_ERR_NVS_INVALID_HANDLE;
     }
     entry = *it;
     return ESP_OK;
 }
 
+// while a batch is in progress, the partition can only be changed through the handle which started it
+static esp_err_t nvs_check_batch(const HandleEntry& entry)
+{
+    if (!entry.mBatch && entry.mStoragePtr->isBatchActive()) {
+        return ESP_ERR_NVS_BATCH_ACTIVE;
+    }
+    return ESP_OK;
+}
+
 extern "C" esp_err_t nvs_open_from_partition(const char *part_name, const char* name, nvs_open_mode open_mode, nvs_handle *out_handle)
 {
     Lock lock;
@@ -236,14 +273,20 @@ extern "C" void nvs_close(nvs_handle handle)
 {
     Lock lock;
     ESP_LOGD(TAG, "%s %d", __func__, handle);
-    auto it = find_if(begin(s_nvs_handles), end(s_nvs_handles), [=](HandleEntry& e) -> bool {
-        return e.mHandle == handle;
-    });
-    if (it == end(s_nvs_handles)) {
+    HandleEntry* it = nvs_find_handle_entry(handle);
+    if (it == NULL) {
         return;
     }
+    if (it->mBatch) {
+        ESP_LOGD(TAG, "handle %d closed with an open batch, dropping it", handle);
+        it->mStoragePtr->abortBatch();
+    }
+    if (it->mBlobWrite) {
+        ESP_LOGD(TAG, "handle %d closed with an unfinished blob, dropping it", handle);
+        it->mStoragePtr->abortBlobWrite();
+    }
     s_nvs_handles.erase(it);
-    delete static_cast<HandleEntry*>(it);
+    delete it;
 }
 
 extern "C" esp_err_t nvs_erase_key(nvs_handle handle, const char* key)
@@ -258,6 +301,10 @@ extern "C" esp_err_t nvs_erase_key(nvs_handle handle, const char* key)
     if (entry.mReadOnly) {
         return ESP_ERR_NVS_READ_ONLY;
     }
+    err = nvs_check_batch(entry);
+    if (err != ESP_OK) {
+        return err;
+    }
     return entry.mStoragePtr->eraseItem(entry.mNsIndex, key);
 }
 
@@ -273,6 +320,10 @@ extern "C" esp_err_t nvs_erase_all(nvs_handle handle)
     if (entry.mReadOnly) {
         return ESP_ERR_NVS_READ_ONLY;
     }
+    err = nvs_check_batch(entry);
+    if (err != ESP_OK) {
+        return err;
+    }
     return entry.mStoragePtr->eraseNamespace(entry.mNsIndex);
 }
 
@@ -289,6 +340,10 @@ static esp_err_t nvs_set(nvs_handle handle, const char* key, T value)
     if (entry.mReadOnly) {
         return ESP_ERR_NVS_READ_ONLY;
     }
+    err = nvs_check_batch(entry);
+    if (err != ESP_OK) {
+        return err;
+    }
     return entry.mStoragePtr->writeItem(entry.mNsIndex, key, value);
 }
 
@@ -332,12 +387,53 @@ extern "C" esp_err_t nvs_set_u64 (nvs_handle handle, const char* key, uint64_t v
     return nvs_set(handle, key, value);
 }
 
+extern "C" esp_err_t nvs_batch_begin(nvs_handle handle)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s %d", __func__, handle);
+    HandleEntry* entry = nvs_find_handle_entry(handle);
+    if (entry == NULL) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (entry->mReadOnly) {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+    auto err = entry->mStoragePtr->beginBatch();
+    if (err != ESP_OK) {
+        return err;
+    }
+    entry->mBatch = true;
+    return ESP_OK;
+}
+
+extern "C" esp_err_t nvs_batch_abort(nvs_handle handle)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s %d", __func__, handle);
+    HandleEntry* entry = nvs_find_handle_entry(handle);
+    if (entry == NULL) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (!entry->mBatch) {
+        return ESP_OK;
+    }
+    entry->mBatch = false;
+    return entry->mStoragePtr->abortBatch();
+}
+
 extern "C" esp_err_t nvs_commit(nvs_handle handle)
 {
     Lock lock;
-    // no-op for now, to be used when intermediate cache is added
-    HandleEntry entry;
-    return nvs_find_ns_handle(handle, entry);
+    HandleEntry* entry = nvs_find_handle_entry(handle);
+    if (entry == NULL) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    // without a batch every change has been written already
+    if (!entry->mBatch) {
+        return nvs_check_batch(*entry);
+    }
+    entry->mBatch = false;
+    return entry->mStoragePtr->commitBatch();
 }
 
 extern "C" esp_err_t nvs_set_str(nvs_handle handle, const char* key, const char* value)
@@ -349,6 +445,10 @@ extern "C" esp_err_t nvs_set_str(nvs_handle handle, const char* key, const char*
     if (err != ESP_OK) {
         return err;
     }
+    err = nvs_check_batch(entry);
+    if (err != ESP_OK) {
+        return err;
+    }
     return entry.mStoragePtr->writeItem(entry.mNsIndex, nvs::ItemType::SZ, key, value, strlen(value) + 1);
 }
 
@@ -361,9 +461,84 @@ extern "C" esp_err_t nvs_set_blob(nvs_handle handle, const char* key, const void
     if (err != ESP_OK) {
         return err;
     }
+    err = nvs_check_batch(entry);
+    if (err != ESP_OK) {
+        return err;
+    }
     return entry.mStoragePtr->writeItem(entry.mNsIndex, nvs::ItemType::BLOB, key, value, length);
 }
 
+extern "C" esp_err_t nvs_set_blob_begin(nvs_handle handle, const char* key)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s %s", __func__, key);
+    HandleEntry* entry = nvs_find_handle_entry(handle);
+    if (entry == NULL) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (entry->mReadOnly) {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+    auto err = entry->mStoragePtr->beginBlobWrite(entry->mNsIndex, key);
+    if (err != ESP_OK) {
+        return err;
+    }
+    entry->mBlobWrite = true;
+    return ESP_OK;
+}
+
+extern "C" esp_err_t nvs_set_blob_append(nvs_handle handle, const void* value, size_t length)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s %d", __func__, length);
+    HandleEntry* entry = nvs_find_handle_entry(handle);
+    if (entry == NULL) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (!entry->mBlobWrite) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+    auto err = entry->mStoragePtr->writeBlobPart(value, length);
+    if (err != ESP_OK) {
+        // the storage has dropped the blob
+        entry->mBlobWrite = false;
+    }
+    return err;
+}
+
+extern "C" esp_err_t nvs_set_blob_end(nvs_handle handle)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s %d", __func__, handle);
+    HandleEntry* entry = nvs_find_handle_entry(handle);
+    if (entry == NULL) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (!entry->mBlobWrite) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+    auto err = entry->mStoragePtr->finishBlobWrite();
+    if (err != ESP_ERR_NVS_BATCH_ACTIVE) {
+        entry->mBlobWrite = false;
+    }
+    return err;
+}
+
+extern "C" esp_err_t nvs_set_blob_abort(nvs_handle handle)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s %d", __func__, handle);
+    HandleEntry* entry = nvs_find_handle_entry(handle);
+    if (entry == NULL) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (!entry->mBlobWrite) {
+        return ESP_OK;
+    }
+    entry->mBlobWrite = false;
+    return entry->mStoragePtr->abortBlobWrite();
+}
+
 
 template<typename T>
 static esp_err_t nvs_get(nvs_handle handle, const char* key, T* out_value)
@@ -458,3 +633,99 @@ extern "C" esp_err_t nvs_get_blob(nvs_handle handle, const char* key, void* out_
     return nvs_get_str_or_blob(handle, nvs::ItemType::BLOB, key, out_value, length);
 }
 
+extern "C" esp_err_t nvs_get_blob_part(nvs_handle handle, const char* key, size_t offset, void* out_value, size_t* length)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s %s %d", __func__, key, offset);
+    HandleEntry entry;
+    auto err = nvs_find_ns_handle(handle, entry);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (length == nullptr || out_value == nullptr) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    return entry.mStoragePtr->readBlobPart(entry.mNsIndex, key, offset, out_value, *length, *length);
+}
+
+extern "C" esp_err_t nvs_get_stats(const char* part_name, nvs_stats_t* nvs_stats)
+{
+    Lock lock;
+    if (nvs_stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(nvs_stats, 0, sizeof(*nvs_stats));
+
+    nvs::Storage* pStorage = lookup_storage_from_name((part_name == NULL) ? NVS_DEFAULT_PART_NAME : part_name);
+    if (pStorage == NULL) {
+        return ESP_ERR_NVS_PART_NOT_FOUND;
+    }
+    return pStorage->fillStats(*nvs_stats);
+}
+
+static void nvs_fill_entry_info(nvs_opaque_iterator_t* it)
+{
+    nvs::Item& item = it->mIterator.mItem;
+    memset(&it->mInfo, 0, sizeof(it->mInfo));
+    item.getKey(it->mInfo.key, sizeof(it->mInfo.key) - 1);
+    const char* nsName = it->mStoragePtr->getNamespaceName(item.nsIndex);
+    if (nsName != nullptr) {
+        strncpy(it->mInfo.namespace_name, nsName, sizeof(it->mInfo.namespace_name) - 1);
+    }
+    it->mInfo.type = static_cast<nvs_type_t>(item.datatype);
+}
+
+extern "C" void nvs_release_iterator(nvs_iterator_t it)
+{
+    Lock lock;
+    if (it == NULL) {
+        return;
+    }
+    s_nvs_iterators.erase(it);
+    delete it;
+}
+
+extern "C" nvs_iterator_t nvs_entry_find(const char* part_name, const char* namespace_name, nvs_type_t type)
+{
+    Lock lock;
+    ESP_LOGD(TAG, "%s %s %d", __func__, namespace_name ? namespace_name : "", type);
+    nvs::Storage* pStorage = lookup_storage_from_name(part_name);
+    if (pStorage == NULL) {
+        return NULL;
+    }
+
+    nvs::Storage::EntryIterator entry;
+    if (pStorage->findEntry(namespace_name, static_cast<nvs::ItemType>(type), entry) != ESP_OK) {
+        return NULL;
+    }
+
+    nvs_opaque_iterator_t* it = new (std::nothrow) nvs_opaque_iterator_t;
+    if (it == NULL) {
+        return NULL;
+    }
+    it->mStoragePtr = pStorage;
+    it->mIterator = entry;
+    nvs_fill_entry_info(it);
+    s_nvs_iterators.push_back(it);
+    return it;
+}
+
+extern "C" nvs_iterator_t nvs_entry_next(nvs_iterator_t it)
+{
+    Lock lock;
+    assert(it);
+    if (it->mStoragePtr == nullptr || it->mStoragePtr->nextEntry(it->mIterator) != ESP_OK) {
+        s_nvs_iterators.erase(it);
+        delete it;
+        return NULL;
+    }
+    nvs_fill_entry_info(it);
+    return it;
+}
+
+extern "C" void nvs_entry_info(nvs_iterator_t it, nvs_entry_info_t* out_info)
+{
+    Lock lock;
+    assert(it && out_info);
+    *out_info = it->mInfo;
+}
@@ -0,0 +1,172 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <new>
+#include "nvs_item_index.hpp"
+
+namespace nvs
+{
+
+ItemIndex::ItemIndex()
+{
+}
+
+ItemIndex::~ItemIndex()
+{
+    delete[] mNodes;
+}
+
+void ItemIndex::setMaxItems(size_t maxItems)
+{
+    mMaxItems = maxItems;
+    clear();
+}
+
+void ItemIndex::clear()
+{
+    delete[] mNodes;
+    mNodes = nullptr;
+    mCapacity = 0;
+    mCount = 0;
+    mComplete = mMaxItems > 0;
+}
+
+bool ItemIndex::grow()
+{
+    size_t capacity = mCapacity ? mCapacity * 2 : MIN_CAPACITY;
+    Node* nodes = new (std::nothrow) Node[capacity]();
+    if (!nodes) {
+        return false;
+    }
+
+    Node* oldNodes = mNodes;
+    size_t oldCapacity = mCapacity;
+    mNodes = nodes;
+    mCapacity = capacity;
+    for (size_t i = 0; i < oldCapacity; ++i) {
+        if (oldNodes[i].mUsed) {
+            place(oldNodes[i]);
+        }
+    }
+    delete[] oldNodes;
+    return true;
+}
+
+void ItemIndex::place(const Node& node)
+{
+    const size_t mask = mCapacity - 1;
+    size_t slot = node.mHash & mask;
+    while (mNodes[slot].mUsed) {
+        slot = (slot + 1) & mask;
+    }
+    mNodes[slot] = node;
+}
+
+void ItemIndex::remove(size_t slot)
+{
+    // backward shift deletion, so that probe sequences never need tombstones
+    const size_t mask = mCapacity - 1;
+    size_t hole = slot;
+    size_t next = slot;
+    while (true) {
+        next = (next + 1) & mask;
+        if (!mNodes[next].mUsed) {
+            break;
+        }
+        size_t home = mNodes[next].mHash & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            mNodes[hole] = mNodes[next];
+            hole = next;
+        }
+    }
+    mNodes[hole].mUsed = 0;
+    --mCount;
+}
+
+void ItemIndex::insert(const Item& item, size_t page, size_t entry)
+{
+    if (mCount >= mMaxItems || ((mCount + 1) * 4 > mCapacity * 3 && !grow())) {
+        mComplete = false;
+        return;
+    }
+
+    Node node;
+    node.mHash = hashOf(item);
+    node.mPage = static_cast<uint16_t>(page);
+    node.mEntry = static_cast<uint8_t>(entry);
+    node.mUsed = 1;
+    place(node);
+    ++mCount;
+}
+
+void ItemIndex::erase(const Item& item, size_t page, size_t entry)
+{
+    if (!mCapacity) {
+        return;
+    }
+    const uint32_t hash = hashOf(item);
+    const size_t mask = mCapacity - 1;
+    for (size_t slot = hash & mask; mNodes[slot].mUsed; slot = (slot + 1) & mask) {
+        const Node& node = mNodes[slot];
+        if (node.mHash == hash && node.mPage == page && node.mEntry == entry) {
+            remove(slot);
+            return;
+        }
+    }
+}
+
+void ItemIndex::erase(size_t page, size_t entry)
+{
+    for (size_t slot = 0; slot < mCapacity; ++slot) {
+        const Node& node = mNodes[slot];
+        if (node.mUsed && node.mPage == page && node.mEntry == entry) {
+            remove(slot);
+            return;
+        }
+    }
+}
+
+void ItemIndex::erasePage(size_t page)
+{
+    for (size_t slot = 0; slot < mCapacity; ) {
+        const Node& node = mNodes[slot];
+        if (node.mUsed && node.mPage == page) {
+            // another node may have been shifted into this slot
+            remove(slot);
+        } else {
+            ++slot;
+        }
+    }
+}
+
+bool ItemIndex::find(uint32_t hash, size_t& cursor, size_t& page, size_t& entry) const
+{
+    const size_t mask = mCapacity - 1;
+    while (cursor < mCapacity) {
+        const Node& node = mNodes[(hash + cursor) & mask];
+        ++cursor;
+        if (!node.mUsed) {
+            cursor = mCapacity;
+            break;
+        }
+        if (node.mHash == hash) {
+            page = node.mPage;
+            entry = node.mEntry;
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace nvs
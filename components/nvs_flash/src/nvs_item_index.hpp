@@ -0,0 +1,101 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef nvs_item_index_h
+#define nvs_item_index_h
+
+#include "sdkconfig.h"
+#include "nvs.h"
+#include "nvs_types.hpp"
+
+#ifndef CONFIG_NVS_ITEM_INDEX_SIZE
+#define CONFIG_NVS_ITEM_INDEX_SIZE 256
+#endif
+
+namespace nvs
+{
+
+/**
+ * Storage-wide index from the hash of (namespace, key), and chunk index for blob chunks, to the
+ * location (page, entry) of the item.
+ *
+ * The index is an open-addressing hash table with linear probing. It holds at most
+ * "maxItems" items; when more items are stored the index becomes incomplete, and lookups
+ * which miss in the index must fall back to searching the pages.
+ */
+class ItemIndex
+{
+public:
+    ItemIndex();
+    ~ItemIndex();
+
+    void setMaxItems(size_t maxItems);
+    void clear();
+
+    void insert(const Item& item, size_t page, size_t entry);
+    void erase(const Item& item, size_t page, size_t entry);
+    void erase(size_t page, size_t entry);
+    void erasePage(size_t page);
+
+    /**
+     * Get the next location of items with the given hash, "cursor" must be 0 for the first call.
+     * Items with other keys may have the same hash, so every location has to be checked.
+     */
+    bool find(uint32_t hash, size_t& cursor, size_t& page, size_t& entry) const;
+
+    static uint32_t hashOf(const Item& item)
+    {
+        return item.calculateCrc32WithoutValue();
+    }
+
+    bool isComplete() const
+    {
+        return mComplete;
+    }
+
+    size_t size() const
+    {
+        return mCount;
+    }
+
+private:
+    ItemIndex(const ItemIndex& other);
+    const ItemIndex& operator= (const ItemIndex& rhs);
+
+protected:
+
+    struct Node {
+        uint32_t mHash;
+        uint16_t mPage;
+        uint8_t  mEntry;
+        uint8_t  mUsed;
+    };
+
+    bool grow();
+    void place(const Node& node);
+    void remove(size_t slot);
+
+    Node* mNodes = nullptr;
+    size_t mCapacity = 0;
+    size_t mCount = 0;
+    size_t mMaxItems = CONFIG_NVS_ITEM_INDEX_SIZE;
+    bool mComplete = CONFIG_NVS_ITEM_INDEX_SIZE > 0;
+
+    static const size_t MIN_CAPACITY = 32;
+}; // class ItemIndex
+
+} // namespace nvs
+
+
+#endif /* nvs_item_index_h */
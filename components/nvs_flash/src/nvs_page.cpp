@@ -151,7 +151,8 @@ esp_err_t Page::writeEntryData(const uint8_t* data, size_t size)
     return ESP_OK;
 }
 
-esp_err_t Page::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize)
+esp_err_t Page::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize,
+        uint8_t batchTag, uint8_t chunkIndex)
 {
     Item item;
     esp_err_t err;
@@ -176,20 +177,20 @@ esp_err_t Page::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, c
         return ESP_ERR_NVS_KEY_TOO_LONG;
     }
     
-    if (dataSize > Page::BLOB_MAX_SIZE) {
+    if (dataSize > ((datatype == ItemType::BLOB_DATA) ? Page::CHUNK_MAX_SIZE : Page::BLOB_MAX_SIZE)) {
         return ESP_ERR_NVS_VALUE_TOO_LONG;
     }
 
     size_t totalSize = ENTRY_SIZE;
     size_t entriesCount = 1;
-    if (datatype == ItemType::SZ || datatype == ItemType::BLOB) {
+    if (isVariableLengthType(datatype)) {
         size_t roundedSize = (dataSize + ENTRY_SIZE - 1) & ~(ENTRY_SIZE - 1);
         totalSize += roundedSize;
         entriesCount += roundedSize / ENTRY_SIZE;
     }
 
     // primitive types should fit into one entry
-    assert(totalSize == ENTRY_SIZE || datatype == ItemType::BLOB || datatype == ItemType::SZ);
+    assert(totalSize == ENTRY_SIZE || isVariableLengthType(datatype));
 
     if (mNextFreeEntry == INVALID_ENTRY || mNextFreeEntry + entriesCount > ENTRY_COUNT) {
         // page will not fit this amount of data
@@ -199,11 +200,12 @@ esp_err_t Page::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, c
     // write first item
     size_t span = (totalSize + ENTRY_SIZE - 1) / ENTRY_SIZE;
     item = Item(nsIndex, datatype, span, key);
-    mHashList.insert(item, mNextFreeEntry);
+    item.batchTag = batchTag;
 
-    if (datatype != ItemType::SZ && datatype != ItemType::BLOB) {
+    if (!isVariableLengthType(datatype)) {
         memcpy(item.data, data, dataSize);
         item.crc32 = item.calculateCrc32();
+        cacheInsert(item, mNextFreeEntry);
         err = writeEntry(item);
         if (err != ESP_OK) {
             return err;
@@ -212,8 +214,11 @@ esp_err_t Page::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, c
         const uint8_t* src = reinterpret_cast<const uint8_t*>(data);
         item.varLength.dataCrc32 = Item::calculateCrc32(src, dataSize);
         item.varLength.dataSize = dataSize;
-        item.varLength.reserved2 = 0xffff;
+        item.varLength.chunkIndex = chunkIndex;
+        item.varLength.reserved2 = 0xff;
         item.crc32 = item.calculateCrc32();
+        // chunks are hashed with their index
+        cacheInsert(item, mNextFreeEntry);
         err = writeEntry(item);
         if (err != ESP_OK) {
             return err;
@@ -241,6 +246,111 @@ esp_err_t Page::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, c
     return ESP_OK;
 }
 
+esp_err_t Page::writeItems(Item* items, size_t count, size_t& written)
+{
+    esp_err_t err;
+
+    written = 0;
+    if (mState == PageState::INVALID) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+
+    if (mState == PageState::UNINITIALIZED) {
+        err = initialize();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    if (mState == PageState::FULL || mNextFreeEntry == INVALID_ENTRY || mNextFreeEntry >= ENTRY_COUNT) {
+        return ESP_ERR_NVS_PAGE_FULL;
+    }
+
+    if (count > ENTRY_COUNT - mNextFreeEntry) {
+        count = ENTRY_COUNT - mNextFreeEntry;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        assert(items[i].span == 1);
+        items[i].crc32 = items[i].calculateCrc32();
+        cacheInsert(items[i], mNextFreeEntry + i);
+    }
+
+    if (mFirstUsedEntry == INVALID_ENTRY) {
+        mFirstUsedEntry = mNextFreeEntry;
+    }
+
+    err = writeEntryData(reinterpret_cast<const uint8_t*>(items), count * ENTRY_SIZE);
+    if (err != ESP_OK) {
+        return err;
+    }
+    written = count;
+    return ESP_OK;
+}
+
+esp_err_t Page::clearBatchTag(uint8_t batchTag, Item* buffer, size_t bufferSize)
+{
+    if (mState != PageState::ACTIVE && mState != PageState::FULL) {
+        return ESP_OK;
+    }
+    if (mFirstUsedEntry == INVALID_ENTRY) {
+        return ESP_OK;
+    }
+
+    // "buffer" holds the headers of entries [runBegin, runBegin + runSize), tag already cleared
+    size_t runBegin = 0;
+    size_t runSize = 0;
+    auto flushRun = [&]() -> esp_err_t {
+        if (runSize == 0) {
+            return ESP_OK;
+        }
+        auto rc = spi_flash_write(getEntryAddress(runBegin), buffer, runSize * ENTRY_SIZE);
+        runSize = 0;
+        if (rc != ESP_OK) {
+            mState = PageState::INVALID;
+        }
+        return rc;
+    };
+
+    const size_t end = mNextFreeEntry < ENTRY_COUNT ? mNextFreeEntry : ENTRY_COUNT;
+    size_t next;
+    for (size_t i = mFirstUsedEntry; i < end; i = next) {
+        next = i + 1;
+        Item item;
+        bool tagged = false;
+        if (mEntryTable.get(i) == EntryState::WRITTEN) {
+            auto rc = readEntry(i, item);
+            if (rc != ESP_OK) {
+                mState = PageState::INVALID;
+                return rc;
+            }
+            if (item.crc32 == item.calculateCrc32()) {
+                if (isVariableLengthType(item.datatype)) {
+                    next = i + item.span;
+                }
+                tagged = item.batchTag == batchTag;
+            }
+        }
+
+        // the data entries of a string or a blob end the run, they stay as they are
+        if (!tagged || runBegin + runSize != i || runSize == bufferSize) {
+            auto rc = flushRun();
+            if (rc != ESP_OK) {
+                return rc;
+            }
+        }
+        if (tagged) {
+            if (runSize == 0) {
+                runBegin = i;
+            }
+            buffer[runSize] = item;
+            buffer[runSize].batchTag = Item::COMMITTED_BATCH;
+            ++runSize;
+        }
+    }
+    return flushRun();
+}
+
 esp_err_t Page::readItem(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize)
 {
     size_t index = 0;
@@ -255,7 +365,15 @@ esp_err_t Page::readItem(uint8_t nsIndex, ItemType datatype, const char* key, vo
         return rc;
     }
 
-    if (datatype != ItemType::SZ && datatype != ItemType::BLOB) {
+    return readItemAt(index, item, data, dataSize);
+}
+
+esp_err_t Page::readItemAt(size_t index, const Item& item, void* data, size_t dataSize)
+{
+    esp_err_t rc;
+    ItemType datatype = item.datatype;
+
+    if (!isVariableLengthType(datatype)) {
         if (dataSize != getAlignmentForType(datatype)) {
             return ESP_ERR_NVS_TYPE_MISMATCH;
         }
@@ -292,6 +410,49 @@ esp_err_t Page::readItem(uint8_t nsIndex, ItemType datatype, const char* key, vo
     return ESP_OK;
 }
 
+esp_err_t Page::readItemDataAt(size_t index, const Item& item, size_t offset, void* data, size_t dataSize)
+{
+    if (!isVariableLengthType(item.datatype)) {
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+
+    const size_t itemSize = item.varLength.dataSize;
+    if (offset > itemSize || dataSize > itemSize - offset) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    uint8_t* dst = reinterpret_cast<uint8_t*>(data);
+    uint32_t crc32 = 0xffffffff;
+    size_t pos = 0;
+    for (size_t i = index + 1; i < index + item.span && pos < itemSize; ++i, pos += ENTRY_SIZE) {
+        Item ditem;
+        auto rc = readEntry(i, ditem);
+        if (rc != ESP_OK) {
+            return rc;
+        }
+        size_t size = itemSize - pos;
+        if (size > ENTRY_SIZE) {
+            size = ENTRY_SIZE;
+        }
+        crc32 = Item::calculateCrc32(ditem.rawData, size, crc32);
+
+        // copy the part of this entry which overlaps [offset, offset + dataSize)
+        size_t begin = std::max(pos, offset);
+        size_t end = std::min(pos + size, offset + dataSize);
+        if (begin < end) {
+            memcpy(dst + begin - offset, ditem.rawData + begin - pos, end - begin);
+        }
+    }
+    if (crc32 != item.varLength.dataCrc32) {
+        auto rc = eraseEntryAndSpan(index);
+        if (rc != ESP_OK) {
+            return rc;
+        }
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
 esp_err_t Page::eraseItem(uint8_t nsIndex, ItemType datatype, const char* key)
 {
     size_t index = 0;
@@ -303,6 +464,14 @@ esp_err_t Page::eraseItem(uint8_t nsIndex, ItemType datatype, const char* key)
     return eraseEntryAndSpan(index);
 }
 
+esp_err_t Page::eraseItemAt(size_t index)
+{
+    if (index >= ENTRY_COUNT || mEntryTable.get(index) != EntryState::WRITTEN) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    return eraseEntryAndSpan(index);
+}
+
 esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key)
 {
     size_t index = 0;
@@ -324,6 +493,9 @@ esp_err_t Page::eraseEntryAndSpan(size_t index)
         }
         if (item.calculateCrc32() != item.crc32) {
             mHashList.erase(index, false);
+            if (mItemIndex) {
+                mItemIndex->erase(mPageNumber, index);
+            }
             rc = alterEntryState(index, EntryState::ERASED);
             --mUsedEntryCount;
             ++mErasedEntryCount;
@@ -332,6 +504,9 @@ esp_err_t Page::eraseEntryAndSpan(size_t index)
             }
         } else {
             mHashList.erase(index);
+            if (mItemIndex) {
+                mItemIndex->erase(item, mPageNumber, index);
+            }
             span = item.span;
             for (ptrdiff_t i = index + span - 1; i >= static_cast<ptrdiff_t>(index); --i) {
                 if (mEntryTable.get(i) == EntryState::WRITTEN) {
@@ -366,6 +541,18 @@ esp_err_t Page::eraseEntryAndSpan(size_t index)
     return ESP_OK;
 }
 
+bool Page::isDuplicate(const Item& item, const Item& other)
+{
+    if (item.nsIndex != other.nsIndex || strncmp(item.key, other.key, Item::MAX_KEY_LENGTH) != 0) {
+        return false;
+    }
+    // chunks of a blob are different items, both from each other and from the index of the blob
+    if ((item.datatype == ItemType::BLOB_DATA) != (other.datatype == ItemType::BLOB_DATA)) {
+        return false;
+    }
+    return item.datatype != ItemType::BLOB_DATA || item.varLength.chunkIndex == other.varLength.chunkIndex;
+}
+
 void Page::updateFirstUsedEntry(size_t index, size_t span)
 {
     assert(index == mFirstUsedEntry);
@@ -410,7 +597,7 @@ esp_err_t Page::copyItems(Page& other)
             return err;
         }
 
-        other.mHashList.insert(entry, other.mNextFreeEntry);
+        other.cacheInsert(entry, other.mNextFreeEntry);
         err = other.writeEntry(entry);
         if (err != ESP_OK) {
             return err;
@@ -533,12 +720,12 @@ esp_err_t Page::mLoadEntryTable()
                 continue;
             }
 
-            mHashList.insert(item, i);
+            cacheInsert(item, i);
 
             // search for potential duplicate item
             size_t duplicateIndex = mHashList.find(0, item);
             
-            if (item.datatype == ItemType::BLOB || item.datatype == ItemType::SZ) {
+            if (isVariableLengthType(item.datatype)) {
                 span = item.span;
                 bool needErase = false;
                 for (size_t j = i; j < i + span; ++j) {
@@ -554,17 +741,30 @@ esp_err_t Page::mLoadEntryTable()
                 }
             }
             
-            if (duplicateIndex < i) {
-                eraseEntryAndSpan(duplicateIndex);
+            // copies written by a batch are resolved by Storage, which knows whether the batch was committed;
+            // items with the same hash may have another key, or be other chunks of the same blob
+            for (; duplicateIndex < i && item.batchTag == Item::NO_BATCH;
+                    duplicateIndex = mHashList.find(duplicateIndex + 1, item)) {
+                Item dupItem;
+                err = readEntry(duplicateIndex, dupItem);
+                if (err != ESP_OK) {
+                    mState = PageState::INVALID;
+                    return err;
+                }
+                if (dupItem.batchTag == Item::NO_BATCH && isDuplicate(item, dupItem)) {
+                    eraseEntryAndSpan(duplicateIndex);
+                    break;
+                }
             }
         }
 
         // check that last item is not duplicate
-        if (lastItemIndex != INVALID_ENTRY) {
+        if (lastItemIndex != INVALID_ENTRY && item.batchTag == Item::NO_BATCH) {
             size_t findItemIndex = 0;
             Item dupItem;
-            if (findItem(item.nsIndex, item.datatype, item.key, findItemIndex, dupItem) == ESP_OK) {
-                if (findItemIndex < lastItemIndex) {
+            uint8_t chunkIndex = (item.datatype == ItemType::BLOB_DATA) ? item.varLength.chunkIndex : Item::CHUNK_ANY;
+            if (findItem(item.nsIndex, item.datatype, item.key, findItemIndex, dupItem, chunkIndex) == ESP_OK) {
+                if (findItemIndex < lastItemIndex && dupItem.batchTag == Item::NO_BATCH) {
                     auto err = eraseEntryAndSpan(findItemIndex);
                     if (err != ESP_OK) {
                         mState = PageState::INVALID;
@@ -598,10 +798,10 @@ esp_err_t Page::mLoadEntryTable()
             }
             assert(item.span > 0);
 
-            mHashList.insert(item, i);
+            cacheInsert(item, i);
             size_t span = item.span;
 
-            if (item.datatype == ItemType::BLOB || item.datatype == ItemType::SZ) {
+            if (isVariableLengthType(item.datatype)) {
                 for (size_t j = i + 1; j < i + span; ++j) {
                     if (mEntryTable.get(j) != EntryState::WRITTEN) {
                         eraseEntryAndSpan(i);
@@ -644,6 +844,10 @@ esp_err_t Page::alterEntryState(size_t index, EntryState state)
     assert(index < ENTRY_COUNT);
     mEntryTable.set(index, state);
     size_t wordToWrite = mEntryTable.getWordIndex(index);
+    if (mDeferEntryTableWrites) {
+        mDirtyEntryTableWords |= 1u << wordToWrite;
+        return ESP_OK;
+    }
     uint32_t word = mEntryTable.data()[wordToWrite];
     auto rc = spi_flash_write(mBaseAddress + ENTRY_TABLE_OFFSET + static_cast<uint32_t>(wordToWrite) * 4,
             &word, sizeof(word));
@@ -667,7 +871,9 @@ esp_err_t Page::alterEntryRangeState(size_t begin, size_t end, EntryState state)
         } else {
             nextWordIndex = mEntryTable.getWordIndex(i - 1);
         }
-        if (nextWordIndex != wordIndex) {
+        if (nextWordIndex != wordIndex && mDeferEntryTableWrites) {
+            mDirtyEntryTableWords |= 1u << wordIndex;
+        } else if (nextWordIndex != wordIndex) {
             uint32_t word = mEntryTable.data()[wordIndex];
             auto rc = spi_flash_write(mBaseAddress + ENTRY_TABLE_OFFSET + static_cast<uint32_t>(wordIndex) * 4,
                     &word, 4);
@@ -680,6 +886,26 @@ esp_err_t Page::alterEntryRangeState(size_t begin, size_t end, EntryState state)
     return ESP_OK;
 }
 
+esp_err_t Page::flushEntryTable()
+{
+    mDeferEntryTableWrites = false;
+    if (mDirtyEntryTableWords == 0) {
+        return ESP_OK;
+    }
+
+    // words between the dirty ones are rewritten with the same value, which leaves the flash unchanged
+    size_t first = __builtin_ctz(mDirtyEntryTableWords);
+    size_t last = 31 - __builtin_clz(mDirtyEntryTableWords);
+    mDirtyEntryTableWords = 0;
+    auto rc = spi_flash_write(mBaseAddress + ENTRY_TABLE_OFFSET + static_cast<uint32_t>(first) * 4,
+            mEntryTable.data() + first, (last - first + 1) * 4);
+    if (rc != ESP_OK) {
+        mState = PageState::INVALID;
+        return rc;
+    }
+    return ESP_OK;
+}
+
 esp_err_t Page::alterPageState(PageState state)
 {
     uint32_t state_val = static_cast<uint32_t>(state);
@@ -701,7 +927,8 @@ esp_err_t Page::readEntry(size_t index, Item& dst) const
     return ESP_OK;
 }
 
-esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key, size_t &itemIndex, Item& item)
+esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key, size_t &itemIndex, Item& item,
+        uint8_t chunkIndex)
 {
     if (mState == PageState::CORRUPT || mState == PageState::INVALID || mState == PageState::UNINITIALIZED) {
         return ESP_ERR_NVS_NOT_FOUND;
@@ -722,8 +949,12 @@ esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key, si
         end = ENTRY_COUNT;
     }
 
-    if (nsIndex != NS_ANY && datatype != ItemType::ANY && key != NULL) {
-        size_t cachedIndex = mHashList.find(start, Item(nsIndex, datatype, 0, key));
+    // chunks are hashed with their index, so a lookup of any chunk has to walk the page
+    if (nsIndex != NS_ANY && datatype != ItemType::ANY && key != NULL &&
+            (datatype != ItemType::BLOB_DATA || chunkIndex != Item::CHUNK_ANY)) {
+        Item probe(nsIndex, datatype, 0, key);
+        probe.varLength.chunkIndex = chunkIndex;
+        size_t cachedIndex = mHashList.find(start, probe);
         if (cachedIndex < ENTRY_COUNT) {
             start = cachedIndex;
         } else {
@@ -754,7 +985,7 @@ esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key, si
             continue;
         }
 
-        if (item.datatype == ItemType::BLOB || item.datatype == ItemType::SZ) {
+        if (isVariableLengthType(item.datatype)) {
             next = i + item.span;
         }
 
@@ -767,9 +998,17 @@ esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key, si
         }
 
         if (datatype != ItemType::ANY && item.datatype != datatype) {
+            // the index and the chunks of a blob have the key of the blob
+            if (isBlobType(datatype) && isBlobType(item.datatype)) {
+                continue;
+            }
             return ESP_ERR_NVS_TYPE_MISMATCH;
         }
 
+        if (!item.matchesChunk(chunkIndex)) {
+            continue;
+        }
+
         itemIndex = i;
 
         return ESP_OK;
@@ -778,6 +1017,70 @@ esp_err_t Page::findItem(uint8_t nsIndex, ItemType datatype, const char* key, si
     return ESP_ERR_NVS_NOT_FOUND;
 }
 
+esp_err_t Page::findItemAt(size_t itemIndex, uint8_t nsIndex, ItemType datatype, const char* key, Item& item,
+        uint8_t chunkIndex)
+{
+    if (mState == PageState::CORRUPT || mState == PageState::INVALID || mState == PageState::UNINITIALIZED) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    if (itemIndex >= ENTRY_COUNT || mEntryTable.get(itemIndex) != EntryState::WRITTEN) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    auto rc = readEntry(itemIndex, item);
+    if (rc != ESP_OK) {
+        mState = PageState::INVALID;
+        return rc;
+    }
+
+    if (item.crc32 != item.calculateCrc32()) {
+        rc = eraseEntryAndSpan(itemIndex);
+        if (rc != ESP_OK) {
+            mState = PageState::INVALID;
+            return rc;
+        }
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    if (item.nsIndex != nsIndex || strncmp(key, item.key, Item::MAX_KEY_LENGTH) != 0) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    if (datatype != ItemType::ANY && item.datatype != datatype) {
+        return (isBlobType(datatype) && isBlobType(item.datatype)) ? ESP_ERR_NVS_NOT_FOUND : ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+
+    if (!item.matchesChunk(chunkIndex)) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    return ESP_OK;
+}
+
+void Page::calcEntries(nvs_stats_t& nvsStats) const
+{
+    nvsStats.total_entries += ENTRY_COUNT;
+    switch (mState) {
+    case PageState::ACTIVE:
+    case PageState::FULL:
+    case PageState::FREEING:
+        // erased entries are reclaimed by garbage collection, so they are free space too
+        nvsStats.used_entries += mUsedEntryCount;
+        nvsStats.free_entries += ENTRY_COUNT - mUsedEntryCount;
+        break;
+
+    case PageState::UNINITIALIZED:
+    case PageState::CORRUPT:
+        // corrupt pages are erased once there are no free pages left
+        nvsStats.free_entries += ENTRY_COUNT;
+        break;
+
+    default:
+        break;
+    }
+}
+
 esp_err_t Page::getSeqNumber(uint32_t& seqNumber) const
 {
     if (mState != PageState::UNINITIALIZED && mState != PageState::INVALID && mState != PageState::CORRUPT) {
@@ -811,6 +1114,9 @@ esp_err_t Page::erase()
     mNextFreeEntry = INVALID_ENTRY;
     mState = PageState::UNINITIALIZED;
     mHashList.clear();
+    if (mItemIndex) {
+        mItemIndex->erasePage(mPageNumber);
+    }
     return ESP_OK;
 }
 
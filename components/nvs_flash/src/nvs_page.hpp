@@ -24,6 +24,7 @@
 #include "compressed_enum_table.hpp"
 #include "intrusive_list.h"
 #include "nvs_item_hash_list.hpp"
+#include "nvs_item_index.hpp"
 
 namespace nvs
 {
@@ -48,7 +49,10 @@ public:
     
     static const size_t BLOB_MAX_SIZE = ENTRY_SIZE * (ENTRY_COUNT / 2 - 1);
 
+    static const size_t CHUNK_MAX_SIZE = ENTRY_SIZE * (ENTRY_COUNT - 1);
+
     static const uint8_t NS_INDEX = 0;
+    static const uint8_t NS_BATCH = 254;
     static const uint8_t NS_ANY = 255;
 
     enum class PageState : uint32_t {
@@ -84,7 +88,21 @@ public:
 
     esp_err_t setSeqNumber(uint32_t seqNumber);
 
-    esp_err_t writeItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize);
+    esp_err_t writeItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize,
+            uint8_t batchTag = Item::NO_BATCH, uint8_t chunkIndex = Item::CHUNK_ANY);
+
+    /**
+     * Write as many of the given single-entry items as fit into the page, with one flash write.
+     * The crc of the items is filled in; "written" returns how many items were written.
+     */
+    esp_err_t writeItems(Item* items, size_t count, size_t& written);
+
+    /**
+     * Set the batch tag of the items tagged with "batchTag" to Item::COMMITTED_BATCH. Only bits
+     * of the headers are cleared; headers of up to "bufferSize" items stored back to back are
+     * rewritten with one flash write, through "buffer".
+     */
+    esp_err_t clearBatchTag(uint8_t batchTag, Item* buffer, size_t bufferSize);
 
     esp_err_t readItem(uint8_t nsIndex, ItemType datatype, const char* key, void* data, size_t dataSize);
 
@@ -92,7 +110,21 @@ public:
 
     esp_err_t findItem(uint8_t nsIndex, ItemType datatype, const char* key);
 
-    esp_err_t findItem(uint8_t nsIndex, ItemType datatype, const char* key, size_t &itemIndex, Item& item);
+    esp_err_t findItem(uint8_t nsIndex, ItemType datatype, const char* key, size_t &itemIndex, Item& item,
+            uint8_t chunkIndex = Item::CHUNK_ANY);
+
+    esp_err_t findItemAt(size_t itemIndex, uint8_t nsIndex, ItemType datatype, const char* key, Item& item,
+            uint8_t chunkIndex = Item::CHUNK_ANY);
+
+    esp_err_t readItemAt(size_t itemIndex, const Item& item, void* data, size_t dataSize);
+
+    /**
+     * Read "dataSize" bytes of a variable length item, starting at "offset" into its data.
+     * All entries of the item are still read, to check the crc of the data.
+     */
+    esp_err_t readItemDataAt(size_t itemIndex, const Item& item, size_t offset, void* data, size_t dataSize);
+
+    esp_err_t eraseItemAt(size_t itemIndex);
 
     template<typename T>
     esp_err_t writeItem(uint8_t nsIndex, const char* key, const T& value)
@@ -122,6 +154,21 @@ public:
         return mErasedEntryCount;
     }
 
+    // add the entries of this page to the partition usage statistics
+    void calcEntries(nvs_stats_t& nvsStats) const;
+
+    // size of the largest variable length item which still fits into the page
+    size_t getVarDataTailroom() const
+    {
+        if (mState == PageState::UNINITIALIZED) {
+            return CHUNK_MAX_SIZE;
+        }
+        if (mState != PageState::ACTIVE || mNextFreeEntry == INVALID_ENTRY || mNextFreeEntry + 1 >= ENTRY_COUNT) {
+            return 0;
+        }
+        return (ENTRY_COUNT - mNextFreeEntry - 1) * ENTRY_SIZE;
+    }
+
 
     esp_err_t markFull();
 
@@ -131,6 +178,24 @@ public:
 
     esp_err_t erase();
 
+    /**
+     * Keep entry state changes in RAM until flushEntryTable is called, so that erasing
+     * many items costs a single write of the entry state table. Only erasing is allowed
+     * while the writes are deferred.
+     */
+    void deferEntryTableWrites()
+    {
+        mDeferEntryTableWrites = true;
+    }
+
+    esp_err_t flushEntryTable();
+
+    void setItemIndex(ItemIndex* itemIndex, size_t pageNumber)
+    {
+        mItemIndex = itemIndex;
+        mPageNumber = pageNumber;
+    }
+
     void debugDump() const;
 
 protected:
@@ -178,6 +243,16 @@ protected:
 
     void updateFirstUsedEntry(size_t index, size_t span);
 
+    static bool isDuplicate(const Item& item, const Item& other);
+
+    void cacheInsert(const Item& item, size_t index)
+    {
+        mHashList.insert(item, index);
+        if (mItemIndex) {
+            mItemIndex->insert(item, mPageNumber, index);
+        }
+    }
+
     static constexpr size_t getAlignmentForType(ItemType type)
     {
         return static_cast<uint8_t>(type) & 0x0f;
@@ -205,6 +280,12 @@ protected:
 
     HashList mHashList;
 
+    ItemIndex* mItemIndex = nullptr;
+    size_t mPageNumber = 0;
+
+    bool mDeferEntryTableWrites = false;
+    uint32_t mDirtyEntryTableWords = 0;
+
     static const uint32_t HEADER_OFFSET = 0;
     static const uint32_t ENTRY_TABLE_OFFSET = HEADER_OFFSET + 32;
     static const uint32_t ENTRY_DATA_OFFSET = ENTRY_TABLE_OFFSET + 32;
@@ -212,6 +293,7 @@ protected:
     static_assert(sizeof(Header) == 32, "header size must be 32 bytes");
     static_assert(ENTRY_TABLE_OFFSET % 32 == 0, "entry table offset should be aligned");
     static_assert(ENTRY_DATA_OFFSET % 32 == 0, "entry data offset should be aligned");
+    static_assert(TEntryTable::byteSize() / 4 <= 32, "dirty entry table words must fit into a 32-bit mask");
 
 }; // class Page
 
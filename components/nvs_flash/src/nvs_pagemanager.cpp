@@ -22,8 +22,10 @@ esp_err_t PageManager::load(uint32_t baseSector, uint32_t sectorCount)
     mPageList.clear();
     mFreePageList.clear();
     mPages.reset(new Page[sectorCount]);
+    mItemIndex.clear();
 
     for (uint32_t i = 0; i < sectorCount; ++i) {
+        mPages[i].setItemIndex(&mItemIndex, i);
         auto err = mPages[i].load(baseSector + i);
         if (err != ESP_OK) {
             return err;
@@ -64,14 +66,32 @@ esp_err_t PageManager::load(uint32_t baseSector, uint32_t sectorCount)
         lastItemIndex = itemIndex;
     }
 
-    if (lastItemIndex != SIZE_MAX) {
-        auto last = PageManager::TPageListIterator(&lastPage);
-        for (auto it = begin(); it != last; ++it) {
+    // (copies written by a batch are resolved by Storage, which knows whether the batch was committed)
+    if (lastItemIndex != SIZE_MAX && item.batchTag == Item::NO_BATCH) {
+        // a blob written as a single item replaces one written in chunks, and the other way round
+        ItemType dupTypes[] = {item.datatype, item.datatype};
+        if (item.datatype == ItemType::BLOB) {
+            dupTypes[1] = ItemType::BLOB_IDX;
+        } else if (item.datatype == ItemType::BLOB_IDX) {
+            dupTypes[1] = ItemType::BLOB;
+        }
+        uint8_t chunkIndex = (item.datatype == ItemType::BLOB_DATA) ? item.varLength.chunkIndex : Item::CHUNK_ANY;
 
-            if ((it->state() != Page::PageState::FREEING) &&
-                    (it->eraseItem(item.nsIndex, item.datatype, item.key) == ESP_OK)) {
+        auto last = PageManager::TPageListIterator(&lastPage);
+        for (size_t i = 0; i < sizeof(dupTypes) / sizeof(dupTypes[0]); ++i) {
+            if (i > 0 && dupTypes[i] == dupTypes[i - 1]) {
                 break;
             }
+            for (auto it = begin(); it != last; ++it) {
+                size_t dupIndex = 0;
+                Item dupItem;
+                if ((it->state() != Page::PageState::FREEING) &&
+                        (it->findItem(item.nsIndex, dupTypes[i], item.key, dupIndex, dupItem, chunkIndex) == ESP_OK) &&
+                        (dupItem.batchTag == Item::NO_BATCH) &&
+                        (it->eraseItemAt(dupIndex) == ESP_OK)) {
+                    break;
+                }
+            }
         }
     }
 
@@ -181,6 +201,16 @@ esp_err_t PageManager::requestNewPage()
     return ESP_OK;
 }
 
+void PageManager::fillStats(nvs_stats_t& nvsStats)
+{
+    for (auto it = mPageList.begin(); it != mPageList.end(); ++it) {
+        it->calcEntries(nvsStats);
+    }
+    for (auto it = mFreePageList.begin(); it != mFreePageList.end(); ++it) {
+        it->calcEntries(nvsStats);
+    }
+}
+
 esp_err_t PageManager::activatePage()
 {
     if (mFreePageList.empty()) {
@@ -50,6 +50,18 @@ public:
 
     esp_err_t requestNewPage();
 
+    Page* getPage(size_t pageNumber)
+    {
+        return (pageNumber < mPageCount) ? &mPages[pageNumber] : nullptr;
+    }
+
+    ItemIndex& itemIndex()
+    {
+        return mItemIndex;
+    }
+
+    void fillStats(nvs_stats_t& nvsStats);
+
 protected:
     friend class Iterator;
 
@@ -61,6 +73,7 @@ protected:
     uint32_t mBaseSector;
     uint32_t mPageCount;
     uint32_t mSeqNumber;
+    ItemIndex mItemIndex;
 }; // class PageManager
 
 
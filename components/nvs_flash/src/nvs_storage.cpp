@@ -11,6 +11,7 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+#include <new>
 #include "nvs_storage.hpp"
 
 #ifndef ESP_PLATFORM
@@ -21,9 +22,16 @@
 namespace nvs
 {
 
+const char* const Storage::BATCH_BEGIN_KEY = "nvs.batch";
+const char* const Storage::BATCH_COMMIT_KEY = "nvs.commit";
+
+// a blob is stored either as a single item, or as an index and chunks
+static const ItemType BLOB_ITEM_TYPES[] = {ItemType::BLOB_IDX, ItemType::BLOB_DATA, ItemType::BLOB};
+
 Storage::~Storage()
 {
     clearNamespaces();
+    clearBatchEntries();
 }
 
 void Storage::clearNamespaces()
@@ -36,112 +44,950 @@ void Storage::clearNamespaces()
     }
 }
 
-esp_err_t Storage::init(uint32_t baseSector, uint32_t sectorCount)
+esp_err_t Storage::init(uint32_t baseSector, uint32_t sectorCount)
+{
+    auto err = mPageManager.load(baseSector, sectorCount);
+    if (err != ESP_OK) {
+        mState = StorageState::INVALID;
+        return err;
+    }
+    mPageCount = sectorCount;
+
+    releaseBlobWriter();
+    clearBatchEntries();
+    mBatchItems.reset();
+    mBatchItemCount = 0;
+    mBatchTag = Item::NO_BATCH;
+    mBatchTagUsageLoaded = false;
+
+    // load namespaces list
+    clearNamespaces();
+    std::fill_n(mNamespaceUsage.data(), mNamespaceUsage.byteSize() / 4, 0);
+    for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
+        Page& p = *it;
+        size_t itemIndex = 0;
+        Item item;
+        while (p.findItem(Page::NS_INDEX, ItemType::U8, nullptr, itemIndex, item) == ESP_OK) {
+            NamespaceEntry* entry = new NamespaceEntry;
+            item.getKey(entry->mName, sizeof(entry->mName) - 1);
+            item.getValue(entry->mIndex);
+            mNamespaces.push_back(entry);
+            mNamespaceUsage.set(entry->mIndex, true);
+            itemIndex += item.span;
+        }
+    }
+    mNamespaceUsage.set(0, true);
+    mNamespaceUsage.set(255, true);
+
+    // namespace index NS_BATCH holds the batch records, unless a namespace got it before batches existed
+    if (!isBatchNamespaceTaken()) {
+        mNamespaceUsage.set(Page::NS_BATCH, true);
+        err = recoverBatch();
+        if (err != ESP_OK) {
+            mState = StorageState::INVALID;
+            return err;
+        }
+    }
+
+    err = eraseOrphanBlobChunks();
+    if (err != ESP_OK) {
+        mState = StorageState::INVALID;
+        return err;
+    }
+    mState = StorageState::ACTIVE;
+#ifndef ESP_PLATFORM
+    debugCheck();
+#endif
+    return ESP_OK;
+}
+
+bool Storage::isValid() const
+{
+    return mState == StorageState::ACTIVE;
+}
+
+esp_err_t Storage::findIndexedItem(uint8_t nsIndex, ItemType datatype, const char* key, Page* &page, Item& item, size_t& itemIndex,
+        BatchFilter filter, uint8_t batchTag, uint8_t chunkIndex)
+{
+    ItemIndex& index = mPageManager.itemIndex();
+    Item probe(nsIndex, datatype, 0, key);
+    probe.varLength.chunkIndex = chunkIndex;
+    const uint32_t hash = ItemIndex::hashOf(probe);
+    size_t cursor = 0;
+    size_t pageNumber;
+    size_t entry;
+    uint32_t foundSeqNumber = 0;
+
+    // if there is more than one copy (power went out between writing a new one and erasing the old one),
+    // the oldest one wins, as if the pages had been searched in order
+    page = nullptr;
+    while (index.find(hash, cursor, pageNumber, entry)) {
+        Page* p = mPageManager.getPage(pageNumber);
+        uint32_t seqNumber;
+        Item candidate;
+
+        if (!p || p->getSeqNumber(seqNumber) != ESP_OK) {
+            continue;
+        }
+        if (page && (seqNumber > foundSeqNumber || (seqNumber == foundSeqNumber && entry > itemIndex))) {
+            continue;
+        }
+        if (p->findItemAt(entry, nsIndex, datatype, key, candidate, chunkIndex) != ESP_OK ||
+                !passesFilter(candidate, filter, batchTag)) {
+            continue;
+        }
+
+        page = p;
+        foundSeqNumber = seqNumber;
+        itemIndex = entry;
+        item = candidate;
+    }
+
+    return page ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t Storage::findItem(uint8_t nsIndex, ItemType datatype, const char* key, Page* &page, Item& item, size_t& itemIndex,
+        BatchFilter filter, uint8_t batchTag, uint8_t chunkIndex)
+{
+    // the index knows every item unless it ran out of memory, only then the pages must be searched;
+    // chunks are indexed by their chunk index, so a lookup of any chunk has to search the pages as well
+    esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+    const bool anyChunk = datatype == ItemType::BLOB_DATA && chunkIndex == Item::CHUNK_ANY;
+    if (!anyChunk) {
+        err = findIndexedItem(nsIndex, datatype, key, page, item, itemIndex, filter, batchTag, chunkIndex);
+        if (err == ESP_OK || mPageManager.itemIndex().isComplete()) {
+            return err;
+        }
+    }
+
+    for (auto it = std::begin(mPageManager); it != std::end(mPageManager); ++it) {
+        itemIndex = 0;
+        if (filter == BatchFilter::ALL) {
+            err = it->findItem(nsIndex, datatype, key, itemIndex, item, chunkIndex);
+            if (err == ESP_OK) {
+                page = it;
+                return ESP_OK;
+            }
+            continue;
+        }
+
+        // the first copy of the key on the page may not be the wanted one, so walk all of them
+        while (it->findItem(nsIndex, ItemType::ANY, key, itemIndex, item) == ESP_OK) {
+            if ((datatype == ItemType::ANY || item.datatype == datatype) && item.matchesChunk(chunkIndex) &&
+                    passesFilter(item, filter, batchTag)) {
+                page = it;
+                return ESP_OK;
+            }
+            itemIndex += item.span;
+        }
+    }
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t Storage::startNewPage()
+{
+    Page& page = getCurrentPage();
+    if (page.state() != Page::PageState::FULL) {
+        auto err = page.markFull();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return mPageManager.requestNewPage();
+}
+
+esp_err_t Storage::appendItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize, uint8_t batchTag)
+{
+    auto err = getCurrentPage().writeItem(nsIndex, datatype, key, data, dataSize, batchTag);
+    if (err == ESP_ERR_NVS_PAGE_FULL) {
+        err = startNewPage();
+        if (err != ESP_OK) {
+            return err;
+        }
+
+        err = getCurrentPage().writeItem(nsIndex, datatype, key, data, dataSize, batchTag);
+        if (err == ESP_ERR_NVS_PAGE_FULL) {
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+    }
+    return err;
+}
+
+esp_err_t Storage::eraseItemCopies(uint8_t nsIndex, ItemType datatype, const char* key, BatchFilter filter, uint8_t batchTag)
+{
+    Page* findPage = nullptr;
+    Item item;
+    size_t findIndex;
+    esp_err_t err;
+    while ((err = findItem(nsIndex, datatype, key, findPage, item, findIndex, filter, batchTag)) == ESP_OK) {
+        err = findPage->eraseItemAt(findIndex);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return (err == ESP_ERR_NVS_NOT_FOUND) ? ESP_OK : err;
+}
+
+esp_err_t Storage::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    if (isBlobWriteKey(nsIndex, key)) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+
+    // namespace entries are never part of a batch
+    if (isBatchActive() && nsIndex != Page::NS_INDEX) {
+        return writeBatchItem(nsIndex, datatype, key, data, dataSize);
+    }
+
+    if (datatype == ItemType::BLOB && dataSize > Page::BLOB_MAX_SIZE) {
+        return writeMultiPageBlob(nsIndex, key, data, dataSize, Item::NO_BATCH);
+    }
+
+    Page* findPage = nullptr;
+    Item item;
+    size_t findIndex;
+    auto err = findItem(nsIndex, datatype, key, findPage, item, findIndex);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        return err;
+    }
+
+    err = appendItem(nsIndex, datatype, key, data, dataSize, Item::NO_BATCH);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (findPage) {
+        if (findPage->state() == Page::PageState::UNINITIALIZED ||
+                findPage->state() == Page::PageState::INVALID) {
+            ESP_ERROR_CHECK( findItem(nsIndex, datatype, key, findPage, item, findIndex) );
+        }
+        err = findPage->eraseItemAt(findIndex);
+        if (err == ESP_ERR_FLASH_OP_FAIL) {
+            return ESP_ERR_NVS_REMOVE_FAILED;
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    if (datatype == ItemType::BLOB) {
+        // the previous value may have been written in chunks
+        err = eraseMultiPageBlob(nsIndex, key, Item::CHUNK_ANY, BatchFilter::ALL, Item::NO_BATCH);
+        if (err == ESP_ERR_FLASH_OP_FAIL) {
+            return ESP_ERR_NVS_REMOVE_FAILED;
+        }
+        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+            return err;
+        }
+    }
+#ifndef ESP_PLATFORM
+    debugCheck();
+#endif
+    return ESP_OK;
+}
+
+size_t Storage::getMaxBlobSize() const
+{
+    // one page is always kept free for garbage collection
+    size_t chunkCount = mPageCount - 1;
+    if (chunkCount > MAX_CHUNK_COUNT) {
+        chunkCount = MAX_CHUNK_COUNT;
+    }
+    return chunkCount * Page::CHUNK_MAX_SIZE;
+}
+
+esp_err_t Storage::getBlobChunkStart(uint8_t nsIndex, const char* key, uint8_t batchTag, uint8_t& chunkStart)
+{
+    Page* findPage = nullptr;
+    Item item;
+    size_t findIndex;
+    const BatchFilter filter = (batchTag == Item::NO_BATCH) ? BatchFilter::ALL : BatchFilter::UNTAGGED;
+    auto err = findItem(nsIndex, ItemType::BLOB_IDX, key, findPage, item, findIndex, filter, batchTag);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        chunkStart = 0;
+        return ESP_OK;
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    chunkStart = item.blobIndex.chunkStart ^ CHUNK_VERSION_OFFSET;
+    return ESP_OK;
+}
+
+esp_err_t Storage::writeMultiPageBlob(uint8_t nsIndex, const char* key, const void* data, size_t dataSize, uint8_t batchTag)
+{
+    if (strlen(key) > Item::MAX_KEY_LENGTH) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    if (dataSize > getMaxBlobSize()) {
+        return ESP_ERR_NVS_VALUE_TOO_LONG;
+    }
+
+    uint8_t chunkStart;
+    auto err = getBlobChunkStart(nsIndex, key, batchTag, chunkStart);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    uint8_t chunkCount = 0;
+    err = writeBlobChunks(nsIndex, key, static_cast<const uint8_t*>(data), dataSize, chunkStart, chunkCount, batchTag);
+    if (err != ESP_OK) {
+        const BatchFilter filter = (batchTag == Item::NO_BATCH) ? BatchFilter::ALL : BatchFilter::TAGGED;
+        eraseBlobChunks(nsIndex, key, chunkStart, chunkCount, filter, batchTag);
+        return err;
+    }
+    return finishMultiPageBlob(nsIndex, key, dataSize, chunkStart, chunkCount, batchTag);
+}
+
+esp_err_t Storage::writeBlobChunks(uint8_t nsIndex, const char* key, const uint8_t* data, size_t dataSize,
+        uint8_t chunkStart, uint8_t& chunkCount, uint8_t batchTag)
+{
+    // each chunk takes what is left of the current page
+    while (dataSize > 0) {
+        size_t chunkSize = getCurrentPage().getVarDataTailroom();
+        if (chunkSize == 0) {
+            auto err = startNewPage();
+            if (err != ESP_OK) {
+                return err;
+            }
+            continue;
+        }
+        if (chunkCount == MAX_CHUNK_COUNT) {
+            return ESP_ERR_NVS_VALUE_TOO_LONG;
+        }
+        if (chunkSize > dataSize) {
+            chunkSize = dataSize;
+        }
+
+        auto err = getCurrentPage().writeItem(nsIndex, ItemType::BLOB_DATA, key, data, chunkSize, batchTag,
+                                              chunkStart + chunkCount);
+        if (err != ESP_OK) {
+            return err;
+        }
+        ++chunkCount;
+        data += chunkSize;
+        dataSize -= chunkSize;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::finishMultiPageBlob(uint8_t nsIndex, const char* key, size_t dataSize, uint8_t chunkStart, uint8_t chunkCount,
+        uint8_t batchTag)
+{
+    // the blob exists once its index is written
+    Item index(nsIndex, ItemType::BLOB_IDX, 1, key);
+    index.blobIndex.dataSize = dataSize;
+    index.blobIndex.chunkCount = chunkCount;
+    index.blobIndex.chunkStart = chunkStart;
+    auto err = appendItem(nsIndex, ItemType::BLOB_IDX, key, index.data, sizeof(index.data), batchTag);
+    if (err != ESP_OK) {
+        const BatchFilter filter = (batchTag == Item::NO_BATCH) ? BatchFilter::ALL : BatchFilter::TAGGED;
+        eraseBlobChunks(nsIndex, key, chunkStart, chunkCount, filter, batchTag);
+        return err;
+    }
+
+    // in a batch, the commit erases the previous value
+    if (batchTag != Item::NO_BATCH) {
+        return ESP_OK;
+    }
+
+    // the previous value was either written in chunks of the other version, or as a single item
+    err = eraseMultiPageBlob(nsIndex, key, chunkStart ^ CHUNK_VERSION_OFFSET, BatchFilter::ALL, Item::NO_BATCH);
+    if (err == ESP_OK || err == ESP_ERR_NVS_NOT_FOUND) {
+        err = eraseItemCopies(nsIndex, ItemType::BLOB, key, BatchFilter::ALL, Item::NO_BATCH);
+    }
+    if (err == ESP_ERR_FLASH_OP_FAIL) {
+        return ESP_ERR_NVS_REMOVE_FAILED;
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+#ifndef ESP_PLATFORM
+    debugCheck();
+#endif
+    return ESP_OK;
+}
+
+esp_err_t Storage::readMultiPageBlob(const Item& indexItem, size_t offset, void* data, size_t dataSize,
+        BatchFilter filter, uint8_t batchTag)
+{
+    uint8_t* dst = static_cast<uint8_t*>(data);
+    esp_err_t err = ESP_OK;
+    for (uint8_t i = 0; i < indexItem.blobIndex.chunkCount && dataSize > 0; ++i) {
+        Page* findPage = nullptr;
+        Item item;
+        size_t findIndex;
+        err = findItem(indexItem.nsIndex, ItemType::BLOB_DATA, indexItem.key, findPage, item, findIndex, filter, batchTag,
+                       indexItem.blobIndex.chunkStart + i);
+        if (err != ESP_OK) {
+            break;
+        }
+
+        size_t chunkSize = item.varLength.dataSize;
+        if (offset >= chunkSize) {
+            offset -= chunkSize;
+            continue;
+        }
+        size_t size = chunkSize - offset;
+        if (size > dataSize) {
+            size = dataSize;
+        }
+        err = findPage->readItemDataAt(findIndex, item, offset, dst, size);
+        if (err != ESP_OK) {
+            break;
+        }
+        offset = 0;
+        dst += size;
+        dataSize -= size;
+    }
+
+    if (err == ESP_OK && dataSize > 0) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        // a chunk is missing or was corrupted, the blob can't be read any more
+        eraseMultiPageBlob(indexItem.nsIndex, indexItem.key, indexItem.blobIndex.chunkStart, filter, batchTag);
+    }
+    return err;
+}
+
+esp_err_t Storage::eraseMultiPageBlob(uint8_t nsIndex, const char* key, uint8_t chunkStart, BatchFilter filter, uint8_t batchTag)
+{
+    Page* findPage = nullptr;
+    Item item;
+    size_t findIndex;
+    auto err = findItem(nsIndex, ItemType::BLOB_IDX, key, findPage, item, findIndex, filter, batchTag, chunkStart);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // the index goes first: if power goes out before all chunks are erased, init erases the rest
+    err = findPage->eraseItemAt(findIndex);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return eraseBlobChunks(nsIndex, key, item.blobIndex.chunkStart, item.blobIndex.chunkCount, filter, batchTag);
+}
+
+esp_err_t Storage::eraseBlobChunks(uint8_t nsIndex, const char* key, uint8_t chunkStart, uint8_t chunkCount,
+        BatchFilter filter, uint8_t batchTag)
+{
+    for (uint8_t i = 0; i < chunkCount; ++i) {
+        Page* findPage = nullptr;
+        Item item;
+        size_t findIndex;
+        auto err = findItem(nsIndex, ItemType::BLOB_DATA, key, findPage, item, findIndex, filter, batchTag, chunkStart + i);
+        if (err == ESP_ERR_NVS_NOT_FOUND) {
+            continue;
+        }
+        if (err == ESP_OK) {
+            err = findPage->eraseItemAt(findIndex);
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::eraseOrphanBlobChunks()
+{
+    // chunks which no index refers to are left when power goes out while a blob is written or erased
+    TBlobIndexEntries blobIndices;
+    bool haveChunks = false;
+    bool complete = true;
+    for (auto it = mPageManager.begin(); it != mPageManager.end() && complete; ++it) {
+        size_t itemIndex = 0;
+        Item item;
+        while (it->findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item) == ESP_OK) {
+            itemIndex += item.span;
+            if (item.datatype == ItemType::BLOB_DATA) {
+                haveChunks = true;
+            }
+            if (item.datatype != ItemType::BLOB_IDX) {
+                continue;
+            }
+
+            BlobIndexEntry* entry = new (std::nothrow) BlobIndexEntry;
+            if (!entry) {
+                complete = false;
+                break;
+            }
+            strncpy(entry->mKey, item.key, sizeof(entry->mKey) - 1);
+            entry->mKey[sizeof(entry->mKey) - 1] = 0;
+            entry->mNsIndex = item.nsIndex;
+            entry->mChunkStart = item.blobIndex.chunkStart;
+            entry->mChunkCount = item.blobIndex.chunkCount;
+            blobIndices.push_back(entry);
+        }
+    }
+
+    // without all indices, chunks of valid blobs could be taken for orphans; those can wait for the next init
+    esp_err_t err = ESP_OK;
+    for (auto it = mPageManager.begin(); it != mPageManager.end() && haveChunks && complete && err == ESP_OK; ++it) {
+        size_t itemIndex = 0;
+        Item item;
+        while (it->findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item) == ESP_OK) {
+            size_t index = itemIndex;
+            itemIndex += item.span;
+            if (item.datatype != ItemType::BLOB_DATA) {
+                continue;
+            }
+
+            const uint8_t chunkIndex = item.varLength.chunkIndex;
+            bool orphan = std::none_of(blobIndices.begin(), blobIndices.end(), [&] (const BlobIndexEntry& e) -> bool {
+                return e.mNsIndex == item.nsIndex && strncmp(item.key, e.mKey, sizeof(e.mKey) - 1) == 0 &&
+                       chunkIndex >= e.mChunkStart && chunkIndex < e.mChunkStart + e.mChunkCount;
+            });
+            if (orphan) {
+                err = it->eraseItemAt(index);
+                if (err != ESP_OK) {
+                    break;
+                }
+            }
+        }
+    }
+
+    for (auto it = std::begin(blobIndices); it != std::end(blobIndices); ) {
+        auto tmp = it;
+        ++it;
+        blobIndices.erase(tmp);
+        delete static_cast<BlobIndexEntry*>(tmp);
+    }
+    return err;
+}
+
+esp_err_t Storage::writeBatchItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize)
+{
+    if (strlen(key) > Item::MAX_KEY_LENGTH) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+
+    // the entries must exist before the tagged copies do, or the commit could miss the old copies
+    auto err = addBatchWriteEntries(nsIndex, datatype, key);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // a value written earlier in the same batch is simply dropped, it never was visible
+    dropBufferedItems(nsIndex, datatype, key);
+    if (datatype == ItemType::BLOB) {
+        for (auto type : BLOB_ITEM_TYPES) {
+            err = eraseItemCopies(nsIndex, type, key, BatchFilter::TAGGED, mBatchTag);
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+    } else {
+        err = eraseItemCopies(nsIndex, datatype, key, BatchFilter::TAGGED, mBatchTag);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    if (datatype == ItemType::BLOB && dataSize > Page::BLOB_MAX_SIZE) {
+        err = writeMultiPageBlob(nsIndex, key, data, dataSize, mBatchTag);
+    } else if (isVariableLengthType(datatype)) {
+        err = appendItem(nsIndex, datatype, key, data, dataSize, mBatchTag);
+    } else {
+        Item item(nsIndex, datatype, 1, key);
+        item.batchTag = mBatchTag;
+        memcpy(item.data, data, dataSize);
+        err = bufferBatchItem(item);
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+#ifndef ESP_PLATFORM
+    debugCheck();
+#endif
+    return ESP_OK;
+}
+
+esp_err_t Storage::eraseBatchItem(uint8_t nsIndex, ItemType datatype, const char* key)
+{
+    // all items of a blob have its key, whichever format it was written in
+    if (datatype == ItemType::BLOB) {
+        datatype = ItemType::ANY;
+    }
+
+    Page* findPage = nullptr;
+    Item item;
+    size_t findIndex;
+    auto err = findItem(nsIndex, datatype, key, findPage, item, findIndex, BatchFilter::UNTAGGED, mBatchTag);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        return err;
+    }
+    bool committed = (err == ESP_OK);
+
+    // values written earlier in the same batch are simply dropped
+    bool written = dropBufferedItems(nsIndex, datatype, key);
+    written |= (findItem(nsIndex, datatype, key, findPage, item, findIndex, BatchFilter::TAGGED, mBatchTag) == ESP_OK);
+    err = eraseItemCopies(nsIndex, datatype, key, BatchFilter::TAGGED, mBatchTag);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (!committed) {
+        return written ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (findBatchEntry(nsIndex, datatype, key, true)) {
+        return ESP_OK;
+    }
+
+    // the committed copy is erased by the commit, and a tagged tombstone lets init do the same
+    if (!addBatchEntry(nsIndex, datatype, key, true)) {
+        return ESP_ERR_NO_MEM;
+    }
+    uint16_t target = nsIndex | (static_cast<uint16_t>(datatype) << 8);
+    Item tombstone(Page::NS_BATCH, ItemType::U16, 1, key);
+    tombstone.batchTag = mBatchTag;
+    memcpy(tombstone.data, &target, sizeof(target));
+    return bufferBatchItem(tombstone);
+}
+
+esp_err_t Storage::bufferBatchItem(const Item& item)
+{
+    if (mBatchItemCount == CONFIG_NVS_BATCH_BUFFER_SIZE) {
+        auto err = flushBatchItems();
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    mBatchItems[mBatchItemCount++] = item;
+    return ESP_OK;
+}
+
+bool Storage::dropBufferedItems(uint8_t nsIndex, ItemType datatype, const char* key)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < mBatchItemCount; ++i) {
+        const Item& item = mBatchItems[i];
+        if (item.nsIndex == nsIndex && (datatype == ItemType::ANY || item.datatype == datatype) &&
+                strncmp(key, item.key, Item::MAX_KEY_LENGTH) == 0) {
+            continue;
+        }
+        mBatchItems[count++] = item;
+    }
+    bool dropped = (count != mBatchItemCount);
+    mBatchItemCount = count;
+    return dropped;
+}
+
+esp_err_t Storage::flushBatchItems()
+{
+    size_t done = 0;
+    bool newPage = false;
+    esp_err_t err = ESP_OK;
+    while (done < mBatchItemCount) {
+        size_t written;
+        err = getCurrentPage().writeItems(&mBatchItems[done], mBatchItemCount - done, written);
+        if (err == ESP_ERR_NVS_PAGE_FULL && !newPage) {
+            err = startNewPage();
+            newPage = true;
+        } else if (err == ESP_ERR_NVS_PAGE_FULL) {
+            err = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        } else {
+            newPage = false;
+            done += written;
+        }
+        if (err != ESP_OK) {
+            break;
+        }
+    }
+
+    // keep what could not be written for the next attempt
+    std::copy(mBatchItems.get() + done, mBatchItems.get() + mBatchItemCount, mBatchItems.get());
+    mBatchItemCount -= done;
+    return err;
+}
+
+bool Storage::isBatchNamespaceTaken()
+{
+    return std::any_of(mNamespaces.begin(), mNamespaces.end(), [] (const NamespaceEntry& e) -> bool {
+        return e.mIndex == Page::NS_BATCH;
+    });
+}
+
+Storage::BatchEntry* Storage::findBatchEntry(uint8_t nsIndex, ItemType datatype, const char* key, bool erase)
+{
+    auto it = std::find_if(mBatchEntries.begin(), mBatchEntries.end(), [=] (const BatchEntry& e) -> bool {
+        return e.mNsIndex == nsIndex && e.mDatatype == datatype && e.mErase == erase &&
+               strncmp(key, e.mKey, sizeof(e.mKey) - 1) == 0;
+    });
+    return (it == std::end(mBatchEntries)) ? nullptr : static_cast<BatchEntry*>(it);
+}
+
+Storage::BatchEntry* Storage::addBatchEntry(uint8_t nsIndex, ItemType datatype, const char* key, bool erase)
+{
+    BatchEntry* entry = findBatchEntry(nsIndex, datatype, key, erase);
+    if (entry) {
+        return entry;
+    }
+
+    entry = new (std::nothrow) BatchEntry;
+    if (!entry) {
+        return nullptr;
+    }
+    strncpy(entry->mKey, key, sizeof(entry->mKey) - 1);
+    entry->mKey[sizeof(entry->mKey) - 1] = 0;
+    entry->mNsIndex = nsIndex;
+    entry->mDatatype = datatype;
+    entry->mErase = erase;
+    mBatchEntries.push_back(entry);
+    return entry;
+}
+
+esp_err_t Storage::addBatchWriteEntries(uint8_t nsIndex, ItemType datatype, const char* key)
+{
+    // the previous value of a blob may be stored in either format, and so may the new one
+    if (isBlobType(datatype)) {
+        for (auto type : BLOB_ITEM_TYPES) {
+            if (!addBatchEntry(nsIndex, type, key, false)) {
+                return ESP_ERR_NO_MEM;
+            }
+        }
+        return ESP_OK;
+    }
+    return addBatchEntry(nsIndex, datatype, key, false) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void Storage::clearBatchEntries()
+{
+    for (auto it = std::begin(mBatchEntries); it != std::end(mBatchEntries); ) {
+        auto tmp = it;
+        ++it;
+        mBatchEntries.erase(tmp);
+        delete static_cast<BatchEntry*>(tmp);
+    }
+}
+
+esp_err_t Storage::allocateBatchTag(uint8_t& batchTag)
+{
+    for (int pass = 0; pass < 2; ++pass) {
+        // a tag can't be reused while items carrying it are stored, a rollback would erase them;
+        // a commit clears the tag, so this only happens if power went out while it was being cleared
+        if (!mBatchTagUsageLoaded) {
+            std::fill_n(mBatchTagUsage.data(), mBatchTagUsage.byteSize() / 4, 0);
+            for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
+                size_t itemIndex = 0;
+                Item item;
+                while (it->findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item) == ESP_OK) {
+                    if (item.batchTag != Item::NO_BATCH) {
+                        mBatchTagUsage.set(item.batchTag, true);
+                    }
+                    itemIndex += item.span;
+                }
+            }
+            mBatchTagUsageLoaded = true;
+        }
+
+        for (size_t tag = Item::COMMITTED_BATCH + 1; tag < Item::NO_BATCH; ++tag) {
+            if (!mBatchTagUsage.get(tag)) {
+                mBatchTagUsage.set(tag, true);
+                batchTag = static_cast<uint8_t>(tag);
+                return ESP_OK;
+            }
+        }
+
+        // items of old batches may have been overwritten since the tags were loaded
+        mBatchTagUsageLoaded = false;
+    }
+    return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+}
+
+esp_err_t Storage::beginBatch()
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    if (isBatchActive()) {
+        return ESP_ERR_NVS_BATCH_ACTIVE;
+    }
+    if (isBatchNamespaceTaken()) {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+
+    mBatchItems.reset(new (std::nothrow) Item[CONFIG_NVS_BATCH_BUFFER_SIZE]);
+    if (!mBatchItems) {
+        return ESP_ERR_NO_MEM;
+    }
+    mBatchItemCount = 0;
+
+    uint8_t batchTag;
+    auto err = allocateBatchTag(batchTag);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = appendItem(Page::NS_BATCH, ItemType::U8, BATCH_BEGIN_KEY, &batchTag, sizeof(batchTag), Item::NO_BATCH);
+    if (err != ESP_OK) {
+        return err;
+    }
+    mBatchTag = batchTag;
+    return ESP_OK;
+}
+
+esp_err_t Storage::commitBatch()
 {
-    auto err = mPageManager.load(baseSector, sectorCount);
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    if (!isBatchActive()) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+
+    auto err = flushBatchItems();
     if (err != ESP_OK) {
-        mState = StorageState::INVALID;
         return err;
     }
 
-    // load namespaces list
-    clearNamespaces();
-    std::fill_n(mNamespaceUsage.data(), mNamespaceUsage.byteSize() / 4, 0);
-    for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
-        Page& p = *it;
-        size_t itemIndex = 0;
-        Item item;
-        while (p.findItem(Page::NS_INDEX, ItemType::U8, nullptr, itemIndex, item) == ESP_OK) {
-            NamespaceEntry* entry = new NamespaceEntry;
-            item.getKey(entry->mName, sizeof(entry->mName) - 1);
-            item.getValue(entry->mIndex);
-            mNamespaces.push_back(entry);
-            mNamespaceUsage.set(entry->mIndex, true);
-            itemIndex += item.span;
-        }
+    // the batch is committed as soon as this record is on flash
+    err = appendItem(Page::NS_BATCH, ItemType::U8, BATCH_COMMIT_KEY, &mBatchTag, sizeof(mBatchTag), Item::NO_BATCH);
+    if (err != ESP_OK) {
+        return err;
     }
-    mNamespaceUsage.set(0, true);
-    mNamespaceUsage.set(255, true);
-    mState = StorageState::ACTIVE;
-#ifndef ESP_PLATFORM
-    debugCheck();
-#endif
-    return ESP_OK;
+
+    err = finishBatch(true);
+    if (err == ESP_ERR_FLASH_OP_FAIL) {
+        return ESP_ERR_NVS_REMOVE_FAILED;
+    }
+    return err;
 }
 
-bool Storage::isValid() const
+esp_err_t Storage::abortBatch()
 {
-    return mState == StorageState::ACTIVE;
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    if (!isBatchActive()) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+    return finishBatch(false);
 }
 
-esp_err_t Storage::findItem(uint8_t nsIndex, ItemType datatype, const char* key, Page* &page, Item& item)
+esp_err_t Storage::finishBatch(bool commit)
 {
-    for (auto it = std::begin(mPageManager); it != std::end(mPageManager); ++it) {
-        size_t itemIndex = 0;
-        auto err = it->findItem(nsIndex, datatype, key, itemIndex, item);
-        if (err == ESP_OK) {
-            page = it;
-            return ESP_OK;
+    esp_err_t err = ESP_OK;
+
+    // a commit erases the copies which the batch replaced or erased, an abort erases what the batch wrote;
+    // tombstones go only after all their targets, and the records go last, so that init can always redo this
+    const BatchFilter filter = commit ? BatchFilter::UNTAGGED : BatchFilter::TAGGED;
+    for (int pass = 0; pass < 2 && err == ESP_OK; ++pass) {
+        for (auto it = std::begin(mPageManager); it != std::end(mPageManager); ++it) {
+            it->deferEntryTableWrites();
+        }
+
+        for (auto it = std::begin(mBatchEntries); it != std::end(mBatchEntries) && err == ESP_OK; ++it) {
+            if (pass == 0) {
+                err = eraseItemCopies(it->mNsIndex, it->mDatatype, it->mKey, filter, mBatchTag);
+            } else if (it->mErase) {
+                err = eraseItemCopies(Page::NS_BATCH, ItemType::U16, it->mKey, BatchFilter::TAGGED, mBatchTag);
+            }
+        }
+
+        for (auto it = std::begin(mPageManager); it != std::end(mPageManager); ++it) {
+            auto rc = it->flushEntryTable();
+            if (err == ESP_OK) {
+                err = rc;
+            }
         }
     }
-    return ESP_ERR_NVS_NOT_FOUND;
-}
 
-esp_err_t Storage::writeItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize)
-{
-    if (mState != StorageState::ACTIVE) {
-        return ESP_ERR_NVS_NOT_INITIALIZED;
+    // committed items must not carry the tag any more, or it could never be used again
+    if (err == ESP_OK && commit) {
+        Item oneItem;
+        Item* buffer = mBatchItems ? mBatchItems.get() : &oneItem;
+        size_t bufferSize = mBatchItems ? CONFIG_NVS_BATCH_BUFFER_SIZE : 1;
+        for (auto it = std::begin(mPageManager); it != std::end(mPageManager) && err == ESP_OK; ++it) {
+            err = it->clearBatchTag(mBatchTag, buffer, bufferSize);
+        }
+    }
+
+    if (err == ESP_OK) {
+        err = eraseItemCopies(Page::NS_BATCH, ItemType::U8, BATCH_BEGIN_KEY, BatchFilter::ALL, Item::NO_BATCH);
+    }
+    if (err == ESP_OK) {
+        err = eraseItemCopies(Page::NS_BATCH, ItemType::U8, BATCH_COMMIT_KEY, BatchFilter::ALL, Item::NO_BATCH);
+    }
+
+    if (err == ESP_OK) {
+        mBatchTagUsage.set(mBatchTag, false);
     }
+    clearBatchEntries();
+    mBatchItems.reset();
+    mBatchItemCount = 0;
+    mBatchTag = Item::NO_BATCH;
+#ifndef ESP_PLATFORM
+    if (err == ESP_OK) {
+        debugCheck();
+    }
+#endif
+    return err;
+}
 
+esp_err_t Storage::recoverBatch()
+{
     Page* findPage = nullptr;
     Item item;
-    auto err = findItem(nsIndex, datatype, key, findPage, item);
-    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
-        return err;
+    size_t findIndex;
+    bool commit = true;
+    auto err = findItem(Page::NS_BATCH, ItemType::U8, BATCH_COMMIT_KEY, findPage, item, findIndex);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        commit = false;
+        err = findItem(Page::NS_BATCH, ItemType::U8, BATCH_BEGIN_KEY, findPage, item, findIndex);
     }
 
-    Page& page = getCurrentPage();
-    err = page.writeItem(nsIndex, datatype, key, data, dataSize);
-    if (err == ESP_ERR_NVS_PAGE_FULL) {
-        if (page.state() != Page::PageState::FULL) {
-            err = page.markFull();
-            if (err != ESP_OK) {
-                return err;
-            }
-        }
-        err = mPageManager.requestNewPage();
-        if (err != ESP_OK) {
-            return err;
-        }
-
-        err = getCurrentPage().writeItem(nsIndex, datatype, key, data, dataSize);
-        if (err == ESP_ERR_NVS_PAGE_FULL) {
-            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        // if power went out between writing a new copy of an item, which a batch wrote before,
+        // and erasing the old copy, the new copy is the last item and the old one is tagged
+        Page& lastPage = getCurrentPage();
+        size_t itemIndex = 0;
+        Item lastItem;
+        bool found = false;
+        while (lastPage.findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item) == ESP_OK) {
+            itemIndex += item.span;
+            lastItem = item;
+            found = true;
         }
-        if (err != ESP_OK) {
-            return err;
+        if (!found || lastItem.batchTag != Item::NO_BATCH) {
+            return ESP_OK;
         }
-    } else if (err != ESP_OK) {
+        return eraseItemCopies(lastItem.nsIndex, lastItem.datatype, lastItem.key, BatchFilter::UNTAGGED, Item::NO_BATCH);
+    }
+    if (err != ESP_OK) {
         return err;
     }
 
-    if (findPage) {
-        if (findPage->state() == Page::PageState::UNINITIALIZED ||
-                findPage->state() == Page::PageState::INVALID) {
-            ESP_ERROR_CHECK( findItem(nsIndex, datatype, key, findPage, item) );
-        }
-        err = findPage->eraseItem(nsIndex, datatype, key);
-        if (err == ESP_ERR_FLASH_OP_FAIL) {
-            return ESP_ERR_NVS_REMOVE_FAILED;
-        }
-        if (err != ESP_OK) {
-            return err;
+    // power went out in the middle of a batch, the tagged items tell what it wrote and erased
+    item.getValue(mBatchTag);
+    for (auto it = mPageManager.begin(); it != mPageManager.end(); ++it) {
+        size_t itemIndex = 0;
+        while (it->findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item) == ESP_OK) {
+            itemIndex += item.span;
+            if (item.batchTag != mBatchTag) {
+                continue;
+            }
+
+            if (item.nsIndex == Page::NS_BATCH && item.datatype == ItemType::U16) {
+                uint16_t target;
+                item.getValue(target);
+                if (!addBatchEntry(target & 0xff, static_cast<ItemType>(target >> 8), item.key, true)) {
+                    return ESP_ERR_NO_MEM;
+                }
+            } else {
+                auto err = addBatchWriteEntries(item.nsIndex, item.datatype, item.key);
+                if (err != ESP_OK) {
+                    return err;
+                }
+            }
         }
     }
-#ifndef ESP_PLATFORM
-    debugCheck();
-#endif
-    return ESP_OK;
+    return finishBatch(commit);
 }
 
 esp_err_t Storage::createOrOpenNamespace(const char* nsName, bool canCreate, uint8_t& nsIndex)
@@ -195,12 +1041,198 @@ esp_err_t Storage::readItem(uint8_t nsIndex, ItemType datatype, const char* key,
 
     Item item;
     Page* findPage = nullptr;
-    auto err = findItem(nsIndex, datatype, key, findPage, item);
+    size_t findIndex;
+    auto err = findItem(nsIndex, datatype, key, findPage, item, findIndex, visibleItems(), mBatchTag);
+    if (err == ESP_ERR_NVS_NOT_FOUND && datatype == ItemType::BLOB) {
+        err = findItem(nsIndex, ItemType::BLOB_IDX, key, findPage, item, findIndex, visibleItems(), mBatchTag);
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (dataSize < item.blobIndex.dataSize) {
+            return ESP_ERR_NVS_INVALID_LENGTH;
+        }
+        return readMultiPageBlob(item, 0, data, item.blobIndex.dataSize, visibleItems(), mBatchTag);
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    return findPage->readItemAt(findIndex, item, data, dataSize);
+}
+
+esp_err_t Storage::readBlobPart(uint8_t nsIndex, const char* key, size_t offset, void* data, size_t dataSize, size_t& readSize)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    Item item;
+    Page* findPage = nullptr;
+    size_t findIndex;
+    size_t blobSize;
+    auto err = findItem(nsIndex, ItemType::BLOB, key, findPage, item, findIndex, visibleItems(), mBatchTag);
+    if (err == ESP_OK) {
+        blobSize = item.varLength.dataSize;
+    } else if (err == ESP_ERR_NVS_NOT_FOUND) {
+        err = findItem(nsIndex, ItemType::BLOB_IDX, key, findPage, item, findIndex, visibleItems(), mBatchTag);
+        if (err != ESP_OK) {
+            return err;
+        }
+        blobSize = item.blobIndex.dataSize;
+    } else {
+        return err;
+    }
+
+    if (offset > blobSize) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    if (dataSize > blobSize - offset) {
+        dataSize = blobSize - offset;
+    }
+
+    if (item.datatype == ItemType::BLOB) {
+        err = findPage->readItemDataAt(findIndex, item, offset, data, dataSize);
+    } else {
+        err = readMultiPageBlob(item, offset, data, dataSize, visibleItems(), mBatchTag);
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    readSize = dataSize;
+    return ESP_OK;
+}
+
+bool Storage::isBlobWriteKey(uint8_t nsIndex, const char* key) const
+{
+    return isBlobWriteActive() && mBlobWriter.mNsIndex == nsIndex &&
+           (key == nullptr || strncmp(key, mBlobWriter.mKey, sizeof(mBlobWriter.mKey) - 1) == 0);
+}
+
+void Storage::releaseBlobWriter()
+{
+    mBlobWriter.mBuffer.reset();
+    mBlobWriter.mBufferedSize = 0;
+    mBlobWriter.mDataSize = 0;
+    mBlobWriter.mChunkCount = 0;
+}
+
+esp_err_t Storage::beginBlobWrite(uint8_t nsIndex, const char* key)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    if (isBatchActive()) {
+        return ESP_ERR_NVS_BATCH_ACTIVE;
+    }
+    if (isBlobWriteActive()) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+    if (strlen(key) > Item::MAX_KEY_LENGTH) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+
+    uint8_t chunkStart;
+    auto err = getBlobChunkStart(nsIndex, key, Item::NO_BATCH, chunkStart);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    mBlobWriter.mBuffer.reset(new (std::nothrow) uint8_t[BLOB_WRITE_BUFFER_SIZE]);
+    if (!mBlobWriter.mBuffer) {
+        return ESP_ERR_NO_MEM;
+    }
+    strncpy(mBlobWriter.mKey, key, sizeof(mBlobWriter.mKey) - 1);
+    mBlobWriter.mKey[sizeof(mBlobWriter.mKey) - 1] = 0;
+    mBlobWriter.mNsIndex = nsIndex;
+    mBlobWriter.mChunkStart = chunkStart;
+    mBlobWriter.mChunkCount = 0;
+    mBlobWriter.mDataSize = 0;
+    mBlobWriter.mBufferedSize = 0;
+    return ESP_OK;
+}
+
+esp_err_t Storage::writeBlobPart(const void* data, size_t dataSize)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    if (!isBlobWriteActive()) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+    if (dataSize > getMaxBlobSize() - mBlobWriter.mDataSize) {
+        abortBlobWrite();
+        return ESP_ERR_NVS_VALUE_TOO_LONG;
+    }
+
+    BlobWriter& w = mBlobWriter;
+    const uint8_t* src = static_cast<const uint8_t*>(data);
+    while (dataSize > 0) {
+        size_t size;
+        esp_err_t err = ESP_OK;
+        if (w.mBufferedSize == 0 && dataSize >= BLOB_WRITE_BUFFER_SIZE) {
+            // large parts are written as they come, small ones are collected into larger chunks
+            size = dataSize / Page::ENTRY_SIZE * Page::ENTRY_SIZE;
+            err = writeBlobChunks(w.mNsIndex, w.mKey, src, size, w.mChunkStart, w.mChunkCount, Item::NO_BATCH);
+        } else {
+            size = std::min(dataSize, BLOB_WRITE_BUFFER_SIZE - w.mBufferedSize);
+            memcpy(w.mBuffer.get() + w.mBufferedSize, src, size);
+            w.mBufferedSize += size;
+            if (w.mBufferedSize == BLOB_WRITE_BUFFER_SIZE) {
+                err = writeBlobChunks(w.mNsIndex, w.mKey, w.mBuffer.get(), w.mBufferedSize, w.mChunkStart, w.mChunkCount,
+                                      Item::NO_BATCH);
+                w.mBufferedSize = 0;
+            }
+        }
+        if (err != ESP_OK) {
+            abortBlobWrite();
+            return err;
+        }
+        w.mDataSize += size;
+        src += size;
+        dataSize -= size;
+    }
+    return ESP_OK;
+}
+
+esp_err_t Storage::finishBlobWrite()
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    if (!isBlobWriteActive()) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+    if (isBatchActive()) {
+        return ESP_ERR_NVS_BATCH_ACTIVE;
+    }
+
+    BlobWriter& w = mBlobWriter;
+    auto err = writeBlobChunks(w.mNsIndex, w.mKey, w.mBuffer.get(), w.mBufferedSize, w.mChunkStart, w.mChunkCount,
+                               Item::NO_BATCH);
     if (err != ESP_OK) {
+        abortBlobWrite();
         return err;
     }
 
-    return findPage->readItem(nsIndex, datatype, key, data, dataSize);
+    char key[sizeof(w.mKey)];
+    memcpy(key, w.mKey, sizeof(key));
+    const uint8_t nsIndex = w.mNsIndex;
+    const uint8_t chunkStart = w.mChunkStart;
+    const uint8_t chunkCount = w.mChunkCount;
+    const size_t dataSize = w.mDataSize;
+    releaseBlobWriter();
+    return finishMultiPageBlob(nsIndex, key, dataSize, chunkStart, chunkCount, Item::NO_BATCH);
+}
+
+esp_err_t Storage::abortBlobWrite()
+{
+    if (!isBlobWriteActive()) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+    auto err = eraseBlobChunks(mBlobWriter.mNsIndex, mBlobWriter.mKey, mBlobWriter.mChunkStart, mBlobWriter.mChunkCount,
+                               BatchFilter::ALL, Item::NO_BATCH);
+    releaseBlobWriter();
+    return err;
 }
 
 esp_err_t Storage::eraseItem(uint8_t nsIndex, ItemType datatype, const char* key)
@@ -209,14 +1241,33 @@ esp_err_t Storage::eraseItem(uint8_t nsIndex, ItemType datatype, const char* key
         return ESP_ERR_NVS_NOT_INITIALIZED;
     }
 
+    if (isBlobWriteKey(nsIndex, key)) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
+
+    if (isBatchActive()) {
+        return eraseBatchItem(nsIndex, datatype, key);
+    }
+
     Item item;
     Page* findPage = nullptr;
-    auto err = findItem(nsIndex, datatype, key, findPage, item);
+    size_t findIndex;
+    auto err = findItem(nsIndex, datatype, key, findPage, item, findIndex);
+    if (err == ESP_ERR_NVS_NOT_FOUND && datatype == ItemType::BLOB) {
+        return eraseMultiPageBlob(nsIndex, key, Item::CHUNK_ANY, BatchFilter::ALL, Item::NO_BATCH);
+    }
     if (err != ESP_OK) {
         return err;
     }
 
-    return findPage->eraseItem(nsIndex, datatype, key);
+    if (item.datatype == ItemType::BLOB_IDX || item.datatype == ItemType::BLOB_DATA) {
+        err = eraseMultiPageBlob(nsIndex, key, Item::CHUNK_ANY, BatchFilter::ALL, Item::NO_BATCH);
+        // a chunk without an index is erased on its own
+        if (err != ESP_ERR_NVS_NOT_FOUND) {
+            return err;
+        }
+    }
+    return findPage->eraseItemAt(findIndex);
 }
 
 esp_err_t Storage::eraseNamespace(uint8_t nsIndex)
@@ -224,6 +1275,12 @@ esp_err_t Storage::eraseNamespace(uint8_t nsIndex)
     if (mState != StorageState::ACTIVE) {
         return ESP_ERR_NVS_NOT_INITIALIZED;
     }
+    if (isBatchActive()) {
+        return ESP_ERR_NVS_BATCH_ACTIVE;
+    }
+    if (isBlobWriteKey(nsIndex, nullptr)) {
+        return ESP_ERR_NVS_INVALID_STATE;
+    }
 
     for (auto it = std::begin(mPageManager); it != std::end(mPageManager); ++it) {
         while (true) {
@@ -248,7 +1305,16 @@ esp_err_t Storage::getItemDataSize(uint8_t nsIndex, ItemType datatype, const cha
 
     Item item;
     Page* findPage = nullptr;
-    auto err = findItem(nsIndex, datatype, key, findPage, item);
+    size_t findIndex;
+    auto err = findItem(nsIndex, datatype, key, findPage, item, findIndex, visibleItems(), mBatchTag);
+    if (err == ESP_ERR_NVS_NOT_FOUND && datatype == ItemType::BLOB) {
+        err = findItem(nsIndex, ItemType::BLOB_IDX, key, findPage, item, findIndex, visibleItems(), mBatchTag);
+        if (err != ESP_OK) {
+            return err;
+        }
+        dataSize = item.blobIndex.dataSize;
+        return ESP_OK;
+    }
     if (err != ESP_OK) {
         return err;
     }
@@ -257,6 +1323,92 @@ esp_err_t Storage::getItemDataSize(uint8_t nsIndex, ItemType datatype, const cha
     return ESP_OK;
 }
 
+esp_err_t Storage::findEntry(const char* nsName, ItemType datatype, EntryIterator& it)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    it = EntryIterator();
+    it.mDatatype = datatype;
+    if (nsName != nullptr) {
+        auto ns = std::find_if(mNamespaces.begin(), mNamespaces.end(), [=] (const NamespaceEntry& e) -> bool {
+            return strncmp(nsName, e.mName, sizeof(e.mName) - 1) == 0;
+        });
+        if (ns == std::end(mNamespaces)) {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+        it.mNsIndex = ns->mIndex;
+    }
+    return nextEntry(it);
+}
+
+esp_err_t Storage::nextEntry(EntryIterator& it)
+{
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    for (auto p = mPageManager.begin(); p != mPageManager.end(); ++p) {
+        uint32_t seqNumber;
+        if (p->getSeqNumber(seqNumber) != ESP_OK || seqNumber < it.mPageSeqNumber) {
+            continue;
+        }
+
+        size_t itemIndex = (seqNumber == it.mPageSeqNumber) ? it.mItemIndex : 0;
+        Item item;
+        esp_err_t err;
+        while ((err = p->findItem(it.mNsIndex, ItemType::ANY, nullptr, itemIndex, item)) == ESP_OK) {
+            itemIndex += item.span;
+            // namespace entries, batch records, and chunks of blobs are not values
+            if (item.datatype == ItemType::BLOB_DATA || !passesFilter(item, visibleItems(), mBatchTag) ||
+                    getNamespaceName(item.nsIndex) == nullptr) {
+                continue;
+            }
+            if (item.datatype == ItemType::BLOB_IDX) {
+                item.datatype = ItemType::BLOB;
+            }
+            if (it.mDatatype != ItemType::ANY && item.datatype != it.mDatatype) {
+                continue;
+            }
+            it.mPageSeqNumber = seqNumber;
+            it.mItemIndex = itemIndex;
+            it.mItem = item;
+            return ESP_OK;
+        }
+        if (err != ESP_ERR_NVS_NOT_FOUND) {
+            return err;
+        }
+    }
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+const char* Storage::getNamespaceName(uint8_t nsIndex)
+{
+    auto it = std::find_if(mNamespaces.begin(), mNamespaces.end(), [=] (const NamespaceEntry& e) -> bool {
+        return e.mIndex == nsIndex;
+    });
+    if (it == std::end(mNamespaces)) {
+        return nullptr;
+    }
+    return it->mName;
+}
+
+esp_err_t Storage::fillStats(nvs_stats_t& nvsStats)
+{
+    nvsStats.used_entries = 0;
+    nvsStats.free_entries = 0;
+    nvsStats.total_entries = 0;
+    nvsStats.namespace_count = 0;
+    if (mState != StorageState::ACTIVE) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+
+    mPageManager.fillStats(nvsStats);
+    nvsStats.namespace_count = mNamespaces.size();
+    return ESP_OK;
+}
+
 void Storage::debugDump()
 {
     for (auto p = mPageManager.begin(); p != mPageManager.end(); ++p) {
@@ -274,8 +1426,17 @@ void Storage::debugCheck()
         size_t usedCount = 0;
         Item item;
         while (p->findItem(Page::NS_ANY, ItemType::ANY, nullptr, itemIndex, item) == ESP_OK) {
+            if (isBatchActive() && item.batchTag == mBatchTag) {
+                // items of the open batch coexist with the copies they are going to replace
+                itemIndex += item.span;
+                usedCount += item.span;
+                continue;
+            }
             std::stringstream keyrepr;
             keyrepr << static_cast<unsigned>(item.nsIndex) << "_" << static_cast<unsigned>(item.datatype) << "_" << item.key;
+            if (item.datatype == ItemType::BLOB_DATA) {
+                keyrepr << "_" << static_cast<unsigned>(item.varLength.chunkIndex);
+            }
             std::string keystr = keyrepr.str();
             if (keys.find(keystr) != std::end(keys)) {
                 printf("Duplicate key: %s\n", keystr.c_str());
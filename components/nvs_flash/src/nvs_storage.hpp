@@ -22,6 +22,10 @@
 #include "nvs_page.hpp"
 #include "nvs_pagemanager.hpp"
 
+#ifndef CONFIG_NVS_BATCH_BUFFER_SIZE
+#define CONFIG_NVS_BATCH_BUFFER_SIZE 16
+#endif
+
 //extern void dumpBytes(const uint8_t* data, size_t count);
 
 namespace nvs
@@ -42,6 +46,43 @@ class Storage : public intrusive_list_node<Storage>
 
     typedef intrusive_list<NamespaceEntry> TNamespaces;
 
+    struct BatchEntry : public intrusive_list_node<BatchEntry> {
+    public:
+        char mKey[Item::MAX_KEY_LENGTH + 1];
+        uint8_t mNsIndex;
+        ItemType mDatatype;
+        bool mErase;
+    };
+
+    typedef intrusive_list<BatchEntry> TBatchEntries;
+
+    struct BlobIndexEntry : public intrusive_list_node<BlobIndexEntry> {
+    public:
+        char mKey[Item::MAX_KEY_LENGTH + 1];
+        uint8_t mNsIndex;
+        uint8_t mChunkStart;
+        uint8_t mChunkCount;
+    };
+
+    typedef intrusive_list<BlobIndexEntry> TBlobIndexEntries;
+
+    struct BlobWriter {
+        char mKey[Item::MAX_KEY_LENGTH + 1];
+        uint8_t mNsIndex;
+        uint8_t mChunkStart;
+        uint8_t mChunkCount;
+        size_t mDataSize;
+        std::unique_ptr<uint8_t[]> mBuffer;
+        size_t mBufferedSize;
+    };
+
+    // which copies of an item findItem may return, relative to a batch tag
+    enum class BatchFilter {
+        ALL,
+        TAGGED,
+        UNTAGGED,
+    };
+
 public:
     ~Storage();
 
@@ -49,6 +90,11 @@ public:
 
     esp_err_t init(uint32_t baseSector, uint32_t sectorCount);
 
+    void setItemIndexSize(size_t maxItems)
+    {
+        mPageManager.itemIndex().setMaxItems(maxItems);
+    }
+
     bool isValid() const;
 
     esp_err_t createOrOpenNamespace(const char* nsName, bool canCreate, uint8_t& nsIndex);
@@ -80,6 +126,80 @@ public:
     
     esp_err_t eraseNamespace(uint8_t nsIndex);
 
+    /**
+     * Start a batch: until commitBatch or abortBatch, items written or erased in any namespace
+     * only become visible all together, even if power goes out in the middle.
+     *
+     * Items of the batch are tagged with the batch tag. Single-entry items are collected in
+     * RAM and written to the pages back to back, many entries per flash write. Old copies
+     * are kept, and readers see them, until the batch is committed. The commit writes a
+     * single commit record, after which the old copies are erased in one pass. If power
+     * goes out before the commit record is written, init erases the tagged items; if it
+     * goes out after, init finishes erasing the old copies.
+     */
+    esp_err_t beginBatch();
+
+    esp_err_t commitBatch();
+
+    esp_err_t abortBatch();
+
+    bool isBatchActive() const
+    {
+        return mBatchTag != Item::NO_BATCH;
+    }
+
+    /**
+     * Read "dataSize" bytes of a blob, starting at "offset" into its data. "readSize" returns
+     * the number of bytes read, which is less than dataSize at the end of the blob.
+     */
+    esp_err_t readBlobPart(uint8_t nsIndex, const char* key, size_t offset, void* data, size_t dataSize, size_t& readSize);
+
+    /**
+     * Write a blob in parts, without keeping all of it in RAM. The data is written in chunks
+     * as it comes, and replaces the previous value of the key when finishBlobWrite is called;
+     * if power goes out before that, init erases the chunks. One blob can be written at a time,
+     * and the key can't be changed otherwise until the write is finished or aborted.
+     */
+    esp_err_t beginBlobWrite(uint8_t nsIndex, const char* key);
+
+    esp_err_t writeBlobPart(const void* data, size_t dataSize);
+
+    esp_err_t finishBlobWrite();
+
+    esp_err_t abortBlobWrite();
+
+    bool isBlobWriteActive() const
+    {
+        return static_cast<bool>(mBlobWriter.mBuffer);
+    }
+
+    /**
+     * Position of an iteration over the entries of the storage. Only the sequence number of
+     * the page and the index of the next item in it are kept, and pages are read one item at
+     * a time. Entries written or moved by garbage collection while iterating may be skipped
+     * or returned twice.
+     */
+    struct EntryIterator {
+        uint8_t mNsIndex = Page::NS_ANY;
+        ItemType mDatatype = ItemType::ANY;
+        uint32_t mPageSeqNumber = 0;
+        size_t mItemIndex = 0;
+        Item mItem;
+    };
+
+    /**
+     * Find the first entry of namespace "nsName" (any namespace if nullptr) with type "datatype"
+     * (ItemType::ANY for all types). Entries are the values seen by readers: items of an open
+     * batch are skipped, and a blob stored in chunks is returned once, with type BLOB.
+     */
+    esp_err_t findEntry(const char* nsName, ItemType datatype, EntryIterator& it);
+
+    esp_err_t nextEntry(EntryIterator& it);
+
+    const char* getNamespaceName(uint8_t nsIndex);
+
+    esp_err_t fillStats(nvs_stats_t& nvsStats);
+
     const char *getPartName() const
     {
         return mPartitionName;
@@ -99,7 +219,79 @@ protected:
 
     void clearNamespaces();
 
-    esp_err_t findItem(uint8_t nsIndex, ItemType datatype, const char* key, Page* &page, Item& item);
+    esp_err_t findItem(uint8_t nsIndex, ItemType datatype, const char* key, Page* &page, Item& item, size_t& itemIndex,
+            BatchFilter filter = BatchFilter::ALL, uint8_t batchTag = Item::NO_BATCH, uint8_t chunkIndex = Item::CHUNK_ANY);
+
+    esp_err_t findIndexedItem(uint8_t nsIndex, ItemType datatype, const char* key, Page* &page, Item& item, size_t& itemIndex,
+            BatchFilter filter, uint8_t batchTag, uint8_t chunkIndex);
+
+    static bool passesFilter(const Item& item, BatchFilter filter, uint8_t batchTag)
+    {
+        return filter == BatchFilter::ALL || ((item.batchTag == batchTag) == (filter == BatchFilter::TAGGED));
+    }
+
+    BatchFilter visibleItems() const
+    {
+        // items of an open batch are hidden from readers until it is committed
+        return isBatchActive() ? BatchFilter::UNTAGGED : BatchFilter::ALL;
+    }
+
+    esp_err_t startNewPage();
+
+    esp_err_t appendItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize, uint8_t batchTag);
+
+    esp_err_t eraseItemCopies(uint8_t nsIndex, ItemType datatype, const char* key, BatchFilter filter, uint8_t batchTag);
+
+    size_t getMaxBlobSize() const;
+
+    esp_err_t getBlobChunkStart(uint8_t nsIndex, const char* key, uint8_t batchTag, uint8_t& chunkStart);
+
+    esp_err_t writeMultiPageBlob(uint8_t nsIndex, const char* key, const void* data, size_t dataSize, uint8_t batchTag);
+
+    esp_err_t writeBlobChunks(uint8_t nsIndex, const char* key, const uint8_t* data, size_t dataSize,
+            uint8_t chunkStart, uint8_t& chunkCount, uint8_t batchTag);
+
+    esp_err_t finishMultiPageBlob(uint8_t nsIndex, const char* key, size_t dataSize, uint8_t chunkStart, uint8_t chunkCount,
+            uint8_t batchTag);
+
+    esp_err_t readMultiPageBlob(const Item& blobIndex, size_t offset, void* data, size_t dataSize, BatchFilter filter, uint8_t batchTag);
+
+    esp_err_t eraseMultiPageBlob(uint8_t nsIndex, const char* key, uint8_t chunkStart, BatchFilter filter, uint8_t batchTag);
+
+    esp_err_t eraseBlobChunks(uint8_t nsIndex, const char* key, uint8_t chunkStart, uint8_t chunkCount,
+            BatchFilter filter, uint8_t batchTag);
+
+    esp_err_t eraseOrphanBlobChunks();
+
+    bool isBlobWriteKey(uint8_t nsIndex, const char* key) const;
+
+    void releaseBlobWriter();
+
+    esp_err_t writeBatchItem(uint8_t nsIndex, ItemType datatype, const char* key, const void* data, size_t dataSize);
+
+    esp_err_t eraseBatchItem(uint8_t nsIndex, ItemType datatype, const char* key);
+
+    bool isBatchNamespaceTaken();
+
+    esp_err_t bufferBatchItem(const Item& item);
+
+    bool dropBufferedItems(uint8_t nsIndex, ItemType datatype, const char* key);
+
+    esp_err_t flushBatchItems();
+
+    BatchEntry* findBatchEntry(uint8_t nsIndex, ItemType datatype, const char* key, bool erase);
+
+    BatchEntry* addBatchEntry(uint8_t nsIndex, ItemType datatype, const char* key, bool erase);
+
+    esp_err_t addBatchWriteEntries(uint8_t nsIndex, ItemType datatype, const char* key);
+
+    void clearBatchEntries();
+
+    esp_err_t allocateBatchTag(uint8_t& batchTag);
+
+    esp_err_t finishBatch(bool commit);
+
+    esp_err_t recoverBatch();
 
 protected:
     const char *mPartitionName;
@@ -108,6 +300,23 @@ protected:
     TNamespaces mNamespaces;
     CompressedEnumTable<bool, 1, 256> mNamespaceUsage;
     StorageState mState = StorageState::INVALID;
+    TBatchEntries mBatchEntries;
+    uint8_t mBatchTag = Item::NO_BATCH;
+    std::unique_ptr<Item[]> mBatchItems;
+    size_t mBatchItemCount = 0;
+    CompressedEnumTable<bool, 1, 256> mBatchTagUsage;
+    bool mBatchTagUsageLoaded = false;
+    BlobWriter mBlobWriter;
+
+    static const char* const BATCH_BEGIN_KEY;
+    static const char* const BATCH_COMMIT_KEY;
+
+    // a new value of a chunked blob is written with the other version of chunk indices,
+    // so that the chunks of the previous value can be kept until the new index is written
+    static const uint8_t CHUNK_VERSION_OFFSET = 0x80;
+    static const uint8_t MAX_CHUNK_COUNT = CHUNK_VERSION_OFFSET - 1;
+
+    static const size_t BLOB_WRITE_BUFFER_SIZE = 16 * Page::ENTRY_SIZE;
 };
 
 } // namespace nvs
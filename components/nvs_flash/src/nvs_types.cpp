@@ -25,8 +25,10 @@ uint32_t Item::calculateCrc32() const
 {
     uint32_t result = 0xffffffff;
     const uint8_t* p = reinterpret_cast<const uint8_t*>(this);
-    result = crc32_le(result, p + offsetof(Item, nsIndex),
-                      offsetof(Item, crc32) - offsetof(Item, nsIndex));
+    // the batch tag counts as NO_BATCH, so that it can be cleared in place when the batch is committed
+    const uint8_t header[] = {nsIndex, static_cast<uint8_t>(datatype), span, NO_BATCH};
+    static_assert(sizeof(header) == offsetof(Item, crc32) - offsetof(Item, nsIndex), "unexpected item header size");
+    result = crc32_le(result, header, sizeof(header));
     result = crc32_le(result, p + offsetof(Item, key), sizeof(key));
     result = crc32_le(result, p + offsetof(Item, data), sizeof(data));
     return result;
@@ -39,14 +41,16 @@ uint32_t Item::calculateCrc32WithoutValue() const
     result = crc32_le(result, p + offsetof(Item, nsIndex),
                       offsetof(Item, datatype) - offsetof(Item, nsIndex));
     result = crc32_le(result, p + offsetof(Item, key), sizeof(key));
+    if (datatype == ItemType::BLOB_DATA) {
+        // chunks of a blob share the key, a lookup of one of them shouldn't have to walk the others
+        result = crc32_le(result, &varLength.chunkIndex, sizeof(varLength.chunkIndex));
+    }
     return result;
 }
 
-uint32_t Item::calculateCrc32(const uint8_t* data, size_t size)
+uint32_t Item::calculateCrc32(const uint8_t* data, size_t size, uint32_t crc)
 {
-    uint32_t result = 0xffffffff;
-    result = crc32_le(result, data, size);
-    return result;
+    return crc32_le(crc, data, size);
 }
 
 } // namespace nvs
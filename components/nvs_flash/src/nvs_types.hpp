@@ -37,9 +37,24 @@ enum class ItemType : uint8_t {
     I64  = 0x18,
     SZ   = 0x21,
     BLOB = 0x41,
+    // IDF's 0x42 and 0x48 are not used: there the chunk index is in the header, where the batch tag is here
+    BLOB_DATA = 0x43,
+    BLOB_IDX  = 0x49,
     ANY  = 0xff
 };
 
+// items with this type are followed by their data in the next "span - 1" entries
+inline bool isVariableLengthType(ItemType type)
+{
+    return type == ItemType::SZ || type == ItemType::BLOB || type == ItemType::BLOB_DATA;
+}
+
+// a blob is stored either as a single BLOB item, or as a BLOB_IDX item and its BLOB_DATA chunks
+inline bool isBlobType(ItemType type)
+{
+    return type == ItemType::BLOB || type == ItemType::BLOB_IDX || type == ItemType::BLOB_DATA;
+}
+
 template<typename T, typename std::enable_if<std::is_integral<T>::value, void*>::type = nullptr>
 constexpr ItemType itemTypeOf()
 {
@@ -60,15 +75,22 @@ public:
             uint8_t  nsIndex;
             ItemType datatype;
             uint8_t  span;
-            uint8_t  reserved;
+            uint8_t  batchTag;
             uint32_t crc32;
             char     key[16];
             union {
                 struct {
                     uint16_t dataSize;
-                    uint16_t reserved2;
+                    uint8_t  chunkIndex;    // index of a BLOB_DATA chunk, CHUNK_ANY for other types
+                    uint8_t  reserved2;
                     uint32_t dataCrc32;
                 } varLength;
+                struct {
+                    uint32_t dataSize;
+                    uint8_t  chunkCount;
+                    uint8_t  chunkStart;    // index of the first BLOB_DATA chunk
+                    uint16_t reserved2;
+                } blobIndex;
                 uint8_t data[8];
             };
         };
@@ -77,8 +99,16 @@ public:
 
     static const size_t MAX_KEY_LENGTH = sizeof(key) - 1;
 
+    // batchTag of items which were not written as a part of a batch, see Storage::beginBatch
+    static const uint8_t NO_BATCH = 0xff;
+
+    // batchTag of items of a committed batch: the tag is cleared in place, so that it can be used again
+    static const uint8_t COMMITTED_BATCH = 0x00;
+
+    static const uint8_t CHUNK_ANY = 0xff;
+
     Item(uint8_t nsIndex, ItemType datatype, uint8_t span, const char* key_)
-        : nsIndex(nsIndex), datatype(datatype), span(span), reserved(0xff)
+        : nsIndex(nsIndex), datatype(datatype), span(span), batchTag(NO_BATCH)
     {
         std::fill_n(reinterpret_cast<uint32_t*>(key),  sizeof(key)  / 4, 0xffffffff);
         std::fill_n(reinterpret_cast<uint32_t*>(data), sizeof(data) / 4, 0xffffffff);
@@ -95,8 +125,28 @@ public:
     }
 
     uint32_t calculateCrc32() const;
+    // hash of the namespace and the key, and of the chunk index for BLOB_DATA items
     uint32_t calculateCrc32WithoutValue() const;
-    static uint32_t calculateCrc32(const uint8_t* data, size_t size);
+    // "crc" continues the checksum of data which came before
+    static uint32_t calculateCrc32(const uint8_t* data, size_t size, uint32_t crc = 0xffffffff);
+
+    /**
+     * For BLOB_DATA items, check the chunk index; for BLOB_IDX items, check the index of
+     * the first chunk, which tells the version of the blob. CHUNK_ANY matches any item.
+     */
+    bool matchesChunk(uint8_t chunkIndex) const
+    {
+        if (chunkIndex == CHUNK_ANY) {
+            return true;
+        }
+        if (datatype == ItemType::BLOB_DATA) {
+            return varLength.chunkIndex == chunkIndex;
+        }
+        if (datatype == ItemType::BLOB_IDX) {
+            return blobIndex.chunkStart == chunkIndex;
+        }
+        return false;
+    }
 
     void getKey(char* dst, size_t dstSize)
     {
@@ -17,6 +17,8 @@
 #include "spi_flash_emulation.h"
 #include <sstream>
 #include <iostream>
+#include <chrono>
+#include <vector>
 
 #define TEST_ESP_ERR(rc, res) CHECK((rc) == (res))
 #define TEST_ESP_OK(rc) CHECK((rc) == ESP_OK)
@@ -45,7 +47,7 @@ TEST_CASE("crc32 behaves as expected", "[nvs]")
     item1.datatype = ItemType::I32;
     item1.nsIndex = 1;
     item1.crc32 = 0;
-    item1.reserved = 0xff;
+    item1.batchTag = 0xff;
     fill_n(item1.key, sizeof(item1.key), 0xbb);
     fill_n(item1.data, sizeof(item1.data), 0xaa);
 
@@ -1286,6 +1288,796 @@ TEST_CASE("nvs page selection takes into account free entries also not just eras
     nvs_close(handle);
 }
 
+TEST_CASE("storage finds items when the item index is full", "[nvs]")
+{
+    SpiFlashEmulator emu(8);
+    Storage storage;
+    emu.setBounds(4, 8);
+    storage.setItemIndexSize(4);
+    CHECK(storage.init(4, 4) == ESP_OK);
+
+    char key[16];
+    for (int i = 0; i < 32; ++i) {
+        snprintf(key, sizeof(key), "key%d", i);
+        REQUIRE(storage.writeItem(1, key, i) == ESP_OK);
+    }
+    for (int i = 0; i < 32; ++i) {
+        int val;
+        snprintf(key, sizeof(key), "key%d", i);
+        REQUIRE(storage.readItem(1, key, val) == ESP_OK);
+        CHECK(val == i);
+    }
+    TEST_ESP_OK(storage.eraseItem(1, "key2"));
+    TEST_ESP_OK(storage.eraseItem(1, "key20"));
+    int val;
+    TEST_ESP_ERR(storage.readItem(1, "key2", val), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_ERR(storage.readItem(1, "key20", val), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_ERR(storage.readItem(1, "nokey", val), ESP_ERR_NVS_NOT_FOUND);
+}
+
+TEST_CASE("lookup cost doesn't grow with partition size", "[nvs][bench]")
+{
+    const size_t lookups = 2000;
+    const size_t itemsPerPage = Page::ENTRY_COUNT;
+
+    for (size_t sectors : {8, 32, 128}) {
+        SpiFlashEmulator emu(sectors);
+        char key[16];
+        size_t itemCount = 0;
+
+        // fill all pages but the last one with small items, it is much faster than going through Storage
+        for (size_t sector = 0; sector < sectors - 1; ++sector) {
+            Page page;
+            REQUIRE(page.load(sector) == ESP_OK);
+            REQUIRE(page.setSeqNumber(sector) == ESP_OK);
+            for (size_t i = 0; i < itemsPerPage; ++i, ++itemCount) {
+                snprintf(key, sizeof(key), "k%d", static_cast<int>(itemCount));
+                REQUIRE(page.writeItem(1, key, static_cast<uint32_t>(itemCount)) == ESP_OK);
+            }
+            REQUIRE(page.markFull() == ESP_OK);
+        }
+
+        for (size_t indexSize : {itemCount, static_cast<size_t>(0)}) {
+            Storage storage;
+            storage.setItemIndexSize(indexSize);
+            REQUIRE(storage.init(0, sectors) == ESP_OK);
+
+            // the last key is on the last page, which is the worst case of searching the pages in order
+            snprintf(key, sizeof(key), "k%d", static_cast<int>(itemCount - 1));
+            size_t readOps = emu.getReadOps();
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < lookups; ++i) {
+                uint32_t val;
+                REQUIRE(storage.readItem(1, key, val) == ESP_OK);
+                CHECK(val == itemCount - 1);
+            }
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            CHECK(emu.getReadOps() - readOps == lookups);
+
+            s_perf << "Lookup of one of " << itemCount << " items on " << sectors << " sectors "
+                   << (indexSize ? "with" : "without") << " index: " << ns / lookups << " ns" << std::endl;
+        }
+    }
+}
+
+TEST_CASE("batch changes become visible only when committed", "[nvs][batch]")
+{
+    const char str[] = "batched string";
+    char buf[sizeof(str)];
+    int val;
+
+    for (size_t indexSize : {static_cast<size_t>(CONFIG_NVS_ITEM_INDEX_SIZE), static_cast<size_t>(0)}) {
+        SpiFlashEmulator emu(5);
+        Storage storage;
+        storage.setItemIndexSize(indexSize);
+        TEST_ESP_OK(storage.init(0, 5));
+
+        TEST_ESP_OK(storage.writeItem(1, "a", 1));
+        TEST_ESP_OK(storage.writeItem(1, "b", 2));
+        TEST_ESP_OK(storage.writeItem(1, "c", 3));
+
+        TEST_ESP_OK(storage.beginBatch());
+        TEST_ESP_ERR(storage.beginBatch(), ESP_ERR_NVS_BATCH_ACTIVE);
+        TEST_ESP_ERR(storage.eraseNamespace(1), ESP_ERR_NVS_BATCH_ACTIVE);
+        TEST_ESP_OK(storage.writeItem(1, "a", 10));
+        TEST_ESP_OK(storage.writeItem(1, "a", 11));
+        TEST_ESP_OK(storage.eraseItem(1, "b"));
+        TEST_ESP_OK(storage.writeItem(1, "d", 40));
+        TEST_ESP_OK(storage.writeItem(1, "e", 50));
+        TEST_ESP_OK(storage.eraseItem(1, "e"));
+        TEST_ESP_ERR(storage.eraseItem(1, "nokey"), ESP_ERR_NVS_NOT_FOUND);
+        TEST_ESP_OK(storage.writeItem(1, ItemType::SZ, "s", str, sizeof(str)));
+        TEST_ESP_OK(storage.writeItem(1, ItemType::SZ, "s", str, sizeof(str)));
+
+        // readers still see the values from before the batch
+        TEST_ESP_OK(storage.readItem(1, "a", val));
+        CHECK(val == 1);
+        TEST_ESP_OK(storage.readItem(1, "b", val));
+        CHECK(val == 2);
+        TEST_ESP_ERR(storage.readItem(1, "d", val), ESP_ERR_NVS_NOT_FOUND);
+        TEST_ESP_ERR(storage.readItem(1, ItemType::SZ, "s", buf, sizeof(buf)), ESP_ERR_NVS_NOT_FOUND);
+
+        TEST_ESP_OK(storage.commitBatch());
+        TEST_ESP_ERR(storage.commitBatch(), ESP_ERR_NVS_INVALID_STATE);
+
+        // changes of an aborted batch are dropped
+        TEST_ESP_OK(storage.beginBatch());
+        TEST_ESP_OK(storage.writeItem(1, "a", 20));
+        TEST_ESP_OK(storage.eraseItem(1, "c"));
+        TEST_ESP_OK(storage.writeItem(1, "f", 60));
+        TEST_ESP_OK(storage.abortBatch());
+
+        Storage reloaded;
+        reloaded.setItemIndexSize(indexSize);
+        TEST_ESP_OK(reloaded.init(0, 5));
+        for (Storage* st : {&storage, &reloaded}) {
+            TEST_ESP_OK(st->readItem(1, "a", val));
+            CHECK(val == 11);
+            TEST_ESP_ERR(st->readItem(1, "b", val), ESP_ERR_NVS_NOT_FOUND);
+            TEST_ESP_OK(st->readItem(1, "c", val));
+            CHECK(val == 3);
+            TEST_ESP_OK(st->readItem(1, "d", val));
+            CHECK(val == 40);
+            TEST_ESP_ERR(st->readItem(1, "e", val), ESP_ERR_NVS_NOT_FOUND);
+            TEST_ESP_ERR(st->readItem(1, "f", val), ESP_ERR_NVS_NOT_FOUND);
+            TEST_ESP_OK(st->readItem(1, ItemType::SZ, "s", buf, sizeof(buf)));
+            CHECK(strcmp(buf, str) == 0);
+        }
+    }
+}
+
+TEST_CASE("nvs_commit commits the batch of the handle", "[nvs][batch]")
+{
+    SpiFlashEmulator emu(3);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, 0, 3));
+    nvs_handle handle, other;
+    TEST_ESP_OK(nvs_open("ns", NVS_READWRITE, &handle));
+    TEST_ESP_OK(nvs_open("ns", NVS_READWRITE, &other));
+    TEST_ESP_OK(nvs_set_u32(handle, "config", 1));
+
+    TEST_ESP_OK(nvs_batch_begin(handle));
+    TEST_ESP_ERR(nvs_batch_begin(other), ESP_ERR_NVS_BATCH_ACTIVE);
+    TEST_ESP_OK(nvs_set_u32(handle, "config", 2));
+    uint32_t val;
+    TEST_ESP_OK(nvs_get_u32(other, "config", &val));
+    CHECK(val == 1);
+
+    // other handles can't change the partition, or their changes would be committed or dropped with the batch
+    TEST_ESP_ERR(nvs_set_u32(other, "other", 3), ESP_ERR_NVS_BATCH_ACTIVE);
+    TEST_ESP_ERR(nvs_set_str(other, "other", "3"), ESP_ERR_NVS_BATCH_ACTIVE);
+    TEST_ESP_ERR(nvs_set_blob(other, "other", "3", 1), ESP_ERR_NVS_BATCH_ACTIVE);
+    TEST_ESP_ERR(nvs_erase_key(other, "config"), ESP_ERR_NVS_BATCH_ACTIVE);
+    TEST_ESP_ERR(nvs_erase_all(other), ESP_ERR_NVS_BATCH_ACTIVE);
+    TEST_ESP_ERR(nvs_commit(other), ESP_ERR_NVS_BATCH_ACTIVE);
+    TEST_ESP_OK(nvs_get_u32(other, "config", &val));
+    CHECK(val == 1);
+
+    TEST_ESP_OK(nvs_commit(handle));
+    TEST_ESP_OK(nvs_get_u32(other, "config", &val));
+    CHECK(val == 2);
+    TEST_ESP_OK(nvs_set_u32(other, "other", 3));
+    TEST_ESP_OK(nvs_commit(other));
+    TEST_ESP_OK(nvs_get_u32(handle, "other", &val));
+    CHECK(val == 3);
+
+    // an aborted batch doesn't take values set with other handles
+    TEST_ESP_OK(nvs_batch_begin(handle));
+    TEST_ESP_OK(nvs_erase_key(handle, "other"));
+    TEST_ESP_ERR(nvs_set_u32(other, "other", 4), ESP_ERR_NVS_BATCH_ACTIVE);
+    TEST_ESP_OK(nvs_batch_abort(handle));
+    TEST_ESP_OK(nvs_get_u32(other, "other", &val));
+    CHECK(val == 3);
+
+    // closing the handle drops its batch
+    TEST_ESP_OK(nvs_batch_begin(handle));
+    TEST_ESP_OK(nvs_set_u32(handle, "config", 4));
+    nvs_close(handle);
+    TEST_ESP_OK(nvs_get_u32(other, "config", &val));
+    CHECK(val == 2);
+    TEST_ESP_OK(nvs_batch_begin(other));
+    TEST_ESP_OK(nvs_batch_abort(other));
+    nvs_close(other);
+}
+
+TEST_CASE("batch tags are reused once batches are committed", "[nvs][batch]")
+{
+    const size_t sectors = 3;
+    SpiFlashEmulator emu(sectors);
+    Storage storage;
+    TEST_ESP_OK(storage.init(0, sectors));
+
+    // there are only 254 tags, and committed items stay on flash for good
+    char key[16];
+    int val;
+    for (int i = 0; i < 1000; ++i) {
+        INFO(i);
+        TEST_ESP_OK(storage.beginBatch());
+        snprintf(key, sizeof(key), "key%d", i % 20);
+        TEST_ESP_OK(storage.writeItem(1, key, i));
+        TEST_ESP_OK(storage.writeItem(1, "last", i));
+        if (i % 3 == 0) {
+            TEST_ESP_OK(storage.writeItem(1, ItemType::SZ, "str", key, strlen(key) + 1));
+        }
+        if (i % 7 == 0) {
+            TEST_ESP_OK(storage.abortBatch());
+            continue;
+        }
+        TEST_ESP_OK(storage.commitBatch());
+        TEST_ESP_OK(storage.readItem(1, "last", val));
+        CHECK(val == i);
+    }
+
+    Storage reloaded;
+    TEST_ESP_OK(reloaded.init(0, sectors));
+    for (Storage* st : {&storage, &reloaded}) {
+        TEST_ESP_OK(st->readItem(1, "last", val));
+        CHECK(val == 999);
+        TEST_ESP_OK(st->readItem(1, "key19", val));
+        CHECK(val == 999);
+        char str[16];
+        TEST_ESP_OK(st->readItem(1, ItemType::SZ, "str", str, sizeof(str)));
+        CHECK(strcmp(str, "key19") == 0);
+    }
+
+    // a batch aborted after many commits doesn't touch what they wrote
+    TEST_ESP_OK(reloaded.beginBatch());
+    TEST_ESP_OK(reloaded.writeItem(1, "last", 0));
+    TEST_ESP_OK(reloaded.abortBatch());
+    TEST_ESP_OK(reloaded.readItem(1, "last", val));
+    CHECK(val == 999);
+}
+
+TEST_CASE("batch is all or nothing when power goes out", "[nvs][batch]")
+{
+    const size_t sectors = 3;
+    const int keyCount = 40;
+    char key[16];
+    SpiFlashEmulator emu(sectors);
+
+    // old values on the first page, surrounded by erased entries, and live fillers on the second page:
+    // the batch fills the second page, and the garbage collection moves the old values behind batch items
+    {
+        Storage storage;
+        REQUIRE(storage.init(0, sectors) == ESP_OK);
+        for (int i = 0; i < keyCount; ++i) {
+            snprintf(key, sizeof(key), "key%d", i);
+            REQUIRE(storage.writeItem(1, key, i) == ESP_OK);
+        }
+        REQUIRE(storage.writeItem(1, "gone", 1) == ESP_OK);
+        for (int i = 0; i < 85; ++i) {
+            REQUIRE(storage.writeItem(1, "junk", i) == ESP_OK);
+        }
+        for (int i = 0; i < 100; ++i) {
+            snprintf(key, sizeof(key), "filler%d", i);
+            REQUIRE(storage.writeItem(1, key, i) == ESP_OK);
+        }
+    }
+    std::vector<uint32_t> image(emu.words(), emu.words() + emu.size() / 4);
+
+    size_t totalOps = 0;
+    for (size_t indexSize : {static_cast<size_t>(CONFIG_NVS_ITEM_INDEX_SIZE), static_cast<size_t>(0)}) {
+        for (uint32_t errDelay = 0; ; ++errDelay) {
+            INFO(indexSize);
+            INFO(errDelay);
+            for (size_t sector = 0; sector < sectors; ++sector) {
+                emu.erase(sector);
+                emu.write(sector * SPI_FLASH_SEC_SIZE, &image[sector * SPI_FLASH_SEC_SIZE / 4], SPI_FLASH_SEC_SIZE);
+            }
+            emu.clearStats();
+            emu.failAfter(errDelay);
+
+            bool committed = false;
+            {
+                Storage storage;
+                storage.setItemIndexSize(indexSize);
+                if (storage.init(0, sectors) == ESP_OK && storage.beginBatch() == ESP_OK) {
+                    bool ok = true;
+                    for (int i = 0; i < keyCount && ok; ++i) {
+                        snprintf(key, sizeof(key), "key%d", i);
+                        ok = storage.writeItem(1, key, 1000 + i) == ESP_OK;
+                    }
+                    ok = ok && storage.eraseItem(1, "gone") == ESP_OK;
+                    committed = ok && storage.commitBatch() == ESP_OK;
+                }
+            }
+            totalOps = emu.getEraseOps() + emu.getWriteBytes() / 4;
+            emu.failAfter(UINT32_MAX);
+
+            Storage storage;
+            storage.setItemIndexSize(indexSize);
+            REQUIRE(storage.init(0, sectors) == ESP_OK);
+            int val;
+            REQUIRE(storage.readItem(1, "key0", val) == ESP_OK);
+            bool isNew = (val == 1000);
+            CHECK((isNew || !committed));
+            for (int i = 0; i < keyCount; ++i) {
+                snprintf(key, sizeof(key), "key%d", i);
+                REQUIRE(storage.readItem(1, key, val) == ESP_OK);
+                CHECK(val == (isNew ? 1000 + i : i));
+            }
+            CHECK(storage.readItem(1, "gone", val) == (isNew ? ESP_ERR_NVS_NOT_FOUND : ESP_OK));
+            TEST_ESP_OK(storage.readItem(1, "filler99", val));
+            CHECK(val == 99);
+
+            // the partition stays usable for the next batch
+            TEST_ESP_OK(storage.beginBatch());
+            TEST_ESP_OK(storage.writeItem(1, "key0", 2000));
+            TEST_ESP_OK(storage.commitBatch());
+            TEST_ESP_OK(storage.readItem(1, "key0", val));
+            CHECK(val == 2000);
+
+            if (committed) {
+                break;
+            }
+        }
+    }
+    s_perf << "Batch power-off test: " << totalOps << " flash operations checked" << std::endl;
+}
+
+TEST_CASE("batch of writes costs fewer flash operations", "[nvs][batch][bench]")
+{
+    const int keyCount = 40;
+    char key[16];
+    size_t ops[2];
+
+    for (int batch = 0; batch < 2; ++batch) {
+        SpiFlashEmulator emu(4);
+        Storage storage;
+        REQUIRE(storage.init(0, 4) == ESP_OK);
+        for (int i = 0; i < keyCount; ++i) {
+            snprintf(key, sizeof(key), "key%d", i);
+            REQUIRE(storage.writeItem(1, key, i) == ESP_OK);
+        }
+
+        emu.clearStats();
+        if (batch) {
+            TEST_ESP_OK(storage.beginBatch());
+        }
+        for (int i = 0; i < keyCount; ++i) {
+            snprintf(key, sizeof(key), "key%d", i);
+            REQUIRE(storage.writeItem(1, key, i + 1) == ESP_OK);
+        }
+        if (batch) {
+            TEST_ESP_OK(storage.commitBatch());
+        }
+        ops[batch] = emu.getWriteOps() + emu.getEraseOps();
+    }
+
+    s_perf << "Writing " << keyCount << " keys: " << ops[0] << " flash operations, " << ops[1] << " in a batch" << std::endl;
+    CHECK(ops[1] * 4 < ops[0]);
+}
+
+static void fillBlob(uint8_t* data, size_t size, uint8_t seed)
+{
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = static_cast<uint8_t>(i * 7 + seed + (i >> 8));
+    }
+}
+
+static bool checkBlob(const uint8_t* data, size_t size, uint8_t seed, size_t offset = 0)
+{
+    for (size_t i = 0; i < size; ++i) {
+        if (data[i] != static_cast<uint8_t>((offset + i) * 7 + seed + ((offset + i) >> 8))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST_CASE("large blobs are stored in chunks across pages", "[nvs][blob]")
+{
+    const size_t sectors = 5;
+    SpiFlashEmulator emu(sectors);
+    Storage storage;
+    TEST_ESP_OK(storage.init(0, sectors));
+
+    uint8_t blob[10000];
+    uint8_t buf[10000];
+    size_t size;
+    for (size_t blobSize : {6000, 100, 9000, 1984, 1985, 3000}) {
+        INFO(blobSize);
+        uint8_t seed = static_cast<uint8_t>(blobSize);
+        fillBlob(blob, blobSize, seed);
+        TEST_ESP_OK(storage.writeItem(1, ItemType::BLOB, "blob", blob, blobSize));
+        TEST_ESP_OK(storage.getItemDataSize(1, ItemType::BLOB, "blob", size));
+        CHECK(size == blobSize);
+        memset(buf, 0, sizeof(buf));
+        TEST_ESP_OK(storage.readItem(1, ItemType::BLOB, "blob", buf, blobSize));
+        CHECK(checkBlob(buf, blobSize, seed));
+    }
+
+    // there is only one copy of the value, in any format
+    TEST_ESP_ERR(storage.writeItem(1, ItemType::BLOB, "blob", blob, 4000 * (sectors - 1) + 1), ESP_ERR_NVS_VALUE_TOO_LONG);
+    TEST_ESP_OK(storage.eraseItem(1, ItemType::BLOB, "blob"));
+    TEST_ESP_ERR(storage.getItemDataSize(1, ItemType::BLOB, "blob", size), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_ERR(storage.eraseItem(1, ItemType::BLOB, "blob"), ESP_ERR_NVS_NOT_FOUND);
+
+    fillBlob(blob, 7000, 1);
+    TEST_ESP_OK(storage.writeItem(1, ItemType::BLOB, "blob", blob, 7000));
+    TEST_ESP_OK(storage.writeItem(2, ItemType::BLOB, "blob", blob, 5000));
+
+    // parts of the blob can be read, across chunk boundaries
+    for (size_t offset : {0, 1, 3999, 4000, 4033, 6990}) {
+        INFO(offset);
+        size_t readSize;
+        TEST_ESP_OK(storage.readBlobPart(1, "blob", offset, buf, 100, readSize));
+        CHECK(readSize == std::min<size_t>(100, 7000 - offset));
+        CHECK(checkBlob(buf, readSize, 1, offset));
+    }
+    size_t readSize;
+    TEST_ESP_OK(storage.readBlobPart(1, "blob", 7000, buf, 100, readSize));
+    CHECK(readSize == 0);
+    TEST_ESP_ERR(storage.readBlobPart(1, "blob", 7001, buf, 100, readSize), ESP_ERR_NVS_INVALID_LENGTH);
+
+    Storage storage2;
+    TEST_ESP_OK(storage2.init(0, sectors));
+    TEST_ESP_OK(storage2.readItem(1, ItemType::BLOB, "blob", buf, 7000));
+    CHECK(checkBlob(buf, 7000, 1));
+    TEST_ESP_OK(storage2.readItem(2, ItemType::BLOB, "blob", buf, 5000));
+    CHECK(checkBlob(buf, 5000, 1));
+    TEST_ESP_OK(storage2.eraseNamespace(1));
+    TEST_ESP_ERR(storage2.getItemDataSize(1, ItemType::BLOB, "blob", size), ESP_ERR_NVS_NOT_FOUND);
+    TEST_ESP_OK(storage2.getItemDataSize(2, ItemType::BLOB, "blob", size));
+    CHECK(size == 5000);
+
+    // large blobs can be a part of a batch
+    fillBlob(blob, 6000, 3);
+    TEST_ESP_OK(storage2.beginBatch());
+    TEST_ESP_OK(storage2.writeItem(2, ItemType::BLOB, "blob", blob, 6000));
+    TEST_ESP_OK(storage2.writeItem(2, ItemType::BLOB, "small", blob, 10));
+    TEST_ESP_OK(storage2.getItemDataSize(2, ItemType::BLOB, "blob", size));
+    CHECK(size == 5000);
+    TEST_ESP_OK(storage2.commitBatch());
+    TEST_ESP_OK(storage2.readItem(2, ItemType::BLOB, "blob", buf, 6000));
+    CHECK(checkBlob(buf, 6000, 3));
+}
+
+TEST_CASE("chunks of large blobs are moved by garbage collection", "[nvs][blob]")
+{
+    const size_t sectors = 4;
+    SpiFlashEmulator emu(sectors);
+    Storage storage;
+    TEST_ESP_OK(storage.init(0, sectors));
+
+    uint8_t blob[5000];
+    uint8_t buf[5000];
+    char key[16];
+    for (int i = 0; i < 40; ++i) {
+        INFO(i);
+        size_t blobSize = 2500 + i * 50;
+        fillBlob(blob, blobSize, static_cast<uint8_t>(i));
+        TEST_ESP_OK(storage.writeItem(1, ItemType::BLOB, "blob", blob, blobSize));
+        snprintf(key, sizeof(key), "key%d", i % 10);
+        TEST_ESP_OK(storage.writeItem(1, key, i));
+        TEST_ESP_OK(storage.readItem(1, ItemType::BLOB, "blob", buf, blobSize));
+        CHECK(checkBlob(buf, blobSize, static_cast<uint8_t>(i)));
+    }
+
+    Storage storage2;
+    TEST_ESP_OK(storage2.init(0, sectors));
+    size_t size;
+    TEST_ESP_OK(storage2.getItemDataSize(1, ItemType::BLOB, "blob", size));
+    CHECK(size == 2500 + 39 * 50);
+    TEST_ESP_OK(storage2.readItem(1, ItemType::BLOB, "blob", buf, size));
+    CHECK(checkBlob(buf, size, 39));
+    int val;
+    TEST_ESP_OK(storage2.readItem(1, "key9", val));
+    CHECK(val == 39);
+}
+
+TEST_CASE("reading a large blob looks up every chunk once", "[nvs][blob]")
+{
+    static uint8_t blob[4000 * 12];
+    static uint8_t buf[sizeof(blob)];
+    size_t readOps[2];
+    for (size_t chunks : {4, 12}) {
+        const size_t sectors = chunks + 2;
+        SpiFlashEmulator emu(sectors);
+        Storage storage;
+        TEST_ESP_OK(storage.init(0, sectors));
+
+        size_t blobSize = 4000 * chunks;
+        fillBlob(blob, blobSize, static_cast<uint8_t>(chunks));
+        TEST_ESP_OK(storage.writeItem(1, ItemType::BLOB, "blob", blob, blobSize));
+        size_t ops = emu.getReadOps();
+        TEST_ESP_OK(storage.readItem(1, ItemType::BLOB, "blob", buf, blobSize));
+        CHECK(checkBlob(buf, blobSize, static_cast<uint8_t>(chunks)));
+        readOps[chunks == 12] = emu.getReadOps() - ops;
+    }
+
+    // the chunks don't share a hash, so the cost of a read grows with the number of chunks, not its square
+    s_perf << "Reading a blob of 4 chunks: " << readOps[0] << " read operations, of 12 chunks: " << readOps[1] << std::endl;
+    CHECK(readOps[1] <= readOps[0] * 3 + 3);
+}
+
+TEST_CASE("blobs can be written and read in parts", "[nvs][blob]")
+{
+    SpiFlashEmulator emu(10);
+    const uint32_t NVS_FLASH_SECTOR = 6;
+    const uint32_t NVS_FLASH_SECTOR_COUNT_MIN = 4;
+    emu.setBounds(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR + NVS_FLASH_SECTOR_COUNT_MIN);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, NVS_FLASH_SECTOR, NVS_FLASH_SECTOR_COUNT_MIN));
+
+    nvs_handle handle, other;
+    TEST_ESP_OK(nvs_open("namespace1", NVS_READWRITE, &handle));
+    TEST_ESP_OK(nvs_open("namespace1", NVS_READWRITE, &other));
+
+    uint8_t blob[8000];
+    uint8_t buf[8000];
+    size_t size;
+    fillBlob(blob, 3000, 1);
+    TEST_ESP_OK(nvs_set_blob(handle, "cert", blob, 3000));
+
+    // small parts are collected, large ones are written as they come
+    fillBlob(blob, sizeof(blob), 2);
+    TEST_ESP_OK(nvs_set_blob_begin(handle, "cert"));
+    TEST_ESP_ERR(nvs_set_blob_begin(other, "other"), ESP_ERR_NVS_INVALID_STATE);
+    TEST_ESP_ERR(nvs_set_blob(other, "cert", blob, 10), ESP_ERR_NVS_INVALID_STATE);
+    TEST_ESP_ERR(nvs_set_blob_append(other, blob, 10), ESP_ERR_NVS_INVALID_STATE);
+    size_t offset = 0;
+    for (size_t part : {100, 1, 300, 2000, 33, 1500, 66}) {
+        TEST_ESP_OK(nvs_set_blob_append(handle, blob + offset, part));
+        offset += part;
+        // readers see the previous value until the blob is finished
+        size = sizeof(buf);
+        TEST_ESP_OK(nvs_get_blob(other, "cert", buf, &size));
+        CHECK(size == 3000);
+        CHECK(checkBlob(buf, size, 1));
+    }
+    TEST_ESP_OK(nvs_set_blob_end(handle));
+    TEST_ESP_ERR(nvs_set_blob_end(handle), ESP_ERR_NVS_INVALID_STATE);
+    size = sizeof(buf);
+    TEST_ESP_OK(nvs_get_blob(other, "cert", buf, &size));
+    CHECK(size == offset);
+    CHECK(checkBlob(buf, size, 2));
+
+    // read back in pieces
+    memset(buf, 0, sizeof(buf));
+    size_t readOffset = 0;
+    size = 777;
+    while (nvs_get_blob_part(other, "cert", readOffset, buf + readOffset, &size) == ESP_OK && size > 0) {
+        readOffset += size;
+        size = 777;
+    }
+    CHECK(readOffset == offset);
+    CHECK(checkBlob(buf, readOffset, 2));
+    size = 10;
+    TEST_ESP_ERR(nvs_get_blob_part(other, "cert", offset + 1, buf, &size), ESP_ERR_NVS_INVALID_LENGTH);
+    TEST_ESP_ERR(nvs_get_blob_part(other, "none", 0, buf, &size), ESP_ERR_NVS_NOT_FOUND);
+
+    // an aborted or dropped blob leaves the previous value
+    TEST_ESP_OK(nvs_set_blob_begin(other, "cert"));
+    TEST_ESP_OK(nvs_set_blob_append(other, blob, 5000));
+    TEST_ESP_OK(nvs_set_blob_abort(other));
+    TEST_ESP_OK(nvs_set_blob_abort(other));
+    TEST_ESP_OK(nvs_set_blob_begin(handle, "cert"));
+    TEST_ESP_OK(nvs_set_blob_append(handle, blob, 700));
+    nvs_close(handle);
+    size = sizeof(buf);
+    TEST_ESP_OK(nvs_get_blob(other, "cert", buf, &size));
+    CHECK(size == offset);
+    CHECK(checkBlob(buf, size, 2));
+
+    // a small blob written in parts
+    TEST_ESP_OK(nvs_set_blob_begin(other, "small"));
+    TEST_ESP_OK(nvs_set_blob_append(other, blob, 10));
+    TEST_ESP_OK(nvs_set_blob_append(other, blob + 10, 10));
+    TEST_ESP_OK(nvs_set_blob_end(other));
+    size = sizeof(buf);
+    TEST_ESP_OK(nvs_get_blob(other, "small", buf, &size));
+    CHECK(size == 20);
+    CHECK(checkBlob(buf, size, 2));
+    nvs_close(other);
+}
+
+TEST_CASE("large blob has the old or the new value when power goes out", "[nvs][blob]")
+{
+    const size_t sectors = 5;
+    SpiFlashEmulator emu(sectors);
+    uint8_t blob[5000];
+    uint8_t buf[5000];
+
+    for (size_t oldSize : {1000, 3000}) {
+        {
+            for (size_t sector = 0; sector < sectors; ++sector) {
+                emu.erase(sector);
+            }
+            Storage storage;
+            REQUIRE(storage.init(0, sectors) == ESP_OK);
+            REQUIRE(storage.writeItem(1, "before", 1) == ESP_OK);
+            fillBlob(blob, oldSize, 1);
+            REQUIRE(storage.writeItem(1, ItemType::BLOB, "blob", blob, oldSize) == ESP_OK);
+            REQUIRE(storage.writeItem(1, "after", 2) == ESP_OK);
+        }
+        std::vector<uint32_t> image(emu.words(), emu.words() + emu.size() / 4);
+
+        fillBlob(blob, sizeof(blob), 2);
+        for (uint32_t errDelay = 0; ; ++errDelay) {
+            INFO(oldSize);
+            INFO(errDelay);
+            for (size_t sector = 0; sector < sectors; ++sector) {
+                emu.erase(sector);
+                emu.write(sector * SPI_FLASH_SEC_SIZE, &image[sector * SPI_FLASH_SEC_SIZE / 4], SPI_FLASH_SEC_SIZE);
+            }
+            emu.failAfter(errDelay);
+
+            bool written = false;
+            {
+                Storage storage;
+                if (storage.init(0, sectors) == ESP_OK) {
+                    written = storage.writeItem(1, ItemType::BLOB, "blob", blob, sizeof(blob)) == ESP_OK;
+                }
+            }
+            emu.failAfter(UINT32_MAX);
+
+            Storage storage;
+            REQUIRE(storage.init(0, sectors) == ESP_OK);
+            size_t size;
+            REQUIRE(storage.getItemDataSize(1, ItemType::BLOB, "blob", size) == ESP_OK);
+            CHECK((size == sizeof(blob) || (size == oldSize && !written)));
+            REQUIRE(storage.readItem(1, ItemType::BLOB, "blob", buf, size) == ESP_OK);
+            CHECK(checkBlob(buf, size, size == oldSize ? 1 : 2));
+            int val;
+            TEST_ESP_OK(storage.readItem(1, "after", val));
+            CHECK(val == 2);
+
+            // the chunks of the interrupted write don't take space any more
+            TEST_ESP_OK(storage.writeItem(1, ItemType::BLOB, "blob", blob, sizeof(blob)));
+            TEST_ESP_OK(storage.readItem(1, ItemType::BLOB, "blob", buf, sizeof(blob)));
+            CHECK(checkBlob(buf, sizeof(blob), 2));
+
+            if (written) {
+                break;
+            }
+        }
+    }
+}
+
+static size_t count_entries(const char* part, const char* ns, nvs_type_t type)
+{
+    size_t count = 0;
+    for (nvs_iterator_t it = nvs_entry_find(part, ns, type); it != NULL; it = nvs_entry_next(it)) {
+        ++count;
+    }
+    return count;
+}
+
+TEST_CASE("nvs iterators list the entries seen by readers", "[nvs][iterator]")
+{
+    SpiFlashEmulator emu(10);
+    const uint32_t NVS_FLASH_SECTOR = 2;
+    const uint32_t NVS_FLASH_SECTOR_COUNT_MIN = 8;
+    emu.setBounds(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR + NVS_FLASH_SECTOR_COUNT_MIN);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, NVS_FLASH_SECTOR, NVS_FLASH_SECTOR_COUNT_MIN));
+
+    CHECK(nvs_entry_find(NVS_DEFAULT_PART_NAME, NULL, NVS_TYPE_ANY) == NULL);
+    CHECK(nvs_entry_find("nonexistent", NULL, NVS_TYPE_ANY) == NULL);
+
+    nvs_handle h1, h2;
+    TEST_ESP_OK(nvs_open("namespace1", NVS_READWRITE, &h1));
+    TEST_ESP_OK(nvs_open("namespace2", NVS_READWRITE, &h2));
+    static uint8_t blob[6000];
+    TEST_ESP_OK(nvs_set_u8(h1, "u8", 1));
+    TEST_ESP_OK(nvs_set_i32(h1, "i32", -1));
+    TEST_ESP_OK(nvs_set_str(h1, "str", "value"));
+    TEST_ESP_OK(nvs_set_blob(h1, "small", blob, 100));
+    TEST_ESP_OK(nvs_set_blob(h1, "large", blob, sizeof(blob)));
+    TEST_ESP_OK(nvs_set_u8(h2, "u8", 2));
+    TEST_ESP_OK(nvs_set_u8(h2, "gone", 3));
+    TEST_ESP_OK(nvs_erase_key(h2, "gone"));
+
+    CHECK(count_entries(NVS_DEFAULT_PART_NAME, "namespace1", NVS_TYPE_ANY) == 5);
+    CHECK(count_entries(NVS_DEFAULT_PART_NAME, "namespace2", NVS_TYPE_ANY) == 1);
+    CHECK(count_entries(NVS_DEFAULT_PART_NAME, NULL, NVS_TYPE_ANY) == 6);
+    CHECK(count_entries(NVS_DEFAULT_PART_NAME, NULL, NVS_TYPE_U8) == 2);
+    CHECK(count_entries(NVS_DEFAULT_PART_NAME, "namespace1", NVS_TYPE_STR) == 1);
+    CHECK(count_entries(NVS_DEFAULT_PART_NAME, "namespace3", NVS_TYPE_ANY) == 0);
+
+    // a blob stored in chunks is listed once, as a blob
+    nvs_iterator_t it = nvs_entry_find(NVS_DEFAULT_PART_NAME, "namespace1", NVS_TYPE_BLOB);
+    REQUIRE(it != NULL);
+    nvs_entry_info_t info;
+    nvs_entry_info(it, &info);
+    CHECK(std::string(info.namespace_name) == "namespace1");
+    CHECK(std::string(info.key) == "small");
+    CHECK(info.type == NVS_TYPE_BLOB);
+    it = nvs_entry_next(it);
+    REQUIRE(it != NULL);
+    nvs_entry_info(it, &info);
+    CHECK(std::string(info.key) == "large");
+    CHECK(info.type == NVS_TYPE_BLOB);
+    CHECK(nvs_entry_next(it) == NULL);
+
+    // an iterator can be released before the end
+    it = nvs_entry_find(NVS_DEFAULT_PART_NAME, NULL, NVS_TYPE_ANY);
+    REQUIRE(it != NULL);
+    nvs_release_iterator(it);
+    nvs_release_iterator(NULL);
+
+    // values of a batch are listed once it is committed
+    TEST_ESP_OK(nvs_batch_begin(h2));
+    TEST_ESP_OK(nvs_set_u8(h2, "batch", 4));
+    TEST_ESP_OK(nvs_set_u8(h2, "u8", 5));
+    TEST_ESP_OK(nvs_commit(h2));
+    CHECK(count_entries(NVS_DEFAULT_PART_NAME, "namespace2", NVS_TYPE_ANY) == 2);
+    TEST_ESP_OK(nvs_batch_begin(h2));
+    TEST_ESP_OK(nvs_set_blob(h2, "blob", blob, sizeof(blob)));
+    CHECK(count_entries(NVS_DEFAULT_PART_NAME, "namespace2", NVS_TYPE_ANY) == 2);
+    TEST_ESP_OK(nvs_commit(h2));
+    CHECK(count_entries(NVS_DEFAULT_PART_NAME, "namespace2", NVS_TYPE_ANY) == 3);
+
+    // entries on all pages are listed
+    char key[16];
+    for (int i = 0; i < 200; ++i) {
+        snprintf(key, sizeof(key), "key%d", i);
+        TEST_ESP_OK(nvs_set_u32(h1, key, i));
+    }
+    CHECK(count_entries(NVS_DEFAULT_PART_NAME, "namespace1", NVS_TYPE_U32) == 200);
+
+    nvs_close(h1);
+    nvs_close(h2);
+}
+
+TEST_CASE("nvs_get_stats reports the usage of the partition", "[nvs][stats]")
+{
+    const size_t sectors = 4;
+    SpiFlashEmulator emu(10);
+    const uint32_t NVS_FLASH_SECTOR = 6;
+    emu.setBounds(NVS_FLASH_SECTOR, NVS_FLASH_SECTOR + sectors);
+    TEST_ESP_OK(nvs_flash_init_custom(NVS_DEFAULT_PART_NAME, NVS_FLASH_SECTOR, sectors));
+
+    const size_t entryCount = Page::ENTRY_COUNT;
+    nvs_stats_t stats;
+    TEST_ESP_ERR(nvs_get_stats(NULL, NULL), ESP_ERR_INVALID_ARG);
+    TEST_ESP_ERR(nvs_get_stats("nonexistent", &stats), ESP_ERR_NVS_PART_NOT_FOUND);
+    CHECK(stats.total_entries == 0);
+    TEST_ESP_OK(nvs_get_stats(NULL, &stats));
+    CHECK(stats.total_entries == sectors * entryCount);
+    CHECK(stats.used_entries == 0);
+    CHECK(stats.free_entries == sectors * entryCount);
+    CHECK(stats.namespace_count == 0);
+
+    nvs_handle handle;
+    TEST_ESP_OK(nvs_open("namespace1", NVS_READWRITE, &handle));
+    TEST_ESP_OK(nvs_set_u32(handle, "u32", 1));
+    TEST_ESP_OK(nvs_set_str(handle, "str", "a string of 40 characters, not counting"));
+    TEST_ESP_OK(nvs_get_stats(NVS_DEFAULT_PART_NAME, &stats));
+    // namespace entry, u32, and a string taking 1 + 2 entries
+    CHECK(stats.used_entries == 5);
+    CHECK(stats.free_entries == stats.total_entries - 5);
+    CHECK(stats.namespace_count == 1);
+
+    // erased entries count as free
+    TEST_ESP_OK(nvs_set_u32(handle, "u32", 2));
+    TEST_ESP_OK(nvs_erase_key(handle, "str"));
+    TEST_ESP_OK(nvs_get_stats(NVS_DEFAULT_PART_NAME, &stats));
+    CHECK(stats.used_entries == 2);
+    CHECK(stats.free_entries == stats.total_entries - 2);
+
+    nvs_handle other;
+    TEST_ESP_OK(nvs_open("namespace2", NVS_READWRITE, &other));
+    TEST_ESP_OK(nvs_get_stats(NVS_DEFAULT_PART_NAME, &stats));
+    CHECK(stats.namespace_count == 2);
+
+    // the partition becomes full while one page is still free for garbage collection
+    char key[16];
+    esp_err_t err = ESP_OK;
+    size_t written = 0;
+    while (err == ESP_OK) {
+        snprintf(key, sizeof(key), "key%d", static_cast<int>(written));
+        err = nvs_set_u32(other, key, written);
+        written += (err == ESP_OK);
+    }
+    TEST_ESP_ERR(err, ESP_ERR_NVS_NOT_ENOUGH_SPACE);
+    TEST_ESP_OK(nvs_get_stats(NVS_DEFAULT_PART_NAME, &stats));
+    CHECK(stats.used_entries == written + 3);
+    CHECK(stats.used_entries + stats.free_entries == stats.total_entries);
+    CHECK(stats.free_entries <= entryCount);
+
+    nvs_close(handle);
+    nvs_close(other);
+}
+
 TEST_CASE("dump all performance data", "[nvs]")
 {
     std::cout << "====================" << std::endl << "Dumping benchmarks" << std::endl;
@@ -7,6 +7,7 @@
 #ifndef _ESP_TRANSPORT_WS_H_
 #define _ESP_TRANSPORT_WS_H_
 
+#include <stdbool.h>
 #include "esp_transport.h"
 
 #ifdef __cplusplus
@@ -96,9 +97,121 @@ esp_err_t esp_transport_ws_set_headers(esp_transport_handle_t t, const char *hea
  */
 int esp_transport_ws_send_raw(esp_transport_handle_t t, ws_transport_opcodes_t opcode, const char *b, int len, int timeout_ms);
 
+/**
+ * @brief               Sends a fragment of a text or binary message
+ *
+ * A message is sent in as many fragments as needed, without holding it whole: the first
+ * fragment is sent with the opcode of the message, the following ones as continuation frames,
+ * until the one with fin set ends the message. A message of one fragment is sent with fin set
+ * in the first call. Control frames may be sent with esp_transport_ws_send_raw() between
+ * the fragments of a message, other messages may not.
+ *
+ * @param[in]  t           Websocket transport handle
+ * @param[in]  opcode      WS_TRANSPORT_OPCODES_TEXT or WS_TRANSPORT_OPCODES_BINARY, the opcode of the message
+ * @param[in]  b           The payload of the fragment
+ * @param[in]  len         The length of the payload, may be 0
+ * @param[in]  fin         Whether the fragment is the last of the message
+ * @param[in]  timeout_ms  The timeout milliseconds (-1 indicates block forever)
+ *
+ * @return
+ *  - Number of bytes of the payload written
+ *  - (-1) if there are any errors
+ */
+int esp_transport_ws_send_fragment(esp_transport_handle_t t, ws_transport_opcodes_t opcode, const char *b, int len, bool fin, int timeout_ms);
+
+/**
+ * @brief               Receives the next part of a text or binary message
+ *
+ * The payload of the messages is returned as it is received, in parts of at most len bytes,
+ * the frames of a message one after the other, so a message is streamed without holding it
+ * whole. The control frames received are answered: a PING with a PONG of the same payload,
+ * a CLOSE with a CLOSE of the same status code, after which the transport returns -1 and
+ * esp_transport_ws_get_close_code() returns the status code. A frame breaking the protocol,
+ * or a message longer than the limit set with esp_transport_ws_set_max_message_len(), makes
+ * the transport close the connection with the status code 1002 or 1009, and return -1.
+ *
+ * As the answers are written by the reading task, the writes of other tasks must not run
+ * at the same time on the transport.
+ *
+ * @param[in]  t           Websocket transport handle
+ * @param[out] buffer      The buffer
+ * @param[in]  len         The length of the buffer
+ * @param[out] opcode      The opcode of the message, WS_TRANSPORT_OPCODES_TEXT or WS_TRANSPORT_OPCODES_BINARY
+ * @param[out] fin         Whether the part ends the message
+ * @param[in]  timeout_ms  The timeout milliseconds (-1 indicates block forever)
+ *
+ * @return
+ *  - Number of bytes received, 0 with fin not set if the timeout expired
+ *  - (-1) if there are any errors, or once the connection is closed
+ */
+int esp_transport_ws_recv(esp_transport_handle_t t, char *buffer, int len, ws_transport_opcodes_t *opcode, bool *fin, int timeout_ms);
+
+/**
+ * @brief               Receives a whole text or binary message
+ *
+ * The fragments of the message are put together in the buffer, the control frames received
+ * meanwhile are answered as by esp_transport_ws_recv(). A message longer than the buffer is
+ * handled as a message longer than the limit of the transport. If the timeout expires in the
+ * middle of a message, 0 is returned and the next call goes on with it in the same buffer.
+ *
+ * @param[in]  t           Websocket transport handle
+ * @param[out] buffer      The buffer
+ * @param[in]  len         The length of the buffer
+ * @param[out] opcode      The opcode of the message, WS_TRANSPORT_OPCODES_CONT if no message was received
+ * @param[in]  timeout_ms  The timeout milliseconds (-1 indicates block forever)
+ *
+ * @return
+ *  - Length of the message, 0 with opcode WS_TRANSPORT_OPCODES_CONT if the timeout expired
+ *  - (-1) if there are any errors, or once the connection is closed
+ */
+int esp_transport_ws_recv_message(esp_transport_handle_t t, char *buffer, int len, ws_transport_opcodes_t *opcode, int timeout_ms);
+
+/**
+ * @brief               Limits the length of the messages received
+ *
+ * @param t                 websocket transport handle
+ * @param max_message_len   The longest message received, 0 for no limit (default)
+ *
+ * @return
+ *      - ESP_OK on success
+ *      - ESP_ERR_INVALID_ARG
+ */
+esp_err_t esp_transport_ws_set_max_message_len(esp_transport_handle_t t, int max_message_len);
+
+/**
+ * @brief               Starts the closing handshake
+ *
+ * Sends a CLOSE frame, the messages received until the CLOSE of the server are still returned
+ * by esp_transport_ws_recv(), which returns -1 on it. The transport is closed with
+ * esp_transport_close() then.
+ *
+ * @param[in]  t            Websocket transport handle
+ * @param[in]  status_code  The status code, 0 for 1000 (normal closure)
+ * @param[in]  timeout_ms   The timeout milliseconds (-1 indicates block forever)
+ *
+ * @return
+ *  - Number of bytes of the payload written
+ *  - (-1) if there are any errors
+ */
+int esp_transport_ws_send_close(esp_transport_handle_t t, int status_code, int timeout_ms);
+
+/**
+ * @brief               Returns the status code the connection was closed with
+ *
+ * @param t             websocket transport handle
+ *
+ * @return
+ *      - The status code of the CLOSE received, or sent on an error of the protocol
+ *      - 0 while the connection is open
+ */
+int esp_transport_ws_get_close_code(esp_transport_handle_t t);
+
 /**
  * @brief               Returns websocket op-code for last received data
  *
+ * esp_transport_read() returns the payload of every frame, control frames included, with
+ * their op-code here. esp_transport_ws_recv() answers the control frames instead.
+ *
  * @param t             websocket transport handle
  *
  * @return
@@ -0,0 +1,10 @@
+// Host build stub of esp_system.h, only esp_random() is used by the client
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+static inline uint32_t esp_random(void)
+{
+    return (uint32_t)random();
+}
@@ -0,0 +1,13 @@
+// Host build stub of lwip/sockets.h, the sockets of the host
+#pragma once
+
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <strings.h>
+#include <unistd.h>
+
+typedef struct in_addr ip_addr_t;
+
+#define ipaddr_ntoa(addr)   inet_ntoa(*(const struct in_addr *)(addr))
@@ -0,0 +1,31 @@
+// Host build stub of mbedtls/base64.h, the encoder of the websocket handshake keys
+#pragma once
+
+#include <stddef.h>
+
+#define MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL -0x002A
+
+static inline int mbedtls_base64_encode(unsigned char *dst, size_t dlen, size_t *olen,
+                                        const unsigned char *src, size_t slen)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t n = (slen + 2) / 3 * 4;
+
+    if (dlen < n + 1) {
+        *olen = n + 1;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+    unsigned char *p = dst;
+    for (size_t i = 0; i < slen; i += 3) {
+        unsigned int v = src[i] << 16;
+        v |= (i + 1 < slen) ? src[i + 1] << 8 : 0;
+        v |= (i + 2 < slen) ? src[i + 2] : 0;
+        *p++ = alphabet[(v >> 18) & 0x3f];
+        *p++ = alphabet[(v >> 12) & 0x3f];
+        *p++ = (i + 1 < slen) ? alphabet[(v >> 6) & 0x3f] : '=';
+        *p++ = (i + 2 < slen) ? alphabet[v & 0x3f] : '=';
+    }
+    *p = 0;
+    *olen = n;
+    return 0;
+}
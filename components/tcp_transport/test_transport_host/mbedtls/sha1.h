@@ -0,0 +1,75 @@
+// Host build stub of mbedtls/sha1.h, the digest of the websocket handshake keys
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+static inline void mbedtls_sha1_block(uint32_t h[5], const unsigned char *block)
+{
+    uint32_t w[80];
+
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[4 * i] << 24 | block[4 * i + 1] << 16 | block[4 * i + 2] << 8 | block[4 * i + 3];
+    }
+    for (int i = 16; i < 80; i++) {
+        uint32_t x = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+        w[i] = x << 1 | x >> 31;
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdc;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+        uint32_t t = (a << 5 | a >> 27) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = b << 30 | b >> 2;
+        b = a;
+        a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+static inline int mbedtls_sha1_ret(const unsigned char *input, size_t ilen, unsigned char output[20])
+{
+    uint32_t h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+    unsigned char block[64];
+    size_t i;
+
+    for (i = 0; i + 64 <= ilen; i += 64) {
+        mbedtls_sha1_block(h, input + i);
+    }
+    size_t rest = ilen - i;
+    memset(block, 0, sizeof(block));
+    memcpy(block, input + i, rest);
+    block[rest] = 0x80;
+    if (rest >= 56) {
+        mbedtls_sha1_block(h, block);
+        memset(block, 0, sizeof(block));
+    }
+    uint64_t bits = (uint64_t)ilen * 8;
+    for (int j = 0; j < 8; j++) {
+        block[63 - j] = (unsigned char)(bits >> (8 * j));
+    }
+    mbedtls_sha1_block(h, block);
+    for (int j = 0; j < 20; j++) {
+        output[j] = (unsigned char)(h[j / 4] >> (24 - 8 * (j % 4)));
+    }
+    return 0;
+}
@@ -0,0 +1,595 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Check the messages of the websocket transport against a stand-in server, run in a thread of
+ * the test on loopback TCP, which answers the handshake and then plays one scenario per
+ * connection. The echo scenario sends each message back in fragments with PINGs between them:
+ * messages sent whole and in fragments have to come back the same, received whole or streamed,
+ * and each PING has to be answered with its payload. Then the server closes, sends a message over
+ * the limit or a continuation frame out of a message, and has to get the close frame with the
+ * status code it expects, while the transport returns -1 with that code. A message with a pause
+ * between its fragments is received whole by calls timing out in the middle of it. At last 4 MB
+ * messages are streamed both ways in 1 kB fragments, which the transport never holds whole.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "esp_transport.h"
+#include "esp_transport_tcp.h"
+#include "esp_transport_ws.h"
+#include "mbedtls/base64.h"
+#include "mbedtls/sha1.h"
+
+#define TEST_TIMEOUT_MS     2000
+#define TEST_LONG_MESSAGE   (64 * 1024)
+#define ECHO_FRAGMENT       700
+#define BENCH_MESSAGE       (4 * 1024 * 1024)
+#define BENCH_FRAGMENT      1024
+
+#define OP_CONT     0x0
+#define OP_TEXT     0x1
+#define OP_BINARY   0x2
+#define OP_CLOSE    0x8
+#define OP_PING     0x9
+#define OP_PONG     0xa
+#define FIN         0x80
+
+typedef void (*scenario_t)(int fd);
+
+static int s_listen_fd;
+static int s_port;
+static scenario_t s_scenario;
+static pthread_t s_server_thread;
+
+/* What the server saw of the client */
+static int s_fragments;         /*!< Frames of the last message */
+static int s_pings;
+static int s_pongs;
+static int s_close_code;
+static int s_big_len;
+
+static inline uint64_t bench_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void expect(int ok, const char *what)
+{
+    if (!ok) {
+        printf("check failed: %s\n", what);
+        exit(1);
+    }
+}
+
+static void fill_pattern(char *data, int len, int seed)
+{
+    for (int i = 0; i < len; i++) {
+        data[i] = (char)(i * 31 + seed + (i >> 8));
+    }
+}
+
+static void accept_key(const char *key, char *accept, size_t accept_len)
+{
+    char text[128];
+    unsigned char sha1[20];
+    size_t outlen;
+
+    snprintf(text, sizeof(text), "%s258EAFA5-E914-47DA-95CA-C5AB0DC85B11", key);
+    mbedtls_sha1_ret((unsigned char *)text, strlen(text), sha1);
+    mbedtls_base64_encode((unsigned char *)accept, accept_len, &outlen, sha1, sizeof(sha1));
+}
+
+static void srv_read_all(int fd, void *buffer, int len)
+{
+    int rlen = 0;
+
+    while (rlen < len) {
+        int ret = read(fd, (char *)buffer + rlen, len - rlen);
+        expect(ret > 0, "the server reads the frame");
+        rlen += ret;
+    }
+}
+
+static void srv_write_all(int fd, const void *buffer, int len)
+{
+    int written = 0;
+
+    while (written < len) {
+        int ret = write(fd, (const char *)buffer + written, len - written);
+        expect(ret > 0, "the server writes the frame");
+        written += ret;
+    }
+}
+
+/* Read a frame of the client, which has to be masked, returns the length of its payload */
+static int srv_read_frame(int fd, uint8_t *opcode, int *fin, char *payload, int max_len)
+{
+    uint8_t header[8], key[4];
+    int len;
+
+    srv_read_all(fd, header, 2);
+    *fin = (header[0] & FIN) != 0;
+    *opcode = header[0] & 0x0f;
+    expect(header[1] & 0x80, "the frames of the client are masked");
+    len = header[1] & 0x7f;
+    if (len == 126) {
+        srv_read_all(fd, header, 2);
+        len = header[0] << 8 | header[1];
+    } else if (len == 127) {
+        srv_read_all(fd, header, 8);
+        len = header[4] << 24 | header[5] << 16 | header[6] << 8 | header[7];
+    }
+    expect(len <= max_len, "the frame fits the server");
+    srv_read_all(fd, key, 4);
+    srv_read_all(fd, payload, len);
+    for (int i = 0; i < len; i++) {
+        payload[i] ^= key[i % 4];
+    }
+    return len;
+}
+
+static void srv_send_frame(int fd, uint8_t first_byte, const char *payload, int len)
+{
+    uint8_t header[10];
+    int header_len = 2;
+
+    header[0] = first_byte;
+    if (len <= 125) {
+        header[1] = len;
+    } else if (len < 65536) {
+        header[1] = 126;
+        header[2] = len >> 8;
+        header[3] = len;
+        header_len = 4;
+    } else {
+        header[1] = 127;
+        memset(header + 2, 0, 4);
+        header[6] = len >> 24;
+        header[7] = len >> 16;
+        header[8] = len >> 8;
+        header[9] = len;
+        header_len = 10;
+    }
+    srv_write_all(fd, header, header_len);
+    srv_write_all(fd, payload, len);
+}
+
+static void srv_send_close(int fd, int code)
+{
+    char payload[2] = { code >> 8, code };
+    srv_send_frame(fd, FIN | OP_CLOSE, payload, 2);
+}
+
+/* Read control frames until the close of the client, which is answered */
+static void srv_wait_close(int fd, int answer)
+{
+    static char payload[128];
+    uint8_t opcode;
+    int fin;
+
+    while (1) {
+        int len = srv_read_frame(fd, &opcode, &fin, payload, sizeof(payload));
+        if (opcode == OP_PONG) {
+            s_pongs++;
+            continue;
+        }
+        expect(opcode == OP_CLOSE && len == 2, "the client sends a close frame with a status code");
+        s_close_code = (uint8_t)payload[0] << 8 | (uint8_t)payload[1];
+        if (answer) {
+            srv_send_close(fd, s_close_code);
+        }
+        return;
+    }
+}
+
+/* Read a message of the client, answering nothing, returns its length or -1 on the close frame */
+static int srv_read_message(int fd, char *message, int max_len, uint8_t *message_opcode)
+{
+    static char control[128];
+    uint8_t opcode;
+    int fin, len = 0, fragments = 0;
+
+    do {
+        if (len == max_len) {
+            // Only the empty fragments ending a message may come
+            int rlen = srv_read_frame(fd, &opcode, &fin, control, sizeof(control));
+            expect(rlen == 0 && opcode == OP_CONT, "the message fits the server");
+            fragments++;
+            continue;
+        }
+        int rlen = srv_read_frame(fd, &opcode, &fin, message + len, max_len - len);
+        if (opcode == OP_PONG) {
+            expect(rlen == 6 && memcmp(message + len, "ping-", 5) == 0 && message[len + 5] == '0' + s_pongs % 10,
+                   "the PONG has the payload of its PING");
+            s_pongs++;
+            fin = 0;
+            continue;
+        }
+        if (opcode == OP_CLOSE) {
+            expect(rlen == 2 && fragments == 0, "the close frame is between messages");
+            s_close_code = (uint8_t)message[len] << 8 | (uint8_t)message[len + 1];
+            return -1;
+        }
+        if (fragments == 0) {
+            expect(opcode == OP_TEXT || opcode == OP_BINARY, "a message starts with a text or binary frame");
+            *message_opcode = opcode;
+        } else {
+            expect(opcode == OP_CONT, "the fragments after the first are continuation frames");
+        }
+        fragments++;
+        len += rlen;
+    } while (!fin);
+    s_fragments = fragments;
+    return len;
+}
+
+static void scenario_echo(int fd)
+{
+    static char message[TEST_LONG_MESSAGE];
+    uint8_t opcode;
+    int len;
+
+    while ((len = srv_read_message(fd, message, sizeof(message), &opcode)) >= 0) {
+        int sent = 0;
+        do {
+            int fragment = (len - sent > ECHO_FRAGMENT) ? ECHO_FRAGMENT : len - sent;
+            if (sent > 0) {
+                char ping[6] = { 'p', 'i', 'n', 'g', '-', '0' + s_pings % 10 };
+                srv_send_frame(fd, FIN | OP_PING, ping, sizeof(ping));
+                s_pings++;
+            }
+            srv_send_frame(fd, (sent == 0 ? opcode : OP_CONT) | (sent + fragment == len ? FIN : 0), message + sent, fragment);
+            sent += fragment;
+        } while (sent < len);
+    }
+    srv_send_close(fd, s_close_code);
+}
+
+static void scenario_server_close(int fd)
+{
+    char message[64];
+    uint8_t opcode;
+
+    expect(srv_read_message(fd, message, sizeof(message), &opcode) == 3, "the server gets the message");
+    srv_send_frame(fd, FIN | OP_PING, "ping-0", 6);
+    s_pings++;
+    srv_send_close(fd, 1001);
+    srv_wait_close(fd, 0);
+}
+
+static void scenario_too_big(int fd)
+{
+    static char message[4096];
+    uint8_t opcode;
+
+    expect(srv_read_message(fd, message, sizeof(message), &opcode) == 3, "the server gets the message");
+    fill_pattern(message, s_big_len, 3);
+    srv_send_frame(fd, OP_BINARY, message, 600);
+    srv_send_frame(fd, OP_CONT, message + 600, 600);
+    srv_send_frame(fd, FIN | OP_CONT, message + 1200, s_big_len - 1200);
+    srv_wait_close(fd, 0);
+}
+
+static void scenario_protocol_error(int fd)
+{
+    char message[64];
+    uint8_t opcode;
+
+    expect(srv_read_message(fd, message, sizeof(message), &opcode) == 3, "the server gets the message");
+    srv_send_frame(fd, FIN | OP_CONT, "out of a message", 16);
+    srv_wait_close(fd, 0);
+}
+
+static void scenario_slow(int fd)
+{
+    char message[200];
+    uint8_t opcode;
+
+    expect(srv_read_message(fd, message, sizeof(message), &opcode) == 3, "the server gets the message");
+    fill_pattern(message, sizeof(message), 5);
+    srv_send_frame(fd, OP_TEXT, message, 100);
+    srv_send_frame(fd, OP_CONT, message + 100, 0);
+    usleep(300 * 1000);
+    srv_send_frame(fd, FIN | OP_CONT, message + 100, 100);
+    srv_wait_close(fd, 1);
+}
+
+static void scenario_stream(int fd)
+{
+    static char fragment[BENCH_FRAGMENT + 4];
+    uint8_t opcode;
+    int fin, len = 0, n = 0;
+
+    // The message of the client is counted, not kept
+    do {
+        len += srv_read_frame(fd, &opcode, &fin, fragment, sizeof(fragment));
+        expect(opcode == (n++ ? OP_CONT : OP_BINARY), "the stream is a fragmented binary message");
+    } while (!fin);
+    expect(len == BENCH_MESSAGE, "the server gets the whole stream");
+    fill_pattern(fragment, BENCH_FRAGMENT, 7);
+    for (int sent = 0; sent < BENCH_MESSAGE; sent += BENCH_FRAGMENT) {
+        srv_send_frame(fd, (sent ? OP_CONT : OP_BINARY) | (sent + BENCH_FRAGMENT == BENCH_MESSAGE ? FIN : 0), fragment, BENCH_FRAGMENT);
+    }
+    srv_wait_close(fd, 1);
+}
+
+static void *server_task(void *arg)
+{
+    char request[2048];
+    char response[256];
+    char accept_value[40];
+    int len = 0;
+
+    int fd = accept(s_listen_fd, NULL, NULL);
+    expect(fd >= 0, "the server accepts the connection");
+    do {
+        int ret = read(fd, request + len, sizeof(request) - 1 - len);
+        expect(ret > 0, "the server reads the upgrade request");
+        len += ret;
+        request[len] = 0;
+    } while (strstr(request, "\r\n\r\n") == NULL);
+    expect(strncmp(request, "GET /ws HTTP/1.1\r\n", 18) == 0, "the request is for the path");
+    char *key = strcasestr(request, "Sec-WebSocket-Key:");
+    expect(key != NULL, "the request has a key");
+    key += strlen("Sec-WebSocket-Key:");
+    while (*key == ' ') {
+        key++;
+    }
+    *strstr(key, "\r\n") = 0;
+    accept_key(key, accept_value, sizeof(accept_value));
+    len = snprintf(response, sizeof(response), "HTTP/1.1 101 Switching Protocols\r\n"
+                   "Upgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n", accept_value);
+    srv_write_all(fd, response, len);
+
+    s_scenario(fd);
+    close(fd);
+    return NULL;
+}
+
+static esp_transport_handle_t connect_to(scenario_t scenario, esp_transport_handle_t *tcp)
+{
+    s_scenario = scenario;
+    s_fragments = s_pings = s_pongs = s_close_code = 0;
+    pthread_create(&s_server_thread, NULL, server_task, NULL);
+
+    *tcp = esp_transport_tcp_init();
+    esp_transport_handle_t ws = esp_transport_ws_init(*tcp);
+    esp_transport_ws_set_path(ws, "/ws");
+    expect(esp_transport_connect(ws, "127.0.0.1", s_port, TEST_TIMEOUT_MS) == 0, "the client connects");
+    return ws;
+}
+
+static void disconnect(esp_transport_handle_t ws, esp_transport_handle_t tcp)
+{
+    pthread_join(s_server_thread, NULL);
+    esp_transport_close(ws);
+    esp_transport_destroy(ws);
+    esp_transport_destroy(tcp);
+}
+
+static void test_handshake_key(void)
+{
+    char accept[40];
+
+    // The example of RFC 6455
+    accept_key("dGhlIHNhbXBsZSBub25jZQ==", accept, sizeof(accept));
+    expect(strcmp(accept, "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") == 0, "the accept key is the one of the RFC");
+}
+
+static void test_echo(void)
+{
+    static char data[TEST_LONG_MESSAGE], received[TEST_LONG_MESSAGE];
+    esp_transport_handle_t tcp;
+    esp_transport_handle_t ws = connect_to(scenario_echo, &tcp);
+    ws_transport_opcodes_t opcode;
+    bool fin;
+
+    // A message of one frame
+    expect(esp_transport_ws_send_raw(ws, WS_TRANSPORT_OPCODES_TEXT, "hello", 5, TEST_TIMEOUT_MS) == 5, "the message is sent");
+    expect(esp_transport_ws_recv_message(ws, received, sizeof(received), &opcode, TEST_TIMEOUT_MS) == 5, "the message comes back");
+    expect(opcode == WS_TRANSPORT_OPCODES_TEXT && memcmp(received, "hello", 5) == 0, "the message is the same");
+
+    // A long message sent in fragments comes back in fragments with PINGs between them
+    fill_pattern(data, sizeof(data), 1);
+    for (int sent = 0; sent < sizeof(data); sent += 1000) {
+        int len = (sizeof(data) - sent > 1000) ? 1000 : sizeof(data) - sent;
+        expect(esp_transport_ws_send_fragment(ws, WS_TRANSPORT_OPCODES_BINARY, data + sent, len, sent + len == sizeof(data), TEST_TIMEOUT_MS) == len,
+               "the fragment is sent");
+    }
+    int len = 0;
+    do {
+        int rlen = esp_transport_ws_recv(ws, received + len, 333, &opcode, &fin, TEST_TIMEOUT_MS);
+        expect(rlen > 0, "a part of the message is received");
+        expect(opcode == WS_TRANSPORT_OPCODES_BINARY, "the part is of a binary message");
+        len += rlen;
+        expect(fin == (len == sizeof(data)), "the message ends with its last part");
+    } while (!fin);
+    expect(s_fragments == (sizeof(data) + 999) / 1000, "the server gets the message in fragments");
+    expect(memcmp(received, data, sizeof(data)) == 0, "the streamed message is the same");
+
+    // The same message received whole
+    for (int sent = 0; sent < sizeof(data); sent += 4096) {
+        expect(esp_transport_ws_send_fragment(ws, WS_TRANSPORT_OPCODES_BINARY, data + sent, 4096, sent + 4096 == sizeof(data), TEST_TIMEOUT_MS) == 4096,
+               "the fragment is sent");
+    }
+    memset(received, 0, sizeof(received));
+    expect(esp_transport_ws_recv_message(ws, received, sizeof(received), &opcode, TEST_TIMEOUT_MS) == sizeof(data), "the message comes back whole");
+    expect(opcode == WS_TRANSPORT_OPCODES_BINARY && memcmp(received, data, sizeof(data)) == 0, "the whole message is the same");
+
+    // An empty message, a message ending with an empty fragment
+    expect(esp_transport_ws_send_fragment(ws, WS_TRANSPORT_OPCODES_TEXT, NULL, 0, true, TEST_TIMEOUT_MS) == 0, "the empty message is sent");
+    opcode = WS_TRANSPORT_OPCODES_CONT;
+    expect(esp_transport_ws_recv_message(ws, received, sizeof(received), &opcode, TEST_TIMEOUT_MS) == 0, "the empty message comes back");
+    expect(opcode == WS_TRANSPORT_OPCODES_TEXT, "the empty message is a text message");
+    expect(esp_transport_ws_send_fragment(ws, WS_TRANSPORT_OPCODES_TEXT, "ab", 2, false, TEST_TIMEOUT_MS) == 2, "the fragment is sent");
+    expect(esp_transport_ws_send_fragment(ws, WS_TRANSPORT_OPCODES_TEXT, NULL, 0, true, TEST_TIMEOUT_MS) == 0, "the empty fragment is sent");
+    expect(esp_transport_ws_recv_message(ws, received, sizeof(received), &opcode, TEST_TIMEOUT_MS) == 2, "the message comes back");
+    expect(s_fragments == 2, "the server gets the empty fragment");
+
+    // No message
+    expect(esp_transport_ws_recv_message(ws, received, sizeof(received), &opcode, 50) == 0, "no message comes");
+    expect(opcode == WS_TRANSPORT_OPCODES_CONT, "no message is told by the opcode");
+
+    // The closing handshake of the client
+    expect(esp_transport_ws_send_close(ws, 0, TEST_TIMEOUT_MS) == 2, "the close frame is sent");
+    expect(esp_transport_ws_recv(ws, received, sizeof(received), &opcode, &fin, TEST_TIMEOUT_MS) == -1, "the close of the server ends the connection");
+    expect(esp_transport_ws_get_close_code(ws) == 1000, "the server closes with the status of the client");
+    expect(esp_transport_ws_recv(ws, received, sizeof(received), &opcode, &fin, TEST_TIMEOUT_MS) == -1, "the connection stays closed");
+    disconnect(ws, tcp);
+    expect(s_close_code == 1000, "the client closes with the normal status");
+    expect(s_pings > 0 && s_pongs == s_pings, "every PING is answered");
+}
+
+static void test_server_close(void)
+{
+    esp_transport_handle_t tcp;
+    esp_transport_handle_t ws = connect_to(scenario_server_close, &tcp);
+    ws_transport_opcodes_t opcode;
+    char received[64];
+
+    expect(esp_transport_ws_send_raw(ws, WS_TRANSPORT_OPCODES_TEXT, "bye", 3, TEST_TIMEOUT_MS) == 3, "the message is sent");
+    expect(esp_transport_ws_recv_message(ws, received, sizeof(received), &opcode, TEST_TIMEOUT_MS) == -1, "the close of the server ends the connection");
+    expect(esp_transport_ws_get_close_code(ws) == 1001, "the status of the server is kept");
+    disconnect(ws, tcp);
+    expect(s_pongs == 1, "the PING before the close is answered");
+    expect(s_close_code == 1001, "the client answers with the status of the server");
+}
+
+static void test_too_big(int max_message_len, int buffer_len, int message_len)
+{
+    esp_transport_handle_t tcp;
+    s_big_len = message_len;
+    esp_transport_handle_t ws = connect_to(scenario_too_big, &tcp);
+    ws_transport_opcodes_t opcode;
+    char received[4096];
+
+    expect(esp_transport_ws_set_max_message_len(ws, max_message_len) == ESP_OK, "the limit is set");
+    expect(esp_transport_ws_send_raw(ws, WS_TRANSPORT_OPCODES_TEXT, "big", 3, TEST_TIMEOUT_MS) == 3, "the message is sent");
+    expect(esp_transport_ws_recv_message(ws, received, buffer_len, &opcode, TEST_TIMEOUT_MS) == -1, "the long message ends the connection");
+    expect(esp_transport_ws_get_close_code(ws) == 1009, "the connection is closed as the message is too big");
+    disconnect(ws, tcp);
+    expect(s_close_code == 1009, "the server gets the status of a message too big");
+}
+
+static void test_protocol_error(void)
+{
+    esp_transport_handle_t tcp;
+    esp_transport_handle_t ws = connect_to(scenario_protocol_error, &tcp);
+    ws_transport_opcodes_t opcode;
+    char received[64];
+    bool fin;
+
+    expect(esp_transport_ws_send_raw(ws, WS_TRANSPORT_OPCODES_TEXT, "err", 3, TEST_TIMEOUT_MS) == 3, "the message is sent");
+    expect(esp_transport_ws_recv(ws, received, sizeof(received), &opcode, &fin, TEST_TIMEOUT_MS) == -1, "the frame out of a message ends the connection");
+    expect(esp_transport_ws_get_close_code(ws) == 1002, "the connection is closed on an error of the protocol");
+    disconnect(ws, tcp);
+    expect(s_close_code == 1002, "the server gets the status of an error of the protocol");
+}
+
+static void test_slow(void)
+{
+    esp_transport_handle_t tcp;
+    esp_transport_handle_t ws = connect_to(scenario_slow, &tcp);
+    ws_transport_opcodes_t opcode;
+    char received[256], data[200];
+    int len, timeouts = 0;
+
+    fill_pattern(data, sizeof(data), 5);
+    expect(esp_transport_ws_send_raw(ws, WS_TRANSPORT_OPCODES_TEXT, "slo", 3, TEST_TIMEOUT_MS) == 3, "the message is sent");
+    while ((len = esp_transport_ws_recv_message(ws, received, sizeof(received), &opcode, 50)) == 0) {
+        expect(opcode == WS_TRANSPORT_OPCODES_CONT, "the message is not received yet");
+        timeouts++;
+    }
+    expect(timeouts > 1, "the calls time out in the middle of the message");
+    expect(len == 200 && opcode == WS_TRANSPORT_OPCODES_TEXT, "the message is received whole");
+    expect(memcmp(received, data, sizeof(data)) == 0, "the message is put together in the same buffer");
+    expect(esp_transport_ws_send_close(ws, 1000, TEST_TIMEOUT_MS) == 2, "the close frame is sent");
+    expect(esp_transport_ws_recv_message(ws, received, sizeof(received), &opcode, TEST_TIMEOUT_MS) == -1, "the close of the server ends the connection");
+    disconnect(ws, tcp);
+}
+
+static void bench(void)
+{
+    static char fragment[BENCH_FRAGMENT], expected[BENCH_FRAGMENT];
+    esp_transport_handle_t tcp;
+    esp_transport_handle_t ws = connect_to(scenario_stream, &tcp);
+    ws_transport_opcodes_t opcode;
+    bool fin = false;
+    int len = 0;
+
+    fill_pattern(fragment, sizeof(fragment), 9);
+    uint64_t start = bench_ns();
+    for (int sent = 0; sent < BENCH_MESSAGE; sent += BENCH_FRAGMENT) {
+        expect(esp_transport_ws_send_fragment(ws, WS_TRANSPORT_OPCODES_BINARY, fragment, BENCH_FRAGMENT, sent + BENCH_FRAGMENT == BENCH_MESSAGE,
+                                              TEST_TIMEOUT_MS) == BENCH_FRAGMENT, "the stream is sent");
+    }
+    uint64_t send_time = bench_ns() - start;
+
+    fill_pattern(expected, sizeof(expected), 7);
+    start = bench_ns();
+    while (!fin) {
+        int rlen = esp_transport_ws_recv(ws, fragment, sizeof(fragment), &opcode, &fin, TEST_TIMEOUT_MS);
+        expect(rlen > 0, "the stream is received");
+        expect(memcmp(fragment, expected + len % BENCH_FRAGMENT, rlen) == 0, "the stream is the one of the server");
+        len += rlen;
+    }
+    uint64_t recv_time = bench_ns() - start;
+    expect(len == BENCH_MESSAGE, "the whole stream is received");
+    esp_transport_ws_send_close(ws, 1000, TEST_TIMEOUT_MS);
+    expect(esp_transport_ws_recv(ws, fragment, sizeof(fragment), &opcode, &fin, TEST_TIMEOUT_MS) == -1, "the stream ends with the close");
+    disconnect(ws, tcp);
+
+    printf("%d kB message in %d B fragments: sent at %.0f MB/s, received at %.0f MB/s, %d B buffer on the client\n",
+           BENCH_MESSAGE / 1024, BENCH_FRAGMENT, BENCH_MESSAGE * 1000.0 / send_time, BENCH_MESSAGE * 1000.0 / recv_time, BENCH_FRAGMENT);
+}
+
+int main(void)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t addr_len = sizeof(addr);
+
+    s_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    expect(bind(s_listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0, "the server binds");
+    expect(listen(s_listen_fd, 4) == 0, "the server listens");
+    getsockname(s_listen_fd, (struct sockaddr *)&addr, &addr_len);
+    s_port = ntohs(addr.sin_port);
+
+    test_handshake_key();
+    test_echo();
+    test_server_close();
+    test_too_big(1000, 4096, 2000);
+    test_too_big(0, 1024, 1500);
+    test_protocol_error();
+    test_slow();
+    bench();
+    close(s_listen_fd);
+    printf("all websocket client checks passed\n");
+    return 0;
+}
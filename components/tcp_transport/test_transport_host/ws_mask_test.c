@@ -0,0 +1,401 @@
+// Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/*
+ * Check and measure the masking of the websocket transport. The masking of a word at a time is
+ * checked against masking a byte at a time, for every alignment of the source and destination,
+ * every offset into the key and the lengths around the word and unrolled loop sizes. Frames are
+ * then written over a transport which keeps what it is given, in writes it may take part of only:
+ * each has to hold the header and the masked payload, and the data of the caller has to be left
+ * as it is. Masked frames are read in parts of a few bytes, for the key to continue from part to
+ * part. At last frames of 64 bytes to 64 kB are written and read, with the former masking of a
+ * byte at a time in the data of the caller, unmasked again once written, and with the new one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+// The test reaches the static functions of the transport
+#include "../transport_ws.c"
+
+#define TEST_MAX_FRAME      (70 * 1024)
+#define TEST_SINK_SIZE      (TEST_MAX_FRAME + MAX_WEBSOCKET_HEADER_SIZE)
+#define BENCH_BYTES         (16 * 1024 * 1024)
+#define BENCH_RUNS          3
+
+typedef struct {
+    char *data;
+    int length;                 /*!< Bytes written to the sink, or left to read from it */
+    int position;               /*!< Next byte read from the sink */
+    int max_io;                 /*!< Most bytes taken or given by one write or read, 0 for no limit */
+    int keep;                   /*!< Whether writes are kept, or overwrite the start of the sink */
+} sink_t;
+
+static sink_t s_sink;
+
+static inline uint64_t bench_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void expect(int ok, const char *what)
+{
+    if (!ok) {
+        printf("check failed: %s\n", what);
+        exit(1);
+    }
+}
+
+static int sink_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms)
+{
+    if (s_sink.max_io && len > s_sink.max_io) {
+        len = s_sink.max_io;
+    }
+    if (s_sink.keep) {
+        expect(s_sink.length + len <= TEST_SINK_SIZE, "the frame fits the sink");
+        memcpy(s_sink.data + s_sink.length, buffer, len);
+        s_sink.length += len;
+    } else {
+        // Like the copy of the data into the buffers of the stack
+        memcpy(s_sink.data, buffer, len);
+    }
+    return len;
+}
+
+static int sink_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+{
+    if (len > s_sink.length - s_sink.position) {
+        len = s_sink.length - s_sink.position;
+    }
+    if (s_sink.max_io && len > s_sink.max_io) {
+        len = s_sink.max_io;
+    }
+    if (len <= 0) {
+        return -1;
+    }
+    memcpy(buffer, s_sink.data + s_sink.position, len);
+    s_sink.position += len;
+    return len;
+}
+
+static int sink_poll(esp_transport_handle_t t, int timeout_ms)
+{
+    return 1;
+}
+
+/* The masking of a byte at a time, the way the transport did it */
+static void mask_bytes(char *dst, const char *src, int len, const char *mask_key, int offset)
+{
+    for (int i = 0; i < len; i++) {
+        dst[i] = src[i] ^ mask_key[(offset + i) % 4];
+    }
+}
+
+/* The former write of a frame: masks the data of the caller, writes the header and the data, unmasks it */
+static int former_ws_write(esp_transport_handle_t t, int opcode, int mask_flag, const char *b, int len, int timeout_ms)
+{
+    transport_ws_t *ws = esp_transport_get_context_data(t);
+    char *buffer = (char *)b;
+    char ws_header[MAX_WEBSOCKET_HEADER_SIZE];
+    char *mask;
+    int header_len = 0, i;
+
+    if (esp_transport_poll_write(ws->parent, timeout_ms) <= 0) {
+        return -1;
+    }
+    ws_header[header_len++] = opcode;
+    if (len <= 125) {
+        ws_header[header_len++] = (uint8_t)(len | mask_flag);
+    } else if (len < 65536) {
+        ws_header[header_len++] = WS_SIZE16 | mask_flag;
+        ws_header[header_len++] = (uint8_t)(len >> 8);
+        ws_header[header_len++] = (uint8_t)(len & 0xFF);
+    } else {
+        ws_header[header_len++] = WS_SIZE64 | mask_flag;
+        memset(ws_header + header_len, 0, 4);
+        header_len += 4;
+        ws_header[header_len++] = (uint8_t)((len >> 24) & 0xFF);
+        ws_header[header_len++] = (uint8_t)((len >> 16) & 0xFF);
+        ws_header[header_len++] = (uint8_t)((len >> 8) & 0xFF);
+        ws_header[header_len++] = (uint8_t)((len >> 0) & 0xFF);
+    }
+    mask = &ws_header[header_len];
+    getrandom(ws_header + header_len, 4, 0);
+    header_len += 4;
+    for (i = 0; i < len; ++i) {
+        buffer[i] = (buffer[i] ^ mask[i % 4]);
+    }
+    if (esp_transport_write(ws->parent, ws_header, header_len, timeout_ms) != header_len) {
+        return -1;
+    }
+    int ret = esp_transport_write(ws->parent, buffer, len, timeout_ms);
+    for (i = 0; i < len; ++i) {
+        buffer[i] = (buffer[i] ^ mask[i % 4]);
+    }
+    return ret;
+}
+
+static void fill_random(char *data, int len)
+{
+    for (int i = 0; i < len; i++) {
+        data[i] = (char)rand();
+    }
+}
+
+static void test_mask_payload(void)
+{
+    static const char key[4] = { 0x37, (char)0xfa, 0x21, 0x3d };
+    char src[256 + 8], dst[256 + 8], ref[256 + 8];
+
+    fill_random(src, sizeof(src));
+    for (int len = 0; len <= 256; len += (len < 72) ? 1 : 61) {
+        for (int src_align = 0; src_align < 4; src_align++) {
+            for (int dst_align = 0; dst_align < 4; dst_align++) {
+                for (int offset = 0; offset < 8; offset++) {
+                    memset(dst, 0x55, sizeof(dst));
+                    memcpy(ref, dst, sizeof(ref));
+                    mask_bytes(ref + dst_align, src + src_align, len, key, offset);
+                    ws_mask_payload(dst + dst_align, src + src_align, len, key, offset);
+                    expect(memcmp(dst, ref, sizeof(dst)) == 0, "the payload is masked as a byte at a time");
+                }
+            }
+            for (int offset = 0; offset < 4; offset++) {
+                memcpy(dst, src, sizeof(dst));
+                mask_bytes(ref, src, sizeof(ref), key, 0);
+                memcpy(ref, src, src_align);
+                mask_bytes(ref + src_align, src + src_align, len, key, offset);
+                memcpy(ref + src_align + len, src + src_align + len, sizeof(ref) - src_align - len);
+                ws_mask_payload(dst + src_align, dst + src_align, len, key, offset);
+                expect(memcmp(dst, ref, sizeof(dst)) == 0, "the payload is masked in place");
+            }
+        }
+    }
+}
+
+static esp_transport_handle_t new_ws(esp_transport_handle_t *parent)
+{
+    *parent = esp_transport_init();
+    esp_transport_set_func(*parent, NULL, sink_read, sink_write, NULL, sink_poll, sink_poll, NULL);
+    esp_transport_handle_t ws = esp_transport_ws_init(*parent);
+    expect(ws != NULL, "the websocket transport is created");
+    return ws;
+}
+
+static void test_write(void)
+{
+    static const int lengths[] = { 0, 1, 3, 125, 126, 1000, 1009, 1010, 1011, 4096, 65535, 65536, 70000 };
+    esp_transport_handle_t parent;
+    esp_transport_handle_t ws = new_ws(&parent);
+    char *data = malloc(TEST_MAX_FRAME + 4);
+    char *copy = malloc(TEST_MAX_FRAME + 4);
+    char *payload = malloc(TEST_MAX_FRAME);
+
+    s_sink.data = malloc(TEST_SINK_SIZE);
+    s_sink.keep = 1;
+    fill_random(data, TEST_MAX_FRAME + 4);
+    memcpy(copy, data, TEST_MAX_FRAME + 4);
+    for (int n = 0; n < sizeof(lengths) / sizeof(lengths[0]); n++) {
+        for (int align = 0; align < 4; align++) {
+            for (int max_io = 0; max_io <= 500; max_io += 250) {
+                int len = lengths[n];
+                s_sink.length = 0;
+                s_sink.max_io = max_io;
+                int ret = (len == 0) ? esp_transport_ws_send_raw(ws, WS_TRANSPORT_OPCODES_PING, NULL, 0, 0)
+                                     : esp_transport_write(ws, data + align, len, 0);
+                expect(ret == len, "the frame is written");
+                expect(memcmp(data, copy, TEST_MAX_FRAME + 4) == 0, "the data of the caller is not changed");
+
+                const uint8_t *h = (const uint8_t *)s_sink.data;
+                int header_len = 2, frame_len = h[1] & 0x7f;
+                expect(h[0] == (WS_FIN | (len ? WS_OPCODE_BINARY : WS_OPCODE_PING)), "the opcode is written");
+                expect(h[1] & WS_MASK, "the frame is masked");
+                if (frame_len == WS_SIZE16) {
+                    frame_len = h[2] << 8 | h[3];
+                    header_len += 2;
+                } else if (frame_len == WS_SIZE64) {
+                    frame_len = h[6] << 24 | h[7] << 16 | h[8] << 8 | h[9];
+                    header_len += 8;
+                }
+                expect(frame_len == len, "the length is written");
+                expect(s_sink.length == header_len + 4 + len, "the header, the key and the payload are written");
+                mask_bytes(payload, s_sink.data + header_len + 4, len, s_sink.data + header_len, 0);
+                expect(memcmp(payload, data + align, len) == 0, "the payload unmasks to the data");
+            }
+        }
+    }
+    s_sink.max_io = 0;
+    esp_transport_destroy(ws);
+    esp_transport_destroy(parent);
+    free(s_sink.data);
+    free(payload);
+    free(copy);
+    free(data);
+}
+
+/* Put a frame from the server in the sink, masked with key if it is not NULL */
+static int put_frame(char *frame, const char *data, int len, const char *key)
+{
+    int header_len = 0;
+
+    frame[header_len++] = WS_FIN | WS_OPCODE_BINARY;
+    if (len <= 125) {
+        frame[header_len++] = (uint8_t)len | (key ? WS_MASK : 0);
+    } else if (len < 65536) {
+        frame[header_len++] = WS_SIZE16 | (key ? WS_MASK : 0);
+        frame[header_len++] = (uint8_t)(len >> 8);
+        frame[header_len++] = (uint8_t)len;
+    } else {
+        frame[header_len++] = WS_SIZE64 | (key ? WS_MASK : 0);
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            frame[header_len++] = (shift < 32) ? (uint8_t)(len >> shift) : 0;
+        }
+    }
+    if (key) {
+        memcpy(frame + header_len, key, 4);
+        header_len += 4;
+        mask_bytes(frame + header_len, data, len, key, 0);
+    } else {
+        memcpy(frame + header_len, data, len);
+    }
+    return header_len + len;
+}
+
+static void test_read(void)
+{
+    static const char key[4] = { 0x11, 0x5e, (char)0xa7, 0x42 };
+    static const int lengths[] = { 1, 5, 125, 126, 1000, 4099, 65536 };
+    esp_transport_handle_t parent;
+    esp_transport_handle_t ws = new_ws(&parent);
+    static char data[65536], frame[65536 + MAX_WEBSOCKET_HEADER_SIZE], payload[65536 + 4];
+
+    s_sink.data = frame;
+    fill_random(data, sizeof(data));
+    for (int n = 0; n < sizeof(lengths) / sizeof(lengths[0]); n++) {
+        for (int masked = 0; masked < 2; masked++) {
+            for (int read_len = 5; read_len <= 41; read_len += 9) {
+                int len = lengths[n];
+                s_sink.length = put_frame(frame, data, len, masked ? key : NULL);
+                s_sink.position = 0;
+                // Reads of 9 bytes at most, the transport reads each part of the header in one
+                s_sink.max_io = 9;
+                int got = 0;
+                while (got < len) {
+                    int rlen = esp_transport_read(ws, payload + got, read_len, 0);
+                    expect(rlen > 0, "a part of the payload is read");
+                    got += rlen;
+                }
+                expect(got == len, "the payload is read to its end");
+                expect(s_sink.position == s_sink.length, "the frame is read to its end");
+                expect(memcmp(payload, data, len) == 0, "the payload read in parts is unmasked");
+            }
+        }
+    }
+    s_sink.max_io = 0;
+    esp_transport_destroy(ws);
+    esp_transport_destroy(parent);
+}
+
+static void bench(void)
+{
+    static const int lengths[] = { 64, 256, 1024, 4096, 16384, 65536 };
+    esp_transport_handle_t parent;
+    esp_transport_handle_t ws = new_ws(&parent);
+    char *data = malloc(65536);
+    char *frame = malloc(65536 + MAX_WEBSOCKET_HEADER_SIZE);
+    char *payload = malloc(65536);
+    static const char key[4] = { 0x4d, 0x19, (char)0xc3, 0x7e };
+
+    fill_random(data, 65536);
+    s_sink.data = malloc(TEST_SINK_SIZE);
+    s_sink.keep = 0;
+    printf("frame     write former  write new    read former  read new   (ns per frame, MB/s)\n");
+    for (int n = 0; n < sizeof(lengths) / sizeof(lengths[0]); n++) {
+        int len = lengths[n];
+        int frames = BENCH_BYTES / len;
+        uint64_t best[4] = { UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX };
+
+        for (int run = 0; run < BENCH_RUNS; run++) {
+            for (int way = 0; way < 2; way++) {
+                uint64_t start = bench_ns();
+                for (int i = 0; i < frames; i++) {
+                    int ret = way ? _ws_write(ws, WS_OPCODE_BINARY | WS_FIN, WS_MASK, data, len, 0)
+                                  : former_ws_write(ws, WS_OPCODE_BINARY | WS_FIN, WS_MASK, data, len, 0);
+                    expect(ret == len, "the bench frame is written");
+                }
+                uint64_t time = bench_ns() - start;
+                if (time < best[way]) {
+                    best[way] = time;
+                }
+            }
+            // Reads of the payload of a masked frame into a buffer of the length of the frame
+            char *sink_data = s_sink.data;
+            s_sink.data = frame;
+            s_sink.length = put_frame(frame, data, len, key);
+            for (int way = 0; way < 2; way++) {
+                uint64_t start = bench_ns();
+                for (int i = 0; i < frames; i++) {
+                    s_sink.position = 0;
+                    int rlen;
+                    if (way) {
+                        rlen = esp_transport_read(ws, payload, len, 0);
+                    } else {
+                        transport_ws_t *ws_data = esp_transport_get_context_data(ws);
+                        expect(ws_read_header(ws, 0) == 1, "the bench header is read");
+                        rlen = esp_transport_read(parent, payload, len, 0);
+                        ws_data->frame_state.bytes_remaining -= rlen;
+                        for (int b = 0; b < rlen; b++) {
+                            payload[b] = (payload[b] ^ ws_data->frame_state.mask_key[b % 4]);
+                        }
+                    }
+                    expect(rlen == len, "the bench frame is read");
+                }
+                uint64_t time = bench_ns() - start;
+                if (time < best[2 + way]) {
+                    best[2 + way] = time;
+                }
+                expect(memcmp(payload, data, len) == 0, "the bench frame is unmasked");
+            }
+            s_sink.data = sink_data;
+        }
+        printf("%5d B", len);
+        for (int way = 0; way < 4; way++) {
+            printf("  %7.0f %5.0f", (double)best[way] / frames, (double)len * frames * 1000.0 / best[way]);
+        }
+        printf("\n");
+    }
+    esp_transport_destroy(ws);
+    esp_transport_destroy(parent);
+    free(s_sink.data);
+    free(payload);
+    free(frame);
+    free(data);
+}
+
+int main(void)
+{
+    srand(1);
+    test_mask_payload();
+    test_write();
+    test_read();
+    bench();
+    printf("all websocket masking checks passed\n");
+    return 0;
+}
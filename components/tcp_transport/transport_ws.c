@@ -1,4 +1,6 @@
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
 #include <ctype.h>
 #include <sys/random.h>
@@ -27,15 +29,31 @@ static const char *TAG = "TRANSPORT_WS";
 #define WS_SIZE64         127
 #define MAX_WEBSOCKET_HEADER_SIZE 16
 #define WS_RESPONSE_OK    101
+#define WS_OPCODE_CONTROL 0x08
+#define WS_MAX_CONTROL_PAYLOAD 125
+
+// Status codes of close frames
+#define WS_CLOSE_NORMAL           1000
+#define WS_CLOSE_PROTOCOL_ERROR   1002
+#define WS_CLOSE_NO_STATUS        1005
+#define WS_CLOSE_TOO_BIG          1009
 
 
 typedef struct {
     uint8_t opcode;
+    bool fin;                           /*!< Whether the frame is the last of its message */
+    bool masked;                        /*!< Whether the payload is masked */
     char mask_key[4];                   /*!< Mask key for this payload */
     int payload_len;                    /*!< Total length of the payload */
     int bytes_remaining;                /*!< Bytes left to read of the payload  */
 } ws_transport_frame_state_t;
 
+typedef struct {
+    uint8_t opcode;                     /*!< Opcode of the message being received, 0 between messages */
+    int len;                            /*!< Bytes of the message announced by its frames so far */
+    int received;                       /*!< Bytes of the message returned by esp_transport_ws_recv_message() so far */
+} ws_transport_message_state_t;
+
 typedef struct {
     char *path;
     char *buffer;
@@ -43,9 +61,89 @@ typedef struct {
     char *user_agent;
     char *headers;
     ws_transport_frame_state_t frame_state;
+    ws_transport_message_state_t message_state;
+    int max_message_len;                /*!< Longest message received, 0 for no limit */
+    bool send_continued;                /*!< Whether the message being sent has fragments to come */
+    bool close_sent;                    /*!< Whether a close frame was sent */
+    int close_code;                     /*!< Status code the connection was closed with, 0 while it is open */
+    char control_payload[WS_MAX_CONTROL_PAYLOAD];
     esp_transport_handle_t parent;
 } transport_ws_t;
 
+/* Word the payload is masked by, the cores fault on loads of words from unaligned addresses,
+   so it is only loaded and stored at aligned ones */
+typedef uint32_t __attribute__((__may_alias__)) ws_mask_word_t;
+
+/**
+ * Mask len bytes of a payload from src into dst, which may be src, from byte `offset` of the payload.
+ * The bytes are masked a word at a time once dst is aligned, if src is aligned as dst is,
+ * and the head and tail of the payload a byte at a time.
+ */
+static void ws_mask_payload(char *dst, const char *src, int len, const char *mask_key, int offset)
+{
+    uint8_t *d = (uint8_t *)dst;
+    const uint8_t *s = (const uint8_t *)src;
+    const uint8_t *key = (const uint8_t *)mask_key;
+    int i = 0;
+
+    while (i < len && ((uintptr_t)(d + i) & 3)) {
+        d[i] = s[i] ^ key[(offset + i) & 3];
+        i++;
+    }
+    if ((((uintptr_t)d ^ (uintptr_t)s) & 3) == 0 && len - i >= 4) {
+        uint8_t key_bytes[4];
+        ws_mask_word_t mask;
+
+        // The key rotated to the first aligned byte, in the order of the bytes in memory
+        for (int k = 0; k < 4; k++) {
+            key_bytes[k] = key[(offset + i + k) & 3];
+        }
+        memcpy(&mask, key_bytes, sizeof(mask));
+        for (; i + 16 <= len; i += 16) {
+            ws_mask_word_t *dw = (ws_mask_word_t *)(d + i);
+            const ws_mask_word_t *sw = (const ws_mask_word_t *)(s + i);
+            dw[0] = sw[0] ^ mask;
+            dw[1] = sw[1] ^ mask;
+            dw[2] = sw[2] ^ mask;
+            dw[3] = sw[3] ^ mask;
+        }
+        for (; i + 4 <= len; i += 4) {
+            *(ws_mask_word_t *)(d + i) = *(const ws_mask_word_t *)(s + i) ^ mask;
+        }
+    }
+    for (; i < len; i++) {
+        d[i] = s[i] ^ key[(offset + i) & 3];
+    }
+}
+
+static int ws_read_all(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+{
+    int rlen = 0;
+
+    while (rlen < len) {
+        int ret = esp_transport_read(t, buffer + rlen, len - rlen, timeout_ms);
+        if (ret <= 0) {
+            return ret;
+        }
+        rlen += ret;
+    }
+    return rlen;
+}
+
+static int ws_write_all(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms)
+{
+    int written = 0;
+
+    while (written < len) {
+        int ret = esp_transport_write(t, buffer + written, len - written, timeout_ms);
+        if (ret <= 0) {
+            return ret;
+        }
+        written += ret;
+    }
+    return written;
+}
+
 static inline uint8_t ws_get_bin_opcode(ws_transport_opcodes_t opcode)
 {
     return (uint8_t)opcode;
@@ -101,6 +199,13 @@ static char *get_http_header(const char *buffer, const char *key)
 static int ws_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms)
 {
     transport_ws_t *ws = esp_transport_get_context_data(t);
+
+    // The connection starts between frames and messages
+    memset(&ws->frame_state, 0, sizeof(ws->frame_state));
+    memset(&ws->message_state, 0, sizeof(ws->message_state));
+    ws->send_continued = false;
+    ws->close_sent = false;
+    ws->close_code = 0;
     if (esp_transport_connect(ws->parent, host, port, timeout_ms) < 0) {
         ESP_LOGE(TAG, "Error connecting to host %s:%d", host, port);
         return -1;
@@ -205,10 +310,9 @@ static int ws_connect(esp_transport_handle_t t, const char *host, int port, int
 static int _ws_write(esp_transport_handle_t t, int opcode, int mask_flag, const char *b, int len, int timeout_ms)
 {
     transport_ws_t *ws = esp_transport_get_context_data(t);
-    char *buffer = (char *)b;
     char ws_header[MAX_WEBSOCKET_HEADER_SIZE];
     char *mask;
-    int header_len = 0, i;
+    int header_len = 0;
 
     int poll_write;
     if ((poll_write = esp_transport_poll_write(ws->parent, timeout_ms)) <= 0) {
@@ -236,34 +340,46 @@ static int _ws_write(esp_transport_handle_t t, int opcode, int mask_flag, const
         ws_header[header_len++] = (uint8_t)((len >> 0) & 0xFF);
     }
 
-    if (mask_flag) {
-        mask = &ws_header[header_len];
-        getrandom(ws_header + header_len, 4, 0);
-        header_len += 4;
-
-        for (i = 0; i < len; ++i) {
-            buffer[i] = (buffer[i] ^ mask[i % 4]);
+    if (!mask_flag) {
+        if (esp_transport_write(ws->parent, ws_header, header_len, timeout_ms) != header_len) {
+            ESP_LOGE(TAG, "Error write header");
+            return -1;
+        }
+        if (len == 0) {
+            return 0;
         }
+        return esp_transport_write(ws->parent, b, len, timeout_ms);
     }
 
-    if (esp_transport_write(ws->parent, ws_header, header_len, timeout_ms) != header_len) {
-        ESP_LOGE(TAG, "Error write header");
-        return -1;
-    }
-    if (len == 0) {
-        return 0;
-    }
+    mask = &ws_header[header_len];
+    getrandom(ws_header + header_len, 4, 0);
+    header_len += 4;
 
-    int ret = esp_transport_write(ws->parent, buffer, len, timeout_ms);
-    // in case of masked transport we have to revert back to the original data, as ws layer
-    // does not create its own copy of data to be sent
-    if (mask_flag) {
-        mask = &ws_header[header_len-4];
-        for (i = 0; i < len; ++i) {
-            buffer[i] = (buffer[i] ^ mask[i % 4]);
+    // The payload is masked into the buffer of the transport, the data of the caller is left as it is.
+    // The header goes out with the first part of the payload, the parts after it fill the buffer.
+    int sent = 0;
+    do {
+        int part_len = (sent == 0) ? header_len : 0;
+        // The part starts in the buffer where its payload is as aligned as in the data of the caller,
+        // for the payload to be masked a word at a time
+        int start = (int)(((uintptr_t)(b + sent) - (uintptr_t)ws->buffer - part_len) & 3);
+        char *part = ws->buffer + start;
+        int payload_len = len - sent;
+        if (payload_len > DEFAULT_WS_BUFFER - start - part_len) {
+            payload_len = DEFAULT_WS_BUFFER - start - part_len;
         }
-    }
-    return ret;
+        if (sent == 0) {
+            memcpy(part, ws_header, header_len);
+        }
+        ws_mask_payload(part + part_len, b + sent, payload_len, mask, sent);
+        part_len += payload_len;
+        if (ws_write_all(ws->parent, part, part_len, timeout_ms) != part_len) {
+            ESP_LOGE(TAG, "Error write %s", sent ? "data" : "header");
+            return -1;
+        }
+        sent += payload_len;
+    } while (sent < len);
+    return len;
 }
 
 int esp_transport_ws_send_raw(esp_transport_handle_t t, ws_transport_opcodes_t opcode, const char *b, int len, int timeout_ms)
@@ -296,6 +412,7 @@ static int ws_read_payload(esp_transport_handle_t t, char *buffer, int len, int
 
     int bytes_to_read;
     int rlen = 0;
+    int offset = ws->frame_state.payload_len - ws->frame_state.bytes_remaining;
 
     if (ws->frame_state.bytes_remaining > len) {
         ESP_LOGD(TAG, "Actual data to receive (%d) are longer than ws buffer (%d)", ws->frame_state.bytes_remaining, len);
@@ -307,85 +424,75 @@ static int ws_read_payload(esp_transport_handle_t t, char *buffer, int len, int
 
     // Receive and process payload
     if (bytes_to_read != 0 && (rlen = esp_transport_read(ws->parent, buffer, bytes_to_read, timeout_ms)) <= 0) {
-        ESP_LOGE(TAG, "Error read data");
+        if (rlen < 0) {
+            ESP_LOGE(TAG, "Error read data");
+        }
         return rlen;
     }
     ws->frame_state.bytes_remaining -= rlen;
 
-    if (ws->frame_state.mask_key) {
-        for (int i = 0; i < bytes_to_read; i++) {
-            buffer[i] = (buffer[i] ^ ws->frame_state.mask_key[i % 4]);
-        }
+    if (ws->frame_state.masked) {
+        // The key continues from where the last read of the payload stopped
+        ws_mask_payload(buffer, buffer, rlen, ws->frame_state.mask_key, offset);
     }
     return rlen;
 }
 
 
-/* Read and parse the WS header, determine length of payload */
-static int ws_read_header(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+/* Read and parse the header of the next frame, returns 1 once it is read, 0 if no frame came within timeout_ms */
+static int ws_read_header(esp_transport_handle_t t, int timeout_ms)
 {
     transport_ws_t *ws = esp_transport_get_context_data(t);
-    int payload_len;
-
-    char ws_header[MAX_WEBSOCKET_HEADER_SIZE];
-    char *data_ptr = ws_header, mask;
-    int rlen;
+    uint8_t ws_header[MAX_WEBSOCKET_HEADER_SIZE];
+    uint32_t payload_len;
     int poll_read;
+
     if ((poll_read = esp_transport_poll_read(ws->parent, timeout_ms)) <= 0) {
         return poll_read;
     }
 
-    // Receive and process header first (based on header size)
-    int header = 2;
-    int mask_len = 4;
-    if ((rlen = esp_transport_read(ws->parent, data_ptr, header, timeout_ms)) <= 0) {
+    // The parts of the header are read whole, a frame begun is not left in the middle of its header
+    if (ws_read_all(ws->parent, (char *)ws_header, 2, timeout_ms) != 2) {
         ESP_LOGE(TAG, "Error read data");
-        return rlen;
+        return -1;
     }
-    ws->frame_state.opcode = (*data_ptr & 0x0F);
-    data_ptr ++;
-    mask = ((*data_ptr >> 7) & 0x01);
-    payload_len = (*data_ptr & 0x7F);
-    data_ptr++;
-    ESP_LOGD(TAG, "Opcode: %d, mask: %d, len: %d\r\n", ws->frame_state.opcode, mask, payload_len);
-    if (payload_len == 126) {
-        // headerLen += 2;
-        if ((rlen = esp_transport_read(ws->parent, data_ptr, header, timeout_ms)) <= 0) {
+    ws->frame_state.fin = (ws_header[0] & WS_FIN) != 0;
+    ws->frame_state.opcode = (ws_header[0] & 0x0F);
+    ws->frame_state.masked = (ws_header[1] & WS_MASK) != 0;
+    payload_len = (ws_header[1] & 0x7F);
+    ESP_LOGD(TAG, "Opcode: %d, fin: %d, mask: %d, len: %d\r\n", ws->frame_state.opcode, ws->frame_state.fin, ws->frame_state.masked, payload_len);
+    if (payload_len == WS_SIZE16) {
+        if (ws_read_all(ws->parent, (char *)ws_header + 2, 2, timeout_ms) != 2) {
             ESP_LOGE(TAG, "Error read data");
-            return rlen;
+            return -1;
         }
-        payload_len = data_ptr[0] << 8 | data_ptr[1];
-    } else if (payload_len == 127) {
-        // headerLen += 8;
-        header = 8;
-        if ((rlen = esp_transport_read(ws->parent, data_ptr, header, timeout_ms)) <= 0) {
+        payload_len = ws_header[2] << 8 | ws_header[3];
+    } else if (payload_len == WS_SIZE64) {
+        if (ws_read_all(ws->parent, (char *)ws_header + 2, 8, timeout_ms) != 8) {
             ESP_LOGE(TAG, "Error read data");
-            return rlen;
+            return -1;
         }
-
-        if (data_ptr[0] != 0 || data_ptr[1] != 0 || data_ptr[2] != 0 || data_ptr[3] != 0) {
-            // really too big!
-            payload_len = 0xFFFFFFFF;
-        } else {
-            payload_len = data_ptr[4] << 24 | data_ptr[5] << 16 | data_ptr[6] << 8 | data_ptr[7];
+        if (ws_header[2] != 0 || ws_header[3] != 0 || ws_header[4] != 0 || ws_header[5] != 0 || (ws_header[6] & 0x80)) {
+            ESP_LOGE(TAG, "Frame too long");
+            return -1;
         }
+        payload_len = (uint32_t)ws_header[6] << 24 | ws_header[7] << 16 | ws_header[8] << 8 | ws_header[9];
     }
 
-    if (mask) {
-        // Read and store mask
-        if (payload_len != 0 && (rlen = esp_transport_read(ws->parent, buffer, mask_len, timeout_ms)) <= 0) {
+    if (ws->frame_state.masked) {
+        // The key is sent with every masked frame, with an empty payload too
+        if (ws_read_all(ws->parent, ws->frame_state.mask_key, 4, timeout_ms) != 4) {
             ESP_LOGE(TAG, "Error read data");
-            return rlen;
+            return -1;
         }
-        memcpy(ws->frame_state.mask_key, buffer, mask_len);
     } else {
-        memset(ws->frame_state.mask_key, 0, mask_len);
+        memset(ws->frame_state.mask_key, 0, sizeof(ws->frame_state.mask_key));
     }
 
     ws->frame_state.payload_len = payload_len;
     ws->frame_state.bytes_remaining = payload_len;
 
-    return payload_len;
+    return 1;
 }
 
 static int ws_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
@@ -395,11 +502,12 @@ static int ws_read(esp_transport_handle_t t, char *buffer, int len, int timeout_
 
     // If message exceeds buffer len then subsequent reads will skip reading header and read whatever is left of the payload
     if (ws->frame_state.bytes_remaining <= 0) {
-        if ( (rlen = ws_read_header(t, buffer, len, timeout_ms)) <= 0) {
+        if ( (rlen = ws_read_header(t, timeout_ms)) <= 0) {
             // If something when wrong then we prepare for reading a new header
             ws->frame_state.bytes_remaining = 0;
             return rlen;
         }
+        rlen = 0;
     }
     if (ws->frame_state.payload_len) {
         if ( (rlen = ws_read_payload(t, buffer, len, timeout_ms)) <= 0) {
@@ -412,6 +520,232 @@ static int ws_read(esp_transport_handle_t t, char *buffer, int len, int timeout_
     return rlen;
 }
 
+static int ws_send_close(esp_transport_handle_t t, int status_code, int timeout_ms)
+{
+    transport_ws_t *ws = esp_transport_get_context_data(t);
+    char payload[2] = { (char)(status_code >> 8), (char)status_code };
+
+    ws->close_sent = true;
+    return _ws_write(t, WS_OPCODE_CLOSE | WS_FIN, WS_MASK, payload, sizeof(payload), timeout_ms);
+}
+
+/* Fail the connection on a frame breaking the protocol, or a message over the limit */
+static int ws_fail(esp_transport_handle_t t, int status_code, int timeout_ms)
+{
+    transport_ws_t *ws = esp_transport_get_context_data(t);
+
+    if (!ws->close_sent) {
+        ws_send_close(t, status_code, timeout_ms);
+    }
+    // The rest of the frame is not read, the connection is over
+    ws->close_code = status_code;
+    ws->frame_state.bytes_remaining = 0;
+    ws->message_state.opcode = 0;
+    return -1;
+}
+
+/* Read the payload of a control frame and answer it, returns -1 once the connection is closed */
+static int ws_handle_control_frame(esp_transport_handle_t t, int timeout_ms)
+{
+    transport_ws_t *ws = esp_transport_get_context_data(t);
+    int len = ws->frame_state.payload_len;
+
+    if (!ws->frame_state.fin || len > WS_MAX_CONTROL_PAYLOAD) {
+        ESP_LOGE(TAG, "Control frame fragmented or too long (%d)", len);
+        return ws_fail(t, WS_CLOSE_PROTOCOL_ERROR, timeout_ms);
+    }
+    if (ws_read_all(ws->parent, ws->control_payload, len, timeout_ms) != len) {
+        ESP_LOGE(TAG, "Error read control frame");
+        ws->frame_state.bytes_remaining = 0;
+        return -1;
+    }
+    ws->frame_state.bytes_remaining = 0;
+    if (ws->frame_state.masked) {
+        ws_mask_payload(ws->control_payload, ws->control_payload, len, ws->frame_state.mask_key, 0);
+    }
+
+    switch (ws->frame_state.opcode) {
+    case WS_OPCODE_PING:
+        ESP_LOGD(TAG, "Received PING, sending PONG");
+        if (!ws->close_sent && _ws_write(t, WS_OPCODE_PONG | WS_FIN, WS_MASK, ws->control_payload, len, timeout_ms) != len) {
+            ESP_LOGE(TAG, "Error write PONG");
+            return -1;
+        }
+        return 0;
+    case WS_OPCODE_PONG:
+        return 0;
+    case WS_OPCODE_CLOSE:
+        ws->close_code = (len >= 2) ? ((uint8_t)ws->control_payload[0] << 8 | (uint8_t)ws->control_payload[1]) : WS_CLOSE_NO_STATUS;
+        ESP_LOGD(TAG, "Received CLOSE, status %d", ws->close_code);
+        if (!ws->close_sent) {
+            // The status of the server is sent back, the server closes the connection then
+            ws_send_close(t, (ws->close_code == WS_CLOSE_NO_STATUS) ? WS_CLOSE_NORMAL : ws->close_code, timeout_ms);
+        }
+        ws->message_state.opcode = 0;
+        return -1;
+    default:
+        ESP_LOGE(TAG, "Unknown control opcode %d", ws->frame_state.opcode);
+        return ws_fail(t, WS_CLOSE_PROTOCOL_ERROR, timeout_ms);
+    }
+}
+
+/* Read headers until the next frame of a message, answering the control frames before it,
+   returns 1 once it is read, 0 if no frame came within timeout_ms */
+static int ws_read_data_header(esp_transport_handle_t t, int timeout_ms)
+{
+    transport_ws_t *ws = esp_transport_get_context_data(t);
+    int ret;
+
+    while (true) {
+        if ((ret = ws_read_header(t, timeout_ms)) <= 0) {
+            return ret;
+        }
+        if (ws->frame_state.opcode & WS_OPCODE_CONTROL) {
+            if ((ret = ws_handle_control_frame(t, timeout_ms)) < 0) {
+                return ret;
+            }
+            continue;
+        }
+        if (ws->frame_state.opcode == WS_OPCODE_CONT) {
+            if (ws->message_state.opcode == 0) {
+                ESP_LOGE(TAG, "Continuation frame out of a message");
+                return ws_fail(t, WS_CLOSE_PROTOCOL_ERROR, timeout_ms);
+            }
+        } else if (ws->frame_state.opcode == WS_OPCODE_TEXT || ws->frame_state.opcode == WS_OPCODE_BINARY) {
+            if (ws->message_state.opcode != 0) {
+                ESP_LOGE(TAG, "New message before the end of the last one");
+                return ws_fail(t, WS_CLOSE_PROTOCOL_ERROR, timeout_ms);
+            }
+            ws->message_state.opcode = ws->frame_state.opcode;
+            ws->message_state.len = 0;
+            ws->message_state.received = 0;
+        } else {
+            ESP_LOGE(TAG, "Unknown opcode %d", ws->frame_state.opcode);
+            return ws_fail(t, WS_CLOSE_PROTOCOL_ERROR, timeout_ms);
+        }
+        if (ws->max_message_len && ws->frame_state.payload_len > ws->max_message_len - ws->message_state.len) {
+            ESP_LOGE(TAG, "Message longer than %d bytes", ws->max_message_len);
+            return ws_fail(t, WS_CLOSE_TOO_BIG, timeout_ms);
+        }
+        ws->message_state.len += ws->frame_state.payload_len;
+        return 1;
+    }
+}
+
+int esp_transport_ws_recv(esp_transport_handle_t t, char *buffer, int len, ws_transport_opcodes_t *opcode, bool *fin, int timeout_ms)
+{
+    if (t == NULL) {
+        ESP_LOGE(TAG, "Transport must be a valid ws handle");
+        return -1;
+    }
+    transport_ws_t *ws = esp_transport_get_context_data(t);
+    int rlen = 0;
+
+    *opcode = WS_TRANSPORT_OPCODES_CONT;
+    *fin = false;
+    if (ws->close_code) {
+        return -1;
+    }
+    // Reads of a frame are done once its payload is, and its last read ended the message if the frame was final.
+    // Empty fragments before the last one are skipped, 0 is returned only on a timeout or at the end of a message
+    while (ws->frame_state.bytes_remaining <= 0) {
+        if ((rlen = ws_read_data_header(t, timeout_ms)) <= 0) {
+            return rlen;
+        }
+        rlen = 0;
+        if (ws->frame_state.payload_len > 0 || ws->frame_state.fin) {
+            break;
+        }
+    }
+    *opcode = ws->message_state.opcode;
+    if (ws->frame_state.bytes_remaining > 0 && (rlen = ws_read_payload(t, buffer, len, timeout_ms)) < 0) {
+        ws->frame_state.bytes_remaining = 0;
+        return rlen;
+    }
+    if (ws->frame_state.bytes_remaining == 0 && ws->frame_state.fin) {
+        *fin = true;
+        ws->message_state.opcode = 0;
+    }
+    return rlen;
+}
+
+int esp_transport_ws_recv_message(esp_transport_handle_t t, char *buffer, int len, ws_transport_opcodes_t *opcode, int timeout_ms)
+{
+    if (t == NULL) {
+        ESP_LOGE(TAG, "Transport must be a valid ws handle");
+        return -1;
+    }
+    transport_ws_t *ws = esp_transport_get_context_data(t);
+    int max_message_len = ws->max_message_len;
+    bool fin = false;
+
+    // The buffer limits the message as the limit set does
+    if (max_message_len == 0 || max_message_len > len) {
+        ws->max_message_len = len;
+    }
+    *opcode = WS_TRANSPORT_OPCODES_CONT;
+    while (!fin) {
+        ws_transport_opcodes_t message_opcode;
+        int received = ws->message_state.opcode ? ws->message_state.received : 0;
+        int rlen = esp_transport_ws_recv(t, buffer + received, len - received, &message_opcode, &fin, timeout_ms);
+        if (rlen < 0) {
+            ws->max_message_len = max_message_len;
+            return rlen;
+        }
+        if (rlen == 0 && !fin) {
+            // The message goes on in the next call, in the same buffer
+            break;
+        }
+        ws->message_state.received = received + rlen;
+        if (fin) {
+            *opcode = message_opcode;
+        }
+    }
+    ws->max_message_len = max_message_len;
+    return fin ? ws->message_state.received : 0;
+}
+
+int esp_transport_ws_send_fragment(esp_transport_handle_t t, ws_transport_opcodes_t opcode, const char *b, int len, bool fin, int timeout_ms)
+{
+    if (t == NULL || (opcode != WS_TRANSPORT_OPCODES_TEXT && opcode != WS_TRANSPORT_OPCODES_BINARY)) {
+        ESP_LOGE(TAG, "Fragments are sent with a text or binary opcode on a valid ws handle");
+        return -1;
+    }
+    transport_ws_t *ws = esp_transport_get_context_data(t);
+    uint8_t op_code = ws->send_continued ? WS_OPCODE_CONT : ws_get_bin_opcode(opcode);
+
+    int ret = _ws_write(t, op_code | (fin ? WS_FIN : 0), WS_MASK, b, len, timeout_ms);
+    if (ret == len) {
+        ws->send_continued = !fin;
+    }
+    return ret;
+}
+
+int esp_transport_ws_send_close(esp_transport_handle_t t, int status_code, int timeout_ms)
+{
+    if (t == NULL) {
+        ESP_LOGE(TAG, "Transport must be a valid ws handle");
+        return -1;
+    }
+    return ws_send_close(t, status_code ? status_code : WS_CLOSE_NORMAL, timeout_ms);
+}
+
+int esp_transport_ws_get_close_code(esp_transport_handle_t t)
+{
+    transport_ws_t *ws = esp_transport_get_context_data(t);
+    return ws->close_code;
+}
+
+esp_err_t esp_transport_ws_set_max_message_len(esp_transport_handle_t t, int max_message_len)
+{
+    if (t == NULL || max_message_len < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    transport_ws_t *ws = esp_transport_get_context_data(t);
+    ws->max_message_len = max_message_len;
+    return ESP_OK;
+}
+
 
 static int ws_poll_read(esp_transport_handle_t t, int timeout_ms)
 {
@@ -0,0 +1,145 @@
+#!/usr/bin/env python
+#
+# Decode the heap trace records printed by heap_trace_dump_records() and
+# aggregate the allocations by caller, to find the top allocators of
+# long-running firmware.
+#
+# Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+from __future__ import print_function
+from __future__ import unicode_literals
+from __future__ import division
+import argparse
+import collections
+import re
+import subprocess
+import sys
+
+DEFAULT_TOOLCHAIN_PREFIX = "xtensa-lx106-elf-"
+
+# "I (1234) heap_trace: A 1200 0x3fff1a2c 64 mqtt_client.c:310"
+RE_RECORD = re.compile(r"heap_trace: ([AF]) (\d+) (0x[0-9a-fA-F]+) (\d+) (\S+)")
+
+TICK_MASK = 0xffffffff
+
+
+class CallerStats(object):
+    def __init__(self, caller):
+        self.caller = caller
+        self.allocs = 0
+        self.frees = 0
+        self.bytes = 0
+        self.max_size = 0
+        self.live_bytes = 0
+        self.live_blocks = 0
+
+
+def parse_records(stream):
+    """ Yield (freed, tick, address, size, caller) for every record line of the log """
+    for line in stream:
+        m = RE_RECORD.search(line)
+        if m:
+            yield (m.group(1) == "F", int(m.group(2)), int(m.group(3), 16), int(m.group(4)), m.group(5))
+
+
+def resolve_callers(callers, elf, toolchain_prefix):
+    """ Translate caller function addresses to "function file:line" with addr2line """
+    addresses = [c for c in callers if re.match(r"^0x[0-9a-fA-F]+$", c)]
+    if not elf or not addresses:
+        return {}
+
+    try:
+        output = subprocess.check_output([toolchain_prefix + "addr2line", "-pfiaC", "-e", elf] + addresses)
+    except (OSError, subprocess.CalledProcessError) as e:
+        print("Warning: failed to run addr2line: %s" % e, file=sys.stderr)
+        return {}
+
+    names = {}
+    for address, line in zip(addresses, output.decode("utf-8", "replace").splitlines()):
+        names[address] = line.split(": ", 1)[-1].replace(" at ", " ")
+    return names
+
+
+def aggregate(records):
+    """ Return (stats by allocating caller, first tick, last tick, number of records) """
+    stats = {}
+    live = {}   # address -> (caller, size) of the allocations seen in the stream
+    first_tick = None
+    last_tick = None
+    num = 0
+
+    for freed, tick, address, size, caller in records:
+        num += 1
+        if first_tick is None:
+            first_tick = tick
+        last_tick = tick
+
+        if not freed:
+            s = stats.setdefault(caller, CallerStats(caller))
+            s.allocs += 1
+            s.bytes += size
+            s.max_size = max(s.max_size, size)
+            s.live_bytes += size
+            s.live_blocks += 1
+            live[address] = (caller, size)
+        elif address in live:
+            # frees are charged to the caller which allocated the memory
+            alloc_caller, alloc_size = live.pop(address)
+            s = stats[alloc_caller]
+            s.frees += 1
+            s.live_bytes -= alloc_size
+            s.live_blocks -= 1
+
+    return stats, first_tick, last_tick, num
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Aggregate heap trace records by caller")
+
+    parser.add_argument("log", help="Log file with the output of heap_trace_dump_records(), '-' for stdin",
+                        type=argparse.FileType("r"))
+    parser.add_argument("--elf", help="ELF file of the application, to resolve caller function addresses")
+    parser.add_argument("--toolchain-prefix", help="Toolchain prefix of addr2line", default=DEFAULT_TOOLCHAIN_PREFIX)
+    parser.add_argument("--tick-rate", help="RTOS tick rate in Hz (CONFIG_FREERTOS_HZ)", type=int, default=100)
+    parser.add_argument("--sort", help="Column to sort by", choices=["bytes", "allocs", "live"], default="bytes")
+    parser.add_argument("--top", help="Number of callers to print, 0 for all", type=int, default=20)
+
+    args = parser.parse_args()
+
+    stats, first_tick, last_tick, num = aggregate(parse_records(args.log))
+    if not num:
+        print("No heap trace records found", file=sys.stderr)
+        return 1
+
+    seconds = max(((last_tick - first_tick) & TICK_MASK) / args.tick_rate, 1.0 / args.tick_rate)
+    names = resolve_callers(stats.keys(), args.elf, args.toolchain_prefix)
+
+    key = {"bytes": lambda s: s.bytes, "allocs": lambda s: s.allocs, "live": lambda s: s.live_bytes}[args.sort]
+    rows = sorted(stats.values(), key=key, reverse=True)
+    if args.top > 0:
+        rows = rows[:args.top]
+
+    print("%d records over %.2f s, %d callers" % (num, seconds, len(stats)))
+    print("%10s %10s %10s %8s %10s %8s %6s  %s" % ("bytes", "bytes/s", "allocs", "allocs/s",
+                                                  "live bytes", "live", "max", "caller"))
+    for s in rows:
+        print("%10d %10.1f %10d %8.1f %10d %8d %6d  %s" % (s.bytes, s.bytes / seconds, s.allocs, s.allocs / seconds,
+                                                         s.live_bytes, s.live_blocks, s.max_size,
+                                                         names.get(s.caller, s.caller)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,226 @@
+#!/usr/bin/env python
+#
+# Decode the log output of an application which uses binary log records
+# (CONFIG_LOG_BINARY). The records hold the addresses of the tag and of the
+# format string, which are looked up in the ELF file of the application,
+# and the raw arguments. Text lines in the output are passed through.
+#
+# Copyright 2019-2020 Espressif Systems (Shanghai) PTE LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+from __future__ import print_function
+from __future__ import unicode_literals
+from __future__ import division
+import argparse
+import io
+import re
+import struct
+import sys
+
+RECORD_MARKER = 0xff
+RECORD_HEADER = struct.Struct("<BIII")  # level, timestamp, tag address, format address
+
+LEVEL_PREFIX = "NEWIDV"
+
+SHF_ALLOC = 0x2
+SHT_NOBITS = 8
+
+# flags, width, precision, length modifier and conversion of a printf format specification
+RE_SPEC = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d*))?(hh|h|ll|l|L|q|j|z|t)?([diouxXcpfFeEgGaAsn%])")
+
+
+class ElfStrings(object):
+    """ Read zero-terminated strings at their addresses from the allocated sections of an ELF file """
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        self.sections = []  # (address, size, file offset)
+
+        if self.data[:4] != b"\x7fELF":
+            raise ValueError("%s is not an ELF file" % path)
+        is64 = self.data[4:5] == b"\x02"
+        endian = "<" if self.data[5:6] == b"\x01" else ">"
+
+        if is64:
+            shoff, = struct.unpack_from(endian + "Q", self.data, 0x28)
+            shentsize, shnum = struct.unpack_from(endian + "HH", self.data, 0x3a)
+            header = struct.Struct(endian + "IIQQQQ")
+        else:
+            shoff, = struct.unpack_from(endian + "I", self.data, 0x20)
+            shentsize, shnum = struct.unpack_from(endian + "HH", self.data, 0x2e)
+            header = struct.Struct(endian + "IIIIII")
+
+        for i in range(shnum):
+            _, sh_type, sh_flags, sh_addr, sh_offset, sh_size = header.unpack_from(self.data, shoff + i * shentsize)
+            if sh_flags & SHF_ALLOC and sh_type != SHT_NOBITS and sh_addr:
+                self.sections.append((sh_addr, sh_size, sh_offset))
+
+    def string(self, address):
+        for sh_addr, sh_size, sh_offset in self.sections:
+            if sh_addr <= address < sh_addr + sh_size:
+                start = sh_offset + address - sh_addr
+                end = self.data.find(b"\0", start, sh_offset + sh_size)
+                if end < 0:
+                    end = sh_offset + sh_size
+                return self.data[start:end].decode("utf-8", "replace")
+        return None
+
+
+class Arguments(object):
+    """ Read the arguments of a record in the order the device wrote them """
+
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def _unpack(self, fmt):
+        value = struct.unpack_from("<" + fmt, self.data, self.pos)[0]
+        self.pos += struct.calcsize(fmt)
+        return value
+
+    def int(self, size, signed):
+        value = self._unpack("Q" if size == 8 else "I")
+        bits = size * 8
+        value &= (1 << bits) - 1
+        if signed and value >> (bits - 1):
+            value -= 1 << bits
+        return value
+
+    def double(self):
+        return self._unpack("d")
+
+    def string(self):
+        length = self._unpack("B")
+        if self.pos + length > len(self.data):
+            raise struct.error("string argument past the end of the record")
+        value = self.data[self.pos:self.pos + length]
+        self.pos += length
+        return value.decode("utf-8", "replace")
+
+
+def format_message(fmt, args):
+    """ Expand the C format string with the arguments of the record """
+    out = []
+    pos = 0
+
+    for m in RE_SPEC.finditer(fmt):
+        out.append(fmt[pos:m.start()])
+        pos = m.end()
+        flags, width, precision, length, conv = m.groups()
+        if conv == "%":
+            out.append("%")
+            continue
+
+        try:
+            if width == "*":
+                width = str(args.int(4, True))
+            if precision == "*":
+                precision = str(args.int(4, True))
+                if precision.startswith("-"):
+                    precision = None
+
+            spec = "%" + flags + (width or "") + ("." + precision if precision is not None else "")
+            if conv in "diouxXc":
+                size = 8 if length in ("ll", "q", "j") else 4
+                value = args.int(size, conv in "di")
+                if length == "hh":
+                    value = struct.unpack("<b" if conv in "di" else "<B", struct.pack("<B", value & 0xff))[0]
+                elif length == "h":
+                    value = struct.unpack("<h" if conv in "di" else "<H", struct.pack("<H", value & 0xffff))[0]
+                if conv == "c":
+                    out.append((spec + "s") % chr(value & 0xff))
+                elif conv == "o" and "#" in flags:
+                    # Python writes the alternate form of octal numbers as 0o10, C as 010
+                    text = (spec + "o") % value
+                    text = text.replace("0o", "0", 1) if value else text.replace("0o", "", 1)
+                    width = int(width or 0)
+                    out.append(text.ljust(width) if "-" in flags else text.rjust(width))
+                else:
+                    out.append((spec + {"i": "d", "u": "d"}.get(conv, conv)) % value)
+            elif conv == "p":
+                out.append("0x%x" % args.int(4, False))
+            elif conv in "fFeEgG":
+                out.append((spec + conv) % args.double())
+            elif conv in "aA":
+                out.append(float.hex(args.double()))
+            elif conv == "s":
+                out.append((spec + "s") % args.string())
+        except struct.error:
+            # the device left out the arguments which did not fit into the record
+            out.append(fmt[m.start():])
+            return "".join(out) + " <truncated>"
+
+    out.append(fmt[pos:])
+    return "".join(out)
+
+
+def decode_record(record, strings):
+    level, timestamp, tag_address, fmt_address = RECORD_HEADER.unpack_from(record)
+    tag = strings.string(tag_address) if strings else None
+    fmt = strings.string(fmt_address) if strings else None
+    prefix = LEVEL_PREFIX[level] if level < len(LEVEL_PREFIX) else "N"
+    args = record[RECORD_HEADER.size:]
+
+    if tag is None:
+        tag = "0x%08x" % tag_address
+    if fmt is None:
+        message = "0x%08x <format not found> %s" % (fmt_address, " ".join("%02x" % b for b in bytearray(args)))
+    else:
+        message = format_message(fmt, Arguments(args))
+
+    return "%s (%d) %s: %s" % (prefix, timestamp, tag, message)
+
+
+def decode(stream, strings, output):
+    """ Write the text lines of the stream and the decoded binary records to output """
+    while True:
+        first = stream.read(1)
+        if not first:
+            break
+
+        if bytearray(first)[0] == RECORD_MARKER:
+            length = stream.read(1)
+            if not length:
+                break
+            record = stream.read(bytearray(length)[0])
+            if len(record) < RECORD_HEADER.size:
+                break
+            output.write(decode_record(record, strings) + "\n")
+        else:
+            line = first + stream.readline()
+            output.write(line.decode("utf-8", "replace"))
+        output.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode binary log records into text")
+
+    parser.add_argument("log", help="Log output of the application, '-' for stdin", type=argparse.FileType("rb"))
+    parser.add_argument("--elf", help="ELF file of the application, to look up tags and format strings",
+                        required=True)
+
+    args = parser.parse_args()
+
+    stream = args.log
+    if stream is sys.stdin and hasattr(sys.stdin, "buffer"):
+        stream = sys.stdin.buffer
+    output = io.open(sys.stdout.fileno(), "w", encoding="utf-8", closefd=False)
+
+    decode(stream, ElfStrings(args.elf), output)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())